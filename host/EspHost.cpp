@@ -0,0 +1,173 @@
+/*
+ * File: EspHost.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: esp_err, esp_log, esp_heap_caps, esp_random and esp_system (host/include).
+*/
+
+// C++
+#include <atomic>
+#include <mutex>
+
+// C
+extern "C" {
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_system.h"
+}
+
+#if defined(__SANITIZE_ADDRESS__)
+extern "C" size_t __sanitizer_get_heap_size(void);              // sanitizer/allocator_interface.h
+extern "C" size_t __sanitizer_get_current_allocated_bytes(void);
+#endif
+
+// Errors -------------------------------------------------------------------------------------------------------
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_NVS_NOT_INITIALIZED: return "ESP_ERR_NVS_NOT_INITIALIZED";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_TYPE_MISMATCH: return "ESP_ERR_NVS_TYPE_MISMATCH";
+        case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+        case ESP_ERR_NVS_KEY_TOO_LONG: return "ESP_ERR_NVS_KEY_TOO_LONG";
+        case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+        case ESP_ERR_NVS_NO_FREE_PAGES: return "ESP_ERR_NVS_NO_FREE_PAGES";
+        case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+        case ESP_ERR_WIFI_NOT_INIT: return "ESP_ERR_WIFI_NOT_INIT";
+        case ESP_ERR_WIFI_NOT_STARTED: return "ESP_ERR_WIFI_NOT_STARTED";
+        case ESP_ERR_WIFI_NOT_CONNECT: return "ESP_ERR_WIFI_NOT_CONNECT";
+        case ESP_ERR_HTTPD_HANDLERS_FULL: return "ESP_ERR_HTTPD_HANDLERS_FULL";
+        case ESP_ERR_HTTPD_HANDLER_EXISTS: return "ESP_ERR_HTTPD_HANDLER_EXISTS";
+        case ESP_ERR_HTTPD_INVALID_REQ: return "ESP_ERR_HTTPD_INVALID_REQ";
+        case ESP_ERR_HTTPD_RESULT_TRUNC: return "ESP_ERR_HTTPD_RESULT_TRUNC";
+        case ESP_ERR_HTTPD_RESP_SEND: return "ESP_ERR_HTTPD_RESP_SEND";
+        case ESP_ERR_HTTPD_ALLOC_MEM: return "ESP_ERR_HTTPD_ALLOC_MEM";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+// Log ----------------------------------------------------------------------------------------------------------
+static std::atomic<int> logLevel(ESP_LOG_INFO);
+static std::mutex logMutex; // One line at a time from the tasks (threads)
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+    (void)tag;
+    logLevel = level;
+}
+
+uint32_t esp_log_timestamp(void) {
+    static timespec start = [] { timespec now; clock_gettime(CLOCK_MONOTONIC, &now); return now; }();
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint32_t((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    if (level > logLevel.load(std::memory_order_relaxed) || level == ESP_LOG_NONE) { return; }
+    static const char LEVEL_LETTERS[] = "NEWIDV";
+    std::lock_guard<std::mutex> lock(logMutex);
+    printf("%c (%lu) %s: ", LEVEL_LETTERS[level], (unsigned long)esp_log_timestamp(), tag);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    putchar('\n');
+    fflush(stdout);
+}
+
+// Heap ---------------------------------------------------------------------------------------------------------
+static std::atomic<size_t> minimumFreeSize(SIZE_MAX);
+
+static size_t getFreeSize() {
+#if defined(__SANITIZE_ADDRESS__)
+    // The sanitizer allocator does not fill mallinfo2
+    size_t freeSize = __sanitizer_get_heap_size() - __sanitizer_get_current_allocated_bytes();
+#else
+    struct mallinfo2 info = mallinfo2();
+    size_t freeSize = info.fordblks;
+#endif
+    size_t minimum = minimumFreeSize.load(std::memory_order_relaxed);
+    while (freeSize < minimum && !minimumFreeSize.compare_exchange_weak(minimum, freeSize)) {}
+    return freeSize;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    (void)caps;
+    return malloc(size);
+}
+
+void* heap_caps_calloc(size_t count, size_t size, uint32_t caps) {
+    (void)caps;
+    return calloc(count, size);
+}
+
+void* heap_caps_realloc(void* pointer, size_t size, uint32_t caps) {
+    (void)caps;
+    return realloc(pointer, size);
+}
+
+void heap_caps_free(void* pointer) {
+    free(pointer);
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+    (void)caps;
+#if defined(__SANITIZE_ADDRESS__)
+    return __sanitizer_get_heap_size();
+#else
+    struct mallinfo2 info = mallinfo2();
+    return info.arena + info.hblkhd;
+#endif
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    (void)caps;
+    return getFreeSize();
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    (void)caps;
+    getFreeSize();
+    return minimumFreeSize.load(std::memory_order_relaxed);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    (void)caps;
+    return getFreeSize();
+}
+
+// System -------------------------------------------------------------------------------------------------------
+void esp_restart(void) {
+    fflush(stdout);
+    exit(0);
+}
+
+uint32_t esp_random(void) {
+    return (uint32_t(random()) << 16) ^ uint32_t(random());
+}
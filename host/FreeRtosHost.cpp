@@ -0,0 +1,332 @@
+/*
+ * File: FreeRtosHost.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: FreeRTOS tasks, notifications and semaphores on POSIX threads (host/include/freertos).
+
+    Every task is a thread, the tasks are never freed (a deleted task stays in the list with eDeleted), so a handle
+    is always valid. A task deleted by another task is stopped at its next blocking call: the blocking calls wait in
+    short slices and check the delete flag, then the thread unwinds with HostTaskExit (like vTaskDelete(NULL)).
+*/
+
+// C++
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// C
+extern "C" {
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+}
+
+#define HOST_WAIT_SLICE_MS      10  // The longest time a deleted task keeps blocking
+#define HOST_MAIN_STACK_DEPTH   3584    // CONFIG_ESP_MAIN_TASK_STACK_SIZE of the target
+
+// Tasks --------------------------------------------------------------------------------------------------------
+namespace {
+    struct HostTask {
+        std::string name;
+        UBaseType_t number;
+        UBaseType_t priority;
+        uint32_t stackDepth;
+        BaseType_t coreId;
+        TaskFunction_t function;
+        void* parameters;
+        std::thread thread;
+        pthread_t nativeThread;
+        std::atomic<bool> isDeleteRequested{false};
+        std::atomic<bool> isFinished{false};
+        std::mutex mutex;
+        std::condition_variable condition;
+        uint32_t notifyCount = 0;
+    };
+
+    struct HostTaskExit {}; // Thrown by vTaskDelete(NULL) and by the blocking calls of a deleted task
+
+    std::mutex tasksMutex;
+    std::vector<std::unique_ptr<HostTask>> tasks;
+    UBaseType_t nextTaskNumber = 1;
+    thread_local HostTask* currentTask = nullptr;
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    HostTask* getCurrentTask() {
+        if (!currentTask) { // A thread that was not created by xTaskCreate (main, or a test thread)
+            auto task = std::make_unique<HostTask>();
+            task->name = "main";
+            task->priority = 1;
+            task->stackDepth = HOST_MAIN_STACK_DEPTH;
+            task->coreId = 0;
+            task->function = nullptr;
+            task->parameters = nullptr;
+            task->nativeThread = pthread_self();
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            task->number = nextTaskNumber++;
+            currentTask = task.get();
+            tasks.push_back(std::move(task));
+        }
+        return currentTask;
+    }
+
+    void exitIfDeleted() {
+        if (currentTask && currentTask->function && currentTask->isDeleteRequested.load()) { throw HostTaskExit(); }
+    }
+
+    /*
+        Waits until the predicate is true or the timeout is over, in slices, so a deleted task does not block forever.
+    */
+    template <typename Predicate>
+    bool waitFor(std::unique_lock<std::mutex>& lock, std::condition_variable& condition, TickType_t ticks, Predicate predicate) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks);
+        while (!predicate()) {
+            if (ticks != portMAX_DELAY && std::chrono::steady_clock::now() >= deadline) { return false; }
+            auto sliceEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(HOST_WAIT_SLICE_MS);
+            if (ticks != portMAX_DELAY && sliceEnd > deadline) { sliceEnd = deadline; }
+            condition.wait_until(lock, sliceEnd);
+            if (currentTask && currentTask->function && currentTask->isDeleteRequested.load()) {
+                lock.unlock();
+                throw HostTaskExit();
+            }
+        }
+        return true;
+    }
+
+    void runTask(HostTask* task) {
+        currentTask = task;
+        task->nativeThread = pthread_self();
+        pthread_setname_np(pthread_self(), task->name.substr(0, 15).c_str());
+        try {
+            task->function(task->parameters);
+        } catch (const HostTaskExit&) {}
+        task->isFinished = true;
+    }
+
+    /*
+        Joins the threads of the tasks at exit, a task that is still running is stopped like vTaskDelete().
+    */
+    struct HostTaskCleanup {
+        ~HostTaskCleanup() {
+            std::vector<HostTask*> runningTasks;
+            {
+                std::lock_guard<std::mutex> lock(tasksMutex);
+                for (auto& task : tasks) { runningTasks.push_back(task.get()); }
+            }
+            for (HostTask* task : runningTasks) {
+                if (task->thread.joinable()) { vTaskDelete(task); }
+            }
+        }
+    } hostTaskCleanup;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char* pcName, uint32_t usStackDepth, void* pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t* pxCreatedTask, BaseType_t xCoreID) {
+    auto task = std::make_unique<HostTask>();
+    task->name = pcName ? std::string(pcName).substr(0, configMAX_TASK_NAME_LEN - 1) : "";
+    task->priority = uxPriority;
+    task->stackDepth = usStackDepth;
+    task->coreId = xCoreID;
+    task->function = pxTaskCode;
+    task->parameters = pvParameters;
+    HostTask* handle = task.get();
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        task->number = nextTaskNumber++;
+        tasks.push_back(std::move(task));
+    }
+    if (pxCreatedTask) { *pxCreatedTask = handle; } // Before the task runs, like on the target
+    handle->thread = std::thread(runTask, handle);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char* pcName, uint32_t usStackDepth, void* pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t* pxCreatedTask) {
+    return xTaskCreatePinnedToCore(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete) {
+    HostTask* task = xTaskToDelete ? static_cast<HostTask*>(xTaskToDelete) : getCurrentTask();
+    if (task == currentTask) {
+        if (task->function) { throw HostTaskExit(); }
+        return; // The main thread cannot be deleted
+    }
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->isDeleteRequested = true;
+    }
+    task->condition.notify_all();
+    if (task->thread.joinable()) { task->thread.join(); }
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+    HostTask* task = getCurrentTask();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    waitFor(lock, task->condition, xTicksToDelay, [] { return false; });
+    exitIfDeleted();
+}
+
+TickType_t xTaskGetTickCount(void) {
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return TickType_t(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() * configTICK_RATE_HZ / 1000);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t* pxPreviousWakeTime, TickType_t xTimeIncrement) {
+    TickType_t wakeTime = *pxPreviousWakeTime + xTimeIncrement;
+    TickType_t now = xTaskGetTickCount();
+    *pxPreviousWakeTime = wakeTime;
+    if (TickType_t(wakeTime - now) > 0 && TickType_t(wakeTime - now) < 0x80000000UL) {
+        vTaskDelay(wakeTime - now);
+        return pdTRUE;
+    }
+    exitIfDeleted();
+    return pdFALSE;
+}
+
+void vTaskDelayUntil(TickType_t* pxPreviousWakeTime, TickType_t xTimeIncrement) {
+    xTaskDelayUntil(pxPreviousWakeTime, xTimeIncrement);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return getCurrentTask();
+}
+
+const char* pcTaskGetName(TaskHandle_t xTaskToQuery) {
+    HostTask* task = xTaskToQuery ? static_cast<HostTask*>(xTaskToQuery) : getCurrentTask();
+    return task->name.c_str();
+}
+
+BaseType_t xPortGetCoreID(void) {
+    HostTask* task = currentTask;
+    if (!task || task->coreId < 0 || task->coreId >= portNUM_PROCESSORS) { return 0; }
+    return task->coreId;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask) {
+    HostTask* task = xTask ? static_cast<HostTask*>(xTask) : getCurrentTask();
+    return task->stackDepth;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void) {
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    UBaseType_t count = 0;
+    for (auto& task : tasks) {
+        if (!task->isFinished) { count++; }
+    }
+    return count;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* pxTaskStatusArray, UBaseType_t uxArraySize, configRUN_TIME_COUNTER_TYPE* pulTotalRunTime) {
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    UBaseType_t count = 0;
+    for (auto& task : tasks) {
+        if (task->isFinished) { continue; }
+        if (count >= uxArraySize) { return 0; } // Like FreeRTOS: the array has to be large enough for every task
+        TaskStatus_t& status = pxTaskStatusArray[count++];
+        memset(&status, 0, sizeof(status));
+        status.xHandle = task.get();
+        status.pcTaskName = task->name.c_str();
+        status.xTaskNumber = task->number;
+        status.eCurrentState = task.get() == currentTask ? eRunning : eBlocked;
+        status.uxCurrentPriority = task->priority;
+        status.uxBasePriority = task->priority;
+        status.usStackHighWaterMark = task->stackDepth;
+        status.xCoreID = task->coreId;
+        clockid_t clock;
+        timespec cpuTime;
+        if (pthread_getcpuclockid(task->nativeThread, &clock) == 0 && clock_gettime(clock, &cpuTime) == 0) {
+            status.ulRunTimeCounter = configRUN_TIME_COUNTER_TYPE(cpuTime.tv_sec * 1000000LL + cpuTime.tv_nsec / 1000);
+        }
+    }
+    if (pulTotalRunTime) {
+        auto elapsed = std::chrono::steady_clock::now() - startTime;
+        *pulTotalRunTime = configRUN_TIME_COUNTER_TYPE(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+    return count;
+}
+
+// Notifications ------------------------------------------------------------------------------------------------
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+    HostTask* task = getCurrentTask();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    waitFor(lock, task->condition, xTicksToWait, [task] { return task->notifyCount > 0; });
+    uint32_t count = task->notifyCount;
+    if (count > 0) { task->notifyCount = xClearCountOnExit ? 0 : count - 1; }
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+    HostTask* task = static_cast<HostTask*>(xTaskToNotify);
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifyCount++;
+    }
+    task->condition.notify_all();
+    return pdPASS;
+}
+
+// Semaphores ---------------------------------------------------------------------------------------------------
+namespace {
+    struct HostSemaphore {
+        std::mutex mutex;
+        std::condition_variable condition;
+        UBaseType_t count;
+        UBaseType_t maxCount;
+    };
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount) {
+    HostSemaphore* semaphore = new HostSemaphore();
+    semaphore->count = uxInitialCount;
+    semaphore->maxCount = uxMaxCount;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime) {
+    HostSemaphore* semaphore = static_cast<HostSemaphore*>(xSemaphore);
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    if (!waitFor(lock, semaphore->condition, xBlockTime, [semaphore] { return semaphore->count > 0; })) { return pdFALSE; }
+    semaphore->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore) {
+    HostSemaphore* semaphore = static_cast<HostSemaphore*>(xSemaphore);
+    {
+        std::lock_guard<std::mutex> lock(semaphore->mutex);
+        if (semaphore->count >= semaphore->maxCount) { return pdFALSE; }
+        semaphore->count++;
+    }
+    semaphore->condition.notify_one();
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore) {
+    delete static_cast<HostSemaphore*>(xSemaphore);
+}
@@ -0,0 +1,884 @@
+/*
+ * File: HalHost.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "HalHost.h"
+
+// C++
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <variant>
+
+// C
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+}
+
+#define HAL_HOST_NVS_KEY_MAX_LENGTH     15  // NVS_KEY_NAME_MAX_SIZE - 1
+#define HAL_HOST_NVS_MAX_HANDLES        8
+
+/*
+    Every fake is guarded by one mutex: the managers call the HAL from their tasks (threads) and the tests read it.
+    The Wi-Fi event callback is called without the mutex, it calls the HAL again.
+*/
+static std::mutex halMutex;
+
+// Timer --------------------------------------------------------------------------------------------------------
+static const auto startTime = std::chrono::steady_clock::now();
+
+int64_t Hal::Timer::getTimeUs() {
+    return HAL_HOST_BOOT_TIME_US + std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+
+// PWM (LEDC) ---------------------------------------------------------------------------------------------------
+static struct {
+    uint32_t duties[HAL_HOST_PWM_CHANNELS];
+    int8_t gpios[HAL_HOST_PWM_CHANNELS];
+    uint8_t channelTimers[HAL_HOST_PWM_CHANNELS];
+    bool isTimerConfigured[HAL_HOST_PWM_TIMERS];
+    uint8_t timerResolutionBits[HAL_HOST_PWM_TIMERS];
+    bool isTimerPaused[HAL_HOST_PWM_TIMERS];
+} pwm;
+
+static void resetPwm() {
+    memset(&pwm, 0, sizeof(pwm));
+    for (uint8_t channel = 0; channel < HAL_HOST_PWM_CHANNELS; channel++) { pwm.gpios[channel] = HAL_GPIO_NC; }
+}
+
+esp_err_t Hal::Pwm::configTimer(uint8_t timer, uint8_t dutyResolutionBits, uint32_t frequencyHz) {
+    if (timer >= HAL_HOST_PWM_TIMERS || dutyResolutionBits == 0 || dutyResolutionBits > 20 || frequencyHz == 0) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(halMutex);
+    pwm.isTimerConfigured[timer] = true;
+    pwm.timerResolutionBits[timer] = dutyResolutionBits;
+    pwm.isTimerPaused[timer] = false;
+    return ESP_OK;
+}
+
+esp_err_t Hal::Pwm::configChannel(uint8_t channel, int8_t gpio, uint8_t timer) {
+    if (channel >= HAL_HOST_PWM_CHANNELS || timer >= HAL_HOST_PWM_TIMERS || gpio < 0) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (!pwm.isTimerConfigured[timer]) { return ESP_ERR_INVALID_STATE; }
+    pwm.gpios[channel] = gpio;
+    pwm.channelTimers[channel] = timer;
+    pwm.duties[channel] = 0;
+    return ESP_OK;
+}
+
+esp_err_t Hal::Pwm::setDuty(uint8_t channel, uint32_t duty) {
+    if (channel >= HAL_HOST_PWM_CHANNELS) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (pwm.gpios[channel] == HAL_GPIO_NC) { return ESP_ERR_INVALID_STATE; }
+    if (duty > (1UL << pwm.timerResolutionBits[pwm.channelTimers[channel]])) { return ESP_ERR_INVALID_ARG; }
+    pwm.duties[channel] = duty;
+    return ESP_OK;
+}
+
+uint32_t Hal::Pwm::getDuty(uint8_t channel) {
+    return HalHost::getPwmDuty(channel);
+}
+
+esp_err_t Hal::Pwm::stop(uint8_t channel) {
+    if (channel >= HAL_HOST_PWM_CHANNELS) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(halMutex);
+    pwm.duties[channel] = 0;
+    return ESP_OK;
+}
+
+esp_err_t Hal::Pwm::pauseTimer(uint8_t timer) {
+    if (timer >= HAL_HOST_PWM_TIMERS) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(halMutex);
+    pwm.isTimerPaused[timer] = true;
+    return ESP_OK;
+}
+
+esp_err_t Hal::Pwm::resumeTimer(uint8_t timer) {
+    if (timer >= HAL_HOST_PWM_TIMERS) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(halMutex);
+    pwm.isTimerPaused[timer] = false;
+    return ESP_OK;
+}
+
+uint32_t HalHost::getPwmDuty(uint8_t channel) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return channel < HAL_HOST_PWM_CHANNELS ? pwm.duties[channel] : 0;
+}
+
+int8_t HalHost::getPwmGpio(uint8_t channel) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return channel < HAL_HOST_PWM_CHANNELS ? pwm.gpios[channel] : HAL_GPIO_NC;
+}
+
+bool HalHost::isPwmTimerPaused(uint8_t timer) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return timer < HAL_HOST_PWM_TIMERS && pwm.isTimerPaused[timer];
+}
+
+
+// LED Strip (RMT) ----------------------------------------------------------------------------------------------
+static struct {
+    bool isInitialized;
+    bool isEnabled;
+    std::vector<uint8_t> pixels;
+    std::vector<HalHostRmtSymbol> symbols;
+    uint32_t transmitCount;
+} ledStrip;
+
+static void resetLedStrip() {
+    ledStrip.isInitialized = false;
+    ledStrip.isEnabled = false;
+    ledStrip.pixels.clear();
+    ledStrip.symbols.clear();
+    ledStrip.transmitCount = 0;
+}
+
+/*
+    The symbols of the WS2812 encoder of HalEspIdf.cpp (rmtEncodeLedArray): the bytes encoder (MSB first,
+    0: 0.3 us high + 0.9 us low, 1: 0.9 us high + 0.3 us low) and the copy encoder of the 50 us reset code.
+*/
+static void encodeLedSymbols(const uint8_t* pixels, size_t length, std::vector<HalHostRmtSymbol>& symbols) {
+    static const HalHostRmtSymbol BIT_0 = { HAL_HOST_RMT_SHORT_TICKS, 1, HAL_HOST_RMT_LONG_TICKS, 0 };
+    static const HalHostRmtSymbol BIT_1 = { HAL_HOST_RMT_LONG_TICKS, 1, HAL_HOST_RMT_SHORT_TICKS, 0 };
+    static const HalHostRmtSymbol RESET = { HAL_HOST_RMT_RESET_TICKS, 0, HAL_HOST_RMT_RESET_TICKS, 0 };
+    symbols.resize(length * 8 + 1);
+    HalHostRmtSymbol* symbol = symbols.data();
+    for (size_t i = 0; i < length; i++) {
+        for (uint8_t mask = 0x80; mask; mask >>= 1) { *symbol++ = (pixels[i] & mask) ? BIT_1 : BIT_0; }
+    }
+    *symbol = RESET;
+}
+
+esp_err_t Hal::LedStrip::init(int8_t gpio) {
+    if (gpio < 0) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (ledStrip.isInitialized) { return ESP_ERR_INVALID_STATE; }
+    ledStrip.isInitialized = true;
+    ledStrip.isEnabled = true;
+    return ESP_OK;
+}
+
+esp_err_t Hal::LedStrip::setEnabled(bool isEnabled) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (!ledStrip.isInitialized) { return ESP_ERR_INVALID_STATE; }
+    ledStrip.isEnabled = isEnabled;
+    return ESP_OK;
+}
+
+esp_err_t Hal::LedStrip::transmit(const uint8_t* pixels, size_t length) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (!ledStrip.isInitialized || !ledStrip.isEnabled) { return ESP_ERR_INVALID_STATE; }
+    ledStrip.pixels.assign(pixels, pixels + length);
+    encodeLedSymbols(pixels, length, ledStrip.symbols);
+    ledStrip.transmitCount++;
+    return ESP_OK;
+}
+
+void Hal::LedStrip::deinit() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    ledStrip.isInitialized = false;
+    ledStrip.isEnabled = false;
+}
+
+bool HalHost::isLedStripInitialized() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return ledStrip.isInitialized;
+}
+
+bool HalHost::isLedStripEnabled() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return ledStrip.isEnabled;
+}
+
+std::vector<uint8_t> HalHost::getLedPixels() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return ledStrip.pixels;
+}
+
+std::vector<HalHostRmtSymbol> HalHost::getLedSymbols() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return ledStrip.symbols;
+}
+
+uint32_t HalHost::getLedTransmitCount() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return ledStrip.transmitCount;
+}
+
+
+// Storage (NVS) ------------------------------------------------------------------------------------------------
+/*
+    The keys are kept per namespace for the whole process (like the flash), a handle is the index of its namespace + 1.
+*/
+typedef std::variant<int8_t, std::string> StorageValue;
+
+static struct {
+    bool isInitialized;
+    esp_err_t nextInitError;
+    uint32_t commitCount;
+    std::map<std::string, std::map<std::string, StorageValue>> namespaces;
+    std::string openNamespaces[HAL_HOST_NVS_MAX_HANDLES];
+} storage;
+
+static void resetStorage() {
+    storage.isInitialized = false;
+    storage.nextInitError = ESP_OK;
+    storage.commitCount = 0;
+    storage.namespaces.clear();
+    for (std::string& name : storage.openNamespaces) { name.clear(); }
+}
+
+static std::map<std::string, StorageValue>* getStorageNamespace(HalStorageHandle handle) {
+    if (handle == 0 || handle > HAL_HOST_NVS_MAX_HANDLES || storage.openNamespaces[handle - 1].empty()) { return nullptr; }
+    return &storage.namespaces[storage.openNamespaces[handle - 1]];
+}
+
+static bool isStorageKeyValid(const char* key) {
+    return key && key[0] && strlen(key) <= HAL_HOST_NVS_KEY_MAX_LENGTH;
+}
+
+esp_err_t Hal::Storage::init() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (storage.nextInitError != ESP_OK) {
+        esp_err_t error = storage.nextInitError;
+        storage.nextInitError = ESP_OK;
+        return error;
+    }
+    storage.isInitialized = true;
+    return ESP_OK;
+}
+
+esp_err_t Hal::Storage::erase() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    storage.namespaces.clear();
+    storage.isInitialized = false;
+    return ESP_OK;
+}
+
+esp_err_t Hal::Storage::open(const char* name, HalStorageHandle* handle) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (!storage.isInitialized) { return ESP_ERR_NVS_NOT_INITIALIZED; }
+    if (!isStorageKeyValid(name)) { return ESP_ERR_NVS_KEY_TOO_LONG; }
+    for (HalStorageHandle i = 0; i < HAL_HOST_NVS_MAX_HANDLES; i++) {
+        if (storage.openNamespaces[i].empty()) {
+            storage.openNamespaces[i] = name;
+            *handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t Hal::Storage::getString(HalStorageHandle handle, const char* key, char* value, size_t size) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    std::map<std::string, StorageValue>* keys = getStorageNamespace(handle);
+    if (!keys) { return ESP_ERR_NVS_INVALID_HANDLE; }
+    if (!isStorageKeyValid(key)) { return ESP_ERR_NVS_KEY_TOO_LONG; }
+    auto entry = keys->find(key);
+    if (entry == keys->end()) { return ESP_ERR_NVS_NOT_FOUND; }
+    const std::string* stored = std::get_if<std::string>(&entry->second);
+    if (!stored) { return ESP_ERR_NVS_TYPE_MISMATCH; }
+    if (stored->size() + 1 > size) { return ESP_ERR_NVS_INVALID_LENGTH; }
+    memcpy(value, stored->c_str(), stored->size() + 1);
+    return ESP_OK;
+}
+
+esp_err_t Hal::Storage::setString(HalStorageHandle handle, const char* key, const char* value) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    std::map<std::string, StorageValue>* keys = getStorageNamespace(handle);
+    if (!keys) { return ESP_ERR_NVS_INVALID_HANDLE; }
+    if (!isStorageKeyValid(key)) { return ESP_ERR_NVS_KEY_TOO_LONG; }
+    (*keys)[key] = std::string(value);
+    return ESP_OK;
+}
+
+esp_err_t Hal::Storage::getI8(HalStorageHandle handle, const char* key, int8_t* value) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    std::map<std::string, StorageValue>* keys = getStorageNamespace(handle);
+    if (!keys) { return ESP_ERR_NVS_INVALID_HANDLE; }
+    if (!isStorageKeyValid(key)) { return ESP_ERR_NVS_KEY_TOO_LONG; }
+    auto entry = keys->find(key);
+    if (entry == keys->end()) { return ESP_ERR_NVS_NOT_FOUND; }
+    const int8_t* stored = std::get_if<int8_t>(&entry->second);
+    if (!stored) { return ESP_ERR_NVS_TYPE_MISMATCH; }
+    *value = *stored;
+    return ESP_OK;
+}
+
+esp_err_t Hal::Storage::setI8(HalStorageHandle handle, const char* key, int8_t value) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    std::map<std::string, StorageValue>* keys = getStorageNamespace(handle);
+    if (!keys) { return ESP_ERR_NVS_INVALID_HANDLE; }
+    if (!isStorageKeyValid(key)) { return ESP_ERR_NVS_KEY_TOO_LONG; }
+    (*keys)[key] = value;
+    return ESP_OK;
+}
+
+esp_err_t Hal::Storage::commit(HalStorageHandle handle) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (!getStorageNamespace(handle)) { return ESP_ERR_NVS_INVALID_HANDLE; }
+    storage.commitCount++;
+    return ESP_OK;
+}
+
+void Hal::Storage::close(HalStorageHandle handle) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (handle == 0 || handle > HAL_HOST_NVS_MAX_HANDLES) { return; }
+    storage.openNamespaces[handle - 1].clear();
+}
+
+void HalHost::failNextStorageInit(esp_err_t error) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    storage.nextInitError = error;
+}
+
+uint32_t HalHost::getStorageCommitCount() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return storage.commitCount;
+}
+
+bool HalHost::hasStorageKey(const char* name, const char* key) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    auto keys = storage.namespaces.find(name);
+    return keys != storage.namespaces.end() && keys->second.count(key) > 0;
+}
+
+
+// Camera -------------------------------------------------------------------------------------------------------
+static struct {
+    bool isInitialized;
+    bool isPoweredDown;
+    bool isFailing;
+    HalCameraConfig config;
+    HalPixelFormat format;
+    uint16_t width;
+    uint16_t height;
+    size_t length;
+    uint32_t captureTimeUs;
+    uint32_t framePeriodUs;         // 0: the frames are stamped with the host clock
+    uint32_t framesInUse;
+    uint32_t frameCount;
+    uint32_t framesUntilFailure;    // 0: no limit
+    uint32_t jpegFailures;          // The next convertToJpeg() calls that fail
+    uint32_t qualityWriteFailures;  // The next setJpegQuality() writes that fail
+    uint32_t jpegDecodes;
+    uint32_t initCount;
+    HalHostCameraSensor sensor;
+    uint32_t switchDelayFrames;     // Frames of the old size after a frame size write
+    uint32_t framesUntilSwitch;     // Of the pending size below, 0: none
+    uint16_t pendingWidth;
+    uint16_t pendingHeight;
+} camera;
+
+static std::vector<uint8_t> cameraThumbnail;   // Every decoded JPEG (empty: flat gray)
+
+static void resetCamera() {
+    memset(&camera, 0, sizeof(camera));
+    cameraThumbnail.clear();
+    camera.format = HAL_PIXFORMAT_JPEG;
+    camera.width = 640;
+    camera.height = 480;
+    camera.length = 16 * 1024;
+}
+
+/*
+    The headers of a baseline YUV 4:2:2 JPEG (the layout of the sensors), for the parsers of the frames (RTP/JPEG):
+    SOI, the quantization tables (DQT), the frame header (SOF0, the size at JPEG_SIZE_OFFSET) and the scan header (SOS).
+*/
+#define JPEG_SIZE_OFFSET    141
+static constexpr uint8_t JPEG_HEADERS[] = {
+    0xFF, 0xD8,
+    0xFF, 0xDB, 0x00, 0x84,
+    0x00, 16, 11, 12, 14, 12, 10, 16, 14, 13, 14, 18, 17, 16, 19, 24, 40, 26, 24, 22, 22, 24, 49, 35, 37, 29, 40, 58,
+    51, 61, 60, 57, 51, 56, 55, 64, 72, 92, 78, 64, 68, 87, 69, 55, 56, 80, 109, 81, 87, 95, 98, 103, 104, 103, 62,
+    77, 113, 121, 112, 100, 120, 92, 101, 103, 99,
+    0x01, 17, 18, 18, 24, 21, 24, 47, 26, 26, 47, 99, 66, 56, 66, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99,
+    0xFF, 0xC0, 0x00, 0x11, 0x08, 0x00, 0x00, 0x00, 0x00, 0x03, 0x01, 0x21, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01,
+    0xFF, 0xDA, 0x00, 0x0C, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3F, 0x00,
+};
+static_assert(sizeof(JPEG_HEADERS) == 169 && JPEG_HEADERS[JPEG_SIZE_OFFSET - 4] == 0xC0, "Two tables of 64, the size after SOF0");
+
+/*
+    A frame of the set format: JPEG frames have the headers (if the frame is long enough) and the EOI marker, the
+    other bytes count up from the frame number.
+*/
+static uint8_t* createFrameData(HalPixelFormat format, size_t length, uint32_t frameNumber, uint16_t width, uint16_t height) {
+    uint8_t* data = static_cast<uint8_t*>(malloc(length));
+    if (!data) { return nullptr; }
+    for (size_t i = 0; i < length; i++) { data[i] = uint8_t(frameNumber + i); }
+    if (format == HAL_PIXFORMAT_JPEG && length >= sizeof(JPEG_HEADERS) + 4) {
+        memcpy(data, JPEG_HEADERS, sizeof(JPEG_HEADERS));
+        data[JPEG_SIZE_OFFSET] = uint8_t(height >> 8);
+        data[JPEG_SIZE_OFFSET + 1] = uint8_t(height);
+        data[JPEG_SIZE_OFFSET + 2] = uint8_t(width >> 8);
+        data[JPEG_SIZE_OFFSET + 3] = uint8_t(width);
+    }
+    if (format == HAL_PIXFORMAT_JPEG && length >= 4) {
+        data[0] = 0xFF;
+        data[1] = 0xD8;
+        data[length - 2] = 0xFF;
+        data[length - 1] = 0xD9;
+    }
+    return data;
+}
+
+esp_err_t Hal::Camera::init(const HalCameraConfig& config) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (camera.isInitialized) { return ESP_ERR_INVALID_STATE; }
+    if (config.frameBufferCount == 0 || config.jpegQuality > 63) { return ESP_ERR_INVALID_ARG; }
+    camera.isInitialized = true;
+    camera.isPoweredDown = false;
+    camera.config = config;
+    camera.format = config.pixelFormat;
+    camera.framesInUse = 0;
+    camera.initCount++;
+    // The driver resets the sensor and programs the configured frame size and quality
+    camera.sensor = { config.frameSize, config.jpegQuality, true, 0, true, 0, {}, 0 };
+    camera.framesUntilSwitch = 0;
+    Hal::Camera::getResolution(config.frameSize, &camera.width, &camera.height);
+    return ESP_OK;
+}
+
+esp_err_t Hal::Camera::deinit() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (!camera.isInitialized) { return ESP_ERR_INVALID_STATE; }
+    camera.isInitialized = false;
+    return ESP_OK;
+}
+
+bool Hal::Camera::getFrame(HalCameraFrame& frame) {
+    uint32_t captureTimeUs;
+    {
+        std::lock_guard<std::mutex> lock(halMutex);
+        // A powered down sensor sends no frames, the driver times out
+        if (!camera.isInitialized || camera.isPoweredDown || camera.isFailing) { return false; }
+        // All frame buffers are taken: the driver would wait for a returned one, the fake fails instead
+        if (camera.framesInUse >= camera.config.frameBufferCount) { return false; }
+        if (camera.framesUntilFailure && --camera.framesUntilFailure == 0) { camera.isFailing = true; }
+        camera.framesInUse++;
+        captureTimeUs = camera.captureTimeUs;
+    }
+    int64_t endUs = Hal::Timer::getTimeUs() + captureTimeUs;
+    while (Hal::Timer::getTimeUs() < endUs) {}
+
+    std::lock_guard<std::mutex> lock(halMutex);
+    frame.data = createFrameData(camera.format, camera.length, camera.frameCount, camera.width, camera.height);
+    if (!frame.data) {
+        camera.framesInUse--;
+        return false;
+    }
+    frame.length = camera.length;
+    frame.width = camera.width;
+    frame.height = camera.height;
+    frame.format = camera.format;
+    frame.timestampUs = camera.framePeriodUs ? int64_t(camera.frameCount + 1) * camera.framePeriodUs : Hal::Timer::getTimeUs();
+    frame.driverFrame = frame.data;
+    camera.frameCount++;
+    if (camera.framesUntilSwitch && --camera.framesUntilSwitch == 0) {
+        camera.width = camera.pendingWidth;
+        camera.height = camera.pendingHeight;
+    }
+    return true;
+}
+
+void Hal::Camera::returnFrame(HalCameraFrame& frame) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (!frame.driverFrame) { return; }
+    free(frame.driverFrame);
+    frame.driverFrame = nullptr;
+    frame.data = nullptr;
+    if (camera.framesInUse > 0) { camera.framesInUse--; }
+}
+
+bool Hal::Camera::convertToJpeg(const HalCameraFrame& frame, uint8_t quality, uint8_t** jpeg, size_t* length) {
+    if (!frame.data || quality == 0 || quality > 100) { return false; }
+    {
+        std::lock_guard<std::mutex> lock(halMutex);
+        if (camera.jpegFailures) {
+            camera.jpegFailures--;
+            return false;
+        }
+    }
+    // About 1/10 of the raw size at quality 80, enough to exercise the stream path
+    size_t jpegLength = frame.length * quality / 800 + 4;
+    *jpeg = createFrameData(HAL_PIXFORMAT_JPEG, jpegLength, 0, frame.width, frame.height);
+    if (!*jpeg) { return false; }
+    *length = jpegLength;
+    return true;
+}
+
+bool Hal::Camera::decodeJpegGray8(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height, uint8_t* gray) {
+    if (!jpeg || length < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8 || width < 8 || height < 8) { return false; }
+    std::lock_guard<std::mutex> lock(halMutex);
+    size_t pixels = size_t(width >> 3) * (height >> 3);
+    if (cameraThumbnail.size() == pixels) {
+        memcpy(gray, cameraThumbnail.data(), pixels);
+    } else {
+        memset(gray, 128, pixels);
+    }
+    camera.jpegDecodes++;
+    return true;
+}
+
+void Hal::Camera::setPowerDown(bool isPoweredDown) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    camera.isPoweredDown = isPoweredDown;
+}
+
+void Hal::Camera::getResolution(HalFrameSize frameSize, uint16_t* width, uint16_t* height) {
+    static const uint16_t RESOLUTIONS[][2] = {  // The table of the driver
+        { 96, 96 }, { 160, 120 }, { 176, 144 }, { 240, 176 }, { 240, 240 }, { 320, 240 }, { 400, 296 },
+        { 480, 320 }, { 640, 480 }, { 800, 600 }, { 1024, 768 }, { 1280, 720 }, { 1280, 1024 }, { 1600, 1200 }
+    };
+    *width = RESOLUTIONS[frameSize][0];
+    *height = RESOLUTIONS[frameSize][1];
+}
+
+/*
+    The fake sensor: the SCCB writes only work on an initialized, powered sensor (halMutex is locked by the caller).
+*/
+static esp_err_t writeSensor() {
+    if (!camera.isInitialized || camera.isPoweredDown) { return ESP_ERR_INVALID_STATE; }
+    camera.sensor.writeCount++;
+    return ESP_OK;
+}
+
+/*
+    The frames of a new frame size, after the switch delay (halMutex is locked by the caller).
+*/
+static void setOutputSize(HalFrameSize frameSize) {
+    uint16_t width, height;
+    Hal::Camera::getResolution(frameSize, &width, &height);
+    if (camera.switchDelayFrames == 0) {
+        camera.width = width;
+        camera.height = height;
+        return;
+    }
+    camera.pendingWidth = width;
+    camera.pendingHeight = height;
+    camera.framesUntilSwitch = camera.switchDelayFrames;
+}
+
+esp_err_t Hal::Camera::setFrameSize(HalFrameSize frameSize) {
+    if (frameSize > HAL_FRAMESIZE_UXGA) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(halMutex);
+    esp_err_t err = writeSensor();
+    if (err != ESP_OK) { return err; }
+    camera.sensor.frameSize = frameSize;
+    camera.sensor.window = {};
+    setOutputSize(frameSize);
+    return ESP_OK;
+}
+
+esp_err_t Hal::Camera::setJpegQuality(uint8_t quality) {
+    if (quality > 63) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (camera.qualityWriteFailures) {
+        camera.qualityWriteFailures--;
+        return ESP_FAIL;            // No SCCB acknowledge
+    }
+    esp_err_t err = writeSensor();
+    if (err == ESP_OK) { camera.sensor.jpegQuality = quality; }
+    return err;
+}
+
+esp_err_t Hal::Camera::setGain(bool isAuto, uint8_t gain) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    esp_err_t err = writeSensor();
+    if (err != ESP_OK) { return err; }
+    camera.sensor.isAutoGain = isAuto;
+    if (!isAuto) { camera.sensor.gain = gain; }
+    return ESP_OK;
+}
+
+esp_err_t Hal::Camera::setExposure(bool isAuto, uint16_t exposure) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    esp_err_t err = writeSensor();
+    if (err != ESP_OK) { return err; }
+    camera.sensor.isAutoExposure = isAuto;
+    if (!isAuto) { camera.sensor.exposure = exposure; }
+    return ESP_OK;
+}
+
+esp_err_t Hal::Camera::setWindow(const HalCameraWindow& window, HalFrameSize frameSize) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    esp_err_t err = writeSensor();
+    if (err != ESP_OK) { return err; }
+    camera.sensor.frameSize = frameSize;
+    camera.sensor.window = window;
+    setOutputSize(frameSize);
+    return ESP_OK;
+}
+
+void HalHost::setCameraFrame(HalPixelFormat format, uint16_t width, uint16_t height, size_t length) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    camera.format = format;
+    camera.width = width;
+    camera.height = height;
+    camera.length = length;
+}
+
+void HalHost::setCameraCaptureTimeUs(uint32_t captureTimeUs) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    camera.captureTimeUs = captureTimeUs;
+}
+
+void HalHost::setCameraFramePeriodUs(uint32_t framePeriodUs) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    camera.framePeriodUs = framePeriodUs;
+}
+
+void HalHost::setCameraSwitchDelay(uint32_t frameCount) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    camera.switchDelayFrames = frameCount;
+}
+
+void HalHost::failCameraCapture(bool isFailing) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    camera.isFailing = isFailing;
+    camera.framesUntilFailure = 0;
+}
+
+void HalHost::failCameraCaptureAfter(uint32_t frameCount) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    camera.isFailing = frameCount == 0;
+    camera.framesUntilFailure = frameCount;
+}
+
+void HalHost::setCameraThumbnail(const std::vector<uint8_t>& gray) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    cameraThumbnail = gray;
+}
+
+uint32_t HalHost::getJpegDecodeCount() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return camera.jpegDecodes;
+}
+
+void HalHost::failJpegConversions(uint32_t count) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    camera.jpegFailures = count;
+}
+
+void HalHost::failCameraQualityWrites(uint32_t count) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    camera.qualityWriteFailures = count;
+}
+
+bool HalHost::isCameraInitialized() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return camera.isInitialized;
+}
+
+bool HalHost::isCameraPoweredDown() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return camera.isPoweredDown;
+}
+
+uint32_t HalHost::getCameraFramesInUse() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return camera.framesInUse;
+}
+
+uint32_t HalHost::getCameraFrameCount() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return camera.frameCount;
+}
+
+uint32_t HalHost::getCameraInitCount() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return camera.initCount;
+}
+
+HalHostCameraSensor HalHost::getCameraSensor() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return camera.sensor;
+}
+
+HalCameraConfig HalHost::getCameraConfig() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return camera.config;
+}
+
+
+// Wi-Fi --------------------------------------------------------------------------------------------------------
+static struct {
+    HalWiFiEventCallback callback;
+    bool isStarted;
+    bool isConnectRequested;
+    bool isConnected;
+    bool isPowerSaveEnabled;
+    int8_t rssi;
+    std::string ssid;
+    std::string staticIp;
+} wifi;
+
+static void resetWiFi() {
+    wifi.callback = nullptr;
+    wifi.isStarted = false;
+    wifi.isConnectRequested = false;
+    wifi.isConnected = false;
+    wifi.isPowerSaveEnabled = false;
+    wifi.rssi = -50;
+    wifi.ssid.clear();
+    wifi.staticIp.clear();
+}
+
+esp_err_t Hal::WiFi::init(HalWiFiEventCallback callback) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    wifi.callback = callback;
+    return ESP_OK;
+}
+
+esp_err_t Hal::WiFi::start(const char* ssid, const char* password, bool isPowerSaveEnabled) {
+    (void)password;
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (!wifi.callback) { return ESP_ERR_WIFI_NOT_INIT; }
+    wifi.ssid = ssid;
+    wifi.isPowerSaveEnabled = isPowerSaveEnabled;
+    wifi.isStarted = true;
+    return ESP_OK;
+}
+
+esp_err_t Hal::WiFi::connect() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (!wifi.isStarted) { return ESP_ERR_WIFI_NOT_STARTED; }
+    wifi.isConnectRequested = true;
+    return ESP_OK;
+}
+
+esp_err_t Hal::WiFi::disconnect() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (!wifi.isStarted) { return ESP_ERR_WIFI_NOT_STARTED; }
+    wifi.isConnectRequested = false;
+    wifi.isConnected = false;
+    return ESP_OK;
+}
+
+esp_err_t Hal::WiFi::stop() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    wifi.isStarted = false;
+    wifi.isConnectRequested = false;
+    wifi.isConnected = false;
+    return ESP_OK;
+}
+
+esp_err_t Hal::WiFi::setPowerSave(bool isEnabled) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    wifi.isPowerSaveEnabled = isEnabled;
+    return ESP_OK;
+}
+
+esp_err_t Hal::WiFi::setStaticIp(const char* ip, const char* gateway, const char* netmask) {
+    (void)gateway;
+    (void)netmask;
+    std::lock_guard<std::mutex> lock(halMutex);
+    wifi.staticIp = ip;
+    return ESP_OK;
+}
+
+esp_err_t Hal::WiFi::getRssi(int8_t* rssi) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    if (!wifi.isConnected) { return ESP_ERR_WIFI_NOT_CONNECT; }
+    *rssi = wifi.rssi;
+    return ESP_OK;
+}
+
+void HalHost::emitWiFiEvent(HalWiFiEvent event, const char* ip, const char* gateway, const char* netmask, uint8_t reason) {
+    HalWiFiEventData data = {};
+    data.event = event;
+    data.reason = reason;
+    strncpy(data.ip, ip, sizeof(data.ip) - 1);
+    strncpy(data.gateway, gateway, sizeof(data.gateway) - 1);
+    strncpy(data.netmask, netmask, sizeof(data.netmask) - 1);
+    HalWiFiEventCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(halMutex);
+        wifi.isConnected = event != HalWiFiEvent::STA_DISCONNECTED;
+        callback = wifi.callback;
+    }
+    if (callback) { callback(data); }
+}
+
+void HalHost::setWiFiRssi(int8_t rssi) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    wifi.rssi = rssi;
+}
+
+bool HalHost::isWiFiStarted() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return wifi.isStarted;
+}
+
+bool HalHost::isWiFiConnectRequested() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return wifi.isConnectRequested;
+}
+
+bool HalHost::isWiFiPowerSaveEnabled() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return wifi.isPowerSaveEnabled;
+}
+
+std::string HalHost::getWiFiSsid() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return wifi.ssid;
+}
+
+std::string HalHost::getWiFiStaticIp() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return wifi.staticIp;
+}
+
+
+// Power --------------------------------------------------------------------------------------------------------
+static struct {
+    bool isLightSleepEnabled;
+    uint32_t minFrequencyMhz;
+} power;
+
+esp_err_t Hal::Power::configure(bool isPowerSaveEnabled, uint32_t minFrequencyMhz) {
+    std::lock_guard<std::mutex> lock(halMutex);
+    power.isLightSleepEnabled = isPowerSaveEnabled;
+    power.minFrequencyMhz = minFrequencyMhz;
+    return ESP_OK;
+}
+
+bool HalHost::isLightSleepEnabled() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return power.isLightSleepEnabled;
+}
+
+uint32_t HalHost::getMinCpuFrequencyMhz() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    return power.minFrequencyMhz;
+}
+
+
+// Reset --------------------------------------------------------------------------------------------------------
+void HalHost::reset() {
+    std::lock_guard<std::mutex> lock(halMutex);
+    resetPwm();
+    resetLedStrip();
+    resetStorage();
+    resetCamera();
+    resetWiFi();
+    power.isLightSleepEnabled = false;
+    power.minFrequencyMhz = 0;
+}
+
+static struct HalHostInit {
+    HalHostInit() { HalHost::reset(); }
+} halHostInit;
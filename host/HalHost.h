@@ -0,0 +1,190 @@
+/*
+ * File: HalHost.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "Hal.h"
+
+// C++
+#include <string>
+#include <vector>
+
+/*
+    Host build: the fakes behind include/Hal.h (host/HalHost.cpp). The tests read the state of the fake peripherals
+    and drive their inputs (camera frames, Wi-Fi events, RSSI, failures) through these functions.
+*/
+
+// Host configuration
+#define HAL_HOST_PWM_CHANNELS       8
+#define HAL_HOST_PWM_TIMERS         4
+#define HAL_HOST_BOOT_TIME_US       300000  // The timer starts here, like esp_timer at app_main (0 is never a valid timestamp)
+
+// WS2812 symbols of the RMT encoder (10 MHz resolution, see HalEspIdf.cpp)
+#define HAL_HOST_RMT_SHORT_TICKS    3       // 0.3 us
+#define HAL_HOST_RMT_LONG_TICKS     9       // 0.9 us
+#define HAL_HOST_RMT_RESET_TICKS    250     // 2 x 25 us low
+
+struct HalHostRmtSymbol {                   // Same fields as rmt_symbol_word_t
+    uint16_t duration0 : 15;
+    uint16_t level0 : 1;
+    uint16_t duration1 : 15;
+    uint16_t level1 : 1;
+};
+
+struct HalHostCameraSensor {                // The registers of the fake sensor, set by init() and the live setters
+    HalFrameSize frameSize;
+    uint8_t jpegQuality;
+    bool isAutoGain;
+    uint8_t gain;
+    bool isAutoExposure;
+    uint16_t exposure;
+    HalCameraWindow window;
+    uint32_t writeCount;                    // Setter calls since the last init()
+};
+
+namespace HalHost {
+    /**
+     * @brief Reset every fake peripheral (the stored NVS keys are erased too).
+     */
+    void reset();
+
+// PWM ----------------------------------------------------------------------------------------------------------
+    uint32_t getPwmDuty(uint8_t channel);
+
+    int8_t getPwmGpio(uint8_t channel);             // HAL_GPIO_NC if the channel is not configured
+
+    bool isPwmTimerPaused(uint8_t timer);
+
+// LED Strip ----------------------------------------------------------------------------------------------------
+    bool isLedStripInitialized();
+
+    bool isLedStripEnabled();
+
+    /**
+     * @brief The bytes of the last transmit (GRB).
+     */
+    std::vector<uint8_t> getLedPixels();
+
+    /**
+     * @brief The RMT symbols of the last transmit (8 per byte and the reset code), like the encoder of the target.
+     */
+    std::vector<HalHostRmtSymbol> getLedSymbols();
+
+    uint32_t getLedTransmitCount();
+
+// Storage ------------------------------------------------------------------------------------------------------
+    /**
+     * @brief The next Hal::Storage::init() returns this error (ESP_ERR_NVS_NO_FREE_PAGES: the erase path).
+     */
+    void failNextStorageInit(esp_err_t error);
+
+    uint32_t getStorageCommitCount();
+
+    bool hasStorageKey(const char* name, const char* key);
+
+// Camera -------------------------------------------------------------------------------------------------------
+    /**
+     * @brief The format and the size of the next frames (JPEG frames start with FF D8 and end with FF D9).
+     * Hal::Camera::init() and the frame size setters set the size of their frame size.
+     */
+    void setCameraFrame(HalPixelFormat format, uint16_t width, uint16_t height, size_t length);
+
+    /**
+     * @brief Hal::Camera::getFrame() takes this long (busy wait, like the capture of the sensor).
+     */
+    void setCameraCaptureTimeUs(uint32_t captureTimeUs);
+
+    /**
+     * @brief Stamp the frames with the sensor clock: frame n (since reset()) at (n + 1) * framePeriodUs, as if the
+     * sensor ran at this rate and every frame was taken. The timing of a test then does not depend on the load of the
+     * host. 0: Hal::Timer::getTimeUs() at the capture (default).
+     */
+    void setCameraFramePeriodUs(uint32_t framePeriodUs);
+
+    /**
+     * @brief The next frameCount frames after a frame size write keep the old size (they were in the frame buffers
+     * already, like the DMA queue of the driver). 0: the next frame has the new size.
+     */
+    void setCameraSwitchDelay(uint32_t frameCount);
+
+    /**
+     * @brief The next captures fail.
+     */
+    void failCameraCapture(bool isFailing);
+
+    /**
+     * @brief The next frameCount captures succeed, the ones after fail (a stream handler returns after a known frame count).
+     */
+    void failCameraCaptureAfter(uint32_t frameCount);
+
+    /**
+     * @brief The next count Hal::Camera::convertToJpeg() calls fail (frame2jpg out of memory).
+     */
+    void failJpegConversions(uint32_t count);
+
+    /**
+     * @brief The next count Hal::Camera::setJpegQuality() writes fail (the sensor does not acknowledge), the register
+     * keeps its value.
+     */
+    void failCameraQualityWrites(uint32_t count);
+
+    /**
+     * @brief Hal::Camera::decodeJpegGray8() returns this thumbnail for every JPEG (if its size matches the frame size
+     * / 8), otherwise a flat gray one.
+     */
+    void setCameraThumbnail(const std::vector<uint8_t>& gray);
+
+    uint32_t getJpegDecodeCount();                  // Hal::Camera::decodeJpegGray8() calls since reset()
+
+    bool isCameraInitialized();
+
+    bool isCameraPoweredDown();
+
+    uint32_t getCameraFramesInUse();                // Taken and not returned
+
+    uint32_t getCameraFrameCount();                 // Frames taken since reset()
+
+    HalCameraConfig getCameraConfig();
+
+    uint32_t getCameraInitCount();                  // Hal::Camera::init() calls since reset() (frame buffer allocations)
+
+    HalHostCameraSensor getCameraSensor();
+
+// Wi-Fi --------------------------------------------------------------------------------------------------------
+    /**
+     * @brief Call the event callback of Hal::WiFi::init() in the calling thread (the addresses are used by STA_GOT_IP,
+     * the reason by STA_DISCONNECTED).
+     */
+    void emitWiFiEvent(HalWiFiEvent event, const char* ip = "", const char* gateway = "", const char* netmask = "",
+                       uint8_t reason = 0);
+
+    /**
+     * @brief The RSSI of Hal::WiFi::getRssi() (the station is connected after STA_CONNECTED or STA_GOT_IP).
+     */
+    void setWiFiRssi(int8_t rssi);
+
+    bool isWiFiStarted();
+
+    bool isWiFiConnectRequested();
+
+    bool isWiFiPowerSaveEnabled();
+
+    std::string getWiFiSsid();
+
+    std::string getWiFiStaticIp();                  // Empty if the DHCP client is used
+
+// Power --------------------------------------------------------------------------------------------------------
+    bool isLightSleepEnabled();
+
+    uint32_t getMinCpuFrequencyMhz();
+}
@@ -0,0 +1,586 @@
+/*
+ * File: HttpdHost.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "HttpdHost.h"
+
+// C++
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// C
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+}
+
+// Host Response ------------------------------------------------------------------------------------------------
+int HttpdHostResponse::getStatus() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return status;
+}
+
+std::string HttpdHostResponse::getType() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return type;
+}
+
+std::string HttpdHostResponse::getHeader(const std::string& field) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto header = headers.find(field);
+    return header != headers.end() ? header->second : std::string();
+}
+
+std::string HttpdHostResponse::getBody() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return body;
+}
+
+uint32_t HttpdHostResponse::getChunkCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return chunkCount;
+}
+
+esp_err_t HttpdHostResponse::getResult() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return result;
+}
+
+bool HttpdHostResponse::getIsComplete() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return isComplete;
+}
+
+bool HttpdHostResponse::waitForComplete(uint32_t timeoutMs) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return condition.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return isComplete; });
+}
+
+void HttpdHostResponse::setStatus(const char* statusLine) {
+    std::lock_guard<std::mutex> lock(mutex);
+    status = atoi(statusLine);
+}
+
+void HttpdHostResponse::setType(const char* contentType) {
+    std::lock_guard<std::mutex> lock(mutex);
+    type = contentType;
+}
+
+void HttpdHostResponse::setHeader(const char* field, const char* value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    headers[field] = value;
+}
+
+void HttpdHostResponse::append(const char* data, size_t length, bool isChunk) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (data && length > 0) { body.append(data, length); }
+    if (isChunk) { chunkCount++; }
+}
+
+void HttpdHostResponse::complete() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isComplete = true;
+    }
+    condition.notify_all();
+}
+
+void HttpdHostResponse::setResult(esp_err_t handlerResult) {
+    std::lock_guard<std::mutex> lock(mutex);
+    result = handlerResult;
+}
+
+void HttpdHostResponse::addHandler() {
+    std::lock_guard<std::mutex> lock(mutex);
+    pendingHandlers++;
+}
+
+void HttpdHostResponse::removeHandler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pendingHandlers > 0) { return; }
+        isComplete = true; // The handler returned without ending the response (httpd closes it)
+    }
+    condition.notify_all();
+}
+
+
+// Servers ------------------------------------------------------------------------------------------------------
+namespace {
+    struct HostSession {
+        void* context = nullptr;
+        httpd_free_ctx_fn_t freeContext = nullptr;
+        uint64_t lastUse = 0;
+    };
+
+    struct HostUriHandler {
+        std::string uri;
+        httpd_method_t method;
+        esp_err_t (*handler)(httpd_req_t* r);
+        void* userContext;
+    };
+
+    struct HostServer {
+        httpd_config_t config;
+        std::vector<HostUriHandler> handlers;
+        std::mutex requestMutex;                // One request at a time, like the server task
+        std::atomic<std::thread::id> requestThread;
+        std::mutex stateMutex;                  // The sessions, the async copies use them from other tasks
+        std::map<int, HostSession> sessions;
+        uint64_t useCounter = 0;
+        bool isStopped = false;
+    };
+
+    struct HostRequest {
+        std::shared_ptr<HostServer> server;
+        int socket;
+        std::string query;
+        std::map<std::string, std::string> headers;
+        std::string body;
+        size_t bodyOffset;
+        std::shared_ptr<HttpdHostResponse> response;
+    };
+
+    std::mutex serversMutex;
+    std::map<uint16_t, std::shared_ptr<HostServer>> servers;
+
+    std::atomic<void (*)()> beforeHandlerHook(nullptr);
+    std::atomic<void (*)()> afterHandlerHook(nullptr);
+
+    std::shared_ptr<HostServer> findServer(httpd_handle_t handle) {
+        std::lock_guard<std::mutex> lock(serversMutex);
+        for (auto& server : servers) {
+            if (server.second.get() == handle) { return server.second; }
+        }
+        return nullptr;
+    }
+
+    HostRequest* getRequest(httpd_req_t* r) { return r ? static_cast<HostRequest*>(r->aux) : nullptr; }
+
+    /*
+        Frees the context of a session and calls the close function (stateMutex is held by the caller, so they must not
+        call the httpd functions).
+    */
+    void closeSessionLocked(HostServer& server, int socket) {
+        auto session = server.sessions.find(socket);
+        if (session == server.sessions.end()) { return; }
+        if (session->second.context && session->second.freeContext) { session->second.freeContext(session->second.context); }
+        if (server.config.close_fn) { server.config.close_fn(&server, socket); }
+        server.sessions.erase(session);
+    }
+
+    /*
+        The sends fail if the client is gone (the session was closed, or the server was stopped).
+    */
+    bool isSessionOpen(HostRequest* request) {
+        std::lock_guard<std::mutex> lock(request->server->stateMutex);
+        if (request->server->isStopped) { return false; }
+        auto session = request->server->sessions.find(request->socket);
+        return session != request->server->sessions.end();
+    }
+
+    bool openSession(HostServer& server, int socket) {
+        {
+            std::lock_guard<std::mutex> lock(server.stateMutex);
+            auto session = server.sessions.find(socket);
+            if (session != server.sessions.end()) {
+                session->second.lastUse = ++server.useCounter;
+                return true;
+            }
+            if (server.sessions.size() >= server.config.max_open_sockets) {
+                if (!server.config.lru_purge_enable) { return false; }
+                auto oldest = server.sessions.begin();
+                for (auto it = server.sessions.begin(); it != server.sessions.end(); ++it) {
+                    if (it->second.lastUse < oldest->second.lastUse) { oldest = it; }
+                }
+                closeSessionLocked(server, oldest->first);
+            }
+            server.sessions[socket].lastUse = ++server.useCounter;
+        }
+        // Without the state mutex, the open function can set the session context
+        if (server.config.open_fn && server.config.open_fn(&server, socket) != ESP_OK) {
+            std::lock_guard<std::mutex> lock(server.stateMutex);
+            closeSessionLocked(server, socket);
+            return false;
+        }
+        return true;
+    }
+}
+
+esp_err_t httpd_start(httpd_handle_t* handle, const httpd_config_t* config) {
+    if (!handle || !config) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(serversMutex);
+    if (servers.count(config->server_port)) { return ESP_FAIL; } // The port is in use
+    auto server = std::make_shared<HostServer>();
+    server->config = *config;
+    servers[config->server_port] = server;
+    *handle = server.get();
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    std::shared_ptr<HostServer> server = findServer(handle);
+    if (!server) { return ESP_ERR_INVALID_ARG; }
+    {
+        std::lock_guard<std::mutex> lock(serversMutex);
+        servers.erase(server->config.server_port);
+    }
+    {
+        std::lock_guard<std::mutex> lock(server->stateMutex);
+        server->isStopped = true; // The running handler and the async copies see a closed session
+    }
+    // Wait for the running request, like the server task is joined (unless the handler stops its own server)
+    bool isCalledFromHandler = server->requestThread.load() == std::this_thread::get_id();
+    std::unique_lock<std::mutex> requestLock(server->requestMutex, std::defer_lock);
+    if (!isCalledFromHandler) { requestLock.lock(); }
+    std::lock_guard<std::mutex> lock(server->stateMutex);
+    while (!server->sessions.empty()) { closeSessionLocked(*server, server->sessions.begin()->first); }
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t* uri_handler) {
+    std::shared_ptr<HostServer> server = findServer(handle);
+    if (!server || !uri_handler || !uri_handler->uri || !uri_handler->handler) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(server->stateMutex);
+    for (const HostUriHandler& handler : server->handlers) {
+        if (handler.uri == uri_handler->uri && handler.method == uri_handler->method) { return ESP_ERR_HTTPD_HANDLER_EXISTS; }
+    }
+    if (server->handlers.size() >= server->config.max_uri_handlers) { return ESP_ERR_HTTPD_HANDLERS_FULL; }
+    server->handlers.push_back({ uri_handler->uri, uri_handler->method, uri_handler->handler, uri_handler->user_ctx });
+    return ESP_OK;
+}
+
+
+// Requests -----------------------------------------------------------------------------------------------------
+size_t httpd_req_get_url_query_len(httpd_req_t* r) {
+    HostRequest* request = getRequest(r);
+    return request ? request->query.size() : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t* r, char* buf, size_t buf_len) {
+    HostRequest* request = getRequest(r);
+    if (!request || !buf || buf_len == 0) { return ESP_ERR_INVALID_ARG; }
+    if (request->query.empty()) { return ESP_ERR_NOT_FOUND; }
+    size_t length = request->query.size() < buf_len ? request->query.size() : buf_len - 1;
+    memcpy(buf, request->query.c_str(), length);
+    buf[length] = '\0';
+    return length < request->query.size() ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char* qry, const char* key, char* val, size_t val_size) {
+    if (!qry || !key || !val || val_size == 0) { return ESP_ERR_INVALID_ARG; }
+    size_t keyLength = strlen(key);
+    const char* pair = qry;
+    while (*pair) {
+        const char* pairEnd = strchr(pair, '&');
+        if (!pairEnd) { pairEnd = pair + strlen(pair); }
+        if (strncmp(pair, key, keyLength) == 0 && pair[keyLength] == '=') {
+            const char* value = pair + keyLength + 1;
+            size_t valueLength = size_t(pairEnd - value);
+            size_t length = valueLength < val_size ? valueLength : val_size - 1;
+            memcpy(val, value, length);
+            val[length] = '\0';
+            return length < valueLength ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+        pair = *pairEnd ? pairEnd + 1 : pairEnd;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_recv(httpd_req_t* r, char* buf, size_t buf_len) {
+    HostRequest* request = getRequest(r);
+    if (!request || !buf) { return HTTPD_SOCK_ERR_INVALID; }
+    if (!isSessionOpen(request)) { return HTTPD_SOCK_ERR_FAIL; }
+    size_t remaining = request->body.size() - request->bodyOffset;
+    if (remaining == 0 && buf_len > 0) { return HTTPD_SOCK_ERR_TIMEOUT; } // The client sends nothing more (recv_wait_timeout)
+    size_t length = buf_len < remaining ? buf_len : remaining;
+    memcpy(buf, request->body.data() + request->bodyOffset, length);
+    request->bodyOffset += length;
+    return int(length);
+}
+
+/*
+    The header fields are compared case-insensitive, like the parser of the ESP-IDF does.
+*/
+static const std::string* findRequestHeader(HostRequest* request, const char* field) {
+    for (const auto& header : request->headers) {
+        if (strcasecmp(header.first.c_str(), field) == 0) { return &header.second; }
+    }
+    return nullptr;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t* r, const char* field) {
+    HostRequest* request = getRequest(r);
+    const std::string* value = request && field ? findRequestHeader(request, field) : nullptr;
+    return value ? value->size() : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* r, const char* field, char* val, size_t val_size) {
+    HostRequest* request = getRequest(r);
+    if (!request || !field || !val || val_size == 0) { return ESP_ERR_INVALID_ARG; }
+    const std::string* value = findRequestHeader(request, field);
+    if (!value) { return ESP_ERR_NOT_FOUND; }
+    size_t length = value->size() < val_size ? value->size() : val_size - 1;
+    memcpy(val, value->c_str(), length);
+    val[length] = '\0';
+    return length < value->size() ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+int httpd_req_to_sockfd(httpd_req_t* r) {
+    HostRequest* request = getRequest(r);
+    return request ? request->socket : -1;
+}
+
+
+// Responses ----------------------------------------------------------------------------------------------------
+esp_err_t httpd_resp_set_status(httpd_req_t* r, const char* status) {
+    HostRequest* request = getRequest(r);
+    if (!request || !status) { return ESP_ERR_INVALID_ARG; }
+    request->response->setStatus(status);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t* r, const char* type) {
+    HostRequest* request = getRequest(r);
+    if (!request || !type) { return ESP_ERR_INVALID_ARG; }
+    request->response->setType(type);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t* r, const char* field, const char* value) {
+    HostRequest* request = getRequest(r);
+    if (!request || !field || !value) { return ESP_ERR_INVALID_ARG; }
+    request->response->setHeader(field, value);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    HostRequest* request = getRequest(r);
+    if (!request) { return ESP_ERR_HTTPD_INVALID_REQ; }
+    if (!isSessionOpen(request)) { return ESP_ERR_HTTPD_RESP_SEND; }
+    size_t length = buf_len == HTTPD_RESP_USE_STRLEN ? (buf ? strlen(buf) : 0) : size_t(buf_len);
+    request->response->append(buf, length, false);
+    request->response->complete();
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    HostRequest* request = getRequest(r);
+    if (!request) { return ESP_ERR_HTTPD_INVALID_REQ; }
+    if (!isSessionOpen(request)) { return ESP_ERR_HTTPD_RESP_SEND; }
+    size_t length = buf_len == HTTPD_RESP_USE_STRLEN ? (buf ? strlen(buf) : 0) : size_t(buf_len);
+    if (!buf || length == 0) { // The last chunk
+        request->response->complete();
+        return ESP_OK;
+    }
+    request->response->append(buf, length, true);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t* req, httpd_err_code_t error, const char* msg) {
+    static const struct {
+        httpd_err_code_t error;
+        const char* status;
+        const char* message;
+    } ERRORS[] = {
+        { HTTPD_500_INTERNAL_SERVER_ERROR, "500 Internal Server Error", "Server has encountered an unexpected error" },
+        { HTTPD_501_METHOD_NOT_IMPLEMENTED, "501 Method Not Implemented", "Server does not support this method" },
+        { HTTPD_505_VERSION_NOT_SUPPORTED, "505 Version Not Supported", "HTTP version not supported by server" },
+        { HTTPD_400_BAD_REQUEST, "400 Bad Request", "Bad request syntax" },
+        { HTTPD_401_UNAUTHORIZED, "401 Unauthorized", "No permission -- see authorization schemes" },
+        { HTTPD_403_FORBIDDEN, "403 Forbidden", "Request forbidden -- authorization will not help" },
+        { HTTPD_404_NOT_FOUND, "404 Not Found", "Nothing matches the given URI" },
+        { HTTPD_405_METHOD_NOT_ALLOWED, "405 Method Not Allowed", "Specified method is invalid for this resource" },
+        { HTTPD_408_REQ_TIMEOUT, "408 Request Timeout", "Server closed this connection" },
+        { HTTPD_411_LENGTH_REQUIRED, "411 Length Required", "Client must specify Content-Length" },
+        { HTTPD_414_URI_TOO_LONG, "414 URI Too Long", "URI is too long" },
+        { HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE, "431 Request Header Fields Too Large", "Header fields are too long" }
+    };
+    HostRequest* request = getRequest(req);
+    if (!request) { return ESP_ERR_HTTPD_INVALID_REQ; }
+    for (const auto& entry : ERRORS) {
+        if (entry.error == error) {
+            request->response->setStatus(entry.status);
+            request->response->setType("text/html");
+            return httpd_resp_send(req, msg ? msg : entry.message, HTTPD_RESP_USE_STRLEN);
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t httpd_resp_send_404(httpd_req_t* r) {
+    return httpd_resp_send_err(r, HTTPD_404_NOT_FOUND, nullptr);
+}
+
+esp_err_t httpd_resp_send_500(httpd_req_t* r) {
+    return httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, nullptr);
+}
+
+
+// Sessions -----------------------------------------------------------------------------------------------------
+void* httpd_sess_get_ctx(httpd_handle_t handle, int sockfd) {
+    std::shared_ptr<HostServer> server = findServer(handle);
+    if (!server) { return nullptr; }
+    std::lock_guard<std::mutex> lock(server->stateMutex);
+    auto session = server->sessions.find(sockfd);
+    return session != server->sessions.end() ? session->second.context : nullptr;
+}
+
+void httpd_sess_set_ctx(httpd_handle_t handle, int sockfd, void* ctx, httpd_free_ctx_fn_t free_fn) {
+    std::shared_ptr<HostServer> server = findServer(handle);
+    if (!server) { return; }
+    std::lock_guard<std::mutex> lock(server->stateMutex);
+    auto session = server->sessions.find(sockfd);
+    if (session == server->sessions.end()) { return; }
+    if (session->second.context && session->second.context != ctx && session->second.freeContext) {
+        session->second.freeContext(session->second.context);
+    }
+    session->second.context = ctx;
+    session->second.freeContext = free_fn;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    std::shared_ptr<HostServer> server = findServer(handle);
+    if (!server) { return ESP_ERR_INVALID_ARG; }
+    std::lock_guard<std::mutex> lock(server->stateMutex);
+    if (!server->sessions.count(sockfd)) { return ESP_ERR_NOT_FOUND; }
+    closeSessionLocked(*server, sockfd);
+    return ESP_OK;
+}
+
+
+// Async Requests -----------------------------------------------------------------------------------------------
+esp_err_t httpd_req_async_handler_begin(httpd_req_t* r, httpd_req_t** out) {
+    HostRequest* request = getRequest(r);
+    if (!request || !out) { return ESP_ERR_INVALID_ARG; }
+    httpd_req_t* copy = new httpd_req_t(*r);
+    copy->aux = new HostRequest(*request);
+    request->response->addHandler();
+    *out = copy;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t* r) {
+    HostRequest* request = getRequest(r);
+    if (!request) { return ESP_ERR_INVALID_ARG; }
+    request->response->removeHandler();
+    delete request;
+    delete r;
+    return ESP_OK;
+}
+
+
+// Host Server --------------------------------------------------------------------------------------------------
+std::shared_ptr<HttpdHostResponse> HttpdHost::request(uint16_t port, httpd_method_t method, const char* uri, const char* body, int socket,
+                                                  const std::map<std::string, std::string>& headers) {
+    std::shared_ptr<HostServer> server;
+    {
+        std::lock_guard<std::mutex> lock(serversMutex);
+        auto found = servers.find(port);
+        if (found == servers.end()) { return nullptr; }
+        server = found->second;
+    }
+    std::lock_guard<std::mutex> requestLock(server->requestMutex);
+    server->requestThread = std::this_thread::get_id();
+    auto response = std::make_shared<HttpdHostResponse>();
+
+    if (server->isStopped || !openSession(*server, socket)) { // Refused connection
+        response->setStatus(HTTPD_408);
+        response->setResult(ESP_FAIL);
+        response->removeHandler();
+        server->requestThread = std::thread::id();
+        return response;
+    }
+
+    const char* queryStart = strchr(uri, '?');
+    std::string path = queryStart ? std::string(uri, queryStart) : std::string(uri);
+    const HostUriHandler* handler = nullptr;
+    bool isPathKnown = false;
+    {
+        std::lock_guard<std::mutex> lock(server->stateMutex);
+        for (const HostUriHandler& candidate : server->handlers) {
+            if (candidate.uri != path) { continue; }
+            isPathKnown = true;
+            if (candidate.method == method) { handler = &candidate; }
+        }
+    }
+
+    HostRequest* request = new HostRequest{ server, socket, queryStart ? std::string(queryStart + 1) : std::string(), headers,
+                                            body ? std::string(body) : std::string(), 0, response };
+    httpd_req_t* req = new httpd_req_t();
+    req->handle = server.get();
+    req->method = method;
+    strncpy(req->uri, uri, HTTPD_MAX_URI_LEN);
+    req->content_len = request->body.size();
+    const std::string* contentLength = findRequestHeader(request, "Content-Length");
+    if (contentLength) { req->content_len = strtoul(contentLength->c_str(), nullptr, 10); } // Longer than the body: a stalled client
+    req->aux = request;
+
+    if (!handler) {
+        httpd_resp_send_err(req, isPathKnown ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, nullptr);
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(server->stateMutex);
+            HostSession& session = server->sessions[socket];
+            req->sess_ctx = session.context;
+            req->free_ctx = session.freeContext;
+        }
+        req->user_ctx = handler->userContext;
+        void (*beforeHandler)() = beforeHandlerHook.load();
+        void (*afterHandler)() = afterHandlerHook.load();
+        if (beforeHandler) { beforeHandler(); }
+        esp_err_t result = handler->handler(req);
+        if (afterHandler) { afterHandler(); }
+        response->setResult(result);
+        std::lock_guard<std::mutex> lock(server->stateMutex);
+        if (result != ESP_OK) { // The server closes the session of a failed handler
+            closeSessionLocked(*server, socket);
+        } else if (!req->ignore_sess_ctx_changes && server->sessions.count(socket)) {
+            HostSession& session = server->sessions[socket];
+            if (session.context != req->sess_ctx) {
+                if (session.context && session.freeContext) { session.freeContext(session.context); }
+                session.context = req->sess_ctx;
+                session.freeContext = req->free_ctx;
+            }
+        }
+    }
+    response->removeHandler();
+    delete request;
+    delete req;
+    server->requestThread = std::thread::id();
+    return response;
+}
+
+void HttpdHost::closeSession(uint16_t port, int socket) {
+    std::shared_ptr<HostServer> server;
+    {
+        std::lock_guard<std::mutex> lock(serversMutex);
+        auto found = servers.find(port);
+        if (found == servers.end()) { return; }
+        server = found->second;
+    }
+    std::lock_guard<std::mutex> lock(server->stateMutex);
+    closeSessionLocked(*server, socket);
+}
+
+bool HttpdHost::isServerRunning(uint16_t port) {
+    std::lock_guard<std::mutex> lock(serversMutex);
+    return servers.count(port) > 0;
+}
+
+void HttpdHost::setHandlerHooks(void (*before)(), void (*after)()) {
+    beforeHandlerHook = before;
+    afterHandlerHook = after;
+}
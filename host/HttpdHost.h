@@ -0,0 +1,126 @@
+/*
+ * File: HttpdHost.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+// C++
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// C
+extern "C" {
+#include <stdint.h>
+#include "esp_http_server.h"
+}
+
+#define HTTPD_HOST_RESPONSE_RESERVE     1024    // bytes
+
+/*
+    Host build: drives the servers of host/HttpdHost.cpp. A request runs the registered handler in the calling thread
+    and records the response; a handler that goes async (httpd_req_async_handler_begin) keeps sending from its own task,
+    so the response is complete when the async copy is completed (waitForComplete).
+*/
+
+// Host Response ------------------------------------------------------------------------------------------------
+class HttpdHostResponse {
+private:
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    int status = 200;
+    std::string type = "text/html";
+    std::map<std::string, std::string> headers;
+    std::string body;
+    esp_err_t result = ESP_OK;
+    uint32_t chunkCount = 0;
+    bool isComplete = false;
+    uint32_t pendingHandlers = 1;   // The handler and the async copies
+
+public:
+    /**
+     * @brief The body is reserved up front, so recording a short response does not count as an allocation of the handler.
+     */
+    HttpdHostResponse() { body.reserve(HTTPD_HOST_RESPONSE_RESERVE); }
+
+    int getStatus() const;
+
+    std::string getType() const;
+
+    std::string getHeader(const std::string& field) const;  // Empty if it is not set
+
+    std::string getBody() const;
+
+    uint32_t getChunkCount() const;
+
+    /**
+     * @brief The return value of the handler (ESP_OK if it went async).
+     */
+    esp_err_t getResult() const;
+
+    /**
+     * @brief The response ended (httpd_resp_send, the last chunk, an error or the last async copy completed).
+     */
+    bool getIsComplete() const;
+
+    bool waitForComplete(uint32_t timeoutMs);
+
+// Used by HttpdHost.cpp ------------------------------------------------
+    void setStatus(const char* status);
+
+    void setType(const char* type);
+
+    void setHeader(const char* field, const char* value);
+
+    void append(const char* data, size_t length, bool isChunk);
+
+    void complete();
+
+    void setResult(esp_err_t result);
+
+    void addHandler();
+
+    void removeHandler();
+};
+
+
+// Host Server --------------------------------------------------------------------------------------------------
+namespace HttpdHost {
+    /**
+     * @brief Send a request to the server on a port.
+     *
+     * @param port The port of the server (COMMAND_SERVER_PORT, VIDEO_SERVER_PORT).
+     * @param method HTTP_GET or HTTP_POST.
+     * @param uri The path and the query ("/mov?X=1&Y=2&L=0&R=0").
+     * @param body The request body (POST), nullptr if there is none.
+     * @param socket The session of the client: the open function of the server runs on the first request of a socket.
+     * @param headers The request header fields (httpd_req_get_hdr_value_str).
+     * @return std::shared_ptr<HttpdHostResponse> nullptr if no server runs on the port.
+     */
+    std::shared_ptr<HttpdHostResponse> request(uint16_t port, httpd_method_t method, const char* uri, const char* body = nullptr,
+                                               int socket = 1000, const std::map<std::string, std::string>& headers = {});
+
+    /**
+     * @brief Close a session like a disconnected client: the sends on it fail, the session context is freed.
+     */
+    void closeSession(uint16_t port, int socket);
+
+    bool isServerRunning(uint16_t port);
+
+    /**
+     * @brief Called in the request thread right before and right after every handler (e.g. to count the allocations
+     * of the handler only, without the request injection). nullptr: no hook.
+     */
+    void setHandlerHooks(void (*before)(), void (*after)());
+}
@@ -0,0 +1,73 @@
+/*
+ * File: MallocHost.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: malloc, calloc and realloc of glibc with a counter (see MallocHost.h).
+*/
+
+#include "MallocHost.h"
+
+// C++
+#include <atomic>
+
+// C
+extern "C" {
+#include <stddef.h>
+}
+
+#if defined(__SANITIZE_ADDRESS__)
+#define MALLOC_HOST_COUNTING    0
+#else
+#define MALLOC_HOST_COUNTING    1
+#endif
+
+static std::atomic<uint64_t> allocationCount(0);
+static thread_local bool isCountingThread = false;
+static thread_local uint64_t countAtStart = 0;
+
+#if MALLOC_HOST_COUNTING
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+
+void* malloc(size_t size) {
+    if (isCountingThread) { allocationCount.fetch_add(1, std::memory_order_relaxed); }
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    if (isCountingThread) { allocationCount.fetch_add(1, std::memory_order_relaxed); }
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+    if (isCountingThread) { allocationCount.fetch_add(1, std::memory_order_relaxed); }
+    return __libc_realloc(pointer, size);
+}
+}
+#endif
+
+bool MallocHost::isCountingAvailable() {
+    return MALLOC_HOST_COUNTING;
+}
+
+void MallocHost::startCounting() {
+    countAtStart = allocationCount.load();
+    isCountingThread = true;
+}
+
+uint64_t MallocHost::stopCounting() {
+    isCountingThread = false;
+    return allocationCount.load() - countAtStart;
+}
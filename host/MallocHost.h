@@ -0,0 +1,40 @@
+/*
+ * File: MallocHost.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+// C
+extern "C" {
+#include <stdint.h>
+}
+
+/*
+    Host build: allocation counter (host/MallocHost.cpp). malloc, calloc and realloc are replaced in the executables
+    that link MallocHost.cpp (not in firmware_host), and only the allocations of the counting thread are counted
+    (the manager tasks keep running). The sanitizers replace the allocator too, the counter is not available there.
+*/
+namespace MallocHost {
+    bool isCountingAvailable();
+
+    /**
+     * @brief Start counting the allocations of the calling thread.
+     */
+    void startCounting();
+
+    /**
+     * @brief Stop counting in the calling thread.
+     *
+     * @return uint64_t The allocations since startCounting() (0 if the counter is not available).
+     */
+    uint64_t stopCounting();
+}
@@ -0,0 +1,297 @@
+/*
+ * File: RtpJpegReceiver.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "RtpJpegReceiver.h"
+
+// C++
+#include <algorithm>
+
+extern "C" {
+#include <string.h>
+}
+
+static inline uint16_t readUint16(const uint8_t* data) { return uint16_t((data[0] << 8) | data[1]); }
+
+static inline uint32_t readUint24(const uint8_t* data) { return (uint32_t(data[0]) << 16) | (uint32_t(data[1]) << 8) | data[2]; }
+
+static inline uint32_t readUint32(const uint8_t* data) { return (uint32_t(readUint16(data)) << 16) | readUint16(data + 2); }
+
+// Receiver -----------------------------------------------------------------------------------------------------
+// The standard Huffman tables (ITU T.81 Annex K.3), every RFC 2435 frame uses them
+static const uint8_t LUMA_DC_BITS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t CHROMA_DC_BITS[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t DC_VALUES[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t LUMA_AC_BITS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D};
+static const uint8_t LUMA_AC_VALUES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+    0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+    0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+    0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA
+};
+static const uint8_t CHROMA_AC_BITS[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t CHROMA_AC_VALUES[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+    0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+    0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+    0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+    0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+    0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA
+};
+
+static void appendMarker(std::vector<uint8_t>& jpeg, uint8_t marker, uint16_t segmentLength) {
+    jpeg.insert(jpeg.end(), {0xFF, marker, uint8_t(segmentLength >> 8), uint8_t(segmentLength)});
+}
+
+static void appendHuffmanTable(std::vector<uint8_t>& jpeg, uint8_t tableClass, uint8_t id, const uint8_t* bits,
+                               const uint8_t* values, size_t valueCount) {
+    appendMarker(jpeg, JPEG_DHT, uint16_t(2 + 1 + 16 + valueCount));
+    jpeg.push_back(uint8_t((tableClass << 4) | id));
+    jpeg.insert(jpeg.end(), bits, bits + 16);
+    jpeg.insert(jpeg.end(), values, values + valueCount);
+}
+
+void RtpJpegReceiver::buildJpeg(const RtpJpegImage& image, std::vector<uint8_t>& jpeg) {
+    jpeg.clear();
+    jpeg.reserve(image.scanLength + 640);
+    jpeg.insert(jpeg.end(), {0xFF, JPEG_SOI});
+
+    uint8_t tableCount = image.quantizationLength >= 128 ? 2 : 1;
+    appendMarker(jpeg, JPEG_DQT, uint16_t(2 + 65 * tableCount));
+    for (uint8_t i = 0; i < tableCount; i++) {
+        jpeg.push_back(i);
+        jpeg.insert(jpeg.end(), image.quantizationTables + 64 * i, image.quantizationTables + 64 * (i + 1));
+    }
+    if (image.restartInterval) {
+        appendMarker(jpeg, JPEG_DRI, 4);
+        jpeg.insert(jpeg.end(), {uint8_t(image.restartInterval >> 8), uint8_t(image.restartInterval)});
+    }
+    uint8_t chromaTable = tableCount - 1;
+    appendMarker(jpeg, JPEG_SOF0, 17);
+    jpeg.insert(jpeg.end(), {8, uint8_t(image.height >> 8), uint8_t(image.height), uint8_t(image.width >> 8), uint8_t(image.width), 3,
+                             1, uint8_t((image.type & RTP_JPEG_TYPE_MASK) == 0 ? 0x21 : 0x22), 0,
+                             2, 0x11, chromaTable,
+                             3, 0x11, chromaTable});
+    appendHuffmanTable(jpeg, 0, 0, LUMA_DC_BITS, DC_VALUES, sizeof(DC_VALUES));
+    appendHuffmanTable(jpeg, 1, 0, LUMA_AC_BITS, LUMA_AC_VALUES, sizeof(LUMA_AC_VALUES));
+    appendHuffmanTable(jpeg, 0, 1, CHROMA_DC_BITS, DC_VALUES, sizeof(DC_VALUES));
+    appendHuffmanTable(jpeg, 1, 1, CHROMA_AC_BITS, CHROMA_AC_VALUES, sizeof(CHROMA_AC_VALUES));
+    appendMarker(jpeg, JPEG_SOS, 12);
+    jpeg.insert(jpeg.end(), {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0});
+
+    jpeg.insert(jpeg.end(), image.scan, image.scan + image.scanLength);
+    if (image.scanLength < 2 || image.scan[image.scanLength - 2] != 0xFF || image.scan[image.scanLength - 1] != JPEG_EOI) {
+        jpeg.insert(jpeg.end(), {0xFF, JPEG_EOI});
+    }
+}
+
+RtpJpegReceiver::RtpJpegReceiver(FrameCallback onFrame, void* context)
+    : onFrame(onFrame), context(context), hasLastTimestamp(false), lastTimestamp(0), stats{} {}
+
+RtpJpegReceiver::PendingFrame* RtpJpegReceiver::findFrame(uint32_t timestamp, bool isCreated) {
+    for (PendingFrame& frame : pendingFrames) {
+        if (frame.timestamp == timestamp) { return &frame; }
+    }
+    if (!isCreated) { return nullptr; }
+    if (pendingFrames.size() >= RTP_RECEIVER_MAX_PENDING_FRAMES) {
+        uint32_t oldest = pendingFrames[0].timestamp;
+        for (const PendingFrame& frame : pendingFrames) {
+            if (int32_t(frame.timestamp - oldest) < 0) { oldest = frame.timestamp; }
+        }
+        finishFrame(oldest, false);
+    }
+    pendingFrames.push_back(PendingFrame{timestamp, {}, {}});
+    return &pendingFrames.back();
+}
+
+void RtpJpegReceiver::recover(PendingFrame& frame) {
+    for (const FecPacket& fec : frame.fecPackets) {
+        uint16_t missing = 0;
+        uint8_t missingCount = 0;
+        for (uint8_t i = 0; i < fec.count; i++) {
+            if (!frame.packets.count(uint16_t(fec.firstSequence + i))) {
+                missing = uint16_t(fec.firstSequence + i);
+                missingCount++;
+            }
+        }
+        if (missingCount != 1) { continue; }    // Complete, or more lost than one parity restores
+
+        std::vector<uint8_t> payload = fec.parity;
+        uint16_t length = fec.lengthParity;
+        uint8_t marker = fec.markerParity;
+        for (uint8_t i = 0; i < fec.count; i++) {
+            auto media = frame.packets.find(uint16_t(fec.firstSequence + i));
+            if (media == frame.packets.end()) { continue; }
+            const std::vector<uint8_t>& data = media->second.payload;
+            if (data.size() > payload.size()) { payload.resize(data.size(), 0); }
+            for (size_t j = 0; j < data.size(); j++) { payload[j] ^= data[j]; }
+            length ^= uint16_t(data.size());
+            marker ^= media->second.isMarker ? 1 : 0;
+        }
+        if (length < RTP_JPEG_HEADER_SIZE || length > payload.size()) {
+            stats.invalidPackets++;
+            continue;
+        }
+        payload.resize(length);
+        frame.packets[missing] = MediaPacket{payload, (marker & 1) != 0, true};
+        stats.recoveredPackets++;
+    }
+}
+
+bool RtpJpegReceiver::complete(PendingFrame& frame) {
+    // The first packet has the offset 0, the last one the marker
+    const MediaPacket* first = nullptr;
+    uint16_t sequence = 0;
+    for (const auto& [packetSequence, packet] : frame.packets) {
+        if (readUint24(packet.payload.data() + 1) == 0) {
+            first = &packet;
+            sequence = packetSequence;
+            break;
+        }
+    }
+    if (!first) { return false; }
+
+    RtpJpegImage image = {};
+    const uint8_t* header = first->payload.data();
+    image.type = header[4];
+    image.width = uint16_t(header[6] * 8);
+    image.height = uint16_t(header[7] * 8);
+    uint8_t quality = header[5];
+    bool hasRestart = (image.type & RTP_JPEG_RESTART) != 0;
+    size_t headerLength = RTP_JPEG_HEADER_SIZE + (hasRestart ? RTP_RESTART_HEADER_SIZE : 0);
+    // Only the in-band tables of the packetizer: the tables scaled from Q (1-99) are not implemented
+    if ((image.type & RTP_JPEG_TYPE_MASK) > 1 || (image.type & ~(RTP_JPEG_TYPE_MASK | RTP_JPEG_RESTART)) || quality < 128) {
+        stats.invalidPackets++;
+        return false;
+    }
+
+    std::vector<uint8_t> scan;
+    uint16_t recovered = 0;
+    for (uint32_t count = 0; count <= frame.packets.size(); count++, sequence++) {
+        auto media = frame.packets.find(sequence);
+        if (media == frame.packets.end()) { return false; }
+        const std::vector<uint8_t>& payload = media->second.payload;
+        if (payload.size() < headerLength || readUint24(payload.data() + 1) != scan.size()) { return false; }
+        size_t dataStart = headerLength;
+        if (count == 0) {
+            if (hasRestart) { image.restartInterval = readUint16(payload.data() + RTP_JPEG_HEADER_SIZE); }
+            if (payload.size() < dataStart + RTP_QUANTIZATION_HEADER_SIZE) { return false; }
+            uint16_t tablesLength = readUint16(payload.data() + dataStart + 2);
+            if (payload[dataStart + 1] != 0 || (tablesLength != 64 && tablesLength != 128) ||
+                payload.size() < dataStart + RTP_QUANTIZATION_HEADER_SIZE + tablesLength) {
+                stats.invalidPackets++;
+                return false;
+            }
+            memcpy(image.quantizationTables, payload.data() + dataStart + RTP_QUANTIZATION_HEADER_SIZE, tablesLength);
+            image.quantizationLength = tablesLength;
+            dataStart += RTP_QUANTIZATION_HEADER_SIZE + tablesLength;
+        }
+        scan.insert(scan.end(), payload.begin() + dataStart, payload.end());
+        if (media->second.isRecovered) { recovered++; }
+        if (media->second.isMarker) {
+            image.scan = scan.data();
+            image.scanLength = scan.size();
+            buildJpeg(image, jpeg);
+            RtpJpegFrame rtpFrame = {jpeg.data(), jpeg.size(), frame.timestamp, image.width, image.height, recovered};
+            stats.framesComplete++;
+            if (onFrame) { onFrame(rtpFrame, context); }
+            return true;
+        }
+    }
+    return false;
+}
+
+void RtpJpegReceiver::finishFrame(uint32_t timestamp, bool isComplete) {
+    // The older frames are given up: a frame behind a complete one is late for the display anyway
+    for (auto frame = pendingFrames.begin(); frame != pendingFrames.end();) {
+        int32_t age = int32_t(timestamp - frame->timestamp);
+        if (age < 0) {
+            ++frame;
+            continue;
+        }
+        if (age > 0 || !isComplete) { stats.framesIncomplete++; }
+        frame = pendingFrames.erase(frame);
+    }
+    if (!hasLastTimestamp || int32_t(timestamp - lastTimestamp) > 0) {
+        lastTimestamp = timestamp;
+        hasLastTimestamp = true;
+    }
+}
+
+void RtpJpegReceiver::receive(const uint8_t* packet, size_t length) {
+    if (!packet || length < RTP_HEADER_SIZE || (packet[0] >> 6) != 2) {
+        stats.invalidPackets++;
+        return;
+    }
+    size_t headerLength = RTP_HEADER_SIZE + 4 * (packet[0] & 0x0F);
+    if ((packet[0] & 0x10) && length >= headerLength + 4) { headerLength += 4 + 4 * size_t(readUint16(packet + headerLength + 2)); }
+    if ((packet[0] & 0x20) && length > headerLength) { length -= std::min<size_t>(packet[length - 1], length - headerLength); }
+    uint8_t payloadType = packet[1] & 0x7F;
+    bool isMarker = (packet[1] & 0x80) != 0;
+    uint16_t sequence = readUint16(packet + 2);
+    uint32_t timestamp = readUint32(packet + 4);
+    const uint8_t* payload = packet + headerLength;
+    size_t payloadLength = length > headerLength ? length - headerLength : 0;
+
+    if (payloadType == RTP_FEC_PAYLOAD_TYPE) {
+        stats.fecPackets++;
+        if (payloadLength < RTP_FEC_HEADER_SIZE || payload[2] == 0 || payload[2] > RTP_FEC_MAX_GROUP_SIZE) {
+            stats.invalidPackets++;
+            return;
+        }
+    } else if (payloadType == RTP_JPEG_PAYLOAD_TYPE) {
+        stats.packets++;
+        if (payloadLength < RTP_JPEG_HEADER_SIZE) {
+            stats.invalidPackets++;
+            return;
+        }
+    } else {
+        stats.invalidPackets++;
+        return;
+    }
+    if (hasLastTimestamp && int32_t(timestamp - lastTimestamp) <= 0) {
+        stats.latePackets++;
+        return;
+    }
+
+    PendingFrame* frame = findFrame(timestamp, true);
+    if (payloadType == RTP_FEC_PAYLOAD_TYPE) {
+        frame->fecPackets.push_back(FecPacket{readUint16(payload), payload[2], payload[3], readUint16(payload + 4),
+                                              std::vector<uint8_t>(payload + RTP_FEC_HEADER_SIZE, payload + payloadLength)});
+    } else {
+        if (frame->packets.count(sequence)) { return; } // Duplicate, or restored already
+        frame->packets[sequence] = MediaPacket{std::vector<uint8_t>(payload, payload + payloadLength), isMarker, false};
+    }
+    recover(*frame);
+    if (complete(*frame)) { finishFrame(timestamp, true); }
+}
+
+void RtpJpegReceiver::flush() {
+    if (pendingFrames.empty()) { return; }
+    uint32_t newest = pendingFrames[0].timestamp;
+    for (const PendingFrame& frame : pendingFrames) {
+        if (int32_t(frame.timestamp - newest) > 0) { newest = frame.timestamp; }
+    }
+    finishFrame(newest, false);
+}
@@ -0,0 +1,107 @@
+/*
+ * File: RtpJpegReceiver.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "RtpJpeg.h"
+
+// C++
+#include <map>
+#include <vector>
+
+#define RTP_RECEIVER_MAX_PENDING_FRAMES 3   // Incomplete frames kept for late and recovered packets
+
+
+// Receiver -----------------------------------------------------------------------------------------------------
+struct RtpJpegFrame {
+    const uint8_t* jpeg;            // Rebuilt JPEG, valid during the callback
+    size_t length;
+    uint32_t timestamp;             // 90 kHz capture time
+    uint16_t width;
+    uint16_t height;
+    uint16_t recoveredPackets;      // Restored from the parity packets
+};
+
+struct RtpJpegReceiverStats {
+    uint32_t packets;
+    uint32_t fecPackets;
+    uint32_t recoveredPackets;
+    uint32_t framesComplete;
+    uint32_t framesIncomplete;      // A packet was missing when a newer frame completed (or at flush())
+    uint32_t latePackets;           // Of a frame that was already completed or given up
+    uint32_t invalidPackets;        // Not RTP/JPEG, or an unsupported type
+};
+
+/*
+    RTP/JPEG receiver of the host tools and tests: it collects the packets per frame, restores lost packets from the
+    parity packets, and rebuilds the JPEG with the standard Huffman tables. A frame is given up as soon as a newer
+    frame is complete, so a lost packet never holds the stream back (unlike the MJPEG stream on TCP).
+    Host only (the firmware sends, it never receives RTP): it allocates per packet.
+*/
+class RtpJpegReceiver {
+public:
+    typedef void (*FrameCallback)(const RtpJpegFrame& frame, void* context);
+
+    RtpJpegReceiver(FrameCallback onFrame, void* context);
+
+    void receive(const uint8_t* packet, size_t length);
+
+    /**
+     * @brief Give up every pending frame (end of the stream).
+     */
+    void flush();
+
+    RtpJpegReceiverStats getStats() const { return stats; }
+
+    /**
+     * @brief Rebuild a JPEG from the fields of the first RTP/JPEG packet and the scan.
+     */
+    static void buildJpeg(const RtpJpegImage& image, std::vector<uint8_t>& jpeg);
+
+private:
+    struct MediaPacket {
+        std::vector<uint8_t> payload;
+        bool isMarker;
+        bool isRecovered;
+    };
+
+    struct FecPacket {
+        uint16_t firstSequence;
+        uint8_t count;
+        uint8_t markerParity;
+        uint16_t lengthParity;
+        std::vector<uint8_t> parity;
+    };
+
+    struct PendingFrame {
+        uint32_t timestamp;
+        std::map<uint16_t, MediaPacket> packets;    // By sequence, walked from the first packet (it can wrap inside a frame)
+        std::vector<FecPacket> fecPackets;
+    };
+
+    FrameCallback onFrame;
+    void* context;
+    std::vector<PendingFrame> pendingFrames;
+    bool hasLastTimestamp;
+    uint32_t lastTimestamp;         // Of the newest completed or given up frame
+    std::vector<uint8_t> jpeg;
+    RtpJpegReceiverStats stats;
+
+    PendingFrame* findFrame(uint32_t timestamp, bool isCreated);
+
+    void recover(PendingFrame& frame);
+
+    bool complete(PendingFrame& frame);
+
+    void finishFrame(uint32_t timestamp, bool isComplete);
+};
@@ -0,0 +1,448 @@
+/*
+ * File: HostBenchmarks.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: benchmarks of the hot paths, in ns/op and allocations/op.
+
+        host_benchmarks [--filter <text>] [--baseline <file>] [--threshold <percent>] [--write-baseline <file>]
+
+    Every benchmark is calibrated to run at least BENCH_MIN_TIME_MS, the best of BENCH_REPEATS runs is reported.
+    With --baseline, the exit code is non-zero if a benchmark is slower than its baseline by more than the threshold,
+    or allocates more. The host numbers are for comparing changes, not the cost on the ESP32 (the HAL is a fake,
+    the handlers run through host/HttpdHost.cpp).
+
+    A benchmark with a harness reports its cost without the cost of the harness benchmark (the fake request,
+    the fake camera), the harness row is printed too. A benchmark with a budget fails when it is over it, with or
+    without a baseline.
+
+    The vision benchmarks run on a generated drive sequence (a noisy floor with an obstacle coming closer), the
+    thumbnails of a VGA stream at 1/8 scale: one op is one row of a cell (kernels) or one frame (vision_frame).
+
+    The flight recorder benchmarks encode the motor loop records of a drive (the duties change every half second),
+    one op is one record: flight_log_encode is the encoder only, flight_recorder_record adds the lock and the clock.
+*/
+
+#include "CameraManager.h"
+#include "FlightRecorder.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "MallocHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "MotorManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+#include "VisionManager.h"
+#include "VisionPipeline.h"
+
+// C++
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// C
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+}
+
+#define BENCH_MIN_TIME_MS           50
+#define BENCH_REPEATS               5
+#define BENCH_DEFAULT_THRESHOLD     100     // percent, the stored baseline can come from another machine
+#define BENCH_ALLOCATION_TOLERANCE  0.005   // allocations/op, rounding of the baseline file
+
+#define BENCH_HARNESS_PORT          8080
+#define BENCH_STREAM_BATCH_FRAMES   500     // Frames per stream request (the response body is recorded)
+#define BENCH_STREAM_TIMEOUT_MS     10000
+#define BENCH_STREAM_FRAME_LENGTH   512
+
+#define BENCH_VISION_WIDTH          80      // VGA at 1/8 scale
+#define BENCH_VISION_HEIGHT         60
+#define BENCH_VISION_FRAMES         16
+#define BENCH_DEVICE_SLOWDOWN       50      // The ESP32 core against a desktop core, generous: the budget catches a
+                                            // kernel that lost its word parallel path, not a few percent
+
+// Benchmarks ---------------------------------------------------------------------------------------------------
+struct Benchmark {
+    const char* name;
+    void (*run)(uint32_t iterations);
+    const char* harness;            // The benchmark whose cost is subtracted (nullptr: none)
+    uint32_t budgetNs;              // Largest accepted ns/op (0: none)
+};
+
+static volatile int32_t sink;       // Keeps the results of the pure functions
+
+static void runHarnessRequest(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        HttpdHost::request(BENCH_HARNESS_PORT, HTTP_GET, "/nop?X=10&Y=50&L=0&R=20");
+    }
+}
+
+static void runMoveRequest(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, "/mov?X=10&Y=50&L=0&R=20");
+    }
+}
+
+static void runDirectionControl(uint32_t iterations) {
+    static const ControlData CONTROLS[] = {
+        { 0, 100, 0, 0 }, { 0, -60, 0, 0 }, { 0, 50, 20, 0 }, { 0, -50, 0, 20 },
+        { 80, 0, 0, 0 }, { -80, 0, 0, 0 }, { 0, 0, 40, 0 }, { 0, 0, 0, 0 }
+    };
+    MotorManager* motorManager = MotorManager::getInstance();
+    for (uint32_t i = 0; i < iterations; i++) {
+        const ControlData& control = CONTROLS[i % (sizeof(CONTROLS) / sizeof(CONTROLS[0]))];
+        motorManager->setControlData(control.X, control.Y, control.L, control.R);
+        motorManager->directionControlManual(control);      // Like the motor loop, on its copy of the command
+    }
+}
+
+static void runConvertSpeed(uint32_t iterations) {
+    int32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += Motor::convertSpeedPercentageToDutyCycle(int16_t(i % 201) - 100);
+    }
+    sink = sum;
+}
+
+/**
+ * @brief One animation frame (the LEDs move towards their target stages), restarted when a one time animation ends.
+ */
+template <AnimationType animation, void (LedManager::*play)()>
+static void runLedFrame(uint32_t iterations) {
+    LedManager* ledManager = LedManager::getInstance();
+    ledManager->resetAnimation();
+    ledManager->setAnimation(animation);
+    for (uint32_t i = 0; i < iterations; i++) {
+        if (ledManager->getCurrentAnimation() != animation) {
+            ledManager->resetAnimation();
+            ledManager->setAnimation(animation);
+        }
+        (ledManager->*play)();
+    }
+}
+
+static void runLedEncode(uint32_t iterations) {
+    uint8_t pixels[18];
+    for (uint32_t i = 0; i < iterations; i++) {
+        memset(pixels, uint8_t(i), sizeof(pixels));
+        Hal::LedStrip::transmit(pixels, sizeof(pixels));
+    }
+}
+
+static void runCameraFrame(uint32_t iterations) {
+    HalCameraFrame frame;
+    for (uint32_t i = 0; i < iterations; i++) {
+        if (Hal::Camera::getFrame(frame)) { Hal::Camera::returnFrame(frame); }
+    }
+}
+
+// The stream runs in its own task: the time is measured end to end, its allocations are not counted
+static void runStreamFrames(uint32_t iterations) {
+    while (iterations > 0) {
+        uint32_t frames = std::min<uint32_t>(iterations, BENCH_STREAM_BATCH_FRAMES);
+        HalHost::failCameraCaptureAfter(frames); // The handler returns after these frames
+        std::shared_ptr<HttpdHostResponse> response = HttpdHost::request(VIDEO_SERVER_PORT, HTTP_GET, "/str");
+        if (response) { response->waitForComplete(BENCH_STREAM_TIMEOUT_MS); }
+        while (ServerManager::getStreamStats().isActive) { std::this_thread::yield(); } // The next stream is refused until then
+        iterations -= frames;
+    }
+    HalHost::failCameraCapture(false);
+}
+
+// Vision: the frames are generated once, the pipeline keeps its previous frame between the runs
+static std::vector<std::vector<uint8_t>> visionFrames;
+static VisionPipeline* visionPipeline = nullptr;
+
+/**
+ * @brief A floor with a light gradient and sensor noise, and a striped obstacle in the center that grows from a
+ * sixth to two thirds of the view over the sequence (the drone drives towards it).
+ */
+static void createVisionFrames() {
+    uint32_t noise = 12345;
+    for (uint8_t i = 0; i < BENCH_VISION_FRAMES; i++) {
+        std::vector<uint8_t> frame(BENCH_VISION_WIDTH * BENCH_VISION_HEIGHT);
+        uint16_t halfWidth = uint16_t(BENCH_VISION_WIDTH / 12 + i * (BENCH_VISION_WIDTH / 3 - BENCH_VISION_WIDTH / 12) / (BENCH_VISION_FRAMES - 1));
+        uint16_t halfHeight = uint16_t(halfWidth * BENCH_VISION_HEIGHT / BENCH_VISION_WIDTH);
+        for (uint16_t y = 0; y < BENCH_VISION_HEIGHT; y++) {
+            for (uint16_t x = 0; x < BENCH_VISION_WIDTH; x++) {
+                noise = noise * 1103515245 + 12345;
+                int32_t value = 90 + x / 4 + y / 3 + int32_t((noise >> 16) % 9) - 4;
+                if (abs(int32_t(x) - BENCH_VISION_WIDTH / 2) < halfWidth && abs(int32_t(y) - BENCH_VISION_HEIGHT * 2 / 3) < halfHeight) {
+                    value = (x / 3) % 2 ? 190 : 50;
+                }
+                frame[y * BENCH_VISION_WIDTH + x] = uint8_t(value);
+            }
+        }
+        visionFrames.push_back(frame);
+    }
+}
+
+static void runVisionSad(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        const uint8_t* frame = visionFrames[i % BENCH_VISION_FRAMES].data();
+        const uint8_t* line = frame + (i % (BENCH_VISION_HEIGHT - 1)) * BENCH_VISION_WIDTH;
+        sum += VisionKernels::sumAbsoluteDifferences(line, line + 1, BENCH_VISION_WIDTH / VISION_GRID_COLUMNS - 1);
+    }
+    sink = int32_t(sum);
+}
+
+static void runVisionCount(uint32_t iterations) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        size_t offset = (i % BENCH_VISION_HEIGHT) * BENCH_VISION_WIDTH;
+        count += VisionKernels::countDifferences(visionFrames[i % BENCH_VISION_FRAMES].data() + offset,
+                                                 visionFrames[(i + 1) % BENCH_VISION_FRAMES].data() + offset,
+                                                 BENCH_VISION_WIDTH / VISION_GRID_COLUMNS, VISION_MOTION_THRESHOLD);
+    }
+    sink = int32_t(count);
+}
+
+static void runVisionFrame(uint32_t iterations) {
+    uint32_t stops = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        memcpy(visionPipeline->getInputBuffer(), visionFrames[i % BENCH_VISION_FRAMES].data(), BENCH_VISION_WIDTH * BENCH_VISION_HEIGHT);
+        VisionResult result;
+        visionPipeline->process(BENCH_VISION_WIDTH, BENCH_VISION_HEIGHT, VISION_PERIOD_MS * 1000, result);
+        stops += result.isStopHint;
+    }
+    sink = int32_t(stops);
+}
+
+// Flight recorder
+static int16_t flightDutyOf(uint32_t loop) { return int16_t(MOTOR_MIN_SPEED + (loop / 25) % (MOTOR_MAX_SPEED - MOTOR_MIN_SPEED)); }
+
+static void runFlightEncode(uint32_t iterations) {
+    static uint8_t block[FLIGHT_RECORDER_BLOCK_SIZE];
+    FlightLogEncoder encoder;
+    uint32_t blocks = 0;
+    int64_t timestampUs = 0;
+    encoder.start(block, sizeof(block), blocks, timestampUs);
+    for (uint32_t i = 0; i < iterations; i++) {
+        int32_t periodUs = MOTOR_CONTROL_PERIOD_MS * 1000 + int32_t(i % 7);
+        timestampUs += periodUs;
+        FlightRecord record = { FlightRecordType::MOTOR, timestampUs, { flightDutyOf(i), flightDutyOf(i), periodUs, int32_t(40 + i % 5) } };
+        if (encoder.append(record) != ESP_OK) {
+            encoder.start(block, sizeof(block), ++blocks, timestampUs);
+            encoder.append(record);
+        }
+    }
+    sink = int32_t(blocks);
+}
+
+static void runFlightRecord(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        FlightRecorder::recordMotorLoop(flightDutyOf(i), flightDutyOf(i), MOTOR_CONTROL_PERIOD_MS * 1000 + i % 7, 40 + i % 5);
+    }
+}
+
+static const Benchmark BENCHMARKS[] = {
+    { "httpd_host_request",     runHarnessRequest,      nullptr },
+    { "mov_handler",            runMoveRequest,         "httpd_host_request" },
+    { "direction_control",      runDirectionControl,    nullptr },
+    { "convert_speed_to_duty",  runConvertSpeed,        nullptr },
+    { "led_idle",               runLedFrame<AnimationType::IDLE, &LedManager::playIdleAnimation>,                       nullptr },
+    { "led_wifi_connecting",    runLedFrame<AnimationType::WIFI_CONNECTING, &LedManager::playWifiConnectingAnimation>,  nullptr },
+    { "led_wifi_connected",     runLedFrame<AnimationType::WIFI_CONNECTED, &LedManager::playWifiConnectedAnimation>,    nullptr },
+    { "led_wifi_disconnected",  runLedFrame<AnimationType::WIFI_DISCONNECTED, &LedManager::playWifiDisconnectedAnimation>, nullptr },
+    { "led_breathing",          runLedFrame<AnimationType::BREATHING, &LedManager::playBreathingAnimation>,             nullptr },
+    { "led_rmt_encode",         runLedEncode,           nullptr },
+    { "camera_host_frame",      runCameraFrame,         nullptr },
+    { "mjpeg_stream_frame",     runStreamFrames,        "camera_host_frame" },
+    { "vision_sad_row",         runVisionSad,           nullptr },
+    { "vision_count_row",       runVisionCount,         nullptr },
+    { "vision_frame",           runVisionFrame,         nullptr, VISION_FRAME_BUDGET_US * 1000 / BENCH_DEVICE_SLOWDOWN },
+    { "flight_log_encode",      runFlightEncode,        nullptr },
+    { "flight_recorder_record", runFlightRecord,        nullptr },
+};
+
+// Measurement --------------------------------------------------------------------------------------------------
+struct BenchmarkResult {
+    double nsPerOp;
+    double allocationsPerOp;
+};
+
+static int64_t getTimeNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static BenchmarkResult measure(const Benchmark& benchmark) {
+    // Calibration: double the iterations until one run takes BENCH_MIN_TIME_MS
+    uint32_t iterations = 16;
+    while (true) {
+        int64_t startNs = getTimeNs();
+        benchmark.run(iterations);
+        if (getTimeNs() - startNs >= int64_t(BENCH_MIN_TIME_MS) * 1000000 || iterations >= (1u << 30)) { break; }
+        iterations *= 2;
+    }
+
+    BenchmarkResult result = { 0, 0 };
+    for (uint8_t repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+        MallocHost::startCounting();
+        int64_t startNs = getTimeNs();
+        benchmark.run(iterations);
+        int64_t elapsedNs = getTimeNs() - startNs;
+        uint64_t allocations = MallocHost::stopCounting();
+        double nsPerOp = double(elapsedNs) / iterations;
+        if (repeat == 0 || nsPerOp < result.nsPerOp) { result.nsPerOp = nsPerOp; }
+        result.allocationsPerOp = double(allocations) / iterations; // Same in every run
+    }
+    return result;
+}
+
+// Baseline -----------------------------------------------------------------------------------------------------
+static bool readBaseline(const char* path, std::map<std::string, BenchmarkResult>& baseline) {
+    FILE* file = fopen(path, "r");
+    if (!file) { return false; }
+    char line[128];
+    while (fgets(line, sizeof(line), file)) {
+        char name[64];
+        BenchmarkResult result;
+        if (line[0] == '#' || sscanf(line, "%63s %lf %lf", name, &result.nsPerOp, &result.allocationsPerOp) != 3) { continue; }
+        baseline[name] = result;
+    }
+    fclose(file);
+    return true;
+}
+
+static bool writeBaseline(const char* path, const std::map<std::string, BenchmarkResult>& results) {
+    FILE* file = fopen(path, "w");
+    if (!file) { return false; }
+    fprintf(file, "# Host benchmark baseline: name ns/op allocations/op (host_benchmarks --write-baseline <file>)\n");
+    for (const Benchmark& benchmark : BENCHMARKS) {
+        auto result = results.find(benchmark.name);
+        if (result == results.end()) { continue; }
+        fprintf(file, "%-24s %10.1f %8.2f\n", benchmark.name, result->second.nsPerOp, result->second.allocationsPerOp);
+    }
+    fclose(file);
+    return true;
+}
+
+// Setup --------------------------------------------------------------------------------------------------------
+static esp_err_t nopHandler(httpd_req_t* req) {
+    return httpd_resp_send(req, nullptr, 0);
+}
+
+static httpd_handle_t harnessServer = nullptr;
+
+static void setUp() {
+    esp_log_level_set("*", ESP_LOG_NONE); // The handlers log, the table is printed with printf
+    ModeManager::init();
+    LedManager::init();
+    StorageManager::init();
+    FlightRecorder::init(); // Like the firmware: the control data of the handlers is recorded
+    MotorManager::getInstance();
+    HalHost::setCameraFrame(HAL_PIXFORMAT_JPEG, 640, 480, BENCH_STREAM_FRAME_LENGTH);
+    CameraManager::init();
+    ServerManager::getInstance()->startServers();
+    createVisionFrames();
+    visionPipeline = new VisionPipeline();
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = BENCH_HARNESS_PORT;
+    httpd_start(&harnessServer, &config);
+    httpd_uri_t nopUri = { .uri = "/nop", .method = HTTP_GET, .handler = nopHandler, .user_ctx = nullptr };
+    httpd_register_uri_handler(harnessServer, &nopUri);
+}
+
+static void tearDown() {
+    httpd_stop(harnessServer);
+    delete visionPipeline;
+    visionPipeline = nullptr;
+    ServerManager::deinit();
+    CameraManager::deinit();
+    MotorManager::deinit();
+    FlightRecorder::deinit();
+    StorageManager::deinit();
+    LedManager::deinit();
+    ModeManager::deinit();
+}
+
+int main(int argc, char** argv) {
+    const char* filter = nullptr;
+    const char* baselinePath = nullptr;
+    const char* writePath = nullptr;
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) { filter = argv[++i]; }
+        else if (!strcmp(argv[i], "--baseline") && i + 1 < argc) { baselinePath = argv[++i]; }
+        else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) { threshold = atof(argv[++i]); }
+        else if (!strcmp(argv[i], "--write-baseline") && i + 1 < argc) { writePath = argv[++i]; }
+        else {
+            fprintf(stderr, "Usage: %s [--filter <text>] [--baseline <file>] [--threshold <percent>] [--write-baseline <file>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::map<std::string, BenchmarkResult> baseline;
+    if (baselinePath && !readBaseline(baselinePath, baseline)) {
+        fprintf(stderr, "Cannot read the baseline: %s\n", baselinePath);
+        return 2;
+    }
+
+    setUp();
+    std::map<std::string, BenchmarkResult> results;
+    std::map<std::string, BenchmarkResult> measured;  // Harnesses included
+    int regressions = 0;
+    printf("%-24s %12s %12s %12s %s\n", "benchmark", "ns/op", "allocs/op", "baseline", "");
+    for (const Benchmark& benchmark : BENCHMARKS) {
+        bool isHarnessNeeded = false;
+        for (const Benchmark& other : BENCHMARKS) {
+            isHarnessNeeded = isHarnessNeeded || (other.harness && !strcmp(other.harness, benchmark.name) && filter && strstr(other.name, filter));
+        }
+        if (filter && !strstr(benchmark.name, filter) && !isHarnessNeeded) { continue; }
+
+        BenchmarkResult result = measure(benchmark);
+        measured[benchmark.name] = result;
+        if (benchmark.harness && measured.count(benchmark.harness)) {
+            const BenchmarkResult& harness = measured[benchmark.harness];
+            result.nsPerOp = std::max(0.0, result.nsPerOp - harness.nsPerOp);
+            result.allocationsPerOp = std::max(0.0, result.allocationsPerOp - harness.allocationsPerOp);
+        }
+        results[benchmark.name] = result;
+
+        char baselineText[16] = "-";
+        const char* verdict = "";
+        if (benchmark.budgetNs && result.nsPerOp > benchmark.budgetNs) {
+            verdict = "OVER BUDGET";
+            regressions++;
+        }
+        auto expected = baseline.find(benchmark.name);
+        if (expected != baseline.end()) {
+            snprintf(baselineText, sizeof(baselineText), "%.1f", expected->second.nsPerOp);
+            bool isSlower = result.nsPerOp > expected->second.nsPerOp * (1 + threshold / 100);
+            bool isAllocating = MallocHost::isCountingAvailable() && result.allocationsPerOp > expected->second.allocationsPerOp + BENCH_ALLOCATION_TOLERANCE;
+            if ((isSlower || isAllocating) && !*verdict) {
+                verdict = isSlower ? "REGRESSION (time)" : "REGRESSION (allocations)";
+                regressions++;
+            }
+        }
+        printf("%-24s %12.1f %12.2f %12s %s\n", benchmark.name, result.nsPerOp, result.allocationsPerOp, baselineText, verdict);
+        fflush(stdout);
+    }
+    tearDown();
+
+    if (!MallocHost::isCountingAvailable()) { printf("Allocations are not counted with the sanitizers\n"); }
+    if (writePath && !writeBaseline(writePath, results)) {
+        fprintf(stderr, "Cannot write the baseline: %s\n", writePath);
+        return 2;
+    }
+    if (baselinePath) { printf("%d regressions (threshold: %.0f%%)\n", regressions, threshold); }
+    return regressions ? 1 : 0;
+}
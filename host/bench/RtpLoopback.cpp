@@ -0,0 +1,229 @@
+/*
+ * File: RtpLoopback.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the RTP/JPEG stream on the loopback interface with packet loss, in frame completeness and latency.
+
+        host_rtp_loopback [--frames <count>] [--loss <percent,...>] [--fec <group size,...>] [--burst <packets>]
+                          [--seed <number>] [--check]
+
+    The sender is RtpStreamManager with the fake camera, the receiver is RtpJpegReceiver behind a lossy shim: every
+    received packet is dropped by a Gilbert-Elliott model (the loss rate, with a mean burst length of --burst packets;
+    1: independent losses). The latency is capture to rebuilt JPEG, both on the host clock. With --check, the exit
+    code is non-zero if a frame is lost without loss, or if FEC completes fewer frames than no FEC at the same loss.
+*/
+
+#include "CameraManager.h"
+#include "HalHost.h"
+#include "RtpJpegReceiver.h"
+#include "RtpStreamManager.h"
+
+// C++
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+// C
+extern "C" {
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "esp_log.h"
+}
+
+#define LOOPBACK_DEFAULT_FRAMES     100
+#define LOOPBACK_CAPTURE_TIME_US    10000   // 100 fps, the stream task spends the rest of the frame sending
+#define LOOPBACK_RECEIVE_TIMEOUT_US 100000  // The stream ended when nothing comes for this long
+#define LOOPBACK_RENEW_MS           1000    // Lease renewal of the client, well within RTP_LEASE_MS
+
+struct LoopbackResult {
+    uint32_t framesSent;
+    uint32_t packetsSent;
+    uint32_t fecPacketsSent;
+    uint32_t packetsDropped;
+    RtpJpegReceiverStats receiver;
+    std::vector<uint32_t> latenciesUs;
+};
+
+/*
+    Gilbert-Elliott loss: every packet is dropped in the bad state, the mean time in the bad state is the burst length.
+*/
+class LossShim {
+public:
+    LossShim(double lossRate, double burstLength, uint32_t seed)
+        : random(seed), isBad(false),
+          goodToBad(lossRate >= 1.0 ? 1.0 : lossRate / (burstLength * (1.0 - lossRate))), badToGood(1.0 / burstLength) {}
+
+    bool isDropped() {
+        isBad = isBad ? uniform(random) >= badToGood : uniform(random) < goodToBad;
+        return isBad;
+    }
+
+private:
+    std::mt19937 random;
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    bool isBad;
+    double goodToBad;
+    double badToGood;
+};
+
+static void onFrame(const RtpJpegFrame& frame, void* context) {
+    LoopbackResult* result = static_cast<LoopbackResult*>(context);
+    uint32_t nowTimestamp = RtpJpegPacketizer::toRtpTimestamp(Hal::Timer::getTimeUs());
+    result->latenciesUs.push_back(uint32_t(uint64_t(nowTimestamp - frame.timestamp) * 100 / 9));
+}
+
+static bool runLoopback(uint32_t frames, double lossRate, uint8_t fecGroupSize, double burstLength, uint32_t seed,
+                        LoopbackResult& result) {
+    result = {};
+    int receiveSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (receiveSocket < 0) { return false; }
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    struct timeval timeout = {0, LOOPBACK_RECEIVE_TIMEOUT_US};
+    int receiveBuffer = 1024 * 1024;    // The bursts of the pacer, the shim drops, not the socket
+    setsockopt(receiveSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(receiveSocket, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+    if (bind(receiveSocket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+        getsockname(receiveSocket, reinterpret_cast<struct sockaddr*>(&address), &length) != 0) {
+        close(receiveSocket);
+        return false;
+    }
+
+    HalHost::reset();
+    HalHost::setCameraCaptureTimeUs(LOOPBACK_CAPTURE_TIME_US);
+    HalHost::failCameraCaptureAfter(frames);
+    CameraManager::init();
+    RtpStreamManager::init();
+    RtpStreamManager* rtpStreamManager = RtpStreamManager::getInstance();
+    bool isStarted = rtpStreamManager->startStream(address.sin_addr.s_addr, ntohs(address.sin_port), fecGroupSize) == ESP_OK;
+
+    LossShim shim(lossRate, burstLength, seed);
+    RtpJpegReceiver receiver(&onFrame, &result);
+    uint8_t packet[2048];
+    int64_t renewUs = Hal::Timer::getTimeUs() + LOOPBACK_RENEW_MS * 1000;
+    while (isStarted) {
+        ssize_t received = recv(receiveSocket, packet, sizeof(packet), 0);
+        if (received > 0) {
+            if (shim.isDropped()) {
+                result.packetsDropped++;
+            } else {
+                receiver.receive(packet, size_t(received));
+            }
+        } else if (!rtpStreamManager->isStreaming()) {
+            break;
+        }
+        if (Hal::Timer::getTimeUs() >= renewUs) {
+            rtpStreamManager->startStream(address.sin_addr.s_addr, ntohs(address.sin_port), fecGroupSize);
+            renewUs += LOOPBACK_RENEW_MS * 1000;
+        }
+    }
+    receiver.flush();
+
+    RtpStreamStats stats = RtpStreamManager::getStats();
+    result.framesSent = stats.framesSent;
+    result.packetsSent = stats.packetsSent;
+    result.fecPacketsSent = stats.fecPacketsSent;
+    result.receiver = receiver.getStats();
+    RtpStreamManager::deinit();
+    CameraManager::deinit();
+    close(receiveSocket);
+    return isStarted;
+}
+
+static std::vector<double> parseList(const char* text) {
+    std::vector<double> values;
+    for (const char* position = text; *position;) {
+        char* end = nullptr;
+        values.push_back(strtod(position, &end));
+        if (end == position) { return {}; }
+        position = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+int main(int argc, char** argv) {
+    uint32_t frames = LOOPBACK_DEFAULT_FRAMES;
+    std::vector<double> lossPercents = {0, 1, 2, 5, 10};
+    std::vector<double> fecGroupSizes = {0, RTP_DEFAULT_FEC_GROUP_SIZE};
+    double burstLength = 1.0;
+    uint32_t seed = 1;
+    bool isCheck = false;
+    bool isUsage = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) { frames = uint32_t(strtoul(argv[++i], nullptr, 10)); }
+        else if (!strcmp(argv[i], "--loss") && i + 1 < argc) { lossPercents = parseList(argv[++i]); }
+        else if (!strcmp(argv[i], "--fec") && i + 1 < argc) { fecGroupSizes = parseList(argv[++i]); }
+        else if (!strcmp(argv[i], "--burst") && i + 1 < argc) { burstLength = atof(argv[++i]); }
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc) { seed = uint32_t(strtoul(argv[++i], nullptr, 10)); }
+        else if (!strcmp(argv[i], "--check")) { isCheck = true; }
+        else { isUsage = true; }
+    }
+    for (double lossPercent : lossPercents) { isUsage = isUsage || lossPercent < 0 || lossPercent >= 100; }
+    for (double fecGroupSize : fecGroupSizes) { isUsage = isUsage || fecGroupSize < 0 || fecGroupSize > RTP_FEC_MAX_GROUP_SIZE; }
+    if (isUsage || frames == 0 || burstLength < 1.0 || lossPercents.empty() || fecGroupSizes.empty()) {
+        fprintf(stderr, "Usage: %s [--frames <count>] [--loss <percent,...>] [--fec <group size,...>] [--burst <packets>] "
+                        "[--seed <number>] [--check]\n", argv[0]);
+        return 2;
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    int failures = 0;
+    printf("%6s %4s %7s %9s %6s %9s %9s %9s %9s %9s\n", "loss", "fec", "frames", "complete", "lost",
+           "recovered", "overhead", "avg ms", "p95 ms", "max ms");
+    for (double lossPercent : lossPercents) {
+        double completeWithoutFec = -1.0;
+        for (double fecGroupSize : fecGroupSizes) {
+            LoopbackResult result;
+            if (!runLoopback(frames, lossPercent / 100.0, uint8_t(fecGroupSize), burstLength, seed, result)) {
+                fprintf(stderr, "The stream did not start\n");
+                return 1;
+            }
+            std::vector<uint32_t>& latencies = result.latenciesUs;
+            std::sort(latencies.begin(), latencies.end());
+            uint64_t totalUs = 0;
+            for (uint32_t latencyUs : latencies) { totalUs += latencyUs; }
+            double complete = result.framesSent ? 100.0 * result.receiver.framesComplete / result.framesSent : 0.0;
+            printf("%5.1f%% %4u %7u %8.1f%% %6u %9u %8.1f%% %9.2f %9.2f %9.2f\n", lossPercent, unsigned(fecGroupSize),
+                   unsigned(result.framesSent), complete, unsigned(result.framesSent - result.receiver.framesComplete),
+                   unsigned(result.receiver.recoveredPackets),
+                   result.packetsSent ? 100.0 * result.fecPacketsSent / result.packetsSent : 0.0,
+                   latencies.empty() ? 0.0 : totalUs / 1000.0 / latencies.size(),
+                   latencies.empty() ? 0.0 : latencies[latencies.size() * 95 / 100] / 1000.0,
+                   latencies.empty() ? 0.0 : latencies.back() / 1000.0);
+
+            if (isCheck && result.framesSent != frames) {
+                fprintf(stderr, "Sent %u of %u frames\n", unsigned(result.framesSent), unsigned(frames));
+                failures++;
+            }
+            if (isCheck && lossPercent == 0 && result.receiver.framesComplete != result.framesSent) {
+                fprintf(stderr, "Frames lost without packet loss\n");
+                failures++;
+            }
+            if (fecGroupSize == 0) {
+                completeWithoutFec = complete;
+            } else if (isCheck && completeWithoutFec >= 0 && complete < completeWithoutFec) {
+                fprintf(stderr, "FEC %u completed fewer frames than no FEC at %.1f%% loss\n", unsigned(fecGroupSize), lossPercent);
+                failures++;
+            }
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,314 @@
+/*
+ * File: VisionFlow.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the optical flow odometry of VisionPipeline on frame sequences with ground truth, in accuracy and
+    time per frame.
+
+        host_vision_flow [--frames <count>] [--noise <gray levels>] [--seed <number>] [--check]
+                         [--record <file>] [--input <file>]
+
+    Without --input, every scenario (a forward speed and a yaw rate) is rendered: a level camera with the geometry of
+    the flow model (VisionPipeline.h) drives over a textured floor, 4 x 4 samples per thumbnail pixel, with Gaussian
+    sensor noise and a jittered frame interval. --record writes the sequences, --input replays recorded ones:
+
+        VFLOW <width> <height>
+        <scenario> <interval us> <forward mm/s> <yaw rate decidegrees/s>    per frame, then width x height gray bytes
+
+    The first frame of a scenario has no flow. With --check, the exit code is non-zero if a scenario is below
+    FLOW_CHECK_VALID_PERCENT valid estimates or above the error limits.
+*/
+
+#include "VisionPipeline.h"
+
+// C++
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+// C
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+}
+
+#define FLOW_DEFAULT_FRAMES         100
+#define FLOW_DEFAULT_NOISE          2.0     // Gray levels, the sensor noise of a lit floor at 1/8 scale
+#define FLOW_WIDTH                  80      // VGA at 1/8 scale
+#define FLOW_HEIGHT                 60
+#define FLOW_INTERVAL_US            100000  // VISION_PERIOD_MS
+#define FLOW_INTERVAL_JITTER_US     10000
+#define FLOW_SUBSAMPLES             4       // Per pixel and axis
+#define FLOW_TEXTURE_SCALE_MM       12.0f   // Finest texture detail, a carpet or a wood floor
+#define FLOW_CHECK_VALID_PERCENT    90.0
+#define FLOW_CHECK_FORWARD_MM_S     40.0    // Mean absolute error
+#define FLOW_CHECK_YAW_DDEG_S       40.0
+
+struct FlowFrame {
+    std::string scenario;
+    uint32_t intervalUs;
+    int32_t forwardMmPerS;          // Ground truth
+    int32_t yawRateDeciDegPerS;
+    std::vector<uint8_t> pixels;
+};
+
+struct Scenario {
+    const char* name;
+    float forwardMmPerS;
+    float yawRateRadPerS;           // Positive: right
+};
+
+static const Scenario SCENARIOS[] = {
+    { "stop",       0.0f,   0.0f },
+    { "slow",       80.0f,  0.0f },
+    { "straight",   250.0f, 0.0f },
+    { "reverse",    -150.0f, 0.0f },
+    { "turn",       0.0f,   0.5f },
+    { "arc",        180.0f, -0.3f },
+};
+
+// Rendering ----------------------------------------------------------------------------------------------------
+/*
+    Value noise: random gray levels on an integer lattice, smoothly interpolated, three octaves. Not periodic, so a
+    match is never ambiguous over the search range.
+*/
+class FloorTexture {
+public:
+    explicit FloorTexture(uint32_t seed) : seed(seed * 0x9E3779B9u) {}
+
+    float sample(float x, float y) const {
+        return octave(x, y) * 0.5f + octave(x * 2.1f + 17.0f, y * 2.1f) * 0.3f + octave(x * 4.3f, y * 4.3f + 31.0f) * 0.2f;
+    }
+
+private:
+    uint32_t seed;
+
+    float lattice(int32_t x, int32_t y) const {
+        uint32_t hash = (uint32_t(x) * 73856093u) ^ (uint32_t(y) * 19349663u) ^ seed;
+        hash ^= hash >> 13;
+        hash *= 0x5BD1E995u;
+        hash ^= hash >> 15;
+        return float(hash & 0xFF);
+    }
+
+    float octave(float x, float y) const {
+        float cellX = floorf(x);
+        float cellY = floorf(y);
+        float fractionX = x - cellX;
+        float fractionY = y - cellY;
+        fractionX = fractionX * fractionX * (3 - 2 * fractionX);
+        fractionY = fractionY * fractionY * (3 - 2 * fractionY);
+        int32_t left = int32_t(cellX);
+        int32_t top = int32_t(cellY);
+        float upper = lattice(left, top) + (lattice(left + 1, top) - lattice(left, top)) * fractionX;
+        float lower = lattice(left, top + 1) + (lattice(left + 1, top + 1) - lattice(left, top + 1)) * fractionX;
+        return upper + (lower - upper) * fractionY;
+    }
+};
+
+/**
+ * @brief The thumbnail of the level camera at the given floor position (mm) and heading (radians, positive: right).
+ */
+static void renderFrame(const FloorTexture& texture, float rightMm, float forwardMm, float heading, float noise,
+                        std::mt19937& random, std::vector<uint8_t>& pixels) {
+    const float focal = FLOW_WIDTH * VISION_FOCAL_PERMILLE / 1000.0f;
+    const float horizon = FLOW_HEIGHT * VISION_HORIZON_PERMILLE / 1000.0f;
+    const float cosHeading = cosf(heading);
+    const float sinHeading = sinf(heading);
+    std::normal_distribution<float> sensorNoise(0.0f, noise > 0 ? noise : 1.0f);
+    pixels.resize(FLOW_WIDTH * FLOW_HEIGHT);
+    for (uint16_t y = 0; y < FLOW_HEIGHT; y++) {
+        for (uint16_t x = 0; x < FLOW_WIDTH; x++) {
+            float sum = 0;
+            for (uint8_t subY = 0; subY < FLOW_SUBSAMPLES; subY++) {
+                for (uint8_t subX = 0; subX < FLOW_SUBSAMPLES; subX++) {
+                    float v = y + (subY + 0.5f) / FLOW_SUBSAMPLES - horizon;
+                    if (v <= 0.5f) { sum += 110; continue; } // The far wall
+                    float depth = VISION_CAMERA_HEIGHT_MM * focal / v;
+                    float side = (x + (subX + 0.5f) / FLOW_SUBSAMPLES - FLOW_WIDTH / 2.0f) * depth / focal;
+                    float worldX = rightMm + side * cosHeading + depth * sinHeading;
+                    float worldZ = forwardMm - side * sinHeading + depth * cosHeading;
+                    sum += 40 + 0.7f * texture.sample(worldX / FLOW_TEXTURE_SCALE_MM, worldZ / FLOW_TEXTURE_SCALE_MM);
+                }
+            }
+            float value = sum / (FLOW_SUBSAMPLES * FLOW_SUBSAMPLES) + (noise > 0 ? sensorNoise(random) : 0.0f);
+            pixels[y * FLOW_WIDTH + x] = uint8_t(value < 0 ? 0 : value > 255 ? 255 : lroundf(value));
+        }
+    }
+}
+
+static void renderScenario(const Scenario& scenario, uint32_t frames, float noise, uint32_t seed,
+                           std::vector<FlowFrame>& sequence) {
+    FloorTexture texture(seed);
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int32_t> jitter(-FLOW_INTERVAL_JITTER_US, FLOW_INTERVAL_JITTER_US);
+    float rightMm = 0;
+    float forwardMm = 0;
+    float heading = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        FlowFrame frame;
+        frame.scenario = scenario.name;
+        frame.intervalUs = i ? uint32_t(FLOW_INTERVAL_US + jitter(random)) : 0;
+        frame.forwardMmPerS = lroundf(scenario.forwardMmPerS);
+        frame.yawRateDeciDegPerS = lroundf(scenario.yawRateRadPerS * 1800.0f / float(M_PI));
+        // The move of the interval, along the mean heading of the interval
+        const float seconds = frame.intervalUs / 1000000.0f;
+        const float turn = scenario.yawRateRadPerS * seconds;
+        rightMm += scenario.forwardMmPerS * seconds * sinf(heading + turn / 2);
+        forwardMm += scenario.forwardMmPerS * seconds * cosf(heading + turn / 2);
+        heading += turn;
+        renderFrame(texture, rightMm, forwardMm, heading, noise, random, frame.pixels);
+        sequence.push_back(std::move(frame));
+    }
+}
+
+// Recordings ---------------------------------------------------------------------------------------------------
+static bool writeSequence(const char* path, const std::vector<FlowFrame>& sequence) {
+    FILE* file = fopen(path, "wb");
+    if (!file) { return false; }
+    bool isWritten = fprintf(file, "VFLOW %u %u\n", unsigned(FLOW_WIDTH), unsigned(FLOW_HEIGHT)) > 0;
+    for (const FlowFrame& frame : sequence) {
+        isWritten = isWritten && fprintf(file, "%s %u %d %d\n", frame.scenario.c_str(), unsigned(frame.intervalUs),
+                                         int(frame.forwardMmPerS), int(frame.yawRateDeciDegPerS)) > 0;
+        isWritten = isWritten && fwrite(frame.pixels.data(), 1, frame.pixels.size(), file) == frame.pixels.size();
+    }
+    return fclose(file) == 0 && isWritten;
+}
+
+static bool readSequence(const char* path, uint16_t& width, uint16_t& height, std::vector<FlowFrame>& sequence) {
+    FILE* file = fopen(path, "rb");
+    if (!file) { return false; }
+    unsigned fileWidth = 0;
+    unsigned fileHeight = 0;
+    bool isRead = fscanf(file, "VFLOW %u %u", &fileWidth, &fileHeight) == 2 && fgetc(file) == '\n' &&
+                  VisionPipeline::isSupported(uint16_t(fileWidth), uint16_t(fileHeight)) &&
+                  fileWidth <= VISION_MAX_WIDTH && fileHeight <= VISION_MAX_HEIGHT;
+    char name[32];
+    unsigned intervalUs;
+    int forward;
+    int yaw;
+    while (isRead && fscanf(file, "%31s %u %d %d", name, &intervalUs, &forward, &yaw) == 4) {
+        FlowFrame frame = { name, intervalUs, forward, yaw, std::vector<uint8_t>(fileWidth * fileHeight) };
+        isRead = fgetc(file) == '\n' && fread(frame.pixels.data(), 1, frame.pixels.size(), file) == frame.pixels.size();
+        sequence.push_back(std::move(frame));
+    }
+    isRead = isRead && feof(file) && !sequence.empty();
+    fclose(file);
+    width = uint16_t(fileWidth);
+    height = uint16_t(fileHeight);
+    return isRead;
+}
+
+// Evaluation ---------------------------------------------------------------------------------------------------
+struct FlowAccuracy {
+    uint32_t frames;                // With a previous frame of the same scenario
+    uint32_t valid;                 // With a flow estimate
+    double forwardErrorSum;         // Absolute errors of the valid frames
+    double yawErrorSum;
+    double forwardBiasSum;
+    double yawBiasSum;
+    double processUs;               // All frames
+};
+
+/**
+ * @brief Run the pipeline over the frames [first, last) of one scenario.
+ */
+static FlowAccuracy evaluate(const std::vector<FlowFrame>& sequence, size_t first, size_t last, uint16_t width, uint16_t height) {
+    FlowAccuracy accuracy = {};
+    VisionPipeline pipeline;
+    for (size_t i = first; i < last; i++) {
+        const FlowFrame& frame = sequence[i];
+        memcpy(pipeline.getInputBuffer(), frame.pixels.data(), frame.pixels.size());
+        VisionResult result;
+        auto start = std::chrono::steady_clock::now();
+        pipeline.process(width, height, i == first ? 0 : frame.intervalUs, result);
+        accuracy.processUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        if (i == first) { continue; }
+        accuracy.frames++;
+        if (!result.flowBlocks) { continue; }
+        accuracy.valid++;
+        accuracy.forwardErrorSum += fabs(double(result.forwardMmPerS) - frame.forwardMmPerS);
+        accuracy.yawErrorSum += fabs(double(result.yawRateDeciDegPerS) - frame.yawRateDeciDegPerS);
+        accuracy.forwardBiasSum += double(result.forwardMmPerS) - frame.forwardMmPerS;
+        accuracy.yawBiasSum += double(result.yawRateDeciDegPerS) - frame.yawRateDeciDegPerS;
+    }
+    return accuracy;
+}
+
+int main(int argc, char** argv) {
+    uint32_t frames = FLOW_DEFAULT_FRAMES;
+    double noise = FLOW_DEFAULT_NOISE;
+    uint32_t seed = 1;
+    bool isCheck = false;
+    bool isUsage = false;
+    const char* recordPath = nullptr;
+    const char* inputPath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) { frames = uint32_t(strtoul(argv[++i], nullptr, 10)); }
+        else if (!strcmp(argv[i], "--noise") && i + 1 < argc) { noise = atof(argv[++i]); }
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc) { seed = uint32_t(strtoul(argv[++i], nullptr, 10)); }
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc) { recordPath = argv[++i]; }
+        else if (!strcmp(argv[i], "--input") && i + 1 < argc) { inputPath = argv[++i]; }
+        else if (!strcmp(argv[i], "--check")) { isCheck = true; }
+        else { isUsage = true; }
+    }
+    if (isUsage || frames < 2 || noise < 0 || (recordPath && inputPath)) {
+        fprintf(stderr, "Usage: %s [--frames <count>] [--noise <gray levels>] [--seed <number>] [--check] "
+                        "[--record <file>] [--input <file>]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<FlowFrame> sequence;
+    uint16_t width = FLOW_WIDTH;
+    uint16_t height = FLOW_HEIGHT;
+    if (inputPath) {
+        if (!readSequence(inputPath, width, height, sequence)) {
+            fprintf(stderr, "Could not read the recording %s\n", inputPath);
+            return 1;
+        }
+    } else {
+        for (const Scenario& scenario : SCENARIOS) { renderScenario(scenario, frames, float(noise), seed, sequence); }
+    }
+    if (recordPath && !writeSequence(recordPath, sequence)) {
+        fprintf(stderr, "Could not write the recording %s\n", recordPath);
+        return 1;
+    }
+
+    int failures = 0;
+    printf("%-10s %7s %7s %10s %10s %10s %10s %9s\n", "scenario", "frames", "valid", "fwd mae", "fwd bias",
+           "yaw mae", "yaw bias", "ms/frame");
+    for (size_t first = 0; first < sequence.size();) {
+        size_t last = first + 1;
+        while (last < sequence.size() && sequence[last].scenario == sequence[first].scenario) { last++; }
+        FlowAccuracy accuracy = evaluate(sequence, first, last, width, height);
+        const double validPercent = accuracy.frames ? 100.0 * accuracy.valid / accuracy.frames : 0.0;
+        const double forwardError = accuracy.valid ? accuracy.forwardErrorSum / accuracy.valid : 0.0;
+        const double yawError = accuracy.valid ? accuracy.yawErrorSum / accuracy.valid : 0.0;
+        printf("%-10s %7u %6.1f%% %5.1f mm/s %5.1f mm/s %4.1f dd/s %4.1f dd/s %9.3f\n", sequence[first].scenario.c_str(),
+               unsigned(accuracy.frames), validPercent, forwardError,
+               accuracy.valid ? accuracy.forwardBiasSum / accuracy.valid : 0.0, yawError,
+               accuracy.valid ? accuracy.yawBiasSum / accuracy.valid : 0.0, accuracy.processUs / 1000.0 / (last - first));
+
+        if (isCheck && (validPercent < FLOW_CHECK_VALID_PERCENT || forwardError > FLOW_CHECK_FORWARD_MM_S ||
+                        yawError > FLOW_CHECK_YAW_DDEG_S)) {
+            fprintf(stderr, "%s: %.1f%% valid, %.1f mm/s, %.1f decidegrees/s of mean error\n", sequence[first].scenario.c_str(),
+                    validPercent, forwardError, yawError);
+            failures++;
+        }
+        first = last;
+    }
+    return failures ? 1 : 0;
+}
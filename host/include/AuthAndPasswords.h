@@ -0,0 +1,19 @@
+/*
+ * File: AuthAndPasswords.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+/*
+    Host build: placeholder for the not versioned include/AuthAndPasswords.h (include/ is searched first, so a local
+    AuthAndPasswords.h is still used). AUTH_AND_PASSWORDS is not defined, the managers use the default credentials.
+*/
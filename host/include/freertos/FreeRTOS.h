@@ -0,0 +1,57 @@
+/*
+ * File: FreeRTOS.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+/*
+    Host build: the part of the FreeRTOS API that the managers use, implemented with POSIX threads (host/FreeRtosHost.cpp).
+    A task is a thread, the tick is one millisecond, the priorities are only reported, the affinity sets xPortGetCoreID().
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE                         0
+#define pdTRUE                          1
+#define pdFAIL                          pdFALSE
+#define pdPASS                          pdTRUE
+
+#define configTICK_RATE_HZ              1000
+#define configMAX_TASK_NAME_LEN         16
+#define configUSE_TRACE_FACILITY        1
+#define configGENERATE_RUN_TIME_STATS   1
+#define configRUN_TIME_COUNTER_TYPE     uint32_t
+
+#define portMAX_DELAY                   ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS              ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portNUM_PROCESSORS              2
+#define pdMS_TO_TICKS(xTimeInMs)        ((TickType_t)(((TickType_t)(xTimeInMs) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+
+#define tskNO_AFFINITY                  ((BaseType_t)0x7FFFFFFF)
+
+/**
+ * @brief The core of the task pinned with xTaskCreatePinnedToCore(), 0 for the other threads.
+ */
+BaseType_t xPortGetCoreID(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,85 @@
+/*
+ * File: task.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+typedef enum {
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid
+} eTaskState;
+
+typedef struct {
+    TaskHandle_t xHandle;
+    const char* pcTaskName;
+    UBaseType_t xTaskNumber;
+    eTaskState eCurrentState;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    configRUN_TIME_COUNTER_TYPE ulRunTimeCounter;   // Host: CPU time of the thread in microseconds
+    void* pxStackBase;
+    uint32_t usStackHighWaterMark;                  // Host: not measured, the stack depth of the task
+    BaseType_t xCoreID;
+} TaskStatus_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char* pcName, uint32_t usStackDepth, void* pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t* pxCreatedTask, BaseType_t xCoreID);
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char* pcName, uint32_t usStackDepth, void* pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t* pxCreatedTask);
+
+/**
+ * @brief Delete a task (NULL: the calling task).
+ *
+ * @note Host: another task is stopped at its next blocking call (vTaskDelay, ulTaskNotifyTake, xSemaphoreTake),
+ * the call waits for it.
+ */
+void vTaskDelete(TaskHandle_t xTaskToDelete);
+
+void vTaskDelay(TickType_t xTicksToDelay);
+
+void vTaskDelayUntil(TickType_t* pxPreviousWakeTime, TickType_t xTimeIncrement);
+
+BaseType_t xTaskDelayUntil(TickType_t* pxPreviousWakeTime, TickType_t xTimeIncrement);
+
+TickType_t xTaskGetTickCount(void);
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+const char* pcTaskGetName(TaskHandle_t xTaskToQuery);
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask);
+
+UBaseType_t uxTaskGetNumberOfTasks(void);
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* pxTaskStatusArray, UBaseType_t uxArraySize, configRUN_TIME_COUNTER_TYPE* pulTotalRunTime);
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,272 @@
+/*
+ * File: CameraManagerHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: which camera settings are written to the sensor live and which reinitialize the driver (new frame
+    buffers). The fake sensor (host/HalHost.cpp) records the register writes and the driver inits.
+*/
+
+#include "CameraManager.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+class CameraManagerHostTest : public testing::Test {
+protected:
+    CameraManager* cameraManager = nullptr;
+    CameraSettings defaults;
+
+    void SetUp() override {
+        HalHost::reset();
+        CameraManager::init();
+        cameraManager = CameraManager::getInstance();
+        ASSERT_TRUE(cameraManager);
+        defaults = cameraManager->getSettings();
+    }
+
+    void TearDown() override {
+        CameraManager::deinit();
+    }
+};
+
+TEST_F(CameraManagerHostTest, DefaultsComeFromTheConfiguration) {
+    EXPECT_EQ(defaults.frameSize, CAMERA_FRAMESIZE);
+    EXPECT_EQ(defaults.jpegQuality, CAMERA_JPEG_QUALITY);
+    EXPECT_EQ(defaults.frameBufferCount, CAMERA_FB_COUNT);
+    EXPECT_EQ(defaults.xclkFrequencyHz, uint32_t(CAMERA_XCLK_FREQ_HZ));
+    EXPECT_EQ(defaults.isGrabLatest, CAMERA_GRAB_LATEST);
+    EXPECT_TRUE(defaults.isAutoGain);
+    EXPECT_TRUE(defaults.isAutoExposure);
+    EXPECT_EQ(defaults.window.width, 0);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 1u);
+}
+
+TEST_F(CameraManagerHostTest, SensorSettingsAreAppliedLive) {
+    CameraSettings settings = defaults;
+    settings.frameSize = HAL_FRAMESIZE_QVGA;
+    settings.jpegQuality = 20;
+    settings.isAutoGain = false;
+    settings.gain = 12;
+    settings.isAutoExposure = false;
+    settings.exposure = 600;
+    EXPECT_FALSE(cameraManager->requiresReallocation(settings));
+    ASSERT_EQ(cameraManager->applySettings(settings, false), ESP_OK);
+
+    EXPECT_EQ(cameraManager->getLastSwitch().type, CameraSwitchType::LIVE);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 1u);
+    HalHostCameraSensor sensor = HalHost::getCameraSensor();
+    EXPECT_EQ(sensor.frameSize, HAL_FRAMESIZE_QVGA);
+    EXPECT_EQ(sensor.jpegQuality, 20);
+    EXPECT_FALSE(sensor.isAutoGain);
+    EXPECT_EQ(sensor.gain, 12);
+    EXPECT_FALSE(sensor.isAutoExposure);
+    EXPECT_EQ(sensor.exposure, 600);
+    EXPECT_EQ(sensor.writeCount, 4u);
+
+    HalCameraFrame frame;
+    ASSERT_TRUE(Hal::Camera::getFrame(frame));
+    EXPECT_EQ(frame.width, 320);
+    EXPECT_EQ(frame.height, 240);
+    Hal::Camera::returnFrame(frame);
+}
+
+TEST_F(CameraManagerHostTest, OnlyTheChangedSettingsAreWritten) {
+    ASSERT_EQ(cameraManager->applySettings(defaults, false), ESP_OK);
+    EXPECT_EQ(cameraManager->getLastSwitch().type, CameraSwitchType::NONE);
+    EXPECT_EQ(HalHost::getCameraSensor().writeCount, 0u);
+
+    CameraSettings settings = defaults;
+    settings.gain = 20; // Not used with automatic gain
+    ASSERT_EQ(cameraManager->applySettings(settings, false), ESP_OK);
+    EXPECT_EQ(HalHost::getCameraSensor().writeCount, 0u);
+
+    settings.jpegQuality = 30;
+    ASSERT_EQ(cameraManager->applySettings(settings, false), ESP_OK);
+    EXPECT_EQ(HalHost::getCameraSensor().writeCount, 1u);
+}
+
+TEST_F(CameraManagerHostTest, FrameSizeUpToTheAllocatedOneIsLive) {
+    CameraSettings settings = defaults;
+    settings.frameSize = HAL_FRAMESIZE_QQVGA;
+    ASSERT_EQ(cameraManager->applySettings(settings, false), ESP_OK);
+    settings.frameSize = CAMERA_FRAMESIZE; // Back up to the frame size of the buffers
+    EXPECT_FALSE(cameraManager->requiresReallocation(settings));
+    ASSERT_EQ(cameraManager->applySettings(settings, false), ESP_OK);
+    EXPECT_EQ(cameraManager->getLastSwitch().type, CameraSwitchType::LIVE);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 1u);
+}
+
+TEST_F(CameraManagerHostTest, BiggerFrameSizeReallocates) {
+    CameraSettings settings = defaults;
+    settings.frameSize = HAL_FRAMESIZE_SVGA;
+    settings.isAutoGain = false;
+    settings.gain = 5;
+    EXPECT_TRUE(cameraManager->requiresReallocation(settings));
+
+    // Not allowed (the stream holds frame buffers): nothing changes
+    EXPECT_EQ(cameraManager->applySettings(settings, false), ESP_ERR_INVALID_STATE);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 1u);
+    EXPECT_EQ(HalHost::getCameraSensor().writeCount, 0u);
+    EXPECT_EQ(cameraManager->getSettings().frameSize, CAMERA_FRAMESIZE);
+
+    ASSERT_EQ(cameraManager->applySettings(settings, true), ESP_OK);
+    EXPECT_EQ(cameraManager->getLastSwitch().type, CameraSwitchType::REALLOCATED);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 2u);
+    EXPECT_EQ(HalHost::getCameraConfig().frameSize, HAL_FRAMESIZE_SVGA);
+    HalHostCameraSensor sensor = HalHost::getCameraSensor();
+    EXPECT_EQ(sensor.frameSize, HAL_FRAMESIZE_SVGA);    // Set by the init
+    EXPECT_FALSE(sensor.isAutoGain);                    // Written after the init
+    EXPECT_EQ(sensor.gain, 5);
+
+    // The buffers are SVGA now: VGA and SVGA are live
+    settings.frameSize = CAMERA_FRAMESIZE;
+    EXPECT_FALSE(cameraManager->requiresReallocation(settings));
+}
+
+TEST_F(CameraManagerHostTest, FrameBufferCountGrabModeAndXclkReallocate) {
+    CameraSettings settings = defaults;
+    settings.frameBufferCount = CAMERA_FB_COUNT + 1;
+    EXPECT_TRUE(cameraManager->requiresReallocation(settings));
+    ASSERT_EQ(cameraManager->applySettings(settings, true), ESP_OK);
+    EXPECT_EQ(HalHost::getCameraConfig().frameBufferCount, CAMERA_FB_COUNT + 1);
+
+    settings.isGrabLatest = !CAMERA_GRAB_LATEST;
+    EXPECT_TRUE(cameraManager->requiresReallocation(settings));
+    ASSERT_EQ(cameraManager->applySettings(settings, true), ESP_OK);
+    EXPECT_EQ(HalHost::getCameraConfig().isGrabLatest, !CAMERA_GRAB_LATEST);
+
+    settings.xclkFrequencyHz = CAMERA_XCLK_FREQ_MIN_HZ;
+    EXPECT_TRUE(cameraManager->requiresReallocation(settings));
+    ASSERT_EQ(cameraManager->applySettings(settings, true), ESP_OK);
+    EXPECT_EQ(HalHost::getCameraConfig().xclkFrequencyHz, uint32_t(CAMERA_XCLK_FREQ_MIN_HZ));
+    EXPECT_EQ(HalHost::getCameraInitCount(), 4u);
+}
+
+TEST_F(CameraManagerHostTest, WindowIsLiveAndResetByTheFrameSize) {
+    CameraSettings settings = defaults;
+    settings.window = { 400, 300, 800, 600 };
+    ASSERT_EQ(cameraManager->applySettings(settings, false), ESP_OK);
+    EXPECT_EQ(HalHost::getCameraSensor().window.width, 800);
+
+    // A new frame size resets the window of the sensor, it is written again after it
+    settings.frameSize = HAL_FRAMESIZE_QVGA;
+    ASSERT_EQ(cameraManager->applySettings(settings, false), ESP_OK);
+    HalHostCameraSensor sensor = HalHost::getCameraSensor();
+    EXPECT_EQ(sensor.frameSize, HAL_FRAMESIZE_QVGA);
+    EXPECT_EQ(sensor.window.offsetX, 400);
+    EXPECT_EQ(sensor.window.width, 800);
+
+    settings.window = {};
+    ASSERT_EQ(cameraManager->applySettings(settings, false), ESP_OK);
+    EXPECT_EQ(HalHost::getCameraSensor().window.width, 0);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 1u);
+}
+
+TEST_F(CameraManagerHostTest, InvalidSettingsAreRejected) {
+    CameraSettings settings = defaults;
+    settings.window = { 0, 0, 320, 240 };               // Smaller than the VGA output, the sensor cannot scale up
+    EXPECT_EQ(cameraManager->applySettings(settings, true), ESP_ERR_INVALID_ARG);
+    settings.window = { 1000, 0, 800, 600 };            // Out of the sensor
+    EXPECT_EQ(cameraManager->applySettings(settings, true), ESP_ERR_INVALID_ARG);
+    settings = defaults;
+    settings.jpegQuality = CAMERA_JPEG_QUALITY_MAX + 1;
+    EXPECT_EQ(cameraManager->applySettings(settings, true), ESP_ERR_INVALID_ARG);
+    settings = defaults;
+    settings.frameBufferCount = 0;
+    EXPECT_EQ(cameraManager->applySettings(settings, true), ESP_ERR_INVALID_ARG);
+    EXPECT_EQ(HalHost::getCameraSensor().writeCount, 0u);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 1u);
+}
+
+TEST_F(CameraManagerHostTest, PoweredDownSensorIsNotChanged) {
+    cameraManager->powerDown();
+    CameraSettings settings = defaults;
+    settings.jpegQuality = 30;
+    EXPECT_EQ(cameraManager->applySettings(settings, false), ESP_ERR_INVALID_STATE);
+    cameraManager->powerUp();
+    EXPECT_EQ(cameraManager->applySettings(settings, false), ESP_OK);
+}
+
+// Endpoint -----------------------------------------------------------------------------------------------------
+class CameraEndpointHostTest : public CameraManagerHostTest {
+protected:
+    ServerManager* serverManager = nullptr;
+
+    void SetUp() override {
+        CameraManagerHostTest::SetUp();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        serverManager = ServerManager::getInstance();
+        serverManager->startServers();
+        ASSERT_TRUE(serverManager->isVideoServerRunning());
+    }
+
+    void TearDown() override {
+        ServerManager::deinit();
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+        CameraManagerHostTest::TearDown();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> get(const char* uri) {
+        return HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, uri);
+    }
+};
+
+TEST_F(CameraEndpointHostTest, ReportsTheSettings) {
+    std::shared_ptr<HttpdHostResponse> response = get("/cam");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_EQ(response->getType(), "application/json");
+    EXPECT_NE(response->getBody().find("\"frameSize\":8,\"quality\":12,\"frameBuffers\":3,\"xclk\":20000000,\"grabLatest\":true"), std::string::npos);
+    EXPECT_NE(response->getBody().find("\"gain\":-1,\"exposure\":-1,\"window\":[0,0,0,0]"), std::string::npos);
+}
+
+TEST_F(CameraEndpointHostTest, LiveChangeKeepsTheStream) {
+    std::shared_ptr<HttpdHostResponse> response = get("/cam?F=5&Q=15&G=8&E=-1");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_NE(response->getBody().find("\"frameSize\":5,\"quality\":15"), std::string::npos);
+    EXPECT_NE(response->getBody().find("\"gain\":8"), std::string::npos);
+    EXPECT_NE(response->getBody().find("\"switch\":\"live\""), std::string::npos);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 1u);
+    EXPECT_TRUE(serverManager->isVideoServerRunning());
+}
+
+TEST_F(CameraEndpointHostTest, ReallocationRestartsTheStream) {
+    std::shared_ptr<HttpdHostResponse> response = get("/cam?F=9&B=4&W=0");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_NE(response->getBody().find("\"switch\":\"reallocated\""), std::string::npos);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 2u);
+    EXPECT_EQ(HalHost::getCameraConfig().frameBufferCount, 4);
+    EXPECT_TRUE(serverManager->isVideoServerRunning());
+}
+
+TEST_F(CameraEndpointHostTest, InvalidQueryIsRejected) {
+    for (const char* uri : { "/cam?F=14", "/cam?Q=abc", "/cam?G=31", "/cam?W=1,2,3", "/cam?W=0,0,100,100", "/cam?B=0" }) {
+        std::shared_ptr<HttpdHostResponse> response = get(uri);
+        ASSERT_TRUE(response) << uri;
+        EXPECT_EQ(response->getStatus(), 400) << uri;
+    }
+    EXPECT_EQ(HalHost::getCameraSensor().writeCount, 0u);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 1u);
+}
@@ -0,0 +1,187 @@
+/*
+ * File: CaptureLatencyHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: simulation of the capture and send timing of the stream, in virtual time (the fake camera of HalHost
+    captures on request, it has no free running sensor). The model follows the frame buffer queue of the esp32-camera
+    driver:
+        - the sensor delivers a frame every frame period into a free buffer, the frame is dropped if there is none,
+        - wait for an empty buffer (CAMERA_GRAB_WHEN_EMPTY): the finished frames are queued, the oldest is handed out,
+        - grab the latest (CAMERA_GRAB_LATEST): a finished frame replaces the queued one, the newest is handed out,
+        - the stream holds one buffer while it sends the frame (the Wi-Fi send time varies per frame).
+    The age is the time a frame waited from its capture to the start of its send, the part of the glass-to-glass
+    latency the capture mode decides.
+*/
+
+#include "CameraManager.h"
+
+// C++
+#include <deque>
+#include <vector>
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define SIMULATION_FRAMES           2000
+#define SIMULATION_FRAME_PERIOD_US  40000   // 25 fps (VGA JPEG at 20 MHz XCLK)
+
+struct CaptureModel {
+    uint8_t frameBufferCount;
+    bool isGrabLatest;
+    std::vector<uint32_t> sendTimesUs;      // Used in a cycle
+};
+
+struct CaptureResult {
+    uint32_t framesSent;
+    uint32_t framesDropped;                 // By the driver (no free buffer, or replaced by a newer frame)
+    double averageAgeUs;                    // Capture to send start
+    double averageLatencyUs;                // Capture to sent
+    uint32_t maxAgeUs;
+    double framesPerSecond;                 // Sent
+};
+
+enum class BufferState : uint8_t { FREE, CAPTURING, READY, SENDING };
+
+static CaptureResult simulate(const CaptureModel& model) {
+    std::vector<BufferState> buffers(model.frameBufferCount, BufferState::FREE);
+    std::vector<int64_t> captureUs(model.frameBufferCount, 0);
+    std::deque<uint8_t> readyQueue;
+    int capturing = -1;                     // The buffer of the sensor
+    int sending = -1;                       // The buffer of the stream
+    int64_t sendEndUs = 0;
+    int64_t sendStartUs = 0;
+    uint32_t sendIndex = 0;
+    CaptureResult result = {};
+    double totalAgeUs = 0;
+    double totalLatencyUs = 0;
+
+    int64_t nextFrameUs = 0;
+    while (result.framesSent < SIMULATION_FRAMES) {
+        bool isFrameBoundary = sending < 0 || nextFrameUs <= sendEndUs;
+        int64_t nowUs = isFrameBoundary ? nextFrameUs : sendEndUs;
+
+        if (isFrameBoundary) {
+            // The frame of the sensor is finished
+            if (capturing >= 0) {
+                if (model.isGrabLatest) {
+                    for (uint8_t older : readyQueue) { buffers[older] = BufferState::FREE; result.framesDropped++; }
+                    readyQueue.clear();
+                }
+                buffers[capturing] = BufferState::READY;
+                captureUs[capturing] = nowUs;
+                readyQueue.push_back(uint8_t(capturing));
+                capturing = -1;
+            }
+            // The next frame starts if there is a free buffer
+            for (uint8_t i = 0; i < model.frameBufferCount && capturing < 0; i++) {
+                if (buffers[i] == BufferState::FREE) { capturing = i; }
+            }
+            if (capturing >= 0) {
+                buffers[capturing] = BufferState::CAPTURING;
+            } else {
+                result.framesDropped++;
+            }
+            nextFrameUs += SIMULATION_FRAME_PERIOD_US;
+        } else {
+            // The send is finished, the buffer is returned
+            int64_t ageUs = sendStartUs - captureUs[sending];
+            totalAgeUs += double(ageUs);
+            totalLatencyUs += double(nowUs - captureUs[sending]);
+            if (ageUs > result.maxAgeUs) { result.maxAgeUs = uint32_t(ageUs); }
+            result.framesSent++;
+            buffers[sending] = BufferState::FREE;
+            sending = -1;
+        }
+
+        // esp_camera_fb_get(): the stream takes the next frame as soon as it is free
+        if (sending < 0 && !readyQueue.empty()) {
+            sending = readyQueue.front();
+            readyQueue.pop_front();
+            buffers[sending] = BufferState::SENDING;
+            sendStartUs = nowUs;
+            sendEndUs = nowUs + model.sendTimesUs[sendIndex++ % model.sendTimesUs.size()];
+        }
+    }
+    result.averageAgeUs = totalAgeUs / result.framesSent;
+    result.averageLatencyUs = totalLatencyUs / result.framesSent;
+    result.framesPerSecond = result.framesSent * 1e6 / double(sendEndUs);
+    return result;
+}
+
+static void printResult(const char* name, const CaptureResult& result) {
+    printf("%-28s age avg %6.1f ms max %6.1f ms, capture->sent avg %6.1f ms, %4.1f fps\n", name, result.averageAgeUs / 1000,
+           result.maxAgeUs / 1000.0, result.averageLatencyUs / 1000, result.framesPerSecond);
+}
+
+// Wi-Fi bound stream with retries: 85 ms per VGA frame on average, up to 3 frame periods
+static const std::vector<uint32_t> SLOW_SEND_TIMES_US = { 47000, 113000, 71000, 131000, 53000, 97000 };
+// About the frame period on average
+static const std::vector<uint32_t> MODERATE_SEND_TIMES_US = { 33000, 47000, 61000, 39000 };
+
+TEST(CaptureLatencyHostTest, GrabLatestBoundsTheAgeOnASlowLink) {
+    CaptureResult whenEmpty = simulate({ 2, false, SLOW_SEND_TIMES_US });
+    CaptureResult latest = simulate({ 3, true, SLOW_SEND_TIMES_US });
+    printResult("wait for empty, 2 buffers", whenEmpty);
+    printResult("grab latest, 3 buffers", latest);
+
+    // The ready frame waits in its buffer while a long send finishes, more than a frame period
+    EXPECT_GT(whenEmpty.maxAgeUs, uint32_t(SIMULATION_FRAME_PERIOD_US));
+    // The ready frame is replaced every frame period
+    EXPECT_LT(latest.maxAgeUs, uint32_t(SIMULATION_FRAME_PERIOD_US));
+    EXPECT_LT(latest.averageAgeUs, whenEmpty.averageAgeUs);
+    EXPECT_LT(latest.averageLatencyUs, whenEmpty.averageLatencyUs);
+    EXPECT_GE(latest.framesPerSecond, whenEmpty.framesPerSecond);
+}
+
+TEST(CaptureLatencyHostTest, GrabLatestNeedsThreeBuffers) {
+    // With 2 buffers there is never a second ready frame to replace: the same timing as waiting for an empty buffer
+    CaptureResult twoBuffers = simulate({ 2, true, SLOW_SEND_TIMES_US });
+    CaptureResult whenEmpty = simulate({ 2, false, SLOW_SEND_TIMES_US });
+    EXPECT_EQ(twoBuffers.averageAgeUs, whenEmpty.averageAgeUs);
+    EXPECT_GT(twoBuffers.maxAgeUs, uint32_t(SIMULATION_FRAME_PERIOD_US));
+}
+
+TEST(CaptureLatencyHostTest, WaitForEmptyQueuesStaleFramesWithThreeBuffers) {
+    // A third buffer without grab latest only queues older frames (FIFO)
+    CaptureResult whenEmpty = simulate({ 3, false, MODERATE_SEND_TIMES_US });
+    CaptureResult latest = simulate({ 3, true, MODERATE_SEND_TIMES_US });
+    printResult("wait for empty, 3 buffers", whenEmpty);
+    printResult("grab latest, 3 buffers", latest);
+    EXPECT_LT(latest.averageAgeUs, whenEmpty.averageAgeUs);
+    EXPECT_LT(latest.maxAgeUs, uint32_t(SIMULATION_FRAME_PERIOD_US));
+}
+
+TEST(CaptureLatencyHostTest, GrabLatestKeepsTheSenderBusyOnAModerateLink) {
+    // Around the frame period, 2 buffers give fresh frames too, but the sender waits for the sensor after every free
+    CaptureResult whenEmpty = simulate({ 2, false, MODERATE_SEND_TIMES_US });
+    CaptureResult latest = simulate({ 3, true, MODERATE_SEND_TIMES_US });
+    printResult("wait for empty, 2 buffers", whenEmpty);
+    printResult("grab latest, 3 buffers", latest);
+    EXPECT_GT(latest.framesPerSecond, whenEmpty.framesPerSecond);
+    EXPECT_LT(latest.maxAgeUs, uint32_t(SIMULATION_FRAME_PERIOD_US));
+}
+
+TEST(CaptureLatencyHostTest, FastLinkSendsEveryFrameFresh) {
+    // A send shorter than the frame period waits for the sensor in both modes, no frame is stale
+    const std::vector<uint32_t> fastSendTimesUs = { 10000 };
+    CaptureResult whenEmpty = simulate({ 2, false, fastSendTimesUs });
+    CaptureResult latest = simulate({ 3, true, fastSendTimesUs });
+    EXPECT_EQ(whenEmpty.maxAgeUs, 0u);
+    EXPECT_EQ(latest.maxAgeUs, 0u);
+    EXPECT_EQ(latest.framesDropped, 0u);
+}
+
+TEST(CaptureLatencyHostTest, DefaultsAreLowLatency) {
+    EXPECT_EQ(CAMERA_GRAB_LATEST, CAMERA_LOW_LATENCY);
+    EXPECT_EQ(CAMERA_FB_COUNT, CAMERA_LOW_LATENCY ? 3 : 2);
+}
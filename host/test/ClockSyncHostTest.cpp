@@ -0,0 +1,319 @@
+/*
+ * File: ClockSyncHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Tuesday, 11th March 2025 6:02:17 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Tuesday, 11th March 2025 6:02:17 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the clock sync of the operator. The estimator runs on simulated exchanges: the four-timestamp math,
+    the bias of the asymmetric ways, and a Wi-Fi that queues one way at a time (retransmits up, power save down),
+    where the fastest exchange of the window has to find the offset that the single exchanges miss. The endpoint tests
+    run /syn with a client clock of another epoch and real (asymmetric) delays, and read the estimate from the telemetry.
+*/
+
+#include "ClockSync.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "ServerManager.h"
+#include "TelemetryManager.h"
+
+// C++
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+// C
+extern "C" {
+#include <stdlib.h>
+}
+
+// GTest
+#include <gtest/gtest.h>
+
+// Drone clock - operator clock of the simulations (the operator counts from the epoch, the drone from its boot)
+static const int64_t OPERATOR_OFFSET_US = -1741710000123456LL;
+
+// Simulated exchange -------------------------------------------------------------------------------------------
+struct SimulatedExchange {
+    int64_t t1;
+    int64_t t2;
+    int64_t t3;
+    int64_t t4;
+};
+
+/**
+ * @brief One exchange at droneUs (drone clock), the ping takes upUs to the drone, the response downUs back.
+ */
+static SimulatedExchange simulate(int64_t droneUs, int64_t upUs, int64_t processUs, int64_t downUs) {
+    SimulatedExchange exchange;
+    exchange.t1 = droneUs - OPERATOR_OFFSET_US;
+    exchange.t2 = droneUs + upUs;
+    exchange.t3 = exchange.t2 + processUs;
+    exchange.t4 = exchange.t3 + downUs - OPERATOR_OFFSET_US;
+    return exchange;
+}
+
+static bool addExchange(ClockSync& clockSync, const SimulatedExchange& exchange) {
+    clockSync.stamp(exchange.t1, exchange.t2, exchange.t3);
+    return clockSync.complete(exchange.t1, exchange.t4);
+}
+
+// Estimator ----------------------------------------------------------------------------------------------------
+TEST(ClockSyncHostTest, SymmetricDelaysGiveTheExactOffset) {
+    SimulatedExchange exchange = simulate(5000000, 1500, 700, 1500);
+    ClockSyncSample sample;
+    ASSERT_TRUE(ClockSync::measure(exchange.t1, exchange.t2, exchange.t3, exchange.t4, sample));
+    EXPECT_EQ(sample.offsetUs, OPERATOR_OFFSET_US);
+    EXPECT_EQ(sample.rttUs, 3000u); // Without the 700 us of the drone
+
+    ClockSync clockSync;
+    EXPECT_FALSE(clockSync.isSynced());
+    EXPECT_EQ(clockSync.toDroneUs(1234), 1234);
+    ASSERT_TRUE(addExchange(clockSync, exchange));
+    EXPECT_TRUE(clockSync.isSynced());
+    EXPECT_EQ(clockSync.toDroneUs(exchange.t1), 5000000);
+    ClockSyncStats stats = clockSync.getStats();
+    EXPECT_EQ(stats.offsetUs, OPERATOR_OFFSET_US);
+    EXPECT_EQ(stats.rttUs, 3000u);
+    EXPECT_EQ(stats.windowCount, 1);
+}
+
+TEST(ClockSyncHostTest, AsymmetryIsOffByHalfItsDifference) {
+    // The two ways can not be told apart: the error is half of their difference, never more than half of the round trip
+    for (int64_t upUs : { 500, 2000, 8000, 30000 }) {
+        for (int64_t downUs : { 500, 4000, 60000 }) {
+            SimulatedExchange exchange = simulate(10000000, upUs, 300, downUs);
+            ClockSyncSample sample;
+            ASSERT_TRUE(ClockSync::measure(exchange.t1, exchange.t2, exchange.t3, exchange.t4, sample));
+            int64_t errorUs = sample.offsetUs - OPERATOR_OFFSET_US;
+            EXPECT_EQ(errorUs, (upUs - downUs) / 2) << upUs << " " << downUs;
+            EXPECT_LE(std::llabs(errorUs), int64_t(sample.rttUs / 2));
+        }
+    }
+}
+
+TEST(ClockSyncHostTest, FastestExchangeFindsTheOffsetInAsymmetricQueueing) {
+    // A Wi-Fi that queues one way at a time: retransmits of the pings (up to 30 ms), the power save of the operator
+    // (its responses wait up to a beacon interval), on top of 1.5 ms each way
+    std::mt19937 random(50);
+    std::uniform_int_distribution<int64_t> jitterUs(0, 300);
+    std::uniform_int_distribution<int64_t> retransmitUs(2000, 30000);
+    std::uniform_int_distribution<int64_t> powerSaveUs(0, 100000);
+    std::uniform_int_distribution<int64_t> processUs(200, 2000);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    ClockSync clockSync;
+    double sampleErrorSumUs = 0;
+    double meanOffsetErrorSumUs = 0;
+    int64_t maxEstimateErrorUs = 0;
+    const uint32_t EXCHANGES = 300;
+    for (uint32_t i = 0; i < EXCHANGES; i++) {
+        int64_t upUs = 1500 + jitterUs(random) + (chance(random) < 0.3 ? retransmitUs(random) : 0);
+        int64_t downUs = 1500 + jitterUs(random) + (chance(random) < 0.5 ? powerSaveUs(random) : 0);
+        SimulatedExchange exchange = simulate(int64_t(i) * 1000000 + 3000000, upUs, processUs(random), downUs);
+        ASSERT_TRUE(addExchange(clockSync, exchange));
+
+        ClockSyncSample sample;
+        ClockSync::measure(exchange.t1, exchange.t2, exchange.t3, exchange.t4, sample);
+        sampleErrorSumUs += std::fabs(double(sample.offsetUs - OPERATOR_OFFSET_US));
+        meanOffsetErrorSumUs += double(sample.offsetUs - OPERATOR_OFFSET_US);
+        ClockSyncStats stats = clockSync.getStats();
+        int64_t errorUs = std::llabs(stats.offsetUs - OPERATOR_OFFSET_US);
+        EXPECT_LE(errorUs, int64_t(stats.rttUs / 2)) << i;
+        if (i >= 16) { maxEstimateErrorUs = std::max(maxEstimateErrorUs, errorUs); }
+    }
+    double sampleErrorUs = sampleErrorSumUs / EXCHANGES;                 // One ping
+    double meanOffsetErrorUs = std::fabs(meanOffsetErrorSumUs / EXCHANGES); // The mean of all pings
+    printf("Offset error: one exchange %.0f us, mean of the exchanges %.0f us, fastest of the window (max) %lld us\n",
+           sampleErrorUs, meanOffsetErrorUs, (long long)maxEstimateErrorUs);
+    EXPECT_LE(maxEstimateErrorUs, 300);
+    EXPECT_GT(sampleErrorUs, 10.0 * maxEstimateErrorUs);
+    EXPECT_GT(meanOffsetErrorUs, 10.0 * maxEstimateErrorUs);
+}
+
+TEST(ClockSyncHostTest, FastestSampleLeavesTheWindow) {
+    ClockSync clockSync;
+    clockSync.addSample({ .offsetUs = 100, .rttUs = 500 });
+    for (uint32_t i = 1; i < CLOCK_SYNC_WINDOW; i++) { clockSync.addSample({ .offsetUs = int64_t(200 + i), .rttUs = 2000 }); }
+    EXPECT_EQ(clockSync.getStats().offsetUs, 100);
+    EXPECT_EQ(clockSync.getStats().rttUs, 500u);
+    // The fast one drops out, the newest of the equal ones is the estimate (the clocks drift apart)
+    clockSync.addSample({ .offsetUs = 400, .rttUs = 2000 });
+    ClockSyncStats stats = clockSync.getStats();
+    EXPECT_EQ(stats.offsetUs, 400);
+    EXPECT_EQ(stats.rttUs, 2000u);
+    EXPECT_EQ(stats.lastRttUs, 2000u);
+    EXPECT_EQ(stats.windowCount, CLOCK_SYNC_WINDOW);
+    EXPECT_EQ(stats.samples, CLOCK_SYNC_WINDOW + 1);
+}
+
+TEST(ClockSyncHostTest, OnlyStampedExchangesComplete) {
+    ClockSync clockSync;
+    EXPECT_FALSE(clockSync.complete(1000, 5000));                   // Never stamped
+    clockSync.stamp(1000, 2000, 2100);
+    EXPECT_FALSE(clockSync.complete(1000, 900));                    // t4 before t1
+    EXPECT_FALSE(clockSync.complete(1000, 4000));                   // Already used up
+    clockSync.stamp(1000, 2000, 2100);
+    EXPECT_FALSE(clockSync.complete(1000, 1000 + CLOCK_SYNC_MAX_RTT_MS * 1000 + 200)); // Too slow
+    clockSync.stamp(1000, 2000, 2100);
+    clockSync.stamp(1000, 2050, 2080);                              // A repeated ping replaces its stamps
+    EXPECT_TRUE(clockSync.complete(1000, 4000));
+    EXPECT_EQ(clockSync.getStats().lastRttUs, 3000u - 30u);
+
+    // CLOCK_SYNC_PENDING exchanges wait at a time, the oldest is replaced
+    for (int64_t t1 = 10; t1 <= 10 + CLOCK_SYNC_PENDING; t1++) { clockSync.stamp(t1, 100, 100); }
+    EXPECT_FALSE(clockSync.complete(10, 200));
+    for (int64_t t1 = 11; t1 <= 10 + CLOCK_SYNC_PENDING; t1++) { EXPECT_TRUE(clockSync.complete(t1, 200)) << t1; }
+
+    ClockSyncStats stats = clockSync.getStats();
+    EXPECT_EQ(stats.exchanges, 5u + CLOCK_SYNC_PENDING);
+    EXPECT_EQ(stats.samples, 1u + CLOCK_SYNC_PENDING);
+    EXPECT_EQ(stats.rejected, 5u);
+}
+
+TEST(ClockSyncHostTest, HistogramsOfTheWindow) {
+    EXPECT_EQ(ClockSync::histogramBin(0), 0);
+    EXPECT_EQ(ClockSync::histogramBin(999), 0);
+    EXPECT_EQ(ClockSync::histogramBin(1000), 1);
+    EXPECT_EQ(ClockSync::histogramBin(4999), 2);
+    EXPECT_EQ(ClockSync::histogramBin(99999), 6);
+    EXPECT_EQ(ClockSync::histogramBin(100000), 7);
+    EXPECT_EQ(ClockSync::histogramBin(UINT32_MAX), 7);
+
+    ClockSync clockSync;
+    clockSync.addSample({ .offsetUs = 5000, .rttUs = 800 });        // The estimate
+    clockSync.addSample({ .offsetUs = 5300, .rttUs = 3000 });       // 0.3 ms off
+    clockSync.addSample({ .offsetUs = 3500, .rttUs = 7000 });       // 1.5 ms off
+    clockSync.addSample({ .offsetUs = 65000, .rttUs = 150000 });    // 60 ms off
+    ClockSyncStats stats = clockSync.getStats();
+    const uint8_t RTTS[CLOCK_SYNC_HISTOGRAM_BINS] = { 1, 0, 1, 1, 0, 0, 0, 1 };
+    const uint8_t OFFSETS[CLOCK_SYNC_HISTOGRAM_BINS] = { 2, 1, 0, 0, 0, 0, 1, 0 };
+    for (uint8_t bin = 0; bin < CLOCK_SYNC_HISTOGRAM_BINS; bin++) {
+        EXPECT_EQ(stats.rttHistogram[bin], RTTS[bin]) << int(bin);
+        EXPECT_EQ(stats.offsetHistogram[bin], OFFSETS[bin]) << int(bin);
+    }
+
+    // A new operator clock: the samples go, the counters stay
+    clockSync.clear();
+    stats = clockSync.getStats();
+    EXPECT_FALSE(clockSync.isSynced());
+    EXPECT_EQ(stats.windowCount, 0);
+    EXPECT_EQ(stats.rttUs, 0u);
+    EXPECT_EQ(stats.rttHistogram[0], 0);
+    EXPECT_EQ(stats.samples, 4u);
+}
+
+// Endpoint -----------------------------------------------------------------------------------------------------
+class ClockSyncEndpointHostTest : public testing::Test {
+protected:
+    void SetUp() override {
+        HalHost::reset();
+        ServerManager::getInstance()->startCommandServer();
+    }
+
+    void TearDown() override {
+        ServerManager::deinit();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> get(const std::string& uri) {
+        return HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, uri.c_str());
+    }
+
+    static int64_t operatorUs() { return Hal::Timer::getTimeUs() - OPERATOR_OFFSET_US; }
+
+    /**
+     * @brief A number field of the JSON response.
+     */
+    static int64_t field(const std::string& body, const char* name) {
+        std::string key = std::string("\"") + name + "\":";
+        size_t position = body.find(key);
+        return position == std::string::npos ? INT64_MIN : strtoll(body.c_str() + position + key.size(), nullptr, 10);
+    }
+};
+
+TEST_F(ClockSyncEndpointHostTest, ExchangeIsStamped) {
+    int64_t beforeUs = Hal::Timer::getTimeUs();
+    std::shared_ptr<HttpdHostResponse> response = get("/syn?T=12345");
+    int64_t afterUs = Hal::Timer::getTimeUs();
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_EQ(response->getType(), "application/json");
+    const std::string& body = response->getBody();
+    EXPECT_EQ(field(body, "t1"), 12345);
+    EXPECT_GE(field(body, "t2"), beforeUs);
+    EXPECT_GE(field(body, "t3"), field(body, "t2"));
+    EXPECT_LE(field(body, "t3"), afterUs);
+    EXPECT_EQ(field(body, "samples"), 0);
+    EXPECT_EQ(ServerManager::getClockSyncStats().exchanges, 1u);
+
+    for (const char* uri : { "/syn", "/syn?T=x", "/syn?T=-1", "/syn?R=1", "/syn?T=1&P=1", "/syn?T=1&E=1", "/syn?T=1&R=2" }) {
+        EXPECT_EQ(get(uri)->getStatus(), 400) << uri;
+    }
+    EXPECT_EQ(ServerManager::getClockSyncStats().exchanges, 1u);
+}
+
+TEST_F(ClockSyncEndpointHostTest, AsymmetricDelaysAreEstimated) {
+    // The client of tools/clock_sync.py: every ping hands over the t4 of the previous one. Most pings are slow on the
+    // way up, every fourth one is fast both ways
+    int64_t previousT1 = -1;
+    int64_t previousT4 = -1;
+    int64_t clientOffsetUs = 0;
+    uint32_t clientRttUs = UINT32_MAX;
+    for (uint32_t i = 0; i < 17; i++) {
+        uint32_t upMs = i % 4 == 0 ? 1 : 16;
+        int64_t t1 = operatorUs();
+        std::string uri = "/syn?T=" + std::to_string(t1);
+        if (previousT1 >= 0) { uri += "&P=" + std::to_string(previousT1) + "&E=" + std::to_string(previousT4); }
+        std::this_thread::sleep_for(std::chrono::milliseconds(upMs));
+        std::shared_ptr<HttpdHostResponse> response = get(uri);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        int64_t t4 = operatorUs();
+        ASSERT_EQ(response->getStatus(), 200) << uri;
+        const std::string& body = response->getBody();
+        ClockSyncSample sample;
+        ASSERT_TRUE(ClockSync::measure(t1, field(body, "t2"), field(body, "t3"), t4, sample));
+        if (sample.rttUs <= clientRttUs) {
+            clientRttUs = sample.rttUs;
+            clientOffsetUs = sample.offsetUs;
+        }
+        previousT1 = t1;
+        previousT4 = t4;
+    }
+
+    // The drone has the same estimate as the client (the last exchange is not handed over)
+    ClockSyncStats stats = ServerManager::getClockSyncStats();
+    EXPECT_EQ(stats.samples, 16u);
+    EXPECT_EQ(stats.rejected, 0u);
+    EXPECT_EQ(stats.windowCount, 16);
+    int64_t errorUs = std::llabs(stats.offsetUs - OPERATOR_OFFSET_US);
+    printf("Offset error %lld us, fastest round trip %lu us\n", (long long)errorUs, (unsigned long)stats.rttUs);
+    EXPECT_LE(errorUs, int64_t(stats.rttUs / 2));
+    EXPECT_LT(errorUs, 3000);                   // The slow pings alone are ~7.5 ms off
+    EXPECT_LT(stats.rttUs, 8000u);
+    if (stats.rttUs == clientRttUs) { EXPECT_EQ(stats.offsetUs, clientOffsetUs); }
+
+    // In the telemetry
+    TelemetryManager::init();
+    TelemetryFrame frame;
+    TelemetryManager::getInstance()->sampleFrame(frame);
+    EXPECT_EQ(frame.header.clockOffsetUs, stats.offsetUs);
+    EXPECT_EQ(frame.header.clockRttUs, stats.rttUs);
+    uint32_t histogramSamples = 0;
+    for (uint8_t count : frame.header.clockRttHistogram) { histogramSamples += count; }
+    EXPECT_EQ(histogramSamples, 16u);
+    TelemetryManager::deinit();
+
+    // A new operator clock
+    ASSERT_EQ(get("/syn?T=1&R=1")->getStatus(), 200);
+    EXPECT_EQ(ServerManager::getClockSyncStats().windowCount, 0);
+}
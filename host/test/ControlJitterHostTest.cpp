@@ -0,0 +1,420 @@
+/*
+ * File: ControlJitterHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the jitter buffer of the controller commands. The buffer runs on simulated time: the bursts, the gaps,
+    the trend and the failsafe, then arrival traces of a jittery Wi-Fi are played into a 50 Hz motor loop and the
+    smoothness and the lag of the output are compared with the motor loop without a buffer. The endpoint tests run
+    /mov and /jit with the real motor task.
+*/
+
+#include "ControlJitterBuffer.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "MotorManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+
+// C++
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// C
+extern "C" {
+#include <stdlib.h>
+}
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define TEST_START_US               1000000
+#define TEST_INTERVAL_US            (CONTROL_JITTER_DEFAULT_INTERVAL_MS * 1000)
+#define TEST_TICK_US                (MOTOR_CONTROL_PERIOD_MS * 1000)
+#define TEST_TICK_PHASE_US          7000        // Of the motor loop against the controller
+#define TRACE_COMMANDS              500         // 10 s of a 50 Hz controller
+#define STOP_CYCLES                 20          // Mode changes away from DRIVE while the controller sends
+#define TRACE_MAX_LAG_MS            300
+#define JITTER_TIMEOUT_MS           3000
+
+static ControlData forward(int16_t Y) { return { .X = 0, .Y = Y, .L = 0, .R = 0 }; }
+
+// Buffer -------------------------------------------------------------------------------------------------------
+TEST(ControlJitterBufferHostTest, NothingToPlayUntilTheFirstCommandIsDue) {
+    ControlJitterBuffer buffer;
+    ControlData command = forward(99);
+    EXPECT_EQ(buffer.play(TEST_START_US, command), ControlJitterOutput::NONE);
+    EXPECT_EQ(command.Y, 99); // Untouched
+
+    buffer.push(forward(30), TEST_START_US);
+    EXPECT_EQ(buffer.play(TEST_START_US + 20000, command), ControlJitterOutput::NONE); // Still in the depth
+    EXPECT_EQ(buffer.play(TEST_START_US + CONTROL_JITTER_DEFAULT_DEPTH_MS * 1000, command), ControlJitterOutput::COMMAND);
+    EXPECT_EQ(command.Y, 30);
+}
+
+TEST(ControlJitterBufferHostTest, SteadyCommandsLagByTheDepth) {
+    ControlJitterBuffer buffer;
+    buffer.setDepthMs(40);
+    ControlData command;
+    for (int16_t i = 0; i < 50; i++) {
+        int64_t sendUs = TEST_START_US + int64_t(i) * TEST_INTERVAL_US;
+        buffer.push(forward(i), sendUs);
+        ASSERT_NE(buffer.play(sendUs + TEST_TICK_PHASE_US, command), ControlJitterOutput::EXTRAPOLATED);
+        if (i >= 2) { EXPECT_EQ(command.Y, i - 2) << i; } // 40 ms: two periods of the controller
+    }
+    ControlJitterStats stats = buffer.getStats();
+    EXPECT_EQ(stats.commands, 50u);
+    EXPECT_EQ(stats.backdated, 0u);
+    EXPECT_EQ(stats.skipped, 0u);
+    EXPECT_EQ(stats.extrapolations, 0u);
+    EXPECT_EQ(stats.intervalUs, uint32_t(TEST_INTERVAL_US));
+    EXPECT_EQ(stats.averageDelayUs, 40000u + TEST_TICK_PHASE_US);
+    EXPECT_EQ(stats.queued, 2u);
+}
+
+TEST(ControlJitterBufferHostTest, BurstIsPlayedAtItsSendTimes) {
+    ControlJitterBuffer buffer;
+    buffer.setDepthMs(40);
+    ControlData command;
+    buffer.push(forward(1), TEST_START_US);
+    buffer.push(forward(2), TEST_START_US + TEST_INTERVAL_US);
+    // 3, 4 and 5 are held back by the Wi-Fi, they come together when 5 is sent
+    for (int16_t Y = 3; Y <= 5; Y++) { buffer.push(forward(Y), TEST_START_US + 4 * TEST_INTERVAL_US); }
+    EXPECT_EQ(buffer.getStats().backdated, 2u);
+
+    // One after the other, like they were sent
+    for (int16_t Y = 1; Y <= 5; Y++) {
+        int64_t tickUs = TEST_START_US + 40000 + TEST_TICK_PHASE_US + int64_t(Y - 1) * TEST_TICK_US;
+        ASSERT_EQ(buffer.play(tickUs, command), ControlJitterOutput::COMMAND);
+        EXPECT_EQ(command.Y, Y);
+    }
+    EXPECT_EQ(buffer.getStats().skipped, 0u);
+}
+
+TEST(ControlJitterBufferHostTest, GapIsBridgedByTheTrend) {
+    ControlJitterBuffer buffer;
+    buffer.setDepthMs(0);
+    ControlData command;
+    for (int16_t i = 0; i < 3; i++) {
+        buffer.push(forward(int16_t(10 + 10 * i)), TEST_START_US + int64_t(i) * TEST_INTERVAL_US);
+        buffer.play(TEST_START_US + int64_t(i) * TEST_INTERVAL_US, command);
+    }
+    ASSERT_EQ(command.Y, 30);
+    int64_t lastUs = TEST_START_US + 2 * TEST_INTERVAL_US;
+
+    // Not late yet: held
+    EXPECT_EQ(buffer.play(lastUs + TEST_INTERVAL_US, command), ControlJitterOutput::COMMAND);
+    EXPECT_EQ(command.Y, 30);
+    // Late: along the trend (+10 per period), at most CONTROL_JITTER_MAX_TREND further, then held
+    EXPECT_EQ(buffer.play(lastUs + 2 * TEST_INTERVAL_US, command), ControlJitterOutput::EXTRAPOLATED);
+    EXPECT_EQ(command.Y, 30 + CONTROL_JITTER_MAX_TREND);
+    EXPECT_EQ(buffer.play(lastUs + CONTROL_JITTER_EXTRAPOLATE_MS * 2000, command), ControlJitterOutput::EXTRAPOLATED);
+    EXPECT_EQ(command.Y, 30 + CONTROL_JITTER_MAX_TREND);
+
+    // A command again: played at once (depth 0)
+    buffer.push(forward(35), lastUs + 200000);
+    EXPECT_EQ(buffer.play(lastUs + 200000, command), ControlJitterOutput::COMMAND);
+    EXPECT_EQ(command.Y, 35);
+    EXPECT_GT(buffer.getStats().extrapolations, 0u);
+}
+
+TEST(ControlJitterBufferHostTest, TrendNeverGoesOverAStop) {
+    ControlJitterBuffer buffer;
+    buffer.setDepthMs(0);
+    ControlData command;
+    buffer.push({ .X = 0, .Y = 20, .L = 0, .R = 30 }, TEST_START_US);
+    buffer.play(TEST_START_US, command);
+    buffer.push({ .X = 0, .Y = 8, .L = 0, .R = 40 }, TEST_START_US + TEST_INTERVAL_US);
+    buffer.play(TEST_START_US + TEST_INTERVAL_US, command);
+
+    ASSERT_EQ(buffer.play(TEST_START_US + 100000, command), ControlJitterOutput::EXTRAPOLATED);
+    EXPECT_EQ(command.Y, 0);    // Slowing down: it stops, it does not reverse
+    EXPECT_EQ(command.X, 0);    // Not moving: it stays
+    EXPECT_EQ(command.L, 0);
+    EXPECT_EQ(command.R, 40 + CONTROL_JITTER_MAX_TREND);
+
+    buffer.push(forward(-20), TEST_START_US + 200000);
+    buffer.play(TEST_START_US + 200000, command);
+    buffer.push(forward(-5), TEST_START_US + 200000 + TEST_INTERVAL_US);
+    buffer.play(TEST_START_US + 200000 + TEST_INTERVAL_US, command);
+    ASSERT_EQ(buffer.play(TEST_START_US + 300000, command), ControlJitterOutput::EXTRAPOLATED);
+    EXPECT_EQ(command.Y, 0);
+}
+
+TEST(ControlJitterBufferHostTest, FailsafeStopsAfterTheLastCommand) {
+    ControlJitterBuffer buffer;
+    ControlData command;
+    buffer.push(forward(60), TEST_START_US);
+    int64_t nowUs = TEST_START_US;
+    ControlJitterOutput output = ControlJitterOutput::NONE;
+    while (output != ControlJitterOutput::FAILSAFE && nowUs < TEST_START_US + 2 * CONTROL_FAILSAFE_MS * 1000) {
+        nowUs += TEST_TICK_US;
+        output = buffer.play(nowUs, command);
+    }
+    ASSERT_EQ(output, ControlJitterOutput::FAILSAFE);
+    EXPECT_GE(nowUs - TEST_START_US, CONTROL_FAILSAFE_MS * 1000);
+    EXPECT_LT(nowUs - TEST_START_US, CONTROL_FAILSAFE_MS * 1000 + TEST_TICK_US);
+    EXPECT_EQ(command.Y, 0);
+    EXPECT_EQ(buffer.play(nowUs + TEST_TICK_US, command), ControlJitterOutput::NONE); // Once
+    EXPECT_EQ(buffer.getStats().failsafes, 1u);
+
+    // The controller is back
+    buffer.push(forward(10), nowUs + 100000);
+    EXPECT_EQ(buffer.play(nowUs + 100000 + CONTROL_JITTER_DEFAULT_DEPTH_MS * 1000, command), ControlJitterOutput::COMMAND);
+    EXPECT_EQ(command.Y, 10);
+}
+
+TEST(ControlJitterBufferHostTest, ClearAndOverflow) {
+    ControlJitterBuffer buffer;
+    ControlData command;
+    for (int16_t i = 0; i < CONTROL_JITTER_CAPACITY + 4; i++) { buffer.push(forward(i), TEST_START_US); }
+    ControlJitterStats stats = buffer.getStats();
+    EXPECT_EQ(stats.overflows, 4u);
+    EXPECT_EQ(stats.queued, CONTROL_JITTER_CAPACITY);
+
+    // The oldest kept one is played first (the burst is spread back from the newest one)
+    int64_t nowUs = TEST_START_US - CONTROL_JITTER_CAPACITY * TEST_INTERVAL_US;
+    while (buffer.play(nowUs, command) == ControlJitterOutput::NONE) { nowUs += 1000; }
+    EXPECT_EQ(command.Y, 4);
+    EXPECT_EQ(buffer.getStats().skipped, 0u);
+
+    buffer.clear();
+    EXPECT_EQ(buffer.play(TEST_START_US + 1000000, command), ControlJitterOutput::NONE);
+    EXPECT_EQ(buffer.getStats().queued, 0u);
+
+    buffer.setDepthMs(CONTROL_JITTER_MAX_DEPTH_MS + 1);
+    EXPECT_EQ(buffer.getDepthMs(), CONTROL_JITTER_MAX_DEPTH_MS);
+}
+
+// Traces -------------------------------------------------------------------------------------------------------
+/*
+    Arrival delays (ms) of a 50 Hz controller app on a phone over Wi-Fi, repeated over the trace: the power save of the
+    phone holds the packets and sends them together, a lost packet waits for its retransmit (and holds the ones after
+    it on the same TCP connection), and a longer stall. The order of the commands is kept (one connection).
+*/
+static const uint8_t NO_DELAYS_MS[] = { 0 };
+static const uint8_t POWER_SAVE_DELAYS_MS[] = {
+    3, 4, 3, 5, 4, 3, 62, 44, 23, 4, 3, 5, 3, 4, 61, 40, 22, 3, 4, 3, 5, 4, 3, 3, 58, 39, 18, 4, 3, 5,
+};
+static const uint8_t RETRANSMIT_DELAYS_MS[] = {
+    5, 6, 4, 9, 5, 7, 4, 5, 8, 6, 5, 4, 7, 5, 6, 5, 9, 4, 6, 5, 210, 190, 170, 150, 130, 110, 90, 70, 50, 30, 12, 6, 5, 7, 5,
+    4, 6, 5, 8, 5,
+};
+
+struct TraceResult {
+    uint32_t jerk;                  // Sum of the second differences of the output (0: a straight ramp)
+    uint32_t overflows;
+    uint32_t lagMs;                 // That fits the output best to the stick
+};
+
+// The stick: one slow swing forward and back per 2 s
+static int16_t stickAt(int32_t index) { return int16_t(lround(60.0 * sin(2.0 * M_PI * index / 100.0))); }
+
+/**
+ * @brief Play a trace into a 50 Hz motor loop.
+ *
+ * @param depthMs The depth of the jitter buffer, -1: no buffer (the newest arrived command, like before the buffer).
+ */
+static TraceResult playTrace(const uint8_t* delaysMs, size_t delayCount, int32_t depthMs) {
+    ControlJitterBuffer buffer;
+    buffer.setDepthMs(uint16_t(depthMs < 0 ? 0 : depthMs));
+    std::vector<int64_t> arrivalsUs(TRACE_COMMANDS);
+    for (int32_t i = 0; i < TRACE_COMMANDS; i++) {
+        arrivalsUs[i] = TEST_START_US + int64_t(i) * TEST_INTERVAL_US + int64_t(delaysMs[i % delayCount]) * 1000;
+        if (i > 0 && arrivalsUs[i] < arrivalsUs[i - 1]) { arrivalsUs[i] = arrivalsUs[i - 1]; }
+    }
+
+    std::vector<int16_t> outputs;
+    std::vector<int64_t> ticksUs;
+    ControlData applied = forward(0);
+    int32_t next = 0;
+    for (int64_t tickUs = TEST_START_US + TEST_TICK_PHASE_US; tickUs < arrivalsUs.back() + 200000; tickUs += TEST_TICK_US) {
+        for (; next < TRACE_COMMANDS && arrivalsUs[next] <= tickUs; next++) {
+            if (depthMs < 0) { applied = forward(stickAt(next)); }
+            else { buffer.push(forward(stickAt(next)), arrivalsUs[next]); }
+        }
+        ControlData command;
+        if (depthMs >= 0 && buffer.play(tickUs, command) != ControlJitterOutput::NONE) { applied = command; }
+        outputs.push_back(applied.Y);
+        ticksUs.push_back(tickUs);
+    }
+
+    TraceResult result = { 0, buffer.getStats().overflows, 0 };
+    for (size_t i = 2; i < outputs.size(); i++) { result.jerk += uint32_t(abs(outputs[i] - 2 * outputs[i - 1] + outputs[i - 2])); }
+    uint64_t bestError = UINT64_MAX;
+    for (uint32_t lagMs = 0; lagMs <= TRACE_MAX_LAG_MS; lagMs++) {
+        uint64_t error = 0;
+        for (size_t i = 0; i < outputs.size(); i++) {
+            int64_t sentIndex = (ticksUs[i] - TEST_START_US - int64_t(lagMs) * 1000) / TEST_INTERVAL_US;
+            int16_t stick = sentIndex < 0 ? 0 : stickAt(int32_t(std::min<int64_t>(sentIndex, TRACE_COMMANDS - 1)));
+            error += uint64_t(abs(outputs[i] - stick));
+        }
+        if (error < bestError) {
+            bestError = error;
+            result.lagMs = lagMs;
+        }
+    }
+    return result;
+}
+
+// The jerk of the stick itself (rounding), without jitter and without a buffer
+static uint32_t getStickJerk() { return playTrace(NO_DELAYS_MS, sizeof(NO_DELAYS_MS), -1).jerk; }
+
+static int32_t getJitterJerk(const TraceResult& result, uint32_t stickJerk) { return int32_t(result.jerk) - int32_t(stickJerk); }
+
+TEST(ControlJitterTraceHostTest, PowerSaveBurstsAreSmoothed) {
+    uint32_t stickJerk = getStickJerk();
+    TraceResult direct = playTrace(POWER_SAVE_DELAYS_MS, sizeof(POWER_SAVE_DELAYS_MS), -1);
+    TraceResult buffered = playTrace(POWER_SAVE_DELAYS_MS, sizeof(POWER_SAVE_DELAYS_MS), CONTROL_JITTER_DEFAULT_DEPTH_MS);
+    printf("stick jerk %u, power save: no buffer jerk %u lag %u ms, buffer jerk %u lag %u ms\n", stickJerk, direct.jerk,
+           direct.lagMs, buffered.jerk, buffered.lagMs);
+    ASSERT_GT(direct.jerk, stickJerk);
+    EXPECT_LT(getJitterJerk(buffered, stickJerk) * 4, getJitterJerk(direct, stickJerk));
+    EXPECT_LE(buffered.lagMs, direct.lagMs + CONTROL_JITTER_DEFAULT_DEPTH_MS);
+    EXPECT_EQ(buffered.overflows, 0u);
+}
+
+TEST(ControlJitterTraceHostTest, RetransmitStallIsBridged) {
+    uint32_t stickJerk = getStickJerk();
+    TraceResult direct = playTrace(RETRANSMIT_DELAYS_MS, sizeof(RETRANSMIT_DELAYS_MS), -1);
+    TraceResult buffered = playTrace(RETRANSMIT_DELAYS_MS, sizeof(RETRANSMIT_DELAYS_MS), CONTROL_JITTER_DEFAULT_DEPTH_MS);
+    printf("stick jerk %u, retransmit: no buffer jerk %u lag %u ms, buffer jerk %u lag %u ms\n", stickJerk, direct.jerk,
+           direct.lagMs, buffered.jerk, buffered.lagMs);
+    ASSERT_GT(direct.jerk, stickJerk);
+    EXPECT_LT(getJitterJerk(buffered, stickJerk) * 3, getJitterJerk(direct, stickJerk));
+    EXPECT_LE(buffered.lagMs, direct.lagMs + CONTROL_JITTER_DEFAULT_DEPTH_MS);
+    EXPECT_EQ(buffered.overflows, 0u);
+}
+
+TEST(ControlJitterTraceHostTest, DepthTradesLagForSmoothness) {
+    const int32_t DEPTHS_MS[] = { 0, 20, 40, 80, 160, CONTROL_JITTER_MAX_DEPTH_MS };
+    TraceResult results[sizeof(DEPTHS_MS) / sizeof(DEPTHS_MS[0])];
+    for (size_t i = 0; i < sizeof(DEPTHS_MS) / sizeof(DEPTHS_MS[0]); i++) {
+        results[i] = playTrace(RETRANSMIT_DELAYS_MS, sizeof(RETRANSMIT_DELAYS_MS), DEPTHS_MS[i]);
+        printf("depth %d ms: jerk %u lag %u ms\n", DEPTHS_MS[i], results[i].jerk, results[i].lagMs);
+        EXPECT_EQ(results[i].overflows, 0u) << DEPTHS_MS[i];
+        if (i == 0) { continue; }
+        EXPECT_LE(results[i].jerk, results[i - 1].jerk) << DEPTHS_MS[i];
+        EXPECT_GT(results[i].lagMs, results[i - 1].lagMs) << DEPTHS_MS[i];
+    }
+}
+
+// Endpoint -----------------------------------------------------------------------------------------------------
+class ControlJitterEndpointHostTest : public testing::Test {
+protected:
+    void SetUp() override {
+        HalHost::reset();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        ServerManager::getInstance()->startCommandServer();
+    }
+
+    void TearDown() override {
+        MotorManager::getInstance()->stopMotorControls();
+        MotorManager::deinit();
+        ServerManager::deinit();
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> get(const char* uri) { return HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, uri); }
+
+    template <typename Condition>
+    static bool waitFor(Condition condition) {
+        for (uint32_t waitedMs = 0; !condition(); waitedMs++) {
+            if (waitedMs >= JITTER_TIMEOUT_MS) { return false; }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+};
+
+TEST_F(ControlJitterEndpointHostTest, DepthIsConfigurable) {
+    std::shared_ptr<HttpdHostResponse> response = get("/jit");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_EQ(response->getType(), "application/json");
+    EXPECT_NE(response->getBody().find("\"depthMs\":" + std::to_string(CONTROL_JITTER_DEFAULT_DEPTH_MS) + ","), std::string::npos);
+
+    response = get("/jit?D=80");
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_NE(response->getBody().find("\"depthMs\":80,"), std::string::npos);
+    EXPECT_EQ(MotorManager::getInstance()->getControlJitterStats().depthMs, 80);
+
+    for (const char* uri : { "/jit?D=-1", "/jit?D=201", "/jit?D=x" }) { EXPECT_EQ(get(uri)->getStatus(), 400) << uri; }
+    EXPECT_EQ(MotorManager::getInstance()->getControlJitterStats().depthMs, 80);
+}
+
+TEST_F(ControlJitterEndpointHostTest, MoveIsPlayedUntilTheFailsafe) {
+    MotorManager* motorManager = MotorManager::getInstance();
+    motorManager->startMotorControls();
+    for (uint32_t i = 0; i < 10; i++) {
+        ASSERT_EQ(get("/mov?X=0&Y=50&L=0&R=0")->getStatus(), 200);
+        std::this_thread::sleep_for(std::chrono::milliseconds(CONTROL_JITTER_DEFAULT_INTERVAL_MS));
+    }
+    EXPECT_EQ(motorManager->getControlData().Y, 50);
+    ASSERT_TRUE(waitFor([] { return HalHost::getPwmDuty(MOTOR_1_CW) == uint32_t(Motor::convertSpeedPercentageToDutyCycle(50)); }));
+    EXPECT_EQ(motorManager->getAppliedControlData().Y, 50);
+
+    // The controller is gone: the motors stop
+    ASSERT_TRUE(waitFor([] { return HalHost::getPwmDuty(MOTOR_1_CW) == MOTOR_OFF; }));
+    EXPECT_EQ(motorManager->getControlData().Y, 0);
+    std::shared_ptr<HttpdHostResponse> response = get("/jit");
+    EXPECT_NE(response->getBody().find("\"commands\":10,"), std::string::npos) << response->getBody();
+    EXPECT_NE(response->getBody().find("\"failsafes\":1,"), std::string::npos) << response->getBody();
+}
+
+TEST_F(ControlJitterEndpointHostTest, DirectCommandDropsTheQueue) {
+    MotorManager* motorManager = MotorManager::getInstance();
+    motorManager->startMotorControls();
+    get("/jit?D=200");
+    ASSERT_EQ(get("/mov?X=0&Y=60&L=0&R=0")->getStatus(), 200);
+    motorManager->setControlData(0, 0, 0, 0); // Like the stop of the motor controls or the line follow
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_EQ(motorManager->getAppliedControlData().Y, 0);
+    EXPECT_EQ(HalHost::getPwmDuty(MOTOR_1_CW), MOTOR_OFF);
+}
+
+TEST_F(ControlJitterEndpointHostTest, StopsWhileTheControllerSends) {
+    // The motor task ends by itself between two loops, so it never leaves the control lock held: the commands, the
+    // restarts and the stops go on
+    MotorManager* motorManager = MotorManager::getInstance();
+    std::atomic<bool> isSending{true};
+    std::atomic<uint32_t> failures{0};
+    std::thread controller([&] {
+        while (isSending) {
+            if (get("/mov?X=0&Y=40&L=0&R=0")->getStatus() != 200) { failures++; }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    });
+    for (uint32_t i = 0; i < STOP_CYCLES; i++) {
+        motorManager->startMotorControls();
+        EXPECT_TRUE(MotorManager::isMotorControlRunning());
+        std::this_thread::sleep_for(std::chrono::milliseconds(MOTOR_CONTROL_PERIOD_MS + i % 7));
+        motorManager->stopMotorControls();
+        EXPECT_FALSE(MotorManager::isMotorControlRunning()) << i;
+        EXPECT_EQ(HalHost::getPwmDuty(MOTOR_1_CW), MOTOR_OFF) << i;
+    }
+    isSending = false;
+    controller.join();
+    EXPECT_EQ(failures, 0u);
+    EXPECT_EQ(get("/jit?D=60")->getStatus(), 200);
+}
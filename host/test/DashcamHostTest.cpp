@@ -0,0 +1,425 @@
+/*
+ * File: DashcamHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the dashcam. The ring is checked with small slabs (wraparound, slab reuse, pins, seek), the exports are
+    parsed back (AVI chunks and index, MJPEG parts, JSON index), and the recording task runs with the fake camera.
+*/
+
+#include "CameraManager.h"
+#include "DashcamManager.h"
+#include "DashcamRing.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "MotorManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+
+// C++
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define TEST_SLAB_SIZE              1000
+#define TEST_SLAB_COUNT             4
+#define TEST_FRAME_SIZE             300     // 3 frames per test slab
+#define TEST_FRAME_INTERVAL_US      200000
+#define TEST_FIRST_TIMESTAMP_US     1000000
+#define DASHCAM_TIMEOUT_MS          3000
+
+/**
+ * @brief A JPEG-like frame: SOI, bytes of the seed, EOI.
+ */
+static std::vector<uint8_t> makeFrame(size_t length, uint32_t seed) {
+    std::vector<uint8_t> frame(length);
+    for (size_t i = 0; i < length; i++) { frame[i] = uint8_t(seed * 31 + i); }
+    frame[0] = 0xFF;
+    frame[1] = 0xD8;
+    frame[length - 2] = 0xFF;
+    frame[length - 1] = 0xD9;
+    return frame;
+}
+
+static int64_t timestampOf(uint32_t index) { return TEST_FIRST_TIMESTAMP_US + int64_t(index) * TEST_FRAME_INTERVAL_US; }
+
+static ControlData controlOf(uint32_t index) { return { int16_t(index), int16_t(-int32_t(index)), int8_t(index % 100), 1 }; }
+
+static bool appendFrame(DashcamRing& ring, uint32_t index, size_t length = TEST_FRAME_SIZE) {
+    std::vector<uint8_t> frame = makeFrame(length, index);
+    return ring.append(frame.data(), uint32_t(length), 640, 480, timestampOf(index), controlOf(index));
+}
+
+// Ring ---------------------------------------------------------------------------------------------------------
+TEST(DashcamRingHostTest, KeepsTheLastFramesAfterTheWraparound) {
+    DashcamRing ring(TEST_SLAB_COUNT, TEST_SLAB_SIZE);
+    ASSERT_TRUE(ring.isAllocated());
+    for (uint32_t i = 0; i < 21; i++) { ASSERT_TRUE(appendFrame(ring, i)) << i; }
+
+    // 4 slabs of 3 frames: the last 12 frames, the slabs of the first 9 were reused
+    DashcamRingStats stats = ring.getStats();
+    EXPECT_EQ(stats.frames, 12u);
+    EXPECT_EQ(stats.slabsUsed, TEST_SLAB_COUNT);
+    EXPECT_EQ(stats.appendedFrames, 21u);
+    EXPECT_EQ(stats.evictedFrames, 9u);
+    EXPECT_EQ(stats.droppedFrames, 0u);
+    EXPECT_EQ(stats.bytes, 12u * TEST_FRAME_SIZE);
+    EXPECT_EQ(stats.oldestTimestampUs, timestampOf(9));
+    EXPECT_EQ(stats.newestTimestampUs, timestampOf(20));
+    EXPECT_EQ(ring.getFirstId(), 10u);
+    EXPECT_EQ(ring.getEndId(), 22u);
+
+    DashcamFrame frame;
+    EXPECT_FALSE(ring.getFrame(9, frame));      // Evicted
+    EXPECT_FALSE(ring.getFrame(22, frame));     // Not yet
+    for (uint32_t id = 10; id <= 21; id++) {
+        ASSERT_TRUE(ring.getFrame(id, frame)) << id;
+        uint32_t index = id - 1;
+        EXPECT_EQ(frame.id, id);
+        EXPECT_EQ(frame.timestampUs, timestampOf(index));
+        EXPECT_EQ(frame.control.X, controlOf(index).X);
+        EXPECT_EQ(frame.control.Y, controlOf(index).Y);
+        EXPECT_EQ(frame.control.L, controlOf(index).L);
+        ASSERT_EQ(frame.length, uint32_t(TEST_FRAME_SIZE));
+        EXPECT_EQ(std::vector<uint8_t>(frame.data, frame.data + frame.length), makeFrame(TEST_FRAME_SIZE, index)) << id;
+    }
+}
+
+TEST(DashcamRingHostTest, ReusesWholeSlabs) {
+    DashcamRing ring(TEST_SLAB_COUNT, TEST_SLAB_SIZE);
+    for (uint32_t i = 0; i < 12; i++) { ASSERT_TRUE(appendFrame(ring, i)); }
+    DashcamFrame first;
+    ASSERT_TRUE(ring.getFrame(1, first));
+    const uint8_t* firstSlab = first.data;
+
+    // The 13th frame takes the slab of the first three, from its start
+    ASSERT_TRUE(appendFrame(ring, 12));
+    DashcamFrame frame;
+    ASSERT_TRUE(ring.getFrame(13, frame));
+    EXPECT_EQ(frame.data, firstSlab);
+    EXPECT_FALSE(ring.getFrame(3, frame));
+    EXPECT_TRUE(ring.getFrame(4, frame));
+    EXPECT_EQ(ring.getStats().evictedFrames, 3u);
+
+    // A frame that does not fit the rest of the slab starts the next one, a frame larger than a slab is dropped
+    ASSERT_TRUE(appendFrame(ring, 13, 800));
+    ASSERT_TRUE(ring.getFrame(14, frame));
+    EXPECT_EQ(frame.data, firstSlab + TEST_SLAB_SIZE);
+    EXPECT_FALSE(appendFrame(ring, 14, TEST_SLAB_SIZE + 1));
+    EXPECT_EQ(ring.getStats().droppedFrames, 1u);
+    EXPECT_EQ(ring.getEndId(), 15u);
+
+    // An older timestamp would break the seek
+    std::vector<uint8_t> old = makeFrame(100, 99);
+    EXPECT_FALSE(ring.append(old.data(), 100, 640, 480, timestampOf(13), {}));
+    EXPECT_EQ(ring.getStats().droppedFrames, 2u);
+}
+
+TEST(DashcamRingHostTest, SlabIndexLimitsTheFramesPerSlab) {
+    DashcamRing ring(TEST_SLAB_COUNT, TEST_SLAB_SIZE);
+    for (uint32_t i = 0; i <= DASHCAM_SLAB_MAX_FRAMES; i++) { ASSERT_TRUE(appendFrame(ring, i, 10)); }
+    DashcamRingStats stats = ring.getStats();
+    EXPECT_EQ(stats.slabsUsed, 2u);
+    EXPECT_EQ(stats.frames, uint32_t(DASHCAM_SLAB_MAX_FRAMES + 1));
+}
+
+TEST(DashcamRingHostTest, PinnedSlabsAreNotReused) {
+    DashcamRing ring(TEST_SLAB_COUNT, TEST_SLAB_SIZE);
+    for (uint32_t i = 0; i < 12; i++) { ASSERT_TRUE(appendFrame(ring, i)); }
+    DashcamRange range = ring.pin(timestampOf(1), timestampOf(4));     // Frames 2 - 4: the first two slabs
+    EXPECT_EQ(range.firstId, 2u);
+    EXPECT_EQ(range.endId, 5u);
+
+    // The oldest slab is pinned: the ring is full
+    EXPECT_FALSE(appendFrame(ring, 12));
+    EXPECT_EQ(ring.getStats().droppedFrames, 1u);
+    DashcamFrame frame;
+    ASSERT_TRUE(ring.getFrame(2, frame));
+    EXPECT_EQ(std::vector<uint8_t>(frame.data, frame.data + frame.length), makeFrame(TEST_FRAME_SIZE, 1));
+
+    // Unpinned, the recording goes on over them
+    ring.unpin(range);
+    for (uint32_t i = 13; i < 19; i++) { ASSERT_TRUE(appendFrame(ring, i)); }
+    EXPECT_FALSE(ring.getFrame(6, frame));
+    EXPECT_EQ(ring.getStats().evictedFrames, 6u);
+
+    // An empty range pins nothing
+    range = ring.pin(timestampOf(100), timestampOf(200));
+    EXPECT_EQ(range.firstId, range.endId);
+    ring.unpin(range);
+    for (uint32_t i = 19; i < 40; i++) { ASSERT_TRUE(appendFrame(ring, i)); }
+}
+
+TEST(DashcamRingHostTest, SeeksByTimestamp) {
+    DashcamRing ring(TEST_SLAB_COUNT, TEST_SLAB_SIZE);
+    EXPECT_EQ(ring.seek(0), 1u);                    // Empty
+    for (uint32_t i = 0; i < 18; i++) { ASSERT_TRUE(appendFrame(ring, i)); }
+    // Frames 7 - 18 (indexes 6 - 17) are in the ring
+    EXPECT_EQ(ring.seek(0), 7u);                    // Before the oldest: the oldest
+    EXPECT_EQ(ring.seek(timestampOf(2)), 7u);       // Evicted
+    for (uint32_t i = 6; i < 18; i++) {
+        EXPECT_EQ(ring.seek(timestampOf(i)), i + 1) << i;           // Exact
+        EXPECT_EQ(ring.seek(timestampOf(i) - 1), i + 1) << i;       // Just before it
+        EXPECT_EQ(ring.seek(timestampOf(i) + 1), i + 2) << i;       // Just after it: the next one
+    }
+    EXPECT_EQ(ring.seek(timestampOf(18)), ring.getEndId());         // After the newest
+}
+
+// Export -------------------------------------------------------------------------------------------------------
+static uint32_t readU32(const std::string& data, size_t offset) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data()) + offset;
+    return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+}
+
+static bool appendOutput(const char* data, size_t length, void* context) {
+    static_cast<std::string*>(context)->append(data, length);
+    return true;
+}
+
+class DashcamManagerHostTest : public testing::Test {
+protected:
+    DashcamManager* dashcamManager = nullptr;
+
+    void SetUp() override {
+        HalHost::reset();
+        DashcamManager::init();
+        dashcamManager = DashcamManager::getInstance();
+        ASSERT_TRUE(dashcamManager);
+    }
+
+    void TearDown() override {
+        DashcamManager::deinit();
+    }
+
+    /**
+     * @brief Odd and even lengths, the AVI chunks are padded.
+     */
+    static size_t lengthOf(uint32_t index) { return 10001 + index * 7; }
+
+    void record(uint32_t first, uint32_t count, size_t length = 0) {
+        for (uint32_t i = first; i < first + count; i++) {
+            std::vector<uint8_t> frame = makeFrame(length ? length : lengthOf(i), i);
+            ASSERT_TRUE(dashcamManager->record(frame.data(), frame.size(), 640, 480, timestampOf(i), controlOf(i))) << i;
+        }
+    }
+};
+
+TEST_F(DashcamManagerHostTest, ExportsAvi) {
+    record(0, 10);
+    std::string avi;
+    ASSERT_EQ(dashcamManager->exportRecording(DashcamFormat::AVI, timestampOf(2), timestampOf(8), appendOutput, &avi), ESP_OK);
+
+    ASSERT_GT(avi.size(), 224u);
+    EXPECT_EQ(avi.substr(0, 4), "RIFF");
+    EXPECT_EQ(readU32(avi, 4), avi.size() - 8);
+    EXPECT_EQ(avi.substr(8, 4), "AVI ");
+    EXPECT_EQ(avi.substr(12, 4), "LIST");
+    EXPECT_EQ(avi.substr(20, 4), "hdrl");
+    EXPECT_EQ(avi.substr(24, 4), "avih");
+    EXPECT_EQ(readU32(avi, 32), uint32_t(TEST_FRAME_INTERVAL_US));  // Microseconds per frame
+    EXPECT_EQ(readU32(avi, 48), 6u);                                // Frames 2 - 7
+    EXPECT_EQ(readU32(avi, 64), 640u);
+    EXPECT_EQ(readU32(avi, 68), 480u);
+    EXPECT_NE(avi.find("vidsMJPG"), std::string::npos);
+
+    // The frame chunks, then the index pointing at them
+    size_t moviList = 20 + readU32(avi, 16);
+    ASSERT_EQ(avi.substr(moviList, 4), "LIST");
+    ASSERT_EQ(avi.substr(moviList + 8, 4), "movi");
+    size_t movi = moviList + 8;
+    size_t position = movi + 4;
+    for (uint32_t i = 2; i < 8; i++) {
+        ASSERT_EQ(avi.substr(position, 4), "00dc") << i;
+        uint32_t length = readU32(avi, position + 4);
+        ASSERT_EQ(length, lengthOf(i));
+        std::vector<uint8_t> frame = makeFrame(length, i);
+        EXPECT_EQ(avi.compare(position + 8, length, reinterpret_cast<const char*>(frame.data()), length), 0) << i;
+        position += 8 + length + (length & 1);
+    }
+    EXPECT_EQ(position, movi + readU32(avi, moviList + 4));
+    ASSERT_EQ(avi.substr(position, 4), "idx1");
+    ASSERT_EQ(readU32(avi, position + 4), 6u * 16);
+    for (uint32_t i = 0; i < 6; i++) {
+        size_t entry = position + 8 + i * 16;
+        EXPECT_EQ(avi.substr(entry, 4), "00dc");
+        EXPECT_EQ(readU32(avi, entry + 4), 0x10u);  // Key frame
+        size_t chunk = movi + readU32(avi, entry + 8);
+        EXPECT_EQ(avi.substr(chunk, 4), "00dc") << i;
+        EXPECT_EQ(readU32(avi, chunk + 4), readU32(avi, entry + 12)) << i;
+    }
+    EXPECT_EQ(position + 8 + 6 * 16, avi.size());
+    EXPECT_EQ(dashcamManager->getStats().downloads, 1u);
+}
+
+TEST_F(DashcamManagerHostTest, ExportsMjpegAndIndex) {
+    record(0, 4);
+    std::string mjpeg;
+    ASSERT_EQ(dashcamManager->exportRecording(DashcamFormat::MJPEG, 0, INT64_MAX, appendOutput, &mjpeg), ESP_OK);
+    size_t parts = 0;
+    for (size_t position = mjpeg.find("\r\n--" DASHCAM_PART_BOUNDARY "\r\n"); position != std::string::npos;
+         position = mjpeg.find("\r\n--" DASHCAM_PART_BOUNDARY "\r\n", position + 1)) {
+        parts++;
+    }
+    EXPECT_EQ(parts, 4u);
+    EXPECT_NE(mjpeg.find("X-Timestamp: 1.600000\r\nX-Frame-Id: 4\r\nX-Control: 3,-3,3,1\r\n"), std::string::npos);
+    EXPECT_NE(mjpeg.find("Content-Length: 10001\r\n"), std::string::npos);
+    const std::string end = "\r\n--" DASHCAM_PART_BOUNDARY "--\r\n";
+    EXPECT_EQ(mjpeg.substr(mjpeg.size() - end.size()), end);
+
+    std::string json;
+    ASSERT_EQ(dashcamManager->exportRecording(DashcamFormat::JSON, timestampOf(3), INT64_MAX, appendOutput, &json), ESP_OK);
+    EXPECT_EQ(json, "{\"frames\":[{\"id\":4,\"timestampUs\":1600000,\"length\":10022,\"width\":640,\"height\":480,"
+                    "\"X\":3,\"Y\":-3,\"L\":3,\"R\":1}]}");
+
+    std::string empty;
+    EXPECT_EQ(dashcamManager->exportRecording(DashcamFormat::JSON, timestampOf(4), INT64_MAX, appendOutput, &empty),
+              ESP_ERR_NOT_FOUND);
+    EXPECT_TRUE(empty.empty());
+}
+
+TEST_F(DashcamManagerHostTest, RecordingGoesOnDuringTheDownload) {
+    // The whole ring is downloaded: the frames recorded meanwhile need a new slab and are dropped, the downloaded ones
+    // stay intact
+    const size_t length = 10000;
+    const uint32_t framesPerSlab = DASHCAM_SLAB_SIZE / length;
+    const uint32_t capacity = DASHCAM_SLAB_COUNT * framesPerSlab;
+    record(0, capacity, length);
+    ASSERT_EQ(dashcamManager->getStats().evictedFrames, 0u);
+    struct Download {
+        DashcamManager* dashcamManager;
+        size_t length;
+        std::string body;
+        bool isRecorded;
+    } download = { dashcamManager, length, "", false };
+    auto output = [](const char* data, size_t length, void* context) {
+        Download* download = static_cast<Download*>(context);
+        if (!download->isRecorded) {
+            download->isRecorded = true;
+            for (uint32_t i = 0; i < 10; i++) {
+                std::vector<uint8_t> frame = makeFrame(download->length, i);
+                EXPECT_FALSE(download->dashcamManager->record(frame.data(), frame.size(), 640, 480, timestampOf(10000 + i), {}));
+            }
+        }
+        download->body.append(data, length);
+        return true;
+    };
+    ASSERT_EQ(dashcamManager->exportRecording(DashcamFormat::MJPEG, 0, INT64_MAX, output, &download), ESP_OK);
+    EXPECT_EQ(dashcamManager->getStats().droppedFrames, 10u);
+    std::vector<uint8_t> last = makeFrame(length, capacity - 1);
+    EXPECT_NE(download.body.find(std::string(last.begin(), last.end())), std::string::npos);
+
+    // Unpinned after the download
+    record(capacity, framesPerSlab, length);
+    DashcamStats stats = dashcamManager->getStats();
+    EXPECT_EQ(stats.evictedFrames, framesPerSlab);
+    EXPECT_EQ(stats.frames, capacity);
+}
+
+TEST_F(DashcamManagerHostTest, FailedOutputStopsTheExport) {
+    record(0, 3);
+    uint32_t calls = 0;
+    auto output = [](const char*, size_t, void* context) { return ++*static_cast<uint32_t*>(context) < 2; };
+    EXPECT_EQ(dashcamManager->exportRecording(DashcamFormat::AVI, 0, INT64_MAX, output, &calls), ESP_FAIL);
+    EXPECT_EQ(calls, 2u);
+    record(3, 1);   // Unpinned
+}
+
+// Recording ----------------------------------------------------------------------------------------------------
+class DashcamEndpointHostTest : public testing::Test {
+protected:
+    void SetUp() override {
+        HalHost::reset();
+        CameraManager::init();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        DashcamManager::init();
+        ServerManager::getInstance()->startServers();
+        ASSERT_NE(DashcamManager::getInstance(), nullptr);
+    }
+
+    void TearDown() override {
+        MotorManager::getInstance()->stopMotorControls();
+        MotorManager::deinit();
+        DashcamManager::setEnabled(true);
+        ServerManager::deinit();
+        DashcamManager::deinit();
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+        CameraManager::deinit();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> get(const char* uri) { return HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, uri); }
+
+    static std::shared_ptr<HttpdHostResponse> download(const char* uri) { return HttpdHost::request(VIDEO_SERVER_PORT, HTTP_GET, uri); }
+
+    static bool waitForFrames(uint32_t frames) {
+        for (uint32_t waitedMs = 0; DashcamManager::getInstance()->getStats().recordedFrames < frames; waitedMs++) {
+            if (waitedMs >= DASHCAM_TIMEOUT_MS) { return false; }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+};
+
+TEST_F(DashcamEndpointHostTest, RecordsWhileTheMotorControlsRun) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2 * DASHCAM_PERIOD_MS));
+    EXPECT_EQ(DashcamManager::getInstance()->getStats().recordedFrames, 0u);
+    EXPECT_EQ(download("/dcm")->getStatus(), 404);
+
+    MotorManager::getInstance()->startMotorControls();
+    MotorManager::getInstance()->setControlData(0, 40, 0, 10);
+    ASSERT_TRUE(waitForFrames(2));     // The first frame can have the control data before the request
+    std::shared_ptr<HttpdHostResponse> response = get("/rec");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_NE(response->getBody().find("{\"enabled\":true,\"recording\":true,\"frames\":"), std::string::npos);
+
+    response = download("/dcm?fmt=json");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_EQ(response->getType(), "application/json");
+    EXPECT_NE(response->getBody().find("\"width\":640,\"height\":480,\"X\":0,\"Y\":40,\"L\":0,\"R\":10}"), std::string::npos);
+
+    response = download("/dcm?last=5");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_EQ(response->getType(), "video/x-msvideo");
+    EXPECT_EQ(response->getHeader("Content-Disposition"), "attachment; filename=\"dashcam.avi\"");
+    EXPECT_EQ(response->getBody().substr(0, 4), "RIFF");
+    EXPECT_EQ(readU32(response->getBody(), 4), response->getBody().size() - 8);
+
+    // Stopped: no more frames
+    EXPECT_NE(get("/rec?E=0")->getBody().find("{\"enabled\":false,\"recording\":false"), std::string::npos);
+    std::this_thread::sleep_for(std::chrono::milliseconds(DASHCAM_PERIOD_MS));
+    uint32_t frames = DashcamManager::getInstance()->getStats().recordedFrames;
+    std::this_thread::sleep_for(std::chrono::milliseconds(2 * DASHCAM_PERIOD_MS));
+    EXPECT_EQ(DashcamManager::getInstance()->getStats().recordedFrames, frames);
+}
+
+TEST_F(DashcamEndpointHostTest, InvalidQueries) {
+    for (const char* uri : { "/dcm?fmt=mp4", "/dcm?from=-1", "/dcm?last=0", "/dcm?to=x" }) {
+        std::shared_ptr<HttpdHostResponse> response = download(uri);
+        ASSERT_TRUE(response) << uri;
+        EXPECT_EQ(response->getStatus(), 400) << uri;
+    }
+    EXPECT_EQ(get("/rec?E=2")->getStatus(), 400);
+    EXPECT_EQ(download("/dcm?fmt=mjpeg&from=1000")->getStatus(), 404);
+}
@@ -0,0 +1,393 @@
+/*
+ * File: FlightRecorderHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the flight recorder. The block format is encoded and decoded back (every record type, extreme values,
+    the size of the unchanged fields, full and broken blocks), the ring is filled over its end, and the records of the
+    motor loop, the control data and the Wi-Fi events are downloaded from /flt.
+*/
+
+#include "CameraManager.h"
+#include "FlightLog.h"
+#include "FlightRecorder.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "MotorManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+#include "WiFiModulManager.h"
+
+// C++
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define TEST_BLOCK_SIZE             256
+#define TEST_BASE_TIMESTAMP_US      5000000
+#define FLIGHT_TIMEOUT_MS           3000
+
+static void collectRecord(const FlightRecord& record, void* context) {
+    static_cast<std::vector<FlightRecord>*>(context)->push_back(record);
+}
+
+static bool isSameRecord(const FlightRecord& a, const FlightRecord& b) {
+    return a.type == b.type && a.timestampUs == b.timestampUs && a.fields[0] == b.fields[0] && a.fields[1] == b.fields[1] &&
+           a.fields[2] == b.fields[2] && a.fields[3] == b.fields[3];
+}
+
+/**
+ * @brief Decode the blocks of a download.
+ *
+ * @param sequences The sequences of the blocks (nullptr: not needed).
+ * @return false If a block is broken.
+ */
+static bool decodeBlocks(const std::string& body, std::vector<FlightRecord>& records, std::vector<uint32_t>* sequences = nullptr) {
+    size_t offset = 0;
+    while (offset < body.size()) {
+        FlightLogBlockHeader header;
+        const uint8_t* block = reinterpret_cast<const uint8_t*>(body.data()) + offset;
+        if (FlightLogDecoder::decodeBlock(block, body.size() - offset, collectRecord, &records, &header) != ESP_OK) { return false; }
+        if (sequences) { sequences->push_back(header.sequence); }
+        offset += header.length;
+    }
+    return true;
+}
+
+// Block format -------------------------------------------------------------------------------------------------
+TEST(FlightLogHostTest, RoundTripsEveryRecordType) {
+    const FlightRecord RECORDS[] = {
+        { FlightRecordType::CONTROL, TEST_BASE_TIMESTAMP_US, { 0, 100, 0, 20 } },
+        { FlightRecordType::MOTOR, TEST_BASE_TIMESTAMP_US + 15, { 230, -230, 0, 41 } },
+        { FlightRecordType::MOTOR, TEST_BASE_TIMESTAMP_US + 20015, { -70, 150, 20000, 38 } },
+        { FlightRecordType::WIFI, TEST_BASE_TIMESTAMP_US + 20015, { 1, 201, 0, 0 } },          // Same time
+        { FlightRecordType::CONTROL, TEST_BASE_TIMESTAMP_US + 3600000000LL, { -80, 0, 0, 0 } }, // An hour later
+        { FlightRecordType::CONTROL, TEST_BASE_TIMESTAMP_US + 3600000001LL, { INT32_MIN, INT32_MAX, -1, 1 } },
+        { FlightRecordType::CONTROL, TEST_BASE_TIMESTAMP_US + 3600000002LL, { INT32_MAX, INT32_MIN, 0, 0 } },
+    };
+    std::vector<uint8_t> block(1024);
+    FlightLogEncoder encoder;
+    encoder.start(block.data(), block.size(), 42, TEST_BASE_TIMESTAMP_US);
+    for (const FlightRecord& record : RECORDS) { ASSERT_EQ(encoder.append(record), ESP_OK); }
+
+    std::vector<FlightRecord> decoded;
+    FlightLogBlockHeader header;
+    ASSERT_EQ(FlightLogDecoder::decodeBlock(block.data(), encoder.getLength(), collectRecord, &decoded, &header), ESP_OK);
+    EXPECT_EQ(header.sequence, 42u);
+    EXPECT_EQ(header.baseTimestampUs, TEST_BASE_TIMESTAMP_US);
+    EXPECT_EQ(header.length, encoder.getLength());
+    EXPECT_EQ(header.recordCount, sizeof(RECORDS) / sizeof(RECORDS[0]));
+    ASSERT_EQ(decoded.size(), sizeof(RECORDS) / sizeof(RECORDS[0]));
+    for (size_t i = 0; i < decoded.size(); i++) { EXPECT_TRUE(isSameRecord(decoded[i], RECORDS[i])) << i; }
+}
+
+TEST(FlightLogHostTest, UnchangedFieldsAreNotStored) {
+    std::vector<uint8_t> block(TEST_BLOCK_SIZE);
+    FlightLogEncoder encoder;
+    encoder.start(block.data(), block.size(), 0, TEST_BASE_TIMESTAMP_US);
+    ASSERT_EQ(encoder.getLength(), sizeof(FlightLogBlockHeader));
+
+    // The first motor loop stores every field: tag, time, 150 (2 bytes) twice, 20000 (3 bytes) and 40
+    FlightRecord record = { FlightRecordType::MOTOR, TEST_BASE_TIMESTAMP_US, { 150, 150, 20000, 40 } };
+    ASSERT_EQ(encoder.append(record), ESP_OK);
+    EXPECT_EQ(encoder.getLength(), sizeof(FlightLogBlockHeader) + 1 + 1 + 2 + 2 + 3 + 1);
+
+    // The same loop 20 ms later: the tag and the time (3 bytes) only, then a busy time change costs one byte
+    size_t length = encoder.getLength();
+    record.timestampUs += 20000;
+    ASSERT_EQ(encoder.append(record), ESP_OK);
+    EXPECT_EQ(encoder.getLength() - length, 4u);
+    length = encoder.getLength();
+    record.timestampUs += 20000;
+    record.fields[3] = 37;
+    ASSERT_EQ(encoder.append(record), ESP_OK);
+    EXPECT_EQ(encoder.getLength() - length, 5u);
+
+    // The deltas are kept per type: a control record in between does not change the next motor loop
+    record.timestampUs += 1;
+    ASSERT_EQ(encoder.append({ FlightRecordType::CONTROL, record.timestampUs, { 0, 50, 0, 0 } }), ESP_OK);
+    length = encoder.getLength();
+    record.timestampUs += 19999;
+    ASSERT_EQ(encoder.append(record), ESP_OK);
+    EXPECT_EQ(encoder.getLength() - length, 4u);
+
+    std::vector<FlightRecord> decoded;
+    ASSERT_EQ(FlightLogDecoder::decodeBlock(block.data(), encoder.getLength(), collectRecord, &decoded), ESP_OK);
+    ASSERT_EQ(decoded.size(), 5u);
+    EXPECT_TRUE(isSameRecord(decoded[4], record));
+    EXPECT_EQ(decoded[1].fields[3], 40);
+    EXPECT_EQ(decoded[2].fields[3], 37);
+}
+
+TEST(FlightLogHostTest, FullBlockRejectsTheRecord) {
+    std::vector<uint8_t> block(TEST_BLOCK_SIZE);
+    FlightLogEncoder encoder;
+    encoder.start(block.data(), block.size(), 7, TEST_BASE_TIMESTAMP_US);
+    FlightRecord record = { FlightRecordType::CONTROL, TEST_BASE_TIMESTAMP_US, { 0, 0, 0, 0 } };
+    uint16_t records = 0;
+    while (true) {
+        record.timestampUs += 1000000;
+        record.fields[0] = records % 2 ? INT32_MIN : INT32_MAX; // The largest deltas
+        record.fields[1] = -record.fields[0];
+        esp_err_t res = encoder.append(record);
+        if (res == ESP_ERR_INVALID_SIZE) { break; }
+        ASSERT_EQ(res, ESP_OK);
+        records++;
+    }
+    EXPECT_GT(records, 0);
+    EXPECT_LE(encoder.getLength(), block.size());
+
+    // The block is complete without the rejected record
+    std::vector<FlightRecord> decoded;
+    FlightLogBlockHeader header;
+    ASSERT_EQ(FlightLogDecoder::decodeBlock(block.data(), block.size(), collectRecord, &decoded, &header), ESP_OK);
+    EXPECT_EQ(header.recordCount, records);
+    EXPECT_EQ(decoded.size(), records);
+}
+
+TEST(FlightLogHostTest, InvalidRecordsAndBlocks) {
+    std::vector<uint8_t> block(TEST_BLOCK_SIZE);
+    FlightLogEncoder encoder;
+    EXPECT_EQ(encoder.append({ FlightRecordType::CONTROL, 0, {} }), ESP_ERR_INVALID_SIZE); // Not started
+    encoder.start(block.data(), block.size(), 0, TEST_BASE_TIMESTAMP_US);
+    EXPECT_EQ(encoder.append({ static_cast<FlightRecordType>(9), TEST_BASE_TIMESTAMP_US, {} }), ESP_ERR_INVALID_ARG);
+    EXPECT_EQ(encoder.append({ FlightRecordType::CONTROL, TEST_BASE_TIMESTAMP_US - 1, {} }), ESP_ERR_INVALID_ARG);
+    ASSERT_EQ(encoder.append({ FlightRecordType::MOTOR, TEST_BASE_TIMESTAMP_US + 20000, { 150, 150, 20000, 40 } }), ESP_OK);
+    size_t length = encoder.getLength();
+
+    EXPECT_EQ(FlightLogDecoder::decodeBlock(block.data(), length, nullptr, nullptr), ESP_OK);
+    EXPECT_EQ(FlightLogDecoder::decodeBlock(block.data(), length - 1, nullptr, nullptr), ESP_ERR_INVALID_SIZE);
+    EXPECT_EQ(FlightLogDecoder::decodeBlock(block.data(), sizeof(FlightLogBlockHeader) - 1, nullptr, nullptr), ESP_ERR_INVALID_SIZE);
+
+    std::vector<uint8_t> broken(block.begin(), block.begin() + length);
+    broken[0] ^= 0xFF;
+    EXPECT_EQ(FlightLogDecoder::decodeBlock(broken.data(), length, nullptr, nullptr), ESP_ERR_INVALID_VERSION);
+
+    // A record that runs over the end of the block, and a tag of an unknown type
+    broken.assign(block.begin(), block.begin() + length);
+    reinterpret_cast<FlightLogBlockHeader*>(broken.data())->length = uint16_t(length - 1);
+    EXPECT_EQ(FlightLogDecoder::decodeBlock(broken.data(), length, nullptr, nullptr), ESP_ERR_INVALID_SIZE);
+    broken.assign(block.begin(), block.begin() + length);
+    broken[sizeof(FlightLogBlockHeader)] = 0x0F;
+    EXPECT_EQ(FlightLogDecoder::decodeBlock(broken.data(), length, nullptr, nullptr), ESP_ERR_INVALID_ARG);
+}
+
+// Recorder -----------------------------------------------------------------------------------------------------
+class FlightRecorderHostTest : public testing::Test {
+protected:
+    void SetUp() override {
+        HalHost::reset();
+        FlightRecorder::init();
+        ASSERT_NE(FlightRecorder::getInstance(), nullptr);
+    }
+
+    void TearDown() override { FlightRecorder::deinit(); }
+
+    static std::string download(uint32_t firstSequence = 0) {
+        std::string body;
+        EXPECT_EQ(FlightRecorder::getInstance()->exportLog(firstSequence, [](const char* data, size_t length, void* context) {
+            static_cast<std::string*>(context)->append(data, length);
+            return true;
+        }, &body), ESP_OK);
+        return body;
+    }
+};
+
+TEST_F(FlightRecorderHostTest, EmptyRecorder) {
+    EXPECT_EQ(download(), "");
+    FlightRecorderStats stats = FlightRecorder::getInstance()->getStats();
+    EXPECT_EQ(stats.records, 0u);
+    EXPECT_EQ(stats.blocks, 0u);
+    EXPECT_EQ(stats.bytes, 0u);
+    EXPECT_EQ(stats.downloads, 1u);
+}
+
+TEST_F(FlightRecorderHostTest, RecordsInTimeOrder) {
+    FlightRecorder::recordControl({ 0, 60, 0, 10 });
+    FlightRecorder::recordMotorLoop(166, 150, 0, 35);
+    FlightRecorder::recordWiFiEvent(HalWiFiEvent::STA_DISCONNECTED, 8);
+
+    std::vector<FlightRecord> records;
+    std::vector<uint32_t> sequences;
+    ASSERT_TRUE(decodeBlocks(download(), records, &sequences));
+    ASSERT_EQ(records.size(), 3u);
+    EXPECT_EQ(sequences, std::vector<uint32_t>{ 0 });
+    EXPECT_TRUE(isSameRecord(records[0], { FlightRecordType::CONTROL, records[0].timestampUs, { 0, 60, 0, 10 } }));
+    EXPECT_TRUE(isSameRecord(records[1], { FlightRecordType::MOTOR, records[1].timestampUs, { 166, 150, 0, 35 } }));
+    EXPECT_TRUE(isSameRecord(records[2], { FlightRecordType::WIFI, records[2].timestampUs, { int32_t(HalWiFiEvent::STA_DISCONNECTED), 8 } }));
+    EXPECT_LE(records[0].timestampUs, records[1].timestampUs);
+    EXPECT_LE(records[1].timestampUs, records[2].timestampUs);
+    EXPECT_LE(records[2].timestampUs, Hal::Timer::getTimeUs());
+
+    // Not initialized: nothing is recorded (and nothing breaks)
+    FlightRecorder::deinit();
+    FlightRecorder::recordControl({ 0, 0, 0, 0 });
+    FlightRecorder::init();
+    EXPECT_EQ(FlightRecorder::getInstance()->getStats().records, 0u);
+}
+
+TEST_F(FlightRecorderHostTest, OverwritesTheOldestBlocks) {
+    FlightRecorder* flightRecorder = FlightRecorder::getInstance();
+    for (int32_t i = 0; flightRecorder->getStats().blocks <= FLIGHT_RECORDER_BLOCK_COUNT + 2; i++) {
+        for (uint8_t j = 0; j < 100; j++) { FlightRecorder::recordControl({ int16_t(i), int16_t(-i), int8_t(j), 0 }); }
+    }
+    FlightRecorderStats stats = flightRecorder->getStats();
+    EXPECT_EQ(stats.overwrittenBlocks, stats.blocks - FLIGHT_RECORDER_BLOCK_COUNT);
+    EXPECT_EQ(stats.oldestSequence, stats.overwrittenBlocks);
+    EXPECT_EQ(stats.rejectedRecords, 0u);
+    EXPECT_LE(stats.bytes, uint32_t(FLIGHT_RECORDER_BLOCK_COUNT * FLIGHT_RECORDER_BLOCK_SIZE));
+
+    // Every block of the ring, oldest first, each one decoded on its own
+    std::string body = download();
+    EXPECT_EQ(body.size(), stats.bytes);
+    std::vector<FlightRecord> records;
+    std::vector<uint32_t> sequences;
+    ASSERT_TRUE(decodeBlocks(body, records, &sequences));
+    ASSERT_EQ(sequences.size(), size_t(FLIGHT_RECORDER_BLOCK_COUNT));
+    for (size_t i = 0; i < sequences.size(); i++) { ASSERT_EQ(sequences[i], stats.oldestSequence + i); }
+    EXPECT_LT(records.size(), stats.records);
+    for (size_t i = 1; i < records.size(); i++) {
+        ASSERT_GE(records[i].timestampUs, records[i - 1].timestampUs);
+        ASSERT_EQ(uint8_t(records[i].fields[2]), uint8_t(records[i - 1].fields[2] + 1) % 100); // No record is missing
+    }
+
+    // From a sequence on: the newest block again, to follow the log
+    records.clear();
+    sequences.clear();
+    ASSERT_TRUE(decodeBlocks(download(stats.blocks - 1), records, &sequences));
+    EXPECT_EQ(sequences, std::vector<uint32_t>{ stats.blocks - 1 });
+    EXPECT_EQ(download(stats.blocks), "");
+}
+
+TEST_F(FlightRecorderHostTest, FailedOutputStopsTheDownload) {
+    for (uint16_t i = 0; FlightRecorder::getInstance()->getStats().blocks < 3; i++) { FlightRecorder::recordMotorLoop(int16_t(i), 0, i, 0); }
+    uint32_t pieces = 0;
+    EXPECT_EQ(FlightRecorder::getInstance()->exportLog(0, [](const char* data, size_t length, void* context) {
+        return ++*static_cast<uint32_t*>(context) < 2;
+    }, &pieces), ESP_FAIL);
+    EXPECT_EQ(pieces, 2u);
+}
+
+// Endpoint -----------------------------------------------------------------------------------------------------
+class FlightRecorderEndpointHostTest : public testing::Test {
+protected:
+    void SetUp() override {
+        HalHost::reset();
+        FlightRecorder::init();
+        CameraManager::init();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        ServerManager::getInstance()->startServers();
+    }
+
+    void TearDown() override {
+        MotorManager::getInstance()->stopMotorControls();
+        MotorManager::deinit();
+        WiFiModulManager::deinit();
+        ServerManager::deinit();
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+        CameraManager::deinit();
+        FlightRecorder::deinit();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> get(const char* uri) { return HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, uri); }
+};
+
+TEST_F(FlightRecorderEndpointHostTest, RecordsTheDrive) {
+    WiFiModulManager::getInstance(); // The event callback of the fake Wi-Fi
+    HalHost::emitWiFiEvent(HalWiFiEvent::STA_CONNECTED);
+    MotorManager::getInstance()->startMotorControls();
+    ASSERT_EQ(get("/mov?X=0&Y=50&L=0&R=0")->getStatus(), 200);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10 * MOTOR_CONTROL_PERIOD_MS));
+    HalHost::emitWiFiEvent(HalWiFiEvent::STA_DISCONNECTED, "", "", "", 201);
+
+    std::shared_ptr<HttpdHostResponse> response = get("/flt");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_EQ(response->getType(), "application/octet-stream");
+    EXPECT_EQ(response->getHeader("Content-Disposition"), "attachment; filename=\"flight.bin\"");
+    std::vector<FlightRecord> records;
+    ASSERT_TRUE(decodeBlocks(response->getBody(), records));
+
+    // The Wi-Fi events around the control data of the start (0) and of /mov, and the motor loops with its duties
+    int16_t duty = Motor::convertSpeedPercentageToDutyCycle(50);
+    std::vector<FlightRecord> controls, loops, events;
+    for (const FlightRecord& record : records) {
+        if (record.type == FlightRecordType::CONTROL) { controls.push_back(record); }
+        if (record.type == FlightRecordType::MOTOR) { loops.push_back(record); }
+        if (record.type == FlightRecordType::WIFI) { events.push_back(record); }
+    }
+    ASSERT_EQ(events.size(), 2u);
+    EXPECT_EQ(events[0].fields[0], int32_t(HalWiFiEvent::STA_CONNECTED));
+    EXPECT_EQ(events[1].fields[0], int32_t(HalWiFiEvent::STA_DISCONNECTED));
+    EXPECT_EQ(events[1].fields[1], 201);
+    ASSERT_EQ(controls.size(), 2u);
+    EXPECT_TRUE(isSameRecord(controls[1], { FlightRecordType::CONTROL, controls[1].timestampUs, { 0, 50, 0, 0 } }));
+    ASSERT_GE(loops.size(), 3u);
+    EXPECT_EQ(loops[0].fields[2], 0);   // No period for the first loop
+    const FlightRecord& last = loops.back();
+    EXPECT_EQ(last.fields[0], duty);
+    EXPECT_EQ(last.fields[1], duty);
+    EXPECT_GE(last.fields[2], MOTOR_CONTROL_PERIOD_MS * 1000);
+    EXPECT_LT(last.fields[2], 20 * MOTOR_CONTROL_PERIOD_MS * 1000);
+    EXPECT_GE(last.fields[3], 0);
+    EXPECT_LT(last.fields[3], last.fields[2]);
+
+    EXPECT_NE(get("/sst")->getBody().find("flight records "), std::string::npos);
+}
+
+TEST_F(FlightRecorderEndpointHostTest, RecordsAcrossTheMotorStops) {
+    // Every mode change away from DRIVE stops the motor task, which records every loop under the recorder lock: the
+    // lock is free after each stop, /mov records its command and /flt downloads
+    MotorManager* motorManager = MotorManager::getInstance();
+    for (uint32_t i = 0; i < 10; i++) {
+        motorManager->startMotorControls();
+        std::this_thread::sleep_for(std::chrono::milliseconds(MOTOR_CONTROL_PERIOD_MS + i));
+        motorManager->stopMotorControls();
+        ASSERT_EQ(get("/mov?X=0&Y=30&L=0&R=0")->getStatus(), 200) << i;
+    }
+    std::shared_ptr<HttpdHostResponse> response = get("/flt");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    std::vector<FlightRecord> records;
+    ASSERT_TRUE(decodeBlocks(response->getBody(), records));
+    uint32_t loops = 0;
+    for (const FlightRecord& record : records) { loops += record.type == FlightRecordType::MOTOR; }
+    EXPECT_GE(loops, 10u);
+}
+
+TEST_F(FlightRecorderEndpointHostTest, FollowsTheLog) {
+    FlightRecorder::recordControl({ 1, 2, 3, 4 });
+    std::shared_ptr<HttpdHostResponse> response = get("/flt?S=0");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_FALSE(response->getBody().empty());
+    response = get("/flt?S=1");
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_EQ(response->getBody(), "");
+
+    for (const char* uri : { "/flt?S=-1", "/flt?S=x" }) {
+        response = get(uri);
+        ASSERT_TRUE(response) << uri;
+        EXPECT_EQ(response->getStatus(), 400) << uri;
+    }
+}
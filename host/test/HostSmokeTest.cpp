@@ -0,0 +1,150 @@
+/*
+ * File: HostSmokeTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build smoke test: the managers run against the fake HAL, and the command server handlers answer injected
+    requests. It returns a non-zero exit code if a check fails.
+*/
+
+#include "CameraManager.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "MotorManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+
+// C
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+}
+
+static int failures = 0;
+
+#define CHECK(condition) do {                                                           \
+        if (!(condition)) {                                                             \
+            printf("FAILED: %s (%s:%d)\n", #condition, __FILE__, __LINE__);             \
+            failures++;                                                                 \
+        }                                                                               \
+    } while (0)
+
+// Test cases -----------------------------------------------------------
+static void checkMotors() {
+    MotorManager* motorManager = MotorManager::getInstance();
+    CHECK(HalHost::getPwmGpio(MOTOR_1_CW) == MOTOR_1_GPIO_CW);
+    CHECK(HalHost::getPwmGpio(MOTOR_2_CCW) == MOTOR_2_GPIO_CCW);
+
+    motorManager->setControlData(0, 100, 0, 0); // Full speed forward
+    motorManager->directionControlManual();
+    CHECK(HalHost::getPwmDuty(MOTOR_1_CW) == MOTOR_MAX_SPEED);
+    CHECK(HalHost::getPwmDuty(MOTOR_2_CW) == MOTOR_MAX_SPEED);
+    CHECK(HalHost::getPwmDuty(MOTOR_1_CCW) == 0);
+    CHECK(HalHost::getPwmDuty(MOTOR_2_CCW) == 0);
+
+    motorManager->setControlData(0, 0, 0, 0);
+    motorManager->directionControlManual();
+    CHECK(HalHost::getPwmDuty(MOTOR_1_CW) == MOTOR_OFF);
+    CHECK(HalHost::getPwmDuty(MOTOR_2_CW) == MOTOR_OFF);
+}
+
+static void checkLeds() {
+    LedManager::init();
+    LedManager* ledManager = LedManager::getInstance();
+    CHECK(ledManager != nullptr);
+    CHECK(HalHost::isLedStripInitialized());
+    if (!ledManager) { return; }
+
+    uint32_t transmitCount = HalHost::getLedTransmitCount();
+    ledManager->setAllOff();
+    ledManager->transmitWaveformToLedArray();
+    std::vector<uint8_t> pixels = HalHost::getLedPixels();
+    CHECK(HalHost::getLedTransmitCount() == transmitCount + 1);
+    CHECK(pixels.size() == 18);
+    bool isDark = true;
+    for (uint8_t pixel : pixels) { isDark = isDark && pixel == 0; }
+    CHECK(isDark);
+}
+
+static void checkStorage() {
+    StorageManager::init();
+    StorageManager* storageManager = StorageManager::getInstance();
+    CHECK(storageManager != nullptr);
+    if (!storageManager) { return; }
+
+    uint32_t commitCount = HalHost::getStorageCommitCount();
+    storageManager->setWiFiSSID("host-ssid");
+    storageManager->setColorNumber(2);
+    CHECK(HalHost::getStorageCommitCount() == commitCount + 2);
+
+    StorageManager::deinit(); // The keys survive a restart
+    StorageManager::init();
+    storageManager = StorageManager::getInstance();
+    storageManager->getAllDataFromStorage();
+    CHECK(storageManager->getWiFiSSID() == "host-ssid");
+    CHECK(storageManager->getColorNumber() == 2);
+}
+
+static void checkCommandServer() {
+    ServerManager* serverManager = ServerManager::getInstance();
+    serverManager->startCommandServer();
+    CHECK(HttpdHost::isServerRunning(COMMAND_SERVER_PORT));
+
+    std::shared_ptr<HttpdHostResponse> response = HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, "/mov?X=0&Y=-40&L=0&R=10");
+    CHECK(response && response->getStatus() == 200);
+    ControlData controlData = MotorManager::getInstance()->getControlData();
+    CHECK(controlData.X == 0 && controlData.Y == -40 && controlData.L == 0 && controlData.R == 10);
+
+    response = HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, "/mov?X=0");
+    CHECK(response && response->getStatus() == 404);
+
+    response = HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, "/gst");
+    CHECK(response && response->getStatus() == 200 && response->getType() == "application/json");
+    CHECK(response && response->getBody().find("host-ssid") != std::string::npos);
+
+    response = HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, "/mod?M=99");
+    CHECK(response && response->getStatus() == 404);
+
+    serverManager->stopCommandServer();
+    CHECK(!HttpdHost::isServerRunning(COMMAND_SERVER_PORT));
+}
+
+static void checkCamera() {
+    CameraManager::init();
+    CameraManager* cameraManager = CameraManager::getInstance();
+    CHECK(cameraManager != nullptr);
+    CHECK(HalHost::isCameraInitialized());
+    if (!cameraManager) { return; }
+    CHECK(HalHost::getCameraConfig().frameBufferCount == CAMERA_FB_COUNT);
+
+    cameraManager->powerDown();
+    CHECK(HalHost::isCameraPoweredDown());
+    cameraManager->powerUp();
+    CHECK(!HalHost::isCameraPoweredDown());
+    CameraManager::deinit();
+    CHECK(!HalHost::isCameraInitialized());
+}
+
+int main() {
+    ModeManager::init(); // Used by the command handlers
+
+    checkMotors();
+    checkLeds();
+    checkStorage();
+    checkCommandServer();
+    checkCamera();
+
+    printf("%s (%d failed checks)\n", failures ? "FAILED" : "PASSED", failures);
+    return failures ? 1 : 0;
+}
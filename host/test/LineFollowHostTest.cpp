@@ -0,0 +1,410 @@
+/*
+ * File: LineFollowHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the line follow. LineFollower on rendered track thumbnails (the level camera of the vision model over
+    a taped floor, with uneven light and sensor noise), a closed loop through MotorManager and a differential drive
+    model for the steering stability, and /lfw with the fake camera.
+*/
+
+#include "CameraManager.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "LineFollower.h"
+#include "ModeManager.h"
+#include "MotorManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+#include "VisionManager.h"
+
+// C++
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define THUMBNAIL_WIDTH     80      // VGA at 1/8 scale, the fake camera frame
+#define THUMBNAIL_HEIGHT    60
+#define TAPE_WIDTH_MM       19
+#define SIM_FRAME_MS        VISION_LINE_PERIOD_MS
+#define SIM_WHEEL_BASE_MM   90
+#define SIM_MM_PER_PERCENT  5.0f    // Wheel speed per speed percent (40 %: 200 mm/s)
+#define LINE_TIMEOUT_MS     3000
+
+// Track --------------------------------------------------------------------------------------------------------
+struct Pose {
+    float xMm;                      // Right
+    float zMm;                      // Forward
+    float heading;                  // Radians, positive: right
+};
+
+/*
+    A straight tape along the z axis (radius 0), or a circle through the origin that turns right (its center is at
+    x = radius).
+*/
+struct Track {
+    float radiusMm;
+
+    float distanceMm(float x, float z) const { // Signed, positive: right of the tape
+        if (radiusMm == 0) { return x; }
+        return radiusMm - hypotf(x - radiusMm, z);
+    }
+};
+
+/**
+ * @brief The thumbnail seen from a pose: 2 x 2 samples per pixel, a light gradient and Gaussian noise.
+ */
+static std::vector<uint8_t> renderTrack(const Track& track, const Pose& pose, float noise = 0, float gradient = 0,
+                                        uint32_t seed = 1) {
+    const float focal = THUMBNAIL_WIDTH * VISION_FOCAL_PERMILLE / 1000.0f;
+    const float horizon = THUMBNAIL_HEIGHT * VISION_HORIZON_PERMILLE / 1000.0f;
+    std::mt19937 random(seed);
+    std::normal_distribution<float> sensorNoise(0.0f, noise > 0 ? noise : 1.0f);
+    std::vector<uint8_t> image(THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT);
+    for (uint16_t y = 0; y < THUMBNAIL_HEIGHT; y++) {
+        for (uint16_t x = 0; x < THUMBNAIL_WIDTH; x++) {
+            float sum = 0;
+            for (float dy : { 0.25f, 0.75f }) {
+                for (float dx : { 0.25f, 0.75f }) {
+                    float v = y + dy - horizon;
+                    if (v <= 0.5f) { sum += 120; continue; } // The wall
+                    float depth = VISION_CAMERA_HEIGHT_MM * focal / v;
+                    float side = (x + dx - THUMBNAIL_WIDTH / 2.0f) * depth / focal;
+                    float worldX = pose.xMm + side * cosf(pose.heading) + depth * sinf(pose.heading);
+                    float worldZ = pose.zMm - side * sinf(pose.heading) + depth * cosf(pose.heading);
+                    bool isTape = fabsf(track.distanceMm(worldX, worldZ)) < TAPE_WIDTH_MM / 2.0f;
+                    sum += isTape ? 45 : 170;
+                }
+            }
+            float value = sum / 4 + gradient * (float(x) / THUMBNAIL_WIDTH - 0.5f) + (noise > 0 ? sensorNoise(random) : 0.0f);
+            image[y * THUMBNAIL_WIDTH + x] = uint8_t(value < 0 ? 0 : value > 255 ? 255 : lroundf(value));
+        }
+    }
+    return image;
+}
+
+static LineObservation detect(const std::vector<uint8_t>& image) {
+    LineObservation observation;
+    LineFollower::detect(image.data(), THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, observation);
+    return observation;
+}
+
+static float radiansToDeciDeg(float radians) { return radians * 1800.0f / float(M_PI); }
+
+// Detection ----------------------------------------------------------------------------------------------------
+TEST(LineFollowerHostTest, IntegerArcTangentMatchesTheLibrary) {
+    for (int32_t denominator : { 1000, 250, -700, 3, -1 }) {
+        for (int32_t numerator = -5000; numerator <= 5000; numerator += 125) {
+            float expected = radiansToDeciDeg(atan2f(float(numerator), float(denominator)));
+            EXPECT_NEAR(LineFollower::atan2DeciDeg(numerator, denominator), expected, 6) << numerator << " / " << denominator;
+        }
+    }
+    EXPECT_EQ(LineFollower::atan2DeciDeg(0, 0), 0);
+}
+
+TEST(LineFollowerHostTest, CenteredLineAhead) {
+    LineObservation observation = detect(renderTrack({ 0 }, { 0, 0, 0 }));
+    ASSERT_TRUE(observation.isFound);
+    EXPECT_EQ(observation.rows, LINE_SCAN_ROWS);
+    EXPECT_NEAR(observation.offsetMm, 0, 2);
+    EXPECT_NEAR(observation.angleDeciDeg, 0, 15);
+    EXPECT_NEAR(observation.targetMm, 0, 2);
+    // The middle columns of the near field
+    const uint32_t middle = (1u << (VISION_GRID_COLUMNS / 2 - 1)) | (1u << (VISION_GRID_COLUMNS / 2));
+    EXPECT_NE(observation.cells & (middle << (2 * VISION_GRID_COLUMNS)), 0u);
+    EXPECT_NE(observation.cells & (middle << (3 * VISION_GRID_COLUMNS)), 0u);
+    EXPECT_EQ(observation.cells & ~(middle * ((1u << (2 * VISION_GRID_COLUMNS)) | (1u << (3 * VISION_GRID_COLUMNS)))), 0u);
+}
+
+TEST(LineFollowerHostTest, OffsetAndAngleOnTheFloor) {
+    // The drone is 40 mm left of the tape, turned 10 degrees left: the tape is right of it and turns right
+    LineObservation observation = detect(renderTrack({ 0 }, { -40, 0, -0.1745f }));
+    ASSERT_TRUE(observation.isFound);
+    EXPECT_EQ(observation.rows, LINE_SCAN_ROWS);
+    // At the nearest scan row (about 130 mm ahead) the tape is 40 mm / cos + 130 mm * tan to the right
+    EXPECT_NEAR(observation.offsetMm, 40 / cosf(0.1745f) + 130 * tanf(0.1745f), 8);
+    EXPECT_NEAR(observation.angleDeciDeg, 100, 20);
+    EXPECT_NEAR(observation.targetMm, 40 / cosf(0.1745f) + LINE_LOOKAHEAD_MM * tanf(0.1745f), 10);
+
+    observation = detect(renderTrack({ 0 }, { 30, 0, 0.0873f }));
+    ASSERT_TRUE(observation.isFound);
+    EXPECT_LT(observation.offsetMm, -30);
+    EXPECT_NEAR(observation.angleDeciDeg, -50, 20);
+}
+
+TEST(LineFollowerHostTest, UnevenLightAndNoise) {
+    // Like a recorded frame under a lamp: a 60 gray level gradient across the view, sensor noise
+    for (uint32_t seed = 1; seed <= 20; seed++) {
+        LineObservation observation = detect(renderTrack({ 0 }, { -20, 0, 0.05f }, 6.0f, 60.0f, seed));
+        ASSERT_TRUE(observation.isFound) << seed;
+        EXPECT_GE(observation.rows, LINE_SCAN_ROWS - 1) << seed;
+        EXPECT_NEAR(observation.offsetMm, 20 - 130 * tanf(0.05f), 8) << seed;
+        EXPECT_NEAR(observation.angleDeciDeg, -29, 40) << seed;
+    }
+}
+
+TEST(LineFollowerHostTest, NoLineOnAPlainFloorOrUnderAShadow) {
+    std::vector<uint8_t> floor(THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT, 160);
+    EXPECT_FALSE(detect(floor).isFound);
+
+    // Half of the view is dark: a shadow or a wall, not a line
+    for (uint16_t y = 0; y < THUMBNAIL_HEIGHT; y++) {
+        for (uint16_t x = 0; x < THUMBNAIL_WIDTH / 2; x++) { floor[y * THUMBNAIL_WIDTH + x] = 40; }
+    }
+    EXPECT_FALSE(detect(floor).isFound);
+    EXPECT_FALSE(LineFollower::detect(floor.data(), VISION_MAX_WIDTH + 1, VISION_MAX_HEIGHT, *std::make_unique<LineObservation>()));
+}
+
+TEST(LineFollowerHostTest, TheLineIsNotAnObstacle) {
+    VisionPipeline pipeline;
+    std::vector<uint8_t> image = renderTrack({ 0 }, { -15, 0, 0.1f });
+    LineObservation observation = detect(image);
+    VisionResult result;
+    for (uint8_t i = 0; i < VISION_STOP_FRAMES + 1; i++) {
+        pipeline.setIgnoredCells(observation.cells);
+        memcpy(pipeline.getInputBuffer(), image.data(), image.size());
+        pipeline.process(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, 0, result);
+    }
+    EXPECT_NE(result.obstacleMap & observation.cells, 0u); // The edges of the tape are there
+    EXPECT_LT(result.nearObstacleCells, VISION_STOP_MIN_CELLS);
+    EXPECT_FALSE(result.isStopHint);
+}
+
+// Steering -----------------------------------------------------------------------------------------------------
+TEST(LineFollowerHostTest, SteersTowardTheLineAndStopsWhenLost) {
+    LineFollower follower;
+    LineObservation right = { .isFound = true, .rows = 4, .offsetMm = 30, .angleDeciDeg = 0, .targetMm = 60, .cells = 0 };
+    ControlData command = follower.steer(right);
+    EXPECT_EQ(command.X, 0);
+    EXPECT_GT(command.Y, LINE_MIN_SPEED - 1);
+    EXPECT_LT(command.Y, LINE_DEFAULT_SPEED);  // Slower in a turn
+    EXPECT_GT(command.R, 0);
+    EXPECT_EQ(command.L, 0);
+
+    LineObservation left = { .isFound = true, .rows = 4, .offsetMm = 0, .angleDeciDeg = -200, .targetMm = -90, .cells = 0 };
+    command = follower.steer(left);
+    EXPECT_GT(command.L, 0);
+    EXPECT_EQ(command.R, 0);
+    EXPECT_LE(command.L, command.Y); // One wheel stops at most
+    LineObservation sharp = { .isFound = true, .rows = 4, .offsetMm = 100, .angleDeciDeg = 600, .targetMm = 400, .cells = 0 };
+    command = follower.steer(sharp);
+    EXPECT_EQ(command.Y, LINE_MIN_SPEED);
+    EXPECT_EQ(command.R, command.Y);
+
+    LineObservation ahead = { .isFound = true, .rows = 4, .offsetMm = 0, .angleDeciDeg = 0, .targetMm = 0, .cells = 0 };
+    follower.setSpeed(60);
+    command = follower.steer(ahead);
+    EXPECT_EQ(command.Y, 60);
+    EXPECT_EQ(command.L, 0);
+    EXPECT_EQ(command.R, 0);
+
+    // A gap in the tape: the last command, then a stop
+    const LineObservation missed = {};
+    for (uint8_t i = 0; i < LINE_LOST_FRAMES; i++) {
+        EXPECT_EQ(follower.steer(missed).Y, 60);
+        EXPECT_FALSE(follower.isLost());
+    }
+    command = follower.steer(missed);
+    EXPECT_TRUE(follower.isLost());
+    EXPECT_EQ(command.Y, 0);
+    EXPECT_EQ(follower.steer(ahead).Y, 60);
+    EXPECT_FALSE(follower.isLost());
+}
+
+// Closed loop --------------------------------------------------------------------------------------------------
+/*
+    Every frame: render, detect, steer, MotorManager::directionControlManual() and the PWM duties of the fake HAL, then
+    a differential drive with the wheel speeds proportional to the speed percent of the duty. The command of a frame
+    drives during the next one (the capture and the decode take about a frame).
+*/
+class LineFollowClosedLoopHostTest : public testing::Test {
+protected:
+    void SetUp() override { HalHost::reset(); }
+
+    void TearDown() override { MotorManager::deinit(); }
+
+    static float wheelSpeedMmPerS(uint8_t channelCW, uint8_t channelCCW) {
+        int32_t duty = int32_t(HalHost::getPwmDuty(channelCW)) - int32_t(HalHost::getPwmDuty(channelCCW));
+        if (duty == 0) { return 0; }
+        float percent = (abs(duty) - MOTOR_MIN_SPEED) / 1.6f;
+        return (duty > 0 ? percent : -percent) * SIM_MM_PER_PERCENT;
+    }
+
+    struct Trace {
+        std::vector<float> errorsMm;    // Of the drone from the tape, per frame
+        uint32_t lostFrames;
+    };
+
+    static Trace drive(const Track& track, Pose pose, uint32_t frames, uint8_t speed) {
+        MotorManager* motorManager = MotorManager::getInstance();
+        LineFollower follower;
+        follower.setSpeed(speed);
+        Trace trace = { {}, 0 };
+        float leftMmPerS = 0;
+        float rightMmPerS = 0;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            LineObservation observation = detect(renderTrack(track, pose, 3.0f, 20.0f, frame + 1));
+            if (!observation.isFound) { trace.lostFrames++; }
+            ControlData command = follower.steer(observation);
+
+            // The last command drives while this frame is processed
+            const float seconds = SIM_FRAME_MS / 1000.0f;
+            const float forward = (leftMmPerS + rightMmPerS) / 2;
+            const float turn = (leftMmPerS - rightMmPerS) / SIM_WHEEL_BASE_MM * seconds; // Faster left wheel: right
+            pose.xMm += forward * seconds * sinf(pose.heading + turn / 2);
+            pose.zMm += forward * seconds * cosf(pose.heading + turn / 2);
+            pose.heading += turn;
+            trace.errorsMm.push_back(-track.distanceMm(pose.xMm, pose.zMm));
+
+            motorManager->setControlData(command.X, command.Y, command.L, command.R);
+            motorManager->directionControlManual();
+            leftMmPerS = wheelSpeedMmPerS(MOTOR_1_CW, MOTOR_1_CCW);
+            rightMmPerS = wheelSpeedMmPerS(MOTOR_2_CW, MOTOR_2_CCW);
+        }
+        return trace;
+    }
+
+    static float largestError(const Trace& trace, size_t first) {
+        float largest = 0;
+        for (size_t i = first; i < trace.errorsMm.size(); i++) { largest = fmaxf(largest, fabsf(trace.errorsMm[i])); }
+        return largest;
+    }
+};
+
+TEST_F(LineFollowClosedLoopHostTest, SettlesOnAStraightLine) {
+    // 40 mm left of the tape, turned 12 degrees away from it; 10 s at 20 frames per second
+    Trace trace = drive({ 0 }, { -40, 0, -0.21f }, 200, LINE_DEFAULT_SPEED);
+    EXPECT_EQ(trace.lostFrames, 0u);
+    EXPECT_LT(largestError(trace, 0), 80.0f);      // No overshoot beyond the view
+    EXPECT_LT(largestError(trace, 60), 6.0f);      // Settled after 3 s
+    EXPECT_LT(largestError(trace, 140), 4.0f);     // And stays there: no growing oscillation
+}
+
+TEST_F(LineFollowClosedLoopHostTest, FollowsACurveAtSeveralSpeeds) {
+    for (uint8_t speed : { uint8_t(LINE_MIN_SPEED), uint8_t(LINE_DEFAULT_SPEED), uint8_t(60) }) {
+        Trace trace = drive({ 600 }, { 0, 0, 0 }, 160, speed);
+        EXPECT_EQ(trace.lostFrames, 0u) << unsigned(speed);
+        EXPECT_LT(largestError(trace, 0), 20.0f) << unsigned(speed);   // Half a tape width beside it at most
+        EXPECT_LT(largestError(trace, 60), 15.0f) << unsigned(speed);
+    }
+}
+
+// Line Follow --------------------------------------------------------------------------------------------------
+class LineFollowManagerHostTest : public testing::Test {
+protected:
+    void SetUp() override {
+        HalHost::reset();
+        CameraManager::init();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        VisionManager::init();
+        ServerManager::getInstance()->startServers();
+        ASSERT_NE(VisionManager::getInstance(), nullptr);
+    }
+
+    void TearDown() override {
+        VisionManager::setLineFollow(false);
+        MotorManager::getInstance()->stopMotorControls();
+        MotorManager::deinit();
+        VisionManager::setEnabled(true);
+        MotorManager::clearStopHint();
+        ServerManager::deinit();
+        VisionManager::deinit();
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+        CameraManager::deinit();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> get(const char* uri) { return HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, uri); }
+
+    static bool waitFor(bool (*condition)()) {
+        for (uint32_t waitedMs = 0; !condition(); waitedMs++) {
+            if (waitedMs >= LINE_TIMEOUT_MS) { return false; }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+};
+
+TEST_F(LineFollowManagerHostTest, NeedsTheMotorControlsAndTheVisionStage) {
+    EXPECT_EQ(get("/lfw?E=1")->getStatus(), 409);
+    EXPECT_FALSE(VisionManager::isLineFollowing());
+    MotorManager::getInstance()->startMotorControls();
+    get("/vis?E=0");
+    EXPECT_EQ(get("/lfw?E=1")->getStatus(), 409);
+    get("/vis?E=1");
+    EXPECT_EQ(get("/lfw?E=2")->getStatus(), 400);
+    EXPECT_EQ(get("/lfw?S=100")->getStatus(), 400);
+    EXPECT_EQ(get("/lfw?E=1&S=10")->getStatus(), 400);
+    EXPECT_FALSE(VisionManager::isLineFollowing());
+}
+
+TEST_F(LineFollowManagerHostTest, FollowsUntilAManualMove) {
+    HalHost::setCameraThumbnail(renderTrack({ 0 }, { -30, 0, 0 })); // The tape is right of the drone
+    MotorManager* motorManager = MotorManager::getInstance();
+    motorManager->startMotorControls();
+    std::shared_ptr<HttpdHostResponse> response = get("/lfw?E=1&S=50");
+    ASSERT_EQ(response->getStatus(), 200);
+    EXPECT_NE(response->getBody().find("\"enabled\":true"), std::string::npos);
+    EXPECT_NE(response->getBody().find("\"speed\":50"), std::string::npos);
+
+    ASSERT_TRUE(waitFor([] { return VisionManager::getLineFollowStats().frames >= 3; }));
+    LineFollowStats stats = VisionManager::getLineFollowStats();
+    EXPECT_TRUE(stats.isFound);
+    EXPECT_GT(stats.offsetMm, 20);
+    EXPECT_GT(stats.steering, 0);
+    ControlData controlData = motorManager->getControlData();
+    EXPECT_GT(controlData.Y, 0);
+    EXPECT_GT(controlData.R, 0);
+    EXPECT_FALSE(VisionManager::getStats().isStopHint); // The tape in the near field is not an obstacle
+
+    // The idle stick of the controller does not stop it, a move does
+    EXPECT_EQ(get("/mov?X=0&Y=0&L=0&R=0")->getStatus(), 200);
+    EXPECT_TRUE(VisionManager::isLineFollowing());
+    EXPECT_EQ(get("/mov?X=0&Y=-30&L=0&R=0")->getStatus(), 200);
+    EXPECT_FALSE(VisionManager::isLineFollowing());
+    std::this_thread::sleep_for(std::chrono::milliseconds(3 * VISION_LINE_PERIOD_MS));
+    controlData = motorManager->getControlData();
+    EXPECT_EQ(controlData.Y, -30); // Not overwritten by a late frame
+    EXPECT_EQ(controlData.R, 0);
+}
+
+TEST_F(LineFollowManagerHostTest, StopsWhenTheLineIsLost) {
+    HalHost::setCameraThumbnail(renderTrack({ 0 }, { 0, 0, 0 }));
+    MotorManager* motorManager = MotorManager::getInstance();
+    motorManager->startMotorControls();
+    ASSERT_EQ(get("/lfw?E=1")->getStatus(), 200);
+    ASSERT_TRUE(waitFor([] { return VisionManager::getLineFollowStats().forward >= LINE_DEFAULT_SPEED - 1; }));
+
+    HalHost::setCameraThumbnail(std::vector<uint8_t>(THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT, 160));
+    ASSERT_TRUE(waitFor([] { return VisionManager::getLineFollowStats().forward == 0; }));
+    EXPECT_GT(VisionManager::getLineFollowStats().missedFrames, uint32_t(LINE_LOST_FRAMES));
+    EXPECT_EQ(motorManager->getControlData().Y, 0);
+    EXPECT_TRUE(VisionManager::isLineFollowing()); // It goes on when the line is back
+
+    // Stopped with the motor controls
+    motorManager->stopMotorControls();
+    ASSERT_TRUE(waitFor([] { return !VisionManager::isLineFollowing(); }));
+    std::shared_ptr<HttpdHostResponse> response = get("/lfw");
+    ASSERT_EQ(response->getStatus(), 200);
+    EXPECT_NE(response->getBody().find("\"enabled\":false"), std::string::npos);
+}
@@ -0,0 +1,200 @@
+/*
+ * File: MjpegStreamHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the MJPEG stream of the video server (/str), parsed like a client does (tools/stream_latency.py):
+    the boundary comes from the content type, every part has its headers and Content-Length bytes of JPEG. The fake
+    camera fails after a known frame count, so the stream task ends and the recorded body is complete.
+*/
+
+#include "CameraManager.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+
+// C++
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define STREAM_FRAMES               5
+#define STREAM_CAPTURE_TIME_US      500     // The capture timestamps of the fake differ at least by this much
+#define STREAM_TIMEOUT_MS           2000
+
+struct StreamPart {
+    std::map<std::string, std::string> headers;
+    std::string jpeg;
+};
+
+/**
+ * @brief Split a multipart/x-mixed-replace body into its parts. Stops at the first malformed part.
+ */
+static std::vector<StreamPart> parseStream(const std::string& contentType, const std::string& body) {
+    std::vector<StreamPart> parts;
+    size_t boundaryAt = contentType.find("boundary=");
+    if (boundaryAt == std::string::npos) { return parts; }
+    const std::string delimiter = "--" + contentType.substr(boundaryAt + 9) + "\r\n";
+
+    size_t position = body.find(delimiter);
+    while (position != std::string::npos) {
+        position += delimiter.size();
+        size_t headersEnd = body.find("\r\n\r\n", position);
+        if (headersEnd == std::string::npos) { break; }
+        StreamPart part;
+        while (position < headersEnd) {
+            size_t lineEnd = body.find("\r\n", position);
+            size_t colon = body.find(": ", position);
+            if (colon == std::string::npos || colon > lineEnd) { return parts; }
+            part.headers[body.substr(position, colon - position)] = body.substr(colon + 2, lineEnd - colon - 2);
+            position = lineEnd + 2;
+        }
+        position = headersEnd + 4;
+        size_t length = strtoul(part.headers["Content-Length"].c_str(), nullptr, 10);
+        if (position + length > body.size()) { break; }
+        part.jpeg = body.substr(position, length);
+        parts.push_back(part);
+        position = body.find(delimiter, position + length);
+    }
+    return parts;
+}
+
+/**
+ * @brief "<seconds>.<6 digit microseconds>" to microseconds, -1 if it is not in this format.
+ */
+static int64_t parseTimestampUs(const std::string& value) {
+    size_t dot = value.find('.');
+    if (dot == std::string::npos || dot == 0 || value.size() - dot - 1 != 6) { return -1; }
+    return int64_t(strtoull(value.c_str(), nullptr, 10)) * 1000000 + int64_t(strtoul(value.c_str() + dot + 1, nullptr, 10));
+}
+
+class MjpegStreamHostTest : public testing::Test {
+protected:
+    void SetUp() override {
+        HalHost::reset();
+        CameraManager::init();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        ServerManager::getInstance()->startServers();
+        ASSERT_TRUE(ServerManager::getInstance()->isVideoServerRunning());
+        HalHost::setCameraCaptureTimeUs(STREAM_CAPTURE_TIME_US);
+    }
+
+    void TearDown() override {
+        ServerManager::deinit();
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+        CameraManager::deinit();
+    }
+
+    /**
+     * @brief A stream of frameCount frames (the capture fails after them and the stream task ends).
+     */
+    static std::vector<StreamPart> stream(uint32_t frameCount) {
+        HalHost::failCameraCaptureAfter(frameCount);
+        std::shared_ptr<HttpdHostResponse> response = HttpdHost::request(VIDEO_SERVER_PORT, HTTP_GET, "/str");
+        bool isEnded = response && response->waitForComplete(STREAM_TIMEOUT_MS) && waitForStreamEnd();
+        HalHost::failCameraCapture(false);
+        if (!isEnded) { return {}; }
+        return parseStream(response->getType(), response->getBody());
+    }
+
+    static bool waitForStreamEnd() {
+        for (uint32_t waitedMs = 0; ServerManager::getStreamStats().isActive; waitedMs++) {
+            if (waitedMs >= STREAM_TIMEOUT_MS) { return false; }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+};
+
+TEST_F(MjpegStreamHostTest, PartsCarryTheCaptureAndSendTimes) {
+    std::vector<StreamPart> parts = stream(STREAM_FRAMES);
+    ASSERT_EQ(parts.size(), size_t(STREAM_FRAMES));
+
+    int64_t lastCaptureUs = 0;
+    for (uint32_t i = 0; i < parts.size(); i++) {
+        const StreamPart& part = parts[i];
+        EXPECT_EQ(part.headers.at("Content-Type"), "image/jpeg");
+        ASSERT_GE(part.jpeg.size(), 4u);
+        EXPECT_EQ(uint8_t(part.jpeg[0]), 0xFF);
+        EXPECT_EQ(uint8_t(part.jpeg[1]), 0xD8);
+        EXPECT_EQ(uint8_t(part.jpeg[part.jpeg.size() - 1]), 0xD9);
+        EXPECT_EQ(part.headers.at("X-Frame-Sequence"), std::to_string(i));
+
+        int64_t captureUs = parseTimestampUs(part.headers.at("X-Timestamp"));
+        int64_t sendUs = parseTimestampUs(part.headers.at("X-Send-Timestamp"));
+        EXPECT_GE(captureUs, HAL_HOST_BOOT_TIME_US);
+        EXPECT_GE(captureUs - lastCaptureUs, STREAM_CAPTURE_TIME_US);
+        EXPECT_GE(sendUs, captureUs);
+        lastCaptureUs = captureUs;
+    }
+}
+
+TEST_F(MjpegStreamHostTest, StatsCountEveryStream) {
+    ASSERT_EQ(stream(STREAM_FRAMES).size(), size_t(STREAM_FRAMES));
+    VideoStreamStats stats = ServerManager::getStreamStats();
+    EXPECT_FALSE(stats.isActive);
+    EXPECT_EQ(stats.framesSent, uint32_t(STREAM_FRAMES));
+    EXPECT_EQ(stats.framesDropped, 0u);
+    EXPECT_LE(stats.averageSendTimeUs, stats.maxSendTimeUs);
+
+    // A new stream starts from 0
+    uint32_t streams = stats.streams;
+    ASSERT_EQ(stream(2).size(), 2u);
+    stats = ServerManager::getStreamStats();
+    EXPECT_EQ(stats.streams, streams + 1);
+    EXPECT_EQ(stats.framesSent, 2u);
+}
+
+TEST_F(MjpegStreamHostTest, DroppedFramesLeaveASequenceGap) {
+    // Raw frames are converted to JPEG, the first two conversions fail
+    HalHost::setCameraFrame(HAL_PIXFORMAT_RGB565, 320, 240, 320 * 240 * 2);
+    HalHost::failJpegConversions(2);
+    std::vector<StreamPart> parts = stream(STREAM_FRAMES);
+    ASSERT_EQ(parts.size(), size_t(STREAM_FRAMES - 2));
+    EXPECT_EQ(parts[0].headers.at("X-Frame-Sequence"), "2");
+    EXPECT_EQ(parts.back().headers.at("X-Frame-Sequence"), std::to_string(STREAM_FRAMES - 1));
+
+    VideoStreamStats stats = ServerManager::getStreamStats();
+    EXPECT_EQ(stats.framesSent, uint32_t(STREAM_FRAMES - 2));
+    EXPECT_EQ(stats.framesDropped, 2u);
+}
+
+TEST_F(MjpegStreamHostTest, SessionStatsReportTheStream) {
+    ASSERT_EQ(stream(STREAM_FRAMES).size(), size_t(STREAM_FRAMES));
+    std::shared_ptr<HttpdHostResponse> response = HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, "/sst");
+    ASSERT_TRUE(response);
+    EXPECT_NE(response->getBody().find("active 0 sent 5 dropped 0 avg_send_us"), std::string::npos) << response->getBody();
+}
+
+TEST(MjpegStreamParserHostTest, StopsAtATruncatedPart) {
+    const std::string type = "multipart/x-mixed-replace;boundary=AB";
+    const std::string body = "\r\n--AB\r\nContent-Length: 3\r\nX-Frame-Sequence: 7\r\n\r\nabc"
+                             "\r\n--AB\r\nContent-Length: 10\r\n\r\nabc";
+    std::vector<StreamPart> parts = parseStream(type, body);
+    ASSERT_EQ(parts.size(), 1u);
+    EXPECT_EQ(parts[0].jpeg, "abc");
+    EXPECT_EQ(parts[0].headers.at("X-Frame-Sequence"), "7");
+    EXPECT_EQ(parseTimestampUs("12.000034"), 12000034);
+    EXPECT_EQ(parseTimestampUs("12.34"), -1);
+}
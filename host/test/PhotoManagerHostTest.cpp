@@ -0,0 +1,327 @@
+/*
+ * File: PhotoManagerHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the photo mode. The fake sensor keeps the old frame size for a few frames after a switch (the frames
+    in the buffers), so the photo has to drop them and the stream has to drop the photo size ones after it. A stream
+    thread measures the gap the photo leaves in it.
+*/
+
+#include "CameraManager.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "PhotoManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+
+// C++
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define PHOTO_CAPTURE_TIME_US       5000    // Per frame of the fake sensor
+#define PHOTO_SWITCH_DELAY          2       // Frames of the old size after a switch
+
+class PhotoManagerHostTest : public testing::Test {
+protected:
+    CameraManager* cameraManager = nullptr;
+    PhotoManager* photoManager = nullptr;
+
+    void SetUp() override {
+        HalHost::reset();
+        CameraManager::init();
+        PhotoManager::init();
+        cameraManager = CameraManager::getInstance();
+        photoManager = PhotoManager::getInstance();
+        ASSERT_TRUE(cameraManager);
+        ASSERT_TRUE(photoManager);
+    }
+
+    void TearDown() override {
+        HalHost::failCameraCapture(false);
+        PhotoManager::deinit();
+        CameraManager::deinit();
+    }
+
+    void reserve() {
+        ASSERT_EQ(cameraManager->reserveFrameSize(PHOTO_FRAMESIZE), ESP_OK);
+        HalHost::setCameraSwitchDelay(PHOTO_SWITCH_DELAY);
+    }
+};
+
+TEST_F(PhotoManagerHostTest, BuffersAreReservedForThePhotoSizeOnce) {
+    uint32_t firstId = 0;
+    EXPECT_FALSE(cameraManager->isFrameSizeAllocated(PHOTO_FRAMESIZE));
+    EXPECT_EQ(photoManager->capture(1, &firstId), ESP_ERR_INVALID_STATE); // It would need a reallocation
+    EXPECT_EQ(HalHost::getCameraSensor().writeCount, 0u);
+
+    HalHost::setCameraSwitchDelay(PHOTO_SWITCH_DELAY);
+    ASSERT_EQ(cameraManager->reserveFrameSize(PHOTO_FRAMESIZE), ESP_OK);
+    EXPECT_EQ(cameraManager->getLastSwitch().type, CameraSwitchType::REALLOCATED);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 2u);
+    EXPECT_EQ(HalHost::getCameraConfig().frameSize, PHOTO_FRAMESIZE);
+    EXPECT_EQ(HalHost::getCameraSensor().frameSize, CAMERA_FRAMESIZE); // The stream size is kept
+    EXPECT_EQ(cameraManager->getSettings().frameSize, CAMERA_FRAMESIZE);
+    EXPECT_TRUE(cameraManager->isFrameSizeAllocated(PHOTO_FRAMESIZE));
+    // The driver started with the photo size, the stream drops those frames
+    HalCameraFrame frame;
+    ASSERT_TRUE(CameraManager::getStreamFrame(frame));
+    EXPECT_EQ(frame.width, 640);
+    Hal::Camera::returnFrame(frame);
+
+    // A reallocation for an other reason keeps the big buffers
+    CameraSettings settings = cameraManager->getSettings();
+    settings.frameBufferCount = CAMERA_FB_COUNT - 1;
+    ASSERT_EQ(cameraManager->applySettings(settings, true), ESP_OK);
+    EXPECT_EQ(HalHost::getCameraConfig().frameSize, PHOTO_FRAMESIZE);
+    EXPECT_EQ(HalHost::getCameraSensor().frameSize, CAMERA_FRAMESIZE);
+    EXPECT_EQ(cameraManager->reserveFrameSize(PHOTO_FRAMESIZE), ESP_OK);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 3u);
+}
+
+TEST_F(PhotoManagerHostTest, SwitchesLiveAndBack) {
+    reserve();
+    CameraSettings streamSettings = cameraManager->getSettings();
+    uint32_t initCount = HalHost::getCameraInitCount();
+    uint32_t frameCount = HalHost::getCameraFrameCount();
+
+    uint32_t firstId = 0;
+    ASSERT_EQ(photoManager->capture(1, &firstId), ESP_OK);
+    EXPECT_EQ(firstId, 1u);
+    EXPECT_EQ(HalHost::getCameraInitCount(), initCount); // No reallocation
+    EXPECT_EQ(HalHost::getCameraFramesInUse(), 0u);
+    // The frames of the old size, the settle frame, the still
+    EXPECT_EQ(HalHost::getCameraFrameCount() - frameCount, uint32_t(PHOTO_SWITCH_DELAY + PHOTO_SETTLE_FRAMES + 1));
+    PhotoStats stats = photoManager->getStats();
+    EXPECT_EQ(stats.bursts, 1u);
+    EXPECT_EQ(stats.stills, 1u);
+    EXPECT_EQ(stats.droppedFrames, uint32_t(PHOTO_SWITCH_DELAY + PHOTO_SETTLE_FRAMES));
+
+    const PhotoFrame* still = photoManager->acquire(firstId);
+    ASSERT_TRUE(still);
+    EXPECT_EQ(still->width, 1600);
+    EXPECT_EQ(still->height, 1200);
+    EXPECT_EQ(still->data[0], 0xFF);
+    EXPECT_EQ(still->data[1], 0xD8);
+    photoManager->release(still);
+
+    // The stream settings are back on the sensor, the stream drops the photo frames left in the buffers
+    HalHostCameraSensor sensor = HalHost::getCameraSensor();
+    EXPECT_EQ(sensor.frameSize, streamSettings.frameSize);
+    EXPECT_EQ(sensor.jpegQuality, streamSettings.jpegQuality);
+    EXPECT_EQ(cameraManager->getSettings().jpegQuality, streamSettings.jpegQuality);
+    frameCount = HalHost::getCameraFrameCount();
+    HalCameraFrame frame;
+    ASSERT_TRUE(CameraManager::getStreamFrame(frame));
+    EXPECT_EQ(frame.width, 640);
+    EXPECT_EQ(HalHost::getCameraFrameCount() - frameCount, uint32_t(PHOTO_SWITCH_DELAY + 1));
+    Hal::Camera::returnFrame(frame);
+}
+
+TEST_F(PhotoManagerHostTest, BurstFillsTheRing) {
+    reserve();
+    uint32_t firstId = 0;
+    ASSERT_EQ(photoManager->capture(3, &firstId), ESP_OK);
+    EXPECT_EQ(photoManager->getStats().droppedFrames, uint32_t(PHOTO_SWITCH_DELAY + PHOTO_SETTLE_FRAMES)); // Once per burst
+    const PhotoFrame* oldest = photoManager->acquire(firstId);
+    ASSERT_TRUE(oldest);
+
+    ASSERT_EQ(photoManager->capture(PHOTO_BURST_MAX, &firstId), ESP_OK);
+    EXPECT_EQ(firstId, 4u);
+    uint32_t ids[PHOTO_RING_SIZE];
+    ASSERT_EQ(photoManager->getIds(ids), PHOTO_RING_SIZE);
+    for (uint8_t i = 0; i < PHOTO_RING_SIZE; i++) { EXPECT_EQ(ids[i], 4u + i); }
+    EXPECT_EQ(photoManager->acquire(1), nullptr);           // Replaced...
+    EXPECT_EQ(oldest->id, 1u);                              // ...but the held one stays valid
+    EXPECT_EQ(oldest->width, 1600);
+    photoManager->release(oldest);
+
+    const PhotoFrame* latest = photoManager->acquire(0);
+    ASSERT_TRUE(latest);
+    EXPECT_EQ(latest->id, 7u);
+    photoManager->release(latest);
+    EXPECT_EQ(photoManager->getStats().stills, 7u);
+}
+
+TEST_F(PhotoManagerHostTest, RejectsAndRecovers) {
+    uint32_t firstId = 0;
+    reserve();
+    EXPECT_EQ(photoManager->capture(0, &firstId), ESP_ERR_INVALID_ARG);
+    EXPECT_EQ(photoManager->capture(PHOTO_BURST_MAX + 1, &firstId), ESP_ERR_INVALID_ARG);
+    cameraManager->powerDown();
+    EXPECT_EQ(photoManager->capture(1, &firstId), ESP_ERR_INVALID_STATE);
+    cameraManager->powerUp();
+
+    // A failed capture restores the stream settings and releases the stream
+    HalHost::failCameraCaptureAfter(1);
+    EXPECT_EQ(photoManager->capture(1, &firstId), ESP_FAIL);
+    EXPECT_EQ(photoManager->getStats().failures, 1u);
+    EXPECT_EQ(HalHost::getCameraSensor().frameSize, CAMERA_FRAMESIZE);
+    EXPECT_EQ(HalHost::getCameraFramesInUse(), 0u);
+    HalHost::failCameraCapture(false);
+    HalCameraFrame frame;
+    ASSERT_TRUE(CameraManager::getStreamFrame(frame));
+    Hal::Camera::returnFrame(frame);
+    EXPECT_EQ(photoManager->capture(1, &firstId), ESP_OK);
+}
+
+TEST_F(PhotoManagerHostTest, FailedSwitchRestoresTheStreamSize) {
+    // The photo switch fails after the frame size is on the sensor already (the quality write is not acknowledged)
+    reserve();
+    CameraSettings streamSettings = cameraManager->getSettings();
+    HalHost::failCameraQualityWrites(1);
+    uint32_t firstId = 0;
+    EXPECT_EQ(photoManager->capture(1, &firstId), ESP_FAIL);
+    EXPECT_EQ(photoManager->getStats().failures, 1u);
+    EXPECT_EQ(photoManager->getStats().stills, 0u);
+    HalHostCameraSensor sensor = HalHost::getCameraSensor();
+    EXPECT_EQ(sensor.frameSize, streamSettings.frameSize);
+    EXPECT_EQ(sensor.jpegQuality, streamSettings.jpegQuality);
+    EXPECT_EQ(cameraManager->getSettings().frameSize, streamSettings.frameSize);
+
+    // The stream goes on at its own size
+    HalCameraFrame frame;
+    ASSERT_TRUE(CameraManager::getStreamFrame(frame));
+    EXPECT_EQ(frame.width, 640);
+    EXPECT_EQ(frame.height, 480);
+    Hal::Camera::returnFrame(frame);
+    EXPECT_EQ(photoManager->capture(1, &firstId), ESP_OK);
+}
+
+TEST_F(PhotoManagerHostTest, StreamGapStaysInTheBudget) {
+    // The frames are stamped with the sensor clock: the gaps are frame periods, whatever the load of the host
+    reserve();
+    HalHost::setCameraCaptureTimeUs(PHOTO_CAPTURE_TIME_US);
+    HalHost::setCameraFramePeriodUs(PHOTO_CAPTURE_TIME_US);
+    struct StreamFrame {
+        int64_t timestampUs;
+        uint16_t width;
+    };
+    std::vector<StreamFrame> frames;
+    frames.reserve(1000);
+    std::atomic<uint32_t> streamedFrames{0};
+    std::atomic<bool> isStreaming{true};
+    std::thread stream([&] {
+        while (isStreaming) {
+            HalCameraFrame frame;
+            if (!CameraManager::getStreamFrame(frame)) { continue; }
+            if (frames.size() < frames.capacity()) { frames.push_back({ frame.timestampUs, frame.width }); }
+            Hal::Camera::returnFrame(frame);
+            streamedFrames++;
+        }
+    });
+    auto waitForStream = [&](uint32_t count) {
+        uint32_t target = streamedFrames + count;
+        while (streamedFrames < target) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    };
+    waitForStream(3);
+    uint32_t firstId = 0;
+    for (uint8_t count : { 1, 2 }) {
+        ASSERT_EQ(photoManager->capture(count, &firstId), ESP_OK);
+        waitForStream(3);
+    }
+    isStreaming = false;
+    stream.join();
+
+    // The stream never gets a photo size frame. Its longest gap is the second burst: the old size frames, the settle
+    // frame, the two stills, the photo frames left after it, then the next frame
+    int64_t maxGapUs = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        EXPECT_EQ(frames[i].width, 640) << i;
+        if (i > 0) { maxGapUs = std::max(maxGapUs, frames[i].timestampUs - frames[i - 1].timestampUs); }
+    }
+    EXPECT_EQ(maxGapUs, int64_t(2 * PHOTO_SWITCH_DELAY + PHOTO_SETTLE_FRAMES + 2 + 1) * PHOTO_CAPTURE_TIME_US);
+    // The stats count the frames the burst took (the stream drops the ones left after it)
+    PhotoStats stats = photoManager->getStats();
+    EXPECT_EQ(stats.bursts, 2u);
+    EXPECT_EQ(stats.lastGapUs, uint32_t(PHOTO_SWITCH_DELAY + PHOTO_SETTLE_FRAMES + 2 + 1) * PHOTO_CAPTURE_TIME_US);
+    EXPECT_EQ(stats.maxGapUs, stats.lastGapUs);
+    EXPECT_EQ(stats.gapsOverBudget, 0u);
+    EXPECT_LE(stats.maxGapUs, uint32_t(PHOTO_STREAM_GAP_BUDGET_MS) * 1000);
+}
+
+// Endpoint -----------------------------------------------------------------------------------------------------
+class PhotoEndpointHostTest : public PhotoManagerHostTest {
+protected:
+    ServerManager* serverManager = nullptr;
+
+    void SetUp() override {
+        PhotoManagerHostTest::SetUp();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        serverManager = ServerManager::getInstance();
+        serverManager->startServers();
+        ASSERT_TRUE(serverManager->isVideoServerRunning());
+    }
+
+    void TearDown() override {
+        ServerManager::deinit();
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+        PhotoManagerHostTest::TearDown();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> get(const char* uri) { return HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, uri); }
+
+    static std::shared_ptr<HttpdHostResponse> getStill(const char* uri) { return HttpdHost::request(VIDEO_SERVER_PORT, HTTP_GET, uri); }
+};
+
+TEST_F(PhotoEndpointHostTest, CapturesAndServesStills) {
+    std::shared_ptr<HttpdHostResponse> response = get("/pic");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_NE(response->getBody().find("{\"stills\":[],\"reserved\":false,\"bursts\":0"), std::string::npos);
+    EXPECT_EQ(getStill("/stl")->getStatus(), 404);
+
+    // The first capture reallocates the buffers once (the video server restarts), the next one is live
+    response = get("/pic?N=2");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_NE(response->getBody().find("{\"stills\":[1,2],\"reserved\":true,\"bursts\":1"), std::string::npos);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 2u);
+    EXPECT_TRUE(serverManager->isVideoServerRunning());
+    EXPECT_EQ(get("/pic?N=1")->getStatus(), 200);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 2u);
+
+    response = getStill("/stl?id=2");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_EQ(response->getType(), "image/jpeg");
+    EXPECT_EQ(response->getHeader("X-Photo-Id"), "2");
+    EXPECT_EQ(response->getBody().substr(0, 2), "\xFF\xD8");
+    EXPECT_EQ(getStill("/stl")->getHeader("X-Photo-Id"), "3");
+    EXPECT_EQ(getStill("/stl?id=9")->getStatus(), 404);
+    EXPECT_EQ(getStill("/stl?id=x")->getStatus(), 400);
+}
+
+TEST_F(PhotoEndpointHostTest, InvalidAndConflictingRequests) {
+    for (const char* uri : { "/pic?N=0", "/pic?N=5", "/pic?N=a", "/pic?X=1" }) {
+        std::shared_ptr<HttpdHostResponse> response = get(uri);
+        ASSERT_TRUE(response) << uri;
+        EXPECT_EQ(response->getStatus(), 400) << uri;
+    }
+    cameraManager->powerDown();
+    EXPECT_EQ(get("/pic?N=1")->getStatus(), 409);
+    EXPECT_EQ(HalHost::getCameraInitCount(), 1u);
+    cameraManager->powerUp();
+}
@@ -0,0 +1,111 @@
+/*
+ * File: ResourceManagerHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the alarm logic of the resource monitor with stand-in samples (the host heap and the host tasks
+    have no real stack watermarks, see host/FreeRtosHost.cpp).
+*/
+
+#include "ResourceManager.h"
+#include "TelemetryManager.h"
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+// C
+extern "C" {
+#include <string.h>
+}
+
+class ResourceManagerHostTest : public testing::Test {
+protected:
+    ResourceSample sample;
+    const ResourceThresholds thresholds = { 256, 16384, 4096, 65536 };
+
+    void SetUp() override {
+        // Every value well above its threshold, two tasks
+        memset(&sample, 0, sizeof(sample));
+        sample.internalHeap = { 60000, 50000, 30000 };
+        sample.psramHeap = { 2000000, 1900000, 1800000 };
+        sample.hasPsram = true;
+        sample.taskCount = 2;
+        strcpy(sample.tasks[0].name, "WIF_CONT");
+        sample.tasks[0].stackHighWaterMark = 900;
+        strcpy(sample.tasks[1].name, "DIR_CONT");
+        sample.tasks[1].stackHighWaterMark = 600;
+        sample.lowestStackTask = 1;
+    }
+
+    uint8_t evaluate(uint8_t previousAlarms) {
+        return ResourceManager::evaluateAlarms(sample, thresholds, previousAlarms);
+    }
+};
+
+TEST_F(ResourceManagerHostTest, NoAlarmAboveThresholds) {
+    EXPECT_EQ(evaluate(RESOURCE_ALARM_NONE), RESOURCE_ALARM_NONE);
+}
+
+TEST_F(ResourceManagerHostTest, StackAlarmWithHysteresis) {
+    sample.tasks[1].stackHighWaterMark = 200;
+    uint8_t alarms = evaluate(RESOURCE_ALARM_NONE);
+    EXPECT_EQ(alarms, RESOURCE_ALARM_STACK);
+
+    // Between the threshold and threshold + 25%: an active alarm stays, an inactive one is not raised
+    sample.tasks[1].stackHighWaterMark = 300;
+    EXPECT_EQ(evaluate(alarms), RESOURCE_ALARM_STACK);
+    EXPECT_EQ(evaluate(RESOURCE_ALARM_NONE), RESOURCE_ALARM_NONE);
+
+    sample.tasks[1].stackHighWaterMark = 320; // 256 * 1.25
+    EXPECT_EQ(evaluate(alarms), RESOURCE_ALARM_NONE);
+}
+
+TEST_F(ResourceManagerHostTest, HeapAlarmsAreIndependent) {
+    sample.internalHeap.freeBytes = 12000;
+    EXPECT_EQ(evaluate(RESOURCE_ALARM_NONE), RESOURCE_ALARM_INTERNAL_FREE);
+
+    // Enough free memory, but fragmented
+    sample.internalHeap.freeBytes = 60000;
+    sample.internalHeap.largestFreeBlock = 3000;
+    EXPECT_EQ(evaluate(RESOURCE_ALARM_INTERNAL_FREE), RESOURCE_ALARM_INTERNAL_BLOCK);
+
+    sample.psramHeap.freeBytes = 40000;
+    EXPECT_EQ(evaluate(RESOURCE_ALARM_INTERNAL_BLOCK), RESOURCE_ALARM_INTERNAL_BLOCK | RESOURCE_ALARM_PSRAM_FREE);
+}
+
+TEST_F(ResourceManagerHostTest, NoPsramNoPsramAlarm) {
+    sample.hasPsram = false;
+    sample.psramHeap = { 0, 0, 0 };
+    EXPECT_EQ(evaluate(RESOURCE_ALARM_NONE), RESOURCE_ALARM_NONE);
+    EXPECT_EQ(evaluate(RESOURCE_ALARM_PSRAM_FREE), RESOURCE_ALARM_NONE); // The PSRAM is gone (e.g. a failed init)
+}
+
+TEST_F(ResourceManagerHostTest, NoTaskStatsNoStackAlarm) {
+    sample.taskCount = 0;
+    sample.lowestStackTask = -1;
+    EXPECT_EQ(evaluate(RESOURCE_ALARM_STACK), RESOURCE_ALARM_NONE);
+}
+
+TEST_F(ResourceManagerHostTest, TelemetryFrameCarriesAlarms) {
+    ResourceManager::init();
+    TelemetryManager::init();
+    ResourceSample last;
+    for (uint16_t waitedMs = 0; !ResourceManager::getInstance()->getLastSample(last) && waitedMs < 500; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TelemetryFrame frame;
+    TelemetryManager::getInstance()->sampleFrame(frame);
+    EXPECT_EQ(frame.header.resourceAlarms, ResourceManager::getActiveAlarms());
+    EXPECT_GT(frame.header.largestFreeInternalBlock, 0u);
+    TelemetryManager::deinit();
+    ResourceManager::deinit();
+}
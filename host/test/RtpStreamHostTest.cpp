@@ -0,0 +1,503 @@
+/*
+ * File: RtpStreamHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the RTP/JPEG stream (RtpJpeg, RtpStreamManager, /rtp). The packets of the packetizer go straight to
+    the receiver, with the losses picked by the test; the stream task sends to a UDP socket on the loopback interface.
+*/
+
+#include "CameraManager.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "RtpJpegReceiver.h"
+#include "RtpStreamManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+
+// C++
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// C
+extern "C" {
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define RTP_TEST_SSRC               0x12345678
+#define RTP_TEST_CAPTURE_US         1234567
+#define RTP_TEST_STREAM_FRAMES      5
+#define RTP_TEST_TIMEOUT_MS         2000
+
+struct RtpTestPacket {
+    std::vector<uint8_t> data;
+    bool isFec;
+};
+
+struct RtpTestFrames {
+    std::vector<std::vector<uint8_t>> jpegs;
+    std::vector<uint16_t> recoveredPackets;
+};
+
+static bool collectPacket(const uint8_t* packet, size_t length, bool isFec, void* context) {
+    static_cast<std::vector<RtpTestPacket>*>(context)->push_back({std::vector<uint8_t>(packet, packet + length), isFec});
+    return true;
+}
+
+static void collectFrame(const RtpJpegFrame& frame, void* context) {
+    RtpTestFrames* frames = static_cast<RtpTestFrames*>(context);
+    frames->jpegs.emplace_back(frame.jpeg, frame.jpeg + frame.length);
+    frames->recoveredPackets.push_back(frame.recoveredPackets);
+}
+
+/**
+ * @brief A baseline JPEG of the size: the headers of the fake camera, a scan that counts up, EOI.
+ */
+static std::vector<uint8_t> createJpeg(uint16_t width, uint16_t height, size_t scanLength, uint16_t restartInterval = 0) {
+    HalHost::setCameraFrame(HAL_PIXFORMAT_JPEG, width, height, 4096);
+    HalCameraFrame frame;
+    EXPECT_TRUE(Hal::Camera::getFrame(frame));
+    size_t headersLength = 0;   // Up to the end of the scan header (SOS)
+    for (size_t i = 0; i + 4 < frame.length && !headersLength; i++) {
+        if (frame.data[i] == 0xFF && frame.data[i + 1] == 0xDA) { headersLength = i + 2 + ((frame.data[i + 2] << 8) | frame.data[i + 3]); }
+    }
+    EXPECT_GT(headersLength, 0u);
+    std::vector<uint8_t> jpeg(frame.data, frame.data + headersLength);
+    Hal::Camera::returnFrame(frame);
+    if (restartInterval) {
+        jpeg.insert(jpeg.begin() + 2, {0xFF, 0xDD, 0x00, 0x04, uint8_t(restartInterval >> 8), uint8_t(restartInterval)});
+    }
+    for (size_t i = 0; i < scanLength; i++) { jpeg.push_back(uint8_t(i % 0xFF)); }   // No 0xFF: no markers in the scan
+    jpeg.insert(jpeg.end(), {0xFF, 0xD9});
+    return jpeg;
+}
+
+static uint16_t getSequence(const RtpTestPacket& packet) { return uint16_t((packet.data[2] << 8) | packet.data[3]); }
+
+static uint32_t getTimestamp(const RtpTestPacket& packet) {
+    return (uint32_t(packet.data[4]) << 24) | (uint32_t(packet.data[5]) << 16) | (uint32_t(packet.data[6]) << 8) | packet.data[7];
+}
+
+static bool hasMarker(const RtpTestPacket& packet) { return (packet.data[1] & 0x80) != 0; }
+
+static void expectSameScan(const std::vector<uint8_t>& rebuilt, const std::vector<uint8_t>& original) {
+    RtpJpegImage rebuiltImage;
+    RtpJpegImage originalImage;
+    ASSERT_EQ(RtpJpegPacketizer::parse(rebuilt.data(), rebuilt.size(), rebuiltImage), ESP_OK);
+    ASSERT_EQ(RtpJpegPacketizer::parse(original.data(), original.size(), originalImage), ESP_OK);
+    EXPECT_EQ(rebuiltImage.type, originalImage.type);
+    EXPECT_EQ(rebuiltImage.width, originalImage.width);
+    EXPECT_EQ(rebuiltImage.height, originalImage.height);
+    EXPECT_EQ(rebuiltImage.restartInterval, originalImage.restartInterval);
+    EXPECT_EQ(memcmp(rebuiltImage.quantizationTables, originalImage.quantizationTables, 128), 0);
+    ASSERT_EQ(rebuiltImage.scanLength, originalImage.scanLength);
+    EXPECT_EQ(memcmp(rebuiltImage.scan, originalImage.scan, originalImage.scanLength), 0);
+}
+
+class RtpJpegHostTest : public testing::Test {
+protected:
+    void SetUp() override {
+        HalHost::reset();
+        CameraManager::init();
+    }
+
+    void TearDown() override {
+        CameraManager::deinit();
+    }
+
+    static std::vector<RtpTestPacket> packetize(const std::vector<uint8_t>& jpeg, uint8_t fecGroupSize,
+                                                int64_t captureTimeUs = RTP_TEST_CAPTURE_US, uint32_t ssrc = RTP_TEST_SSRC) {
+        RtpJpegPacketizer packetizer(ssrc, fecGroupSize);
+        std::vector<RtpTestPacket> packets;
+        EXPECT_EQ(packetizer.packetize(jpeg.data(), jpeg.size(), captureTimeUs, &collectPacket, &packets), ESP_OK);
+        return packets;
+    }
+};
+
+TEST_F(RtpJpegHostTest, ParseFindsTheScanAndTheTables) {
+    std::vector<uint8_t> jpeg = createJpeg(640, 480, 10000);
+    RtpJpegImage image;
+    ASSERT_EQ(RtpJpegPacketizer::parse(jpeg.data(), jpeg.size(), image), ESP_OK);
+    EXPECT_EQ(image.type, 0);   // 4:2:2
+    EXPECT_EQ(image.width, 640);
+    EXPECT_EQ(image.height, 480);
+    EXPECT_EQ(image.restartInterval, 0);
+    EXPECT_EQ(image.quantizationLength, 128);
+    EXPECT_EQ(image.scanLength, 10000u);
+    EXPECT_EQ(image.scan + image.scanLength + 2, jpeg.data() + jpeg.size());
+
+    // Padding after the EOI (the frame buffer of the driver)
+    jpeg.insert(jpeg.end(), 16, 0);
+    ASSERT_EQ(RtpJpegPacketizer::parse(jpeg.data(), jpeg.size(), image), ESP_OK);
+    EXPECT_EQ(image.scanLength, 10000u);
+
+    jpeg = createJpeg(320, 240, 100, 4);
+    ASSERT_EQ(RtpJpegPacketizer::parse(jpeg.data(), jpeg.size(), image), ESP_OK);
+    EXPECT_EQ(image.type, 64);
+    EXPECT_EQ(image.restartInterval, 4);
+}
+
+TEST_F(RtpJpegHostTest, ParseRejectsOtherJpegs) {
+    const std::vector<uint8_t> jpeg = createJpeg(640, 480, 100);
+    RtpJpegImage image;
+    const uint8_t* sof = nullptr;
+    for (size_t i = 0; i + 1 < jpeg.size(); i++) {
+        if (jpeg[i] == 0xFF && jpeg[i + 1] == 0xC0) {
+            sof = &jpeg[i];
+            break;
+        }
+    }
+    ASSERT_NE(sof, nullptr);
+    const size_t sofAt = size_t(sof - jpeg.data());
+
+    std::vector<uint8_t> progressive = jpeg;
+    progressive[sofAt + 1] = 0xC2;
+    EXPECT_EQ(RtpJpegPacketizer::parse(progressive.data(), progressive.size(), image), ESP_ERR_NOT_SUPPORTED);
+
+    std::vector<uint8_t> grayscale = jpeg;
+    grayscale[sofAt + 9] = 1;   // Components
+    EXPECT_EQ(RtpJpegPacketizer::parse(grayscale.data(), grayscale.size(), image), ESP_ERR_NOT_SUPPORTED);
+
+    std::vector<uint8_t> sampling = jpeg;
+    sampling[sofAt + 11] = 0x11;   // Luminance 1x1: 4:4:4
+    EXPECT_EQ(RtpJpegPacketizer::parse(sampling.data(), sampling.size(), image), ESP_ERR_NOT_SUPPORTED);
+
+    std::vector<uint8_t> tables16 = jpeg;
+    tables16[6] = 0x10;   // First DQT table with 16 bit values
+    EXPECT_EQ(RtpJpegPacketizer::parse(tables16.data(), tables16.size(), image), ESP_ERR_NOT_SUPPORTED);
+
+    std::vector<uint8_t> large = createJpeg(2048, 1536, 100);
+    EXPECT_EQ(RtpJpegPacketizer::parse(large.data(), large.size(), image), ESP_ERR_NOT_SUPPORTED);
+
+    EXPECT_EQ(RtpJpegPacketizer::parse(jpeg.data(), sofAt + 4, image), ESP_ERR_INVALID_ARG);
+    EXPECT_EQ(RtpJpegPacketizer::parse(jpeg.data() + 2, jpeg.size() - 2, image), ESP_ERR_INVALID_ARG);
+}
+
+TEST_F(RtpJpegHostTest, PacketsFollowRfc2435) {
+    const std::vector<uint8_t> jpeg = createJpeg(640, 480, 20000);
+    std::vector<RtpTestPacket> packets = packetize(jpeg, 0);
+    ASSERT_GE(packets.size(), 15u);
+
+    size_t offset = 0;
+    for (size_t i = 0; i < packets.size(); i++) {
+        const RtpTestPacket& packet = packets[i];
+        ASSERT_LE(packet.data.size(), size_t(RTP_MAX_PACKET_SIZE));
+        EXPECT_FALSE(packet.isFec);
+        EXPECT_EQ(packet.data[0], 0x80);   // Version 2, no padding, extension or CSRC
+        EXPECT_EQ(packet.data[1] & 0x7F, RTP_JPEG_PAYLOAD_TYPE);
+        EXPECT_EQ(hasMarker(packet), i + 1 == packets.size());
+        EXPECT_EQ(getSequence(packet), uint16_t((RTP_TEST_SSRC >> 16) + i));
+        EXPECT_EQ(getTimestamp(packet), RtpJpegPacketizer::toRtpTimestamp(RTP_TEST_CAPTURE_US));
+        EXPECT_EQ(memcmp(packet.data.data() + 8, "\x12\x34\x56\x78", 4), 0);
+
+        const uint8_t* header = packet.data.data() + RTP_HEADER_SIZE;
+        EXPECT_EQ((size_t(header[1]) << 16) | (size_t(header[2]) << 8) | header[3], offset);
+        EXPECT_EQ(header[4], 0);
+        EXPECT_EQ(header[5], 255);   // The tables are in the first packet
+        EXPECT_EQ(header[6], 640 / 8);
+        EXPECT_EQ(header[7], 480 / 8);
+        size_t dataStart = RTP_HEADER_SIZE + RTP_JPEG_HEADER_SIZE;
+        if (i == 0) {
+            EXPECT_EQ(header[RTP_JPEG_HEADER_SIZE + 2], 0);
+            EXPECT_EQ(header[RTP_JPEG_HEADER_SIZE + 3], 128);
+            dataStart += RTP_QUANTIZATION_HEADER_SIZE + 128;
+        }
+        offset += packet.data.size() - dataStart;
+    }
+    EXPECT_EQ(offset, 20000u);
+    EXPECT_EQ(RtpJpegPacketizer::toRtpTimestamp(1000000), uint32_t(RTP_CLOCK_RATE_HZ));
+}
+
+TEST_F(RtpJpegHostTest, ReceiverRebuildsTheJpeg) {
+    const std::vector<uint8_t> jpeg = createJpeg(640, 480, 20000);
+    const std::vector<uint8_t> restartJpeg = createJpeg(320, 240, 3000, 4);
+    RtpTestFrames frames;
+    RtpJpegReceiver receiver(&collectFrame, &frames);
+    for (const RtpTestPacket& packet : packetize(jpeg, 4)) { receiver.receive(packet.data.data(), packet.data.size()); }
+    for (const RtpTestPacket& packet : packetize(restartJpeg, 0, RTP_TEST_CAPTURE_US + 40000)) {
+        receiver.receive(packet.data.data(), packet.data.size());
+    }
+
+    ASSERT_EQ(frames.jpegs.size(), 2u);
+    expectSameScan(frames.jpegs[0], jpeg);
+    expectSameScan(frames.jpegs[1], restartJpeg);
+    RtpJpegReceiverStats stats = receiver.getStats();
+    EXPECT_EQ(stats.framesComplete, 2u);
+    EXPECT_EQ(stats.framesIncomplete, 0u);
+    EXPECT_EQ(stats.recoveredPackets, 0u);
+    EXPECT_EQ(stats.invalidPackets, 0u);
+}
+
+TEST_F(RtpJpegHostTest, ParityRestoresAnySingleLoss) {
+    const std::vector<uint8_t> jpeg = createJpeg(640, 480, 20000);
+    const std::vector<RtpTestPacket> packets = packetize(jpeg, 4);
+    size_t fecPackets = 0;
+    for (const RtpTestPacket& packet : packets) { fecPackets += packet.isFec ? 1 : 0; }
+    const size_t mediaPackets = packets.size() - fecPackets;
+    EXPECT_EQ(fecPackets, (mediaPackets + 3) / 4);
+    for (const RtpTestPacket& packet : packets) {
+        EXPECT_LE(packet.data.size(), size_t(RTP_MAX_PACKET_SIZE));
+        if (packet.isFec) { EXPECT_EQ(packet.data[1] & 0x7F, RTP_FEC_PAYLOAD_TYPE); }
+    }
+
+    for (size_t lost = 0; lost < packets.size(); lost++) {
+        if (packets[lost].isFec) { continue; }
+        RtpTestFrames frames;
+        RtpJpegReceiver receiver(&collectFrame, &frames);
+        for (size_t i = 0; i < packets.size(); i++) {
+            if (i != lost) { receiver.receive(packets[i].data.data(), packets[i].data.size()); }
+        }
+        ASSERT_EQ(frames.jpegs.size(), 1u) << "Lost packet " << lost;
+        EXPECT_EQ(frames.recoveredPackets[0], 1);
+        expectSameScan(frames.jpegs[0], jpeg);
+    }
+}
+
+TEST_F(RtpJpegHostTest, TwoLossesInAGroupLoseOnlyThatFrame) {
+    const std::vector<uint8_t> jpeg = createJpeg(640, 480, 20000);
+    const std::vector<RtpTestPacket> first = packetize(jpeg, 4, RTP_TEST_CAPTURE_US);
+    const std::vector<RtpTestPacket> second = packetize(jpeg, 4, RTP_TEST_CAPTURE_US + 40000);
+    RtpTestFrames frames;
+    RtpJpegReceiver receiver(&collectFrame, &frames);
+    for (size_t i = 0; i < first.size(); i++) {
+        if (i != 1 && i != 2) { receiver.receive(first[i].data.data(), first[i].data.size()); }
+    }
+    EXPECT_TRUE(frames.jpegs.empty());
+    for (const RtpTestPacket& packet : second) { receiver.receive(packet.data.data(), packet.data.size()); }
+    ASSERT_EQ(frames.jpegs.size(), 1u);
+    expectSameScan(frames.jpegs[0], jpeg);
+
+    // The given up frame stays given up
+    const uint32_t latePackets = receiver.getStats().latePackets;   // The parity packets after the last packet
+    receiver.receive(first[1].data.data(), first[1].data.size());
+    RtpJpegReceiverStats stats = receiver.getStats();
+    EXPECT_EQ(stats.framesComplete, 1u);
+    EXPECT_EQ(stats.framesIncomplete, 1u);
+    EXPECT_EQ(stats.latePackets, latePackets + 1);
+    EXPECT_EQ(frames.jpegs.size(), 1u);
+}
+
+TEST_F(RtpJpegHostTest, ReorderedAndWrappingPackets) {
+    const std::vector<uint8_t> jpeg = createJpeg(640, 480, 20000);
+    // The sequence starts 3 before the wrap
+    std::vector<RtpTestPacket> packets = packetize(jpeg, 0, RTP_TEST_CAPTURE_US, 0xFFFD0000);
+    ASSERT_EQ(getSequence(packets[0]), 0xFFFD);
+    std::swap(packets[0], packets[5]);
+    std::swap(packets[2], packets.back());
+    RtpTestFrames frames;
+    RtpJpegReceiver receiver(&collectFrame, &frames);
+    for (const RtpTestPacket& packet : packets) { receiver.receive(packet.data.data(), packet.data.size()); }
+    ASSERT_EQ(frames.jpegs.size(), 1u);
+    expectSameScan(frames.jpegs[0], jpeg);
+
+    const uint8_t notRtp[RTP_HEADER_SIZE + RTP_JPEG_HEADER_SIZE] = {0x80, 96};
+    receiver.receive(notRtp, sizeof(notRtp));
+    EXPECT_EQ(receiver.getStats().invalidPackets, 1u);
+}
+
+TEST_F(RtpJpegHostTest, AbortedFrameStopsSending) {
+    const std::vector<uint8_t> jpeg = createJpeg(640, 480, 20000);
+    RtpJpegPacketizer packetizer(RTP_TEST_SSRC, 4);
+    uint32_t calls = 0;
+    EXPECT_EQ(packetizer.packetize(jpeg.data(), jpeg.size(), RTP_TEST_CAPTURE_US,
+                                   [](const uint8_t*, size_t, bool, void* context) { return ++*static_cast<uint32_t*>(context) < 3; },
+                                   &calls), ESP_FAIL);
+    EXPECT_EQ(calls, 3u);
+
+    const uint8_t notJpeg[] = {0x00, 0x01, 0x02, 0x03};
+    EXPECT_EQ(packetizer.packetize(notJpeg, sizeof(notJpeg), RTP_TEST_CAPTURE_US, &collectPacket, nullptr), ESP_ERR_INVALID_ARG);
+}
+
+TEST(RtpPacerHostTest, BurstThenRate) {
+    RtpPacer pacer(1000000, 10000);   // 1 byte/us, 10 ms of burst
+    for (uint32_t i = 0; i < 10; i++) { EXPECT_EQ(pacer.reserve(1000, 0), 0u); }
+    EXPECT_EQ(pacer.reserve(1000, 0), 1000u);
+    EXPECT_EQ(pacer.reserve(1000, 0), 2000u);
+    EXPECT_EQ(pacer.reserve(1000, 2000), 1000u);
+    // Idle: a new burst, but no more than one
+    EXPECT_EQ(pacer.reserve(1000, 1000000), 0u);
+    for (uint32_t i = 0; i < 9; i++) { EXPECT_EQ(pacer.reserve(1000, 1000000), 0u); }
+    EXPECT_EQ(pacer.reserve(1000, 1000000), 1000u);
+}
+
+
+// Stream -------------------------------------------------------------------------------------------------------
+class RtpStreamHostTest : public testing::Test {
+protected:
+    int receiveSocket = -1;
+    uint16_t receivePort = 0;
+
+    void SetUp() override {
+        HalHost::reset();
+        CameraManager::init();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        ServerManager::getInstance()->startServers();
+        ASSERT_NE(RtpStreamManager::getInstance(), nullptr);
+        HalHost::setCameraCaptureTimeUs(1000);
+
+        receiveSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        ASSERT_GE(receiveSocket, 0);
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(bind(receiveSocket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)), 0);
+        socklen_t length = sizeof(address);
+        ASSERT_EQ(getsockname(receiveSocket, reinterpret_cast<struct sockaddr*>(&address), &length), 0);
+        receivePort = ntohs(address.sin_port);
+        struct timeval timeout = {0, 100000};
+        setsockopt(receiveSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    void TearDown() override {
+        if (receiveSocket >= 0) { close(receiveSocket); }
+        HalHost::failCameraCapture(false);
+        ServerManager::deinit();
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+        CameraManager::deinit();
+    }
+
+    /**
+     * @brief Receive until the stream ended and no packet came for the receive timeout.
+     */
+    void receiveStream(RtpJpegReceiver& receiver) {
+        uint8_t packet[2048];
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(RTP_TEST_TIMEOUT_MS)) {
+            ssize_t length = recv(receiveSocket, packet, sizeof(packet), 0);
+            if (length > 0) {
+                receiver.receive(packet, size_t(length));
+            } else if (!RtpStreamManager::getInstance()->isStreaming()) {
+                break;
+            }
+        }
+        receiver.flush();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> get(const char* uri) {
+        return HttpdHost::request(VIDEO_SERVER_PORT, HTTP_GET, uri);
+    }
+};
+
+TEST_F(RtpStreamHostTest, StreamsToTheClientPort) {
+    HalHost::failCameraCaptureAfter(RTP_TEST_STREAM_FRAMES);
+    RtpStreamManager* rtpStreamManager = RtpStreamManager::getInstance();
+    const uint32_t loopback = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(rtpStreamManager->startStream(loopback, receivePort, 4), ESP_OK);
+    EXPECT_TRUE(rtpStreamManager->isStreaming());
+    // The same client renews the lease, another one has to wait
+    EXPECT_EQ(rtpStreamManager->startStream(loopback, receivePort, 4), ESP_OK);
+    EXPECT_EQ(rtpStreamManager->startStream(loopback, uint16_t(receivePort + 1), 4), ESP_ERR_INVALID_STATE);
+
+    RtpTestFrames frames;
+    RtpJpegReceiver receiver(&collectFrame, &frames);
+    receiveStream(receiver);
+    EXPECT_FALSE(rtpStreamManager->isStreaming());
+
+    ASSERT_EQ(frames.jpegs.size(), size_t(RTP_TEST_STREAM_FRAMES));
+    for (const std::vector<uint8_t>& jpeg : frames.jpegs) {
+        RtpJpegImage image;
+        ASSERT_EQ(RtpJpegPacketizer::parse(jpeg.data(), jpeg.size(), image), ESP_OK);
+        EXPECT_EQ(image.width, 640);
+        EXPECT_EQ(image.height, 480);
+    }
+    RtpJpegReceiverStats receiverStats = receiver.getStats();
+    RtpStreamStats stats = RtpStreamManager::getStats();
+    EXPECT_FALSE(stats.isActive);
+    EXPECT_EQ(stats.framesSent, uint32_t(RTP_TEST_STREAM_FRAMES));
+    EXPECT_EQ(stats.framesDropped, 0u);
+    EXPECT_EQ(stats.sendErrors, 0u);
+    EXPECT_EQ(stats.packetsSent, receiverStats.packets);
+    EXPECT_EQ(stats.fecPacketsSent, receiverStats.fecPackets);
+    EXPECT_EQ(stats.fecPacketsSent, (stats.packetsSent / RTP_TEST_STREAM_FRAMES + 3) / 4 * RTP_TEST_STREAM_FRAMES);
+    EXPECT_EQ(HalHost::getCameraFramesInUse(), 0u);
+}
+
+TEST_F(RtpStreamHostTest, StopEndsTheStream) {
+    RtpStreamManager* rtpStreamManager = RtpStreamManager::getInstance();
+    ASSERT_EQ(rtpStreamManager->startStream(htonl(INADDR_LOOPBACK), receivePort, 0), ESP_OK);
+    uint8_t packet[2048];
+    EXPECT_GT(recv(receiveSocket, packet, sizeof(packet), 0), 0);
+
+    std::shared_ptr<HttpdHostResponse> response = get("/rtp?stop=1");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_FALSE(rtpStreamManager->isStreaming());
+    EXPECT_EQ(RtpStreamManager::getStats().fecPacketsSent, 0u);
+    EXPECT_EQ(HalHost::getCameraFramesInUse(), 0u);
+}
+
+TEST_F(RtpStreamHostTest, SlowTaskKeepsTheInstance) {
+    // A capture longer than two stop timeouts: /rtp?stop=1 and deinit() give up while the task still uses the instance
+    HalHost::setCameraCaptureTimeUs((2 * RTP_STREAM_STOP_TIMEOUT_MS + 500) * 1000);
+    RtpStreamManager* rtpStreamManager = RtpStreamManager::getInstance();
+    ASSERT_EQ(rtpStreamManager->startStream(htonl(INADDR_LOOPBACK), receivePort, 0), ESP_OK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    EXPECT_EQ(get("/rtp?stop=1")->getStatus(), 500);
+    RtpStreamManager::deinit();
+    EXPECT_EQ(RtpStreamManager::getInstance(), rtpStreamManager);
+    EXPECT_TRUE(rtpStreamManager->isStreaming());
+
+    // The task ends after its capture, then the instance is deleted
+    for (uint32_t waitedMs = 0; rtpStreamManager->isStreaming() && waitedMs < RTP_TEST_TIMEOUT_MS; waitedMs++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_FALSE(rtpStreamManager->isStreaming());
+    RtpStreamManager::deinit();
+    EXPECT_EQ(RtpStreamManager::getInstance(), nullptr);
+    EXPECT_EQ(HalHost::getCameraFramesInUse(), 0u);
+}
+
+TEST_F(RtpStreamHostTest, InvalidRequestsAreRejected) {
+    EXPECT_EQ(get("/rtp")->getStatus(), 400);
+    EXPECT_EQ(get("/rtp?port=0")->getStatus(), 400);
+    EXPECT_EQ(get("/rtp?port=65536")->getStatus(), 400);
+    EXPECT_EQ(get("/rtp?port=5004&fec=17")->getStatus(), 400);
+    EXPECT_EQ(get("/rtp?port=udp")->getStatus(), 400);
+    EXPECT_FALSE(RtpStreamManager::getInstance()->isStreaming());
+}
+
+TEST_F(RtpStreamHostTest, OneCameraStreamAtATime) {
+    RtpStreamManager* rtpStreamManager = RtpStreamManager::getInstance();
+    ASSERT_EQ(rtpStreamManager->startStream(htonl(INADDR_LOOPBACK), receivePort, 0), ESP_OK);
+    std::shared_ptr<HttpdHostResponse> stream = get("/str");
+    ASSERT_TRUE(stream);
+    EXPECT_EQ(stream->getStatus(), 409);
+    rtpStreamManager->stopStream();
+
+    HalHost::failCameraCaptureAfter(20);
+    stream = get("/str");
+    ASSERT_TRUE(stream);
+    for (uint32_t waitedMs = 0; !ServerManager::getStreamStats().isActive && waitedMs < RTP_TEST_TIMEOUT_MS; waitedMs++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::shared_ptr<HttpdHostResponse> rtp = get("/rtp?port=5004");
+    ASSERT_TRUE(rtp);
+    EXPECT_EQ(rtp->getStatus(), 409);
+    EXPECT_FALSE(rtpStreamManager->isStreaming());
+    ASSERT_TRUE(stream->waitForComplete(RTP_TEST_TIMEOUT_MS));
+}
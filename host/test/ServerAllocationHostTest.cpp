@@ -0,0 +1,136 @@
+/*
+ * File: ServerAllocationHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the control requests do not allocate. malloc is counted (host/MallocHost.cpp) from right before
+    to right after the handler (HttpdHost::setHandlerHooks), the request injection of the fake server is not counted.
+    A separate executable, the allocator is only replaced here and in the benchmarks.
+*/
+
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "MallocHost.h"
+#include "ModeManager.h"
+#include "MotorManager.h"
+#include "RequestArena.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define MOVE_REQUESTS               100
+
+static uint64_t handlerAllocations = 0;
+
+static void startCounting() {
+    MallocHost::startCounting();
+}
+
+static void stopCounting() {
+    handlerAllocations += MallocHost::stopCounting();
+}
+
+class ServerAllocationHostTest : public testing::Test {
+protected:
+    void SetUp() override {
+        if (!MallocHost::isCountingAvailable()) { GTEST_SKIP() << "The allocator is replaced by the sanitizers"; }
+        HalHost::reset();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        ServerManager::getInstance()->startCommandServer();
+        ASSERT_TRUE(HttpdHost::isServerRunning(COMMAND_SERVER_PORT));
+
+        // Warm up: the first /mov creates the motor manager, the first request of a socket opens the session
+        ASSERT_TRUE(get("/mov?X=0&Y=0&L=0&R=0"));
+        handlerAllocations = 0;
+        HttpdHost::setHandlerHooks(startCounting, stopCounting);
+    }
+
+    void TearDown() override {
+        HttpdHost::setHandlerHooks(nullptr, nullptr);
+        ServerManager::deinit();
+        MotorManager::deinit();
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> get(const char* uri) {
+        return HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, uri);
+    }
+};
+
+TEST_F(ServerAllocationHostTest, MoveDoesNotAllocate) {
+    for (uint16_t i = 0; i < MOVE_REQUESTS; i++) {
+        std::shared_ptr<HttpdHostResponse> response = get(i % 2 ? "/mov?X=0&Y=50&L=10&R=0" : "/mov?X=-20&Y=-50&L=0&R=30");
+        ASSERT_TRUE(response);
+        ASSERT_EQ(response->getStatus(), 200);
+    }
+    EXPECT_EQ(handlerAllocations, 0u);
+    EXPECT_EQ(MotorManager::getInstance()->getControlData().Y, 50);
+}
+
+TEST_F(ServerAllocationHostTest, InvalidMoveDoesNotAllocate) {
+    for (const char* uri : { "/mov", "/mov?X=0", "/mov?X=0&Y=10&L=0" }) {
+        ASSERT_TRUE(get(uri)) << uri;
+    }
+    EXPECT_EQ(handlerAllocations, 0u);
+}
+
+TEST_F(ServerAllocationHostTest, AllocationStatsCountTheCheckedRequests) {
+    ServerAllocationStats before = ServerManager::getAllocationStats();
+    ASSERT_TRUE(get("/mov?X=0&Y=10&L=0&R=0"));
+    ServerAllocationStats after = ServerManager::getAllocationStats();
+#if defined(SERVER_ALLOCATION_CHECK) && defined(CONFIG_HEAP_USE_HOOKS)
+    EXPECT_EQ(after.checkedRequests, before.checkedRequests + 1);
+    EXPECT_EQ(after.allocatingRequests, before.allocatingRequests);
+#else
+    EXPECT_EQ(after.checkedRequests, before.checkedRequests); // The IDF heap hooks are not part of the host build
+#endif
+}
+
+TEST(RequestArenaHostTest, ResetReleasesEverything) {
+    alignas(REQUEST_ARENA_ALIGNMENT) static uint8_t buffer[64];
+    RequestArena arena(buffer, sizeof(buffer));
+    {
+        RequestArenaScope scope(arena);
+        void* first = arena.allocate(3);
+        void* second = arena.allocate(8);
+        ASSERT_NE(first, nullptr);
+        ASSERT_NE(second, nullptr);
+        EXPECT_EQ(uintptr_t(second) % REQUEST_ARENA_ALIGNMENT, 0u);
+        EXPECT_EQ(arena.allocate(64), nullptr);
+        EXPECT_EQ(arena.getFailedCount(), 1u);
+    }
+    EXPECT_EQ(arena.getUsed(), 0u);
+    EXPECT_EQ(arena.getHighWaterMark(), 16u);
+    EXPECT_NE(arena.allocate(64), nullptr);
+}
+
+TEST(RequestArenaHostTest, FixedStringTruncates) {
+    char buffer[8];
+    FixedString text(buffer, sizeof(buffer));
+    text.append("abc").appendFormat("%d", 42);
+    EXPECT_STREQ(text.c_str(), "abc42");
+    EXPECT_FALSE(text.isOverflow());
+    text.appendFormat("%s", "6789");
+    EXPECT_STREQ(text.c_str(), "abc4267");
+    EXPECT_EQ(text.length(), 7u);
+    EXPECT_TRUE(text.isOverflow());
+    text.clear();
+    EXPECT_EQ(text.length(), 0u);
+    EXPECT_FALSE(text.isOverflow());
+}
@@ -0,0 +1,320 @@
+/*
+ * File: ServerManagerHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the command server handlers answer injected requests (host/HttpdHost.h). The device suite
+    (src/UnitTests/ServerManagerUnitTest.cpp) only starts and stops the servers, it has no client.
+*/
+
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "MotorManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+
+// C++
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// C
+extern "C" {
+#include <stdio.h>
+}
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define MOVE_REQUESTS               1000
+#define MOVE_MAX_AVERAGE_US         200     // Request injection, query parsing and the handler (the host is faster than the ESP32)
+#define SESSION_SOCKET_BASE         2000    // Sockets of the session tests, one per client
+#define SESSION_EXTRA               2       // Sessions opened over COMMAND_SERVER_MAX_OPEN_SOCKETS (purged by the LRU)
+#define LOAD_REQUESTS_PER_SESSION   500
+
+class ServerManagerHostTest : public testing::Test {
+protected:
+    ServerManager* serverManager = nullptr;
+
+    void SetUp() override {
+        HalHost::reset();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        serverManager = ServerManager::getInstance();
+        serverManager->startCommandServer();
+        ASSERT_TRUE(HttpdHost::isServerRunning(COMMAND_SERVER_PORT));
+    }
+
+    void TearDown() override {
+        ServerManager::deinit();
+        MotorManager::deinit(); // Created by the /mov handler
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> get(const char* uri) {
+        return HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, uri);
+    }
+
+    struct SessionTable {
+        unsigned long opened;
+        unsigned long closed;
+        std::map<int, unsigned long> requests;      // Of the open sessions with a stats slot, by socket
+    };
+
+    /*
+        The session lines of /sst. Sent on an open session, so it does not purge one (/sst is not counted as a request).
+    */
+    static SessionTable readSessions(int socket) {
+        SessionTable table = {};
+        std::shared_ptr<HttpdHostResponse> response = HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, "/sst", nullptr, socket);
+        if (!response || response->getStatus() != 200) { return table; }
+        std::string body = response->getBody();
+        if (sscanf(body.c_str(), "opened %lu closed %lu", &table.opened, &table.closed) != 2) { return table; }
+        size_t line = body.find('\n', body.find('\n') + 1) + 1;  // After the column names
+        int sessionSocket;
+        unsigned long requests;
+        while (line > 0 && line < body.size() && sscanf(body.c_str() + line, "%d %lu", &sessionSocket, &requests) == 2) {
+            table.requests[sessionSocket] = requests;
+            line = body.find('\n', line) + 1;
+        }
+        return table;
+    }
+
+    static void sendMoves(int socket, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            std::shared_ptr<HttpdHostResponse> response = HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, "/mov?X=0&Y=20&L=0&R=0",
+                                                                             nullptr, socket);
+            ASSERT_TRUE(response && response->getStatus() == 200);
+        }
+    }
+};
+
+TEST_F(ServerManagerHostTest, MoveSetsControlData) {
+    std::shared_ptr<HttpdHostResponse> response = get("/mov?X=0&Y=-40&L=0&R=10");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    ControlData controlData = MotorManager::getInstance()->getControlData();
+    EXPECT_EQ(controlData.X, 0);
+    EXPECT_EQ(controlData.Y, -40);
+    EXPECT_EQ(controlData.L, 0);
+    EXPECT_EQ(controlData.R, 10);
+}
+
+TEST_F(ServerManagerHostTest, MoveRejectsMissingAxes) {
+    MotorManager::getInstance()->setControlData(0, 25, 0, 0);
+    for (const char* uri : { "/mov", "/mov?X=0", "/mov?X=0&Y=10&L=0" }) {
+        std::shared_ptr<HttpdHostResponse> response = get(uri);
+        ASSERT_TRUE(response);
+        EXPECT_EQ(response->getStatus(), 404) << uri;
+    }
+    EXPECT_EQ(MotorManager::getInstance()->getControlData().Y, 25); // The last valid command is kept
+}
+
+TEST_F(ServerManagerHostTest, MoveHandlerTime) {
+    int64_t startUs = Hal::Timer::getTimeUs();
+    for (uint32_t i = 0; i < MOVE_REQUESTS; i++) {
+        std::shared_ptr<HttpdHostResponse> response = get("/mov?X=0&Y=50&L=10&R=0");
+        ASSERT_TRUE(response && response->getStatus() == 200);
+    }
+    int64_t averageUs = (Hal::Timer::getTimeUs() - startUs) / MOVE_REQUESTS;
+    EXPECT_LE(averageUs, MOVE_MAX_AVERAGE_US);
+}
+
+TEST_F(ServerManagerHostTest, ConnectionSetsAnimation) {
+    std::shared_ptr<HttpdHostResponse> response = get("/con");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getBody(), "OK");
+    EXPECT_EQ(LedManager::getInstance()->getCurrentAnimation(), AnimationType::IDLE);
+
+    response = get("/dis");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_EQ(LedManager::getInstance()->getCurrentAnimation(), AnimationType::NONE);
+}
+
+TEST_F(ServerManagerHostTest, SettingsFromStorage) {
+    StorageManager::getInstance()->setWiFiSSID("host-ssid");
+    std::shared_ptr<HttpdHostResponse> response = get("/gst");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 200);
+    EXPECT_EQ(response->getType(), "application/json");
+    EXPECT_NE(response->getBody().find("host-ssid"), std::string::npos);
+}
+
+TEST_F(ServerManagerHostTest, SettingsWithUtf8Ssid) {
+    // The UTF-8 bytes are stored as they are, the escapes are encoded to UTF-8, the control characters are rejected
+    StorageManager* storageManager = StorageManager::getInstance();
+    const char* batch = "{\"ssid\":\"K\xC3\xA1v\xC3\xA9z\xC3\xB3 \xE2\x98\x95\",\"color\":2}";
+    EXPECT_EQ(HttpdHost::request(COMMAND_SERVER_PORT, HTTP_POST, "/set", batch)->getStatus(), 200);
+    EXPECT_EQ(storageManager->getWiFiSSID(), "K\xC3\xA1v\xC3\xA9z\xC3\xB3 \xE2\x98\x95");
+    EXPECT_NE(get("/gst")->getBody().find("K\xC3\xA1v\xC3\xA9z\xC3\xB3 \xE2\x98\x95"), std::string::npos);
+
+    EXPECT_EQ(HttpdHost::request(COMMAND_SERVER_PORT, HTTP_POST, "/set", "{\"ssid\":\"Caf\\u00e9 \\u2615\"}")->getStatus(), 200);
+    EXPECT_EQ(storageManager->getWiFiSSID(), "Caf\xC3\xA9 \xE2\x98\x95");
+
+    EXPECT_EQ(HttpdHost::request(COMMAND_SERVER_PORT, HTTP_POST, "/set", "{\"ssid\":\"a\tb\"}")->getStatus(), 400);
+    EXPECT_EQ(HttpdHost::request(COMMAND_SERVER_PORT, HTTP_POST, "/set", "{\"ssid\":\"\\ud83d\"}")->getStatus(), 400);
+    EXPECT_EQ(storageManager->getWiFiSSID(), "Caf\xC3\xA9 \xE2\x98\x95");
+}
+
+TEST_F(ServerManagerHostTest, StalledBodyTimesOut) {
+    // The client announced more than it sends: the handler gives up after the receive timeouts, the server goes on
+    std::shared_ptr<HttpdHostResponse> response = HttpdHost::request(COMMAND_SERVER_PORT, HTTP_POST, "/set", "{\"color\":",
+                                                                     1000, { { "Content-Length", "40" } });
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 408);
+    EXPECT_EQ(get("/mov?X=0&Y=10&L=0&R=0")->getStatus(), 200);
+}
+
+TEST_F(ServerManagerHostTest, SessionStatsFollowThePool) {
+    static_assert(SESSION_EXTRA < COMMAND_SERVER_MAX_OPEN_SOCKETS, "The first session has to stay open");
+    SessionTable start = readSessions(SESSION_SOCKET_BASE);
+    ASSERT_EQ(start.requests.size(), 1u);
+    EXPECT_EQ(start.requests[SESSION_SOCKET_BASE], 0u);
+
+    // Every slot of the pool is used, one session per slot with its own request count
+    for (int i = 0; i < COMMAND_SERVER_MAX_OPEN_SOCKETS; i++) { sendMoves(SESSION_SOCKET_BASE + i, i + 1); }
+    SessionTable table = readSessions(SESSION_SOCKET_BASE);     // The first session becomes the most recently used
+    ASSERT_EQ(table.requests.size(), size_t(COMMAND_SERVER_MAX_OPEN_SOCKETS));
+    for (int i = 0; i < COMMAND_SERVER_MAX_OPEN_SOCKETS; i++) { EXPECT_EQ(table.requests[SESSION_SOCKET_BASE + i], unsigned(i + 1)); }
+    EXPECT_EQ(table.opened - start.opened, unsigned(COMMAND_SERVER_MAX_OPEN_SOCKETS - 1));
+    EXPECT_EQ(table.closed, start.closed);
+
+    // More clients than sockets: the least recently used sessions are purged, their slots go to the new sessions
+    for (int i = 0; i < SESSION_EXTRA; i++) { sendMoves(SESSION_SOCKET_BASE + COMMAND_SERVER_MAX_OPEN_SOCKETS + i, 1); }
+    table = readSessions(SESSION_SOCKET_BASE);
+    ASSERT_EQ(table.requests.size(), size_t(COMMAND_SERVER_MAX_OPEN_SOCKETS));
+    EXPECT_EQ(table.requests[SESSION_SOCKET_BASE], 1u);
+    for (int i = 1; i <= SESSION_EXTRA; i++) { EXPECT_EQ(table.requests.count(SESSION_SOCKET_BASE + i), 0u) << i; }
+    for (int i = SESSION_EXTRA + 1; i < COMMAND_SERVER_MAX_OPEN_SOCKETS; i++) {
+        EXPECT_EQ(table.requests[SESSION_SOCKET_BASE + i], unsigned(i + 1));
+    }
+    for (int i = 0; i < SESSION_EXTRA; i++) { EXPECT_EQ(table.requests[SESSION_SOCKET_BASE + COMMAND_SERVER_MAX_OPEN_SOCKETS + i], 1u); }
+    EXPECT_EQ(table.opened - start.opened, unsigned(COMMAND_SERVER_MAX_OPEN_SOCKETS - 1 + SESSION_EXTRA));
+    EXPECT_EQ(table.closed - start.closed, unsigned(SESSION_EXTRA));
+
+    // The clients disconnect: every slot is released, a new session starts from zero
+    for (const auto& session : table.requests) { HttpdHost::closeSession(COMMAND_SERVER_PORT, session.first); }
+    SessionTable end = readSessions(SESSION_SOCKET_BASE - 1);
+    ASSERT_EQ(end.requests.size(), 1u);
+    EXPECT_EQ(end.requests[SESSION_SOCKET_BASE - 1], 0u);
+    EXPECT_EQ(end.opened - start.opened, unsigned(COMMAND_SERVER_MAX_OPEN_SOCKETS + SESSION_EXTRA));
+    EXPECT_EQ(end.closed - start.closed, unsigned(COMMAND_SERVER_MAX_OPEN_SOCKETS + SESSION_EXTRA));
+}
+
+TEST_F(ServerManagerHostTest, MoveLoadFromKeepAliveSessions) {
+    // Like tools/command_load.py --connections COMMAND_SERVER_MAX_OPEN_SOCKETS --rate 0: one keep-alive session per
+    // client thread, a request as soon as the last one is answered. The rates are for comparing changes (the HAL is a
+    // fake, the host server runs one request at a time like the server task), only the counts are checked
+    SessionTable start = readSessions(SESSION_SOCKET_BASE);
+    std::vector<std::vector<int64_t>> latencies(COMMAND_SERVER_MAX_OPEN_SOCKETS);
+    std::atomic<uint32_t> failures{0};
+    std::vector<std::thread> clients;
+    int64_t startUs = Hal::Timer::getTimeUs();
+    for (int i = 0; i < COMMAND_SERVER_MAX_OPEN_SOCKETS; i++) {
+        clients.emplace_back([&, i] {
+            latencies[i].reserve(LOAD_REQUESTS_PER_SESSION);
+            for (uint32_t n = 0; n < LOAD_REQUESTS_PER_SESSION; n++) {
+                int64_t sentUs = Hal::Timer::getTimeUs();
+                std::shared_ptr<HttpdHostResponse> response = HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET,
+                                                                                 "/mov?X=10&Y=40&L=0&R=0", nullptr,
+                                                                                 SESSION_SOCKET_BASE + i);
+                if (!response || response->getStatus() != 200) { failures++; }
+                latencies[i].push_back(Hal::Timer::getTimeUs() - sentUs);
+            }
+        });
+    }
+    for (std::thread& client : clients) { client.join(); }
+    int64_t elapsedUs = Hal::Timer::getTimeUs() - startUs;
+
+    std::vector<int64_t> all;
+    for (const std::vector<int64_t>& session : latencies) { all.insert(all.end(), session.begin(), session.end()); }
+    std::sort(all.begin(), all.end());
+    printf("mov load: %d sessions, %zu requests, %.0f req/s, latency p50 %lld us p99 %lld us max %lld us\n",
+           COMMAND_SERVER_MAX_OPEN_SOCKETS, all.size(), all.size() * 1e6 / std::max<int64_t>(elapsedUs, 1),
+           (long long)all[all.size() / 2], (long long)all[all.size() * 99 / 100], (long long)all.back());
+    EXPECT_EQ(failures, 0u);
+
+    // Every request is counted on its own session, none of them was purged
+    SessionTable table = readSessions(SESSION_SOCKET_BASE);
+    ASSERT_EQ(table.requests.size(), size_t(COMMAND_SERVER_MAX_OPEN_SOCKETS));
+    for (int i = 0; i < COMMAND_SERVER_MAX_OPEN_SOCKETS; i++) {
+        EXPECT_EQ(table.requests[SESSION_SOCKET_BASE + i], unsigned(LOAD_REQUESTS_PER_SESSION)) << i;
+    }
+    EXPECT_EQ(table.closed, start.closed);
+}
+
+TEST_F(ServerManagerHostTest, RequestWakesTheRoomPlantInTheBudget) {
+    // The wake path of src/UnitTests/ModeManagerUnitTest.cpp through the handlers: the request runs in a client thread
+    // (the server task), this thread is the main loop. The Wi-Fi, the LEDs and the command server are not on the path
+    ModeManager* modeManager = ModeManager::getInstance();
+    modeManager->setSubsystemHooks(SUBSYSTEM_WIFI, { nullptr, nullptr, nullptr, nullptr });
+    modeManager->setSubsystemHooks(SUBSYSTEM_LEDS, { nullptr, nullptr, nullptr, nullptr });
+    modeManager->setSubsystemHooks(SUBSYSTEM_COMMAND_SERVER, { nullptr, nullptr, nullptr, nullptr });
+    const int64_t wakeLatencyMaxUs = int64_t(ModeManager::getModeProfile(DroneMode::ROOM_PLANT).wakeLatencyBudgetMs
+                                             - WIFI_DTIM_WAKE_LATENCY_MS) * 1000;
+    for (const char* uri : { "/con", "/mov?X=0&Y=30&L=0&R=0" }) {
+        modeManager->setMode(DroneMode::ROOM_PLANT);
+        modeManager->processModeRequest();
+        ASSERT_EQ(modeManager->getMode(), DroneMode::ROOM_PLANT);
+        modeManager->waitForModeRequest(0);
+
+        int64_t startUs = Hal::Timer::getTimeUs();
+        std::thread client([uri] { EXPECT_EQ(get(uri)->getStatus(), 200) << uri; });
+        modeManager->waitForModeRequest(MODE_PROCESS_PERIOD_MS);
+        modeManager->processModeRequest();
+        int64_t wakeUs = Hal::Timer::getTimeUs() - startUs;
+        client.join();
+        EXPECT_EQ(modeManager->getMode(), DroneMode::DRIVE) << uri;
+        EXPECT_LE(wakeUs, wakeLatencyMaxUs) << uri;
+    }
+    modeManager->setMode(DroneMode::SHUTDOWN);  // Stop the managers while the servers are there
+    modeManager->processModeRequest();
+}
+
+TEST_F(ServerManagerHostTest, RequestsWithoutTheModeAndLedManagers) {
+    // The command server can run before the mode manager is initialized and after it is deinitialized
+    ModeManager::deinit();
+    LedManager::deinit();
+    EXPECT_EQ(get("/con")->getStatus(), 200);
+    EXPECT_EQ(get("/mov?X=0&Y=20&L=0&R=0")->getStatus(), 200);
+    EXPECT_EQ(get("/dis")->getStatus(), 200);
+    EXPECT_EQ(get("/rpl")->getStatus(), 500);
+}
+
+TEST_F(ServerManagerHostTest, ModeRejectsShutdownAndUnknown) {
+    for (const char* uri : { "/mod?M=0", "/mod?M=99", "/mod" }) {
+        std::shared_ptr<HttpdHostResponse> response = get(uri);
+        ASSERT_TRUE(response);
+        EXPECT_EQ(response->getStatus(), 404) << uri;
+    }
+}
+
+TEST_F(ServerManagerHostTest, UnknownUri) {
+    std::shared_ptr<HttpdHostResponse> response = get("/xyz");
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 404);
+}
+
+TEST_F(ServerManagerHostTest, StopCommandServer) {
+    serverManager->stopCommandServer();
+    EXPECT_FALSE(serverManager->isCommandServerRunning());
+    EXPECT_FALSE(HttpdHost::isServerRunning(COMMAND_SERVER_PORT));
+}
@@ -0,0 +1,192 @@
+/*
+ * File: SnapshotCacheHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the snapshot endpoint of the video server (/jpg) and its cache. The fake camera busy waits for a
+    capture, so the concurrent requests arrive while one capture is running and have to share it.
+*/
+
+#include "CameraManager.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "ServerManager.h"
+#include "SnapshotCache.h"
+#include "StorageManager.h"
+
+// C++
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define SNAPSHOT_CAPTURE_TIME_US    20000   // Longer than starting the threads, they all find the capture running
+#define SNAPSHOT_CLIENTS            8
+#define SNAPSHOT_TIMEOUT_MS         2000
+
+class SnapshotCacheHostTest : public testing::Test {
+protected:
+    void SetUp() override {
+        HalHost::reset();
+        CameraManager::init();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        ServerManager::getInstance()->startServers();
+        ASSERT_TRUE(ServerManager::getInstance()->isVideoServerRunning());
+        ASSERT_NE(SnapshotCache::getInstance(), nullptr);
+        HalHost::setCameraCaptureTimeUs(SNAPSHOT_CAPTURE_TIME_US);
+    }
+
+    void TearDown() override {
+        HalHost::failCameraCapture(false);
+        ServerManager::deinit();
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+        CameraManager::deinit();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> snapshot(const char* uri = "/jpg", const std::string& ifNoneMatch = "") {
+        std::map<std::string, std::string> headers;
+        if (!ifNoneMatch.empty()) { headers["If-None-Match"] = ifNoneMatch; }
+        return HttpdHost::request(VIDEO_SERVER_PORT, HTTP_GET, uri, nullptr, 1000, headers);
+    }
+
+    static bool waitFor(bool (*condition)()) {
+        for (uint32_t waitedMs = 0; !condition(); waitedMs++) {
+            if (waitedMs >= SNAPSHOT_TIMEOUT_MS) { return false; }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+};
+
+TEST_F(SnapshotCacheHostTest, ConcurrentAcquiresShareOneCapture) {
+    SnapshotCache* snapshotCache = SnapshotCache::getInstance();
+    std::vector<const SnapshotFrame*> frames(SNAPSHOT_CLIENTS, nullptr);
+    std::vector<std::thread> clients;
+    for (uint32_t i = 0; i < SNAPSHOT_CLIENTS; i++) {
+        clients.emplace_back([&, i] { EXPECT_EQ(snapshotCache->acquire(SNAPSHOT_MAX_AGE_MS, frames[i]), ESP_OK); });
+    }
+    for (std::thread& client : clients) { client.join(); }
+
+    EXPECT_EQ(HalHost::getCameraFrameCount(), 1u);
+    EXPECT_EQ(HalHost::getCameraFramesInUse(), 0u); // The driver buffer is returned right after the copy
+    for (const SnapshotFrame* frame : frames) {
+        ASSERT_NE(frame, nullptr);
+        EXPECT_EQ(frame, frames[0]);
+        snapshotCache->release(frame);
+    }
+    SnapshotCacheStats stats = snapshotCache->getStats();
+    EXPECT_EQ(stats.requests, uint32_t(SNAPSHOT_CLIENTS));
+    EXPECT_EQ(stats.captures, 1u);
+    EXPECT_EQ(stats.hits, uint32_t(SNAPSHOT_CLIENTS - 1));
+}
+
+TEST_F(SnapshotCacheHostTest, RequestsReturnTheSameFrame) {
+    std::vector<std::shared_ptr<HttpdHostResponse>> responses(SNAPSHOT_CLIENTS);
+    std::vector<std::thread> clients;
+    for (uint32_t i = 0; i < SNAPSHOT_CLIENTS; i++) {
+        clients.emplace_back([&, i] { responses[i] = snapshot(); });
+    }
+    for (std::thread& client : clients) { client.join(); }
+
+    EXPECT_EQ(HalHost::getCameraFrameCount(), 1u);
+    for (const std::shared_ptr<HttpdHostResponse>& response : responses) {
+        ASSERT_TRUE(response);
+        EXPECT_EQ(response->getStatus(), 200);
+        EXPECT_EQ(response->getType(), "image/jpeg");
+        EXPECT_EQ(response->getHeader("ETag"), responses[0]->getHeader("ETag"));
+        EXPECT_EQ(response->getHeader("Cache-Control"), "no-cache");
+        const std::string body = response->getBody();
+        ASSERT_GE(body.size(), 4u);
+        EXPECT_EQ(uint8_t(body[0]), 0xFF);
+        EXPECT_EQ(uint8_t(body[1]), 0xD8);
+    }
+    EXPECT_EQ(responses[0]->getHeader("ETag"), "\"" + responses[0]->getHeader("X-Timestamp") + "\"");
+}
+
+TEST_F(SnapshotCacheHostTest, MatchingETagIsNotModified) {
+    std::shared_ptr<HttpdHostResponse> first = snapshot();
+    ASSERT_TRUE(first);
+    ASSERT_EQ(first->getStatus(), 200);
+
+    std::shared_ptr<HttpdHostResponse> second = snapshot("/jpg", first->getHeader("ETag"));
+    ASSERT_TRUE(second);
+    EXPECT_EQ(second->getStatus(), 304);
+    EXPECT_TRUE(second->getBody().empty());
+    EXPECT_EQ(second->getHeader("ETag"), first->getHeader("ETag"));
+
+    std::shared_ptr<HttpdHostResponse> other = snapshot("/jpg", "\"1.000000\"");
+    ASSERT_TRUE(other);
+    EXPECT_EQ(other->getStatus(), 200);
+    EXPECT_EQ(HalHost::getCameraFrameCount(), 1u);
+}
+
+TEST_F(SnapshotCacheHostTest, MaxAgeSelectsTheFreshness) {
+    ASSERT_EQ(snapshot()->getStatus(), 200);
+    // Every capture is newer than the previous one, a zero max age never uses the cache
+    ASSERT_EQ(snapshot("/jpg?maxAge=0")->getStatus(), 200);
+    EXPECT_EQ(HalHost::getCameraFrameCount(), 2u);
+    ASSERT_EQ(snapshot("/jpg?maxAge=60000")->getStatus(), 200);
+    EXPECT_EQ(HalHost::getCameraFrameCount(), 2u);
+
+    EXPECT_EQ(snapshot("/jpg?maxAge=fresh")->getStatus(), 400);
+    EXPECT_EQ(snapshot("/jpg?maxAge=60001")->getStatus(), 400);
+    EXPECT_EQ(HalHost::getCameraFrameCount(), 2u);
+}
+
+TEST_F(SnapshotCacheHostTest, FailedCaptureIsAnError) {
+    HalHost::failCameraCapture(true);
+    std::shared_ptr<HttpdHostResponse> response = snapshot();
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->getStatus(), 500);
+    EXPECT_EQ(SnapshotCache::getInstance()->getStats().failures, 1u);
+
+    // Nothing was cached, the next request captures
+    HalHost::failCameraCapture(false);
+    EXPECT_EQ(snapshot()->getStatus(), 200);
+}
+
+TEST_F(SnapshotCacheHostTest, RunningStreamPublishesTheFrames) {
+    // 50 frames of 20 ms: the stream runs for about a second and publishes every 100 ms
+    HalHost::failCameraCaptureAfter(50);
+    std::shared_ptr<HttpdHostResponse> stream = HttpdHost::request(VIDEO_SERVER_PORT, HTTP_GET, "/str");
+    ASSERT_TRUE(stream);
+    ASSERT_TRUE(waitFor([] { return SnapshotCache::getInstance()->getStats().publishes > 0; }));
+
+    // Served from the published frames while the stream holds the camera
+    for (uint32_t i = 0; i < 3; i++) {
+        std::shared_ptr<HttpdHostResponse> response = snapshot();
+        ASSERT_TRUE(response);
+        EXPECT_EQ(response->getStatus(), 200);
+    }
+    // One stream at a time
+    std::shared_ptr<HttpdHostResponse> second = HttpdHost::request(VIDEO_SERVER_PORT, HTTP_GET, "/str");
+    ASSERT_TRUE(second);
+    EXPECT_EQ(second->getStatus(), 409);
+
+    ASSERT_TRUE(stream->waitForComplete(SNAPSHOT_TIMEOUT_MS));
+    ASSERT_TRUE(waitFor([] { return !ServerManager::getStreamStats().isActive; }));
+    SnapshotCacheStats stats = SnapshotCache::getInstance()->getStats();
+    EXPECT_EQ(stats.captures, 0u);
+    EXPECT_EQ(stats.hits, 3u);
+    EXPECT_GE(stats.publishes, 2u);
+}
@@ -0,0 +1,48 @@
+/*
+ * File: UnitTestSuites.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: every automated suite of UnitTests::SUITES (src/UnitTests) is a GoogleTest case against the fake HAL.
+    The interactive suites (operator, access point, restart) are skipped.
+*/
+
+#include "UnitTests.h"
+#include "HalHost.h"
+
+// C++
+#include <string>
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+class UnitTestSuiteTest : public testing::TestWithParam<const UnitTestSuite*> {
+protected:
+    void SetUp() override {
+        HalHost::reset();
+    }
+};
+
+TEST_P(UnitTestSuiteTest, Passes) {
+    const UnitTestSuite* suite = GetParam();
+    if (suite->flags & UNIT_SUITE_INTERACTIVE) { GTEST_SKIP() << suite->name << " is interactive"; }
+    EXPECT_TRUE(suite->run(false)) << suite->name << " suite failed, see the log above";
+}
+
+static std::vector<const UnitTestSuite*> getSuites() {
+    std::vector<const UnitTestSuite*> suites;
+    for (uint8_t i = 0; i < UnitTests::SUITE_COUNT; i++) { suites.push_back(&UnitTests::SUITES[i]); }
+    return suites;
+}
+
+INSTANTIATE_TEST_SUITE_P(Firmware, UnitTestSuiteTest, testing::ValuesIn(getSuites()),
+    [](const testing::TestParamInfo<const UnitTestSuite*>& info) { return std::string(info.param->name); });
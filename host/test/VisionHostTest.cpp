@@ -0,0 +1,385 @@
+/*
+ * File: VisionHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the vision stage. The word parallel kernels against a per pixel reference, the motion and obstacle
+    maps of VisionPipeline on generated thumbnails, the optical flow on rendered floors, and the stop hint from the fake
+    camera to the motor duties. The fake JPEG decoder returns the thumbnail set by HalHost::setCameraThumbnail().
+    host_vision_flow (host/bench/VisionFlow.cpp) measures the accuracy of the flow on longer sequences.
+*/
+
+#include "CameraManager.h"
+#include "HalHost.h"
+#include "HttpdHost.h"
+#include "LedManager.h"
+#include "ModeManager.h"
+#include "MotorManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+#include "VisionManager.h"
+#include "VisionPipeline.h"
+
+// C++
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define THUMBNAIL_WIDTH     80      // VGA at 1/8 scale, the fake camera frame
+#define THUMBNAIL_HEIGHT    60
+#define VISION_TIMEOUT_MS   3000
+#define FRAME_INTERVAL_US   100000  // 10 Hz
+
+// Thumbnails ---------------------------------------------------------------------------------------------------
+/**
+ * @brief A floor with a smooth light gradient (no edges at 1/8 scale), with a striped box of the given bounds.
+ */
+static std::vector<uint8_t> createScene(uint16_t boxLeft, uint16_t boxTop, uint16_t boxRight, uint16_t boxBottom,
+                                        uint16_t stripeShift = 0) {
+    std::vector<uint8_t> scene(THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT);
+    for (uint16_t y = 0; y < THUMBNAIL_HEIGHT; y++) {
+        for (uint16_t x = 0; x < THUMBNAIL_WIDTH; x++) {
+            bool isBox = x >= boxLeft && x < boxRight && y >= boxTop && y < boxBottom;
+            scene[y * THUMBNAIL_WIDTH + x] = isBox ? (((x + stripeShift) / 2) % 2 ? 200 : 40) : uint8_t(90 + x / 4 + y / 4);
+        }
+    }
+    return scene;
+}
+
+/**
+ * @brief Value noise: random gray levels on an integer lattice, bilinear in between (not periodic, no false matches).
+ */
+static float floorTexture(float x, float y) {
+    auto lattice = [](int32_t latticeX, int32_t latticeY) {
+        uint32_t hash = uint32_t(latticeX) * 73856093u ^ uint32_t(latticeY) * 19349663u;
+        hash ^= hash >> 13;
+        hash *= 0x5BD1E995u;
+        return float((hash ^ (hash >> 15)) & 0xFF);
+    };
+    float cellX = floorf(x);
+    float cellY = floorf(y);
+    float fractionX = x - cellX;
+    float fractionY = y - cellY;
+    int32_t left = int32_t(cellX);
+    int32_t top = int32_t(cellY);
+    float upper = lattice(left, top) + (lattice(left + 1, top) - lattice(left, top)) * fractionX;
+    float lower = lattice(left, top + 1) + (lattice(left + 1, top + 1) - lattice(left, top + 1)) * fractionX;
+    return upper + (lower - upper) * fractionY;
+}
+
+/**
+ * @brief A textured floor seen by the level camera of the flow model (VISION_CAMERA_HEIGHT_MM and the focal length),
+ * from the given position (mm) and heading (radians, positive: right). 2 x 2 samples per pixel.
+ */
+static std::vector<uint8_t> renderFloor(float rightMm, float forwardMm, float heading) {
+    const float focal = THUMBNAIL_WIDTH * VISION_FOCAL_PERMILLE / 1000.0f;
+    const float horizon = THUMBNAIL_HEIGHT * VISION_HORIZON_PERMILLE / 1000.0f;
+    std::vector<uint8_t> floor(THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT, 90);
+    for (uint16_t y = 0; y < THUMBNAIL_HEIGHT; y++) {
+        for (uint16_t x = 0; x < THUMBNAIL_WIDTH; x++) {
+            float sum = 0;
+            for (float dy : { 0.25f, 0.75f }) {
+                for (float dx : { 0.25f, 0.75f }) {
+                    float v = y + dy - horizon;
+                    if (v <= 0.5f) { sum += 90; continue; } // The wall at the horizon
+                    float depth = VISION_CAMERA_HEIGHT_MM * focal / v;
+                    float side = (x + dx - THUMBNAIL_WIDTH / 2.0f) * depth / focal;
+                    float worldX = rightMm + side * cosf(heading) + depth * sinf(heading);
+                    float worldZ = forwardMm - side * sinf(heading) + depth * cosf(heading);
+                    sum += floorTexture(worldX / 16, worldZ / 16) * 0.6f + floorTexture(worldX / 7, worldZ / 7) * 0.4f;
+                }
+            }
+            floor[y * THUMBNAIL_WIDTH + x] = uint8_t(sum / 4);
+        }
+    }
+    return floor;
+}
+
+static uint32_t referenceSad(const uint8_t* a, const uint8_t* b, size_t length) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < length; i++) { sum += uint32_t(abs(int(a[i]) - int(b[i]))); }
+    return sum;
+}
+
+static uint32_t referenceCount(const uint8_t* a, const uint8_t* b, size_t length, uint8_t threshold) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < length; i++) { count += abs(int(a[i]) - int(b[i])) > threshold ? 1 : 0; }
+    return count;
+}
+
+static uint32_t cellBit(uint8_t row, uint8_t column) { return 1u << (row * VISION_GRID_COLUMNS + column); }
+
+// Kernels ------------------------------------------------------------------------------------------------------
+TEST(VisionKernelsHostTest, MatchReferenceOnRandomData) {
+    std::mt19937 random(43);
+    std::vector<uint8_t> a(1100), b(1100);
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = uint8_t(random());
+        b[i] = uint8_t(random());
+    }
+    for (size_t offset = 0; offset < 4; offset++) {                     // Unaligned rows of a cell
+        for (size_t length : { 0, 1, 3, 4, 5, 9, 79, 80, 511, 512, 513, 1024 }) {
+            const uint8_t* rowA = a.data() + offset;
+            const uint8_t* rowB = b.data() + 3 - offset;
+            EXPECT_EQ(VisionKernels::sumAbsoluteDifferences(rowA, rowB, length), referenceSad(rowA, rowB, length)) << length;
+            for (uint8_t threshold : { 0, 1, 24, 127, 128, 254, 255 }) {
+                EXPECT_EQ(VisionKernels::countDifferences(rowA, rowB, length, threshold), referenceCount(rowA, rowB, length, threshold))
+                    << length << " " << unsigned(threshold);
+            }
+        }
+    }
+}
+
+TEST(VisionKernelsHostTest, LargestDifferencesDoNotOverflowTheLanes) {
+    std::vector<uint8_t> black(4096, 0), white(4096, 255);
+    EXPECT_EQ(VisionKernels::sumAbsoluteDifferences(black.data(), white.data(), black.size()), 4096u * 255);
+    EXPECT_EQ(VisionKernels::sumAbsoluteDifferences(white.data(), black.data(), black.size()), 4096u * 255);
+    EXPECT_EQ(VisionKernels::countDifferences(black.data(), white.data(), black.size(), 254), 4096u);
+    EXPECT_EQ(VisionKernels::countDifferences(black.data(), white.data(), black.size(), 255), 0u);
+    EXPECT_EQ(VisionKernels::countDifferences(white.data(), white.data(), white.size(), 0), 0u);
+}
+
+// Pipeline -----------------------------------------------------------------------------------------------------
+class VisionPipelineHostTest : public testing::Test {
+protected:
+    VisionPipeline pipeline;
+
+    VisionResult process(const std::vector<uint8_t>& scene, uint32_t intervalUs = FRAME_INTERVAL_US) {
+        memcpy(pipeline.getInputBuffer(), scene.data(), scene.size());
+        VisionResult result;
+        pipeline.process(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, intervalUs, result);
+        return result;
+    }
+};
+
+TEST_F(VisionPipelineHostTest, SupportsTheThumbnailsUpToSvga) {
+    ASSERT_TRUE(pipeline.isAllocated());
+    EXPECT_TRUE(VisionPipeline::isSupported(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+    EXPECT_TRUE(VisionPipeline::isSupported(800 >> VISION_SCALE_SHIFT, 600 >> VISION_SCALE_SHIFT));
+    EXPECT_FALSE(VisionPipeline::isSupported(1024 >> VISION_SCALE_SHIFT, 768 >> VISION_SCALE_SHIFT));
+    EXPECT_FALSE(VisionPipeline::isSupported(VISION_GRID_COLUMNS, VISION_GRID_ROWS));
+
+    VisionResult result = {};
+    result.obstacleMap = 1;
+    pipeline.process(VISION_MAX_WIDTH + 1, VISION_MAX_HEIGHT, FRAME_INTERVAL_US, result);
+    EXPECT_EQ(result.obstacleMap, 0u); // Cleared, nothing processed
+}
+
+TEST_F(VisionPipelineHostTest, EmptyFloorHasNoObstacleAndStaticSceneNoMotion) {
+    std::vector<uint8_t> floor = createScene(0, 0, 0, 0);
+    VisionResult first = process(floor);
+    EXPECT_EQ(first.obstacleMap, 0u);
+    EXPECT_EQ(first.motionMap, 0u); // No previous frame
+    VisionResult second = process(floor);
+    EXPECT_EQ(second.motionMap, 0u);
+    EXPECT_EQ(second.motionPermille, 0u);
+    EXPECT_FALSE(second.isStopHint);
+}
+
+TEST_F(VisionPipelineHostTest, MovingTextureSetsTheMotionMap) {
+    // Top left corner, out of the near field
+    process(createScene(0, 0, 20, 15));
+    VisionResult result = process(createScene(0, 0, 20, 15, 2));
+    EXPECT_EQ(result.motionMap, cellBit(0, 0) | cellBit(0, 1));
+    EXPECT_EQ(result.obstacleMap, cellBit(0, 0) | cellBit(0, 1));
+    EXPECT_EQ(result.nearObstacleCells, 0u);
+    EXPECT_GT(result.motionPermille, 0u);
+    EXPECT_FALSE(result.isStopHint);
+}
+
+TEST_F(VisionPipelineHostTest, NearObstacleStopsAfterConsecutiveFrames) {
+    std::vector<uint8_t> box = createScene(20, 30, 60, 60);
+    VisionResult first = process(box);
+    EXPECT_EQ(first.nearObstacleCells, VISION_NEAR_COLUMNS * (VISION_GRID_ROWS - VISION_NEAR_FIRST_ROW));
+    EXPECT_FALSE(first.isStopHint); // One frame is not enough
+    EXPECT_TRUE(process(box).isStopHint);
+    EXPECT_TRUE(process(box).isStopHint);
+
+    VisionResult cleared = process(createScene(0, 0, 0, 0));
+    EXPECT_EQ(cleared.obstacleMap, 0u);
+    EXPECT_FALSE(cleared.isStopHint);
+
+    // An obstacle at the side of the view does not stop the drone
+    std::vector<uint8_t> side = createScene(0, 30, 20, 60);
+    process(side);
+    EXPECT_FALSE(process(side).isStopHint);
+
+    pipeline.reset();
+    EXPECT_FALSE(process(box).isStopHint);
+    EXPECT_EQ(process(box).motionMap, 0u);
+}
+
+TEST_F(VisionPipelineHostTest, FlowOfAForwardMove) {
+    EXPECT_EQ(process(renderFloor(0, 0, 0)).flowBlocks, 0u); // No previous frame
+    VisionResult result = process(renderFloor(0, 25, 0));   // 250 mm/s
+    EXPECT_GE(result.flowBlocks, 3u);
+    EXPECT_NEAR(result.forwardMmPerS, 250, 40);
+    EXPECT_NEAR(result.yawRateDeciDegPerS, 0, 30);
+
+    result = process(renderFloor(0, 10, 0));                // Backward, 150 mm/s
+    EXPECT_GE(result.flowBlocks, 3u);
+    EXPECT_NEAR(result.forwardMmPerS, -150, 30);
+}
+
+TEST_F(VisionPipelineHostTest, FlowOfATurn) {
+    process(renderFloor(0, 0, 0));
+    VisionResult right = process(renderFloor(0, 0, 0.05f)); // 0.5 rad/s: 286 decidegrees/s
+    EXPECT_GE(right.flowBlocks, 3u);
+    EXPECT_NEAR(right.yawRateDeciDegPerS, 286, 45);
+    EXPECT_NEAR(right.forwardMmPerS, 0, 30);
+
+    VisionResult left = process(renderFloor(0, 0, 0.02f)); // Back to the left, at 0.3 rad/s
+    EXPECT_GE(left.flowBlocks, 3u);
+    EXPECT_NEAR(left.yawRateDeciDegPerS, -172, 35);
+}
+
+TEST_F(VisionPipelineHostTest, NoFlowWithoutTextureOrInterval) {
+    std::vector<uint8_t> plain = createScene(0, 0, 0, 0);
+    process(plain);
+    EXPECT_EQ(process(plain).flowBlocks, 0u);
+
+    process(renderFloor(0, 0, 0));
+    VisionResult unknown = process(renderFloor(0, 20, 0), 0);
+    EXPECT_EQ(unknown.flowBlocks, 0u);
+    EXPECT_EQ(unknown.forwardMmPerS, 0);
+    EXPECT_EQ(process(renderFloor(0, 40, 0), VISION_FLOW_MAX_INTERVAL_MS * 1000 + 1).flowBlocks, 0u);
+
+    // Too fast: beyond the search range
+    process(renderFloor(0, 0, 0));
+    EXPECT_EQ(process(renderFloor(0, 0, 0.16f)).flowBlocks, 0u); // 10 pixels
+}
+
+// Vision Manager -----------------------------------------------------------------------------------------------
+class VisionManagerHostTest : public testing::Test {
+protected:
+    void SetUp() override {
+        HalHost::reset();
+        CameraManager::init();
+        ModeManager::init();
+        LedManager::init();
+        StorageManager::init();
+        VisionManager::init();
+        ServerManager::getInstance()->startServers();
+        ASSERT_NE(VisionManager::getInstance(), nullptr);
+    }
+
+    void TearDown() override {
+        MotorManager::getInstance()->stopMotorControls();
+        MotorManager::deinit();
+        VisionManager::setEnabled(true);
+        MotorManager::clearStopHint();
+        ServerManager::deinit();
+        VisionManager::deinit();
+        StorageManager::deinit();
+        LedManager::deinit();
+        ModeManager::deinit();
+        CameraManager::deinit();
+    }
+
+    static std::shared_ptr<HttpdHostResponse> get(const char* uri) { return HttpdHost::request(COMMAND_SERVER_PORT, HTTP_GET, uri); }
+
+    static bool waitFor(bool (*condition)()) {
+        for (uint32_t waitedMs = 0; !condition(); waitedMs++) {
+            if (waitedMs >= VISION_TIMEOUT_MS) { return false; }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    static bool waitForMotorLoops() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(3 * MOTOR_CONTROL_PERIOD_MS));
+        return true;
+    }
+};
+
+TEST_F(VisionManagerHostTest, IdleWithoutMotorControls) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(3 * VISION_PERIOD_MS));
+    EXPECT_EQ(HalHost::getCameraFrameCount(), 0u);
+    EXPECT_EQ(HalHost::getJpegDecodeCount(), 0u);
+    EXPECT_EQ(VisionManager::getStats().frames, 0u);
+}
+
+TEST_F(VisionManagerHostTest, ObstacleAheadHoldsForwardMoves) {
+    HalHost::setCameraThumbnail(createScene(20, 30, 60, 60));
+    MotorManager* motorManager = MotorManager::getInstance();
+    motorManager->startMotorControls();
+    ASSERT_TRUE(waitFor([] { return VisionManager::getStats().isStopHint; }));
+    EXPECT_TRUE(MotorManager::isStopHinted());
+    EXPECT_GE(HalHost::getJpegDecodeCount(), 2u);
+
+    motorManager->setControlData(0, 60, 0, 0);
+    waitForMotorLoops();
+    EXPECT_EQ(HalHost::getPwmDuty(MOTOR_1_CW), uint32_t(MOTOR_OFF));
+    EXPECT_EQ(HalHost::getPwmDuty(MOTOR_2_CW), uint32_t(MOTOR_OFF));
+    EXPECT_GT(MotorManager::getStopHintBlocks(), 0u);
+    motorManager->setControlData(0, -60, 0, 0);
+    waitForMotorLoops();
+    EXPECT_GT(HalHost::getPwmDuty(MOTOR_1_CCW), uint32_t(MOTOR_OFF)); // Backing away is allowed
+    EXPECT_GT(HalHost::getPwmDuty(MOTOR_2_CCW), uint32_t(MOTOR_OFF));
+
+    std::shared_ptr<HttpdHostResponse> response = get("/vis");
+    ASSERT_EQ(response->getStatus(), 200);
+    EXPECT_NE(response->getBody().find("\"stopHint\":true"), std::string::npos);
+    EXPECT_NE(response->getBody().find("\"nearCells\":8"), std::string::npos);
+
+    // Disabled: the hint is cleared at once
+    response = get("/vis?E=0");
+    ASSERT_EQ(response->getStatus(), 200);
+    EXPECT_NE(response->getBody().find("\"enabled\":false"), std::string::npos);
+    EXPECT_FALSE(MotorManager::isStopHinted());
+    motorManager->setControlData(0, 60, 0, 0);
+    waitForMotorLoops();
+    EXPECT_GT(HalHost::getPwmDuty(MOTOR_1_CW), uint32_t(MOTOR_OFF));
+}
+
+TEST_F(VisionManagerHostTest, ClearFloorDoesNotStop) {
+    HalHost::setCameraThumbnail(createScene(0, 0, 0, 0));
+    MotorManager::getInstance()->startMotorControls();
+    ASSERT_TRUE(waitFor([] { return VisionManager::getStats().frames >= 3; }));
+    VisionStats stats = VisionManager::getStats();
+    EXPECT_FALSE(stats.isStopHint);
+    EXPECT_EQ(stats.obstacleMap, 0u);
+    EXPECT_EQ(stats.stopHints, 0u);
+    EXPECT_EQ(stats.failures, 0u);
+    EXPECT_FALSE(MotorManager::isStopHinted());
+}
+
+TEST_F(VisionManagerHostTest, PausedWhileTheVideoServerIsStopped) {
+    MotorManager::getInstance()->startMotorControls();
+    ASSERT_TRUE(waitFor([] { return VisionManager::getStats().frames >= 1; }));
+    ServerManager* serverManager = ServerManager::getInstance();
+    serverManager->stopVideoServer(); // Frees the snapshot cache
+    uint32_t frames = VisionManager::getStats().frames;
+    uint32_t decodes = HalHost::getJpegDecodeCount();
+    std::this_thread::sleep_for(std::chrono::milliseconds(3 * VISION_PERIOD_MS));
+    EXPECT_EQ(VisionManager::getStats().frames, frames);
+    EXPECT_EQ(HalHost::getJpegDecodeCount(), decodes);
+
+    serverManager->startVideoServer();
+    EXPECT_TRUE(waitFor([] { return VisionManager::getStats().frames >= 3; }));
+}
+
+TEST_F(VisionManagerHostTest, InvalidQueryIsRejected) {
+    EXPECT_EQ(get("/vis?E=2")->getStatus(), 400);
+    EXPECT_EQ(get("/vis?E=x")->getStatus(), 400);
+    EXPECT_TRUE(VisionManager::isEnabled());
+    std::shared_ptr<HttpdHostResponse> response = get("/sst");
+    ASSERT_EQ(response->getStatus(), 200);
+    EXPECT_NE(response->getBody().find("vision enabled 1"), std::string::npos);
+}
@@ -0,0 +1,104 @@
+/*
+ * File: WiFiModulManagerHostTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+/*
+    Host build: the Wi-Fi state machine driven by fake station events (HalHost::emitWiFiEvent). The device suite
+    (src/UnitTests/WiFiModulManagerUnitTest.cpp) needs a real access point, so it is interactive.
+*/
+
+#include "HalHost.h"
+#include "LedManager.h"
+#include "WiFiModulManager.h"
+
+// GoogleTest
+#include <gtest/gtest.h>
+
+#define WIFI_CONTROL_TIMEOUT_MS     8000    // The control task checks the status every 2 s
+
+class WiFiModulManagerHostTest : public testing::Test {
+protected:
+    WiFiModulManager* wifiModulManager = nullptr;
+
+    void SetUp() override {
+        HalHost::reset();
+        LedManager::init();
+        wifiModulManager = WiFiModulManager::getInstance();
+        wifiModulManager->setSSID("host-ap");
+        wifiModulManager->setPassword("host-password");
+    }
+
+    void TearDown() override {
+        wifiModulManager->stopWiFiControls();
+        WiFiModulManager::deinit();
+        LedManager::deinit();
+    }
+
+    /**
+     * @brief Poll a condition (the control task runs in its own thread).
+     */
+    template <typename Condition>
+    static bool waitFor(Condition condition) {
+        int64_t endUs = Hal::Timer::getTimeUs() + int64_t(WIFI_CONTROL_TIMEOUT_MS) * 1000;
+        while (!condition()) {
+            if (Hal::Timer::getTimeUs() > endUs) { return false; }
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        return true;
+    }
+};
+
+TEST_F(WiFiModulManagerHostTest, StationEvents) {
+    wifiModulManager->setNetworkStatus(TRYING_TO_CONNECT);
+    HalHost::emitWiFiEvent(HalWiFiEvent::STA_DISCONNECTED);
+    EXPECT_EQ(wifiModulManager->getNetworkStatus(), TRYING_TO_CONNECT); // A failed attempt keeps the status
+
+    HalHost::emitWiFiEvent(HalWiFiEvent::STA_CONNECTED);
+    EXPECT_EQ(wifiModulManager->getNetworkStatus(), CONNECTED);
+    EXPECT_TRUE(wifiModulManager->isGatewayInfosEmpty());
+
+    HalHost::emitWiFiEvent(HalWiFiEvent::STA_GOT_IP, "172.20.10.5", "172.20.10.1", "255.255.255.240");
+    EXPECT_EQ(wifiModulManager->getGatewayIP(), "172.20.10.1");
+    EXPECT_EQ(wifiModulManager->getSubnetMask(), "255.255.255.240");
+
+    HalHost::emitWiFiEvent(HalWiFiEvent::STA_DISCONNECTED);
+    EXPECT_EQ(wifiModulManager->getNetworkStatus(), DISCONNECTED);
+}
+
+TEST_F(WiFiModulManagerHostTest, ConnectStartsStation) {
+    wifiModulManager->connectToWiFi();
+    EXPECT_TRUE(HalHost::isWiFiStarted());
+    EXPECT_TRUE(HalHost::isWiFiConnectRequested());
+    EXPECT_EQ(HalHost::getWiFiSsid(), "host-ap");
+    EXPECT_TRUE(HalHost::getWiFiStaticIp().empty());
+}
+
+/*
+    The full flow of the control task: connect with DHCP, take the gateway, reconnect with the static IP,
+    then play the connected animation.
+*/
+TEST_F(WiFiModulManagerHostTest, ControlTaskReconnectsWithStaticIp) {
+    wifiModulManager->startWiFiControls();
+    ASSERT_TRUE(waitFor([] { return HalHost::isWiFiConnectRequested(); }));
+    EXPECT_EQ(LedManager::getInstance()->getCurrentAnimation(), AnimationType::WIFI_CONNECTING);
+
+    HalHost::emitWiFiEvent(HalWiFiEvent::STA_CONNECTED);
+    HalHost::emitWiFiEvent(HalWiFiEvent::STA_GOT_IP, "172.20.10.5", "172.20.10.1", "255.255.255.240");
+    ASSERT_TRUE(waitFor([] { return HalHost::getWiFiStaticIp() == "172.20.10.2"; }));
+
+    HalHost::emitWiFiEvent(HalWiFiEvent::STA_CONNECTED);
+    EXPECT_TRUE(waitFor([] { return LedManager::getInstance()->getCurrentAnimation() == AnimationType::WIFI_CONNECTED; }));
+
+    wifiModulManager->stopWiFiControls();
+    EXPECT_FALSE(HalHost::isWiFiStarted());
+    EXPECT_EQ(wifiModulManager->getNetworkStatus(), DISCONNECTED);
+}
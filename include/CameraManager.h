@@ -14,45 +14,102 @@
 #pragma once
 
 #include "DebugAndVersionControl.h"
+#include "Hal.h"
+
+// C++
+#include <atomic>
 
 // C
 extern "C" {
-#include "esp_camera.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 }
 
 // Camera GPIO pins
-#define CAMERA_PWDN             GPIO_NUM_32
-#define CAMERA_RESET            GPIO_NUM_NC
-#define CAMERA_XCLK             GPIO_NUM_0
-#define CAMERA_SIOD             GPIO_NUM_26
-#define CAMERA_SIOC             GPIO_NUM_27
-
-#define CAMERA_Y9               GPIO_NUM_35
-#define CAMERA_Y8               GPIO_NUM_34
-#define CAMERA_Y7               GPIO_NUM_39
-#define CAMERA_Y6               GPIO_NUM_36
-#define CAMERA_Y5               GPIO_NUM_21
-#define CAMERA_Y4               GPIO_NUM_19
-#define CAMERA_Y3               GPIO_NUM_18
-#define CAMERA_Y2               GPIO_NUM_5
-
-#define CAMERA_VSYNC            GPIO_NUM_25
-#define CAMERA_HREF             GPIO_NUM_23
-#define CAMERA_PCLK             GPIO_NUM_22
+#define CAMERA_PWDN             32
+#define CAMERA_RESET            HAL_GPIO_NC
+#define CAMERA_XCLK             0
+#define CAMERA_SIOD             26
+#define CAMERA_SIOC             27
+
+#define CAMERA_Y9               35
+#define CAMERA_Y8               34
+#define CAMERA_Y7               39
+#define CAMERA_Y6               36
+#define CAMERA_Y5               21
+#define CAMERA_Y4               19
+#define CAMERA_Y3               18
+#define CAMERA_Y2               5
+
+#define CAMERA_VSYNC            25
+#define CAMERA_HREF             23
+#define CAMERA_PCLK             22
 
 // Camera configuration
 #define CAMERA_XCLK_FREQ_HZ     20000000
-#define CAMERA_TIMER            LEDC_TIMER_0
-#define CAMERA_CHANNEL          LEDC_CHANNEL_0
+#define CAMERA_TIMER            0   // PWM timer of the XCLK
+#define CAMERA_CHANNEL          0   // PWM channel of the XCLK
 
-#define CAMERA_PIXEL_FORMAT     PIXFORMAT_JPEG
+#define CAMERA_PIXEL_FORMAT     HAL_PIXFORMAT_JPEG
 
-#define CAMERA_FRAMESIZE        FRAMESIZE_VGA
+#define CAMERA_FRAMESIZE        HAL_FRAMESIZE_VGA
+#define CAMERA_FB_FRAMESIZE     CAMERA_FRAMESIZE    // The frame buffers fit this size (HAL_FRAMESIZE_UXGA: the photos switch live from the start, 3 x 384 kB of PSRAM)
 #define CAMERA_JPEG_QUALITY     12
-#define CAMERA_FB_COUNT         2
-#define CAMERA_FB_LOCATION      CAMERA_FB_IN_PSRAM
+#define CAMERA_FB_IN_PSRAM      true
 
-#define CAMERA_GRAB_MODE        CAMERA_GRAB_WHEN_EMPTY
+/*
+    Low latency capture: the driver always hands out the latest frame, with one buffer being sent, one being captured
+    and one ready, so a sent frame is less than a frame period old. Waiting for an empty buffer (2 buffers) keeps the
+    ready frame while a long send finishes, more than a frame period on a slow link, and the sender waits for the
+    sensor on a fast one (see host/test/CaptureLatencyHostTest.cpp).
+*/
+#define CAMERA_LOW_LATENCY      true
+
+#if CAMERA_LOW_LATENCY
+#define CAMERA_FB_COUNT         3
+#define CAMERA_GRAB_LATEST      true    // Drop the older frames
+#else
+#define CAMERA_FB_COUNT         2
+#define CAMERA_GRAB_LATEST      false   // Wait for an empty frame buffer
+#endif
+
+#define CAMERA_POWER_UP_DELAY_MS 10 // The sensor needs a few frames of XCLK after PWDN is released
+#define CAMERA_STALE_FRAMES_MAX 3   // Frames of the old size after a frame size switch (captured before it, in the buffers)
+
+// Sensor settings (the macros above are the defaults)
+#define CAMERA_SENSOR_WIDTH     1600    // OV2640, full sensor (UXGA) coordinates of the window
+#define CAMERA_SENSOR_HEIGHT    1200
+#define CAMERA_JPEG_QUALITY_MAX 63
+#define CAMERA_FB_COUNT_MAX     4
+#define CAMERA_GAIN_MAX         30
+#define CAMERA_EXPOSURE_MAX     1200
+#define CAMERA_XCLK_FREQ_MIN_HZ 8000000
+#define CAMERA_XCLK_FREQ_MAX_HZ 20000000
+
+
+struct CameraSettings {
+    HalFrameSize frameSize;
+    uint8_t jpegQuality;            // 0-63, lower is better
+    uint8_t frameBufferCount;
+    uint32_t xclkFrequencyHz;
+    bool isGrabLatest;              // Low latency capture (CAMERA_LOW_LATENCY)
+    bool isAutoGain;
+    uint8_t gain;                   // 0-CAMERA_GAIN_MAX, used without automatic gain
+    bool isAutoExposure;
+    uint16_t exposure;              // 0-CAMERA_EXPOSURE_MAX, used without automatic exposure
+    HalCameraWindow window;         // Zero width: the full sensor
+};
+
+enum class CameraSwitchType : uint8_t {
+    NONE,                           // Nothing changed
+    LIVE,                           // Sensor registers only, the stream keeps running
+    REALLOCATED                     // Driver deinit and init (new frame buffers), the stream has to be stopped
+};
+
+struct CameraSwitch {
+    CameraSwitchType type;
+    uint32_t durationUs;            // From the first register write (or the deinit) to the last one
+};
 
 
 class CameraManager {
@@ -62,7 +119,97 @@ private:
 
 // Camera configuration -------------------------------------------------
 private:
-    camera_config_t cameraConfig;
+    HalCameraConfig cameraConfig;
+
+// Camera power ---------------------------------------------------------
+private:
+    bool isPoweredDown;
+
+public:
+    /**
+     * @brief Put the sensor into standby with the PWDN pin. The driver and the frame buffers stay allocated,
+     * so powerUp() is much faster than a new init (no sensor probe, no frame buffer allocation).
+     *
+     * @note Do not get frames while the sensor is powered down (the video server has to be stopped first).
+     */
+    void powerDown();
+
+    /**
+     * @brief Wake the sensor up from standby (released PWDN pin).
+     */
+    void powerUp();
+
+    bool isCameraPoweredDown() const { return isPoweredDown; }
+
+// Sensor settings ------------------------------------------------------
+private:
+    CameraSettings settings;
+    CameraSwitch lastSwitch;
+
+    esp_err_t applySensorSettings(const CameraSettings& newSettings);
+
+    esp_err_t reallocate(const CameraSettings& newSettings, HalFrameSize bufferFrameSize);
+
+public:
+    CameraSettings getSettings() const { return settings; }
+
+    CameraSwitch getLastSwitch() const { return lastSwitch; }
+
+    /**
+     * @brief Check the ranges, and the window against the sensor and the frame size (it can only be scaled down).
+     */
+    static bool isValid(const CameraSettings& settings);
+
+    /**
+     * @brief The settings need new frame buffers: an other frame buffer count, grab mode or XCLK, or a frame size bigger
+     * than the one the buffers were allocated for. Everything else is a live register write.
+     */
+    bool requiresReallocation(const CameraSettings& newSettings) const;
+
+    /**
+     * @brief Apply the changed settings, live if possible (getLastSwitch() tells how and how long it took).
+     *
+     * @param isReallocationAllowed The caller stopped the stream: nobody holds a frame buffer.
+     * @return esp_err_t ESP_ERR_INVALID_ARG for invalid settings, ESP_ERR_INVALID_STATE if the sensor is powered down
+     * or a reallocation is needed and not allowed (nothing is changed then).
+     */
+    esp_err_t applySettings(const CameraSettings& newSettings, bool isReallocationAllowed);
+
+    /**
+     * @brief The frame buffers fit a frame of this size, it can be switched to live.
+     */
+    bool isFrameSizeAllocated(HalFrameSize frameSize) const;
+
+    /**
+     * @brief Reallocate the frame buffers for a bigger frame size, the sensor keeps its settings. The buffers keep the
+     * biggest frame size of the reallocations from then on.
+     *
+     * @note The caller stopped the stream, like for applySettings() with a reallocation.
+     * @return esp_err_t ESP_ERR_INVALID_STATE if the sensor is powered down.
+     */
+    esp_err_t reserveFrameSize(HalFrameSize frameSize);
+
+// Stream frames --------------------------------------------------------
+private:
+    SemaphoreHandle_t streamMutex;  // Held by the stream captures for a getFrame(), and by a photo for its whole switch
+    std::atomic<uint32_t> streamResolution{0}; // Width << 16 | height the stream waits for after a switch, 0: any
+
+public:
+    /**
+     * @brief Hal::Camera::getFrame() of the streams (MJPEG, RTP, snapshots): waits while a photo holds the sensor, and
+     * drops the frames of the photo size that were still in the buffers after it (CAMERA_STALE_FRAMES_MAX at most).
+     */
+    static bool getStreamFrame(HalCameraFrame& frame);
+
+    /**
+     * @brief The streams wait in getStreamFrame() until releaseStream(); the frames they hold are not affected.
+     */
+    void holdStream();
+
+    /**
+     * @brief Let the streams capture again, the frames until one of the current frame size are dropped.
+     */
+    void releaseStream();
 
 // Deinit camera --------------------------------------------------------
 public:
@@ -0,0 +1,131 @@
+/*
+ * File: ClockSync.h
+ * Project: drone_r6_fw
+ * File Created: Tuesday, 11th March 2025 6:02:17 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Tuesday, 11th March 2025 6:02:17 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+
+// C
+extern "C" {
+#include <stdint.h>
+}
+
+// Clock sync configuration
+#define CLOCK_SYNC_WINDOW               32      // Samples of the estimate (the operator pings about once a second)
+#define CLOCK_SYNC_PENDING              4       // Exchanges waiting for their t4, one per command server socket
+#define CLOCK_SYNC_MAX_RTT_MS           1000    // A slower exchange says nothing about the offset, it is dropped
+#define CLOCK_SYNC_HISTOGRAM_BINS       8
+
+
+// Clock Sync ---------------------------------------------------------------------------------------------------
+struct ClockSyncSample {
+    int64_t offsetUs;               // Drone clock - operator clock
+    uint32_t rttUs;                 // Without the time of the drone between t2 and t3
+};
+
+struct ClockSyncStats {
+    uint32_t exchanges;             // Stamped (t2 and t3)
+    uint32_t samples;               // Completed (the operator sent its t4 back)
+    uint32_t rejected;              // Unknown t1, a negative or a too long round trip
+    int64_t offsetUs;               // Of the fastest exchange in the window
+    uint32_t rttUs;                 // Fastest in the window (the offset is within +- half of it), 0: no sample
+    uint32_t lastRttUs;
+    uint8_t windowCount;
+    uint8_t rttHistogram[CLOCK_SYNC_HISTOGRAM_BINS];      // Round trips of the window (ClockSync::histogramBin())
+    uint8_t offsetHistogram[CLOCK_SYNC_HISTOGRAM_BINS];   // Distance of the window offsets from the estimate (same bins)
+};
+
+/*
+    NTP-style four-timestamp exchange between the operator and the drone (/syn of the command server): the operator
+    sends its clock (t1), the drone stamps the arrival (t2) and the response (t3) with its own clock, the operator
+    stamps the response it got (t4) and sends it back with t1 in its next ping. Then
+        offset = ((t2 - t1) + (t3 - t4)) / 2,   rtt = (t4 - t1) - (t3 - t2).
+    The offset is right if the two ways took the same time, otherwise it is off by half of their difference (at most
+    rtt / 2). The Wi-Fi queues one way at a time (power save, retransmits), so the estimate is the offset of the fastest
+    exchange of the last CLOCK_SYNC_WINDOW samples: the one with the least queueing, and the tightest bound.
+    One operator clock at a time (clear() when it changes). No allocation, no RTOS calls, the caller locks it.
+*/
+class ClockSync {
+public:
+    ClockSync();
+
+    /**
+     * @brief The four timestamps of one exchange into a sample.
+     *
+     * @return bool false if the round trip is negative (t4 before t1, or the drone time is longer) or longer than
+     * CLOCK_SYNC_MAX_RTT_MS.
+     */
+    static bool measure(int64_t t1, int64_t t2, int64_t t3, int64_t t4, ClockSyncSample& sample);
+
+    /**
+     * @brief Keep the timestamps of a stamped exchange until the operator sends its t4 (the oldest one is replaced).
+     *
+     * @param t1 Operator clock, the ping was sent.
+     * @param t2 Drone clock, the ping arrived.
+     * @param t3 Drone clock, the response was sent.
+     */
+    void stamp(int64_t t1, int64_t t2, int64_t t3);
+
+    /**
+     * @brief Complete a stamped exchange with the t4 of the operator, and add it to the window.
+     *
+     * @return bool false if t1 is not stamped (or already completed) or the round trip is invalid.
+     */
+    bool complete(int64_t t1, int64_t t4);
+
+    /**
+     * @brief Add a measured sample to the window (complete() does it), the oldest one drops out.
+     */
+    void addSample(const ClockSyncSample& sample);
+
+    /**
+     * @brief Drop the samples and the stamped exchanges (a new operator clock), the counters are kept.
+     */
+    void clear();
+
+    bool isSynced() const { return windowCount > 0; }
+
+    /**
+     * @brief An operator timestamp on the drone clock (unchanged before the first sample).
+     */
+    int64_t toDroneUs(int64_t operatorUs) const { return operatorUs + offsetUs; }
+
+    ClockSyncStats getStats() const;
+
+    /**
+     * @brief The bin of a time in the histograms: below 1, 2, 5, 10, 20, 50, 100 ms, then the rest.
+     */
+    static uint8_t histogramBin(uint32_t timeUs);
+
+private:
+    struct Exchange {
+        int64_t t1;
+        int64_t t2;
+        int64_t t3;
+        bool isStamped;
+    };
+
+    Exchange exchanges[CLOCK_SYNC_PENDING];
+    uint8_t nextExchange;           // Replaced by the next stamp (round robin)
+    ClockSyncSample window[CLOCK_SYNC_WINDOW];
+    uint8_t windowNext;
+    uint8_t windowCount;
+    int64_t offsetUs;               // Estimate, updated by every sample
+    uint32_t rttUs;                 // Of the estimate
+    uint32_t lastRttUs;
+    uint32_t exchangeCount;
+    uint32_t sampleCount;
+    uint32_t rejectedCount;
+
+    void estimate();
+};
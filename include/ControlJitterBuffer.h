@@ -0,0 +1,124 @@
+/*
+ * File: ControlJitterBuffer.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+#include "MotorManager.h"
+
+// C
+extern "C" {
+#include <stdint.h>
+}
+
+// Jitter buffer configuration: the controller app sends its stick at ~50 Hz (/mov), the motor loop runs every
+// MOTOR_CONTROL_PERIOD_MS
+#define CONTROL_JITTER_CAPACITY             32      // Queued commands: the maximum depth and a burst after a stall at 50 Hz
+#define CONTROL_JITTER_DEFAULT_DEPTH_MS     40      // Playout delay: a longer one rides out longer gaps, but lags more
+#define CONTROL_JITTER_MAX_DEPTH_MS         200
+#define CONTROL_JITTER_DEFAULT_INTERVAL_MS  20      // Of the controller, until it is measured
+#define CONTROL_JITTER_MIN_INTERVAL_MS      5
+#define CONTROL_JITTER_MAX_INTERVAL_MS      100
+#define CONTROL_JITTER_PAUSE_MS             250     // A longer gap between two commands is a pause of the controller, not jitter
+#define CONTROL_JITTER_EXTRAPOLATE_MS       100     // After the newest command: the trend of the last two, then it is held
+#define CONTROL_JITTER_MAX_TREND            20      // Extrapolated at most this far from the newest command (per axis)
+#define CONTROL_FAILSAFE_MS                 500     // No command for this long: stop
+
+
+// Control Jitter Buffer ----------------------------------------------------------------------------------------
+enum class ControlJitterOutput : uint8_t {
+    NONE,           // Nothing to play (no command yet, still buffering, after a clear or the failsafe)
+    COMMAND,        // A command of the controller (a new one or the held one)
+    EXTRAPOLATED,   // A gap: the trend of the last two commands
+    FAILSAFE,       // A stop, the buffer is cleared
+};
+
+struct ControlJitterStats {
+    uint32_t commands;              // Pushed
+    uint32_t backdated;             // Came in a burst, moved back to their send time
+    uint32_t overflows;             // The oldest queued command was dropped
+    uint32_t skipped;               // Played over (more than one command in a motor loop period)
+    uint32_t extrapolations;        // Motor loops in a gap
+    uint32_t failsafes;
+    uint32_t intervalUs;            // Measured period of the controller
+    uint32_t averageDelayUs;        // From the arrival to the motor loop that applied it
+    uint32_t maxDelayUs;
+    uint16_t depthMs;
+    uint8_t queued;
+};
+
+/*
+    Between the command server and the motor loop: the commands of the controller are stamped with their arrival time
+    and played a fixed depth later, so the motor loop gets one command after the other instead of the bursts and the
+    gaps of the Wi-Fi. The commands of a burst are moved back to the send times they would have had (the measured
+    period of the controller, never before the play position), then the depth hides a gap up to its own length.
+    A longer gap is bridged by the trend of the last two commands (never over a stop) for CONTROL_JITTER_EXTRAPOLATE_MS,
+    then that is held, CONTROL_FAILSAFE_MS after the newest arrival it stops.
+    Depth 0 plays the newest command at once (the motor loop without a buffer), but the gaps and the failsafe are the same.
+    No allocation, no RTOS calls, the caller locks it (the host tests run it on recorded arrival times).
+*/
+class ControlJitterBuffer {
+public:
+    ControlJitterBuffer();
+
+    /**
+     * @brief Queue a command of the controller.
+     *
+     * @param arrivalUs Hal::Timer::getTimeUs() of the arrival, not older than the previous one.
+     */
+    void push(const ControlData& command, int64_t arrivalUs);
+
+    /**
+     * @brief The command of a motor loop.
+     *
+     * @param command Set unless NONE is returned (then the motor loop keeps its last command).
+     */
+    ControlJitterOutput play(int64_t nowUs, ControlData& command);
+
+    /**
+     * @brief Drop the queued and the played commands (a direct command took over), the stats and the depth are kept.
+     */
+    void clear();
+
+    void setDepthMs(uint16_t depthMs);
+
+    uint16_t getDepthMs() const { return depthMs; }
+
+    ControlJitterStats getStats() const;
+
+private:
+    struct Entry {
+        ControlData command;
+        int64_t arrivalUs;
+        int64_t playUs;             // Arrival, or the send time of a burst, the depth is added when it is played
+    };
+
+    Entry entries[CONTROL_JITTER_CAPACITY]; // Queued, oldest first from first
+    uint8_t first;
+    uint8_t count;
+    Entry newest;                   // Played last
+    Entry previous;                 // Played before the newest, the trend of a gap
+    bool isNewestSet;
+    bool isPreviousSet;
+    int64_t playPositionUs;         // Of the last motor loop (minus the depth)
+    int64_t lastArrivalUs;
+    uint16_t depthMs;
+    ControlJitterStats stats;
+
+    Entry& entryAt(uint8_t index) { return entries[(first + index) % CONTROL_JITTER_CAPACITY]; }
+
+    /**
+     * @brief The newest command continued along the trend of the previous one, elapsedUs after the newest.
+     */
+    ControlData extrapolate(int64_t elapsedUs) const;
+};
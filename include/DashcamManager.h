@@ -0,0 +1,162 @@
+/*
+ * File: DashcamManager.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+#include "DashcamRing.h"
+
+// C++
+#include <atomic>
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+}
+
+// Dashcam task configuration
+#define DASHCAM_STACK_SIZE              3072
+#define DASHCAM_PRIORITY                2       // Like the vision stage, below the streams and the motor loop
+#define DASHCAM_CORE                    0
+#define DASHCAM_PERIOD_MS               200     // 5 frames per second
+#define DASHCAM_FRAME_MAX_AGE_MS        150     // A cached frame up to this old is recorded (of the stream or the vision
+                                                // stage), otherwise a new capture
+#define DASHCAM_STOP_TIMEOUT_MS         1000
+
+// Download
+#define DASHCAM_PART_BOUNDARY           "dashcamframe"
+#define DASHCAM_CHUNK_SIZE              512     // Headers and index pieces, on the stack of the server task
+
+
+// Dashcam Stats ------------------------------------------------------------------------------------------------
+struct DashcamStats {
+    bool isEnabled;
+    bool isRecording;               // Enabled, the motor controls run and the video server is up
+    uint32_t frames;                // In the ring
+    uint32_t bytes;
+    uint16_t slabsUsed;
+    uint32_t recordedFrames;        // Since boot
+    uint32_t evictedFrames;
+    uint32_t droppedFrames;
+    uint32_t failures;              // No frame from the snapshot cache
+    uint32_t downloads;
+    int64_t oldestTimestampUs;      // 0: empty
+    int64_t newestTimestampUs;
+};
+
+enum class DashcamFormat {
+    AVI,                            // RIFF AVI with MJPEG video, for the players and the editors
+    MJPEG,                          // multipart/x-mixed-replace like /str, with the timestamp and the control data per part
+    JSON                            // The index: timestamps, sizes and control data
+};
+
+
+// Dashcam Manager ----------------------------------------------------------------------------------------------
+/*
+    A "dashcam": while the motor controls run, a low priority task copies a frame of the snapshot cache (a frame of a
+    running stream or of the vision stage, or its own capture) with the control data of the motors into the
+    DashcamRing every DASHCAM_PERIOD_MS. When the link comes back, the last seconds are downloaded from the video
+    server (/dcm): the downloaded frames are pinned, the recording goes on into the other slabs.
+    Initialized in main.cpp, the recording survives the restarts of the video server (it pauses while the snapshot
+    cache is not there, like the vision stage).
+*/
+class DashcamManager {
+// Init dashcam manager -------------------------------------------------
+private:
+    DashcamManager();
+
+// Recording ------------------------------------------------------------
+private:
+    SemaphoreHandle_t ringMutex;    // The ring and its index, not held while the bytes of a pinned frame are sent
+    DashcamRing ring;
+    int64_t lastTimestampUs;        // Only used by the dashcam task
+    std::atomic<uint32_t> failures{0};
+    std::atomic<uint32_t> downloads{0};
+    static inline std::atomic<bool> isRecordingEnabled{true};  // Kept over a restart
+    static inline std::atomic<bool> isPaused{false};
+    static inline std::atomic<bool> isProcessing{false};      // Set by the task before it checks isPaused
+
+public:
+    /**
+     * @brief Copy a frame into the ring (the task records the frames of the snapshot cache).
+     *
+     * @return false If the ring dropped it.
+     */
+    bool record(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height, int64_t timestampUs,
+                const ControlData& control);
+
+    static void setEnabled(bool isEnabled) { isRecordingEnabled.store(isEnabled, std::memory_order_relaxed); }
+
+    static bool isEnabled() { return isRecordingEnabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Wait for the running frame and take no more until resume() (the snapshot cache is freed).
+     */
+    static void pause();
+
+    static void resume();
+
+    DashcamStats getStats();
+
+// Download -------------------------------------------------------------
+public:
+    typedef bool (*Output)(const char* data, size_t length, void* context);
+
+    /**
+     * @brief Write the frames captured in [fromUs, toUs) in a format, piece by piece. The frames are pinned for the
+     * time of the export, the ring lock is only held to read the index.
+     *
+     * @param output Called with every piece, false stops the export.
+     * @return esp_err_t ESP_ERR_NOT_FOUND if there is no frame in the range, ESP_FAIL if the output failed.
+     */
+    esp_err_t exportRecording(DashcamFormat format, int64_t fromUs, int64_t toUs, Output output, void* context);
+
+    static const char* getContentType(DashcamFormat format);
+
+// Dashcam task ---------------------------------------------------------
+private:
+    std::atomic<bool> isTaskEnabled;            // Cleared to end the task
+    std::atomic<bool> isTaskRunning;            // Cleared by the task when it ended
+    TaskHandle_t taskHandle;                    // Notified to end the task without waiting for the period
+
+    static void taskDashcam(void *pvParameters);
+
+    /**
+     * @brief Take a frame of the snapshot cache and record it (a frame that was recorded already is skipped).
+     */
+    void recordFrame();
+
+// Deinit dashcam manager -----------------------------------------------
+public:
+    ~DashcamManager();
+
+// Singleton ------------------------------------------------------------
+private:
+    static DashcamManager* instance;
+
+public:
+    DashcamManager(const DashcamManager& dashcamManager) = delete;
+
+    DashcamManager& operator=(const DashcamManager& dashcamManager) = delete;
+
+    static void init();
+
+    static DashcamManager* getInstance() { return instance; }
+
+    static void deinit();
+};
@@ -0,0 +1,159 @@
+/*
+ * File: DashcamRing.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+#include "MotorManager.h"
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+}
+
+// Ring configuration: a VGA frame of the stream quality is 10 - 25 kB, 24 slabs keep about 15 s at DASHCAM_PERIOD_MS
+#define DASHCAM_SLAB_SIZE               (64 * 1024)
+#define DASHCAM_SLAB_COUNT              24      // 1.5 MB of PSRAM
+#define DASHCAM_SLAB_MAX_FRAMES         16      // Index entries of a slab (small frame sizes)
+
+
+// Dashcam Frame ------------------------------------------------------------------------------------------------
+struct DashcamFrame {
+    const uint8_t* data;            // In its slab, valid while the slab is pinned
+    uint32_t length;
+    uint16_t width;
+    uint16_t height;
+    int64_t timestampUs;            // Capture time (esp_timer)
+    ControlData control;            // The control data of the motors at the capture
+    uint32_t id;                    // Counts up from 1 over the whole ring
+};
+
+/*
+    Frames [firstId, endId) of the ring, their slabs are not reused while the range is pinned.
+*/
+struct DashcamRange {
+    uint32_t firstId;
+    uint32_t endId;
+};
+
+struct DashcamRingStats {
+    uint32_t frames;                // In the ring
+    uint32_t bytes;
+    uint16_t slabsUsed;
+    uint32_t appendedFrames;        // Since the allocation
+    uint32_t evictedFrames;         // With their reused slab
+    uint32_t droppedFrames;         // Larger than a slab, not newer than the last one, or the oldest slab was pinned
+    int64_t oldestTimestampUs;      // 0: empty
+    int64_t newestTimestampUs;
+};
+
+
+// Dashcam Ring -------------------------------------------------------------------------------------------------
+/*
+    The last seconds of JPEG frames in fixed size slabs, allocated once (PSRAM first): a frame is copied behind the
+    previous one in the current slab, a frame that does not fit starts the next slab, and the oldest slab is reused
+    as a whole when the ring is full (no allocation per frame, no fragmentation). Every slab has its own index, the
+    frames are in capture order, so a timestamp is found with two binary searches.
+    Not thread safe: DashcamManager locks it. The bytes of a pinned range never change, they can be read unlocked.
+*/
+class DashcamRing {
+public:
+    DashcamRing(uint16_t slabCount = DASHCAM_SLAB_COUNT, uint32_t slabSize = DASHCAM_SLAB_SIZE);
+
+    ~DashcamRing();
+
+    DashcamRing(const DashcamRing& dashcamRing) = delete;
+
+    DashcamRing& operator=(const DashcamRing& dashcamRing) = delete;
+
+    bool isAllocated() const { return slabs != nullptr; }
+
+    /**
+     * @brief Copy a frame to the end of the ring, reusing the oldest slab if needed.
+     *
+     * @return false If the frame was dropped (see DashcamRingStats::droppedFrames).
+     */
+    bool append(const uint8_t* jpeg, uint32_t length, uint16_t width, uint16_t height, int64_t timestampUs,
+                const ControlData& control);
+
+    /**
+     * @brief The id of the first frame captured at or after timestampUs (getEndId() if there is none).
+     */
+    uint32_t seek(int64_t timestampUs) const;
+
+    /**
+     * @brief A frame of the ring, false if it was evicted or not appended yet.
+     */
+    bool getFrame(uint32_t id, DashcamFrame& frame) const;
+
+    /**
+     * @brief Pin the frames captured in [fromUs, toUs), an empty range if there is none. Every range has to be unpinned.
+     */
+    DashcamRange pin(int64_t fromUs, int64_t toUs);
+
+    void unpin(const DashcamRange& range);
+
+    uint32_t getFirstId() const;
+
+    uint32_t getEndId() const { return nextId; }
+
+    DashcamRingStats getStats() const;
+
+private:
+    struct Entry {
+        uint32_t offset;
+        uint32_t length;
+        int64_t timestampUs;
+        ControlData control;
+        uint16_t width;
+        uint16_t height;
+    };
+
+    struct Slab {
+        uint8_t* data;
+        uint32_t used;              // Bytes
+        uint32_t firstId;           // Of its first frame
+        uint8_t frameCount;
+        uint8_t pins;
+        Entry entries[DASHCAM_SLAB_MAX_FRAMES];
+    };
+
+    Slab* slabs;
+    uint8_t* memory;                // The data of every slab, one block
+    uint16_t slabCount;
+    uint32_t slabSize;
+    uint16_t oldestSlab;
+    uint16_t slabsUsed;             // From the oldest one, the last one is written
+    uint32_t nextId;
+    uint32_t appendedFrames;
+    uint32_t evictedFrames;
+    uint32_t droppedFrames;
+
+    /**
+     * @brief The slab of the logical position (0: the oldest one).
+     */
+    Slab& slabAt(uint16_t position) const { return slabs[(oldestSlab + position) % slabCount]; }
+
+    /**
+     * @brief The position of the slab with the frame id, slabsUsed if there is none.
+     */
+    uint16_t findSlab(uint32_t id) const;
+
+    /**
+     * @brief Start a new slab after the last one.
+     *
+     * @return false If the ring is full and its oldest slab is pinned.
+     */
+    bool startSlab();
+};
@@ -35,6 +35,47 @@
 #define DEBUG_DEINIT_NO_NEED(x)
 #endif
 
+// For Log Manager (deferred logging on the hot paths, see LogManager.h)
+// Log levels (same values as esp_log_level_t)
+#define LOG_LEVEL_NONE          0
+#define LOG_LEVEL_ERROR         1
+#define LOG_LEVEL_WARN          2
+#define LOG_LEVEL_INFO          3
+#define LOG_LEVEL_DEBUG         4
+
+// Compile-time log level per module, the calls above the level are removed
+#ifdef DEBUG_MODE
+#define LOG_LEVEL_CAMERA        LOG_LEVEL_INFO
+#define LOG_LEVEL_LED           LOG_LEVEL_INFO
+#define LOG_LEVEL_MODE          LOG_LEVEL_INFO
+#define LOG_LEVEL_MOTOR         LOG_LEVEL_INFO
+#define LOG_LEVEL_RESOURCE      LOG_LEVEL_INFO
+#define LOG_LEVEL_SERVER        LOG_LEVEL_INFO  // LOG_LEVEL_DEBUG logs every control request
+#define LOG_LEVEL_STORAGE       LOG_LEVEL_INFO
+#define LOG_LEVEL_TELEMETRY     LOG_LEVEL_INFO
+#define LOG_LEVEL_WIFI          LOG_LEVEL_INFO  // LOG_LEVEL_DEBUG logs every Wi-Fi and IP event
+#else
+#define LOG_LEVEL_CAMERA        LOG_LEVEL_ERROR
+#define LOG_LEVEL_LED           LOG_LEVEL_ERROR
+#define LOG_LEVEL_MODE          LOG_LEVEL_ERROR
+#define LOG_LEVEL_MOTOR         LOG_LEVEL_ERROR
+#define LOG_LEVEL_RESOURCE      LOG_LEVEL_WARN  // The alarms
+#define LOG_LEVEL_SERVER        LOG_LEVEL_ERROR
+#define LOG_LEVEL_STORAGE       LOG_LEVEL_ERROR
+#define LOG_LEVEL_TELEMETRY     LOG_LEVEL_ERROR
+#define LOG_LEVEL_WIFI          LOG_LEVEL_ERROR
+#endif
+
+// For Trace Manager (span tracing on the hot paths, see TraceManager.h)
+#ifdef DEBUG_MODE
+#define TRACE_SPANS // Comment to remove the spans (TRACE_SPAN) from the hot paths
+#endif
+
+// For Server Manager (heap allocation check of the control requests, see ServerManager.h)
+#ifdef DEBUG_MODE
+#define SERVER_ALLOCATION_CHECK // Comment to remove the check (it needs CONFIG_HEAP_USE_HOOKS in the sdkconfig)
+#endif
+
 // For Motor Manager
 #define MANUAL_CONTROL // Comment to disable manual control and enable auto control
 
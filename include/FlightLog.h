@@ -0,0 +1,129 @@
+/*
+ * File: FlightLog.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+}
+
+// Flight log block
+#define FLIGHT_LOG_BLOCK_MAGIC          0x5246  // "FR" (little endian)
+#define FLIGHT_LOG_BLOCK_VERSION        1
+#define FLIGHT_LOG_MAX_FIELDS           4
+#define FLIGHT_LOG_RECORD_MAX_SIZE      (1 + 10 + FLIGHT_LOG_MAX_FIELDS * 5)    // Tag, time delta and field varints
+
+
+// Flight Records -----------------------------------------------------------------------------------------------
+enum class FlightRecordType : uint8_t {
+    CONTROL = 1,                    // Accepted control data: X, Y, L, R
+    MOTOR = 2,                      // Motor loop: left duty, right duty, period (us), busy time (us)
+    WIFI = 3                        // Wi-Fi station event: HalWiFiEvent, disconnect reason (0: none)
+};
+
+#define FLIGHT_RECORD_TYPE_COUNT        4       // With the unused 0
+
+struct FlightRecord {
+    FlightRecordType type;
+    int64_t timestampUs;            // esp_timer
+    int32_t fields[FLIGHT_LOG_MAX_FIELDS];  // The fields after the field count of the type are 0
+};
+
+/*
+    A block of the flight log (little endian, packed): the header, then header.recordCount records back to back,
+    header.length is the length of the whole block. Every block is decoded on its own (the deltas start over), so the
+    oldest blocks of the ring can be overwritten. The decoder is tools/flight_decode.py (keep the two in sync, and bump
+    the version on every change).
+
+    Record: a tag byte (type in the low 4 bits, a bit per changed field in the high 4 bits), the time since the previous
+    record of the block (the first one: since baseTimestampUs) as an unsigned LEB128 varint, then the delta of every
+    changed field against the previous record of the same type in the block (starting from 0), zigzag LEB128 varints.
+    A motor loop record with the same duties is 4 - 5 bytes.
+*/
+struct __attribute__((packed)) FlightLogBlockHeader {
+    uint16_t magic;                 // FLIGHT_LOG_BLOCK_MAGIC
+    uint8_t version;                // FLIGHT_LOG_BLOCK_VERSION
+    uint8_t reserved;
+    uint16_t length;
+    uint16_t recordCount;
+    uint32_t sequence;              // Blocks since boot, a gap means overwritten blocks
+    int64_t baseTimestampUs;        // esp_timer at the start of the block
+};
+
+static_assert(sizeof(FlightLogBlockHeader) == 20, "The flight log block layout is shared with tools/flight_decode.py");
+
+
+// Flight Log Encoder -------------------------------------------------------------------------------------------
+/*
+    Writes the records of one block into a buffer, the header is kept up to date after every record (a copy of the
+    buffer is always a complete block). Not thread safe: FlightRecorder locks it.
+*/
+class FlightLogEncoder {
+public:
+    /**
+     * @brief The number of fields of a record type, 0 if the type is unknown.
+     */
+    static uint8_t getFieldCount(FlightRecordType type);
+
+    /**
+     * @brief Start a new block in the buffer.
+     *
+     * @param buffer At least sizeof(FlightLogBlockHeader) + FLIGHT_LOG_RECORD_MAX_SIZE bytes (at most UINT16_MAX).
+     */
+    void start(uint8_t* buffer, size_t size, uint32_t sequence, int64_t timestampUs);
+
+    /**
+     * @brief Encode a record at the end of the block.
+     *
+     * @return esp_err_t ESP_ERR_INVALID_SIZE if it does not fit (start the next block), ESP_ERR_INVALID_ARG if its type
+     * is unknown or it is older than the previous record.
+     */
+    esp_err_t append(const FlightRecord& record);
+
+    bool isStarted() const { return buffer != nullptr; }
+
+    size_t getLength() const { return length; }
+
+private:
+    uint8_t* buffer = nullptr;
+    size_t size = 0;
+    size_t length = 0;
+    int64_t lastTimestampUs = 0;
+    int32_t lastFields[FLIGHT_RECORD_TYPE_COUNT][FLIGHT_LOG_MAX_FIELDS] = {};
+};
+
+
+// Flight Log Decoder -------------------------------------------------------------------------------------------
+/*
+    Decoder of the host tests and tools (the firmware only encodes), the same rules as tools/flight_decode.py.
+*/
+class FlightLogDecoder {
+public:
+    typedef void (*RecordCallback)(const FlightRecord& record, void* context);
+
+    /**
+     * @brief Decode one block.
+     *
+     * @param block The block, at least header.length bytes.
+     * @param header The header of the block (nullptr: not needed).
+     * @return esp_err_t ESP_ERR_INVALID_VERSION if it is not a block of this version, ESP_ERR_INVALID_SIZE if it is
+     * truncated or a record runs over its end, ESP_ERR_INVALID_ARG if a record has an unknown type.
+     */
+    static esp_err_t decodeBlock(const uint8_t* block, size_t length, RecordCallback onRecord, void* context,
+                                 FlightLogBlockHeader* header = nullptr);
+};
@@ -0,0 +1,140 @@
+/*
+ * File: FlightRecorder.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+#include "FlightLog.h"
+#include "Hal.h"
+#include "MotorManager.h"
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+}
+
+// Flight recorder configuration: a motor loop record is ~5 bytes at 50 Hz, a /mov record ~8 bytes, so the ring keeps
+// about 10 minutes of driving
+#define FLIGHT_RECORDER_BLOCK_SIZE      1024    // Also the copy buffer of the download, on the stack of the server task
+#define FLIGHT_RECORDER_BLOCK_COUNT     256     // 256 kB of PSRAM
+
+
+// Flight Recorder Stats ----------------------------------------------------------------------------------------
+struct FlightRecorderStats {
+    uint32_t records;               // Since boot
+    uint32_t rejectedRecords;       // Unknown type (a bug), never because the ring is full
+    uint32_t blocks;                // Started since boot, the ring keeps the last FLIGHT_RECORDER_BLOCK_COUNT
+    uint32_t overwrittenBlocks;
+    uint32_t oldestSequence;        // Of the oldest block in the ring
+    uint32_t bytes;                 // In the ring
+    uint32_t downloads;
+};
+
+
+// Flight Recorder ----------------------------------------------------------------------------------------------
+/*
+    A "black box" of the drive: every accepted control data, the applied duties and the timing of every motor loop,
+    and the Wi-Fi station events are delta encoded (FlightLog.h) into a ring of fixed blocks, allocated once (PSRAM first).
+    When the ring is full, the oldest block is overwritten. The blocks are downloaded from the command server (/flt)
+    and decoded by tools/flight_decode.py.
+    The record functions can be called from any task: the encoder is locked for the encoding of one record (and for the
+    copy of one block by a download), a record is skipped if the recorder is not initialized.
+*/
+class FlightRecorder {
+// Init flight recorder -------------------------------------------------
+private:
+    FlightRecorder();
+
+// Recording ------------------------------------------------------------
+private:
+    SemaphoreHandle_t mutex;        // The encoder, the blocks and the counters
+    uint8_t* blocks;                // FLIGHT_RECORDER_BLOCK_COUNT blocks, one allocation
+    FlightLogEncoder encoder;       // Of the newest block
+    uint32_t blockSequence;         // Started blocks, the newest one is blockSequence - 1
+    uint32_t records;
+    uint32_t rejectedRecords;
+    uint32_t downloads;
+
+    uint8_t* blockOf(uint32_t sequence) const { return blocks + size_t(sequence % FLIGHT_RECORDER_BLOCK_COUNT) * FLIGHT_RECORDER_BLOCK_SIZE; }
+
+    uint32_t getOldestSequence() const {
+        return blockSequence > FLIGHT_RECORDER_BLOCK_COUNT ? blockSequence - FLIGHT_RECORDER_BLOCK_COUNT : 0;
+    }
+
+    /**
+     * @brief Timestamp and encode a record, in a new block if it does not fit the newest one.
+     */
+    void append(FlightRecord& record);
+
+    static void record(FlightRecordType type, int32_t field0, int32_t field1, int32_t field2 = 0, int32_t field3 = 0);
+
+public:
+    static void recordControl(const ControlData& control) {
+        record(FlightRecordType::CONTROL, control.X, control.Y, control.L, control.R);
+    }
+
+    /**
+     * @brief A motor loop. The motor task holds the lock of the recorder here, so it is never deleted from another
+     * task (MotorManager::stopMotorControls() lets it end between two loops).
+     *
+     * @param periodUs Since the start of the previous loop, 0 for the first one.
+     * @param busyUs The time of the direction control.
+     */
+    static void recordMotorLoop(int16_t leftDuty, int16_t rightDuty, uint32_t periodUs, uint32_t busyUs) {
+        record(FlightRecordType::MOTOR, leftDuty, rightDuty, int32_t(periodUs), int32_t(busyUs));
+    }
+
+    static void recordWiFiEvent(HalWiFiEvent event, uint8_t reason) {
+        record(FlightRecordType::WIFI, int32_t(event), reason);
+    }
+
+    FlightRecorderStats getStats();
+
+// Download -------------------------------------------------------------
+public:
+    typedef bool (*Output)(const char* data, size_t length, void* context);
+
+    /**
+     * @brief Write the blocks of the ring from a sequence on (the newest one as far as it is written), one piece each,
+     * oldest first. A block is copied under the lock and sent without it, a block overwritten in the meantime is left out
+     * (a gap of the sequences).
+     *
+     * @param firstSequence The first block to send, an older one than the oldest block of the ring sends every block.
+     * @param output Called with every block, false stops the download.
+     * @return esp_err_t ESP_FAIL if the output failed.
+     */
+    esp_err_t exportLog(uint32_t firstSequence, Output output, void* context);
+
+// Deinit flight recorder -----------------------------------------------
+public:
+    ~FlightRecorder();
+
+// Singleton ------------------------------------------------------------
+private:
+    static FlightRecorder* instance;
+
+public:
+    FlightRecorder(const FlightRecorder& flightRecorder) = delete;
+
+    FlightRecorder& operator=(const FlightRecorder& flightRecorder) = delete;
+
+    static void init();
+
+    static FlightRecorder* getInstance() { return instance; }
+
+    static void deinit();
+};
@@ -0,0 +1,348 @@
+/*
+ * File: Hal.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 6:02:18 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 6:02:18 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+}
+
+/*
+    Hardware abstraction layer: the managers reach the peripherals (PWM, LED strip, NVS, camera, Wi-Fi, power management)
+    and the system timer only through these functions.
+    src/HalEspIdf.cpp implements them with the ESP-IDF drivers, host/HalHost.cpp with fakes for the Linux host build
+    (see host/CMakeLists.txt, the fakes can be inspected and driven with host/HalHost.h).
+    FreeRTOS, esp_log, esp_heap_caps and esp_http_server are not abstracted, the host build provides them (host/include).
+*/
+
+// HAL configuration
+#define HAL_GPIO_NC                 -1  // Not connected pin
+
+
+// Timer --------------------------------------------------------------------------------------------------------
+namespace Hal::Timer {
+    /**
+     * @brief Microseconds since boot (esp_timer, host: monotonic clock).
+     */
+    int64_t getTimeUs();
+}
+
+
+// PWM (LEDC) ---------------------------------------------------------------------------------------------------
+namespace Hal::Pwm {
+    /**
+     * @brief Configure a PWM timer (low speed mode, automatic clock source).
+     *
+     * @param timer The timer number.
+     * @param dutyResolutionBits The duty resolution (8: duty 0-255).
+     * @param frequencyHz The PWM frequency.
+     */
+    esp_err_t configTimer(uint8_t timer, uint8_t dutyResolutionBits, uint32_t frequencyHz);
+
+    /**
+     * @brief Route a PWM channel of a timer to a pin, with 0 duty.
+     */
+    esp_err_t configChannel(uint8_t channel, int8_t gpio, uint8_t timer);
+
+    /**
+     * @brief Set and apply the duty of a channel.
+     */
+    esp_err_t setDuty(uint8_t channel, uint32_t duty);
+
+    /**
+     * @brief The applied duty of a channel (0 after stop()).
+     */
+    uint32_t getDuty(uint8_t channel);
+
+    /**
+     * @brief Stop the output of a channel at low level.
+     */
+    esp_err_t stop(uint8_t channel);
+
+    esp_err_t pauseTimer(uint8_t timer);
+
+    esp_err_t resumeTimer(uint8_t timer);
+}
+
+
+// LED Strip (RMT) ----------------------------------------------------------------------------------------------
+namespace Hal::LedStrip {
+    /**
+     * @brief Create the RMT channel and the WS2812 encoder of the LED strip, and enable the channel.
+     */
+    esp_err_t init(int8_t gpio);
+
+    /**
+     * @brief Enable or disable the RMT channel (no-op if it is already in that state).
+     *
+     * @note The enabled channel holds a power management lock, it is disabled for the light sleep.
+     */
+    esp_err_t setEnabled(bool isEnabled);
+
+    /**
+     * @brief Send the pixels (GRB bytes) to the strip, blocks until the transfer and the reset code are done.
+     */
+    esp_err_t transmit(const uint8_t* pixels, size_t length);
+
+    void deinit();
+}
+
+
+// Storage (NVS) ------------------------------------------------------------------------------------------------
+typedef uint32_t HalStorageHandle;
+
+namespace Hal::Storage {
+    /**
+     * @brief Initialize the default NVS partition.
+     *
+     * @return esp_err_t ESP_ERR_NVS_NO_FREE_PAGES or ESP_ERR_NVS_NEW_VERSION_FOUND, if the partition has to be erased.
+     */
+    esp_err_t init();
+
+    esp_err_t erase();
+
+    /**
+     * @brief Open a namespace for reading and writing.
+     */
+    esp_err_t open(const char* name, HalStorageHandle* handle);
+
+    /**
+     * @brief Read a string.
+     *
+     * @return esp_err_t ESP_ERR_NVS_NOT_FOUND if the key does not exist, ESP_ERR_NVS_INVALID_LENGTH if the buffer is too small.
+     */
+    esp_err_t getString(HalStorageHandle handle, const char* key, char* value, size_t size);
+
+    esp_err_t setString(HalStorageHandle handle, const char* key, const char* value);
+
+    esp_err_t getI8(HalStorageHandle handle, const char* key, int8_t* value);
+
+    esp_err_t setI8(HalStorageHandle handle, const char* key, int8_t value);
+
+    /**
+     * @brief Write the pending changes to the flash.
+     */
+    esp_err_t commit(HalStorageHandle handle);
+
+    void close(HalStorageHandle handle);
+}
+
+
+// Camera -------------------------------------------------------------------------------------------------------
+enum HalPixelFormat : uint8_t {     // Same values as pixformat_t
+    HAL_PIXFORMAT_RGB565,
+    HAL_PIXFORMAT_YUV422,
+    HAL_PIXFORMAT_YUV420,
+    HAL_PIXFORMAT_GRAYSCALE,
+    HAL_PIXFORMAT_JPEG,
+    HAL_PIXFORMAT_RGB888
+};
+
+enum HalFrameSize : uint8_t {       // Same values as framesize_t
+    HAL_FRAMESIZE_96X96,
+    HAL_FRAMESIZE_QQVGA,
+    HAL_FRAMESIZE_QCIF,
+    HAL_FRAMESIZE_HQVGA,
+    HAL_FRAMESIZE_240X240,
+    HAL_FRAMESIZE_QVGA,
+    HAL_FRAMESIZE_CIF,
+    HAL_FRAMESIZE_HVGA,
+    HAL_FRAMESIZE_VGA,
+    HAL_FRAMESIZE_SVGA,
+    HAL_FRAMESIZE_XGA,
+    HAL_FRAMESIZE_HD,
+    HAL_FRAMESIZE_SXGA,
+    HAL_FRAMESIZE_UXGA
+};
+
+struct HalCameraPins {
+    int8_t pwdn;
+    int8_t reset;
+    int8_t xclk;
+    int8_t sccbSda;
+    int8_t sccbScl;
+    int8_t data[8];                 // D0-D7
+    int8_t vsync;
+    int8_t href;
+    int8_t pclk;
+};
+
+struct HalCameraConfig {
+    HalCameraPins pins;
+    uint32_t xclkFrequencyHz;
+    uint8_t xclkPwmTimer;           // The XCLK is generated by a PWM channel
+    uint8_t xclkPwmChannel;
+    HalPixelFormat pixelFormat;
+    HalFrameSize frameSize;
+    uint8_t jpegQuality;            // 0-63, lower is better
+    uint8_t frameBufferCount;
+    bool isFrameBufferInPsram;
+    bool isGrabLatest;              // Grab the latest frame, or wait for an empty buffer
+};
+
+struct HalCameraWindow {            // Sensor area scaled down to the frame size, in full sensor coordinates
+    uint16_t offsetX;
+    uint16_t offsetY;
+    uint16_t width;                 // 0: the full sensor (no windowing)
+    uint16_t height;
+};
+
+struct HalCameraFrame {
+    uint8_t* data;
+    size_t length;
+    uint16_t width;
+    uint16_t height;
+    HalPixelFormat format;
+    int64_t timestampUs;            // Hal::Timer::getTimeUs() time of the capture
+    void* driverFrame;              // The frame buffer of the driver (camera_fb_t), returned by returnFrame()
+};
+
+namespace Hal::Camera {
+    esp_err_t init(const HalCameraConfig& config);
+
+    esp_err_t deinit();
+
+    /**
+     * @brief Get a frame buffer from the driver (blocks until a frame is captured).
+     *
+     * @return true If the frame is valid, it has to be returned with returnFrame().
+     */
+    bool getFrame(HalCameraFrame& frame);
+
+    void returnFrame(HalCameraFrame& frame);
+
+    /**
+     * @brief Compress a not JPEG frame.
+     *
+     * @param jpeg The allocated JPEG, the caller frees it with free().
+     */
+    bool convertToJpeg(const HalCameraFrame& frame, uint8_t quality, uint8_t** jpeg, size_t* length);
+
+    /**
+     * @brief Decode a JPEG at 1/8 scale to 8 bit luminance: only the DC coefficients, no IDCT (the vision thumbnail).
+     *
+     * @param width Width of the JPEG (a multiple of 8, like every frame size of the driver).
+     * @param height Height of the JPEG.
+     * @param gray (width / 8) x (height / 8) bytes, row by row.
+     */
+    bool decodeJpegGray8(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height, uint8_t* gray);
+
+    /**
+     * @brief Set the PWDN pin of the sensor (standby, the driver and the frame buffers stay allocated).
+     */
+    void setPowerDown(bool isPoweredDown);
+
+    /**
+     * @brief Width and height of a frame size (the resolution table of the driver).
+     */
+    void getResolution(HalFrameSize frameSize, uint16_t* width, uint16_t* height);
+
+// Sensor (SCCB registers, applied live: the driver and the frame buffers stay as they are) -----------------
+    /**
+     * @brief Output frame size of the sensor. The frame buffers are not reallocated,
+     * a frame size bigger than the one of init() does not fit into them.
+     */
+    esp_err_t setFrameSize(HalFrameSize frameSize);
+
+    esp_err_t setJpegQuality(uint8_t quality);
+
+    /**
+     * @param isAuto Automatic gain control, gain is used only without it (0-30).
+     */
+    esp_err_t setGain(bool isAuto, uint8_t gain);
+
+    /**
+     * @param isAuto Automatic exposure control, exposure is used only without it (0-1200).
+     */
+    esp_err_t setExposure(bool isAuto, uint16_t exposure);
+
+    /**
+     * @brief Scale the window of the sensor to the output frame size (digital zoom). A zero width window restores
+     * the full sensor. The window has to be at least as big as the frame size.
+     *
+     * @note A new frame size resets the window.
+     */
+    esp_err_t setWindow(const HalCameraWindow& window, HalFrameSize frameSize);
+}
+
+
+// Wi-Fi --------------------------------------------------------------------------------------------------------
+enum class HalWiFiEvent : uint8_t {
+    STA_CONNECTED,
+    STA_DISCONNECTED,
+    STA_GOT_IP
+};
+
+struct HalWiFiEventData {
+    HalWiFiEvent event;
+    char ip[16];                    // Dotted decimal, STA_GOT_IP only
+    char gateway[16];
+    char netmask[16];
+    uint8_t reason;                 // wifi_err_reason_t, STA_DISCONNECTED only
+};
+
+typedef void (*HalWiFiEventCallback)(const HalWiFiEventData& data);
+
+namespace Hal::WiFi {
+    /**
+     * @brief Initialize the network stack, the default event loop, the station interface and the Wi-Fi driver.
+     *
+     * @param callback Called from the event loop task with the station events.
+     */
+    esp_err_t init(HalWiFiEventCallback callback);
+
+    /**
+     * @brief Configure the station (WPA2, strongest AP first, RAM storage) and start the driver.
+     */
+    esp_err_t start(const char* ssid, const char* password, bool isPowerSaveEnabled);
+
+    esp_err_t connect();
+
+    esp_err_t disconnect();
+
+    esp_err_t stop();
+
+    /**
+     * @brief Modem sleep (minimum), it is needed by the automatic light sleep.
+     */
+    esp_err_t setPowerSave(bool isEnabled);
+
+    /**
+     * @brief Stop the DHCP client and set a static address.
+     */
+    esp_err_t setStaticIp(const char* ip, const char* gateway, const char* netmask);
+
+    /**
+     * @brief The RSSI of the connected AP.
+     *
+     * @return esp_err_t ESP_ERR_WIFI_NOT_CONNECT if the station is not connected.
+     */
+    esp_err_t getRssi(int8_t* rssi);
+}
+
+
+// Power --------------------------------------------------------------------------------------------------------
+namespace Hal::Power {
+    /**
+     * @brief Configure the dynamic frequency scaling and the automatic light sleep.
+     *
+     * @param isPowerSaveEnabled Scale the CPU down to minFrequencyMhz and light sleep when idle, or run at the default frequency.
+     * @return esp_err_t ESP_ERR_NOT_SUPPORTED if the power management is disabled in the sdkconfig.
+     */
+    esp_err_t configure(bool isPowerSaveEnabled, uint32_t minFrequencyMhz);
+}
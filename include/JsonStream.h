@@ -0,0 +1,140 @@
+/*
+ * File: JsonStream.h
+ * Project: drone_r6_fw
+ * File Created: Wednesday, 5th March 2025 6:42:18 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Wednesday, 5th March 2025 6:42:18 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+}
+
+// JSON configuration
+#define JSON_MAX_DEPTH          8   // Max nesting of the writer (objects and arrays)
+#define JSON_MAX_KEY_LENGTH     15  // Max key length of the reader (without the terminating zero)
+#define JSON_MAX_STRING_LENGTH  63  // Max decoded string value length of the reader (without the terminating zero)
+
+
+// JSON Writer --------------------------------------------------------------------------------------------------
+/*
+    Streaming JSON writer into a caller provided buffer, it never allocates.
+    If the buffer is too small, the output is truncated and isOverflow() returns true (the buffer is always zero terminated).
+*/
+class JsonWriter {
+// Init JSON writer -----------------------------------------------------
+public:
+    JsonWriter(char* buffer, size_t size);
+
+// Buffer ---------------------------------------------------------------
+private:
+    char* buffer;
+    size_t size;
+    size_t position;
+    bool isOverflowed;
+
+    void put(char c);
+    void putRaw(const char* text);
+    void putEscaped(const char* text);
+
+public:
+    const char* c_str() const { return buffer; }
+    size_t length() const { return position; }
+    bool isOverflow() const { return isOverflowed; }
+
+// Structure ------------------------------------------------------------
+private:
+    uint8_t depth;
+    uint8_t hasValueMask;   // Bit per depth: a value is already written at this depth (a comma is needed before the next one)
+    bool isAfterKey;        // The next value belongs to a key, no comma is needed
+
+    void beginValue();
+
+public:
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    void key(const char* name);
+
+// Values ---------------------------------------------------------------
+public:
+    void string(const char* value);
+    void number(int32_t value);
+    void boolean(bool value);
+    void null();
+
+    // Key and value in one call
+    void field(const char* name, const char* value) { key(name); string(value); }
+    void field(const char* name, int32_t value) { key(name); number(value); }
+    void field(const char* name, bool value) { key(name); boolean(value); }
+};
+
+
+// JSON Reader --------------------------------------------------------------------------------------------------
+enum JsonValueType {
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_BOOL,
+    JSON_NULL
+};
+
+struct JsonField {
+    char key[JSON_MAX_KEY_LENGTH + 1];
+    JsonValueType type;
+    char string[JSON_MAX_STRING_LENGTH + 1];    // JSON_STRING (decoded, UTF-8)
+    int32_t number;                             // JSON_NUMBER (integers only)
+    bool boolean;                               // JSON_BOOL
+};
+
+/*
+    Pull parser for one flat JSON object ({"key": value, ...}), it never allocates.
+    The values can be strings (UTF-8, the bytes are not validated), integers, true, false and null. Nested objects,
+    arrays, fractions, control characters and too long keys or strings (in bytes) are reported as errors.
+*/
+class JsonReader {
+// Init JSON reader -----------------------------------------------------
+public:
+    JsonReader(const char* json, size_t length);
+
+// Input ----------------------------------------------------------------
+private:
+    const char* json;
+    size_t length;
+    size_t position;
+    uint8_t state;          // 0: before the object, 1: first field, 2: next field, 3: finished
+    bool isErrored;
+
+    bool fail() { isErrored = true; return false; }
+    void skipWhitespace();
+    bool expect(char c);
+    bool readString(char* output, size_t outputSize);
+    bool readNumber(int32_t& value);
+    bool readLiteral(const char* literal);
+
+public:
+    /**
+     * @brief Read the next field of the object.
+     *
+     * @param field The field to fill.
+     * @return true If a field is read, false at the end of the object or on error (see isError()).
+     */
+    bool nextField(JsonField& field);
+
+    /**
+     * @brief The whole input is a valid object, and every field is read.
+     */
+    bool isFinished() const { return state == 3 && !isErrored; }
+
+    bool isError() const { return isErrored; }
+};
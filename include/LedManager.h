@@ -14,13 +14,14 @@
 #pragma once
 
 #include "DebugAndVersionControl.h"
-
-extern "C" {
-#include "driver/gpio.h"
-}
+#include "Hal.h"
 
 // LED GPIO pins
-#define LED_WS2812              GPIO_NUM_0
+#define LED_WS2812              0
+
+// LED array configuration
+#define LED_FRAME_PERIOD_MS             40  // 25 fps animation
+#define LED_LOW_POWER_FRAME_PERIOD_MS   200 // 5 fps animation, the SoC can light sleep between the frames
 
 
 // Colors -------------------------------------------------------------------------------------------------------
@@ -82,6 +83,21 @@ namespace Colors {
 
     // OFF RGB Color
     static const Color Off(0U, 0U, 0U, 0U);         // Obviously OK
+
+    /**
+     * @brief Get the gadget color by the color number stored in the StorageManager.
+     * 
+     * @param colorNumber 0: Orange, 1: Red, 2: Blue, 3: Pink (anything else: Orange).
+     * @return Color The gadget color.
+     */
+    static inline Color getGadgetColor(int8_t colorNumber) {
+        switch (colorNumber) {
+            case 1: return Red;
+            case 2: return Blue;
+            case 3: return Pink;
+            default: return Orange;
+        }
+    }
 }
 
 
@@ -125,7 +141,10 @@ enum AnimationType {
     // Extra Gadget Animations
     WIFI_CONNECTING,
     WIFI_CONNECTED,
-    WIFI_DISCONNECTED // TODO: When wifi disconnects request a /dis connection from the server, and set the led to red color
+    WIFI_DISCONNECTED, // TODO: When wifi disconnects request a /dis connection from the server, and set the led to red color
+
+    // Low Power Animations
+    BREATHING
 };
 
 
@@ -181,6 +200,8 @@ public:
 
     void playWifiDisconnectedAnimation();
 
+    void playBreathingAnimation();
+
 // LED array controls -------------------------------------------------
 private:
     Led LED[6];
@@ -190,6 +211,26 @@ public:
 
     void startLedArrayControls();
 
+    void stopLedArrayControls();
+
+// Low power mode -----------------------------------------------------
+private:
+    bool isLowPower;
+    uint16_t framePeriodMs;
+
+public:
+    /**
+     * @brief Switch between the normal and the low power (room plant) LED array controls.
+     * In low power mode the LEDs play a dim breathing animation at a low frame rate,
+     * and the RMT channel is only enabled while a frame is transmitted (an enabled channel blocks the light sleep).
+     *
+     * @param isLowPower true: low power mode, false: normal mode.
+     */
+    void setLowPowerMode(bool isLowPower);
+
+    bool isLowPowerMode() const { return isLowPower; }
+    uint16_t getFramePeriodMs() const { return framePeriodMs; }
+
 // Deinit LED manager -------------------------------------------------
 public:
      ~LedManager();
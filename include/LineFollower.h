@@ -0,0 +1,92 @@
+/*
+ * File: LineFollower.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+#include "MotorManager.h"
+#include "VisionPipeline.h"
+
+// C
+extern "C" {
+#include <stdint.h>
+}
+
+// Detection: a dark line (tape) on a lighter floor, in a few rows of the grayscale thumbnail below the horizon. The
+// rows are mapped to the floor with the camera model of the optical flow (VisionPipeline.h).
+#define LINE_SCAN_ROWS                  4
+#define LINE_MIN_CONTRAST               40      // Gray levels between the darkest and the lightest pixel of a row
+#define LINE_MAX_WIDTH_PERMILLE         300     // A dark part wider than this of a row is a shadow, not a line
+
+// Steering: ControlData for MotorManager::directionControlManual(), like the controller app sends them
+#define LINE_DEFAULT_SPEED              40      // Percent (the Y of /mov)
+#define LINE_MIN_SPEED                  20
+#define LINE_MAX_SPEED                  80
+#define LINE_LOOKAHEAD_MM               250     // Pursuit point on the line ahead (within the scan rows: 145 - 490 mm)
+#define LINE_WHEEL_BASE_MM              90      // Between the tracks
+#define LINE_LOST_FRAMES                3       // Frames without the line on the last command (a gap in the tape), then a stop
+
+
+// Line Follower ------------------------------------------------------------------------------------------------
+struct LineObservation {
+    bool isFound;
+    uint8_t rows;                   // Scan rows with the line
+    int16_t offsetMm;               // Of the line at the nearest scan row, positive: right of the drone
+    int16_t angleDeciDeg;           // Of the line against the heading, positive: it turns right
+    int16_t targetMm;               // Of the line LINE_LOOKAHEAD_MM ahead, positive: right
+    uint32_t cells;                 // Vision grid cells the line crosses (VisionPipeline::setIgnoredCells)
+};
+
+/*
+    Integer math only: centroids of the dark pixels per scan row, mapped to the floor, and a least squares line
+    through them. steer() turns an observation into the control data of the next camera frame: pure pursuit, the arc
+    through the point of the line LINE_LOOKAHEAD_MM ahead (a curve needs no steady offset, unlike a gain on the
+    offset). No allocation, no RTOS calls (the host tests run it in a closed loop).
+*/
+class LineFollower {
+public:
+    LineFollower();
+
+    /**
+     * @brief Find the line in a grayscale thumbnail (rows without padding).
+     *
+     * @return false If no scan row has the line (observation.isFound is false).
+     */
+    static bool detect(const uint8_t* image, uint16_t width, uint16_t height, LineObservation& observation);
+
+    /**
+     * @brief The control data for an observation, a missed frame is an observation without the line.
+     */
+    ControlData steer(const LineObservation& observation);
+
+    /**
+     * @brief Forget the last command and the lost frames (following starts again).
+     */
+    void reset();
+
+    void setSpeed(uint8_t speed) { this->speed = speed; }
+
+    uint8_t getSpeed() const { return speed; }
+
+    bool isLost() const { return lostFrames > LINE_LOST_FRAMES; }
+
+    /**
+     * @brief atan(numerator / denominator) in decidegrees (-1800 - 1800), without floating point.
+     */
+    static int16_t atan2DeciDeg(int32_t numerator, int32_t denominator);
+
+private:
+    uint8_t speed;
+    uint8_t lostFrames;
+    ControlData lastCommand;
+};
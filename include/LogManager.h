@@ -0,0 +1,185 @@
+/*
+ * File: LogManager.h
+ * Project: drone_r6_fw
+ * File Created: Saturday, 8th March 2025 4:37:52 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Saturday, 8th March 2025 4:37:52 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+#include "Hal.h"
+
+// C++
+#include <atomic>
+#include <type_traits>
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+}
+
+// Log manager configuration
+#define LOG_RING_SIZE           64  // Entries, power of 2
+#define LOG_MAX_ARGS            4
+#define LOG_MAX_LINE_LENGTH     160 // Formatted line (longer lines are truncated)
+#define LOG_DRAIN_PERIOD_MS     100
+#define LOG_DRAIN_STACK_SIZE    3072
+#define LOG_DRAIN_PRIORITY      1   // Above idle only, the formatting and the UART writes never delay the other tasks
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE has to be a power of 2");
+
+
+// Log Macros ---------------------------------------------------------------------------------------------------
+/*
+    Deferred logging for the hot paths (handlers, event callbacks, tasks): the call only stores the address of
+    the call site (tag, level and format string, the format string ID) and the raw arguments into a lock-free ring,
+    the formatting and the UART write is done later by the low priority drain task (or by the /log endpoint).
+    Every call above the compile-time level of the module (LOG_LEVEL_<MODULE> in DebugAndVersionControl.h) is removed.
+
+    The arguments can be integers (up to 32 bit) and static strings only (the string is read at formatting time),
+    at most LOG_MAX_ARGS. Use DEBUG_PRINT for everything else (cold paths: init, deinit, mode changes).
+
+    Example: LOG_I(WIFI, "Got IP: " IPSTR, IP2STR(&ip));
+*/
+#define LOG_DEFERRED(module, level, format, ...) do {                                      \
+        if constexpr ((level) <= LOG_LEVEL_##module) {                                      \
+            static const LogSite logSite = { #module, format, (level) };                    \
+            LogManager::write(&logSite, ##__VA_ARGS__);                                      \
+        }                                                                                   \
+    } while (0)
+
+#define LOG_E(module, format, ...) LOG_DEFERRED(module, LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#define LOG_W(module, format, ...) LOG_DEFERRED(module, LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_I(module, format, ...) LOG_DEFERRED(module, LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_D(module, format, ...) LOG_DEFERRED(module, LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+
+
+// Log Entries --------------------------------------------------------------------------------------------------
+struct LogSite {
+    const char* tag;        // Module name
+    const char* format;     // printf format (%d, %i, %u, %x, %X, %o, %c, %s, %p, with l and h modifiers)
+    uint8_t level;          // LOG_LEVEL_*
+};
+
+struct LogEntry {
+    std::atomic<uint32_t> sequence;     // Ring slot state (written by the producer last, read by the consumer first)
+    const LogSite* site;
+    uint32_t timestampUs;
+    uint8_t argCount;
+    uintptr_t args[LOG_MAX_ARGS];
+};
+
+
+// Log Manager --------------------------------------------------------------------------------------------------
+class LogManager {
+// Init log manager -----------------------------------------------------
+private:
+    LogManager();
+
+// Ring -----------------------------------------------------------------
+/*
+    Bounded multi-producer, single-consumer ring: a producer reserves a slot with a CAS on the write position,
+    fills it, then publishes it with the slot sequence. The producers never block, if the ring is full the entry is dropped
+    (and counted). The consumers (drain task, /log endpoint) are serialized with drainMutex.
+*/
+private:
+    static LogEntry ring[LOG_RING_SIZE];
+    static inline std::atomic<uint32_t> writePosition{0};
+    static inline uint32_t readPosition = 0;
+    static inline std::atomic<uint32_t> droppedCount{0};
+
+    static bool push(const LogSite* site, const uintptr_t* args, uint8_t argCount);
+
+    template <typename T>
+    static uintptr_t toArg(T value) {
+        static_assert((std::is_integral_v<T> || std::is_enum_v<T>) ? sizeof(T) <= 4 : std::is_same_v<T, const char*> || std::is_same_v<T, char*>,
+                      "Only integers (up to 32 bit) and static strings can be logged deferred, use DEBUG_PRINT");
+        if constexpr (std::is_pointer_v<T>) { return reinterpret_cast<uintptr_t>(value); }
+        else if constexpr (std::is_signed_v<T>) { return uintptr_t(intptr_t(value)); } // Sign extended, printed back with %d
+        else { return uintptr_t(value); }
+    }
+
+public:
+    /**
+     * @brief Store a log entry into the ring (use the LOG_* macros).
+     *
+     * @param site The call site.
+     * @param args The arguments of the format string.
+     * @return true If stored, false if the ring was full (the entry is dropped).
+     */
+    template <typename... Args>
+    static bool write(const LogSite* site, Args... args) {
+        static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "Too many log arguments (LOG_MAX_ARGS)");
+        const uintptr_t values[LOG_MAX_ARGS + 1] = { toArg(args)... };
+        return push(site, values, sizeof...(Args));
+    }
+
+    /**
+     * @brief Format a log entry (without the level and the tag).
+     *
+     * @param entry The entry.
+     * @param buffer The output buffer (always zero terminated).
+     * @param size The size of the buffer.
+     * @return size_t The length of the line.
+     */
+    static size_t format(const LogEntry& entry, char* buffer, size_t size);
+
+    /**
+     * @brief Take the pending entries out of the ring, and pass them to the output function in order.
+     *
+     * @param output Called with every entry and its formatted line.
+     * @param context Passed to the output function.
+     * @return uint32_t The number of entries.
+     */
+    uint32_t drain(void (*output)(const LogEntry& entry, const char* line, void* context), void* context);
+
+    static uint32_t getDroppedCount() { return droppedCount.load(std::memory_order_relaxed); }
+
+// Drain task -----------------------------------------------------------
+private:
+    SemaphoreHandle_t drainMutex;
+    TaskHandle_t drainTaskHandle;
+
+    static void taskLogDrain(void *pvParameters);
+
+public:
+    /**
+     * @brief Start the drain task, it prints the pending entries on the UART every LOG_DRAIN_PERIOD_MS (started by the constructor).
+     */
+    void startDrainTask();
+
+    /**
+     * @brief Stop the drain task, the entries stay in the ring (until drain() or the /log endpoint takes them).
+     */
+    void stopDrainTask();
+
+// Deinit log manager ---------------------------------------------------
+public:
+    ~LogManager();
+
+// Singleton ------------------------------------------------------------
+private:
+    static LogManager* instance;
+
+public:
+    LogManager(const LogManager& logManager) = delete;
+
+    LogManager& operator=(const LogManager& logManager) = delete;
+
+    static void init();
+
+    static LogManager* getInstance() { return instance; }
+
+    static void deinit();
+};
@@ -15,8 +15,214 @@
 
 #include "DebugAndVersionControl.h"
 
+// C++
+#include <atomic>
+
+// C
+extern "C" {
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+}
+
 // Mode GPIO pins
 #define RP_MODE_BUTTON          0   // GPIO_0
 
+// Mode manager configuration
+#define MODE_PROCESS_PERIOD_MS  100 // How often the main loop checks the requested mode without notification
+#define MODE_POWER_SAVE_MIN_CPU_FREQ_MHZ 40 // XTAL frequency, the CPU is scaled down to it between the events
+
+
+// Drone Modes --------------------------------------------------------------------------------------------------
+enum DroneMode {
+    SHUTDOWN,       // Nothing is running (before the first mode is applied, and after shutdown)
+    DRIVE,          // Everything is running, the drone can be driven and streams video
+    STREAM_ONLY,    // Video stream only, the motors are stopped
+    ROOM_PLANT,     // Decoration mode, only the LEDs and the command server are running, the camera is in standby
+    LOW_POWER       // Only the Wi-Fi and the command server are running (to be able to wake up)
+};
+
+// Subsystems ---------------------------------------------------------------------------------------------------
+// NOTE: The order is the start order (dependency order), the subsystems are stopped in reverse order.
+enum Subsystem {
+    SUBSYSTEM_WIFI,
+    SUBSYSTEM_LEDS,
+    SUBSYSTEM_COMMAND_SERVER,
+    SUBSYSTEM_CAMERA,
+    SUBSYSTEM_VIDEO_SERVER,
+    SUBSYSTEM_MOTORS,
+    SUBSYSTEM_COUNT
+};
+
+#define SUBSYSTEM_BIT(subsystem) (uint8_t(1U << (subsystem)))
+
+/*
+    A suspended subsystem keeps its resources (driver, buffers) but does not use power,
+    so resuming it is much faster than starting it again. If a subsystem has no suspend and resume hooks,
+    it is simply stopped and started.
+*/
+struct SubsystemHooks {
+    void (*start)();
+    void (*stop)();
+    void (*suspend)();
+    void (*resume)();
+};
+
+// Subsystem start and resume latencies (ms, estimates for the ESP32-CAM) for the wake latency budget. The unit test
+// times the ROOM_PLANT -> DRIVE path with the real managers (the resume and start ones), the rest is not measured
+#define WIFI_START_LATENCY_MS           3000    // Connect + DHCP
+#define LEDS_START_LATENCY_MS           5
+#define COMMAND_SERVER_START_LATENCY_MS 10
+#define CAMERA_START_LATENCY_MS         800     // Sensor probe + frame buffer allocation in PSRAM
+#define CAMERA_RESUME_LATENCY_MS        20      // PWDN release + first frames
+#define VIDEO_SERVER_START_LATENCY_MS   10
+#define MOTORS_START_LATENCY_MS         2
+#define WIFI_DTIM_WAKE_LATENCY_MS       103     // Worst case with modem sleep: the request waits for the next DTIM beacon (DTIM 1, 102.4 ms)
+#define MODE_REQUEST_LATENCY_MS         10      // The main task is notified, one tick to be scheduled
+
+
+// Mode Profiles ------------------------------------------------------------------------------------------------
+/*
+    Power and latency budget per mode (ESP32-CAM board at 5 V, budgeted current without the motors):
+
+    | Mode        | Camera         | Video server | Motors      | LEDs                 | Wi-Fi / CPU                          | Current | Wake to DRIVE |
+    |-------------|----------------|--------------|-------------|----------------------|--------------------------------------|---------|---------------|
+    | DRIVE       | streaming      | running      | running     | 25 fps, full         | no power save, 160 MHz               | ~310 mA | -             |
+    | STREAM_ONLY | streaming      | running      | PWM gated   | 25 fps, full         | no power save, 160 MHz               | ~280 mA | <= 50 ms      |
+    | ROOM_PLANT  | PWDN (standby) | stopped      | PWM gated   | 5 fps breathing, dim | modem sleep, 40-160 MHz, light sleep | ~40 mA  | <= 200 ms     |
+    | LOW_POWER   | deinitialized  | stopped      | PWM gated   | off                  | modem sleep, 40-160 MHz, light sleep | ~30 mA  | <= 1000 ms    |
+
+    The budgets are checked against estimateTransitionLatencyMs() (see the unit test), in ROOM_PLANT it is dominated
+    by the DTIM interval of the access point. The unit test also times the ROOM_PLANT -> DRIVE wake (wakeUp() from
+    another task, the transition in the mode task) against the budget without the DTIM wait.
+*/
+struct ModeProfile {
+    uint8_t requiredSubsystems;     // Running subsystems (SUBSYSTEM_BIT)
+    uint8_t suspendedSubsystems;    // Suspended subsystems (SUBSYSTEM_BIT), they are ready to be resumed
+    bool isPowerSaveEnabled;        // Wi-Fi modem sleep, CPU frequency scaling and automatic light sleep
+    bool isLedDimmed;               // Dim breathing animation at a low frame rate
+    uint16_t wakeLatencyBudgetMs;   // Max time to get back to DRIVE mode from this mode
+};
+
+
+// Mode Manager -------------------------------------------------------------------------------------------------
+class ModeManager {
+// Init mode manager ----------------------------------------------------
+private:
+    ModeManager();
+
+// Modes ----------------------------------------------------------------
+private:
+    DroneMode currentMode;
+    std::atomic<DroneMode> requestedMode;
+
+public:
+    TaskHandle_t modeTaskHandle;
+
+public:
+    /**
+     * @brief Request a mode change. Safe to call from any task (server handlers, Wi-Fi task),
+     * the transition itself is done by processModeRequest() in the main loop (which is woken up immediately).
+     *
+     * @param mode The requested mode.
+     */
+    void setMode(DroneMode mode);
+
+    /**
+     * @brief Fast wake: request DRIVE mode if the drone is in ROOM_PLANT mode (called on every control request).
+     */
+    void wakeUp();
+
+    /**
+     * @brief Block the calling (main) task until a mode is requested, or the timeout expires.
+     * The CPU can light sleep meanwhile.
+     *
+     * @param timeoutMs Timeout in milliseconds.
+     */
+    void waitForModeRequest(uint32_t timeoutMs);
+
+    DroneMode getMode() const { return currentMode; }
+    DroneMode getRequestedMode() const { return requestedMode; }
+
+    /**
+     * @brief Apply the requested mode, if it differs from the current one.
+     *
+     * @return true If the mode changed.
+     */
+    bool processModeRequest();
+
+    /**
+     * @brief Get the subsystems, power save settings and the wake latency budget of the given mode.
+     *
+     * @param mode The mode.
+     * @return const ModeProfile& The profile of the mode.
+     */
+    static const ModeProfile& getModeProfile(DroneMode mode);
+
+    /**
+     * @brief Get the subsystems which has to run in the given mode.
+     *
+     * @param mode The mode.
+     * @return uint8_t Bit mask of the subsystems (SUBSYSTEM_BIT).
+     */
+    static uint8_t getRequiredSubsystems(DroneMode mode) { return getModeProfile(mode).requiredSubsystems; }
+
+    /**
+     * @brief Estimate the worst case time of a mode transition (from the request to the last started subsystem),
+     * based on the subsystem start and resume latencies.
+     *
+     * @param from The current mode.
+     * @param to The requested mode.
+     * @return uint16_t The estimated latency in milliseconds.
+     */
+    static uint16_t estimateTransitionLatencyMs(DroneMode from, DroneMode to);
+
+// Subsystems -----------------------------------------------------------
+private:
+    uint8_t activeSubsystems;
+    uint8_t suspendedSubsystems;
+    SubsystemHooks subsystemHooks[SUBSYSTEM_COUNT];
+    void (*powerProfileHook)(const ModeProfile& profile);
+
+    void applyMode(DroneMode mode);
+
+public:
+    uint8_t getActiveSubsystems() const { return activeSubsystems; }
+    uint8_t getSuspendedSubsystems() const { return suspendedSubsystems; }
+    bool isSubsystemActive(Subsystem subsystem) const { return activeSubsystems & SUBSYSTEM_BIT(subsystem); }
+
+    /**
+     * @brief Replace the hooks of a subsystem (for unit tests with stub managers).
+     *
+     * @param subsystem The subsystem.
+     * @param hooks The new hooks.
+     */
+    void setSubsystemHooks(Subsystem subsystem, SubsystemHooks hooks) { subsystemHooks[subsystem] = hooks; }
+
+    /**
+     * @brief Replace the hook which applies the power save settings of a mode (for unit tests).
+     *
+     * @param hook The new hook, called before the transition if the new mode leaves the power save,
+     * otherwise after the transition.
+     */
+    void setPowerProfileHook(void (*hook)(const ModeProfile& profile)) { powerProfileHook = hook; }
+
+// Deinit mode manager --------------------------------------------------
+public:
+    ~ModeManager();
+
+// Singleton ------------------------------------------------------------
+private:
+    static ModeManager* instance;
+
+public:
+    ModeManager(const ModeManager& modeManager) = delete;
+
+    ModeManager& operator=(const ModeManager& modeManager) = delete;
+
+    static void init();
 
+    static ModeManager* getInstance() { return instance; }
 
+    static void deinit();
+};
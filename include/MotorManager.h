@@ -14,24 +14,32 @@
 #pragma once
 
 #include "DebugAndVersionControl.h"
-#include "driver/ledc.h" // LEDC driver for PWM control
+#include "Hal.h"
+
+// C++
+#include <atomic>
+
+// C
+extern "C" {
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+}
 
 // Motor GPIO pins
-#define MOTOR_2_GPIO_CW         GPIO_NUM_12
-#define MOTOR_2_GPIO_CCW        GPIO_NUM_13
-#define MOTOR_1_GPIO_CW         GPIO_NUM_15
-#define MOTOR_1_GPIO_CCW        GPIO_NUM_14
+#define MOTOR_2_GPIO_CW         12
+#define MOTOR_2_GPIO_CCW        13
+#define MOTOR_1_GPIO_CW         15
+#define MOTOR_1_GPIO_CCW        14
 
-// Channels for the motors
-#define MOTOR_2_CW              LEDC_CHANNEL_1
-#define MOTOR_2_CCW             LEDC_CHANNEL_2
-#define MOTOR_1_CW              LEDC_CHANNEL_3
-#define MOTOR_1_CCW             LEDC_CHANNEL_4
+// PWM channels for the motors (channel 0 is the camera XCLK)
+#define MOTOR_2_CW              1
+#define MOTOR_2_CCW             2
+#define MOTOR_1_CW              3
+#define MOTOR_1_CCW             4
 
 // Motor configurations
-#define MOTOR_TIMER             LEDC_TIMER_1
-#define MOTOR_SPEED_MODE        LEDC_LOW_SPEED_MODE
-#define MOTOR_DUTY_RES          LEDC_TIMER_8_BIT
+#define MOTOR_TIMER             1   // PWM timer (timer 0 is the camera XCLK)
+#define MOTOR_DUTY_RES          8   // bits
 #define MOTOR_FREQ              100
 
 // Motor speed limits
@@ -40,6 +48,10 @@
 #define MOTOR_MIN_SPEED         70  // Minimum working speed (8 bit)
 #define MOTOR_OFF               0   // 0% duty cycle (8 bit)
 
+// Motor control loop
+#define MOTOR_CONTROL_PERIOD_MS 20
+#define MOTOR_TASK_STOP_TIMEOUT_MS 500 // The task ends after its current loop (a period)
+
 
 // Control Data -------------------------------------------------------------------------------------------------
 struct ControlData {
@@ -56,17 +68,15 @@ public:
     /**
      * @brief Construct a new Motor object.
      *
-     * @param motorCW LEDC channel for the motor in the clockwise direction.
-     * @param motorCCW LEDC channel for the motor in the counter-clockwise direction.
+     * @param motorCW PWM channel for the motor in the clockwise direction.
+     * @param motorCCW PWM channel for the motor in the counter-clockwise direction.
      */
-    Motor(int8_t motorCWPin = MOTOR_1_GPIO_CW, ledc_channel_t motorCW = MOTOR_1_CW, int8_t motorCCWPin = MOTOR_1_GPIO_CCW, ledc_channel_t motorCCW = MOTOR_1_CCW);
+    Motor(int8_t motorCWPin = MOTOR_1_GPIO_CW, uint8_t motorCW = MOTOR_1_CW, int8_t motorCCWPin = MOTOR_1_GPIO_CCW, uint8_t motorCCW = MOTOR_1_CCW);
 
 // Speed and motor channels ----------------------------------------------
 private:
-    ledc_channel_t motorCW;
-    ledc_channel_t motorCCW;
-    ledc_timer_config_t timerConfig;
-    ledc_channel_config_t channelConfig;
+    uint8_t motorCW;
+    uint8_t motorCCW;
     int16_t speed;
 
 // Setters and Getters ---------------------------------------------------
@@ -88,32 +98,37 @@ public:
      */
     void setSpeed(int16_t speed, int16_t offset);
 #endif
-    int16_t getSpeed() const { return speed; }
+    int16_t getSpeed() const { return speed; } // Applied duty cycle, negative: counter-clockwise
 
 // Deinit motor ----------------------------------------------------------
 public:
     ~Motor();
 
-// Private methods -------------------------------------------------------
-private:
+// Conversion ------------------------------------------------------------
+public:
     /**
      * @brief Convert the speed percentage to a duty cycle.
      * 
      * @param speed Speed of the motor (0-100).
      * @return int16_t Duty cycle of the motor (70-230).
      */
-    int16_t convertSpeedPercentageToDutyCycle(int16_t speed);
+    static int16_t convertSpeedPercentageToDutyCycle(int16_t speed);
 
+// Private methods -------------------------------------------------------
+private:
     /**
      * @brief Configure the GPIO pins for the motor.
      *
      * @param pin GPIO pin number.
-     * @param motor LEDC channel for the motor.
+     * @param motor PWM channel for the motor.
      */
-    void motorPinConfig(int8_t pin, ledc_channel_t motor); 
+    void motorPinConfig(int8_t pin, uint8_t motor); 
 };
 
 // Motor Manager ------------------------------------------------------------------------------------------------
+struct ControlJitterStats;
+class ControlJitterBuffer;
+
 class MotorManager {
 // Init motor manager ---------------------------------------------------
 private:
@@ -161,12 +176,19 @@ private:
     void allStop();
 
 // Control --------------------------------------------------------------
+/*
+    The commands of the controller (/mov) are queued into a jitter buffer (ControlJitterBuffer.h), every motor loop
+    plays the one of its time. The commands of the tasks (the line follow, the start and the stop) are applied at once.
+*/
 private:
-    ControlData controlData;
+    ControlData controlData;            // The newest command
+    ControlData appliedControlData;     // Of the motor loop
+    ControlJitterBuffer* jitterBuffer;
+    SemaphoreHandle_t controlMutex;     // The jitter buffer and the control data (the server task queues, the motor loop plays)
 
 public:
     /**
-     * @brief Set the control data for the drone.
+     * @brief Set the control data for the drone, applied at once (the queued commands of the controller are dropped).
      * 
      * @param X Speed of the drone on the X-axis (0-100).
      * @param Y Speed of the drone on the Y-axis (0-100).
@@ -175,11 +197,68 @@ public:
      */
     void setControlData(int16_t X, int16_t Y, int8_t L, int8_t R);
 
-    ControlData getControlData() const { return controlData; }
+    /**
+     * @brief Queue a command of the controller into the jitter buffer, the motor loop plays it.
+     */
+    void queueControlData(int16_t X, int16_t Y, int8_t L, int8_t R);
+
+    /**
+     * @brief The command of this motor loop from the jitter buffer (the applied one is kept if it has none).
+     *
+     * @return ControlData The applied command, copied under the lock (the other tasks write it meanwhile).
+     */
+    ControlData playControlData();
+
+    ControlData getControlData() const { return controlData; } // The newest command (the applied one may lag behind)
+
+    ControlData getAppliedControlData() const;
+
+    /**
+     * @brief The depth of the jitter buffer (0 - CONTROL_JITTER_MAX_DEPTH_MS).
+     */
+    void setControlJitterDepthMs(uint16_t depthMs);
+
+    ControlJitterStats getControlJitterStats();
+
+    /**
+     * @brief The applied duty cycles of the motors, negative: counter-clockwise.
+     */
+    void getMotorDuties(int16_t& left, int16_t& right) const {
+        left = leftMotor.getSpeed();
+        right = rightMotor.getSpeed();
+    }
 
 #ifdef MANUAL_CONTROL
-    void directionControlManual();
+    /**
+     * @brief Mix a command into the duties of the motors (the motor loop passes the one playControlData() returned).
+     */
+    void directionControlManual(const ControlData& control);
+
+    void directionControlManual() { directionControlManual(getAppliedControlData()); }
 #endif
+
+// Stop hint ------------------------------------------------------------
+/*
+    Set by the vision stage (VisionManager) when an obstacle is close in front: the forward moves are held at a stop
+    until the hint expires, the backward moves and the turns still work (to get away from it). Any task can set it.
+*/
+private:
+    static inline std::atomic<bool> isStopHintSet{false};
+    static inline std::atomic<uint32_t> stopHintEndMs{0};
+    static inline std::atomic<uint32_t> stopHintBlocks{0};
+
+public:
+    /**
+     * @brief Hold the forward moves for holdMs from now (a new hint replaces the running one).
+     */
+    static void setStopHint(uint32_t holdMs);
+
+    static void clearStopHint();
+
+    static bool isStopHinted();
+
+    static uint32_t getStopHintBlocks() { return stopHintBlocks.load(std::memory_order_relaxed); } // Control loops that held a forward move
+
 #ifdef VERSION_BETA_OR_LATER
 #ifdef AUTO_CONTROL
     void directionControlAutoAssisted();
@@ -188,6 +267,14 @@ public:
 // Motor Controls --------------------------------------------------------
     void startMotorControls();
 
+    static bool isMotorControlRunning();
+
+    /**
+     * @brief Stop the direction control task (it ends after its current loop, this waits for it), stop the motors,
+     * clear the control data and gate the motor PWM timer.
+     */
+    void stopMotorControls();
+
 // Deinit motor manager -------------------------------------------------
 public:
     ~MotorManager();
@@ -203,7 +290,7 @@ public:
 
     static MotorManager* getInstance();
 
-    static void deinit() { delete instance; }
+    static void deinit() { delete instance; instance = nullptr; }
 };
 
 // DONE: MotorManager.h VERSION_ALPHA
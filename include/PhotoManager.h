@@ -0,0 +1,143 @@
+/*
+ * File: PhotoManager.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+#include "CameraManager.h"
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+}
+
+// Photo configuration
+#define PHOTO_FRAMESIZE                 HAL_FRAMESIZE_UXGA
+#define PHOTO_JPEG_QUALITY              8       // Better than the stream (CAMERA_JPEG_QUALITY)
+#define PHOTO_CONVERT_QUALITY           90      // frame2jpg quality of a raw sensor format
+#define PHOTO_RING_SIZE                 4       // Stills kept in PSRAM, a new one replaces the oldest
+#define PHOTO_BURST_MAX                 PHOTO_RING_SIZE
+#define PHOTO_SETTLE_FRAMES             1       // Full size frames dropped first: the exposure adapts to the UXGA timing
+/*
+    The stream waits while the sensor has the photo size. OV2640 at 20 MHz XCLK: up to CAMERA_STALE_FRAMES_MAX VGA
+    frames left in the buffers, the settle frame and the still at about 15 fps, then the UXGA frames left at the
+    switch back: about 400 ms for one still.
+*/
+#define PHOTO_STREAM_GAP_BUDGET_MS      500
+
+
+// Photo Frame --------------------------------------------------------------------------------------------------
+/*
+    A still in the ring, one allocation with its JPEG (PSRAM first). It is freed when the ring replaced it and the
+    last request sending it released it.
+*/
+struct PhotoFrame {
+    uint8_t* data;
+    size_t length;
+    uint16_t width;
+    uint16_t height;
+    int64_t timestampUs;            // Capture time (esp_timer)
+    uint32_t id;                    // Counts up from 1, never reused
+    uint32_t refCount;              // Guarded by the ring mutex
+};
+
+struct PhotoStats {
+    uint32_t bursts;                // Successful capture() calls
+    uint32_t stills;
+    uint32_t failures;
+    uint32_t droppedFrames;         // Of the old size, or settling
+    uint32_t lastSwitchUs;          // Register writes of the switch to the photo size
+    uint32_t lastGapUs;             // The stream waited this long for the last burst (on the frame timestamps)
+    uint32_t maxGapUs;
+    uint32_t gapsOverBudget;        // Longer than PHOTO_STREAM_GAP_BUDGET_MS
+};
+
+
+// Photo Manager ------------------------------------------------------------------------------------------------
+/*
+    High resolution stills while the stream runs at its own size: the streams are held (CameraManager::holdStream()),
+    the sensor is switched to PHOTO_FRAMESIZE live, the frames of the old size and the settle frames are dropped, the
+    stills are copied into the ring, then the stream settings are written back and the streams go on. The frame
+    buffers have to fit the photo size for the live switch (CameraManager::reserveFrameSize(), once).
+    Initialized in main.cpp, the ring survives the restarts of the video server.
+*/
+class PhotoManager {
+// Init photo manager ---------------------------------------------------
+private:
+    PhotoManager();
+
+// Stills ---------------------------------------------------------------
+private:
+    SemaphoreHandle_t ringMutex;    // The ring, the reference counts and the stats, held for a few instructions
+    SemaphoreHandle_t captureMutex; // One burst at a time
+    PhotoFrame* ring[PHOTO_RING_SIZE];
+    uint32_t nextId;
+    PhotoStats stats;
+
+    static PhotoFrame* createFrame(const HalCameraFrame& cameraFrame);
+
+    /**
+     * @brief Put a still into the ring with the next id, the replaced one is released.
+     */
+    uint32_t store(PhotoFrame* frame);
+
+public:
+    /**
+     * @brief Capture count stills at PHOTO_FRAMESIZE, the stream is held meanwhile (getStats().lastGapUs).
+     *
+     * @param count 1 - PHOTO_BURST_MAX.
+     * @param firstId The id of the first still, the others follow it.
+     * @return esp_err_t ESP_ERR_INVALID_ARG for a wrong count, ESP_ERR_INVALID_STATE if there is no camera, it is
+     * powered down, the buffers do not fit the photo size or a burst is running; ESP_FAIL if the capture failed.
+     */
+    esp_err_t capture(uint8_t count, uint32_t* firstId);
+
+    /**
+     * @brief A still of the ring (id 0: the latest), nullptr if it was replaced. Every acquired still has to be released.
+     */
+    const PhotoFrame* acquire(uint32_t id);
+
+    void release(const PhotoFrame* frame);
+
+    /**
+     * @brief The ids of the ring, the oldest first.
+     *
+     * @return uint8_t The number of ids.
+     */
+    uint8_t getIds(uint32_t (&ids)[PHOTO_RING_SIZE]);
+
+    PhotoStats getStats();
+
+// Deinit photo manager -------------------------------------------------
+public:
+    ~PhotoManager();
+
+// Singleton ------------------------------------------------------------
+private:
+    static PhotoManager* instance;
+
+public:
+    PhotoManager(const PhotoManager& photoManager) = delete;
+
+    PhotoManager& operator=(const PhotoManager& photoManager) = delete;
+
+    static void init();
+
+    static PhotoManager* getInstance() { return instance; }
+
+    static void deinit();
+};
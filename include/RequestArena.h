@@ -0,0 +1,128 @@
+/*
+ * File: RequestArena.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+// C
+extern "C" {
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+}
+
+#define REQUEST_ARENA_ALIGNMENT     8   // Enough for every type of the handlers (int64_t, double)
+
+
+// Request Arena ------------------------------------------------------------------------------------------------
+/*
+    Bump allocator over a caller provided (static) buffer, for the buffers of one request handler: the query string,
+    the request body, the response. Every server has its own arena, and its handlers run in the single server task,
+    so there is no locking. The arena is reset after every handler (RequestArenaScope), nothing is freed one by one,
+    so the internal heap is never fragmented by the requests.
+*/
+class RequestArena {
+// Init request arena ---------------------------------------------------
+public:
+    RequestArena(uint8_t* buffer, size_t size);
+
+// Allocation -----------------------------------------------------------
+private:
+    uint8_t* buffer;
+    size_t size;
+    size_t used;
+    size_t highWaterMark;       // Most bytes used by one request
+    uint32_t failedCount;       // Allocations that did not fit
+
+public:
+    /**
+     * @brief Allocate from the arena, the memory is valid until the next reset().
+     *
+     * @param length Bytes to allocate.
+     * @return void* REQUEST_ARENA_ALIGNMENT aligned memory, nullptr if it does not fit (counted).
+     */
+    void* allocate(size_t length);
+
+    /**
+     * @brief Allocate a zero terminated, empty string of capacity characters (plus the terminating zero).
+     */
+    char* allocateString(size_t capacity);
+
+    /**
+     * @brief Release every allocation.
+     */
+    void reset() { used = 0; }
+
+    size_t getSize() const { return size; }
+    size_t getUsed() const { return used; }
+    size_t getHighWaterMark() const { return highWaterMark; }
+    uint32_t getFailedCount() const { return failedCount; }
+};
+
+/*
+    Resets the arena when it goes out of scope (at the end of the handler).
+*/
+class RequestArenaScope {
+private:
+    RequestArena& arena;
+
+public:
+    RequestArenaScope(RequestArena& arena) : arena(arena) { arena.reset(); }
+
+    ~RequestArenaScope() { arena.reset(); }
+
+    RequestArenaScope(const RequestArenaScope& scope) = delete;
+
+    RequestArenaScope& operator=(const RequestArenaScope& scope) = delete;
+};
+
+
+// Fixed String -------------------------------------------------------------------------------------------------
+/*
+    Fixed capacity string over a caller provided buffer (or arena memory), it never allocates.
+    If the capacity is exceeded, the text is truncated and isOverflow() returns true (the buffer is always zero terminated).
+*/
+class FixedString {
+// Init fixed string ----------------------------------------------------
+public:
+    FixedString(char* buffer, size_t size);
+
+    /**
+     * @brief A string of capacity characters from the arena (an empty, overflowed string if it does not fit).
+     */
+    FixedString(RequestArena& arena, size_t capacity);
+
+// Buffer ---------------------------------------------------------------
+private:
+    char* buffer;
+    size_t size;
+    size_t position;
+    bool isOverflowed;
+
+public:
+    const char* c_str() const { return buffer ? buffer : ""; }
+    size_t length() const { return position; }
+    size_t capacity() const { return size ? size - 1 : 0; }
+    bool isOverflow() const { return isOverflowed; }
+
+    void clear();
+
+// Append ---------------------------------------------------------------
+public:
+    FixedString& append(const char* text);
+    FixedString& append(const char* text, size_t length);
+
+    /**
+     * @brief Append printf formatted text.
+     */
+    FixedString& appendFormat(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
@@ -0,0 +1,184 @@
+/*
+ * File: ResourceManager.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+#include "Hal.h"
+
+// C++
+#include <atomic>
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+}
+
+// Resource monitor configuration
+#define RESOURCE_SAMPLE_PERIOD_MS           1000
+#define RESOURCE_MAX_TASKS                  24      // Every task of the system has to fit, otherwise the task stats are skipped
+#define RESOURCE_TASK_NAME_LENGTH           16      // configMAX_TASK_NAME_LEN of the ESP-IDF, zero terminated
+#define RESOURCE_MONITOR_STACK_SIZE         3072
+#define RESOURCE_MONITOR_PRIORITY           1       // Above idle only, like the log drain task
+
+// Alarm thresholds (an alarm is raised below the threshold, and cleared above threshold + hysteresis)
+#define RESOURCE_STACK_ALARM_BYTES          256     // Free stack of the task that used the most of its stack
+#define RESOURCE_INTERNAL_FREE_ALARM_BYTES  16384   // The Wi-Fi driver allocates its buffers from the internal RAM
+#define RESOURCE_INTERNAL_BLOCK_ALARM_BYTES 4096    // A new task stack or an httpd session needs one contiguous block
+#define RESOURCE_PSRAM_FREE_ALARM_BYTES     65536   // Room for one more frame buffer
+#define RESOURCE_ALARM_HYSTERESIS_PERCENT   25
+
+// Alarms (bit mask)
+#define RESOURCE_ALARM_NONE                 0
+#define RESOURCE_ALARM_STACK                (1 << 0)
+#define RESOURCE_ALARM_INTERNAL_FREE        (1 << 1)
+#define RESOURCE_ALARM_INTERNAL_BLOCK       (1 << 2)
+#define RESOURCE_ALARM_PSRAM_FREE           (1 << 3)    // Only if the PSRAM is present
+
+
+// Resource Sample ----------------------------------------------------------------------------------------------
+struct ResourceHeapStats {
+    uint32_t freeBytes;
+    uint32_t minFreeBytes;          // Lowest free size since boot
+    uint32_t largestFreeBlock;
+};
+
+struct ResourceTaskStats {
+    char name[RESOURCE_TASK_NAME_LENGTH];
+    uint32_t stackHighWaterMark;    // Bytes of the stack never used since the task started
+    uint32_t runTimeUs;             // Run time counter of the task (wraps around)
+    uint16_t cpuPermille;           // Share of one core since the previous sample
+};
+
+struct ResourceSample {
+    uint32_t uptimeMs;
+    ResourceHeapStats internalHeap;
+    ResourceHeapStats psramHeap;    // All 0 without PSRAM
+    bool hasPsram;
+    uint8_t taskCount;              // 0 if the run time stats are disabled, or there are more tasks than RESOURCE_MAX_TASKS
+    int8_t lowestStackTask;         // Index of the task with the least free stack, -1 if there are no task stats
+    ResourceTaskStats tasks[RESOURCE_MAX_TASKS];
+};
+
+struct ResourceThresholds {
+    uint32_t stackBytes;
+    uint32_t internalFreeBytes;
+    uint32_t internalBlockBytes;
+    uint32_t psramFreeBytes;
+};
+
+
+// Resource Manager ---------------------------------------------------------------------------------------------
+/*
+    Resource monitor: a low priority task samples the stack high-water mark and the run time of every task, and
+    the free, minimum free and largest free block of the internal and the PSRAM heap every RESOURCE_SAMPLE_PERIOD_MS.
+    The alarms are logged when they are raised or cleared, and sent in the telemetry frames (TelemetryManager)
+    with the largest free blocks, so the task stacks and the buffers can be sized from measured data.
+*/
+class ResourceManager {
+// Init resource manager ------------------------------------------------
+private:
+    ResourceManager();
+
+// Sampling -------------------------------------------------------------
+private:
+    // Run time of the previous sample (matched by task number)
+    UBaseType_t lastTaskNumbers[RESOURCE_MAX_TASKS];
+    uint32_t lastTaskRunTimes[RESOURCE_MAX_TASKS];
+    uint8_t lastTaskCount;
+    uint32_t lastTotalRunTime;
+
+    void sampleTasks(ResourceSample& sample);
+
+public:
+    /**
+     * @brief Sample the heaps and the tasks (the CPU usage is measured since the previous call).
+     *
+     * @param sample The sample to fill.
+     */
+    void sample(ResourceSample& sample);
+
+// Alarms ---------------------------------------------------------------
+private:
+    static inline std::atomic<uint8_t> activeAlarms{RESOURCE_ALARM_NONE};
+
+public:
+    static const ResourceThresholds DEFAULT_THRESHOLDS;
+
+    /**
+     * @brief Evaluate the alarms of a sample. An active alarm is only cleared when its value is back above
+     * the threshold + RESOURCE_ALARM_HYSTERESIS_PERCENT, so a value around the threshold does not flood the log.
+     *
+     * @param sample The resource sample.
+     * @param thresholds The alarm thresholds.
+     * @param previousAlarms The alarms of the previous evaluation (RESOURCE_ALARM_*).
+     * @return uint8_t The active alarms (RESOURCE_ALARM_*).
+     */
+    static uint8_t evaluateAlarms(const ResourceSample& sample, const ResourceThresholds& thresholds, uint8_t previousAlarms);
+
+    /**
+     * @brief The alarms of the last sample of the monitor task (RESOURCE_ALARM_NONE if the monitor is not running).
+     */
+    static uint8_t getActiveAlarms() { return activeAlarms.load(std::memory_order_relaxed); }
+
+// Monitor task ---------------------------------------------------------
+private:
+    SemaphoreHandle_t sampleMutex;  // Sampling (the task stats of the previous sample) and lastSample
+    ResourceSample monitorSample;   // Only used by the monitor task
+    ResourceSample lastSample;      // Written by the monitor task, copied out by getLastSample()
+    bool hasLastSample;
+    TaskHandle_t monitorTaskHandle;
+
+    static void taskResourceMonitor(void *pvParameters);
+
+    void logAlarmChanges(const ResourceSample& sample, uint8_t previousAlarms, uint8_t alarms);
+
+public:
+    /**
+     * @brief Start the monitor task (started by the constructor).
+     */
+    void startMonitorTask();
+
+    void stopMonitorTask();
+
+    /**
+     * @brief Copy the last sample of the monitor task.
+     *
+     * @param sample The copy.
+     * @return true If the monitor task took a sample already.
+     */
+    bool getLastSample(ResourceSample& sample);
+
+// Deinit resource manager ----------------------------------------------
+public:
+    ~ResourceManager();
+
+// Singleton ------------------------------------------------------------
+private:
+    static ResourceManager* instance;
+
+public:
+    ResourceManager(const ResourceManager& resourceManager) = delete;
+
+    ResourceManager& operator=(const ResourceManager& resourceManager) = delete;
+
+    static void init();
+
+    static ResourceManager* getInstance() { return instance; }
+
+    static void deinit();
+};
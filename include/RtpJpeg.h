@@ -0,0 +1,135 @@
+/*
+ * File: RtpJpeg.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+}
+
+// RTP configuration
+#define RTP_JPEG_PAYLOAD_TYPE           26      // Static payload type of JPEG (RFC 3551)
+#define RTP_FEC_PAYLOAD_TYPE            127     // Dynamic: the parity packets, with their own SSRC (media + 1) and sequence
+#define RTP_CLOCK_RATE_HZ               90000
+#define RTP_MAX_PACKET_SIZE             1400    // UDP payload: below the Wi-Fi MTU (1500) with the IP and UDP headers
+#define RTP_FEC_MAX_GROUP_SIZE          16      // Media packets protected by one parity packet
+#define RTP_JPEG_MAX_DIMENSION          2040    // Width and height are sent in 8 pixel units in one byte
+
+// Packet layout (big endian)
+#define RTP_HEADER_SIZE                 12
+#define RTP_JPEG_HEADER_SIZE            8
+#define RTP_RESTART_HEADER_SIZE         4
+#define RTP_QUANTIZATION_HEADER_SIZE    4
+#define RTP_FEC_HEADER_SIZE             8
+
+// RFC 2435 fields
+#define RTP_JPEG_Q_INBAND               255     // The quantization tables are in the first packet of every frame
+#define RTP_JPEG_TYPE_MASK              0x3F
+#define RTP_JPEG_RESTART                64
+
+// JPEG markers
+#define JPEG_SOI                        0xD8
+#define JPEG_EOI                        0xD9
+#define JPEG_SOF0                       0xC0    // Baseline
+#define JPEG_DHT                        0xC4
+#define JPEG_DQT                        0xDB
+#define JPEG_DRI                        0xDD
+#define JPEG_SOS                        0xDA
+
+
+// JPEG ---------------------------------------------------------------------------------------------------------
+/*
+    A baseline JPEG of the camera, split for RFC 2435: the receiver rebuilds the headers from the type, the size and
+    the quantization tables, only the entropy coded scan is sent. The Huffman tables have to be the standard ones
+    (the JPEG encoders of the sensors and of frame2jpg use them).
+*/
+struct RtpJpegImage {
+    uint8_t type;                   // 0: YUV 4:2:2, 1: YUV 4:2:0, + 64 with restart markers
+    uint16_t width;
+    uint16_t height;
+    uint16_t restartInterval;       // MCUs, 0: no restart markers
+    uint8_t quantizationTables[128];    // Luminance and chrominance, 8 bit, zigzag order (like DQT)
+    uint16_t quantizationLength;
+    const uint8_t* scan;            // After SOS, up to EOI
+    size_t scanLength;
+};
+
+
+// Packetizer ---------------------------------------------------------------------------------------------------
+/*
+    RTP/JPEG sender (RFC 2435): one frame is split into packets of at most RTP_MAX_PACKET_SIZE bytes, the first one
+    carries the quantization tables (Q = 255, so a quality change of the sensor needs no signaling). With a FEC group
+    size, a parity packet follows every group of media packets of a frame: the XOR of their payloads, so the receiver
+    restores one lost packet per group instead of losing the frame. No allocation, the packets are built in place.
+*/
+class RtpJpegPacketizer {
+public:
+    /**
+     * @brief Called for every packet in order. False aborts the rest of the frame (the send queue is full).
+     */
+    typedef bool (*PacketCallback)(const uint8_t* packet, size_t length, bool isFec, void* context);
+
+    /**
+     * @param ssrc Random per stream, the parity packets use ssrc + 1.
+     * @param fecGroupSize Media packets per parity packet (up to RTP_FEC_MAX_GROUP_SIZE), 0: no FEC.
+     */
+    RtpJpegPacketizer(uint32_t ssrc = 0, uint8_t fecGroupSize = 0) { reset(ssrc, fecGroupSize); }
+
+    /**
+     * @brief Start a new stream (the sequence numbers start from the SSRC, like a random start).
+     */
+    void reset(uint32_t ssrc, uint8_t fecGroupSize);
+
+    /**
+     * @brief Find the parts of a baseline JPEG that RFC 2435 sends.
+     *
+     * @return esp_err_t ESP_ERR_NOT_SUPPORTED if the JPEG cannot be sent as RTP/JPEG (progressive, grayscale,
+     * 16 bit tables, other sampling, too large), ESP_ERR_INVALID_ARG if it is truncated.
+     */
+    static esp_err_t parse(const uint8_t* jpeg, size_t length, RtpJpegImage& image);
+
+    /**
+     * @brief Send one frame. The RTP timestamp is the capture time on the 90 kHz clock.
+     *
+     * @return esp_err_t ESP_FAIL if the callback aborted the frame, the errors of parse().
+     */
+    esp_err_t packetize(const uint8_t* jpeg, size_t length, int64_t captureTimeUs, PacketCallback send, void* context);
+
+    static uint32_t toRtpTimestamp(int64_t timeUs) { return uint32_t(uint64_t(timeUs) * 9 / 100); }
+
+    uint8_t getFecGroupSize() const { return fecGroupSize; }
+
+private:
+    uint32_t ssrc;
+    uint8_t fecGroupSize;
+    uint16_t sequence;
+    uint16_t fecSequence;
+    uint8_t packet[RTP_MAX_PACKET_SIZE];
+
+    // Parity of the current group
+    uint8_t parity[RTP_MAX_PACKET_SIZE - RTP_HEADER_SIZE - RTP_FEC_HEADER_SIZE];
+    size_t parityLength;
+    uint16_t groupFirstSequence;
+    uint8_t groupCount;
+    uint16_t lengthParity;
+    uint8_t markerParity;
+
+    void addToParity(const uint8_t* payload, size_t length, bool isMarker);
+
+    bool sendParity(uint32_t timestamp, PacketCallback send, void* context);
+};
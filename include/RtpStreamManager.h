@@ -0,0 +1,166 @@
+/*
+ * File: RtpStreamManager.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+#include "RtpJpeg.h"
+
+// C++
+#include <atomic>
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+}
+
+// RTP stream configuration
+#define RTP_STREAM_STACK_SIZE           4096
+#define RTP_STREAM_PRIORITY             5       // Like the MJPEG stream task
+#define RTP_STREAM_CORE                 0       // With the Wi-Fi, the motor loop runs on core 1
+#define RTP_STREAM_STOP_TIMEOUT_MS      1000    // A send never blocks, the task ends after the current frame
+#define RTP_DEFAULT_FEC_GROUP_SIZE      4       // One parity packet per 4 media packets (25 % more data)
+#define RTP_LEASE_MS                    10000   // The stream stops this long after the last /rtp request of its client
+#define RTP_MAX_FRAME_AGE_MS            150     // An older frame is dropped instead of sent late
+#define RTP_JPEG_QUALITY                80      // A raw frame is converted with this quality, like the MJPEG stream
+
+// Pacing: the packets of a frame leave in bursts instead of all at once, so a large frame does not fill the Wi-Fi
+// queue in front of the command responses. The burst is about one tick (10 ms) of the rate, the task sleeps in ticks.
+#define RTP_PACING_RATE_BYTES_PER_S     1500000 // 12 Mbit/s
+#define RTP_PACING_BURST_BYTES          16384
+
+
+// RTP Pacer ----------------------------------------------------------------------------------------------------
+/*
+    Token bucket of the stream: up to burstBytes go out back to back, after that the packets are spaced at the rate.
+*/
+class RtpPacer {
+public:
+    RtpPacer(uint32_t bytesPerSecond, uint32_t burstBytes);
+
+    /**
+     * @brief Account a packet sent at nowUs (or later, after the returned wait).
+     *
+     * @return uint32_t The time to wait before the packet is sent, 0: right now.
+     */
+    uint32_t reserve(size_t bytes, int64_t nowUs);
+
+private:
+    uint32_t bytesPerSecond;
+    uint32_t burstUs;
+    int64_t busyUntilUs;            // The queued packets are sent at the rate by then
+};
+
+// RTP Stream Stats ---------------------------------------------------------------------------------------------
+struct RtpStreamStats {
+    uint32_t streams;               // Streams started since boot
+    bool isActive;
+    uint32_t framesSent;
+    uint32_t framesDropped;         // Late, not RTP/JPEG, conversion failed, or the send queue was full
+    uint32_t packetsSent;
+    uint32_t fecPacketsSent;
+    uint32_t sendErrors;            // sendto() failed, the rest of the frame was dropped
+    uint32_t averageSendTimeUs;     // First to last packet of a frame, with the pacing
+};
+
+// RTP Stream Manager -------------------------------------------------------------------------------------------
+/*
+    RTP/JPEG (RFC 2435) on UDP to one client, the alternative of the MJPEG stream (/str) on lossy Wi-Fi: a lost
+    packet loses one frame instead of stalling the TCP connection and the command responses behind it. The client
+    requests the stream on the video server (/rtp), and repeats the request within RTP_LEASE_MS, otherwise the stream
+    stops (UDP has no connection that ends with the client). One camera stream at a time, /str or /rtp.
+*/
+class RtpStreamManager {
+// Init RTP stream manager ----------------------------------------------
+private:
+    RtpStreamManager();
+
+// Stats ----------------------------------------------------------------
+/*
+    Written by the stream task, read by /sst: single 32 bit atomics with relaxed ordering (like TelemetryManager).
+*/
+private:
+    static inline std::atomic<uint32_t> streams{0};
+    static inline std::atomic<bool> isActive{false};
+    static inline std::atomic<uint32_t> framesSent{0};
+    static inline std::atomic<uint32_t> framesDropped{0};
+    static inline std::atomic<uint32_t> packetsSent{0};
+    static inline std::atomic<uint32_t> fecPacketsSent{0};
+    static inline std::atomic<uint32_t> sendErrors{0};
+    static inline std::atomic<uint32_t> averageSendTimeUs{0};
+
+public:
+    static RtpStreamStats getStats();
+
+// Stream ---------------------------------------------------------------
+private:
+    std::atomic<bool> isStreamEnabled;          // Cleared to stop the stream
+    std::atomic<bool> isStreamRunning;          // Cleared by the stream task when it closed the socket
+    std::atomic<uint32_t> leaseEndMs;           // Renewed by every /rtp request of the client
+    uint32_t destinationAddress;                // IPv4, network byte order
+    uint16_t destinationPort;
+    int streamSocket;                           // Owned by the stream task
+    RtpJpegPacketizer packetizer;               // Only used by the stream task
+    RtpPacer pacer;
+
+    static void taskRtpStream(void *pvParameters);
+
+    static bool sendPacket(const uint8_t* packet, size_t length, bool isFec, void* context);
+
+public:
+    /**
+     * @brief Start the stream, or renew the lease of the running stream of the same client.
+     *
+     * @param address IPv4 address of the client, network byte order.
+     * @param port UDP port of the client (host byte order).
+     * @param fecGroupSize Media packets per parity packet, 0: no FEC (a renewal keeps the running one).
+     * @return esp_err_t ESP_ERR_INVALID_STATE if a stream to another client is running, ESP_FAIL if the socket or the
+     * task cannot be created.
+     */
+    esp_err_t startStream(uint32_t address, uint16_t port, uint8_t fecGroupSize);
+
+    /**
+     * @brief Stop the stream and wait for the stream task to end.
+     *
+     * @return esp_err_t ESP_ERR_TIMEOUT if the task still runs after RTP_STREAM_STOP_TIMEOUT_MS (it ends later).
+     */
+    esp_err_t stopStream();
+
+    bool isStreaming() const { return isStreamRunning; }
+
+// Deinit RTP stream manager --------------------------------------------
+public:
+    ~RtpStreamManager();
+
+// Singleton ------------------------------------------------------------
+private:
+    static RtpStreamManager* instance;
+
+public:
+    RtpStreamManager(const RtpStreamManager& rtpStreamManager) = delete;
+
+    RtpStreamManager& operator=(const RtpStreamManager& rtpStreamManager) = delete;
+
+    static void init();
+
+    static RtpStreamManager* getInstance() { return instance; }
+
+    /**
+     * @brief Stop the stream and delete the instance, it is kept if the stream task did not end (call it again later).
+     */
+    static void deinit();
+};
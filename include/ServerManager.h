@@ -14,11 +14,75 @@
 #pragma once
 
 #include "DebugAndVersionControl.h"
+#include "ClockSync.h"
 
 extern "C" {
 #include "esp_http_server.h"
+#include <stdint.h>
 }
 
+// Command server configuration
+#define COMMAND_SERVER_PORT                     80
+#define COMMAND_SERVER_MAX_OPEN_SOCKETS         4   // Controller + settings app + spares, the least recently used session is purged
+#define COMMAND_SERVER_MAX_URI_HANDLERS         24  // The default (8) is already used up, room for a few more
+#define COMMAND_SERVER_KEEP_ALIVE_IDLE_S        5   // TCP keep-alive, frees the session of a lost controller
+#define COMMAND_SERVER_KEEP_ALIVE_INTERVAL_S    2
+#define COMMAND_SERVER_KEEP_ALIVE_COUNT         3
+#define COMMAND_SERVER_BODY_TIMEOUTS            3   // Receive timeouts (5 s each) of a request body, then 408
+#define COMMAND_SERVER_ARENA_SIZE               1024    // Largest request: the query (HTTPD_MAX_URI_LEN) or the settings body + response
+
+// Video server configuration
+#define VIDEO_SERVER_PORT                       81
+#define VIDEO_SERVER_MAX_OPEN_SOCKETS           2   // One stream + one snapshot client (both servers share the 10 LWIP sockets)
+#define VIDEO_SERVER_ARENA_SIZE                 256     // The headers of a snapshot, or the SDP of /rtp
+#define VIDEO_STREAM_STACK_SIZE                 4096    // The stream loop ran on the server task before (same stack)
+#define VIDEO_STREAM_PRIORITY                   5       // Like the server task
+#define VIDEO_STREAM_CORE                       0       // With the Wi-Fi, the motor loop runs on core 1
+#define VIDEO_STREAM_STOP_TIMEOUT_MS            5500    // Longer than the send timeout of the video server (5 s)
+
+
+// Session Stats ------------------------------------------------------------------
+/*
+    Per-session statistics of the command server, stored in a fixed pool (one slot per open socket).
+    Every field is only touched by the command server task, so there is no locking.
+*/
+struct CommandSessionStats {
+    bool isUsed;
+    int socket;
+    uint32_t requests;
+    int64_t openedAtUs;
+    int64_t lastRequestAtUs;
+    uint32_t maxHandlerTimeUs;
+    uint64_t totalHandlerTimeUs;
+};
+
+// Allocation Check ---------------------------------------------------------------
+/*
+    Debug check of the control requests (SERVER_ALLOCATION_CHECK in DebugAndVersionControl.h): the heap allocations
+    of the command server task are counted while the /mov handler runs (ESP-IDF heap hooks, CONFIG_HEAP_USE_HOOKS),
+    a request that allocated is logged and counted. The handlers use the request arena of their server instead.
+*/
+struct ServerAllocationStats {
+    uint32_t checkedRequests;
+    uint32_t allocatingRequests;    // Has to stay 0
+    uint32_t lastAllocations;       // Allocations of the last allocating request
+};
+
+// Stream Stats -------------------------------------------------------------------
+/*
+    Stats of the current (or the last) MJPEG stream of the video server, reset when a stream starts. The stream
+    handler publishes them after every frame, /sst of the command server reports them.
+*/
+struct VideoStreamStats {
+    uint32_t streams;               // Streams started since boot
+    bool isActive;
+    uint32_t framesSent;
+    uint32_t framesDropped;         // Taken from the camera and not sent (JPEG conversion or send failed)
+    uint32_t averageSendTimeUs;     // Part header and JPEG, on the socket
+    uint32_t maxSendTimeUs;
+    uint32_t averageAgeUs;          // Capture to send start (the frame waited in a buffer)
+};
+
 // Server Manager ----------------------------------------------------------------
 class ServerManager {
 // Init server manager ---------------------------------------------------
@@ -32,17 +96,60 @@ private:
     httpd_uri_t disconnectionUri;
     httpd_uri_t moveUri;
     httpd_uri_t getSettingsUri;
+    httpd_uri_t setSettingsUri;
     httpd_uri_t setWiFiUri;
     httpd_uri_t setLedUri;
     httpd_uri_t setRoomPlantModeUri;
+    httpd_uri_t setModeUri;
+    httpd_uri_t sessionStatsUri;
+    httpd_uri_t telemetryUri;
+    httpd_uri_t logUri;
+    httpd_uri_t traceUri;
+    httpd_uri_t cameraUri;
+    httpd_uri_t visionUri;
+    httpd_uri_t lineFollowUri;
+    httpd_uri_t photoUri;
+    httpd_uri_t dashcamUri;
+    httpd_uri_t flightRecorderUri;
+    httpd_uri_t controlJitterUri;
+    httpd_uri_t clockSyncUri;
 
 // Video Server ----------------------------------------------------------
 private:
     httpd_uri_t streamUri;
+    httpd_uri_t snapshotUri;
+    httpd_uri_t rtpUri;
+    httpd_uri_t stillUri;
+    httpd_uri_t dashcamDownloadUri;
 
 // Servers ---------------------------------------------------------------
 public:
     void startServers();
+    void stopServers();
+
+    void startCommandServer();
+    void stopCommandServer();
+
+    void startVideoServer();
+    void stopVideoServer();
+
+    bool isCommandServerRunning() const;
+    bool isVideoServerRunning() const;
+
+    /**
+     * @brief The stats of the allocation check (all 0 if SERVER_ALLOCATION_CHECK or CONFIG_HEAP_USE_HOOKS is disabled).
+     */
+    static ServerAllocationStats getAllocationStats();
+
+    /**
+     * @brief The stats of the current or the last stream (all 0 before the first stream).
+     */
+    static VideoStreamStats getStreamStats();
+
+    /**
+     * @brief The clock sync of the operator (/syn), all 0 before the server manager is created.
+     */
+    static ClockSyncStats getClockSyncStats();
 
 // Deinit server manager -------------------------------------------------
 public:
@@ -59,7 +166,7 @@ public:
 
     static ServerManager* getInstance();
 
-    static void deinit() { delete instance; }
+    static void deinit() { delete instance; instance = nullptr; }
 };
 
 // DONE: ServerManager.h VERSION_ALPHA
\ No newline at end of file
@@ -0,0 +1,68 @@
+/*
+ * File: SettingsJson.h
+ * Project: drone_r6_fw
+ * File Created: Wednesday, 5th March 2025 8:05:47 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Wednesday, 5th March 2025 8:05:47 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "JsonStream.h"
+#include "StorageManager.h"
+
+// Settings JSON configuration
+#define SETTINGS_JSON_MAX_LENGTH    256 // Max request and response body length
+
+// Settings fields (bit mask)
+#define SETTINGS_FIELD_SSID         (1U << 0)
+#define SETTINGS_FIELD_PASSWORD     (1U << 1)
+#define SETTINGS_FIELD_COLOR        (1U << 2)
+#define SETTINGS_FIELD_ALL          (SETTINGS_FIELD_SSID | SETTINGS_FIELD_PASSWORD | SETTINGS_FIELD_COLOR)
+
+/*
+    Settings JSON format (every field is optional in a request, the password is never sent back):
+    {
+        "ssid": "ssid",
+        "password": "password",
+        "color": 2
+    }
+*/
+
+
+// Settings Update ----------------------------------------------------------------------------------------------
+struct SettingsUpdate {
+    uint8_t fields; // The received fields (SETTINGS_FIELD_*)
+    char ssid[STORAGE_MAX_STRING_LENGTH + 1];
+    char password[STORAGE_MAX_STRING_LENGTH + 1];
+    int8_t colorNumber;
+};
+
+namespace SettingsJson {
+    /**
+     * @brief Write the settings as JSON (without the password).
+     *
+     * @param buffer The output buffer.
+     * @param size The size of the output buffer.
+     * @param ssid The Wi-Fi SSID.
+     * @param colorNumber The gadget color number.
+     * @return size_t The length of the JSON, 0 if the buffer is too small.
+     */
+    size_t write(char* buffer, size_t size, const char* ssid, int8_t colorNumber);
+
+    /**
+     * @brief Parse and validate a settings JSON. Nothing is applied, if any field is invalid.
+     *
+     * @param json The JSON (does not have to be zero terminated).
+     * @param length The length of the JSON.
+     * @param allowedFields The fields which can be set with this request (SETTINGS_FIELD_*).
+     * @param update The parsed settings.
+     * @return true If the JSON is valid, has only allowed fields, and every value is in range.
+     */
+    bool parse(const char* json, size_t length, uint8_t allowedFields, SettingsUpdate& update);
+}
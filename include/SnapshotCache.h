@@ -0,0 +1,143 @@
+/*
+ * File: SnapshotCache.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+
+// C++
+#include <atomic>
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+}
+
+// Snapshot configuration
+#define SNAPSHOT_MAX_AGE_MS             200     // Default of /jpg, an older cached frame is captured again
+#define SNAPSHOT_MAX_AGE_LIMIT_MS       60000   // The largest maxAge of /jpg
+#define SNAPSHOT_PUBLISH_INTERVAL_MS    100     // A running stream copies a frame this often (below the default max age)
+#define SNAPSHOT_JPEG_QUALITY           80      // A raw frame is converted with this quality, like the stream does
+
+
+// Snapshot Frame -----------------------------------------------------------------------------------------------
+/*
+    A JPEG copy of a camera frame, one allocation with its data (PSRAM first). It is shared by the cache and the
+    requests that send it, and freed when the last reference is released.
+*/
+struct SnapshotFrame {
+    uint8_t* data;
+    size_t length;
+    uint16_t width;
+    uint16_t height;
+    int64_t timestampUs;            // Capture time (esp_timer), the ETag of /jpg
+    uint32_t refCount;              // Guarded by the cache mutex
+};
+
+struct SnapshotCacheStats {
+    uint32_t requests;
+    uint32_t hits;                  // Served from the cache (or the capture of a concurrent request)
+    uint32_t captures;              // Frames taken from the camera for a stale cache
+    uint32_t publishes;             // Frames copied from the stream
+    uint32_t failures;              // Capture, conversion or allocation failed
+};
+
+
+// Snapshot Cache -----------------------------------------------------------------------------------------------
+/*
+    The latest frame of the camera for the snapshot endpoint (/jpg), so a thumbnail or a health check does not open
+    a stream and does not hold a frame buffer of the driver. A running stream publishes a copy every
+    SNAPSHOT_PUBLISH_INTERVAL_MS; a request with a stale cache captures one frame, and the requests arriving during
+    that capture wait for it instead of capturing again (at most one capture at a time, from any task).
+    Started and stopped with the video server.
+*/
+class SnapshotCache {
+// Init snapshot cache --------------------------------------------------
+private:
+    SnapshotCache();
+
+// Frames ---------------------------------------------------------------
+private:
+    SemaphoreHandle_t cacheMutex;   // The current frame and the reference counts, held for a few instructions
+    SemaphoreHandle_t captureMutex; // One capture at a time, the waiting requests use its frame
+    SnapshotFrame* current;
+    std::atomic<int64_t> currentTimestampUs{0}; // Of the current frame, the stream checks it without a lock
+    SnapshotCacheStats stats;       // Guarded by the cache mutex
+
+    static SnapshotFrame* createFrame(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height, int64_t timestampUs);
+
+    /**
+     * @brief Take a reference of the current frame if it is not older than maxAgeUs (cache mutex held).
+     */
+    SnapshotFrame* acquireCurrentLocked(int64_t maxAgeUs);
+
+    /**
+     * @brief Make a frame the current one, the cache takes a reference and releases the previous frame. A frame
+     * older than the current one is not cached.
+     */
+    void replaceCurrent(SnapshotFrame* frame);
+
+    /**
+     * @brief Capture a frame and convert it to JPEG if the sensor does not send JPEG.
+     */
+    SnapshotFrame* captureFrame();
+
+public:
+    /**
+     * @brief The current frame if it is not older than maxAgeMs, otherwise a new capture (or the capture of a
+     * concurrent request). Every acquired frame has to be released.
+     *
+     * @param maxAgeMs The largest accepted age of a cached frame.
+     * @param frame The frame, nullptr on error.
+     * @return esp_err_t ESP_FAIL if the capture, the conversion or the copy failed.
+     */
+    esp_err_t acquire(uint32_t maxAgeMs, const SnapshotFrame*& frame);
+
+    void release(const SnapshotFrame* frame);
+
+    /**
+     * @brief A frame captured at timestampUs should be published (the current one is SNAPSHOT_PUBLISH_INTERVAL_MS old).
+     * No lock, called for every frame of the stream.
+     */
+    bool isPublishDue(int64_t timestampUs) const;
+
+    /**
+     * @brief Copy a JPEG frame of the stream into the cache.
+     */
+    void publish(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height, int64_t timestampUs);
+
+    SnapshotCacheStats getStats();
+
+// Deinit snapshot cache ------------------------------------------------
+public:
+    ~SnapshotCache();
+
+// Singleton ------------------------------------------------------------
+private:
+    static SnapshotCache* instance;
+
+public:
+    SnapshotCache(const SnapshotCache& snapshotCache) = delete;
+
+    SnapshotCache& operator=(const SnapshotCache& snapshotCache) = delete;
+
+    static void init();
+
+    static SnapshotCache* getInstance() { return instance; }
+
+    static void deinit();
+};
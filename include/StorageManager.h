@@ -15,18 +15,20 @@
 
 #include "DebugAndVersionControl.h"
 #include "AuthAndPasswords.h" // Comment out if not nexist
+#include "Hal.h"
 
 // C++
 #include <iostream>
-#include "nvs_handle.hpp"
-#include "nvs_flash.h"
-#include "nvs.h"
 
 #ifndef AUTH_AND_PASSWORDS
 #define WIFI_SSID "Your wifi SSID"
 #define WIFI_PASSWORD "Your wifi password"
 #endif
 
+// Storage limits
+#define STORAGE_MAX_STRING_LENGTH   30  // Max length of the stored SSID and password
+#define STORAGE_MAX_COLOR_NUMBER    3   // See Colors::getGadgetColor
+
 
 
 // init storage manager
@@ -50,7 +52,7 @@ private:
 // Datas ----------------------------------------------------------------
 private:
     // Storage handle
-    std::unique_ptr<nvs::NVSHandle> nvsHandle;
+    HalStorageHandle storageHandle;
 
     // WiFi data
     std::string WiFiSSID;
@@ -69,12 +71,12 @@ private:
     void commitColorDataToStorage();
 
 public:
-    void setWiFiSSID(const std::string ssid);
-    void setWiFiPassword(const std::string password);
+    void setWiFiSSID(const char* ssid);
+    void setWiFiPassword(const char* password);
     void setColorNumber(int8_t colorNumber);
 
-    std::string getWiFiSSID() const { return WiFiSSID; }
-    std::string getWiFiPassword() const { return WiFiPassword; }
+    const std::string& getWiFiSSID() const { return WiFiSSID; }
+    const std::string& getWiFiPassword() const { return WiFiPassword; }
     int8_t getColorNumber() const { return ColorNumber; }
 
     void getAllDataFromStorage();
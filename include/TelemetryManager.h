@@ -0,0 +1,214 @@
+/*
+ * File: TelemetryManager.h
+ * Project: drone_r6_fw
+ * File Created: Thursday, 6th March 2025 7:12:44 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Thursday, 6th March 2025 7:12:44 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+#include "ClockSync.h"
+#include "Hal.h"
+
+// C++
+#include <atomic>
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+}
+
+// Telemetry configuration
+#define TELEMETRY_DEFAULT_RATE_HZ       10
+#define TELEMETRY_MIN_RATE_HZ           1
+#define TELEMETRY_MAX_RATE_HZ           50  // The motor loop runs at 50 Hz, a faster rate would repeat the same duties
+#define TELEMETRY_MAX_TASKS             16  // Task entries in one frame, the busiest tasks are sent
+#define TELEMETRY_MAX_SYSTEM_TASKS      24  // Every task of the system has to fit, otherwise the task stats are skipped
+#define TELEMETRY_TASK_NAME_LENGTH      8   // Truncated, not zero terminated if the name is longer
+#define TELEMETRY_STREAM_STACK_SIZE     3072
+#define TELEMETRY_STREAM_PRIORITY       2   // Below the motor (5) and the LED tasks
+#define TELEMETRY_STOP_TIMEOUT_MS       5500    // Longer than the send timeout of the command server (5 s)
+
+// Telemetry frame
+#define TELEMETRY_FRAME_MAGIC           0x4D54  // "TM" (little endian)
+#define TELEMETRY_FRAME_VERSION         4
+#define TELEMETRY_NO_CONTROL_DATA       UINT32_MAX
+
+
+// Telemetry Frame ----------------------------------------------------------------------------------------------
+/*
+    Binary frame of the telemetry stream (little endian, packed). The header is followed by header.taskCount task entries,
+    header.length is the length of the whole frame. The frames are sent back to back in a chunked HTTP response,
+    the decoder is tools/telemetry_decode.py (keep the two layouts in sync, and bump the version on every change).
+*/
+struct __attribute__((packed)) TelemetryFrameHeader {
+    uint16_t magic;                 // TELEMETRY_FRAME_MAGIC
+    uint8_t version;                // TELEMETRY_FRAME_VERSION
+    uint8_t taskCount;
+    uint16_t length;
+    uint32_t sequence;              // Continuous, a gap means lost frames
+    uint32_t uptimeMs;
+    int16_t leftMotorDuty;          // Applied LEDC duty (8 bit), negative: counter-clockwise
+    int16_t rightMotorDuty;
+    uint32_t controlDataAgeMs;      // Since the last /mov command, TELEMETRY_NO_CONTROL_DATA: no command yet
+    uint16_t cameraFpsX10;          // Streamed frames per second * 10
+    int8_t rssi;                    // dBm of the access point, 0: not connected
+    uint8_t mode;                   // DroneMode
+    uint32_t streamBytesPerSec;
+    uint32_t freeInternalHeap;
+    uint32_t minFreeInternalHeap;
+    uint32_t freePsramHeap;
+    uint32_t largestFreeInternalBlock;
+    uint32_t largestFreePsramBlock;
+    uint8_t resourceAlarms;         // RESOURCE_ALARM_* of the resource monitor (ResourceManager.h)
+    int16_t forwardSpeedMmPerS;     // Optical flow odometry (VisionManager), negative: backward
+    int16_t yawRateDeciDegPerS;     // Positive: turning right
+    uint8_t odometryBlocks;         // Matched floor crops, 0: no estimate (the speeds are 0)
+    int64_t clockOffsetUs;          // Drone clock - operator clock of the clock sync (/syn, ClockSync.h)
+    uint32_t clockRttUs;            // Fastest exchange of the sync window, the offset is within +- half of it
+    uint8_t clockRttHistogram[CLOCK_SYNC_HISTOGRAM_BINS];     // Round trips of the window: < 1, 2, 5, 10, 20, 50, 100 ms, more
+    uint8_t clockOffsetHistogram[CLOCK_SYNC_HISTOGRAM_BINS];  // Distance of the window offsets from clockOffsetUs (same bins), all 0: no sync
+};
+
+struct __attribute__((packed)) TelemetryTaskEntry {
+    char name[TELEMETRY_TASK_NAME_LENGTH];
+    uint16_t cpuPermille;           // Share of one core since the previous frame
+    uint16_t stackHighWaterMark;    // Free stack bytes at the deepest use so far (saturated)
+};
+
+struct __attribute__((packed)) TelemetryFrame {
+    TelemetryFrameHeader header;
+    TelemetryTaskEntry tasks[TELEMETRY_MAX_TASKS];
+};
+
+static_assert(sizeof(TelemetryFrameHeader) == 84, "The telemetry header layout is shared with tools/telemetry_decode.py");
+static_assert(sizeof(TelemetryTaskEntry) == 12, "The telemetry task layout is shared with tools/telemetry_decode.py");
+
+
+// Telemetry Manager --------------------------------------------------------------------------------------------
+class TelemetryManager {
+// Init telemetry manager -----------------------------------------------
+private:
+    TelemetryManager();
+
+// Counters -------------------------------------------------------------
+/*
+    Updated on the hot paths (motor loop, command handlers, stream handler) without locks: every counter is
+    a single 32 bit atomic (lock-free on the ESP32), written with relaxed ordering. The telemetry task only reads them.
+*/
+private:
+    static inline std::atomic<uint32_t> motorDuties{0};         // Left duty in the low, right duty in the high 16 bits (one store, always a consistent pair)
+    static inline std::atomic<uint32_t> controlDataAtMs{0};     // 0: no control data yet
+    static inline std::atomic<uint32_t> streamFrames{0};
+    static inline std::atomic<uint32_t> streamBytes{0};         // Wraps around, only the differences are used
+
+public:
+    static void recordMotorDuties(int16_t left, int16_t right) {
+        motorDuties.store(uint32_t(uint16_t(left)) | (uint32_t(uint16_t(right)) << 16), std::memory_order_relaxed);
+    }
+
+    static void recordControlData() {
+        uint32_t nowMs = uint32_t(Hal::Timer::getTimeUs() / 1000);
+        controlDataAtMs.store(nowMs ? nowMs : 1, std::memory_order_relaxed);
+    }
+
+    static void recordStreamFrame(size_t bytes) {
+        streamFrames.fetch_add(1, std::memory_order_relaxed);
+        streamBytes.fetch_add(uint32_t(bytes), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Scale a counter difference to a rate per second.
+     *
+     * @param delta The counter difference.
+     * @param elapsedUs The time of the difference.
+     * @param scale Multiplier of the result (e.g. 10 for one decimal).
+     * @return uint32_t The rate, 0 if no time elapsed, saturated at UINT32_MAX.
+     */
+    static uint32_t ratePerSecond(uint32_t delta, int64_t elapsedUs, uint32_t scale = 1);
+
+// Frames ---------------------------------------------------------------
+private:
+    uint32_t sequence;
+    int64_t lastSampleUs;
+    uint32_t lastStreamFrames;
+    uint32_t lastStreamBytes;
+
+    // Task stats of the previous frame (matched by task number)
+    UBaseType_t lastTaskNumbers[TELEMETRY_MAX_SYSTEM_TASKS];
+    uint32_t lastTaskRunTimes[TELEMETRY_MAX_SYSTEM_TASKS];
+    uint8_t lastTaskCount;
+    uint32_t lastTotalRunTime;
+
+    uint8_t sampleTasks(TelemetryTaskEntry* entries);
+
+public:
+    /**
+     * @brief Sample the counters and the system stats into a frame. The rates (fps, bytes/sec, CPU usage)
+     * are measured since the previous frame.
+     *
+     * @param frame The frame to fill.
+     * @return size_t The length of the frame (header.length).
+     */
+    size_t sampleFrame(TelemetryFrame& frame);
+
+// Stream ---------------------------------------------------------------
+private:
+    std::atomic<bool> isStreamEnabled;          // Cleared to stop the stream
+    std::atomic<bool> isStreamRunning;          // Cleared by the telemetry task, when it released the request
+    SemaphoreHandle_t streamWakeSemaphore;      // Wakes the telemetry task up between the frames (to stop)
+    httpd_req_t* streamRequest;                 // Async copy of the request, owned by the telemetry task
+    uint8_t streamRateHz;
+
+    static void taskTelemetryStream(void *pvParameters);
+
+public:
+    /**
+     * @brief Take over the request of a command server handler, and push frames on it from the telemetry task,
+     * so the command server can serve the other sessions. Only one stream can run at a time.
+     *
+     * @param req The request of the handler (it is released by the handler after this call).
+     * @param rateHz Frames per second (clamped to TELEMETRY_MIN_RATE_HZ - TELEMETRY_MAX_RATE_HZ).
+     * @return esp_err_t ESP_OK if the stream is started, ESP_ERR_INVALID_STATE if a stream is already running.
+     */
+    esp_err_t startStream(httpd_req_t *req, int rateHz);
+
+    /**
+     * @brief Stop the stream and wait for the telemetry task to release the request.
+     * It has to be called before the command server is stopped.
+     */
+    void stopStream();
+
+    bool isStreaming() const { return isStreamRunning; }
+
+// Deinit telemetry manager ---------------------------------------------
+public:
+    ~TelemetryManager();
+
+// Singleton ------------------------------------------------------------
+private:
+    static TelemetryManager* instance;
+
+public:
+    TelemetryManager(const TelemetryManager& telemetryManager) = delete;
+
+    TelemetryManager& operator=(const TelemetryManager& telemetryManager) = delete;
+
+    static void init();
+
+    static TelemetryManager* getInstance() { return instance; }
+
+    static void deinit();
+};
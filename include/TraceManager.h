@@ -0,0 +1,201 @@
+/*
+ * File: TraceManager.h
+ * Project: drone_r6_fw
+ * File Created: Sunday, 9th March 2025 2:14:36 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Sunday, 9th March 2025 2:14:36 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+
+// C++
+#include <atomic>
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#ifdef ESP_PLATFORM
+#include "esp_cpu.h"
+#else
+#include <time.h>
+#endif
+}
+
+// Trace manager configuration
+#define TRACE_RING_SIZE             256     // Spans per core, power of 2 (the oldest spans are overwritten)
+#define TRACE_MAX_TASKS             24      // Tasks named in the export (uxTaskGetSystemState)
+#define TRACE_EXPORT_BUFFER_SIZE    1024    // The export is written in pieces of this size
+#define TRACE_HOST_TICKS_PER_US     1000    // Host clock: nanoseconds
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE has to be a power of 2");
+
+
+// Trace Macros -------------------------------------------------------------------------------------------------
+/*
+    TRACE_SPAN("name") measures the rest of the enclosing scope: the start is read from the cycle counter (CCOUNT)
+    at the macro, and the span is stored into the ring of the current core when the scope ends.
+    The name has to be a string literal (only its address is stored). Without TRACE_SPANS the macro is removed.
+
+    Example:
+        {
+            TRACE_SPAN("mov");
+            ...
+        }
+*/
+#ifdef TRACE_SPANS
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+#else
+#define TRACE_SPAN(name) do {} while (0)
+#endif
+
+
+// Trace Events -------------------------------------------------------------------------------------------------
+struct TraceEvent {
+    std::atomic<uint32_t> sequence; // Ring position + 1 when the event is complete, 0 while it is written
+    const char* name;
+    TaskHandle_t task;
+    uint32_t startTicks;            // now() (cycles of core 0, host: nanoseconds), wraps around
+    uint32_t durationTicks;
+};
+
+struct TraceSpanRecord {            // A consistent copy of a ring event
+    const char* name;
+    TaskHandle_t task;
+    uint32_t startTicks;
+    uint32_t durationTicks;
+};
+
+
+// Trace Manager ------------------------------------------------------------------------------------------------
+class TraceManager {
+// Init trace manager ---------------------------------------------------
+private:
+    TraceManager();
+
+// Clock ----------------------------------------------------------------
+/*
+    The cycle counters of the two cores are not synchronized, the difference is measured at init (coreOffsets)
+    and removed by now(), so the spans of both cores are on the timeline of core 0. The spans are exact at a fixed CPU frequency only, the counter wraps around in
+    2^32 cycles (~17.9 s at 240 MHz): only the spans of the last half of this window are exported.
+*/
+private:
+    static inline uint32_t coreOffsets[portNUM_PROCESSORS] = {};    // Counter of the core - counter of core 0
+
+    void calibrateCoreOffsets();
+
+public:
+    /**
+     * @brief The cycle counter of the current core, converted to the counter of core 0 (host: nanoseconds).
+     */
+    static inline uint32_t now() {
+#ifdef ESP_PLATFORM
+        return esp_cpu_get_cycle_count() - coreOffsets[xPortGetCoreID()];
+#else
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return uint32_t(uint64_t(time.tv_sec) * 1000000000ULL + uint64_t(time.tv_nsec));
+#endif
+    }
+
+    static uint32_t ticksPerUs();
+
+// Ring -----------------------------------------------------------------
+/*
+    One ring per core, the spans of a core are written by the tasks (and interrupts) of that core only.
+    A writer reserves a position with an atomic increment and publishes the event with its sequence (seqlock),
+    so the export can run on the other core at the same time: a span that is overwritten during the copy is skipped.
+*/
+private:
+    static inline TraceEvent* rings[portNUM_PROCESSORS] = {};
+    static inline std::atomic<uint32_t> writePositions[portNUM_PROCESSORS] = {};
+
+public:
+    /**
+     * @brief Store a finished span into the ring of the current core (use TRACE_SPAN).
+     *
+     * @param name The name of the span (string literal).
+     * @param startTicks now() at the start of the span.
+     * @param endTicks now() at the end of the span.
+     */
+    static void record(const char* name, uint32_t startTicks, uint32_t endTicks);
+
+    /**
+     * @brief The number of spans written into the ring of a core since init (the ring keeps the last TRACE_RING_SIZE).
+     */
+    static uint32_t getWritePosition(uint8_t core) { return writePositions[core].load(std::memory_order_acquire); }
+
+    /**
+     * @brief Copy a span out of the ring.
+     *
+     * @param core The core of the ring.
+     * @param position The position of the span (less than getWritePosition()).
+     * @param record The copy.
+     * @return true If the span is still in the ring and it was not changed during the copy.
+     */
+    static bool readSpan(uint8_t core, uint32_t position, TraceSpanRecord& record);
+
+// Export ---------------------------------------------------------------
+private:
+    TaskStatus_t taskStatuses[TRACE_MAX_TASKS];
+
+public:
+    /**
+     * @brief Write the spans of every core as a Chrome trace (JSON Object Format, "X" complete events, one process per core,
+     * one thread per task). It can be opened with chrome://tracing and https://ui.perfetto.dev
+     *
+     * @param output Called with the pieces of the JSON (at most TRACE_EXPORT_BUFFER_SIZE bytes each).
+     * @param context Passed to the output function.
+     * @return uint32_t The number of exported spans.
+     *
+     * @note Not reentrant (one export at a time, the command server has one task).
+     */
+    uint32_t exportChromeTrace(void (*output)(const char* data, size_t length, void* context), void* context);
+
+// Deinit trace manager -------------------------------------------------
+public:
+    ~TraceManager();
+
+// Singleton ------------------------------------------------------------
+private:
+    static TraceManager* instance;
+
+public:
+    TraceManager(const TraceManager& traceManager) = delete;
+
+    TraceManager& operator=(const TraceManager& traceManager) = delete;
+
+    static void init();
+
+    static TraceManager* getInstance() { return instance; }
+
+    static void deinit();
+};
+
+
+// Trace Span ---------------------------------------------------------------------------------------------------
+class TraceSpan {
+private:
+    const char* name;
+    uint32_t startTicks;
+
+public:
+    TraceSpan(const char* name) : name(name), startTicks(TraceManager::now()) {}
+
+    ~TraceSpan() { TraceManager::record(name, startTicks, TraceManager::now()); }
+
+    TraceSpan(const TraceSpan& traceSpan) = delete;
+
+    TraceSpan& operator=(const TraceSpan& traceSpan) = delete;
+};
@@ -13,16 +13,28 @@
 
 #pragma once
 
-#define UNIT_TESTS // Comment to disable unit tests
+//#define UNIT_TESTS // Uncomment to enable unit tests
+//#define UNIT_TESTS_INTERACTIVE // Uncomment to run the interactive suites too (visual checks, access point, restart)
 
 #ifdef UNIT_TESTS
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 
 // Includes for tests
+#include "CameraManager.h"
+#include "Hal.h"
 #include "LedManager.h"
+#include "LogManager.h"
+#include "ModeManager.h"
+#include "MotorManager.h"
+#include "ResourceManager.h"
+#include "ServerManager.h"
+#include "SettingsJson.h"
+#include "TelemetryManager.h"
+#include "TraceManager.h"
 #include "WiFiModulManager.h"
 #include "StorageManager.h"
 
@@ -31,25 +43,85 @@
 #define TEST_END_PASSED(x) UNIT_PRINT("\n--- %s Unit Test Ended [PASSED] ---\n", x);
 #define TEST_END_FAILED(x) UNIT_PRINT("\n--- %s Unit Test Ended [FAILED] ---\n", x);
 
+/*
+    Checks for the helper functions of the suites (bool return value): a failed check prints the condition
+    and returns false from the calling function.
+*/
+#define UNIT_CHECK(condition) do {                                                                  \
+        if (!(condition)) {                                                                         \
+            UNIT_PRINT("Check failed: %s (%s:%d)", #condition, __FILE__, __LINE__);                 \
+            return false;                                                                           \
+        }                                                                                           \
+    } while (0)
+
+// Timing assertion: the statement has to finish in maxUs (measured with Hal::Timer, once)
+#define UNIT_CHECK_TIME_US(statement, maxUs) do {                                                   \
+        int64_t unitCheckStartUs = Hal::Timer::getTimeUs();                                         \
+        statement;                                                                                  \
+        int64_t unitCheckElapsedUs = Hal::Timer::getTimeUs() - unitCheckStartUs;                    \
+        if (unitCheckElapsedUs > int64_t(maxUs)) {                                                  \
+            UNIT_PRINT("Check failed: %s took %lld us, limit: %lld us (%s:%d)", #statement,         \
+                (long long)unitCheckElapsedUs, (long long)(maxUs), __FILE__, __LINE__);             \
+            return false;                                                                           \
+        }                                                                                           \
+    } while (0)
+
+// Suite flags
+#define UNIT_SUITE_AUTOMATED        0
+#define UNIT_SUITE_INTERACTIVE      (1 << 0)    // Needs an operator: visual checks, a real access point or a restart
+
+/*
+    Every suite is registered in UnitTests::SUITES (src/UnitTests/UnitTestRunner.cpp). app_main runs them with
+    runAll() on the target, and the host build runs the automated ones with GoogleTest (host/test).
+*/
+struct UnitTestSuite {
+    const char* name;
+    bool (*run)(bool isLoop);   // true: passed
+    uint8_t flags;
+};
+
 
 namespace UnitTests {
-    //void CameraManagerUnitTest(bool isLoop);
+    bool CameraManagerUnitTest(bool isLoop);
+
+    //bool DistanceSensorManagerUnitTest(bool isLoop);
+
+    //bool GyroSensorManagerUnitTest(bool isLoop);
+
+    bool LedManagerUnitTest(bool isLoop);
+
+    bool LogManagerUnitTest(bool isLoop);
+
+    bool ModeManagerUnitTest(bool isLoop);
+
+    bool MotorManagerUnitTest(bool isLoop);
+
+    bool ResourceManagerUnitTest(bool isLoop);
+
+    bool ServerManagerUnitTest(bool isLoop);
 
-    //void DistanceSensorManagerUnitTest(bool isLoop);
+    bool SettingsJsonUnitTest(bool isLoop);
 
-    //void GyroSensorManagerUnitTest(bool isLoop);
+    bool StorageManagerUnitTest(bool isLoop);
 
-    void LedManagerUnitTest(bool isLoop);
+    bool TelemetryManagerUnitTest(bool isLoop);
 
-    //void ModeManagerUnitTest(bool isLoop);
+    bool TraceManagerUnitTest(bool isLoop);
 
-    //void MotorManagerUnitTest(bool isLoop);
+    bool WiFiModulManagerUnitTest(bool isLoop);
 
-    //void ServerManagerUnitTest(bool isLoop);
+// Runner -------------------------------------------------------------------------------------------------------
+    extern const UnitTestSuite SUITES[];
 
-    void StorageManagerUnitTest(bool isLoop);
+    extern const uint8_t SUITE_COUNT;
 
-    void WiFiModulManagerUnitTest(bool isLoop);
+    /**
+     * @brief Run every registered suite once, except the ones with a skipped flag, and print a summary.
+     *
+     * @param skippedFlags The suites with any of these flags are skipped (UNIT_SUITE_INTERACTIVE).
+     * @return uint8_t The number of failed suites.
+     */
+    uint8_t runAll(uint8_t skippedFlags);
 }
 
 #endif
\ No newline at end of file
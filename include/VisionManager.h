@@ -0,0 +1,210 @@
+/*
+ * File: VisionManager.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+#include "LineFollower.h"
+#include "VisionPipeline.h"
+
+// C++
+#include <atomic>
+
+// C
+extern "C" {
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+}
+
+// Vision task configuration
+#define VISION_STACK_SIZE               4096    // The JPEG decoder works in a static area, not on the stack
+#define VISION_PRIORITY                 2       // Below the streams and the motor loop
+#define VISION_CORE                     0       // With the Wi-Fi, the motor loop runs on core 1
+#define VISION_PERIOD_MS                100     // 10 frames per second
+#define VISION_FRAME_MAX_AGE_MS         90      // A cached frame up to this old is used, otherwise a new capture (below
+                                                // the period: the own capture of the last period is not taken again)
+#define VISION_FRAME_BUDGET_US          20000   // Decode and kernels of one frame, a fifth of the period
+#define VISION_STOP_HOLD_MS             500     // A stop hint holds the forward moves this long (a few missed frames)
+#define VISION_STOP_TIMEOUT_MS          1000
+#define VISION_ODOMETRY_MAX_AGE_MS      500     // An older flow estimate is not used (the floor had no texture since)
+#define VISION_LINE_PERIOD_MS           50      // While following a line: 20 frames per second
+#define VISION_LINE_FRAME_MAX_AGE_MS    40      // Below the line period, like VISION_FRAME_MAX_AGE_MS
+
+
+// Vision Stats -------------------------------------------------------------------------------------------------
+struct VisionStats {
+    bool isEnabled;
+    uint32_t frames;                // Processed frames
+    uint32_t skippedFrames;         // The same frame as the last one, or not supported by the pipeline
+    uint32_t failures;              // Capture or decode failed
+    uint32_t averageFrameUs;        // Decode and kernels
+    uint32_t maxFrameUs;
+    uint32_t framesOverBudget;      // Longer than VISION_FRAME_BUDGET_US
+    uint32_t stopHints;             // Frames with a stop hint
+    uint32_t motionMap;             // The last frame
+    uint32_t obstacleMap;
+    uint16_t motionPermille;
+    uint8_t nearObstacleCells;
+    bool isStopHint;
+    uint8_t flowBlocks;             // Matched crops of the last frame
+};
+
+struct VisionOdometry {
+    int16_t forwardMmPerS;          // Negative: backward
+    int16_t yawRateDeciDegPerS;     // Positive: turning right
+    uint8_t flowBlocks;             // Matched crops, 0: no estimate (none in VISION_ODOMETRY_MAX_AGE_MS)
+    uint32_t ageMs;
+};
+
+struct LineFollowStats {
+    bool isEnabled;
+    bool isFound;                   // In the last frame
+    uint8_t speed;                  // Percent, on a straight line
+    int16_t offsetMm;               // The last frame with the line (LineObservation)
+    int16_t angleDeciDeg;
+    int16_t forward;                // The last control data: Y
+    int16_t steering;               // R - L, positive: right
+    uint32_t frames;                // Followed frames
+    uint32_t missedFrames;          // Without the line, or without a frame
+};
+
+// Vision Manager -----------------------------------------------------------------------------------------------
+/*
+    The vision stage: while the motor controls run, a low priority task takes a frame of the snapshot cache (a frame
+    of a running stream, or its own capture), decodes it at 1/8 scale to a grayscale thumbnail and runs the
+    VisionPipeline on it. An occupied near field sets the stop hint of MotorManager. The task lives as long as the
+    manager; the video server pauses it while the snapshot cache is not there.
+
+    Line follow: the task also runs the LineFollower on the thumbnail at VISION_LINE_PERIOD_MS, and sends its control
+    data to MotorManager like a /mov request (the stop hint still holds it). A non-zero /mov command takes over.
+*/
+class VisionManager {
+// Init vision manager --------------------------------------------------
+private:
+    VisionManager();
+
+// Stats ----------------------------------------------------------------
+/*
+    Written by the vision task, read by /vis and /sst: single 32 bit atomics with relaxed ordering (like TelemetryManager).
+*/
+private:
+    static inline std::atomic<bool> isVisionEnabled{true};    // Kept over a restart of the video server
+    static inline std::atomic<uint32_t> frames{0};
+    static inline std::atomic<uint32_t> skippedFrames{0};
+    static inline std::atomic<uint32_t> failures{0};
+    static inline std::atomic<uint32_t> averageFrameUs{0};
+    static inline std::atomic<uint32_t> maxFrameUs{0};
+    static inline std::atomic<uint32_t> framesOverBudget{0};
+    static inline std::atomic<uint32_t> stopHints{0};
+    static inline std::atomic<uint32_t> motionMap{0};
+    static inline std::atomic<uint32_t> obstacleMap{0};
+    static inline std::atomic<uint32_t> lastFrameInfo{0};   // Motion permille (bits 0-15), near cells (16-23), stop hint (24), flow blocks (25-28)
+    static inline std::atomic<uint32_t> odometry{0};        // Forward speed in the low, yaw rate in the high 16 bits (one store, a consistent pair)
+    static inline std::atomic<uint32_t> odometryInfo{0};    // Time in ms (bits 0-27, wraps), flow blocks (28-31), 0: no estimate yet
+    static inline std::atomic<uint32_t> lineFrames{0};
+    static inline std::atomic<uint32_t> lineMissedFrames{0};
+    static inline std::atomic<uint32_t> lineInfo{0};        // Offset in the low, angle in the high 16 bits
+    static inline std::atomic<uint32_t> lineCommand{0};     // Forward in the low, steering in the high 16 bits
+    static inline std::atomic<bool> isLineFound{false};
+
+public:
+    static VisionStats getStats();
+
+    /**
+     * @brief The last optical flow estimate, for the control and the telemetry.
+     */
+    static VisionOdometry getOdometry();
+
+    static LineFollowStats getLineFollowStats();
+
+// Vision task ----------------------------------------------------------
+private:
+    VisionPipeline pipeline;                    // Only used by the vision task
+    std::atomic<bool> isTaskEnabled;            // Cleared to end the task
+    std::atomic<bool> isTaskRunning;            // Cleared by the task when it ended
+    static inline std::atomic<bool> isPaused{false};
+    static inline std::atomic<bool> isProcessing{false};    // Set by the task before it checks isPaused
+    TaskHandle_t taskHandle;                    // Notified to end the task without waiting for the period
+    LineFollower lineFollower;                  // Only used by the vision task
+    static inline std::atomic<bool> isLineFollowEnabled{false};
+    static inline std::atomic<bool> isLineFollowRestarted{false};  // Cleared by the task when it reset the follower
+    static inline std::atomic<uint8_t> lineFollowSpeed{LINE_DEFAULT_SPEED};
+    int64_t lastTimestampUs;                    // The last processed frame
+    uint64_t totalFrameUs;
+
+    static void taskVision(void *pvParameters);
+
+    /**
+     * @brief Take, decode and process one frame.
+     */
+    void processFrame();
+
+    /**
+     * @brief Send the control data of the line follower for one frame (no observation: a missed frame).
+     */
+    void followLine(const LineObservation* observation);
+
+    /**
+     * @brief Wait until the task is between two frames.
+     */
+    static void waitForFrameEnd();
+
+public:
+    /**
+     * @brief Enable or disable the vision stage (a disabled stage captures nothing and sets no stop hint). Also
+     * without an instance, it applies when the video server starts.
+     */
+    static void setEnabled(bool isEnabled);
+
+    static bool isEnabled() { return isVisionEnabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Wait for the running frame and take no more until resume() (the snapshot cache is freed).
+     */
+    static void pause();
+
+    static void resume();
+
+    /**
+     * @brief Start or stop following a line at speed percent (LINE_MIN_SPEED - LINE_MAX_SPEED, a running follow takes
+     * the new speed). Stopping waits for the running frame and stops the drone, a control request after it is not
+     * overwritten.
+     *
+     * @return ESP_ERR_INVALID_STATE To start without the vision task, with the vision stage disabled or without the
+     * motor controls running. ESP_ERR_INVALID_ARG For a speed out of the range.
+     */
+    static esp_err_t setLineFollow(bool isEnabled, uint8_t speed = LINE_DEFAULT_SPEED);
+
+    static bool isLineFollowing() { return isLineFollowEnabled.load(); }
+
+// Deinit vision manager ------------------------------------------------
+public:
+    ~VisionManager();
+
+// Singleton ------------------------------------------------------------
+private:
+    static VisionManager* instance;
+
+public:
+    VisionManager(const VisionManager& visionManager) = delete;
+
+    VisionManager& operator=(const VisionManager& visionManager) = delete;
+
+    static void init();
+
+    static VisionManager* getInstance() { return instance; }
+
+    static void deinit();
+};
@@ -0,0 +1,158 @@
+/*
+ * File: VisionPipeline.h
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#pragma once
+
+#include "DebugAndVersionControl.h"
+
+// C
+extern "C" {
+#include <stddef.h>
+#include <stdint.h>
+}
+
+// Thumbnail: the camera frame decoded at 1/8 scale (VGA: 80 x 60), larger frame sizes than SVGA are skipped
+#define VISION_SCALE_SHIFT              3
+#define VISION_MAX_WIDTH                100
+#define VISION_MAX_HEIGHT               75
+
+// Coarse maps: one bit per cell, row by row from the top left (32 cells: one 32 bit word)
+#define VISION_GRID_COLUMNS             8
+#define VISION_GRID_ROWS                4
+#define VISION_MIN_CELL_SIZE            2       // Pixels, a smaller thumbnail is skipped
+
+// Motion: frame differencing against the previous thumbnail
+#define VISION_MOTION_THRESHOLD         24      // Gray level change of a moving pixel (above the sensor noise)
+#define VISION_MOTION_CELL_PERMILLE     100     // A cell moves if this part of its pixels changed
+
+// Obstacles: at 1/8 scale a floor texture is averaged out, the edges that remain are object boundaries. A cell is
+// occupied if its mean gradient (|dx| + |dy| per pixel) reaches the threshold. The near field is the bottom center
+// of the view, right in front of the drone.
+#define VISION_EDGE_THRESHOLD           16
+#define VISION_NEAR_FIRST_COLUMN        2
+#define VISION_NEAR_COLUMNS             4
+#define VISION_NEAR_FIRST_ROW           2       // The bottom two rows
+#define VISION_STOP_MIN_CELLS           3       // Occupied near field cells of a stop
+#define VISION_STOP_FRAMES              2       // Consecutive frames, one noisy frame does not stop the drone
+
+// Optical flow: block matching of floor crops between the previous and the current thumbnail. The camera looks level
+// from a known height, so the vertical flow of a floor crop gives the forward move, and the horizontal flow that is
+// not explained by it gives the yaw (the drone has no wheel encoders and no working IMU).
+#define VISION_FLOW_BLOCKS              4       // Crops: left and right, at two distances (VisionPipeline.cpp)
+#define VISION_FLOW_BLOCK_SIZE          12      // Pixels, square crops
+#define VISION_FLOW_MIN_BLOCKS          2       // Matched crops of an estimate, one alone can be a false match
+#define VISION_FLOW_SEARCH_X            8       // Pixels per frame: about 70 degrees/s of yaw at 10 Hz
+#define VISION_FLOW_SEARCH_Y            4       // About 350 mm/s at the bottom crops at 10 Hz
+#define VISION_FLOW_MIN_CONTRAST        3       // Mean SAD of the search above the best match per pixel (a plain floor has no flow)
+#define VISION_FLOW_MIN_HORIZON_ROWS    4       // A crop closer to the horizon is too far to measure
+#define VISION_FLOW_MAX_INTERVAL_MS     300     // Frames further apart are not matched
+#define VISION_CAMERA_HEIGHT_MM         60      // Lens above the floor
+#define VISION_FOCAL_PERMILLE           770     // Focal length per image width (OV2640 lens: 66 degrees horizontal)
+#define VISION_HORIZON_PERMILLE         500     // Horizon row per image height (the camera looks level)
+
+
+// Kernels ------------------------------------------------------------------------------------------------------
+/*
+    Word parallel (SWAR) integer kernels: four pixels per 32 bit load, two 8 bit lanes with 8 bits of headroom per
+    16 bit half, so a subtraction never borrows across pixels. The ESP32 (Xtensa LX6) has no SIMD unit, this is its
+    widest integer path; the plain loops are also easy to vectorize for the host compilers.
+*/
+namespace VisionKernels {
+    /**
+     * @brief Sum of |a[i] - b[i]|.
+     */
+    uint32_t sumAbsoluteDifferences(const uint8_t* a, const uint8_t* b, size_t length);
+
+    /**
+     * @brief Number of pixels with |a[i] - b[i]| > threshold.
+     */
+    uint32_t countDifferences(const uint8_t* a, const uint8_t* b, size_t length, uint8_t threshold);
+}
+
+
+// Vision Pipeline ----------------------------------------------------------------------------------------------
+struct VisionResult {
+    uint32_t motionMap;             // Moving cells (0 for the first frame of a size)
+    uint32_t obstacleMap;           // Occupied cells
+    uint16_t motionPermille;        // Changed pixels of the grid
+    uint8_t nearObstacleCells;      // Occupied cells of the near field
+    bool isStopHint;                // The near field was occupied in VISION_STOP_FRAMES consecutive frames
+    int16_t forwardMmPerS;          // Optical flow: forward speed (negative: backward)
+    int16_t yawRateDeciDegPerS;     // Positive: turning right
+    uint8_t flowBlocks;             // Matched crops, 0: no flow estimate (first frame, plain floor, too fast)
+};
+
+/*
+    The per frame work of the vision stage on a grayscale thumbnail: the motion map against the previous frame and
+    the coarse obstacle map, and the optical flow of the floor. No allocation after the constructor, no RTOS calls
+    (the host benchmarks run it as is).
+*/
+class VisionPipeline {
+public:
+    VisionPipeline();
+
+    ~VisionPipeline();
+
+    VisionPipeline(const VisionPipeline& visionPipeline) = delete;
+
+    VisionPipeline& operator=(const VisionPipeline& visionPipeline) = delete;
+
+    /**
+     * @brief The next thumbnail is written here (VISION_MAX_WIDTH x VISION_MAX_HEIGHT bytes, rows without padding).
+     */
+    uint8_t* getInputBuffer() { return current; }
+
+    bool isAllocated() const { return current && previous; }
+
+    /**
+     * @brief A thumbnail of this size can be processed.
+     */
+    static bool isSupported(uint16_t width, uint16_t height);
+
+    /**
+     * @brief Process the thumbnail of the input buffer, it becomes the previous frame of the next one.
+     *
+     * @param intervalUs Capture time since the previous frame, 0: unknown (no optical flow).
+     */
+    void process(uint16_t width, uint16_t height, uint32_t intervalUs, VisionResult& result);
+
+    /**
+     * @brief Forget the previous frame and the stop frame count (the stream was paused).
+     */
+    void reset();
+
+    /**
+     * @brief Cells left out of the near field of the next frames (the line of the line follower, not an obstacle).
+     */
+    void setIgnoredCells(uint32_t cells) { ignoredCells = cells; }
+
+private:
+    /**
+     * @brief Find the shift of a previous frame crop in the current frame, in 1/16 pixels.
+     *
+     * @return false If the crop has no texture, or the best match is at the edge of the search (too fast).
+     */
+    bool matchBlock(uint16_t width, uint16_t left, uint16_t top, int16_t& shiftX16, int16_t& shiftY16) const;
+
+    /**
+     * @brief Forward speed and yaw rate from the flow of the floor crops.
+     */
+    void estimateFlow(uint16_t width, uint16_t height, uint32_t intervalUs, VisionResult& result) const;
+
+    uint8_t* current;
+    uint8_t* previous;
+    uint16_t previousWidth;         // 0: no previous frame
+    uint16_t previousHeight;
+    uint8_t stopFrames;             // Consecutive frames with an occupied near field
+    uint32_t ignoredCells;
+};
@@ -14,17 +14,13 @@
 #pragma once
 
 #include "DebugAndVersionControl.h"
+#include "Hal.h"
 
 // C++
 #include <iostream>
 
 // C
 extern "C" {
-#include "esp_err.h"
-#include "esp_wifi.h"
-
-#include "nvs_flash.h"
-
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 }
@@ -84,7 +80,7 @@ private:
 public:
     std::string getGatewayIP() { return gatewayIP; }
     std::string getSubnetMask() { return subnetMask; }
-    void geatherGatewayInfos(char* gatewayIP, char* subnetMask) { this->gatewayIP = gatewayIP; this->subnetMask = subnetMask; }
+    void geatherGatewayInfos(const char* gatewayIP, const char* subnetMask) { this->gatewayIP = gatewayIP; this->subnetMask = subnetMask; }
     bool isGatewayInfosEmpty() { return gatewayIP.empty() || subnetMask.empty(); }
 
 // Reconnect to wifi -----------------------------------------------------
@@ -99,6 +95,11 @@ public:
 public:
     void startWiFiControls();
 
+    /**
+     * @brief Stop the Wi-Fi control task, disconnect and stop the Wi-Fi driver.
+     */
+    void stopWiFiControls();
+
 // Deinit wifi ----------------------------------------------------------
 public:
     ~WiFiModulManager();
@@ -116,7 +117,7 @@ public:
 
     static WiFiModulManager* getInstance();
 
-    static void deinit() { delete instance; }
+    static void deinit() { delete instance; instance = nullptr; }
 };
 
 // FIXME: Creat the singleton init and deinit method for the WiFiModulManager, and rewrite the getInstance method to not create a new instance
@@ -12,59 +12,290 @@
  */
 
 #include "CameraManager.h"
+#include "LogManager.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @brief The sensor after the init of the driver: the configured frame size and quality, automatic gain and exposure,
+ * the full sensor.
+ */
+static CameraSettings getInitSettings(const HalCameraConfig& config) {
+    return {
+        .frameSize = config.frameSize,
+        .jpegQuality = config.jpegQuality,
+        .frameBufferCount = config.frameBufferCount,
+        .xclkFrequencyHz = config.xclkFrequencyHz,
+        .isGrabLatest = config.isGrabLatest,
+        .isAutoGain = true,
+        .gain = 0,
+        .isAutoExposure = true,
+        .exposure = 0,
+        .window = {}
+    };
+}
 
 
 // Init camera ----------------------------------------------------------
 CameraManager::CameraManager() {
     DEBUG_INIT_START("Camera");
+    isPoweredDown = false;
     cameraConfig = {
-        .pin_pwdn = CAMERA_PWDN,
-        .pin_reset = CAMERA_RESET,
-        .pin_xclk = CAMERA_XCLK,
-        .pin_sscb_sda = CAMERA_SIOD,
-        .pin_sscb_scl = CAMERA_SIOC,
-        
-        .pin_d7 = CAMERA_Y9,
-        .pin_d6 = CAMERA_Y8,
-        .pin_d5 = CAMERA_Y7,
-        .pin_d4 = CAMERA_Y6,
-        .pin_d3 = CAMERA_Y5,
-        .pin_d2 = CAMERA_Y4,
-        .pin_d1 = CAMERA_Y3,
-        .pin_d0 = CAMERA_Y2,
-
-        .pin_vsync = CAMERA_VSYNC,
-        .pin_href = CAMERA_HREF,
-        .pin_pclk = CAMERA_PCLK,
-        
-        .xclk_freq_hz = CAMERA_XCLK_FREQ_HZ,
-        .ledc_timer = CAMERA_TIMER,
-        .ledc_channel = CAMERA_CHANNEL,
-        
-        .pixel_format = CAMERA_PIXEL_FORMAT,
-
-        .frame_size = CAMERA_FRAMESIZE,
-        .jpeg_quality = CAMERA_JPEG_QUALITY,
-        .fb_count = CAMERA_FB_COUNT,
-        .fb_location = CAMERA_FB_LOCATION,
-
-        .grab_mode = CAMERA_GRAB_MODE,
-        
-        .sccb_i2c_port = -1
+        .pins = {
+            .pwdn = CAMERA_PWDN,
+            .reset = CAMERA_RESET,
+            .xclk = CAMERA_XCLK,
+            .sccbSda = CAMERA_SIOD,
+            .sccbScl = CAMERA_SIOC,
+
+            .data = { CAMERA_Y2, CAMERA_Y3, CAMERA_Y4, CAMERA_Y5, CAMERA_Y6, CAMERA_Y7, CAMERA_Y8, CAMERA_Y9 },
+
+            .vsync = CAMERA_VSYNC,
+            .href = CAMERA_HREF,
+            .pclk = CAMERA_PCLK
+        },
+
+        .xclkFrequencyHz = CAMERA_XCLK_FREQ_HZ,
+        .xclkPwmTimer = CAMERA_TIMER,
+        .xclkPwmChannel = CAMERA_CHANNEL,
+
+        .pixelFormat = CAMERA_PIXEL_FORMAT,
+
+        .frameSize = CAMERA_FB_FRAMESIZE,
+        .jpegQuality = CAMERA_JPEG_QUALITY,
+        .frameBufferCount = CAMERA_FB_COUNT,
+        .isFrameBufferInPsram = CAMERA_FB_IN_PSRAM,
+
+        .isGrabLatest = CAMERA_GRAB_LATEST
     };
-    esp_err_t err = esp_camera_init(&cameraConfig);
+    settings = getInitSettings(cameraConfig);
+    lastSwitch = { CameraSwitchType::NONE, 0 };
+    streamMutex = xSemaphoreCreateMutex();
+    esp_err_t err = Hal::Camera::init(cameraConfig);
     if (err != ESP_OK) {
         DEBUG_PRINT("Camera init failed with error: %d", err);
         ESP_ERROR_CHECK(err);
         return;
     }
+    if (CAMERA_FB_FRAMESIZE != CAMERA_FRAMESIZE) {
+        // Bigger buffers than the stream needs: the sensor goes down to the stream size live
+        CameraSettings streamSettings = settings;
+        streamSettings.frameSize = CAMERA_FRAMESIZE;
+        applySensorSettings(streamSettings);
+    }
     DEBUG_INIT_END("Camera");
 }
 
+// Camera power ---------------------------------------------------------
+void CameraManager::powerDown() {
+    if (isPoweredDown) { return; }
+    Hal::Camera::setPowerDown(true);
+    isPoweredDown = true;
+    DEBUG_PRINT("Camera powered down");
+}
+
+void CameraManager::powerUp() {
+    if (!isPoweredDown) { return; }
+    Hal::Camera::setPowerDown(false);
+    vTaskDelay(CAMERA_POWER_UP_DELAY_MS / portTICK_PERIOD_MS);
+    isPoweredDown = false;
+    DEBUG_PRINT("Camera powered up");
+}
+
+// Sensor settings ------------------------------------------------------
+static uint32_t getPixelCount(HalFrameSize frameSize) {
+    uint16_t width, height;
+    Hal::Camera::getResolution(frameSize, &width, &height);
+    return uint32_t(width) * height;
+}
+
+static uint32_t packResolution(uint16_t width, uint16_t height) { return (uint32_t(width) << 16) | height; }
+
+static bool isSameWindow(const HalCameraWindow& a, const HalCameraWindow& b) {
+    return a.offsetX == b.offsetX && a.offsetY == b.offsetY && a.width == b.width && a.height == b.height;
+}
+
+static bool isSameGain(const CameraSettings& a, const CameraSettings& b) {
+    return a.isAutoGain == b.isAutoGain && (a.isAutoGain || a.gain == b.gain);
+}
+
+static bool isSameExposure(const CameraSettings& a, const CameraSettings& b) {
+    return a.isAutoExposure == b.isAutoExposure && (a.isAutoExposure || a.exposure == b.exposure);
+}
+
+static bool isSameSettings(const CameraSettings& a, const CameraSettings& b) {
+    return a.frameSize == b.frameSize && a.jpegQuality == b.jpegQuality && a.frameBufferCount == b.frameBufferCount &&
+           a.xclkFrequencyHz == b.xclkFrequencyHz && a.isGrabLatest == b.isGrabLatest && isSameGain(a, b) && isSameExposure(a, b) && isSameWindow(a.window, b.window);
+}
+
+bool CameraManager::isValid(const CameraSettings& settings) {
+    if (settings.frameSize > HAL_FRAMESIZE_UXGA || settings.jpegQuality > CAMERA_JPEG_QUALITY_MAX ||
+        settings.frameBufferCount == 0 || settings.frameBufferCount > CAMERA_FB_COUNT_MAX ||
+        settings.xclkFrequencyHz < CAMERA_XCLK_FREQ_MIN_HZ || settings.xclkFrequencyHz > CAMERA_XCLK_FREQ_MAX_HZ ||
+        settings.gain > CAMERA_GAIN_MAX || settings.exposure > CAMERA_EXPOSURE_MAX) {
+        return false;
+    }
+    const HalCameraWindow& window = settings.window;
+    if (window.width == 0) { return window.height == 0 && window.offsetX == 0 && window.offsetY == 0; }
+    uint16_t width, height;
+    Hal::Camera::getResolution(settings.frameSize, &width, &height);
+    return uint32_t(window.offsetX) + window.width <= CAMERA_SENSOR_WIDTH &&
+           uint32_t(window.offsetY) + window.height <= CAMERA_SENSOR_HEIGHT &&
+           window.width >= width && window.height >= height; // The sensor scales down only
+}
+
+bool CameraManager::isFrameSizeAllocated(HalFrameSize frameSize) const {
+    // The JPEG frame buffers are sized from the frame size of the init
+    return getPixelCount(frameSize) <= getPixelCount(cameraConfig.frameSize);
+}
+
+bool CameraManager::requiresReallocation(const CameraSettings& newSettings) const {
+    return newSettings.frameBufferCount != cameraConfig.frameBufferCount ||
+           newSettings.isGrabLatest != cameraConfig.isGrabLatest ||
+           newSettings.xclkFrequencyHz != cameraConfig.xclkFrequencyHz ||
+           !isFrameSizeAllocated(newSettings.frameSize);
+}
+
+/**
+ * @brief Write the registers of the changed settings, settings follows every successful write.
+ */
+esp_err_t CameraManager::applySensorSettings(const CameraSettings& newSettings) {
+    esp_err_t err = ESP_OK;
+    if (newSettings.frameSize != settings.frameSize) {
+        err = Hal::Camera::setFrameSize(newSettings.frameSize);
+        if (err != ESP_OK) { return err; }
+        settings.frameSize = newSettings.frameSize;
+        settings.window = {}; // The frame size resets the window
+    }
+    if (!isSameWindow(newSettings.window, settings.window)) {
+        err = Hal::Camera::setWindow(newSettings.window, settings.frameSize);
+        if (err != ESP_OK) { return err; }
+        settings.window = newSettings.window;
+    }
+    if (newSettings.jpegQuality != settings.jpegQuality) {
+        err = Hal::Camera::setJpegQuality(newSettings.jpegQuality);
+        if (err != ESP_OK) { return err; }
+        settings.jpegQuality = newSettings.jpegQuality;
+    }
+    if (!isSameGain(newSettings, settings)) {
+        err = Hal::Camera::setGain(newSettings.isAutoGain, newSettings.gain);
+        if (err != ESP_OK) { return err; }
+        settings.isAutoGain = newSettings.isAutoGain;
+        settings.gain = newSettings.gain;
+    }
+    if (!isSameExposure(newSettings, settings)) {
+        err = Hal::Camera::setExposure(newSettings.isAutoExposure, newSettings.exposure);
+        if (err != ESP_OK) { return err; }
+        settings.isAutoExposure = newSettings.isAutoExposure;
+        settings.exposure = newSettings.exposure;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief New driver init with the new frame buffers, then the live settings. If the init fails, the old
+ * configuration is initialized again (its frame buffers fit before). The buffers never get smaller than the
+ * ones before (a photo size reserved by reserveFrameSize() stays live).
+ */
+esp_err_t CameraManager::reallocate(const CameraSettings& newSettings, HalFrameSize bufferFrameSize) {
+    HalCameraConfig newConfig = cameraConfig;
+    newConfig.frameSize = getPixelCount(bufferFrameSize) > getPixelCount(newSettings.frameSize) ? bufferFrameSize : newSettings.frameSize;
+    newConfig.jpegQuality = newSettings.jpegQuality;
+    newConfig.frameBufferCount = newSettings.frameBufferCount;
+    newConfig.xclkFrequencyHz = newSettings.xclkFrequencyHz;
+    newConfig.isGrabLatest = newSettings.isGrabLatest;
+
+    CameraSettings oldSettings = settings;
+    Hal::Camera::deinit();
+    esp_err_t err = Hal::Camera::init(newConfig);
+    if (err != ESP_OK) {
+        settings = getInitSettings(cameraConfig);
+        if (Hal::Camera::init(cameraConfig) == ESP_OK) { applySensorSettings(oldSettings); }
+        return err;
+    }
+    cameraConfig = newConfig;
+    settings = getInitSettings(cameraConfig);
+    return applySensorSettings(newSettings);
+}
+
+esp_err_t CameraManager::applySettings(const CameraSettings& newSettings, bool isReallocationAllowed) {
+    if (!isValid(newSettings)) { return ESP_ERR_INVALID_ARG; }
+    if (isPoweredDown) { return ESP_ERR_INVALID_STATE; } // The SCCB does not answer in standby
+    if (isSameSettings(newSettings, settings)) {
+        lastSwitch = { CameraSwitchType::NONE, 0 };
+        return ESP_OK;
+    }
+    bool isReallocation = requiresReallocation(newSettings);
+    if (isReallocation && !isReallocationAllowed) { return ESP_ERR_INVALID_STATE; }
+
+    int64_t startUs = Hal::Timer::getTimeUs();
+    esp_err_t err = isReallocation ? reallocate(newSettings, cameraConfig.frameSize) : applySensorSettings(newSettings);
+    uint32_t durationUs = uint32_t(Hal::Timer::getTimeUs() - startUs);
+    if (err != ESP_OK) {
+        LOG_E(CAMERA, "Camera settings failed with error: %d", err);
+        return err;
+    }
+    lastSwitch = { isReallocation ? CameraSwitchType::REALLOCATED : CameraSwitchType::LIVE, durationUs };
+    LOG_I(CAMERA, "Camera settings applied (%s) in %u us", isReallocation ? "reallocated" : "live", unsigned(durationUs));
+    return ESP_OK;
+}
+
+esp_err_t CameraManager::reserveFrameSize(HalFrameSize frameSize) {
+    if (frameSize > HAL_FRAMESIZE_UXGA) { return ESP_ERR_INVALID_ARG; }
+    if (isFrameSizeAllocated(frameSize)) { return ESP_OK; }
+    if (isPoweredDown) { return ESP_ERR_INVALID_STATE; }
+
+    CameraSettings streamSettings = settings; // reallocate() resets the settings before it applies these
+    int64_t startUs = Hal::Timer::getTimeUs();
+    esp_err_t err = reallocate(streamSettings, frameSize);
+    uint32_t durationUs = uint32_t(Hal::Timer::getTimeUs() - startUs);
+    if (err != ESP_OK) {
+        LOG_E(CAMERA, "Frame buffers for frame size %u failed with error: %d", unsigned(frameSize), err);
+        return err;
+    }
+    lastSwitch = { CameraSwitchType::REALLOCATED, durationUs };
+    uint16_t width, height;
+    Hal::Camera::getResolution(settings.frameSize, &width, &height);
+    streamResolution.store(packResolution(width, height), std::memory_order_relaxed); // The driver started at frameSize
+    LOG_I(CAMERA, "Frame buffers reallocated for frame size %u in %u us", unsigned(frameSize), unsigned(durationUs));
+    return ESP_OK;
+}
+
+// Stream frames --------------------------------------------------------
+
+bool CameraManager::getStreamFrame(HalCameraFrame& frame) {
+    CameraManager* cameraManager = instance;
+    if (!cameraManager) { return Hal::Camera::getFrame(frame); }
+    xSemaphoreTake(cameraManager->streamMutex, portMAX_DELAY);
+    bool isFrameValid = Hal::Camera::getFrame(frame);
+    uint32_t resolution = cameraManager->streamResolution.load(std::memory_order_relaxed);
+    for (uint8_t dropped = 0; isFrameValid && resolution != 0; dropped++) {
+        if (packResolution(frame.width, frame.height) == resolution || dropped == CAMERA_STALE_FRAMES_MAX) {
+            cameraManager->streamResolution.store(0, std::memory_order_relaxed);
+            break;
+        }
+        Hal::Camera::returnFrame(frame); // Captured before the switch back
+        isFrameValid = Hal::Camera::getFrame(frame);
+    }
+    xSemaphoreGive(cameraManager->streamMutex);
+    return isFrameValid;
+}
+
+void CameraManager::holdStream() { xSemaphoreTake(streamMutex, portMAX_DELAY); }
+
+void CameraManager::releaseStream() {
+    uint16_t width, height;
+    Hal::Camera::getResolution(settings.frameSize, &width, &height);
+    streamResolution.store(packResolution(width, height), std::memory_order_relaxed);
+    xSemaphoreGive(streamMutex);
+}
+
 // Deinit camera --------------------------------------------------------
 CameraManager::~CameraManager() {
     DEBUG_DEINIT_START("Camera");
-    esp_camera_deinit();
+    powerUp(); // Leave the sensor in a known state for the next init
+    Hal::Camera::deinit();
+    vSemaphoreDelete(streamMutex);
     DEBUG_DEINIT_END("Camera");
 }
 
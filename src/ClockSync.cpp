@@ -0,0 +1,114 @@
+/*
+ * File: ClockSync.cpp
+ * Project: drone_r6_fw
+ * File Created: Tuesday, 11th March 2025 6:02:17 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Tuesday, 11th March 2025 6:02:17 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "ClockSync.h"
+
+// C++
+#include <algorithm>
+
+// Upper edges of the histogram bins, the last bin has none
+static const uint32_t HISTOGRAM_EDGES_US[CLOCK_SYNC_HISTOGRAM_BINS - 1] = { 1000, 2000, 5000, 10000, 20000, 50000, 100000 };
+
+// Clock Sync ---------------------------------------------------------------------------------------------------
+ClockSync::ClockSync() {
+    exchangeCount = 0;
+    sampleCount = 0;
+    rejectedCount = 0;
+    lastRttUs = 0;
+    clear();
+}
+
+bool ClockSync::measure(int64_t t1, int64_t t2, int64_t t3, int64_t t4, ClockSyncSample& sample) {
+    int64_t rttUs = (t4 - t1) - (t3 - t2);
+    if (t3 < t2 || rttUs < 0 || rttUs > int64_t(CLOCK_SYNC_MAX_RTT_MS) * 1000) { return false; }
+    sample.offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+    sample.rttUs = uint32_t(rttUs);
+    return true;
+}
+
+void ClockSync::stamp(int64_t t1, int64_t t2, int64_t t3) {
+    exchangeCount++;
+    uint8_t index = nextExchange;
+    for (uint8_t i = 0; i < CLOCK_SYNC_PENDING; i++) {
+        if (exchanges[i].isStamped && exchanges[i].t1 == t1) { index = i; break; } // A repeated ping
+    }
+    exchanges[index] = { t1, t2, t3, true };
+    if (index == nextExchange) { nextExchange = (nextExchange + 1) % CLOCK_SYNC_PENDING; }
+}
+
+bool ClockSync::complete(int64_t t1, int64_t t4) {
+    for (Exchange& exchange : exchanges) {
+        if (!exchange.isStamped || exchange.t1 != t1) { continue; }
+        exchange.isStamped = false;
+        ClockSyncSample sample;
+        if (!measure(exchange.t1, exchange.t2, exchange.t3, t4, sample)) { break; }
+        addSample(sample);
+        return true;
+    }
+    rejectedCount++;
+    return false;
+}
+
+void ClockSync::addSample(const ClockSyncSample& sample) {
+    sampleCount++;
+    lastRttUs = sample.rttUs;
+    window[windowNext] = sample;
+    windowNext = (windowNext + 1) % CLOCK_SYNC_WINDOW;
+    windowCount = std::min<uint8_t>(windowCount + 1, CLOCK_SYNC_WINDOW);
+    estimate();
+}
+
+void ClockSync::estimate() {
+    // The fastest exchange, the newest of the equal ones (the clocks drift apart)
+    uint8_t oldest = uint8_t((windowNext + CLOCK_SYNC_WINDOW - windowCount) % CLOCK_SYNC_WINDOW);
+    const ClockSyncSample* fastest = nullptr;
+    for (uint8_t i = 0; i < windowCount; i++) {
+        const ClockSyncSample& sample = window[(oldest + i) % CLOCK_SYNC_WINDOW];
+        if (!fastest || sample.rttUs <= fastest->rttUs) { fastest = &sample; }
+    }
+    offsetUs = fastest ? fastest->offsetUs : 0;
+    rttUs = fastest ? fastest->rttUs : 0;
+}
+
+void ClockSync::clear() {
+    for (Exchange& exchange : exchanges) { exchange = {}; }
+    nextExchange = 0;
+    windowNext = 0;
+    windowCount = 0;
+    offsetUs = 0;
+    rttUs = 0;
+}
+
+uint8_t ClockSync::histogramBin(uint32_t timeUs) {
+    uint8_t bin = 0;
+    while (bin < CLOCK_SYNC_HISTOGRAM_BINS - 1 && timeUs >= HISTOGRAM_EDGES_US[bin]) { bin++; }
+    return bin;
+}
+
+ClockSyncStats ClockSync::getStats() const {
+    ClockSyncStats stats = {};
+    stats.exchanges = exchangeCount;
+    stats.samples = sampleCount;
+    stats.rejected = rejectedCount;
+    stats.offsetUs = offsetUs;
+    stats.rttUs = rttUs;
+    stats.lastRttUs = lastRttUs;
+    stats.windowCount = windowCount;
+    for (uint8_t i = 0; i < windowCount; i++) {
+        const ClockSyncSample& sample = window[i];     // Every slot up to windowCount is a sample of the window
+        int64_t distanceUs = sample.offsetUs > offsetUs ? sample.offsetUs - offsetUs : offsetUs - sample.offsetUs;
+        stats.rttHistogram[histogramBin(sample.rttUs)]++;
+        stats.offsetHistogram[histogramBin(uint32_t(std::min<int64_t>(distanceUs, UINT32_MAX)))]++;
+    }
+    return stats;
+}
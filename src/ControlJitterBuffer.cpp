@@ -0,0 +1,149 @@
+/*
+ * File: ControlJitterBuffer.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "ControlJitterBuffer.h"
+
+// C++
+#include <algorithm>
+
+static int32_t clampAxis(int64_t value, int32_t min, int32_t max) { return int32_t(value > max ? max : value < min ? min : value); }
+
+/**
+ * @brief One axis along its trend: at most CONTROL_JITTER_MAX_TREND further, a slowing axis ends at 0 (it never turns
+ * around), a stopped one stays stopped.
+ */
+static int32_t extrapolateAxis(int32_t previous, int32_t newest, int64_t elapsedUs, int64_t spacingUs, int32_t min, int32_t max) {
+    int64_t trend = int64_t(newest - previous) * elapsedUs / spacingUs;
+    int64_t value = newest + clampAxis(trend, -CONTROL_JITTER_MAX_TREND, CONTROL_JITTER_MAX_TREND);
+    if (newest > 0) { value = std::max<int64_t>(value, 0); }
+    else if (newest < 0) { value = std::min<int64_t>(value, 0); }
+    else { value = 0; }
+    return clampAxis(value, min, max);
+}
+
+// Control Jitter Buffer ----------------------------------------------------------------------------------------
+ControlJitterBuffer::ControlJitterBuffer() {
+    first = 0;
+    count = 0;
+    newest = {};
+    previous = {};
+    isNewestSet = false;
+    isPreviousSet = false;
+    playPositionUs = 0;
+    lastArrivalUs = -1;
+    depthMs = CONTROL_JITTER_DEFAULT_DEPTH_MS;
+    stats = {};
+    stats.intervalUs = CONTROL_JITTER_DEFAULT_INTERVAL_MS * 1000;
+}
+
+void ControlJitterBuffer::push(const ControlData& command, int64_t arrivalUs) {
+    stats.commands++;
+    // The period of the controller: a slow mean of the arrival gaps (the bursts and the gaps even out, a fast one would
+    // shrink in every burst), without the pauses
+    int64_t gapUs = arrivalUs - lastArrivalUs;
+    if (lastArrivalUs >= 0 && gapUs >= 0 && gapUs <= CONTROL_JITTER_PAUSE_MS * 1000) {
+        int64_t intervalUs = int64_t(stats.intervalUs) + (gapUs - int64_t(stats.intervalUs)) / 64;
+        stats.intervalUs = uint32_t(std::clamp<int64_t>(intervalUs, CONTROL_JITTER_MIN_INTERVAL_MS * 1000,
+                                                        CONTROL_JITTER_MAX_INTERVAL_MS * 1000));
+    }
+    lastArrivalUs = arrivalUs;
+
+    if (count == CONTROL_JITTER_CAPACITY) {
+        first = (first + 1) % CONTROL_JITTER_CAPACITY;
+        count--;
+        stats.overflows++;
+    }
+    // A burst: the queued commands go back to one period before the next one, but not before the played ones
+    int64_t floorUs = std::max(playPositionUs, isNewestSet ? newest.playUs : 0) + 1;
+    int64_t nextPlayUs = arrivalUs;
+    for (int16_t index = int16_t(count) - 1; index >= 0; index--) {
+        Entry& entry = entryAt(uint8_t(index));
+        int64_t sendUs = std::max(nextPlayUs - int64_t(stats.intervalUs), floorUs);
+        if (sendUs >= entry.playUs) { break; }
+        if (entry.playUs == entry.arrivalUs) { stats.backdated++; }
+        entry.playUs = sendUs;
+        nextPlayUs = sendUs;
+    }
+    entryAt(count) = { command, arrivalUs, arrivalUs };
+    count++;
+}
+
+ControlJitterOutput ControlJitterBuffer::play(int64_t nowUs, ControlData& command) {
+    playPositionUs = nowUs - int64_t(depthMs) * 1000;
+    // The due commands, the newest of them is played
+    bool isPlayed = false;
+    while (count > 0 && entryAt(0).playUs <= playPositionUs) {
+        if (isPlayed) { stats.skipped++; }
+        previous = newest;
+        isPreviousSet = isNewestSet;
+        newest = entryAt(0);
+        isNewestSet = true;
+        first = (first + 1) % CONTROL_JITTER_CAPACITY;
+        count--;
+        isPlayed = true;
+    }
+    if (isPlayed) {
+        int64_t delayUs = nowUs - newest.arrivalUs;
+        stats.averageDelayUs = uint32_t(stats.averageDelayUs ? int64_t(stats.averageDelayUs) + (delayUs - int64_t(stats.averageDelayUs)) / 8
+                                                             : delayUs);
+        stats.maxDelayUs = std::max(stats.maxDelayUs, uint32_t(delayUs));
+    }
+    if (!isNewestSet) { return ControlJitterOutput::NONE; }
+
+    if (count == 0 && nowUs - lastArrivalUs >= CONTROL_FAILSAFE_MS * 1000) {
+        clear();
+        stats.failsafes++;
+        command = { .X = 0, .Y = 0, .L = 0, .R = 0 };
+        return ControlJitterOutput::FAILSAFE;
+    }
+    // The next command is queued or not late yet: the newest one is held
+    int64_t elapsedUs = playPositionUs - newest.playUs;
+    if (count > 0 || elapsedUs <= int64_t(stats.intervalUs)) {
+        command = newest.command;
+        return ControlJitterOutput::COMMAND;
+    }
+    stats.extrapolations++;
+    command = extrapolate(std::min<int64_t>(elapsedUs, CONTROL_JITTER_EXTRAPOLATE_MS * 1000));
+    return ControlJitterOutput::EXTRAPOLATED;
+}
+
+ControlData ControlJitterBuffer::extrapolate(int64_t elapsedUs) const {
+    int64_t spacingUs = newest.playUs - previous.playUs;
+    if (!isPreviousSet || spacingUs <= 0 || spacingUs > CONTROL_JITTER_PAUSE_MS * 1000) { return newest.command; } // No trend
+    const ControlData& from = previous.command;
+    const ControlData& to = newest.command;
+    return {
+        .X = int16_t(extrapolateAxis(from.X, to.X, elapsedUs, spacingUs, INT16_MIN, INT16_MAX)),
+        .Y = int16_t(extrapolateAxis(from.Y, to.Y, elapsedUs, spacingUs, INT16_MIN, INT16_MAX)),
+        .L = int8_t(extrapolateAxis(from.L, to.L, elapsedUs, spacingUs, INT8_MIN, INT8_MAX)),
+        .R = int8_t(extrapolateAxis(from.R, to.R, elapsedUs, spacingUs, INT8_MIN, INT8_MAX)),
+    };
+}
+
+void ControlJitterBuffer::clear() {
+    first = 0;
+    count = 0;
+    isNewestSet = false;
+    isPreviousSet = false;
+}
+
+void ControlJitterBuffer::setDepthMs(uint16_t depthMs) {
+    this->depthMs = std::min<uint16_t>(depthMs, CONTROL_JITTER_MAX_DEPTH_MS);
+}
+
+ControlJitterStats ControlJitterBuffer::getStats() const {
+    ControlJitterStats result = stats;
+    result.depthMs = depthMs;
+    result.queued = count;
+    return result;
+}
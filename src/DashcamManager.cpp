@@ -0,0 +1,354 @@
+/*
+ * File: DashcamManager.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "DashcamManager.h"
+#include "Hal.h"
+#include "LogManager.h"
+#include "MotorManager.h"
+#include "SnapshotCache.h"
+#include "TraceManager.h"
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+}
+
+// AVI layout: RIFF('AVI ' LIST('hdrl' 'avih' LIST('strl' 'strh' 'strf')) LIST('movi' '00dc'...) 'idx1')
+#define AVI_MAIN_HEADER_SIZE    56
+#define AVI_STREAM_HEADER_SIZE  56
+#define AVI_FORMAT_SIZE         40      // BITMAPINFOHEADER
+#define AVI_HEADER_LIST_SIZE    (4 + 8 + AVI_MAIN_HEADER_SIZE + 8 + 4 + 8 + AVI_STREAM_HEADER_SIZE + 8 + AVI_FORMAT_SIZE)
+#define AVI_INDEX_ENTRY_SIZE    16
+#define AVIF_HASINDEX           0x10
+#define AVIIF_KEYFRAME          0x10
+
+static const char* MJPEG_PART = "\r\n--" DASHCAM_PART_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %lu\r\n"
+                                "X-Timestamp: %lu.%06lu\r\nX-Frame-Id: %lu\r\nX-Control: %d,%d,%d,%d\r\n\r\n";
+static const char* MJPEG_END = "\r\n--" DASHCAM_PART_BOUNDARY "--\r\n";
+
+// Init dashcam manager -------------------------------------------------
+DashcamManager::DashcamManager() {
+    DEBUG_INIT_START("Dashcam manager");
+    ringMutex = xSemaphoreCreateMutex();
+    lastTimestampUs = 0;
+    taskHandle = nullptr;
+    isTaskEnabled = ring.isAllocated();
+    isTaskRunning = isTaskEnabled.load();
+    if (!isTaskEnabled) {
+        LOG_E(CAMERA, "Dashcam ring could not be allocated");
+    } else if (xTaskCreatePinnedToCore(&taskDashcam, "DASHCAM", DASHCAM_STACK_SIZE, this, DASHCAM_PRIORITY, &taskHandle,
+                                       DASHCAM_CORE) != pdPASS) {
+        LOG_E(CAMERA, "Dashcam task could not be created");
+        isTaskEnabled = false;
+        isTaskRunning = false;
+    }
+    DEBUG_INIT_END("Dashcam manager");
+}
+
+// Recording ------------------------------------------------------------
+bool DashcamManager::record(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height, int64_t timestampUs,
+                            const ControlData& control) {
+    if (length > UINT32_MAX) { return false; }
+    xSemaphoreTake(ringMutex, portMAX_DELAY);
+    bool isRecorded = ring.append(jpeg, uint32_t(length), width, height, timestampUs, control);
+    xSemaphoreGive(ringMutex);
+    return isRecorded;
+}
+
+void DashcamManager::pause() {
+    isPaused = true;
+    for (uint16_t waitedMs = 0; isProcessing && waitedMs < DASHCAM_STOP_TIMEOUT_MS; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (isProcessing) { DEBUG_PRINT("Dashcam frame did not end in time"); }
+}
+
+void DashcamManager::resume() {
+    isPaused = false;
+}
+
+DashcamStats DashcamManager::getStats() {
+    xSemaphoreTake(ringMutex, portMAX_DELAY);
+    DashcamRingStats ringStats = ring.getStats();
+    xSemaphoreGive(ringMutex);
+    bool isEnabled = isRecordingEnabled.load(std::memory_order_relaxed);
+    return {
+        .isEnabled = isEnabled,
+        .isRecording = isEnabled && isTaskRunning && !isPaused && MotorManager::isMotorControlRunning(),
+        .frames = ringStats.frames,
+        .bytes = ringStats.bytes,
+        .slabsUsed = ringStats.slabsUsed,
+        .recordedFrames = ringStats.appendedFrames,
+        .evictedFrames = ringStats.evictedFrames,
+        .droppedFrames = ringStats.droppedFrames,
+        .failures = failures.load(std::memory_order_relaxed),
+        .downloads = downloads.load(std::memory_order_relaxed),
+        .oldestTimestampUs = ringStats.oldestTimestampUs,
+        .newestTimestampUs = ringStats.newestTimestampUs,
+    };
+}
+
+// Download -------------------------------------------------------------
+static uint8_t* putU16(uint8_t* out, uint16_t value) {
+    out[0] = uint8_t(value);
+    out[1] = uint8_t(value >> 8);
+    return out + 2;
+}
+
+static uint8_t* putU32(uint8_t* out, uint32_t value) {
+    out[0] = uint8_t(value);
+    out[1] = uint8_t(value >> 8);
+    out[2] = uint8_t(value >> 16);
+    out[3] = uint8_t(value >> 24);
+    return out + 4;
+}
+
+static uint8_t* putFourcc(uint8_t* out, const char* fourcc) {
+    memcpy(out, fourcc, 4);
+    return out + 4;
+}
+
+static uint8_t* putChunkHeader(uint8_t* out, const char* fourcc, uint32_t size) { return putU32(putFourcc(out, fourcc), size); }
+
+/*
+    The frames of a pinned range, read from the index once before the export.
+*/
+struct DashcamSummary {
+    uint32_t frames;
+    uint32_t moviSize;              // The chunks of the frames, padded to an even size
+    uint32_t maxLength;
+    uint16_t width;                 // Of the first frame (a later /cam change is not in the headers)
+    uint16_t height;
+    int64_t firstTimestampUs;
+    int64_t lastTimestampUs;
+};
+
+/**
+ * @brief The AVI headers up to the first frame chunk.
+ */
+static size_t writeAviHeader(uint8_t* buffer, const DashcamSummary& summary) {
+    uint32_t microSecPerFrame = summary.frames > 1
+        ? uint32_t((summary.lastTimestampUs - summary.firstTimestampUs) / (summary.frames - 1))
+        : DASHCAM_PERIOD_MS * 1000;
+    if (microSecPerFrame == 0) { microSecPerFrame = 1; }
+    uint32_t riffSize = 4 + 8 + AVI_HEADER_LIST_SIZE + 8 + 4 + summary.moviSize + 8 + summary.frames * AVI_INDEX_ENTRY_SIZE;
+    uint8_t* out = buffer;
+    out = putFourcc(putChunkHeader(out, "RIFF", riffSize), "AVI ");
+    out = putFourcc(putChunkHeader(out, "LIST", AVI_HEADER_LIST_SIZE), "hdrl");
+
+    out = putChunkHeader(out, "avih", AVI_MAIN_HEADER_SIZE);
+    out = putU32(out, microSecPerFrame);
+    out = putU32(out, uint32_t(uint64_t(summary.maxLength) * 1000000 / microSecPerFrame)); // Max bytes per second
+    out = putU32(out, 0);                               // Padding granularity
+    out = putU32(out, AVIF_HASINDEX);
+    out = putU32(out, summary.frames);
+    out = putU32(out, 0);                               // Initial frames
+    out = putU32(out, 1);                               // Streams
+    out = putU32(out, summary.maxLength);               // Suggested buffer size
+    out = putU32(out, summary.width);
+    out = putU32(out, summary.height);
+    for (uint8_t i = 0; i < 4; i++) { out = putU32(out, 0); }
+
+    out = putFourcc(putChunkHeader(out, "LIST", 4 + 8 + AVI_STREAM_HEADER_SIZE + 8 + AVI_FORMAT_SIZE), "strl");
+    out = putChunkHeader(out, "strh", AVI_STREAM_HEADER_SIZE);
+    out = putFourcc(out, "vids");
+    out = putFourcc(out, "MJPG");
+    out = putU32(out, 0);                               // Flags
+    out = putU32(out, 0);                               // Priority and language
+    out = putU32(out, 0);                               // Initial frames
+    out = putU32(out, microSecPerFrame);                // Scale / rate: seconds per frame
+    out = putU32(out, 1000000);
+    out = putU32(out, 0);                               // Start
+    out = putU32(out, summary.frames);                  // Length
+    out = putU32(out, summary.maxLength);
+    out = putU32(out, UINT32_MAX);                      // Quality: default
+    out = putU32(out, 0);                               // Sample size: varies
+    out = putU16(putU16(out, 0), 0);                    // Frame rectangle
+    out = putU16(putU16(out, summary.width), summary.height);
+
+    out = putChunkHeader(out, "strf", AVI_FORMAT_SIZE);
+    out = putU32(out, AVI_FORMAT_SIZE);
+    out = putU32(out, summary.width);
+    out = putU32(out, summary.height);
+    out = putU16(putU16(out, 1), 24);                   // Planes, bits per pixel
+    out = putFourcc(out, "MJPG");
+    out = putU32(out, uint32_t(summary.width) * summary.height * 3);
+    for (uint8_t i = 0; i < 4; i++) { out = putU32(out, 0); }   // Resolution and palette
+
+    out = putFourcc(putChunkHeader(out, "LIST", 4 + summary.moviSize), "movi");
+    return size_t(out - buffer);
+}
+
+const char* DashcamManager::getContentType(DashcamFormat format) {
+    switch (format) {
+        case DashcamFormat::AVI: return "video/x-msvideo";
+        case DashcamFormat::MJPEG: return "multipart/x-mixed-replace;boundary=" DASHCAM_PART_BOUNDARY;
+        default: return "application/json";
+    }
+}
+
+esp_err_t DashcamManager::exportRecording(DashcamFormat format, int64_t fromUs, int64_t toUs, Output output, void* context) {
+    DashcamSummary summary = {};
+    xSemaphoreTake(ringMutex, portMAX_DELAY);
+    DashcamRange range = ring.pin(fromUs, toUs);
+    for (uint32_t id = range.firstId; id < range.endId; id++) {
+        DashcamFrame frame;
+        ring.getFrame(id, frame);   // Pinned
+        if (summary.frames++ == 0) {
+            summary.width = frame.width;
+            summary.height = frame.height;
+            summary.firstTimestampUs = frame.timestampUs;
+        }
+        summary.lastTimestampUs = frame.timestampUs;
+        summary.moviSize += 8 + frame.length + (frame.length & 1);
+        if (frame.length > summary.maxLength) { summary.maxLength = frame.length; }
+    }
+    xSemaphoreGive(ringMutex);
+    if (summary.frames == 0) { return ESP_ERR_NOT_FOUND; }
+    downloads.fetch_add(1, std::memory_order_relaxed);
+
+    char chunk[DASHCAM_CHUNK_SIZE];
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(chunk);
+    size_t length = 0;
+    bool isOk = true;
+    if (format == DashcamFormat::AVI) {
+        isOk = output(chunk, writeAviHeader(bytes, summary), context);
+    } else if (format == DashcamFormat::JSON) {
+        isOk = output("{\"frames\":[", 11, context);
+    }
+    // The frames, one index read per frame: the recording goes on meanwhile
+    for (uint32_t id = range.firstId; isOk && id < range.endId; id++) {
+        DashcamFrame frame;
+        xSemaphoreTake(ringMutex, portMAX_DELAY);
+        ring.getFrame(id, frame);
+        xSemaphoreGive(ringMutex);
+        TRACE_SPAN("dashcam_send");
+        if (format == DashcamFormat::AVI) {
+            isOk = output(chunk, size_t(putChunkHeader(bytes, "00dc", frame.length) - bytes), context) &&
+                   output(reinterpret_cast<const char*>(frame.data), frame.length, context) &&
+                   ((frame.length & 1) == 0 || output("", 1, context));    // Padding to an even size
+        } else if (format == DashcamFormat::MJPEG) {
+            length = snprintf(chunk, sizeof(chunk), MJPEG_PART, (unsigned long)frame.length,
+                              (unsigned long)(frame.timestampUs / 1000000), (unsigned long)(frame.timestampUs % 1000000),
+                              (unsigned long)frame.id, frame.control.X, frame.control.Y, frame.control.L, frame.control.R);
+            isOk = output(chunk, length, context) && output(reinterpret_cast<const char*>(frame.data), frame.length, context);
+        } else {
+            length = snprintf(chunk, sizeof(chunk),
+                              "%s{\"id\":%lu,\"timestampUs\":%lld,\"length\":%lu,\"width\":%u,\"height\":%u,"
+                              "\"X\":%d,\"Y\":%d,\"L\":%d,\"R\":%d}",
+                              id == range.firstId ? "" : ",", (unsigned long)frame.id, (long long)frame.timestampUs,
+                              (unsigned long)frame.length, unsigned(frame.width), unsigned(frame.height),
+                              frame.control.X, frame.control.Y, frame.control.L, frame.control.R);
+            isOk = output(chunk, length, context);
+        }
+    }
+    if (isOk && format == DashcamFormat::AVI) {
+        // idx1: the offsets are from the 'movi' fourcc
+        isOk = output(chunk, size_t(putChunkHeader(bytes, "idx1", summary.frames * AVI_INDEX_ENTRY_SIZE) - bytes), context);
+        uint32_t offset = 4;
+        length = 0;
+        for (uint32_t id = range.firstId; isOk && id < range.endId; id++) {
+            DashcamFrame frame;
+            xSemaphoreTake(ringMutex, portMAX_DELAY);
+            ring.getFrame(id, frame);
+            xSemaphoreGive(ringMutex);
+            putU32(putU32(putU32(putFourcc(bytes + length, "00dc"), AVIIF_KEYFRAME), offset), frame.length);
+            offset += 8 + frame.length + (frame.length & 1);
+            length += AVI_INDEX_ENTRY_SIZE;
+            if (length == sizeof(chunk) || id + 1 == range.endId) {
+                isOk = output(chunk, length, context);
+                length = 0;
+            }
+        }
+    } else if (isOk && format == DashcamFormat::MJPEG) {
+        isOk = output(MJPEG_END, strlen(MJPEG_END), context);
+    } else if (isOk) {
+        isOk = output("]}", 2, context);
+    }
+    xSemaphoreTake(ringMutex, portMAX_DELAY);
+    ring.unpin(range);
+    xSemaphoreGive(ringMutex);
+    return isOk ? ESP_OK : ESP_FAIL;
+}
+
+// Dashcam task ---------------------------------------------------------
+void DashcamManager::recordFrame() {
+    SnapshotCache* snapshotCache = SnapshotCache::getInstance();
+    if (!snapshotCache) { return; }
+    TRACE_SPAN("dashcam_frame");
+    const SnapshotFrame* frame = nullptr;
+    if (snapshotCache->acquire(DASHCAM_FRAME_MAX_AGE_MS, frame) != ESP_OK) {
+        failures.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (frame->timestampUs != lastTimestampUs) {
+        lastTimestampUs = frame->timestampUs;
+        // The motor task reads the control data the same way, a torn value is one control period old
+        record(frame->data, frame->length, frame->width, frame->height, frame->timestampUs,
+               MotorManager::getInstance()->getControlData());
+    }
+    snapshotCache->release(frame);
+}
+
+void DashcamManager::taskDashcam(void *pvParameters) {
+    DashcamManager* dashcamManager = static_cast<DashcamManager*>(pvParameters);
+
+    while (dashcamManager->isTaskEnabled) {
+        // Notified by the destructor
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DASHCAM_PERIOD_MS));
+        if (!dashcamManager->isTaskEnabled) { break; }
+        // The drone stands while the motors are off: nothing worth recording, the streams keep the camera
+        if (isRecordingEnabled.load(std::memory_order_relaxed) && MotorManager::isMotorControlRunning()) {
+            isProcessing = true;
+            if (!isPaused) { dashcamManager->recordFrame(); }
+            isProcessing = false;
+        }
+    }
+
+    dashcamManager->isTaskRunning = false;
+    DEBUG_PRINT("Dashcam task ended");
+    vTaskDelete(NULL);
+}
+
+// Deinit dashcam manager -----------------------------------------------
+DashcamManager::~DashcamManager() {
+    DEBUG_DEINIT_START("Dashcam manager");
+    isTaskEnabled = false;
+    if (taskHandle) { xTaskNotifyGive(taskHandle); }
+    for (uint16_t waitedMs = 0; isTaskRunning && waitedMs < DASHCAM_STOP_TIMEOUT_MS; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (isTaskRunning) { DEBUG_PRINT("Dashcam task did not stop in time"); }
+    vSemaphoreDelete(ringMutex);
+    DEBUG_DEINIT_END("Dashcam manager");
+}
+
+// Singleton ------------------------------------------------------------
+DashcamManager* DashcamManager::instance = nullptr;
+
+void DashcamManager::init() {
+    if (instance == nullptr) {
+        instance = new DashcamManager();
+        return;
+    }
+    DEBUG_INIT_NO_NEED("Dashcam manager");
+}
+
+void DashcamManager::deinit() {
+    if (instance) {
+        delete instance;
+        instance = nullptr;
+        return;
+    }
+    DEBUG_DEINIT_NO_NEED("Dashcam manager");
+}
@@ -0,0 +1,179 @@
+/*
+ * File: DashcamRing.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "DashcamRing.h"
+
+extern "C" {
+#include <string.h>
+#include "esp_heap_caps.h"
+}
+
+// Dashcam Ring ---------------------------------------------------------
+DashcamRing::DashcamRing(uint16_t slabCount, uint32_t slabSize) {
+    this->slabCount = slabCount;
+    this->slabSize = slabSize;
+    oldestSlab = 0;
+    slabsUsed = 0;
+    nextId = 1;
+    appendedFrames = 0;
+    evictedFrames = 0;
+    droppedFrames = 0;
+    // PSRAM first, the internal RAM is kept for the Wi-Fi and the DMA buffers (the index is only read by a download)
+    memory = static_cast<uint8_t*>(heap_caps_malloc(size_t(slabCount) * slabSize, MALLOC_CAP_SPIRAM));
+    slabs = static_cast<Slab*>(heap_caps_calloc(slabCount, sizeof(Slab), MALLOC_CAP_SPIRAM));
+    if (!slabs) { slabs = static_cast<Slab*>(heap_caps_calloc(slabCount, sizeof(Slab), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)); }
+    if (!memory || !slabs || slabCount == 0) {
+        heap_caps_free(memory);
+        heap_caps_free(slabs);
+        memory = nullptr;
+        slabs = nullptr;
+        return;
+    }
+    for (uint16_t i = 0; i < slabCount; i++) { slabs[i].data = memory + size_t(i) * slabSize; }
+}
+
+DashcamRing::~DashcamRing() {
+    heap_caps_free(memory);
+    heap_caps_free(slabs);
+}
+
+uint16_t DashcamRing::findSlab(uint32_t id) const {
+    // The first ids grow with the position
+    uint16_t low = 0;
+    uint16_t high = slabsUsed;
+    while (low < high) {
+        uint16_t middle = (low + high) / 2;
+        if (slabAt(middle).firstId <= id) { low = middle + 1; }
+        else { high = middle; }
+    }
+    if (low == 0) { return slabsUsed; }
+    const Slab& slab = slabAt(low - 1);
+    return id < slab.firstId + slab.frameCount ? low - 1 : slabsUsed;
+}
+
+bool DashcamRing::startSlab() {
+    if (slabsUsed == slabCount) {
+        Slab& oldest = slabAt(0);
+        if (oldest.pins) { return false; } // A download reads it
+        evictedFrames += oldest.frameCount;
+        oldestSlab = (oldestSlab + 1) % slabCount;
+        slabsUsed--;
+    }
+    Slab& slab = slabAt(slabsUsed++);
+    slab.used = 0;
+    slab.firstId = nextId;
+    slab.frameCount = 0;
+    return true;
+}
+
+bool DashcamRing::append(const uint8_t* jpeg, uint32_t length, uint16_t width, uint16_t height, int64_t timestampUs,
+                         const ControlData& control) {
+    if (!slabs || length == 0 || length > slabSize) {
+        droppedFrames++;
+        return false;
+    }
+    if (slabsUsed > 0) {
+        const Slab& last = slabAt(slabsUsed - 1);
+        if (timestampUs <= last.entries[last.frameCount - 1].timestampUs) { // The seek needs the capture order
+            droppedFrames++;
+            return false;
+        }
+    }
+    if (slabsUsed == 0 || slabAt(slabsUsed - 1).used + length > slabSize ||
+        slabAt(slabsUsed - 1).frameCount == DASHCAM_SLAB_MAX_FRAMES) {
+        if (!startSlab()) {
+            droppedFrames++;
+            return false;
+        }
+    }
+    Slab& slab = slabAt(slabsUsed - 1);
+    memcpy(slab.data + slab.used, jpeg, length);
+    slab.entries[slab.frameCount++] = { slab.used, length, timestampUs, control, width, height };
+    slab.used += length;
+    nextId++;
+    appendedFrames++;
+    return true;
+}
+
+uint32_t DashcamRing::seek(int64_t timestampUs) const {
+    // The first slab with a frame at or after the timestamp, then the first such frame in it
+    uint16_t low = 0;
+    uint16_t high = slabsUsed;
+    while (low < high) {
+        uint16_t middle = (low + high) / 2;
+        const Slab& slab = slabAt(middle);
+        if (slab.entries[slab.frameCount - 1].timestampUs < timestampUs) { low = middle + 1; }
+        else { high = middle; }
+    }
+    if (low == slabsUsed) { return nextId; }
+    const Slab& slab = slabAt(low);
+    uint8_t first = 0;
+    uint8_t last = slab.frameCount;
+    while (first < last) {
+        uint8_t middle = (first + last) / 2;
+        if (slab.entries[middle].timestampUs < timestampUs) { first = middle + 1; }
+        else { last = middle; }
+    }
+    return slab.firstId + first;
+}
+
+bool DashcamRing::getFrame(uint32_t id, DashcamFrame& frame) const {
+    uint16_t position = findSlab(id);
+    if (position == slabsUsed) { return false; }
+    const Slab& slab = slabAt(position);
+    const Entry& entry = slab.entries[id - slab.firstId];
+    frame = {
+        .data = slab.data + entry.offset,
+        .length = entry.length,
+        .width = entry.width,
+        .height = entry.height,
+        .timestampUs = entry.timestampUs,
+        .control = entry.control,
+        .id = id,
+    };
+    return true;
+}
+
+DashcamRange DashcamRing::pin(int64_t fromUs, int64_t toUs) {
+    DashcamRange range = { seek(fromUs), seek(toUs) };
+    if (range.endId <= range.firstId) { return { nextId, nextId }; }
+    uint16_t last = findSlab(range.endId - 1);
+    for (uint16_t position = findSlab(range.firstId); position <= last; position++) { slabAt(position).pins++; }
+    return range;
+}
+
+void DashcamRing::unpin(const DashcamRange& range) {
+    if (range.endId <= range.firstId) { return; }
+    uint16_t last = findSlab(range.endId - 1);  // Pinned: still in the ring
+    for (uint16_t position = findSlab(range.firstId); position <= last; position++) { slabAt(position).pins--; }
+}
+
+uint32_t DashcamRing::getFirstId() const { return slabsUsed ? slabAt(0).firstId : nextId; }
+
+DashcamRingStats DashcamRing::getStats() const {
+    DashcamRingStats stats = {};
+    stats.slabsUsed = slabsUsed;
+    stats.appendedFrames = appendedFrames;
+    stats.evictedFrames = evictedFrames;
+    stats.droppedFrames = droppedFrames;
+    for (uint16_t position = 0; position < slabsUsed; position++) {
+        stats.frames += slabAt(position).frameCount;
+        stats.bytes += slabAt(position).used;
+    }
+    if (slabsUsed) {
+        const Slab& newest = slabAt(slabsUsed - 1);
+        stats.oldestTimestampUs = slabAt(0).entries[0].timestampUs;
+        stats.newestTimestampUs = newest.entries[newest.frameCount - 1].timestampUs;
+    }
+    return stats;
+}
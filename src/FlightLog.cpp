@@ -0,0 +1,143 @@
+/*
+ * File: FlightLog.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "FlightLog.h"
+
+extern "C" {
+#include <string.h>
+}
+
+// Varints --------------------------------------------------------------
+static uint8_t* putVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = uint8_t(value);
+    return out;
+}
+
+static const uint8_t* getVarint(const uint8_t* in, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (uint8_t shift = 0; in < end && shift < 64; shift += 7) {
+        uint8_t byte = *in++;
+        result |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return in;
+        }
+    }
+    return nullptr; // Truncated or longer than 64 bits
+}
+
+// The deltas wrap around (32 bit), so every field value is restored exactly
+static uint32_t zigzag(int32_t value) { return (uint32_t(value) << 1) ^ uint32_t(value >> 31); }
+
+static int32_t unzigzag(uint32_t value) { return int32_t((value >> 1) ^ (0 - (value & 1))); }
+
+// Flight Log Encoder ---------------------------------------------------
+uint8_t FlightLogEncoder::getFieldCount(FlightRecordType type) {
+    switch (type) {
+        case FlightRecordType::CONTROL: return 4;
+        case FlightRecordType::MOTOR: return 4;
+        case FlightRecordType::WIFI: return 2;
+        default: return 0;
+    }
+}
+
+void FlightLogEncoder::start(uint8_t* buffer, size_t size, uint32_t sequence, int64_t timestampUs) {
+    this->buffer = buffer;
+    this->size = size > UINT16_MAX ? UINT16_MAX : size;
+    length = sizeof(FlightLogBlockHeader);
+    lastTimestampUs = timestampUs;
+    memset(lastFields, 0, sizeof(lastFields));
+    FlightLogBlockHeader header = {
+        .magic = FLIGHT_LOG_BLOCK_MAGIC,
+        .version = FLIGHT_LOG_BLOCK_VERSION,
+        .reserved = 0,
+        .length = uint16_t(length),
+        .recordCount = 0,
+        .sequence = sequence,
+        .baseTimestampUs = timestampUs,
+    };
+    memcpy(buffer, &header, sizeof(header));
+}
+
+esp_err_t FlightLogEncoder::append(const FlightRecord& record) {
+    uint8_t fieldCount = getFieldCount(record.type);
+    if (fieldCount == 0 || record.timestampUs < lastTimestampUs) { return ESP_ERR_INVALID_ARG; }
+    if (!buffer || length + FLIGHT_LOG_RECORD_MAX_SIZE > size) { return ESP_ERR_INVALID_SIZE; }
+
+    // Encoded in place, the worst case fits
+    uint8_t* tag = buffer + length;
+    uint8_t* out = putVarint(tag + 1, uint64_t(record.timestampUs - lastTimestampUs));
+    int32_t* last = lastFields[uint8_t(record.type)];
+    uint8_t changed = 0;
+    for (uint8_t i = 0; i < fieldCount; i++) {
+        int32_t delta = int32_t(uint32_t(record.fields[i]) - uint32_t(last[i]));
+        if (delta == 0) { continue; }
+        changed |= 1 << i;
+        out = putVarint(out, zigzag(delta));
+        last[i] = record.fields[i];
+    }
+    *tag = uint8_t(record.type) | uint8_t(changed << 4);
+    length = out - buffer;
+    lastTimestampUs = record.timestampUs;
+
+    FlightLogBlockHeader* header = reinterpret_cast<FlightLogBlockHeader*>(buffer); // Packed, no alignment needed
+    header->length = uint16_t(length);
+    header->recordCount++;
+    return ESP_OK;
+}
+
+// Flight Log Decoder ---------------------------------------------------
+esp_err_t FlightLogDecoder::decodeBlock(const uint8_t* block, size_t length, RecordCallback onRecord, void* context,
+                                        FlightLogBlockHeader* header) {
+    FlightLogBlockHeader blockHeader;
+    if (length < sizeof(blockHeader)) { return ESP_ERR_INVALID_SIZE; }
+    memcpy(&blockHeader, block, sizeof(blockHeader));
+    if (blockHeader.magic != FLIGHT_LOG_BLOCK_MAGIC || blockHeader.version != FLIGHT_LOG_BLOCK_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (blockHeader.length < sizeof(blockHeader) || blockHeader.length > length) { return ESP_ERR_INVALID_SIZE; }
+    if (header) { *header = blockHeader; }
+
+    const uint8_t* in = block + sizeof(blockHeader);
+    const uint8_t* end = block + blockHeader.length;
+    int64_t timestampUs = blockHeader.baseTimestampUs;
+    int32_t lastFields[FLIGHT_RECORD_TYPE_COUNT][FLIGHT_LOG_MAX_FIELDS] = {};
+    for (uint16_t i = 0; i < blockHeader.recordCount; i++) {
+        if (in >= end) { return ESP_ERR_INVALID_SIZE; }
+        uint8_t tag = *in++;
+        FlightRecord record = {};
+        record.type = static_cast<FlightRecordType>(tag & 0x0F);
+        uint8_t fieldCount = FlightLogEncoder::getFieldCount(record.type);
+        uint8_t changed = tag >> 4;
+        if (fieldCount == 0 || (changed >> fieldCount)) { return ESP_ERR_INVALID_ARG; }
+
+        uint64_t value;
+        if (!(in = getVarint(in, end, &value))) { return ESP_ERR_INVALID_SIZE; }
+        timestampUs += int64_t(value);
+        record.timestampUs = timestampUs;
+        int32_t* last = lastFields[uint8_t(record.type)];
+        for (uint8_t field = 0; field < fieldCount; field++) {
+            if (changed & (1 << field)) {
+                if (!(in = getVarint(in, end, &value)) || value > UINT32_MAX) { return ESP_ERR_INVALID_SIZE; }
+                last[field] = int32_t(uint32_t(last[field]) + uint32_t(unzigzag(uint32_t(value))));
+            }
+            record.fields[field] = last[field];
+        }
+        if (onRecord) { onRecord(record, context); }
+    }
+    return in == end ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
@@ -0,0 +1,130 @@
+/*
+ * File: FlightRecorder.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "FlightRecorder.h"
+#include "LogManager.h"
+
+extern "C" {
+#include <string.h>
+#include "esp_heap_caps.h"
+}
+
+// Init flight recorder -------------------------------------------------
+FlightRecorder::FlightRecorder() {
+    DEBUG_INIT_START("Flight recorder");
+    mutex = xSemaphoreCreateMutex();
+    blockSequence = 0;
+    records = 0;
+    rejectedRecords = 0;
+    downloads = 0;
+    // PSRAM first, the internal RAM is kept for the Wi-Fi and the DMA buffers
+    size_t size = size_t(FLIGHT_RECORDER_BLOCK_COUNT) * FLIGHT_RECORDER_BLOCK_SIZE;
+    blocks = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_SPIRAM));
+    if (!blocks) { blocks = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)); }
+    if (!blocks) { LOG_E(MOTOR, "Flight recorder blocks could not be allocated"); }
+    DEBUG_INIT_END("Flight recorder");
+}
+
+// Recording ------------------------------------------------------------
+void FlightRecorder::append(FlightRecord& record) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    record.timestampUs = Hal::Timer::getTimeUs(); // Under the lock: the records of the tasks are in time order
+    esp_err_t res = encoder.isStarted() ? encoder.append(record) : ESP_ERR_INVALID_SIZE;
+    if (res == ESP_ERR_INVALID_SIZE) {
+        // The next block, over the oldest one if the ring is full
+        encoder.start(blockOf(blockSequence), FLIGHT_RECORDER_BLOCK_SIZE, blockSequence, record.timestampUs);
+        blockSequence++;
+        res = encoder.append(record);
+    }
+    if (res == ESP_OK) { records++; }
+    else { rejectedRecords++; }
+    xSemaphoreGive(mutex);
+}
+
+void FlightRecorder::record(FlightRecordType type, int32_t field0, int32_t field1, int32_t field2, int32_t field3) {
+    FlightRecorder* flightRecorder = instance;
+    if (!flightRecorder || !flightRecorder->blocks) { return; }
+    FlightRecord record = { type, 0, { field0, field1, field2, field3 } };
+    flightRecorder->append(record);
+}
+
+FlightRecorderStats FlightRecorder::getStats() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    FlightRecorderStats stats = {
+        .records = records,
+        .rejectedRecords = rejectedRecords,
+        .blocks = blockSequence,
+        .overwrittenBlocks = getOldestSequence(),
+        .oldestSequence = getOldestSequence(),
+        .bytes = 0,
+        .downloads = downloads,
+    };
+    for (uint32_t sequence = stats.oldestSequence; blocks && sequence < blockSequence; sequence++) {
+        stats.bytes += reinterpret_cast<const FlightLogBlockHeader*>(blockOf(sequence))->length;
+    }
+    xSemaphoreGive(mutex);
+    return stats;
+}
+
+// Download -------------------------------------------------------------
+esp_err_t FlightRecorder::exportLog(uint32_t firstSequence, Output output, void* context) {
+    if (!blocks) { return ESP_OK; }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    downloads++;
+    uint32_t endSequence = blockSequence; // The blocks started during the download are left for the next one
+    xSemaphoreGive(mutex);
+
+    char buffer[FLIGHT_RECORDER_BLOCK_SIZE];
+    for (uint32_t sequence = firstSequence; sequence < endSequence; sequence++) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        if (sequence < getOldestSequence()) { sequence = getOldestSequence(); } // Overwritten (before or during the download)
+        if (sequence >= endSequence) {
+            xSemaphoreGive(mutex);
+            break;
+        }
+        uint16_t length = reinterpret_cast<const FlightLogBlockHeader*>(blockOf(sequence))->length;
+        memcpy(buffer, blockOf(sequence), length);
+        xSemaphoreGive(mutex);
+        if (!output(buffer, length, context)) { return ESP_FAIL; }
+    }
+    return ESP_OK;
+}
+
+// Deinit flight recorder -----------------------------------------------
+FlightRecorder::~FlightRecorder() {
+    DEBUG_DEINIT_START("Flight recorder");
+    heap_caps_free(blocks);
+    vSemaphoreDelete(mutex);
+    DEBUG_DEINIT_END("Flight recorder");
+}
+
+// Singleton ------------------------------------------------------------
+FlightRecorder* FlightRecorder::instance = nullptr;
+
+void FlightRecorder::init() {
+    if (instance == nullptr) {
+        instance = new FlightRecorder();
+        return;
+    }
+    DEBUG_INIT_NO_NEED("Flight recorder");
+}
+
+void FlightRecorder::deinit() {
+    if (instance) {
+        FlightRecorder* flightRecorder = instance;
+        instance = nullptr; // No more records
+        delete flightRecorder;
+        return;
+    }
+    DEBUG_DEINIT_NO_NEED("Flight recorder");
+}
@@ -0,0 +1,574 @@
+/*
+ * File: HalEspIdf.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 6:02:18 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 6:02:18 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "Hal.h"
+
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "driver/rmt_tx.h"
+#include "esp_camera.h"
+#include "esp_event.h"
+#include "esp_jpg_decode.h"
+#include "esp_netif.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "lwip/inet.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sdkconfig.h"
+}
+
+#define HAL_PWM_SPEED_MODE          LEDC_LOW_SPEED_MODE
+
+// Timer --------------------------------------------------------------------------------------------------------
+int64_t Hal::Timer::getTimeUs() { return esp_timer_get_time(); }
+
+
+// PWM (LEDC) ---------------------------------------------------------------------------------------------------
+esp_err_t Hal::Pwm::configTimer(uint8_t timer, uint8_t dutyResolutionBits, uint32_t frequencyHz) {
+    ledc_timer_config_t timerConfig = {
+        .speed_mode = HAL_PWM_SPEED_MODE,
+        .duty_resolution = static_cast<ledc_timer_bit_t>(dutyResolutionBits),
+        .timer_num = static_cast<ledc_timer_t>(timer),
+        .freq_hz = frequencyHz,
+        .clk_cfg = LEDC_AUTO_CLK,
+        .deconfigure = false
+    };
+    return ledc_timer_config(&timerConfig);
+}
+
+esp_err_t Hal::Pwm::configChannel(uint8_t channel, int8_t gpio, uint8_t timer) {
+    ledc_channel_config_t channelConfig = {
+        .gpio_num = (int)gpio,
+        .speed_mode = HAL_PWM_SPEED_MODE,
+        .channel = static_cast<ledc_channel_t>(channel),
+        .intr_type = LEDC_INTR_DISABLE,
+        .timer_sel = static_cast<ledc_timer_t>(timer),
+        .duty = 0,
+        .hpoint = 0,
+        //.sleep_mode = LEDC_SLEEP_MODE_NO_ALIVE_ALLOW_PD,
+        .flags = { .output_invert = false }
+    };
+    return ledc_channel_config(&channelConfig);
+}
+
+esp_err_t Hal::Pwm::setDuty(uint8_t channel, uint32_t duty) {
+    esp_err_t err = ledc_set_duty(HAL_PWM_SPEED_MODE, static_cast<ledc_channel_t>(channel), duty);
+    if (err != ESP_OK) { return err; }
+    return ledc_update_duty(HAL_PWM_SPEED_MODE, static_cast<ledc_channel_t>(channel));
+}
+
+uint32_t Hal::Pwm::getDuty(uint8_t channel) { return ledc_get_duty(HAL_PWM_SPEED_MODE, static_cast<ledc_channel_t>(channel)); }
+
+esp_err_t Hal::Pwm::stop(uint8_t channel) { return ledc_stop(HAL_PWM_SPEED_MODE, static_cast<ledc_channel_t>(channel), 0); }
+
+esp_err_t Hal::Pwm::pauseTimer(uint8_t timer) { return ledc_timer_pause(HAL_PWM_SPEED_MODE, static_cast<ledc_timer_t>(timer)); }
+
+esp_err_t Hal::Pwm::resumeTimer(uint8_t timer) { return ledc_timer_resume(HAL_PWM_SPEED_MODE, static_cast<ledc_timer_t>(timer)); }
+
+
+// LED Strip (RMT) ----------------------------------------------------------------------------------------------
+#define RMT_LED_RESOLUTION_HZ 10000000
+
+struct RmtLedArrayEncoder {
+    rmt_encoder_t baseEncoder;
+    rmt_encoder_t *bytesEncoder;
+    rmt_encoder_t *copyEncoder;
+    int state;
+    rmt_symbol_word_t resetCode;
+};
+
+static size_t rmtEncodeLedArray(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primaryData, size_t dataSize, rmt_encode_state_t *retState) {
+    RmtLedArrayEncoder *ledEncoder = __containerof(encoder, RmtLedArrayEncoder, baseEncoder);
+    rmt_encoder_handle_t bytesEncoder = ledEncoder->bytesEncoder;
+    rmt_encoder_handle_t copyEncoder = ledEncoder->copyEncoder;
+    rmt_encode_state_t sessionState = RMT_ENCODING_RESET;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    size_t encodedSymbols = 0;
+    switch (ledEncoder->state) {
+    case 0: // send RGB data
+        encodedSymbols += bytesEncoder->encode(bytesEncoder, channel, primaryData, dataSize, &sessionState);
+        if (sessionState & RMT_ENCODING_COMPLETE) {
+            ledEncoder->state = 1; // switch to next state when current encoding session finished
+        }
+        if (sessionState & RMT_ENCODING_MEM_FULL) {
+            state = static_cast<rmt_encode_state_t>(state | RMT_ENCODING_MEM_FULL);
+            *retState = state;
+            return encodedSymbols;
+        }
+    // fall-through
+    case 1: // send reset code
+        encodedSymbols += copyEncoder->encode(copyEncoder, channel, &ledEncoder->resetCode, sizeof(ledEncoder->resetCode), &sessionState);
+        if (sessionState & RMT_ENCODING_COMPLETE) {
+            ledEncoder->state = RMT_ENCODING_RESET; // back to the initial encoding session
+            state = static_cast<rmt_encode_state_t>(state | RMT_ENCODING_COMPLETE);
+        }
+        if (sessionState & RMT_ENCODING_MEM_FULL) {
+            state = static_cast<rmt_encode_state_t>(state | RMT_ENCODING_MEM_FULL);
+            *retState = state;
+            return encodedSymbols;
+        }
+    }
+    *retState = state;
+    return encodedSymbols;
+}
+
+static esp_err_t rmtDeleteLedArrayEncoder(rmt_encoder_t *encoder) {
+    RmtLedArrayEncoder *ledEncoder = __containerof(encoder, RmtLedArrayEncoder, baseEncoder);
+    rmt_del_encoder(ledEncoder->bytesEncoder);
+    rmt_del_encoder(ledEncoder->copyEncoder);
+    free(ledEncoder);
+    return ESP_OK;
+}
+
+static esp_err_t rmtResetLedArrayEncoder(rmt_encoder_t *encoder) {
+    RmtLedArrayEncoder *ledEncoder = __containerof(encoder, RmtLedArrayEncoder, baseEncoder);
+    rmt_encoder_reset(ledEncoder->bytesEncoder);
+    rmt_encoder_reset(ledEncoder->copyEncoder);
+    ledEncoder->state = RMT_ENCODING_RESET;
+    return ESP_OK;
+}
+
+static rmt_channel_handle_t rmtChannelHandle = nullptr;
+static rmt_encoder_handle_t rmtEncoderHandle = nullptr;
+static bool isRmtChannelEnabled = false;
+
+esp_err_t Hal::LedStrip::init(int8_t gpio) {
+    // Setup RMT channel
+    rmt_tx_channel_config_t channelConfig = {
+        .gpio_num = static_cast<gpio_num_t>(gpio),
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = RMT_LED_RESOLUTION_HZ,
+        .mem_block_symbols = 64,
+        .trans_queue_depth = 4,
+        .intr_priority = 0,
+        .flags = {
+            .invert_out = false,
+            .with_dma = false,
+            .io_loop_back = false,
+            .io_od_mode = false,
+            .allow_pd = false
+        }
+    };
+    esp_err_t err = rmt_new_tx_channel(&channelConfig, &rmtChannelHandle);
+    if (err != ESP_OK) { return err; }
+
+    // Setup Encoder
+    RmtLedArrayEncoder *ledEncoder = nullptr;
+    ledEncoder = (RmtLedArrayEncoder*)rmt_alloc_encoder_mem(sizeof(RmtLedArrayEncoder));
+    if (ledEncoder == nullptr) {
+        DEBUG_PRINT("Failed to allocate memory for RMT encoder");
+        return ESP_ERR_NO_MEM;
+    }
+    ledEncoder->baseEncoder.encode = rmtEncodeLedArray;
+    ledEncoder->baseEncoder.reset = rmtResetLedArrayEncoder;
+    ledEncoder->baseEncoder.del = rmtDeleteLedArrayEncoder;
+
+    uint16_t duration01 = (uint16_t)(0.3 * RMT_LED_RESOLUTION_HZ / 1000000);
+    uint16_t duration10 = (uint16_t)(0.9 * RMT_LED_RESOLUTION_HZ / 1000000);
+    rmt_bytes_encoder_config_t bytesEncoderConfig = {
+        .bit0 = {
+            .duration0 = duration01,
+            .level0 = 1,
+            .duration1 = duration10,
+            .level1 = 0
+        },
+        .bit1 = {
+            .duration0 = duration10,
+            .level0 = 1,
+            .duration1 = duration01,
+            .level1 = 0
+        },
+        .flags = { .msb_first = true }
+    };
+    rmt_copy_encoder_config_t encoderConfig = {};
+    ESP_ERROR_CHECK(rmt_new_bytes_encoder(&bytesEncoderConfig, &ledEncoder->bytesEncoder));
+    ESP_ERROR_CHECK(rmt_new_copy_encoder(&encoderConfig, &ledEncoder->copyEncoder));
+
+    uint16_t reset_ticks = (uint16_t)(RMT_LED_RESOLUTION_HZ / 1000000 * 50 / 2); // reset code duration defaults to 50us
+    ledEncoder->resetCode = (rmt_symbol_word_t) {
+        .duration0 = reset_ticks,
+        .level0 = 0,
+        .duration1 = reset_ticks,
+        .level1 = 0
+    };
+
+    rmtEncoderHandle = &ledEncoder->baseEncoder;
+
+    // Enable RMT channel
+    return setEnabled(true);
+}
+
+esp_err_t Hal::LedStrip::setEnabled(bool isEnabled) {
+    if (isRmtChannelEnabled == isEnabled) { return ESP_OK; }
+    esp_err_t err = isEnabled ? rmt_enable(rmtChannelHandle) : rmt_disable(rmtChannelHandle);
+    if (err == ESP_OK) { isRmtChannelEnabled = isEnabled; }
+    return err;
+}
+
+esp_err_t Hal::LedStrip::transmit(const uint8_t* pixels, size_t length) {
+    rmt_transmit_config_t transmitConfig = {
+        .loop_count = 0,
+        .flags = {
+            .eot_level = 0,
+            .queue_nonblocking = 0
+        }
+    };
+    esp_err_t err = rmt_transmit(rmtChannelHandle, rmtEncoderHandle, pixels, length, &transmitConfig);
+    if (err != ESP_OK) { return err; }
+    return rmt_tx_wait_all_done(rmtChannelHandle, portMAX_DELAY);
+}
+
+void Hal::LedStrip::deinit() {
+    setEnabled(false);
+    rmt_del_encoder(rmtEncoderHandle);
+    rmt_del_channel(rmtChannelHandle);
+    rmtEncoderHandle = nullptr;
+    rmtChannelHandle = nullptr;
+}
+
+
+// Storage (NVS) ------------------------------------------------------------------------------------------------
+esp_err_t Hal::Storage::init() { return nvs_flash_init(); }
+
+esp_err_t Hal::Storage::erase() { return nvs_flash_erase(); }
+
+esp_err_t Hal::Storage::open(const char* name, HalStorageHandle* handle) { return nvs_open(name, NVS_READWRITE, handle); }
+
+esp_err_t Hal::Storage::getString(HalStorageHandle handle, const char* key, char* value, size_t size) {
+    return nvs_get_str(handle, key, value, &size);
+}
+
+esp_err_t Hal::Storage::setString(HalStorageHandle handle, const char* key, const char* value) { return nvs_set_str(handle, key, value); }
+
+esp_err_t Hal::Storage::getI8(HalStorageHandle handle, const char* key, int8_t* value) { return nvs_get_i8(handle, key, value); }
+
+esp_err_t Hal::Storage::setI8(HalStorageHandle handle, const char* key, int8_t value) { return nvs_set_i8(handle, key, value); }
+
+esp_err_t Hal::Storage::commit(HalStorageHandle handle) { return nvs_commit(handle); }
+
+void Hal::Storage::close(HalStorageHandle handle) { nvs_close(handle); }
+
+
+// Camera -------------------------------------------------------------------------------------------------------
+static_assert(int(HAL_PIXFORMAT_JPEG) == int(PIXFORMAT_JPEG) && int(HAL_PIXFORMAT_RGB888) == int(PIXFORMAT_RGB888), "HalPixelFormat has to match pixformat_t");
+static_assert(int(HAL_FRAMESIZE_VGA) == int(FRAMESIZE_VGA) && int(HAL_FRAMESIZE_UXGA) == int(FRAMESIZE_UXGA), "HalFrameSize has to match framesize_t");
+
+static gpio_num_t cameraPowerDownPin = GPIO_NUM_NC;
+
+esp_err_t Hal::Camera::init(const HalCameraConfig& config) {
+    const HalCameraPins& pins = config.pins;
+    camera_config_t cameraConfig = {
+        .pin_pwdn = pins.pwdn,
+        .pin_reset = pins.reset,
+        .pin_xclk = pins.xclk,
+        .pin_sscb_sda = pins.sccbSda,
+        .pin_sscb_scl = pins.sccbScl,
+
+        .pin_d7 = pins.data[7],
+        .pin_d6 = pins.data[6],
+        .pin_d5 = pins.data[5],
+        .pin_d4 = pins.data[4],
+        .pin_d3 = pins.data[3],
+        .pin_d2 = pins.data[2],
+        .pin_d1 = pins.data[1],
+        .pin_d0 = pins.data[0],
+
+        .pin_vsync = pins.vsync,
+        .pin_href = pins.href,
+        .pin_pclk = pins.pclk,
+
+        .xclk_freq_hz = int(config.xclkFrequencyHz),
+        .ledc_timer = static_cast<ledc_timer_t>(config.xclkPwmTimer),
+        .ledc_channel = static_cast<ledc_channel_t>(config.xclkPwmChannel),
+
+        .pixel_format = static_cast<pixformat_t>(config.pixelFormat),
+
+        .frame_size = static_cast<framesize_t>(config.frameSize),
+        .jpeg_quality = config.jpegQuality,
+        .fb_count = config.frameBufferCount,
+        .fb_location = config.isFrameBufferInPsram ? CAMERA_FB_IN_PSRAM : CAMERA_FB_IN_DRAM,
+
+        .grab_mode = config.isGrabLatest ? CAMERA_GRAB_LATEST : CAMERA_GRAB_WHEN_EMPTY,
+
+        .sccb_i2c_port = -1
+    };
+    cameraPowerDownPin = static_cast<gpio_num_t>(pins.pwdn);
+    return esp_camera_init(&cameraConfig);
+}
+
+esp_err_t Hal::Camera::deinit() { return esp_camera_deinit(); }
+
+bool Hal::Camera::getFrame(HalCameraFrame& frame) {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) { return false; }
+    frame.data = fb->buf;
+    frame.length = fb->len;
+    frame.width = uint16_t(fb->width);
+    frame.height = uint16_t(fb->height);
+    frame.format = static_cast<HalPixelFormat>(fb->format);
+    frame.timestampUs = int64_t(fb->timestamp.tv_sec) * 1000000 + fb->timestamp.tv_usec; // The driver stamps it with esp_timer
+    frame.driverFrame = fb;
+    return true;
+}
+
+void Hal::Camera::returnFrame(HalCameraFrame& frame) {
+    esp_camera_fb_return(static_cast<camera_fb_t*>(frame.driverFrame));
+    frame.driverFrame = nullptr;
+}
+
+bool Hal::Camera::convertToJpeg(const HalCameraFrame& frame, uint8_t quality, uint8_t** jpeg, size_t* length) {
+    return frame2jpg(static_cast<camera_fb_t*>(frame.driverFrame), quality, jpeg, length);
+}
+
+struct GrayDecoder {
+    const uint8_t* jpeg;
+    size_t length;
+    uint8_t* gray;
+    uint16_t width;                 // Of the thumbnail
+    uint16_t height;
+};
+
+static size_t readJpeg(void* arg, size_t index, uint8_t* buffer, size_t length) {
+    GrayDecoder* decoder = static_cast<GrayDecoder*>(arg);
+    if (index >= decoder->length) { return 0; }
+    if (length > decoder->length - index) { length = decoder->length - index; }
+    if (buffer) { memcpy(buffer, decoder->jpeg + index, length); } // No buffer: skip
+    return length;
+}
+
+static bool writeGray(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t* data) {
+    GrayDecoder* decoder = static_cast<GrayDecoder*>(arg);
+    if (!data) { return true; } // Start and end of the image
+    // One block of RGB888 pixels (one MCU at 1/8 scale), clipped to the thumbnail
+    for (uint16_t row = 0; row < h && y + row < decoder->height; row++) {
+        const uint8_t* rgb = data + size_t(row) * w * 3;
+        uint8_t* gray = decoder->gray + size_t(y + row) * decoder->width;
+        for (uint16_t column = 0; column < w && x + column < decoder->width; column++, rgb += 3) {
+            gray[x + column] = uint8_t((77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2]) >> 8); // BT.601 luma
+        }
+    }
+    return true;
+}
+
+bool Hal::Camera::decodeJpegGray8(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height, uint8_t* gray) {
+    // The decoder of the driver (TJpgDec) skips the IDCT at 1/8 scale. Its work area is static: one decode at a time.
+    GrayDecoder decoder = {jpeg, length, gray, uint16_t(width >> 3), uint16_t(height >> 3)};
+    return esp_jpg_decode(length, JPG_SCALE_8X, &readJpeg, &writeGray, &decoder) == ESP_OK;
+}
+
+void Hal::Camera::setPowerDown(bool isPoweredDown) {
+    if (cameraPowerDownPin == GPIO_NUM_NC) { return; }
+    gpio_set_level(cameraPowerDownPin, isPoweredDown ? 1 : 0);
+}
+
+void Hal::Camera::getResolution(HalFrameSize frameSize, uint16_t* width, uint16_t* height) {
+    *width = resolution[frameSize].width;
+    *height = resolution[frameSize].height;
+}
+
+static esp_err_t toSensorError(int result) { return result == 0 ? ESP_OK : ESP_FAIL; }
+
+esp_err_t Hal::Camera::setFrameSize(HalFrameSize frameSize) {
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (!sensor) { return ESP_ERR_INVALID_STATE; }
+    return toSensorError(sensor->set_framesize(sensor, static_cast<framesize_t>(frameSize)));
+}
+
+esp_err_t Hal::Camera::setJpegQuality(uint8_t quality) {
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (!sensor) { return ESP_ERR_INVALID_STATE; }
+    return toSensorError(sensor->set_quality(sensor, quality));
+}
+
+esp_err_t Hal::Camera::setGain(bool isAuto, uint8_t gain) {
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (!sensor) { return ESP_ERR_INVALID_STATE; }
+    if (sensor->set_gain_ctrl(sensor, isAuto ? 1 : 0) != 0) { return ESP_FAIL; }
+    return isAuto ? ESP_OK : toSensorError(sensor->set_agc_gain(sensor, gain));
+}
+
+esp_err_t Hal::Camera::setExposure(bool isAuto, uint16_t exposure) {
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (!sensor) { return ESP_ERR_INVALID_STATE; }
+    if (sensor->set_exposure_ctrl(sensor, isAuto ? 1 : 0) != 0) { return ESP_FAIL; }
+    return isAuto ? ESP_OK : toSensorError(sensor->set_aec_value(sensor, exposure));
+}
+
+esp_err_t Hal::Camera::setWindow(const HalCameraWindow& window, HalFrameSize frameSize) {
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (!sensor) { return ESP_ERR_INVALID_STATE; }
+    if (window.width == 0) { return toSensorError(sensor->set_framesize(sensor, static_cast<framesize_t>(frameSize))); }
+    // OV2640: the first argument is the sensor mode (0: UXGA, the window is in full sensor coordinates)
+    return toSensorError(sensor->set_res_raw(sensor, 0, 0, 0, 0, window.offsetX, window.offsetY, window.width, window.height,
+                                             resolution[frameSize].width, resolution[frameSize].height, false, false));
+}
+
+
+// Wi-Fi --------------------------------------------------------------------------------------------------------
+static HalWiFiEventCallback wifiEventCallback = nullptr;
+static esp_netif_t* networkInterface = nullptr;
+static esp_event_handler_instance_t wifiEventHandler;
+static esp_event_handler_instance_t ipEventHandler;
+
+static void onWiFiEvent(void* arg, esp_event_base_t base, int32_t id, void* data) {
+    HalWiFiEventData eventData = {};
+    if (base == WIFI_EVENT && id == WIFI_EVENT_STA_CONNECTED) {
+        eventData.event = HalWiFiEvent::STA_CONNECTED;
+    } else if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED) {
+        eventData.event = HalWiFiEvent::STA_DISCONNECTED;
+        eventData.reason = ((wifi_event_sta_disconnected_t*)data)->reason;
+    } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t* eventIP = (ip_event_got_ip_t*)data;
+        eventData.event = HalWiFiEvent::STA_GOT_IP;
+        esp_ip4addr_ntoa(&eventIP->ip_info.ip, eventData.ip, sizeof(eventData.ip));
+        esp_ip4addr_ntoa(&eventIP->ip_info.gw, eventData.gateway, sizeof(eventData.gateway));
+        esp_ip4addr_ntoa(&eventIP->ip_info.netmask, eventData.netmask, sizeof(eventData.netmask));
+    } else {
+        return; // Not used by the managers
+    }
+    if (wifiEventCallback) { wifiEventCallback(eventData); }
+}
+
+esp_err_t Hal::WiFi::init(HalWiFiEventCallback callback) {
+    esp_err_t err = esp_netif_init();
+    if (err != ESP_OK) {
+        DEBUG_PRINT("Failed to initialize TCP/IP network stack");
+        return err;
+    }
+    err = esp_event_loop_create_default();
+    if (err != ESP_OK) {
+        DEBUG_PRINT("Failed to create default event loop");
+        return err;
+    }
+    err = esp_wifi_set_default_wifi_sta_handlers();
+    if (err != ESP_OK) {
+        DEBUG_PRINT("Failed to set default handlers");
+        return err;
+    }
+
+    networkInterface = esp_netif_create_default_wifi_sta();
+    if (networkInterface == nullptr) {
+        DEBUG_PRINT("Failed to create default WiFi STA interface");
+        return ESP_FAIL;
+    }
+
+    wifi_init_config_t wifiConfig = WIFI_INIT_CONFIG_DEFAULT();
+    err = esp_wifi_init(&wifiConfig);
+    if (err != ESP_OK) { return err; }
+
+    wifiEventCallback = callback;
+    err = esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &onWiFiEvent, NULL, &wifiEventHandler);
+    if (err != ESP_OK) { return err; }
+    return esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &onWiFiEvent, NULL, &ipEventHandler);
+}
+
+esp_err_t Hal::WiFi::start(const char* ssid, const char* password, bool isPowerSaveEnabled) {
+    wifi_config_t wifiConfig = {
+        .sta = {
+            .ssid = "",
+            .password = "",
+            .scan_method = WIFI_FAST_SCAN,
+            .bssid_set = 0,
+            .bssid = {0},
+            .channel = 0,
+            .listen_interval = 0,
+            .sort_method = WIFI_CONNECT_AP_BY_SIGNAL,
+            .threshold = {
+                .rssi = -127,
+                .authmode = WIFI_AUTH_WPA2_PSK,
+                .rssi_5g_adjustment = 0,
+            },
+            .pmf_cfg = {
+                .capable = true,
+                .required = false
+            },
+            .rm_enabled = 0,
+            .btm_enabled = 0,
+            .mbo_enabled = 0,
+            .ft_enabled = 0,
+            .owe_enabled = 0,
+            .transition_disable = 0,
+            .reserved = 0,
+            .sae_pwe_h2e = WPA3_SAE_PWE_BOTH,
+            .sae_pk_mode = WPA3_SAE_PK_MODE_AUTOMATIC,
+            .failure_retry_cnt = 0,
+            .he_dcm_set = 0,
+            .he_dcm_max_constellation_tx = 0,
+            .he_dcm_max_constellation_rx = 0,
+            .he_mcs9_enabled = 0,
+            .he_su_beamformee_disabled = 0,
+            .he_trig_su_bmforming_feedback_disabled = 0,
+            .he_trig_mu_bmforming_partial_feedback_disabled = 0,
+            .he_trig_cqi_feedback_disabled = 0,
+            .he_reserved = 0,
+            .sae_h2e_identifier = {0}
+        }
+    };
+
+    strncpy((char*)wifiConfig.sta.ssid, ssid, sizeof(wifiConfig.sta.ssid));
+    strncpy((char*)wifiConfig.sta.password, password, sizeof(wifiConfig.sta.password));
+
+    esp_err_t err = setPowerSave(isPowerSaveEnabled);
+    if (err == ESP_OK) { err = esp_wifi_set_storage(WIFI_STORAGE_RAM); }
+    if (err == ESP_OK) { err = esp_wifi_set_mode(WIFI_MODE_STA); }
+    if (err == ESP_OK) { err = esp_wifi_set_config(WIFI_IF_STA, &wifiConfig); }
+    if (err == ESP_OK) { err = esp_wifi_start(); }
+    return err;
+}
+
+esp_err_t Hal::WiFi::connect() { return esp_wifi_connect(); }
+
+esp_err_t Hal::WiFi::disconnect() { return esp_wifi_disconnect(); }
+
+esp_err_t Hal::WiFi::stop() { return esp_wifi_stop(); }
+
+esp_err_t Hal::WiFi::setPowerSave(bool isEnabled) { return esp_wifi_set_ps(isEnabled ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE); }
+
+esp_err_t Hal::WiFi::setStaticIp(const char* ip, const char* gateway, const char* netmask) {
+    esp_netif_ip_info_t ipInfo;
+    ipInfo.ip.addr = ipaddr_addr(ip);
+    ipInfo.gw.addr = ipaddr_addr(gateway);
+    ipInfo.netmask.addr = ipaddr_addr(netmask);
+
+    esp_err_t err = esp_netif_dhcpc_stop(networkInterface); // Stop DHCP client
+    if (err != ESP_OK) { return err; }
+    return esp_netif_set_ip_info(networkInterface, &ipInfo);
+}
+
+esp_err_t Hal::WiFi::getRssi(int8_t* rssi) {
+    wifi_ap_record_t apInfo;
+    esp_err_t err = esp_wifi_sta_get_ap_info(&apInfo);
+    if (err == ESP_OK) { *rssi = apInfo.rssi; }
+    return err;
+}
+
+
+// Power --------------------------------------------------------------------------------------------------------
+esp_err_t Hal::Power::configure(bool isPowerSaveEnabled, uint32_t minFrequencyMhz) {
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_config_t pmConfig = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = isPowerSaveEnabled ? int(minFrequencyMhz) : CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .light_sleep_enable = isPowerSaveEnabled
+    };
+    return esp_pm_configure(&pmConfig);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
@@ -0,0 +1,304 @@
+/*
+ * File: JsonStream.cpp
+ * Project: drone_r6_fw
+ * File Created: Wednesday, 5th March 2025 6:42:18 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Wednesday, 5th March 2025 6:42:18 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "JsonStream.h"
+
+// JSON Writer --------------------------------------------------------------------------------------------------
+// Init JSON writer -----------------------------------------------------
+JsonWriter::JsonWriter(char* buffer, size_t size) {
+    this->buffer = buffer;
+    this->size = size;
+    position = 0;
+    isOverflowed = size == 0;
+    depth = 0;
+    hasValueMask = 0;
+    isAfterKey = false;
+    if (size > 0) { buffer[0] = '\0'; }
+}
+
+// Buffer ---------------------------------------------------------------
+void JsonWriter::put(char c) {
+    if (position + 1 >= size) { // Keep place for the terminating zero
+        isOverflowed = true;
+        return;
+    }
+    buffer[position++] = c;
+    buffer[position] = '\0';
+}
+
+void JsonWriter::putRaw(const char* text) {
+    while (*text) { put(*text++); }
+}
+
+void JsonWriter::putEscaped(const char* text) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    put('"');
+    for (; *text; text++) {
+        uint8_t c = uint8_t(*text);
+        switch (c) {
+            case '"':  putRaw("\\\""); break;
+            case '\\': putRaw("\\\\"); break;
+            case '\n': putRaw("\\n"); break;
+            case '\r': putRaw("\\r"); break;
+            case '\t': putRaw("\\t"); break;
+            default:
+                if (c < 0x20) { // Other control characters
+                    putRaw("\\u00");
+                    put(HEX_DIGITS[c >> 4]);
+                    put(HEX_DIGITS[c & 0x0F]);
+                } else {
+                    put(char(c));
+                }
+                break;
+        }
+    }
+    put('"');
+}
+
+// Structure ------------------------------------------------------------
+void JsonWriter::beginValue() {
+    if (isAfterKey) {
+        isAfterKey = false;
+        return;
+    }
+    if (hasValueMask & (1U << depth)) { put(','); }
+    hasValueMask |= (1U << depth);
+}
+
+void JsonWriter::beginObject() {
+    beginValue();
+    put('{');
+    if (depth + 1 >= JSON_MAX_DEPTH) { isOverflowed = true; return; }
+    depth++;
+    hasValueMask &= ~(1U << depth);
+}
+
+void JsonWriter::endObject() {
+    if (depth > 0) { depth--; }
+    put('}');
+}
+
+void JsonWriter::beginArray() {
+    beginValue();
+    put('[');
+    if (depth + 1 >= JSON_MAX_DEPTH) { isOverflowed = true; return; }
+    depth++;
+    hasValueMask &= ~(1U << depth);
+}
+
+void JsonWriter::endArray() {
+    if (depth > 0) { depth--; }
+    put(']');
+}
+
+void JsonWriter::key(const char* name) {
+    beginValue();
+    putEscaped(name);
+    put(':');
+    isAfterKey = true;
+}
+
+// Values ---------------------------------------------------------------
+void JsonWriter::string(const char* value) {
+    beginValue();
+    putEscaped(value ? value : "");
+}
+
+void JsonWriter::number(int32_t value) {
+    beginValue();
+    char digits[12];
+    uint8_t count = 0;
+    uint32_t magnitude = value < 0 ? uint32_t(0) - uint32_t(value) : uint32_t(value); // INT32_MIN safe
+    do {
+        digits[count++] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) { put('-'); }
+    while (count > 0) { put(digits[--count]); }
+}
+
+void JsonWriter::boolean(bool value) {
+    beginValue();
+    putRaw(value ? "true" : "false");
+}
+
+void JsonWriter::null() {
+    beginValue();
+    putRaw("null");
+}
+
+
+// JSON Reader --------------------------------------------------------------------------------------------------
+// Init JSON reader -----------------------------------------------------
+JsonReader::JsonReader(const char* json, size_t length) {
+    this->json = json;
+    this->length = json ? length : 0;
+    position = 0;
+    state = 0;
+    isErrored = false;
+}
+
+// Input ----------------------------------------------------------------
+void JsonReader::skipWhitespace() {
+    while (position < length && (json[position] == ' ' || json[position] == '\t' || json[position] == '\n' || json[position] == '\r')) {
+        position++;
+    }
+}
+
+bool JsonReader::expect(char c) {
+    skipWhitespace();
+    if (position >= length || json[position] != c) { return false; }
+    position++;
+    return true;
+}
+
+static int8_t hexValue(char c) {
+    if (c >= '0' && c <= '9') { return c - '0'; }
+    if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+    if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+    return -1;
+}
+
+bool JsonReader::readString(char* output, size_t outputSize) {
+    if (!expect('"')) { return false; }
+    size_t outputLength = 0;
+    while (position < length) {
+        char c = json[position++];
+        if (c == '"') {
+            output[outputLength] = '\0';
+            return true;
+        }
+        if (uint8_t(c) < 0x20) { return false; } // Control character (the UTF-8 bytes are copied as they are)
+        if (c == '\\') {
+            if (position >= length) { return false; }
+            char escaped = json[position++];
+            switch (escaped) {
+                case '"': c = '"'; break;
+                case '\\': c = '\\'; break;
+                case '/': c = '/'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': {
+                    if (position + 4 > length) { return false; }
+                    int32_t code = 0;
+                    for (uint8_t i = 0; i < 4; i++) {
+                        int8_t digit = hexValue(json[position++]);
+                        if (digit < 0) { return false; }
+                        code = (code << 4) | digit;
+                    }
+                    if (code == 0 || (code >= 0xD800 && code <= 0xDFFF)) { return false; } // No embedded zeros and surrogates
+                    if (code > 0x7F) { // To UTF-8, up to 3 bytes
+                        char encoded[3];
+                        size_t encodedLength = 0;
+                        if (code > 0x7FF) {
+                            encoded[encodedLength++] = char(0xE0 | (code >> 12));
+                            encoded[encodedLength++] = char(0x80 | ((code >> 6) & 0x3F));
+                        } else {
+                            encoded[encodedLength++] = char(0xC0 | (code >> 6));
+                        }
+                        encoded[encodedLength++] = char(0x80 | (code & 0x3F));
+                        if (outputLength + encodedLength >= outputSize) { return false; } // Too long
+                        for (size_t i = 0; i < encodedLength; i++) { output[outputLength++] = encoded[i]; }
+                        continue;
+                    }
+                    c = char(code);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        if (outputLength + 1 >= outputSize) { return false; } // Too long
+        output[outputLength++] = c;
+    }
+    return false; // Not terminated
+}
+
+bool JsonReader::readNumber(int32_t& value) {
+    skipWhitespace();
+    bool isNegative = false;
+    if (position < length && json[position] == '-') {
+        isNegative = true;
+        position++;
+    }
+    if (position >= length || json[position] < '0' || json[position] > '9') { return false; }
+    if (json[position] == '0' && position + 1 < length && json[position + 1] >= '0' && json[position + 1] <= '9') { return false; } // Leading zero
+    int64_t magnitude = 0;
+    while (position < length && json[position] >= '0' && json[position] <= '9') {
+        magnitude = magnitude * 10 + (json[position++] - '0');
+        if (magnitude > int64_t(INT32_MAX) + 1) { return false; } // Out of range
+    }
+    if (position < length && (json[position] == '.' || json[position] == 'e' || json[position] == 'E')) { return false; } // Integers only
+    if (!isNegative && magnitude > INT32_MAX) { return false; }
+    value = int32_t(isNegative ? -magnitude : magnitude);
+    return true;
+}
+
+bool JsonReader::readLiteral(const char* literal) {
+    for (; *literal; literal++) {
+        if (position >= length || json[position] != *literal) { return false; }
+        position++;
+    }
+    return true;
+}
+
+bool JsonReader::nextField(JsonField& field) {
+    if (isErrored || state == 3) { return false; }
+
+    if (state == 0) {
+        if (!expect('{')) { return fail(); }
+        skipWhitespace();
+        if (position < length && json[position] == '}') { // Empty object
+            position++;
+            state = 3;
+            skipWhitespace();
+            if (position != length) { return fail(); } // Trailing data
+            return false;
+        }
+        state = 1;
+    } else if (!expect(',')) {
+        if (!expect('}')) { return fail(); }
+        state = 3;
+        skipWhitespace();
+        if (position != length) { return fail(); } // Trailing data
+        return false;
+    }
+
+    if (!readString(field.key, sizeof(field.key))) { return fail(); }
+    if (!expect(':')) { return fail(); }
+
+    skipWhitespace();
+    if (position >= length) { return fail(); }
+    char c = json[position];
+    if (c == '"') {
+        field.type = JSON_STRING;
+        if (!readString(field.string, sizeof(field.string))) { return fail(); }
+    } else if (c == '-' || (c >= '0' && c <= '9')) {
+        field.type = JSON_NUMBER;
+        if (!readNumber(field.number)) { return fail(); }
+    } else if (c == 't' || c == 'f') {
+        field.type = JSON_BOOL;
+        field.boolean = c == 't';
+        if (!readLiteral(field.boolean ? "true" : "false")) { return fail(); }
+    } else if (c == 'n') {
+        field.type = JSON_NULL;
+        if (!readLiteral("null")) { return fail(); }
+    } else {
+        return fail(); // Nested object, array or invalid value
+    }
+    state = 2;
+    return true;
+}
@@ -12,13 +12,10 @@
  */
 
 #include "LedManager.h"
+#include "TraceManager.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
-extern "C" {
-#include <driver/rmt_tx.h>
-}
-
 // Colors -------------------------------------------------------------------------------------------------------
 // RGB Color ----------------------------------------------------------------------------------------------------
 Colors::Color::Color(uint8_t R, uint8_t G, uint8_t B, uint8_t brightness) {
@@ -116,69 +113,6 @@ bool Led::moveTowardsToTargetStage(int speed, int MINB, int MAXB, int MINC, int
 
 // LED Manager ---------------------------------------------------------------------------------------------------
 // Init LED manager --------------------------------------------------
-#define RMT_LED_RESOLUTION_HZ 10000000
-
-struct RmtLedArrayEncoder {
-    rmt_encoder_t baseEncoder;
-    rmt_encoder_t *bytesEncoder;
-    rmt_encoder_t *copyEncoder;
-    int state;
-    rmt_symbol_word_t resetCode;
-};
-
-static size_t rmtEncodeLedArray(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primaryData, size_t dataSize, rmt_encode_state_t *retState) {
-    RmtLedArrayEncoder *ledEncoder = __containerof(encoder, RmtLedArrayEncoder, baseEncoder);
-    rmt_encoder_handle_t bytesEncoder = ledEncoder->bytesEncoder;
-    rmt_encoder_handle_t copyEncoder = ledEncoder->copyEncoder;
-    rmt_encode_state_t sessionState = RMT_ENCODING_RESET;
-    rmt_encode_state_t state = RMT_ENCODING_RESET;
-    size_t encodedSymbols = 0;
-    switch (ledEncoder->state) {
-    case 0: // send RGB data
-        encodedSymbols += bytesEncoder->encode(bytesEncoder, channel, primaryData, dataSize, &sessionState);
-        if (sessionState & RMT_ENCODING_COMPLETE) {
-            ledEncoder->state = 1; // switch to next state when current encoding session finished
-        }
-        if (sessionState & RMT_ENCODING_MEM_FULL) {
-            state = static_cast<rmt_encode_state_t>(state | RMT_ENCODING_MEM_FULL);
-            *retState = state;
-            return encodedSymbols;
-        }
-    // fall-through
-    case 1: // send reset code
-        encodedSymbols += copyEncoder->encode(copyEncoder, channel, &ledEncoder->resetCode, sizeof(ledEncoder->resetCode), &sessionState);
-        if (sessionState & RMT_ENCODING_COMPLETE) {
-            ledEncoder->state = RMT_ENCODING_RESET; // back to the initial encoding session
-            state = static_cast<rmt_encode_state_t>(state | RMT_ENCODING_COMPLETE);
-        }
-        if (sessionState & RMT_ENCODING_MEM_FULL) {
-            state = static_cast<rmt_encode_state_t>(state | RMT_ENCODING_MEM_FULL);
-            *retState = state;
-            return encodedSymbols;
-        }
-    }
-    *retState = state;
-    return encodedSymbols;
-}
-
-static esp_err_t rmtDeleteLedArrayEncoder(rmt_encoder_t *encoder) {
-    RmtLedArrayEncoder *ledEncoder = __containerof(encoder, RmtLedArrayEncoder, baseEncoder);
-    rmt_del_encoder(ledEncoder->bytesEncoder);
-    rmt_del_encoder(ledEncoder->copyEncoder);
-    free(ledEncoder);
-    return ESP_OK;
-}
-
-static esp_err_t rmtResetLedArrayEncoder(rmt_encoder_t *encoder) {
-    RmtLedArrayEncoder *ledEncoder = __containerof(encoder, RmtLedArrayEncoder, baseEncoder);
-    rmt_encoder_reset(ledEncoder->bytesEncoder);
-    rmt_encoder_reset(ledEncoder->copyEncoder);
-    ledEncoder->state = RMT_ENCODING_RESET;
-    return ESP_OK;
-}
-
-static rmt_channel_handle_t rmtChannelHandle = nullptr;
-static rmt_encoder_handle_t rmtEncoderHandle = nullptr;
 LedManager::LedManager() {
     DEBUG_PRINT("Initializing LED manager ---");
     // Initialize LEDs
@@ -193,69 +127,11 @@ LedManager::LedManager() {
     currentAnimation = AnimationType::NONE;
     lastAnimation = AnimationType::NONE;
     animationStage = 0;
+    isLowPower = false;
+    framePeriodMs = LED_FRAME_PERIOD_MS;
 
-    // Setup RMT channel
-    rmt_tx_channel_config_t channelConfig = {
-        .gpio_num = LED_WS2812,
-        .clk_src = RMT_CLK_SRC_DEFAULT,
-        .resolution_hz = RMT_LED_RESOLUTION_HZ,
-        .mem_block_symbols = 64,
-        .trans_queue_depth = 4,
-        .intr_priority = 0,
-        .flags = {
-            .invert_out = false,
-            .with_dma = false,
-            .io_loop_back = false,
-            .io_od_mode = false,
-            .allow_pd = false
-        }
-    };
-    ESP_ERROR_CHECK(rmt_new_tx_channel(&channelConfig, &rmtChannelHandle));
-
-    // Setup Encoder
-    RmtLedArrayEncoder *ledEncoder = nullptr;
-    ledEncoder = (RmtLedArrayEncoder*)rmt_alloc_encoder_mem(sizeof(RmtLedArrayEncoder));
-    if (ledEncoder == nullptr) {
-        DEBUG_PRINT("Failed to allocate memory for RMT encoder");
-        return;
-    }
-    ledEncoder->baseEncoder.encode = rmtEncodeLedArray;
-    ledEncoder->baseEncoder.reset = rmtResetLedArrayEncoder;
-    ledEncoder->baseEncoder.del = rmtDeleteLedArrayEncoder;
-    
-    uint16_t duration01 = (uint16_t)(0.3 * RMT_LED_RESOLUTION_HZ / 1000000);
-    uint16_t duration10 = (uint16_t)(0.9 * RMT_LED_RESOLUTION_HZ / 1000000);
-    rmt_bytes_encoder_config_t bytesEncoderConfig = {
-        .bit0 = {
-            .duration0 = duration01,
-            .level0 = 1,
-            .duration1 = duration10,
-            .level1 = 0
-        },
-        .bit1 = {
-            .duration0 = duration10,
-            .level0 = 1,
-            .duration1 = duration01,
-            .level1 = 0
-        },
-        .flags = { .msb_first = true }
-    };
-    rmt_copy_encoder_config_t encoderConfig = {};
-    ESP_ERROR_CHECK(rmt_new_bytes_encoder(&bytesEncoderConfig, &ledEncoder->bytesEncoder));
-    ESP_ERROR_CHECK(rmt_new_copy_encoder(&encoderConfig, &ledEncoder->copyEncoder));
-
-    uint16_t reset_ticks = (uint16_t)(RMT_LED_RESOLUTION_HZ / 1000000 * 50 / 2); // reset code duration defaults to 50us
-    ledEncoder->resetCode = (rmt_symbol_word_t) {
-        .duration0 = reset_ticks,
-        .level0 = 0,
-        .duration1 = reset_ticks,
-        .level1 = 0
-    };
-
-    rmtEncoderHandle = &ledEncoder->baseEncoder;
-
-    // Enable RMT channel
-    ESP_ERROR_CHECK(rmt_enable(rmtChannelHandle));
+    // Setup the LED strip (RMT channel and WS2812 encoder)
+    ESP_ERROR_CHECK(Hal::LedStrip::init(LED_WS2812));
     DEBUG_PRINT("--- LED manager initialized");
 }
 
@@ -729,6 +605,41 @@ void LedManager::playWifiDisconnectedAnimation() {
     }
 }
 
+#define LED_ANIMATION_BREATHING_MIN_BRIGHTNESS 2
+#define LED_ANIMATION_BREATHING_MAX_BRIGHTNESS 30
+#define LED_ANIMATION_BREATHING_SPEED 2
+void LedManager::playBreathingAnimation() {
+    resetAnimationStageIfChanged(AnimationType::BREATHING, LED_ANIMATION_BREATHING_SPEED);
+    switch (animationStage) {
+        case 0:
+            for (uint8_t i = 0; i < 6; i++) {
+                LED[i].setColor(currentColor);
+                LED[i].setCurrentColorBrightness(LED_ANIMATION_BREATHING_MIN_BRIGHTNESS);
+                LED[i].setTargetColorBrightness(LED_ANIMATION_BREATHING_MAX_BRIGHTNESS);
+            }
+            animationStage = 1;
+            break;
+
+        case 1:
+            if (moveAllLedTowardsToTargetColor(LED_ANIMATION_BREATHING_MIN_BRIGHTNESS, LED_ANIMATION_BREATHING_MAX_BRIGHTNESS)) {
+                for (uint8_t i = 0; i < 6; i++) {
+                    LED[i].setTargetColorBrightness(LED_ANIMATION_BREATHING_MIN_BRIGHTNESS);
+                }
+                animationStage = 2;
+            }
+            break;
+
+        case 2:
+            if (moveAllLedTowardsToTargetColor(LED_ANIMATION_BREATHING_MIN_BRIGHTNESS, LED_ANIMATION_BREATHING_MAX_BRIGHTNESS)) {
+                for (uint8_t i = 0; i < 6; i++) {
+                    LED[i].setTargetColorBrightness(LED_ANIMATION_BREATHING_MAX_BRIGHTNESS);
+                }
+                animationStage = 1;
+            }
+            break;
+    }
+}
+
 // LED Array Controls --------------------------------------------------------
 void LedManager::transmitWaveformToLedArray() {
     uint8_t ledPixels[18]; // 6 LEDs * 3 colors
@@ -738,17 +649,9 @@ void LedManager::transmitWaveformToLedArray() {
         ledPixels[i * 3 + 2] = LED[i].currentColorStage.getB();
     }
     // write all the pixels to the LED array
-
-    rmt_transmit_config_t transmitConfig = {
-        .loop_count = 0,
-        .flags = {
-            .eot_level = 0,
-            .queue_nonblocking = 0
-        }
-    };
-
-    ESP_ERROR_CHECK(rmt_transmit(rmtChannelHandle, rmtEncoderHandle, ledPixels, sizeof(ledPixels), &transmitConfig));
-    ESP_ERROR_CHECK(rmt_tx_wait_all_done(rmtChannelHandle, portMAX_DELAY));
+    ESP_ERROR_CHECK(Hal::LedStrip::setEnabled(true));
+    ESP_ERROR_CHECK(Hal::LedStrip::transmit(ledPixels, sizeof(ledPixels)));
+    if (isLowPower) { ESP_ERROR_CHECK(Hal::LedStrip::setEnabled(false)); } // The enabled channel holds a power management lock
 }
 
 // Tasks -------------------------------------------------------------
@@ -758,46 +661,69 @@ static void taskLedArrayControls(void *pvParameters) {
         if (!ledManager) {
             vTaskDelete(NULL);
         }
-        // Animation
-        switch (ledManager->getCurrentAnimation()) {
-            case AnimationType::IDLE:
-                ledManager->playIdleAnimation();
-                break;
-            case AnimationType::IDLE_DEBUG:
+        {
+            TRACE_SPAN("led_frame");
+            // Animation
+            switch (ledManager->getCurrentAnimation()) {
+                case AnimationType::IDLE:
+                    ledManager->playIdleAnimation();
+                    break;
+                case AnimationType::IDLE_DEBUG:
 #ifdef VERSION_1_OR_LATER
-                ledManager->playIdleDebugAnimation();
+                    ledManager->playIdleDebugAnimation();
 #endif
-                break;
-            case AnimationType::WIFI_CONNECTING:
-                ledManager->playWifiConnectingAnimation();
-                break;
-            case AnimationType::WIFI_CONNECTED:
-                ledManager->playWifiConnectedAnimation();
-                break;
-            case AnimationType::WIFI_DISCONNECTED:
-                ledManager->playWifiDisconnectedAnimation();
-                break;
-            default:
-                ledManager->playNone();
-                break;
+                    break;
+                case AnimationType::WIFI_CONNECTING:
+                    ledManager->playWifiConnectingAnimation();
+                    break;
+                case AnimationType::WIFI_CONNECTED:
+                    ledManager->playWifiConnectedAnimation();
+                    break;
+                case AnimationType::WIFI_DISCONNECTED:
+                    ledManager->playWifiDisconnectedAnimation();
+                    break;
+                case AnimationType::BREATHING:
+                    ledManager->playBreathingAnimation();
+                    break;
+                default:
+                    ledManager->playNone();
+                    break;
+            }
+            TRACE_SPAN("led_transmit");
+            ledManager->transmitWaveformToLedArray();
         }
-        ledManager->transmitWaveformToLedArray();
-        vTaskDelay(40 / portTICK_PERIOD_MS);
+        vTaskDelay(ledManager->getFramePeriodMs() / portTICK_PERIOD_MS);
     }
     vTaskDelete(NULL);
 }
 
 static TaskHandle_t ledTaskHandle = nullptr;
 void LedManager::startLedArrayControls() {
+    if (ledTaskHandle) { return; } // Already running
     xTaskCreatePinnedToCore(&taskLedArrayControls, "LED_CONT", 4096, nullptr, 4, &ledTaskHandle, 1);
 }
 
+void LedManager::stopLedArrayControls() {
+    if (!ledTaskHandle) { return; } // Not running
+    vTaskDelete(ledTaskHandle);
+    ledTaskHandle = nullptr;
+    resetAnimation();
+    setAllOff();
+    transmitWaveformToLedArray();
+}
+
+// Low power mode ------------------------------------------------------------
+void LedManager::setLowPowerMode(bool isLowPower) {
+    if (this->isLowPower == isLowPower) { return; }
+    this->isLowPower = isLowPower;
+    framePeriodMs = isLowPower ? LED_LOW_POWER_FRAME_PERIOD_MS : LED_FRAME_PERIOD_MS;
+    setAnimation(isLowPower ? AnimationType::BREATHING : AnimationType::IDLE);
+}
+
 // Deinit LED manager --------------------------------------------------------
 LedManager::~LedManager() {
     DEBUG_DEINIT_START("LED manager");
-    rmt_disable(rmtChannelHandle);
-    rmt_del_encoder(rmtEncoderHandle);
-    rmt_del_channel(rmtChannelHandle);
+    Hal::LedStrip::deinit();
     DEBUG_DEINIT_END("LED manager");
 }
 
@@ -814,9 +740,9 @@ void LedManager::init() {
 
 void LedManager::deinit() {
     if (instance != nullptr) {
+        instance->stopLedArrayControls(); // Stop the task first, it uses the instance
         delete instance;
         instance = nullptr;
-        vTaskDelete(ledTaskHandle);
         return;
     }
     DEBUG_DEINIT_NO_NEED("LED manager");
@@ -0,0 +1,170 @@
+/*
+ * File: LineFollower.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "LineFollower.h"
+
+// C
+extern "C" {
+#include <stdlib.h>
+}
+
+// Scan rows in permille of the height, the nearest first (all below VISION_HORIZON_PERMILLE)
+static const uint16_t SCAN_ROWS_PERMILLE[LINE_SCAN_ROWS] = { 930, 830, 730, 630 };
+
+static int16_t clampMm(int64_t value) { return int16_t(value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : value); }
+
+// Line Follower ------------------------------------------------------------------------------------------------
+LineFollower::LineFollower() {
+    speed = LINE_DEFAULT_SPEED;
+    reset();
+}
+
+void LineFollower::reset() {
+    lostFrames = 0;
+    lastCommand = { .X = 0, .Y = 0, .L = 0, .R = 0 };
+}
+
+int16_t LineFollower::atan2DeciDeg(int32_t numerator, int32_t denominator) {
+    if (numerator == 0 && denominator == 0) { return 0; }
+    // atan(t) ~ 45 t + 15.64 t (1 - |t|) degrees for |t| <= 1 (0.3 degrees at most off), the rest by symmetry
+    const bool isSteep = llabs(numerator) > llabs(denominator);
+    int64_t ratio = isSteep ? int64_t(denominator) * 1000 / numerator : int64_t(numerator) * 1000 / denominator;
+    int32_t angle = int32_t(ratio * (450 + 156 * (1000 - llabs(ratio)) / 1000) / 1000);
+    if (isSteep) { angle = (numerator > 0 ? 900 : -900) - angle; }
+    else if (denominator < 0) { angle += numerator >= 0 ? 1800 : -1800; }
+    return int16_t(angle);
+}
+
+bool LineFollower::detect(const uint8_t* image, uint16_t width, uint16_t height, LineObservation& observation) {
+    observation = {};
+    if (!VisionPipeline::isSupported(width, height)) { return false; }
+    const int32_t focal16 = int32_t(width) * VISION_FOCAL_PERMILLE * 16 / 1000;    // 1/16 pixels
+    const int32_t horizon16 = int32_t(height) * VISION_HORIZON_PERMILLE * 16 / 1000;
+    const uint16_t cellWidth = width / VISION_GRID_COLUMNS;
+    const uint16_t cellHeight = height / VISION_GRID_ROWS;
+    int32_t sidesMm[LINE_SCAN_ROWS];
+    int32_t distancesMm[LINE_SCAN_ROWS];
+
+    for (uint16_t rowPermille : SCAN_ROWS_PERMILLE) {
+        const uint16_t y = uint16_t(uint32_t(height) * rowPermille / 1000);
+        const int32_t v16 = int32_t(y) * 16 + 8 - horizon16;   // Below the horizon
+        if (v16 < 16) { continue; }
+        const uint8_t* row = image + size_t(y) * width;
+        uint8_t darkest = UINT8_MAX;
+        uint8_t lightest = 0;
+        for (uint16_t x = 0; x < width; x++) {
+            if (row[x] < darkest) { darkest = row[x]; }
+            if (row[x] > lightest) { lightest = row[x]; }
+        }
+        if (lightest - darkest < LINE_MIN_CONTRAST) { continue; } // A plain floor
+
+        // Centroid of the pixels below the mid level, weighted by their darkness
+        const uint8_t threshold = uint8_t((darkest + lightest) / 2);
+        uint32_t weights = 0;
+        uint32_t positions = 0;        // Weighted pixel centers in half pixels
+        uint16_t darkPixels = 0;
+        uint16_t first = width;
+        uint16_t last = 0;
+        for (uint16_t x = 0; x < width; x++) {
+            if (row[x] >= threshold) { continue; }
+            const uint32_t weight = threshold - row[x];
+            weights += weight;
+            positions += weight * (2 * x + 1);
+            darkPixels++;
+            if (x < first) { first = x; }
+            last = x;
+        }
+        if (uint32_t(darkPixels) * 1000 > uint32_t(width) * LINE_MAX_WIDTH_PERMILLE) { continue; }
+        const int32_t u16 = int32_t(positions * 8 / weights) - int32_t(width) * 8;
+
+        // The floor point of the centroid: the pinhole model of the level camera
+        sidesMm[observation.rows] = u16 * VISION_CAMERA_HEIGHT_MM / v16;
+        distancesMm[observation.rows] = VISION_CAMERA_HEIGHT_MM * focal16 / v16;
+        observation.rows++;
+
+        const uint8_t gridRow = uint8_t(y / cellHeight);
+        if (gridRow < VISION_GRID_ROWS) {
+            for (uint16_t column = first / cellWidth; column <= last / cellWidth && column < VISION_GRID_COLUMNS; column++) {
+                observation.cells |= 1u << (gridRow * VISION_GRID_COLUMNS + column);
+            }
+        }
+    }
+    if (observation.rows == 0) { return false; }
+    observation.isFound = true;
+
+    if (observation.rows == 1) {
+        observation.offsetMm = int16_t(sidesMm[0]);
+        observation.targetMm = int16_t(sidesMm[0]);
+        return true;
+    }
+    // Least squares: side = mean side + slope * (distance - mean distance)
+    int32_t meanSide = 0;
+    int32_t meanDistance = 0;
+    for (uint8_t i = 0; i < observation.rows; i++) {
+        meanSide += sidesMm[i];
+        meanDistance += distancesMm[i];
+    }
+    meanSide /= observation.rows;
+    meanDistance /= observation.rows;
+    int64_t covariance = 0;
+    int64_t variance = 0;
+    for (uint8_t i = 0; i < observation.rows; i++) {
+        covariance += int64_t(distancesMm[i] - meanDistance) * (sidesMm[i] - meanSide);
+        variance += int64_t(distancesMm[i] - meanDistance) * (distancesMm[i] - meanDistance);
+    }
+    if (variance == 0) {
+        observation.offsetMm = int16_t(meanSide);
+        observation.targetMm = int16_t(meanSide);
+        return true;
+    }
+    observation.offsetMm = clampMm(meanSide + covariance * (distancesMm[0] - meanDistance) / variance);
+    observation.targetMm = clampMm(meanSide + covariance * (LINE_LOOKAHEAD_MM - meanDistance) / variance);
+    for (uint8_t i = 1; i < observation.rows; i++) {
+        // Between two scan rows: interpolated, the straight fit cuts the curves
+        if (distancesMm[i - 1] <= LINE_LOOKAHEAD_MM && distancesMm[i] >= LINE_LOOKAHEAD_MM && distancesMm[i] > distancesMm[i - 1]) {
+            observation.targetMm = clampMm(sidesMm[i - 1] + (sidesMm[i] - sidesMm[i - 1]) * (LINE_LOOKAHEAD_MM - distancesMm[i - 1]) /
+                                                                (distancesMm[i] - distancesMm[i - 1]));
+            break;
+        }
+    }
+    int64_t slopePermille = covariance * 1000 / variance;
+    if (slopePermille > INT32_MAX / 1000) { slopePermille = INT32_MAX / 1000; }
+    if (slopePermille < -INT32_MAX / 1000) { slopePermille = -INT32_MAX / 1000; }
+    observation.angleDeciDeg = atan2DeciDeg(int32_t(slopePermille), 1000);
+    return true;
+}
+
+ControlData LineFollower::steer(const LineObservation& observation) {
+    if (!observation.isFound) {
+        if (lostFrames <= LINE_LOST_FRAMES) { lostFrames++; }
+        if (lostFrames > LINE_LOST_FRAMES) { lastCommand = { .X = 0, .Y = 0, .L = 0, .R = 0 }; }
+        return lastCommand;
+    }
+    lostFrames = 0;
+
+    // The arc to the pursuit point: curvature 2 target / lookahead^2, the tracks differ by curvature * wheel base.
+    // Slower in the turns, one track stops at most (no pivot over the line).
+    int32_t turnPermille = int32_t(observation.targetMm) * 2 * LINE_WHEEL_BASE_MM * 1000 / (LINE_LOOKAHEAD_MM * LINE_LOOKAHEAD_MM);
+    if (turnPermille > 1000) { turnPermille = 1000; }
+    if (turnPermille < -1000) { turnPermille = -1000; }
+    int32_t forward = speed - speed * abs(turnPermille) / 2000;
+    if (forward < LINE_MIN_SPEED) { forward = speed < LINE_MIN_SPEED ? speed : LINE_MIN_SPEED; }
+    const int8_t turn = int8_t((forward * abs(turnPermille) + 500) / 1000);
+    lastCommand = {
+        .X = 0,
+        .Y = int16_t(forward),
+        .L = int8_t(turnPermille < 0 ? turn : 0),
+        .R = int8_t(turnPermille > 0 ? turn : 0),
+    };
+    return lastCommand;
+}
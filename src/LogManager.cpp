@@ -0,0 +1,218 @@
+/*
+ * File: LogManager.cpp
+ * Project: drone_r6_fw
+ * File Created: Saturday, 8th March 2025 4:37:52 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Saturday, 8th March 2025 4:37:52 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "LogManager.h"
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+}
+
+// Init log manager -----------------------------------------------------
+LogManager::LogManager() {
+    DEBUG_INIT_START("Log manager");
+    drainMutex = xSemaphoreCreateMutex();
+    drainTaskHandle = nullptr;
+    startDrainTask();
+    DEBUG_INIT_END("Log manager");
+}
+
+// Ring -----------------------------------------------------------------
+/*
+    The slot sequence is stored relative to the slot index, so the zero initialized ring is empty:
+    slot + index == position: free for the producer of this position,
+    slot + index == position + 1: published, ready for the consumer.
+*/
+LogEntry LogManager::ring[LOG_RING_SIZE];
+
+bool LogManager::push(const LogSite* site, const uintptr_t* args, uint8_t argCount) {
+    uint32_t timestampUs = uint32_t(Hal::Timer::getTimeUs());
+    uint32_t position = writePosition.load(std::memory_order_relaxed);
+    LogEntry* entry;
+    while (true) {
+        entry = &ring[position & (LOG_RING_SIZE - 1)];
+        uint32_t sequence = entry->sequence.load(std::memory_order_acquire) + (position & (LOG_RING_SIZE - 1));
+        int32_t difference = int32_t(sequence - position);
+        if (difference == 0) {
+            if (writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) { break; }
+        } else if (difference < 0) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed); // Full, the consumer is behind
+            return false;
+        } else {
+            position = writePosition.load(std::memory_order_relaxed); // Another producer took this slot
+        }
+    }
+    entry->site = site;
+    entry->timestampUs = timestampUs;
+    entry->argCount = argCount;
+    for (uint8_t i = 0; i < argCount; i++) { entry->args[i] = args[i]; }
+    entry->sequence.store(position + 1 - (position & (LOG_RING_SIZE - 1)), std::memory_order_release);
+    return true;
+}
+
+size_t LogManager::format(const LogEntry& entry, char* buffer, size_t size) {
+    if (size == 0) { return 0; }
+    const char* format = entry.site->format;
+    size_t length = 0;
+    uint8_t argIndex = 0;
+    buffer[0] = '\0';
+
+    // Every conversion is formatted alone with its own type, so the stored (pointer sized) arguments are passed correctly
+    while (*format && length < size - 1) {
+        if (*format != '%') {
+            buffer[length++] = *format++;
+            buffer[length] = '\0';
+            continue;
+        }
+        if (format[1] == '%') {
+            buffer[length++] = '%';
+            buffer[length] = '\0';
+            format += 2;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        char specification[16];
+        size_t specificationLength = 0;
+        specification[specificationLength++] = *format++;
+        while (*format && strchr("-+ #0123456789.", *format) && specificationLength < sizeof(specification) - 4) {
+            specification[specificationLength++] = *format++;
+        }
+        bool isLong = false;
+        while (*format == 'l' || *format == 'h') {
+            isLong = isLong || *format == 'l';
+            format++;
+        }
+        char conversion = *format ? *format++ : '\0';
+        if (isLong) { specification[specificationLength++] = 'l'; }
+        specification[specificationLength++] = conversion;
+        specification[specificationLength] = '\0';
+
+        uintptr_t arg = argIndex < entry.argCount ? entry.args[argIndex] : 0;
+        argIndex++;
+        int written = 0;
+        switch (conversion) {
+            case 'd':
+            case 'i':
+                written = isLong ? snprintf(buffer + length, size - length, specification, long(int32_t(arg)))
+                                 : snprintf(buffer + length, size - length, specification, int(int32_t(arg)));
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+                written = isLong ? snprintf(buffer + length, size - length, specification, (unsigned long)uint32_t(arg))
+                                 : snprintf(buffer + length, size - length, specification, unsigned(uint32_t(arg)));
+                break;
+            case 'c':
+                written = snprintf(buffer + length, size - length, specification, int(arg & 0xFF));
+                break;
+            case 's':
+                written = snprintf(buffer + length, size - length, specification, arg ? reinterpret_cast<const char*>(arg) : "(null)");
+                break;
+            case 'p':
+                written = snprintf(buffer + length, size - length, specification, reinterpret_cast<void*>(arg));
+                break;
+            default:
+                written = snprintf(buffer + length, size - length, "<%s?>", specification); // Not supported (float, 64 bit)
+                break;
+        }
+        if (written < 0) { break; }
+        length += size_t(written);
+    }
+    if (length > size - 1) { length = size - 1; } // Truncated
+    return length;
+}
+
+uint32_t LogManager::drain(void (*output)(const LogEntry& entry, const char* line, void* context), void* context) {
+    char line[LOG_MAX_LINE_LENGTH];
+    uint32_t count = 0;
+    xSemaphoreTake(drainMutex, portMAX_DELAY);
+    while (true) {
+        LogEntry& entry = ring[readPosition & (LOG_RING_SIZE - 1)];
+        uint32_t sequence = entry.sequence.load(std::memory_order_acquire) + (readPosition & (LOG_RING_SIZE - 1));
+        if (sequence != readPosition + 1) { break; } // Empty (or the next entry is not published yet)
+        format(entry, line, sizeof(line));
+        output(entry, line, context);
+        entry.sequence.store(readPosition + LOG_RING_SIZE - (readPosition & (LOG_RING_SIZE - 1)), std::memory_order_release);
+        readPosition++;
+        count++;
+    }
+    xSemaphoreGive(drainMutex);
+    return count;
+}
+
+// Drain task -----------------------------------------------------------
+static void printEntry(const LogEntry& entry, const char* line, void* context) {
+    esp_log_level_t level = static_cast<esp_log_level_t>(entry.site->level);
+    ESP_LOG_LEVEL(level, entry.site->tag, "[%lu.%06lu] %s", (unsigned long)(entry.timestampUs / 1000000),
+                  (unsigned long)(entry.timestampUs % 1000000), line);
+}
+
+void LogManager::taskLogDrain(void *pvParameters) {
+    LogManager* logManager = static_cast<LogManager*>(pvParameters);
+    uint32_t reportedDroppedCount = 0;
+    while (true) {
+        logManager->drain(printEntry, nullptr);
+        uint32_t dropped = getDroppedCount();
+        if (dropped != reportedDroppedCount) {
+            ESP_LOGW("LOG", "%lu log entries dropped (the ring is full)", (unsigned long)(dropped - reportedDroppedCount));
+            reportedDroppedCount = dropped;
+        }
+        vTaskDelay(LOG_DRAIN_PERIOD_MS / portTICK_PERIOD_MS);
+    }
+    vTaskDelete(NULL);
+}
+
+void LogManager::startDrainTask() {
+    if (drainTaskHandle) { return; } // Already running
+    xTaskCreate(&taskLogDrain, "LOG_DRAIN", LOG_DRAIN_STACK_SIZE, this, LOG_DRAIN_PRIORITY, &drainTaskHandle);
+}
+
+void LogManager::stopDrainTask() {
+    if (!drainTaskHandle) { return; } // Not running
+    xSemaphoreTake(drainMutex, portMAX_DELAY); // Do not delete the task in the middle of a drain
+    vTaskDelete(drainTaskHandle);
+    drainTaskHandle = nullptr;
+    xSemaphoreGive(drainMutex);
+}
+
+// Deinit log manager ---------------------------------------------------
+LogManager::~LogManager() {
+    DEBUG_DEINIT_START("Log manager");
+    stopDrainTask();
+    drain(printEntry, nullptr); // Flush
+    vSemaphoreDelete(drainMutex);
+    DEBUG_DEINIT_END("Log manager");
+}
+
+// Singleton ------------------------------------------------------------
+LogManager* LogManager::instance = nullptr;
+
+void LogManager::init() {
+    if (instance == nullptr) {
+        instance = new LogManager();
+        return;
+    }
+    DEBUG_INIT_NO_NEED("Log manager");
+}
+
+void LogManager::deinit() {
+    if (instance) {
+        delete instance;
+        instance = nullptr;
+        return;
+    }
+    DEBUG_DEINIT_NO_NEED("Log manager");
+}
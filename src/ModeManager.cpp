@@ -0,0 +1,255 @@
+/*
+ * File: ModeManager.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 3rd March 2025 7:12:40 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 3rd March 2025 7:12:40 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "ModeManager.h"
+#include "CameraManager.h"
+#include "LedManager.h"
+#include "MotorManager.h"
+#include "ServerManager.h"
+#include "StorageManager.h"
+#include "WiFiModulManager.h"
+
+// Subsystem hooks --------------------------------------------------------------------------------------------------
+static void startWiFi() {
+    WiFiModulManager* wifiModulManager = WiFiModulManager::getInstance();
+    StorageManager* storageManager = StorageManager::getInstance();
+    if (storageManager) {
+        wifiModulManager->setSSID(storageManager->getWiFiSSID().c_str());
+        wifiModulManager->setPassword(storageManager->getWiFiPassword().c_str());
+    }
+    wifiModulManager->startWiFiControls();
+}
+
+static void stopWiFi() { WiFiModulManager::getInstance()->stopWiFiControls(); }
+
+static void startLeds() {
+    LedManager* ledManager = LedManager::getInstance();
+    if (ledManager) { ledManager->startLedArrayControls(); }
+}
+
+static void stopLeds() {
+    LedManager* ledManager = LedManager::getInstance();
+    if (ledManager) { ledManager->stopLedArrayControls(); }
+}
+
+static void startCommandServer() { ServerManager::getInstance()->startCommandServer(); }
+
+static void stopCommandServer() { ServerManager::getInstance()->stopCommandServer(); }
+
+static void startCamera() { CameraManager::init(); }
+
+static void stopCamera() { CameraManager::deinit(); }
+
+static void suspendCamera() { CameraManager::getInstance()->powerDown(); }
+
+static void resumeCamera() { CameraManager::getInstance()->powerUp(); }
+
+static void startVideoServer() { ServerManager::getInstance()->startVideoServer(); }
+
+static void stopVideoServer() { ServerManager::getInstance()->stopVideoServer(); }
+
+static void startMotors() { MotorManager::getInstance()->startMotorControls(); }
+
+static void stopMotors() { MotorManager::getInstance()->stopMotorControls(); }
+
+// Power profile --------------------------------------------------------
+static void applyPowerProfile(const ModeProfile& profile) {
+    // Modem sleep is required by the automatic light sleep, the Wi-Fi wakes up for every DTIM beacon
+    Hal::WiFi::setPowerSave(profile.isPowerSaveEnabled);
+
+    esp_err_t err = Hal::Power::configure(profile.isPowerSaveEnabled, MODE_POWER_SAVE_MIN_CPU_FREQ_MHZ);
+    if (err != ESP_OK && err != ESP_ERR_NOT_SUPPORTED) { DEBUG_PRINT("Power management configuration failed with error: %d", err); } // Not supported: CONFIG_PM_ENABLE is off
+
+    LedManager* ledManager = LedManager::getInstance();
+    if (ledManager && (profile.requiredSubsystems & SUBSYSTEM_BIT(SUBSYSTEM_LEDS))) { ledManager->setLowPowerMode(profile.isLedDimmed); }
+}
+
+
+// Mode Manager -----------------------------------------------------------------------------------------------------
+// Init mode manager ----------------------------------------------------
+ModeManager::ModeManager() {
+    DEBUG_INIT_START("Mode manager");
+    currentMode = DroneMode::SHUTDOWN;
+    requestedMode = DroneMode::SHUTDOWN;
+    modeTaskHandle = nullptr;
+    activeSubsystems = 0;
+    suspendedSubsystems = 0;
+
+    subsystemHooks[SUBSYSTEM_WIFI] = { startWiFi, stopWiFi, nullptr, nullptr };
+    subsystemHooks[SUBSYSTEM_LEDS] = { startLeds, stopLeds, nullptr, nullptr };
+    subsystemHooks[SUBSYSTEM_COMMAND_SERVER] = { startCommandServer, stopCommandServer, nullptr, nullptr };
+    subsystemHooks[SUBSYSTEM_CAMERA] = { startCamera, stopCamera, suspendCamera, resumeCamera };
+    subsystemHooks[SUBSYSTEM_VIDEO_SERVER] = { startVideoServer, stopVideoServer, nullptr, nullptr };
+    subsystemHooks[SUBSYSTEM_MOTORS] = { startMotors, stopMotors, nullptr, nullptr };
+    powerProfileHook = applyPowerProfile;
+    DEBUG_INIT_END("Mode manager");
+}
+
+// Modes ----------------------------------------------------------------
+void ModeManager::setMode(DroneMode mode) {
+    requestedMode = mode;
+    TaskHandle_t taskHandle = modeTaskHandle;
+    if (taskHandle) { xTaskNotifyGive(taskHandle); } // Do not wait for the next period, it is part of the wake latency
+}
+
+void ModeManager::wakeUp() {
+    if (requestedMode == DroneMode::ROOM_PLANT) { setMode(DroneMode::DRIVE); }
+}
+
+void ModeManager::waitForModeRequest(uint32_t timeoutMs) {
+    modeTaskHandle = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, timeoutMs / portTICK_PERIOD_MS);
+}
+
+bool ModeManager::processModeRequest() {
+    DroneMode mode = requestedMode;
+    if (mode == currentMode) { return false; }
+    applyMode(mode);
+    return true;
+}
+
+#define ALL_SUBSYSTEMS      (SUBSYSTEM_BIT(SUBSYSTEM_WIFI) | SUBSYSTEM_BIT(SUBSYSTEM_LEDS) | SUBSYSTEM_BIT(SUBSYSTEM_COMMAND_SERVER) | \
+                             SUBSYSTEM_BIT(SUBSYSTEM_CAMERA) | SUBSYSTEM_BIT(SUBSYSTEM_VIDEO_SERVER) | SUBSYSTEM_BIT(SUBSYSTEM_MOTORS))
+
+static const ModeProfile modeProfiles[] = {
+    // SHUTDOWN
+    { 0, 0, false, false, 0 },
+    // DRIVE
+    { ALL_SUBSYSTEMS, 0, false, false, 0 },
+    // STREAM_ONLY
+    { ALL_SUBSYSTEMS & ~SUBSYSTEM_BIT(SUBSYSTEM_MOTORS), 0, false, false, 50 },
+    // ROOM_PLANT
+    { SUBSYSTEM_BIT(SUBSYSTEM_WIFI) | SUBSYSTEM_BIT(SUBSYSTEM_LEDS) | SUBSYSTEM_BIT(SUBSYSTEM_COMMAND_SERVER),
+      SUBSYSTEM_BIT(SUBSYSTEM_CAMERA), true, true, 200 },
+    // LOW_POWER
+    { SUBSYSTEM_BIT(SUBSYSTEM_WIFI) | SUBSYSTEM_BIT(SUBSYSTEM_COMMAND_SERVER), 0, true, false, 1000 }
+};
+
+const ModeProfile& ModeManager::getModeProfile(DroneMode mode) {
+    if (mode > DroneMode::LOW_POWER) { return modeProfiles[DroneMode::SHUTDOWN]; }
+    return modeProfiles[mode];
+}
+
+static const uint16_t subsystemStartLatenciesMs[SUBSYSTEM_COUNT] = {
+    WIFI_START_LATENCY_MS,
+    LEDS_START_LATENCY_MS,
+    COMMAND_SERVER_START_LATENCY_MS,
+    CAMERA_START_LATENCY_MS,
+    VIDEO_SERVER_START_LATENCY_MS,
+    MOTORS_START_LATENCY_MS
+};
+
+static const uint16_t subsystemResumeLatenciesMs[SUBSYSTEM_COUNT] = {
+    WIFI_START_LATENCY_MS,
+    LEDS_START_LATENCY_MS,
+    COMMAND_SERVER_START_LATENCY_MS,
+    CAMERA_RESUME_LATENCY_MS,
+    VIDEO_SERVER_START_LATENCY_MS,
+    MOTORS_START_LATENCY_MS
+};
+
+uint16_t ModeManager::estimateTransitionLatencyMs(DroneMode from, DroneMode to) {
+    const ModeProfile& fromProfile = getModeProfile(from);
+    const ModeProfile& toProfile = getModeProfile(to);
+
+    uint32_t latencyMs = MODE_REQUEST_LATENCY_MS;
+    if (fromProfile.isPowerSaveEnabled) { latencyMs += WIFI_DTIM_WAKE_LATENCY_MS; } // The request is received at the next DTIM beacon
+
+    for (uint8_t i = 0; i < SUBSYSTEM_COUNT; i++) {
+        if (!(toProfile.requiredSubsystems & SUBSYSTEM_BIT(i)) || (fromProfile.requiredSubsystems & SUBSYSTEM_BIT(i))) { continue; }
+        latencyMs += (fromProfile.suspendedSubsystems & SUBSYSTEM_BIT(i)) ? subsystemResumeLatenciesMs[i] : subsystemStartLatenciesMs[i];
+    }
+    return latencyMs > UINT16_MAX ? UINT16_MAX : uint16_t(latencyMs);
+}
+
+// Subsystems -----------------------------------------------------------
+void ModeManager::applyMode(DroneMode mode) {
+    DEBUG_PRINT("--- Changing mode: %d -> %d", currentMode, mode);
+    const ModeProfile& profile = getModeProfile(mode);
+    uint8_t neededSubsystems = profile.requiredSubsystems | profile.suspendedSubsystems;
+
+    // Leave the power save first (full CPU speed for the wake up), enter it only after the transition
+    if (!profile.isPowerSaveEnabled && powerProfileHook) { powerProfileHook(profile); }
+
+    // Stop the not needed subsystems first (in reverse order) to free memory for the new ones
+    for (int8_t i = SUBSYSTEM_COUNT - 1; i >= 0; i--) {
+        uint8_t bit = SUBSYSTEM_BIT(i);
+        if (((activeSubsystems | suspendedSubsystems) & bit) && !(neededSubsystems & bit)) {
+            if (suspendedSubsystems & bit) { // The stop hooks expect a running subsystem
+                if (subsystemHooks[i].resume) { subsystemHooks[i].resume(); }
+                suspendedSubsystems &= ~bit;
+            }
+            if (subsystemHooks[i].stop) { subsystemHooks[i].stop(); }
+            activeSubsystems &= ~bit;
+        }
+    }
+
+    // Start or resume the missing subsystems (in dependency order)
+    for (int8_t i = 0; i < SUBSYSTEM_COUNT; i++) {
+        uint8_t bit = SUBSYSTEM_BIT(i);
+        if ((neededSubsystems & bit) && !((activeSubsystems | suspendedSubsystems) & bit)) {
+            if (subsystemHooks[i].start) { subsystemHooks[i].start(); }
+            activeSubsystems |= bit;
+        }
+        else if ((profile.requiredSubsystems & bit) && (suspendedSubsystems & bit)) {
+            if (subsystemHooks[i].resume) { subsystemHooks[i].resume(); }
+            suspendedSubsystems &= ~bit;
+            activeSubsystems |= bit;
+        }
+    }
+
+    // Suspend the subsystems which are not used in this mode, but have to wake up fast (in reverse order)
+    for (int8_t i = SUBSYSTEM_COUNT - 1; i >= 0; i--) {
+        uint8_t bit = SUBSYSTEM_BIT(i);
+        if ((profile.suspendedSubsystems & bit) && (activeSubsystems & bit)) {
+            if (subsystemHooks[i].suspend) {
+                subsystemHooks[i].suspend();
+                suspendedSubsystems |= bit;
+            }
+            else if (subsystemHooks[i].stop) { subsystemHooks[i].stop(); } // Not suspendable, it is started again on wake up
+            activeSubsystems &= ~bit;
+        }
+    }
+
+    if (profile.isPowerSaveEnabled && powerProfileHook) { powerProfileHook(profile); }
+
+    currentMode = mode;
+    DEBUG_PRINT("Mode changed, active subsystems: 0x%02x, suspended subsystems: 0x%02x ---", activeSubsystems, suspendedSubsystems);
+}
+
+// Deinit mode manager --------------------------------------------------
+ModeManager::~ModeManager() {
+    DEBUG_DEINIT_START("Mode manager");
+    applyMode(DroneMode::SHUTDOWN);
+    DEBUG_DEINIT_END("Mode manager");
+}
+
+// Singleton ------------------------------------------------------------
+ModeManager* ModeManager::instance = nullptr;
+
+void ModeManager::init() {
+    if (instance == nullptr) {
+        instance = new ModeManager();
+        return;
+    }
+    DEBUG_INIT_NO_NEED("Mode manager");
+}
+
+void ModeManager::deinit() {
+    if (instance) {
+        delete instance;
+        instance = nullptr;
+        return;
+    }
+    DEBUG_DEINIT_NO_NEED("Mode manager");
+}
@@ -12,17 +12,17 @@
  */
 
 #include "MotorManager.h"
-#include "driver/ledc.h"        // LEDC driver for PWM control
+#include "ControlJitterBuffer.h"
+#include "FlightRecorder.h"
+#include "LogManager.h"
+#include "TelemetryManager.h"
+#include "TraceManager.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
-extern "C" {
-#include <string.h>
-}
-
 // Motor --------------------------------------------------------------------------------------------------------
 // Init motor -----------------------------------------------------------
-Motor::Motor(int8_t motorCWPin, ledc_channel_t motorCW, int8_t motorCCWPin, ledc_channel_t motorCCW) {
+Motor::Motor(int8_t motorCWPin, uint8_t motorCW, int8_t motorCCWPin, uint8_t motorCCW) {
     this->motorCW = motorCW;
     this->motorCCW = motorCCW;
     motorPinConfig(motorCWPin, motorCW);
@@ -35,10 +35,10 @@ Motor::Motor(int8_t motorCWPin, ledc_channel_t motorCW, int8_t motorCCWPin, ledc
 void Motor::setSpeed(int16_t speed) {
     if (speed > 1 || speed < -1) { speed = convertSpeedPercentageToDutyCycle(speed); }
     else { speed = MOTOR_OFF; }
-    ledc_set_duty(MOTOR_SPEED_MODE, motorCW, speed > 0 ? speed : 0);
-    ledc_set_duty(MOTOR_SPEED_MODE, motorCCW, speed < 0 ? -speed : 0);
-    ledc_update_duty(MOTOR_SPEED_MODE, motorCW);
-    ledc_update_duty(MOTOR_SPEED_MODE, motorCCW);
+    this->speed = speed;
+    TRACE_SPAN("ledc_update");
+    Hal::Pwm::setDuty(motorCW, speed > 0 ? speed : 0);
+    Hal::Pwm::setDuty(motorCCW, speed < 0 ? -speed : 0);
 }
 #endif
 #ifdef VERSION_BETA_OR_LATER
@@ -48,8 +48,8 @@ void Motor::setSpeed(int16_t speed) {
 // Deinit motor ----------------------------------------------------------
 Motor::~Motor() {
     setSpeed(MOTOR_OFF);
-    ledc_stop(MOTOR_SPEED_MODE, motorCW, 0);
-    ledc_stop(MOTOR_SPEED_MODE, motorCCW, 0);
+    Hal::Pwm::stop(motorCW);
+    Hal::Pwm::stop(motorCCW);
 }
 
 // Private methods -------------------------------------------------------
@@ -58,32 +58,10 @@ int16_t Motor::convertSpeedPercentageToDutyCycle(int16_t speed) {
     else { return int16_t(speed * 1.6 - MOTOR_MIN_SPEED); }
 }
 
-void Motor::motorPinConfig(int8_t pin, ledc_channel_t motor) {
+void Motor::motorPinConfig(int8_t pin, uint8_t motor) {
     DEBUG_PRINT("--- Configuring motor pins");
-    memset(&timerConfig, 0, sizeof(ledc_timer_config_t));
-    timerConfig = {
-        .speed_mode = MOTOR_SPEED_MODE,
-        .duty_resolution = MOTOR_DUTY_RES,
-        .timer_num = MOTOR_TIMER,
-        .freq_hz = MOTOR_FREQ,
-        .clk_cfg = LEDC_AUTO_CLK,
-        .deconfigure = false
-    };
-    ESP_ERROR_CHECK(ledc_timer_config(&timerConfig));
-
-    memset(&channelConfig, 0, sizeof(ledc_channel_config_t));
-    channelConfig = {
-        .gpio_num = (int)pin,
-        .speed_mode = MOTOR_SPEED_MODE,
-        .channel = motor,
-        .intr_type = LEDC_INTR_DISABLE,
-        .timer_sel = MOTOR_TIMER,
-        .duty = 0,
-        .hpoint = 0,
-        //.sleep_mode = LEDC_SLEEP_MODE_NO_ALIVE_ALLOW_PD,
-        .flags = { .output_invert = false }
-    };
-    ESP_ERROR_CHECK(ledc_channel_config(&channelConfig));
+    ESP_ERROR_CHECK(Hal::Pwm::configTimer(MOTOR_TIMER, MOTOR_DUTY_RES, MOTOR_FREQ));
+    ESP_ERROR_CHECK(Hal::Pwm::configChannel(motor, pin, MOTOR_TIMER));
     DEBUG_PRINT("Motor pins configured ---");
 }
 
@@ -103,6 +81,9 @@ MotorManager::MotorManager() {
         .L = 0,
         .R = 0
     };
+    appliedControlData = controlData;
+    jitterBuffer = new ControlJitterBuffer();
+    controlMutex = xSemaphoreCreateMutex();
 }
 
 // Motor controls -------------------------------------------------------
@@ -195,29 +176,80 @@ void MotorManager::allStop() {
 
 // Control --------------------------------------------------------------
 void MotorManager::setControlData(int16_t X, int16_t Y, int8_t L, int8_t R) {
-    controlData.X = X;
-    controlData.Y = Y;
     if (L > 0 && R > 0) { L = 0; R = 0; } // For safety
-    controlData.L = L;
-    controlData.R = R;
+    ControlData command = { .X = X, .Y = Y, .L = L, .R = R };
+    xSemaphoreTake(controlMutex, portMAX_DELAY);
+    jitterBuffer->clear(); // An older command of the controller must not come after this one
+    controlData = command;
+    appliedControlData = command;
+    xSemaphoreGive(controlMutex);
+    FlightRecorder::recordControl(command);
+}
+
+void MotorManager::queueControlData(int16_t X, int16_t Y, int8_t L, int8_t R) {
+    if (L > 0 && R > 0) { L = 0; R = 0; } // For safety
+    ControlData command = { .X = X, .Y = Y, .L = L, .R = R };
+    xSemaphoreTake(controlMutex, portMAX_DELAY);
+    jitterBuffer->push(command, Hal::Timer::getTimeUs());
+    controlData = command;
+    xSemaphoreGive(controlMutex);
+    FlightRecorder::recordControl(command);
+}
+
+ControlData MotorManager::playControlData() {
+    ControlData command;
+    xSemaphoreTake(controlMutex, portMAX_DELAY);
+    ControlJitterOutput output = jitterBuffer->play(Hal::Timer::getTimeUs(), command);
+    if (output != ControlJitterOutput::NONE) { appliedControlData = command; }
+    if (output == ControlJitterOutput::FAILSAFE) { controlData = command; }
+    ControlData applied = appliedControlData;
+    xSemaphoreGive(controlMutex);
+    if (output == ControlJitterOutput::FAILSAFE) { LOG_W(MOTOR, "No command for %d ms, the motors are stopped", CONTROL_FAILSAFE_MS); }
+    return applied;
+}
+
+ControlData MotorManager::getAppliedControlData() const {
+    xSemaphoreTake(controlMutex, portMAX_DELAY);
+    ControlData applied = appliedControlData;
+    xSemaphoreGive(controlMutex);
+    return applied;
+}
+
+void MotorManager::setControlJitterDepthMs(uint16_t depthMs) {
+    xSemaphoreTake(controlMutex, portMAX_DELAY);
+    jitterBuffer->setDepthMs(depthMs);
+    xSemaphoreGive(controlMutex);
+}
+
+ControlJitterStats MotorManager::getControlJitterStats() {
+    xSemaphoreTake(controlMutex, portMAX_DELAY);
+    ControlJitterStats stats = jitterBuffer->getStats();
+    xSemaphoreGive(controlMutex);
+    return stats;
 }
 
 #ifdef MANUAL_CONTROL
-void MotorManager::directionControlManual() {
+void MotorManager::directionControlManual(const ControlData& control) {
     // Horizontal movement (Y, L, R = Dont Care)
-    if (controlData.X >= 70 || controlData.X <= -70) {
-        moveOnXAxisManual(controlData.X);
+    if (control.X >= 70 || control.X <= -70) {
+        moveOnXAxisManual(control.X);
+    }
+    // Forward movement with an obstacle in front: stop
+    else if (control.Y >= 2 && isStopHinted()) {
+        allStop();
+        stopHintBlocks.fetch_add(1, std::memory_order_relaxed);
     }
     // Vertical movement (X < 70 || X > -70; L, R = 0-100)
-    else if (controlData.Y >= 2 || controlData.Y <= -2) { 
-        moveOnYAxisManual(controlData.Y, controlData.L, controlData.R); 
+    else if (control.Y >= 2 || control.Y <= -2) { 
+        moveOnYAxisManual(control.Y, control.L, control.R); 
     }
     // Rotation (X = Dont Care; Y < 2 || -2 > Y; L, R = 0-100)
-    else if ((controlData.L > 0 && controlData.R == 0) || (controlData.R > 0 && controlData.L == 0)) {
-        turnOnZAxisManual(controlData.L, controlData.R);
+    else if ((control.L > 0 && control.R == 0) || (control.R > 0 && control.L == 0)) {
+        turnOnZAxisManual(control.L, control.R);
     }
     // All stop (X = 0; Y = 0; L = 0; R = 0)
     else { allStop(); }
+    TelemetryManager::recordMotorDuties(leftMotor.getSpeed(), rightMotor.getSpeed());
 }
 #endif
 #ifdef VERSION_BETA_OR_LATER // Beta update (Auto-Assisted Controls)
@@ -227,27 +259,87 @@ void MotorManager::directionControlAutoAssisted() { }
 #endif
 #endif
 
+// Stop hint ------------------------------------------------------------
+void MotorManager::setStopHint(uint32_t holdMs) {
+    stopHintEndMs.store(uint32_t(Hal::Timer::getTimeUs() / 1000) + holdMs, std::memory_order_relaxed);
+    isStopHintSet.store(true, std::memory_order_release);
+}
+
+void MotorManager::clearStopHint() {
+    isStopHintSet.store(false, std::memory_order_relaxed);
+}
+
+bool MotorManager::isStopHinted() {
+    if (!isStopHintSet.load(std::memory_order_acquire)) { return false; }
+    return int32_t(stopHintEndMs.load(std::memory_order_relaxed) - uint32_t(Hal::Timer::getTimeUs() / 1000)) > 0;
+}
+
 // Motor Controls --------------------------------------------------------
 // Tasks ----------------------------------------------------------------
+static std::atomic<bool> isMotorTaskEnabled{false};     // Cleared by stopMotorControls(), the task ends after its loop
+static std::atomic<bool> isMotorTaskRunning{false};     // Cleared by the task, right before it deletes itself
+
 static void taskDirectionControl(void *pvParameters) {
     MotorManager* motorManager = MotorManager::getInstance();
-    while (true) {
+    int64_t lastStartUs = 0;
+    while (isMotorTaskEnabled.load(std::memory_order_acquire)) {
+        int64_t startUs = Hal::Timer::getTimeUs();
+        {
+            TRACE_SPAN("motor_loop");
+            ControlData control = motorManager->playControlData();
 #ifdef MANUAL_CONTROL
-        motorManager->directionControlManual();
+            motorManager->directionControlManual(control);
 #endif
 #ifdef VERSION_BETA_OR_LATER
 #ifdef AUTO_CONTROL
-        motorManager->directionControlAutoAssisted();
+            motorManager->directionControlAutoAssisted();
 #endif
 #endif
-        vTaskDelay(20 / portTICK_PERIOD_MS);
+        }
+        int16_t leftDuty, rightDuty;
+        motorManager->getMotorDuties(leftDuty, rightDuty);
+        FlightRecorder::recordMotorLoop(leftDuty, rightDuty, lastStartUs ? uint32_t(startUs - lastStartUs) : 0,
+                                        uint32_t(Hal::Timer::getTimeUs() - startUs));
+        lastStartUs = startUs;
+        vTaskDelay(MOTOR_CONTROL_PERIOD_MS / portTICK_PERIOD_MS);
     }
+    // Between two loops: the control and the flight recorder locks are free
+    isMotorTaskRunning.store(false, std::memory_order_release);
     vTaskDelete(NULL);
 }
 
-static TaskHandle_t motorTaskHandle = nullptr;
 void MotorManager::startMotorControls() {
-    xTaskCreatePinnedToCore(&taskDirectionControl, "DIR_CONT", 1024, nullptr, 5, &motorTaskHandle, 1);
+    if (isMotorTaskRunning.load(std::memory_order_acquire)) { // Already running (or a stop timed out, it goes on)
+        isMotorTaskEnabled.store(true, std::memory_order_release);
+        return;
+    }
+    setControlData(0, 0, 0, 0); // Do not continue an old command
+    Hal::Pwm::resumeTimer(MOTOR_TIMER);
+    isMotorTaskEnabled.store(true, std::memory_order_release);
+    isMotorTaskRunning.store(true, std::memory_order_release);
+    // 2 kB: the flight record of every loop takes the lock of the flight recorder
+    if (xTaskCreatePinnedToCore(&taskDirectionControl, "DIR_CONT", 2048, nullptr, 5, nullptr, 1) != pdPASS) {
+        isMotorTaskEnabled.store(false, std::memory_order_relaxed);
+        isMotorTaskRunning.store(false, std::memory_order_relaxed);
+        LOG_E(MOTOR, "Direction control task not created");
+    }
+}
+
+bool MotorManager::isMotorControlRunning() { return isMotorTaskRunning.load(std::memory_order_acquire); }
+
+void MotorManager::stopMotorControls() {
+    // The task is not deleted from here: it could hold the control or the flight recorder lock, and a deleted holder
+    // never gives it back. It ends by itself after the current loop (at most a period)
+    isMotorTaskEnabled.store(false, std::memory_order_release);
+    for (uint16_t waitedMs = 0; isMotorTaskRunning.load(std::memory_order_acquire) && waitedMs < MOTOR_TASK_STOP_TIMEOUT_MS;
+         waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (isMotorTaskRunning.load(std::memory_order_acquire)) { LOG_E(MOTOR, "Direction control task did not stop in time"); }
+    setControlData(0, 0, 0, 0);
+    allStop();
+    TelemetryManager::recordMotorDuties(MOTOR_OFF, MOTOR_OFF);
+    Hal::Pwm::pauseTimer(MOTOR_TIMER); // Gate the PWM (the duty is already 0)
 }
 
 // Deinit motor manager ------------------------------------------------
@@ -257,6 +349,8 @@ MotorManager::~MotorManager() {
     // leftMotor.~Motor();
     // rightMotor.~Motor();
     // delete instance;
+    delete jitterBuffer;
+    vSemaphoreDelete(controlMutex);
 }
 
 // Singleton -------------------------------------------------------------
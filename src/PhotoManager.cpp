@@ -0,0 +1,239 @@
+/*
+ * File: PhotoManager.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "PhotoManager.h"
+#include "Hal.h"
+#include "LogManager.h"
+
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+}
+
+// Init photo manager ---------------------------------------------------
+PhotoManager::PhotoManager() {
+    DEBUG_INIT_START("Photo manager");
+    ringMutex = xSemaphoreCreateMutex();
+    captureMutex = xSemaphoreCreateMutex();
+    memset(ring, 0, sizeof(ring));
+    nextId = 1;
+    memset(&stats, 0, sizeof(stats));
+    DEBUG_INIT_END("Photo manager");
+}
+
+// Stills ---------------------------------------------------------------
+PhotoFrame* PhotoManager::createFrame(const HalCameraFrame& cameraFrame) {
+    const uint8_t* jpeg = cameraFrame.data;
+    size_t length = cameraFrame.length;
+    uint8_t* converted = nullptr;
+    if (cameraFrame.format != HAL_PIXFORMAT_JPEG) {
+        if (!Hal::Camera::convertToJpeg(cameraFrame, PHOTO_CONVERT_QUALITY, &converted, &length)) { return nullptr; }
+        jpeg = converted;
+    }
+    // PSRAM first, like the frame buffers: a still does not fit the internal RAM anyway
+    size_t size = sizeof(PhotoFrame) + length;
+    void* block = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (!block) { block = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT); }
+    if (!block) {
+        free(converted);
+        return nullptr;
+    }
+
+    PhotoFrame* frame = static_cast<PhotoFrame*>(block);
+    frame->data = reinterpret_cast<uint8_t*>(frame + 1);
+    frame->length = length;
+    frame->width = cameraFrame.width;
+    frame->height = cameraFrame.height;
+    frame->timestampUs = cameraFrame.timestampUs;
+    frame->id = 0;
+    frame->refCount = 1;            // The ring
+    memcpy(frame->data, jpeg, length);
+    free(converted);
+    return frame;
+}
+
+uint32_t PhotoManager::store(PhotoFrame* frame) {
+    PhotoFrame* replaced = nullptr;
+    xSemaphoreTake(ringMutex, portMAX_DELAY);
+    frame->id = nextId++;
+    PhotoFrame*& slot = ring[frame->id % PHOTO_RING_SIZE];
+    if (slot && --slot->refCount == 0) { replaced = slot; }
+    slot = frame;
+    stats.stills++;
+    xSemaphoreGive(ringMutex);
+    heap_caps_free(replaced); // Outside of the lock, nobody else has it
+    return frame->id;
+}
+
+esp_err_t PhotoManager::capture(uint8_t count, uint32_t* firstId) {
+    if (count == 0 || count > PHOTO_BURST_MAX) { return ESP_ERR_INVALID_ARG; }
+    CameraManager* cameraManager = CameraManager::getInstance();
+    if (!cameraManager || cameraManager->isCameraPoweredDown() || !cameraManager->isFrameSizeAllocated(PHOTO_FRAMESIZE)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xSemaphoreTake(captureMutex, 0) != pdTRUE) { return ESP_ERR_INVALID_STATE; }
+
+    const CameraSettings streamSettings = cameraManager->getSettings();
+    CameraSettings photoSettings = streamSettings;
+    photoSettings.frameSize = PHOTO_FRAMESIZE;
+    photoSettings.jpegQuality = PHOTO_JPEG_QUALITY;
+    photoSettings.window = {};      // The full sensor
+    uint16_t width, height;
+    Hal::Camera::getResolution(PHOTO_FRAMESIZE, &width, &height);
+
+    int64_t holdStartUs = Hal::Timer::getTimeUs();
+    cameraManager->holdStream();
+    esp_err_t err = cameraManager->applySettings(photoSettings, false);
+    uint32_t switchUs = cameraManager->getLastSwitch().durationUs;
+    uint8_t stills = 0;
+    uint32_t droppedFrames = 0;
+    uint32_t heldFrames = 0;        // Taken by the burst, the stream misses them
+    int64_t firstFrameUs = 0;
+    int64_t lastFrameUs = 0;
+    if (err == ESP_OK) {
+        uint8_t staleFrames = 0;
+        uint8_t settleFrames = PHOTO_SETTLE_FRAMES;
+        while (stills < count) {
+            HalCameraFrame cameraFrame;
+            if (!Hal::Camera::getFrame(cameraFrame)) {
+                err = ESP_FAIL;
+                break;
+            }
+            if (heldFrames++ == 0) { firstFrameUs = cameraFrame.timestampUs; }
+            lastFrameUs = cameraFrame.timestampUs;
+            bool isPhotoSize = cameraFrame.width == width && cameraFrame.height == height;
+            if (!isPhotoSize || settleFrames > 0) {
+                Hal::Camera::returnFrame(cameraFrame);
+                droppedFrames++;
+                if (isPhotoSize) { settleFrames--; }
+                else if (++staleFrames > CAMERA_STALE_FRAMES_MAX) {
+                    err = ESP_FAIL;     // The sensor did not switch
+                    break;
+                }
+                continue;
+            }
+            PhotoFrame* frame = createFrame(cameraFrame);
+            Hal::Camera::returnFrame(cameraFrame);
+            if (!frame) {
+                err = ESP_ERR_NO_MEM;
+                break;
+            }
+            uint32_t id = store(frame);
+            if (stills++ == 0) { *firstId = id; }
+        }
+    }
+    // Back to the stream settings (live too), also after a photo switch that failed halfway (the frame size may be
+    // switched already). Nothing is written if the sensor still has them. The streams drop the photo size frames
+    // left in the buffers
+    esp_err_t restoreErr = cameraManager->applySettings(streamSettings, false);
+    if (restoreErr != ESP_OK) { LOG_E(CAMERA, "Stream settings not restored after the photo: %d", restoreErr); }
+    if (err == ESP_OK) { err = restoreErr; }
+    cameraManager->releaseStream();
+    // On the frame timestamps (the sensor clock): the frame period times the frames the stream missed (the held ones,
+    // and one on both sides of them). The host clock only if there is no period to measure
+    uint32_t gapUs = heldFrames >= 2 ? uint32_t((lastFrameUs - firstFrameUs) * (heldFrames + 1) / (heldFrames - 1))
+                                     : uint32_t(Hal::Timer::getTimeUs() - holdStartUs);
+
+    xSemaphoreTake(ringMutex, portMAX_DELAY);
+    if (err == ESP_OK) { stats.bursts++; } else { stats.failures++; }
+    stats.droppedFrames += droppedFrames;
+    stats.lastSwitchUs = switchUs;
+    stats.lastGapUs = gapUs;
+    if (gapUs > stats.maxGapUs) { stats.maxGapUs = gapUs; }
+    if (gapUs > uint32_t(PHOTO_STREAM_GAP_BUDGET_MS) * 1000) { stats.gapsOverBudget++; }
+    xSemaphoreGive(ringMutex);
+    xSemaphoreGive(captureMutex);
+
+    if (err != ESP_OK) {
+        LOG_E(CAMERA, "Photo failed with error: %d after %u stills", err, unsigned(stills));
+        return err;
+    }
+    LOG_I(CAMERA, "Photo: %u stills, the stream waited %u us (%u frames dropped)", unsigned(stills), unsigned(gapUs),
+          unsigned(droppedFrames));
+    if (gapUs > uint32_t(PHOTO_STREAM_GAP_BUDGET_MS) * 1000) { LOG_W(CAMERA, "Photo stream gap over budget: %u us", unsigned(gapUs)); }
+    return ESP_OK;
+}
+
+const PhotoFrame* PhotoManager::acquire(uint32_t id) {
+    PhotoFrame* frame = nullptr;
+    xSemaphoreTake(ringMutex, portMAX_DELAY);
+    if (id == 0 && nextId > 1) { id = nextId - 1; }
+    PhotoFrame* slot = ring[id % PHOTO_RING_SIZE];
+    if (id != 0 && slot && slot->id == id) {
+        frame = slot;
+        frame->refCount++;
+    }
+    xSemaphoreGive(ringMutex);
+    return frame;
+}
+
+void PhotoManager::release(const PhotoFrame* frame) {
+    if (!frame) { return; }
+    PhotoFrame* released = const_cast<PhotoFrame*>(frame);
+    xSemaphoreTake(ringMutex, portMAX_DELAY);
+    bool isLast = --released->refCount == 0;
+    xSemaphoreGive(ringMutex);
+    if (isLast) { heap_caps_free(released); }
+}
+
+uint8_t PhotoManager::getIds(uint32_t (&ids)[PHOTO_RING_SIZE]) {
+    uint8_t count = 0;
+    xSemaphoreTake(ringMutex, portMAX_DELAY);
+    uint32_t first = nextId > PHOTO_RING_SIZE ? nextId - PHOTO_RING_SIZE : 1;
+    for (uint32_t id = first; id < nextId; id++) {
+        if (ring[id % PHOTO_RING_SIZE] && ring[id % PHOTO_RING_SIZE]->id == id) { ids[count++] = id; }
+    }
+    xSemaphoreGive(ringMutex);
+    return count;
+}
+
+PhotoStats PhotoManager::getStats() {
+    xSemaphoreTake(ringMutex, portMAX_DELAY);
+    PhotoStats copy = stats;
+    xSemaphoreGive(ringMutex);
+    return copy;
+}
+
+// Deinit photo manager -------------------------------------------------
+PhotoManager::~PhotoManager() {
+    DEBUG_DEINIT_START("Photo manager");
+    // The servers are stopped: no request holds a still
+    for (PhotoFrame*& frame : ring) {
+        if (frame && --frame->refCount == 0) { heap_caps_free(frame); }
+        frame = nullptr;
+    }
+    vSemaphoreDelete(captureMutex);
+    vSemaphoreDelete(ringMutex);
+    DEBUG_DEINIT_END("Photo manager");
+}
+
+// Singleton ------------------------------------------------------------
+PhotoManager* PhotoManager::instance = nullptr;
+
+void PhotoManager::init() {
+    if (instance == nullptr) {
+        instance = new PhotoManager();
+        return;
+    }
+    DEBUG_INIT_NO_NEED("Photo manager");
+}
+
+void PhotoManager::deinit() {
+    if (instance) {
+        delete instance;
+        instance = nullptr;
+        return;
+    }
+    DEBUG_DEINIT_NO_NEED("Photo manager");
+}
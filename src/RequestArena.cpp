@@ -0,0 +1,107 @@
+/*
+ * File: RequestArena.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "RequestArena.h"
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+}
+
+// Request Arena ------------------------------------------------------------------------------------------------
+// Init request arena ---------------------------------------------------
+RequestArena::RequestArena(uint8_t* buffer, size_t size) {
+    // The start is aligned, so every allocation (rounded up to the alignment) stays aligned
+    size_t padding = (REQUEST_ARENA_ALIGNMENT - uintptr_t(buffer) % REQUEST_ARENA_ALIGNMENT) % REQUEST_ARENA_ALIGNMENT;
+    this->buffer = buffer + padding;
+    this->size = size > padding ? size - padding : 0;
+    used = 0;
+    highWaterMark = 0;
+    failedCount = 0;
+}
+
+// Allocation -----------------------------------------------------------
+void* RequestArena::allocate(size_t length) {
+    size_t alignedLength = (length + REQUEST_ARENA_ALIGNMENT - 1) & ~size_t(REQUEST_ARENA_ALIGNMENT - 1);
+    if (alignedLength < length || alignedLength > size - used) {
+        failedCount++;
+        return nullptr;
+    }
+    void* memory = buffer + used;
+    used += alignedLength;
+    if (used > highWaterMark) { highWaterMark = used; }
+    return memory;
+}
+
+char* RequestArena::allocateString(size_t capacity) {
+    char* string = static_cast<char*>(allocate(capacity + 1));
+    if (string) { string[0] = '\0'; }
+    return string;
+}
+
+// Fixed String -------------------------------------------------------------------------------------------------
+// Init fixed string ----------------------------------------------------
+FixedString::FixedString(char* buffer, size_t size) {
+    this->buffer = buffer;
+    this->size = buffer ? size : 0;
+    position = 0;
+    isOverflowed = this->size == 0;
+    if (this->size > 0) { buffer[0] = '\0'; }
+}
+
+FixedString::FixedString(RequestArena& arena, size_t capacity) : FixedString(arena.allocateString(capacity), capacity + 1) {}
+
+// Buffer ---------------------------------------------------------------
+void FixedString::clear() {
+    position = 0;
+    isOverflowed = size == 0;
+    if (size > 0) { buffer[0] = '\0'; }
+}
+
+// Append ---------------------------------------------------------------
+FixedString& FixedString::append(const char* text, size_t length) {
+    if (size == 0) { return *this; }
+    size_t available = size - 1 - position; // Keep place for the terminating zero
+    if (length > available) {
+        length = available;
+        isOverflowed = true;
+    }
+    memcpy(buffer + position, text, length);
+    position += length;
+    buffer[position] = '\0';
+    return *this;
+}
+
+FixedString& FixedString::append(const char* text) {
+    return append(text, strlen(text));
+}
+
+FixedString& FixedString::appendFormat(const char* format, ...) {
+    if (size == 0) { return *this; }
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer + position, size - position, format, args);
+    va_end(args);
+    if (length < 0) { // Encoding error, drop the piece
+        buffer[position] = '\0';
+        isOverflowed = true;
+        return *this;
+    }
+    if (size_t(length) > size - 1 - position) {
+        position = size - 1;
+        isOverflowed = true;
+    } else {
+        position += length;
+    }
+    return *this;
+}
@@ -0,0 +1,228 @@
+/*
+ * File: ResourceManager.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "ResourceManager.h"
+#include "LogManager.h"
+
+extern "C" {
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+}
+
+// Init resource manager ------------------------------------------------
+ResourceManager::ResourceManager() {
+    DEBUG_INIT_START("Resource manager");
+    lastTaskCount = 0;
+    lastTotalRunTime = 0;
+    sampleMutex = xSemaphoreCreateMutex();
+    memset(&lastSample, 0, sizeof(lastSample));
+    memset(&monitorSample, 0, sizeof(monitorSample));
+    hasLastSample = false;
+    monitorTaskHandle = nullptr;
+    activeAlarms = RESOURCE_ALARM_NONE;
+    startMonitorTask();
+    DEBUG_INIT_END("Resource manager");
+}
+
+// Sampling -------------------------------------------------------------
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+static TaskStatus_t taskStatuses[RESOURCE_MAX_TASKS]; // Too big for the monitor task stack, used under the sample mutex
+#endif
+
+void ResourceManager::sampleTasks(ResourceSample& sample) {
+    sample.taskCount = 0;
+    sample.lowestStackTask = -1;
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+    configRUN_TIME_COUNTER_TYPE totalRunTime = 0;
+    UBaseType_t taskCount = uxTaskGetSystemState(taskStatuses, RESOURCE_MAX_TASKS, &totalRunTime);
+    if (taskCount == 0) { return; } // More tasks than RESOURCE_MAX_TASKS
+
+    // The run time counters wrap around (32 bit microseconds), only the differences are used
+    uint32_t elapsed = uint32_t(totalRunTime) - lastTotalRunTime;
+    bool hasPreviousSample = lastTaskCount > 0 && elapsed > 0;
+    for (UBaseType_t i = 0; i < taskCount; i++) {
+        ResourceTaskStats& task = sample.tasks[i];
+        strncpy(task.name, taskStatuses[i].pcTaskName, RESOURCE_TASK_NAME_LENGTH - 1);
+        task.name[RESOURCE_TASK_NAME_LENGTH - 1] = '\0';
+        task.stackHighWaterMark = taskStatuses[i].usStackHighWaterMark; // Bytes on the ESP-IDF (the stack type is uint8_t)
+        task.runTimeUs = uint32_t(taskStatuses[i].ulRunTimeCounter);
+        task.cpuPermille = 0;
+        for (uint8_t j = 0; hasPreviousSample && j < lastTaskCount; j++) {
+            if (lastTaskNumbers[j] == taskStatuses[i].xTaskNumber) {
+                uint64_t permille = uint64_t(task.runTimeUs - lastTaskRunTimes[j]) * 1000 / elapsed;
+                task.cpuPermille = permille > 1000 ? 1000 : uint16_t(permille);
+                break;
+            }
+        }
+        if (sample.lowestStackTask < 0 || task.stackHighWaterMark < sample.tasks[sample.lowestStackTask].stackHighWaterMark) {
+            sample.lowestStackTask = int8_t(i);
+        }
+    }
+
+    for (UBaseType_t i = 0; i < taskCount; i++) {
+        lastTaskNumbers[i] = taskStatuses[i].xTaskNumber;
+        lastTaskRunTimes[i] = uint32_t(taskStatuses[i].ulRunTimeCounter);
+    }
+    lastTaskCount = uint8_t(taskCount);
+    lastTotalRunTime = uint32_t(totalRunTime);
+    sample.taskCount = uint8_t(taskCount);
+#endif
+}
+
+static void sampleHeap(ResourceHeapStats& heap, uint32_t caps) {
+    heap.freeBytes = heap_caps_get_free_size(caps);
+    heap.minFreeBytes = heap_caps_get_minimum_free_size(caps);
+    heap.largestFreeBlock = heap_caps_get_largest_free_block(caps);
+}
+
+void ResourceManager::sample(ResourceSample& sample) {
+    xSemaphoreTake(sampleMutex, portMAX_DELAY);
+    sample.uptimeMs = uint32_t(Hal::Timer::getTimeUs() / 1000);
+    sampleHeap(sample.internalHeap, MALLOC_CAP_INTERNAL);
+    sample.hasPsram = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0;
+    if (sample.hasPsram) {
+        sampleHeap(sample.psramHeap, MALLOC_CAP_SPIRAM);
+    } else {
+        memset(&sample.psramHeap, 0, sizeof(sample.psramHeap));
+    }
+    sampleTasks(sample);
+    xSemaphoreGive(sampleMutex);
+}
+
+// Alarms ---------------------------------------------------------------
+const ResourceThresholds ResourceManager::DEFAULT_THRESHOLDS = {
+    .stackBytes = RESOURCE_STACK_ALARM_BYTES,
+    .internalFreeBytes = RESOURCE_INTERNAL_FREE_ALARM_BYTES,
+    .internalBlockBytes = RESOURCE_INTERNAL_BLOCK_ALARM_BYTES,
+    .psramFreeBytes = RESOURCE_PSRAM_FREE_ALARM_BYTES,
+};
+
+/**
+ * @brief Below the threshold: raised. Above threshold + hysteresis: cleared. Between the two: unchanged.
+ */
+static bool isAlarmActive(uint32_t value, uint32_t threshold, bool wasActive) {
+    if (value < threshold) { return true; }
+    uint64_t clearLevel = uint64_t(threshold) * (100 + RESOURCE_ALARM_HYSTERESIS_PERCENT) / 100;
+    return wasActive && value < clearLevel;
+}
+
+uint8_t ResourceManager::evaluateAlarms(const ResourceSample& sample, const ResourceThresholds& thresholds, uint8_t previousAlarms) {
+    uint8_t alarms = RESOURCE_ALARM_NONE;
+    if (sample.lowestStackTask >= 0 &&
+        isAlarmActive(sample.tasks[sample.lowestStackTask].stackHighWaterMark, thresholds.stackBytes, previousAlarms & RESOURCE_ALARM_STACK)) {
+        alarms |= RESOURCE_ALARM_STACK;
+    }
+    if (isAlarmActive(sample.internalHeap.freeBytes, thresholds.internalFreeBytes, previousAlarms & RESOURCE_ALARM_INTERNAL_FREE)) {
+        alarms |= RESOURCE_ALARM_INTERNAL_FREE;
+    }
+    if (isAlarmActive(sample.internalHeap.largestFreeBlock, thresholds.internalBlockBytes, previousAlarms & RESOURCE_ALARM_INTERNAL_BLOCK)) {
+        alarms |= RESOURCE_ALARM_INTERNAL_BLOCK;
+    }
+    if (sample.hasPsram &&
+        isAlarmActive(sample.psramHeap.freeBytes, thresholds.psramFreeBytes, previousAlarms & RESOURCE_ALARM_PSRAM_FREE)) {
+        alarms |= RESOURCE_ALARM_PSRAM_FREE;
+    }
+    return alarms;
+}
+
+// Monitor task ---------------------------------------------------------
+void ResourceManager::logAlarmChanges(const ResourceSample& sample, uint8_t previousAlarms, uint8_t alarms) {
+    uint8_t raised = alarms & ~previousAlarms;
+    uint8_t cleared = previousAlarms & ~alarms;
+    if (raised & RESOURCE_ALARM_STACK) {
+        // Formatted here, the deferred log reads the strings later (the sample is overwritten by the next period)
+        const ResourceTaskStats& task = sample.tasks[sample.lowestStackTask];
+        ESP_LOGW("RESOURCE", "Alarm: %s has %lu bytes of free stack", task.name, (unsigned long)task.stackHighWaterMark);
+    }
+    if (raised & RESOURCE_ALARM_INTERNAL_FREE) {
+        LOG_W(RESOURCE, "Alarm: %u bytes of free internal heap", unsigned(sample.internalHeap.freeBytes));
+    }
+    if (raised & RESOURCE_ALARM_INTERNAL_BLOCK) {
+        LOG_W(RESOURCE, "Alarm: the largest internal block is %u bytes", unsigned(sample.internalHeap.largestFreeBlock));
+    }
+    if (raised & RESOURCE_ALARM_PSRAM_FREE) {
+        LOG_W(RESOURCE, "Alarm: %u bytes of free PSRAM", unsigned(sample.psramHeap.freeBytes));
+    }
+    if (cleared) { LOG_I(RESOURCE, "Alarms cleared: 0x%02x", cleared); }
+}
+
+void ResourceManager::taskResourceMonitor(void *pvParameters) {
+    ResourceManager* resourceManager = static_cast<ResourceManager*>(pvParameters);
+    ResourceSample& sample = resourceManager->monitorSample;  // Too big for the task stack
+    TickType_t lastWakeTime = xTaskGetTickCount();
+    while (true) {
+        resourceManager->sample(sample);
+        uint8_t previousAlarms = activeAlarms.load(std::memory_order_relaxed);
+        uint8_t alarms = evaluateAlarms(sample, DEFAULT_THRESHOLDS, previousAlarms);
+        activeAlarms.store(alarms, std::memory_order_relaxed);
+        if (alarms != previousAlarms) { resourceManager->logAlarmChanges(sample, previousAlarms, alarms); }
+
+        xSemaphoreTake(resourceManager->sampleMutex, portMAX_DELAY);
+        resourceManager->lastSample = sample;
+        resourceManager->hasLastSample = true;
+        xSemaphoreGive(resourceManager->sampleMutex);
+        vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(RESOURCE_SAMPLE_PERIOD_MS));
+    }
+    vTaskDelete(NULL);
+}
+
+void ResourceManager::startMonitorTask() {
+    if (monitorTaskHandle) { return; } // Already running
+    xTaskCreate(&taskResourceMonitor, "RES_MON", RESOURCE_MONITOR_STACK_SIZE, this, RESOURCE_MONITOR_PRIORITY, &monitorTaskHandle);
+}
+
+void ResourceManager::stopMonitorTask() {
+    if (!monitorTaskHandle) { return; } // Not running
+    xSemaphoreTake(sampleMutex, portMAX_DELAY); // Do not delete the task in the middle of a sample
+    vTaskDelete(monitorTaskHandle);
+    monitorTaskHandle = nullptr;
+    xSemaphoreGive(sampleMutex);
+    activeAlarms = RESOURCE_ALARM_NONE;
+}
+
+bool ResourceManager::getLastSample(ResourceSample& sample) {
+    xSemaphoreTake(sampleMutex, portMAX_DELAY);
+    bool hasSample = hasLastSample;
+    if (hasSample) { sample = lastSample; }
+    xSemaphoreGive(sampleMutex);
+    return hasSample;
+}
+
+// Deinit resource manager ----------------------------------------------
+ResourceManager::~ResourceManager() {
+    DEBUG_DEINIT_START("Resource manager");
+    stopMonitorTask();
+    vSemaphoreDelete(sampleMutex);
+    DEBUG_DEINIT_END("Resource manager");
+}
+
+// Singleton ------------------------------------------------------------
+ResourceManager* ResourceManager::instance = nullptr;
+
+void ResourceManager::init() {
+    if (instance == nullptr) {
+        instance = new ResourceManager();
+        return;
+    }
+    DEBUG_INIT_NO_NEED("Resource manager");
+}
+
+void ResourceManager::deinit() {
+    if (instance) {
+        delete instance;
+        instance = nullptr;
+        return;
+    }
+    DEBUG_DEINIT_NO_NEED("Resource manager");
+}
@@ -0,0 +1,205 @@
+/*
+ * File: RtpJpeg.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "RtpJpeg.h"
+
+// C++
+#include <algorithm>
+
+extern "C" {
+#include <string.h>
+}
+
+static inline uint16_t readUint16(const uint8_t* data) { return uint16_t((data[0] << 8) | data[1]); }
+
+static inline uint8_t* writeUint16(uint8_t* data, uint16_t value) {
+    data[0] = uint8_t(value >> 8);
+    data[1] = uint8_t(value);
+    return data + 2;
+}
+
+static inline uint8_t* writeUint32(uint8_t* data, uint32_t value) {
+    writeUint16(data, uint16_t(value >> 16));
+    return writeUint16(data + 2, uint16_t(value));
+}
+
+static uint8_t* writeRtpHeader(uint8_t* packet, uint8_t payloadType, bool isMarker, uint16_t sequence, uint32_t timestamp, uint32_t ssrc) {
+    packet[0] = 0x80;   // Version 2, no padding, no extension, no CSRC
+    packet[1] = uint8_t(payloadType | (isMarker ? 0x80 : 0));
+    writeUint16(packet + 2, sequence);
+    writeUint32(packet + 4, timestamp);
+    writeUint32(packet + 8, ssrc);
+    return packet + RTP_HEADER_SIZE;
+}
+
+// Packetizer ---------------------------------------------------------------------------------------------------
+void RtpJpegPacketizer::reset(uint32_t ssrc, uint8_t fecGroupSize) {
+    this->ssrc = ssrc;
+    this->fecGroupSize = std::min<uint8_t>(fecGroupSize, RTP_FEC_MAX_GROUP_SIZE);
+    sequence = uint16_t(ssrc >> 16);
+    fecSequence = uint16_t(ssrc);
+    parityLength = 0;
+    groupFirstSequence = 0;
+    groupCount = 0;
+    lengthParity = 0;
+    markerParity = 0;
+}
+
+esp_err_t RtpJpegPacketizer::parse(const uint8_t* jpeg, size_t length, RtpJpegImage& image) {
+    if (!jpeg || length < 4 || jpeg[0] != 0xFF || jpeg[1] != JPEG_SOI) { return ESP_ERR_INVALID_ARG; }
+    const uint8_t* tables[4] = {nullptr, nullptr, nullptr, nullptr};
+    uint8_t lumaTable = 0;
+    uint8_t chromaTable = 0;
+    bool hasFrame = false;
+    memset(&image, 0, sizeof(image));
+
+    size_t position = 2;
+    while (position + 4 <= length) {
+        if (jpeg[position] != 0xFF) { return ESP_ERR_INVALID_ARG; }
+        uint8_t marker = jpeg[position + 1];
+        if (marker == 0xFF) { position++; continue; }  // Fill byte
+        size_t segmentLength = readUint16(jpeg + position + 2);
+        if (segmentLength < 2 || position + 2 + segmentLength > length) { return ESP_ERR_INVALID_ARG; }
+        const uint8_t* segment = jpeg + position + 4;
+        size_t dataLength = segmentLength - 2;
+
+        if (marker == JPEG_DQT) {
+            for (size_t i = 0; i < dataLength; i += 65) {
+                if (segment[i] >> 4) { return ESP_ERR_NOT_SUPPORTED; } // 16 bit table
+                if ((segment[i] & 0x0F) > 3 || i + 65 > dataLength) { return ESP_ERR_INVALID_ARG; }
+                tables[segment[i] & 0x0F] = segment + i + 1;
+            }
+        } else if (marker == JPEG_SOF0) {
+            if (dataLength < 15 || segment[0] != 8 || segment[5] != 3) { return ESP_ERR_NOT_SUPPORTED; }
+            image.height = readUint16(segment + 1);
+            image.width = readUint16(segment + 3);
+            const uint8_t* components = segment + 6;
+            if (components[0 * 3 + 1] == 0x21) {
+                image.type = 0;
+            } else if (components[0 * 3 + 1] == 0x22) {
+                image.type = 1;
+            } else {
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+            // Cb and Cr share one table, both subsampled (the layout of the rebuilt header)
+            if (components[1 * 3 + 1] != 0x11 || components[2 * 3 + 1] != 0x11 || components[1 * 3 + 2] != components[2 * 3 + 2]) {
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+            lumaTable = components[0 * 3 + 2] & 0x03;
+            chromaTable = components[1 * 3 + 2] & 0x03;
+            if (image.width == 0 || image.height == 0 || image.width > RTP_JPEG_MAX_DIMENSION ||
+                image.height > RTP_JPEG_MAX_DIMENSION || image.width % 8 || image.height % 8) {
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+            hasFrame = true;
+        } else if (marker >= 0xC1 && marker <= 0xCF && marker != JPEG_DHT && marker != 0xC8 && marker != 0xCC) {
+            return ESP_ERR_NOT_SUPPORTED;   // Progressive, lossless or arithmetic coded
+        } else if (marker == JPEG_DRI) {
+            if (dataLength < 2) { return ESP_ERR_INVALID_ARG; }
+            image.restartInterval = readUint16(segment);
+        } else if (marker == JPEG_SOS) {
+            if (!hasFrame || !tables[lumaTable] || !tables[chromaTable]) { return ESP_ERR_INVALID_ARG; }
+            if (dataLength < 1 || segment[0] != 3) { return ESP_ERR_NOT_SUPPORTED; }   // Not interleaved
+            size_t scanStart = position + 2 + segmentLength;
+            // The frame buffer can have padding after the EOI
+            size_t end = length;
+            while (end >= scanStart + 2 && !(jpeg[end - 2] == 0xFF && jpeg[end - 1] == JPEG_EOI)) { end--; }
+            if (end < scanStart + 2) { return ESP_ERR_INVALID_ARG; }
+            image.scan = jpeg + scanStart;
+            image.scanLength = end - 2 - scanStart;
+            if (image.scanLength == 0) { return ESP_ERR_INVALID_ARG; }
+            memcpy(image.quantizationTables, tables[lumaTable], 64);
+            memcpy(image.quantizationTables + 64, tables[chromaTable], 64);
+            image.quantizationLength = 128;
+            if (image.restartInterval) { image.type |= RTP_JPEG_RESTART; }
+            return ESP_OK;
+        }
+        position += 2 + segmentLength;
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+void RtpJpegPacketizer::addToParity(const uint8_t* payload, size_t length, bool isMarker) {
+    if (groupCount == 0) {
+        groupFirstSequence = sequence;
+        parityLength = 0;
+        lengthParity = 0;
+        markerParity = 0;
+    }
+    // The parity is as long as the longest payload, the shorter ones are padded with zeros
+    for (size_t i = 0; i < length; i++) { parity[i] = i < parityLength ? parity[i] ^ payload[i] : payload[i]; }
+    if (length > parityLength) { parityLength = length; }
+    lengthParity ^= uint16_t(length);
+    markerParity ^= isMarker ? 1 : 0;
+    groupCount++;
+}
+
+bool RtpJpegPacketizer::sendParity(uint32_t timestamp, PacketCallback send, void* context) {
+    uint8_t* header = writeRtpHeader(packet, RTP_FEC_PAYLOAD_TYPE, false, fecSequence++, timestamp, ssrc + 1);
+    uint8_t* data = writeUint16(header, groupFirstSequence);
+    *data++ = groupCount;
+    *data++ = markerParity;
+    data = writeUint16(data, lengthParity);
+    data = writeUint16(data, 0);    // Reserved
+    memcpy(data, parity, parityLength);
+    groupCount = 0;
+    return send(packet, RTP_HEADER_SIZE + RTP_FEC_HEADER_SIZE + parityLength, true, context);
+}
+
+esp_err_t RtpJpegPacketizer::packetize(const uint8_t* jpeg, size_t length, int64_t captureTimeUs, PacketCallback send, void* context) {
+    RtpJpegImage image;
+    esp_err_t err = parse(jpeg, length, image);
+    if (err != ESP_OK) { return err; }
+
+    uint32_t timestamp = toRtpTimestamp(captureTimeUs);
+    // With FEC the media packets leave room for the header of the parity packet
+    size_t maxLength = fecGroupSize ? RTP_MAX_PACKET_SIZE - RTP_FEC_HEADER_SIZE : RTP_MAX_PACKET_SIZE;
+    groupCount = 0;
+    size_t offset = 0;
+    while (offset < image.scanLength) {
+        uint8_t* data = packet + RTP_HEADER_SIZE;
+        *data++ = 0;    // Type specific: progressive frame
+        data[0] = uint8_t(offset >> 16);
+        data[1] = uint8_t(offset >> 8);
+        data[2] = uint8_t(offset);
+        data += 3;
+        *data++ = image.type;
+        *data++ = RTP_JPEG_Q_INBAND;
+        *data++ = uint8_t(image.width / 8);
+        *data++ = uint8_t(image.height / 8);
+        if (image.restartInterval) {
+            data = writeUint16(data, image.restartInterval);
+            data = writeUint16(data, 0xFFFF);   // First and last packet of the restart intervals, count 0x3FFF: not aligned
+        }
+        if (offset == 0) {
+            *data++ = 0;    // MBZ
+            *data++ = 0;    // Precision: 8 bit tables
+            data = writeUint16(data, image.quantizationLength);
+            memcpy(data, image.quantizationTables, image.quantizationLength);
+            data += image.quantizationLength;
+        }
+        size_t chunk = std::min(maxLength - size_t(data - packet), image.scanLength - offset);
+        memcpy(data, image.scan + offset, chunk);
+        size_t packetLength = size_t(data - packet) + chunk;
+        bool isMarker = offset + chunk == image.scanLength;
+        writeRtpHeader(packet, RTP_JPEG_PAYLOAD_TYPE, isMarker, sequence, timestamp, ssrc);
+        if (fecGroupSize) { addToParity(packet + RTP_HEADER_SIZE, packetLength - RTP_HEADER_SIZE, isMarker); }
+        sequence++;
+        if (!send(packet, packetLength, false, context)) { return ESP_FAIL; }
+        offset += chunk;
+        if (fecGroupSize && (groupCount == fecGroupSize || isMarker) && !sendParity(timestamp, send, context)) {
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,240 @@
+/*
+ * File: RtpStreamManager.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "RtpStreamManager.h"
+#include "CameraManager.h"
+#include "Hal.h"
+#include "LogManager.h"
+#include "SnapshotCache.h"
+#include "TelemetryManager.h"
+#include "TraceManager.h"
+
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+#include "esp_random.h"
+#include "lwip/sockets.h"
+}
+
+// RTP Pacer ----------------------------------------------------------------------------------------------------
+RtpPacer::RtpPacer(uint32_t bytesPerSecond, uint32_t burstBytes)
+    : bytesPerSecond(bytesPerSecond), burstUs(uint32_t(uint64_t(burstBytes) * 1000000 / bytesPerSecond)), busyUntilUs(0) {}
+
+uint32_t RtpPacer::reserve(size_t bytes, int64_t nowUs) {
+    if (busyUntilUs < nowUs) { busyUntilUs = nowUs; }   // Idle: no credit is saved up beyond the burst
+    busyUntilUs += int64_t(uint64_t(bytes) * 1000000 / bytesPerSecond);
+    int64_t waitUs = busyUntilUs - nowUs - burstUs;
+    return waitUs > 0 ? uint32_t(waitUs) : 0;
+}
+
+// Init RTP stream manager ----------------------------------------------
+RtpStreamManager::RtpStreamManager() : pacer(RTP_PACING_RATE_BYTES_PER_S, RTP_PACING_BURST_BYTES) {
+    DEBUG_INIT_START("RTP stream manager");
+    isStreamEnabled = false;
+    isStreamRunning = false;
+    leaseEndMs = 0;
+    destinationAddress = 0;
+    destinationPort = 0;
+    streamSocket = -1;
+    DEBUG_INIT_END("RTP stream manager");
+}
+
+// Stats ----------------------------------------------------------------
+RtpStreamStats RtpStreamManager::getStats() {
+    return {
+        .streams = streams.load(std::memory_order_relaxed),
+        .isActive = isActive.load(std::memory_order_relaxed),
+        .framesSent = framesSent.load(std::memory_order_relaxed),
+        .framesDropped = framesDropped.load(std::memory_order_relaxed),
+        .packetsSent = packetsSent.load(std::memory_order_relaxed),
+        .fecPacketsSent = fecPacketsSent.load(std::memory_order_relaxed),
+        .sendErrors = sendErrors.load(std::memory_order_relaxed),
+        .averageSendTimeUs = averageSendTimeUs.load(std::memory_order_relaxed),
+    };
+}
+
+// Stream ---------------------------------------------------------------
+struct RtpSendContext {
+    int socket;
+    struct sockaddr_in destination;
+    RtpPacer* pacer;
+};
+
+bool RtpStreamManager::sendPacket(const uint8_t* packet, size_t length, bool isFec, void* context) {
+    RtpSendContext* sendContext = static_cast<RtpSendContext*>(context);
+    uint32_t waitUs = sendContext->pacer->reserve(length, Hal::Timer::getTimeUs());
+    if (waitUs >= portTICK_PERIOD_MS * 1000) {
+        TRACE_SPAN("rtp_pacing");
+        vTaskDelay(pdMS_TO_TICKS(waitUs / 1000));
+    }
+    // Never blocks: a full queue drops the rest of the frame, the next frame is newer anyway
+    if (sendto(sendContext->socket, packet, length, MSG_DONTWAIT, reinterpret_cast<struct sockaddr*>(&sendContext->destination),
+               sizeof(sendContext->destination)) < 0) {
+        sendErrors.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    (isFec ? fecPacketsSent : packetsSent).fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void RtpStreamManager::taskRtpStream(void *pvParameters) {
+    RtpStreamManager* rtpStreamManager = static_cast<RtpStreamManager*>(pvParameters);
+    RtpSendContext sendContext = {};
+    sendContext.socket = rtpStreamManager->streamSocket;
+    sendContext.destination.sin_family = AF_INET;
+    sendContext.destination.sin_port = htons(rtpStreamManager->destinationPort);
+    sendContext.destination.sin_addr.s_addr = rtpStreamManager->destinationAddress;
+    sendContext.pacer = &rtpStreamManager->pacer;
+    HalCameraFrame frame;
+    uint32_t sent = 0;
+    uint64_t totalSendTimeUs = 0;
+
+    while (rtpStreamManager->isStreamEnabled) {
+        if (int32_t(uint32_t(Hal::Timer::getTimeUs() / 1000) - rtpStreamManager->leaseEndMs) > 0) {
+            LOG_I(SERVER, "RTP stream lease expired");
+            break;
+        }
+        TRACE_SPAN("rtp_frame");
+        if (!CameraManager::getStreamFrame(frame)) {
+            LOG_E(SERVER, "Camera capture failed");
+            break;
+        }
+        uint8_t* jpeg = frame.data;
+        size_t jpegLength = frame.length;
+        if (frame.format != HAL_PIXFORMAT_JPEG) {
+            TRACE_SPAN("jpeg_encode");
+            if (!Hal::Camera::convertToJpeg(frame, RTP_JPEG_QUALITY, &jpeg, &jpegLength)) {
+                Hal::Camera::returnFrame(frame);
+                framesDropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+        }
+        SnapshotCache* snapshotCache = SnapshotCache::getInstance();
+        if (snapshotCache && snapshotCache->isPublishDue(frame.timestampUs)) {
+            TRACE_SPAN("snapshot_publish");
+            snapshotCache->publish(jpeg, jpegLength, frame.width, frame.height, frame.timestampUs);
+        }
+
+        int64_t sendStartUs = Hal::Timer::getTimeUs();
+        esp_err_t res = ESP_FAIL;
+        if (sendStartUs - frame.timestampUs <= int64_t(RTP_MAX_FRAME_AGE_MS) * 1000) {
+            TRACE_SPAN("rtp_send");
+            res = rtpStreamManager->packetizer.packetize(jpeg, jpegLength, frame.timestampUs, &sendPacket, &sendContext);
+            if (res == ESP_ERR_NOT_SUPPORTED || res == ESP_ERR_INVALID_ARG) {
+                LOG_E(SERVER, "Frame is not RTP/JPEG (%u bytes)", unsigned(jpegLength));
+            }
+        }
+        if (res == ESP_OK) {
+            TelemetryManager::recordStreamFrame(jpegLength);
+            sent++;
+            totalSendTimeUs += uint64_t(Hal::Timer::getTimeUs() - sendStartUs);
+            framesSent.store(sent, std::memory_order_relaxed);
+            averageSendTimeUs.store(uint32_t(totalSendTimeUs / sent), std::memory_order_relaxed);
+        } else {
+            framesDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (frame.format != HAL_PIXFORMAT_JPEG) { free(jpeg); }
+        Hal::Camera::returnFrame(frame);
+    }
+
+    close(rtpStreamManager->streamSocket);
+    rtpStreamManager->streamSocket = -1;
+    isActive.store(false, std::memory_order_relaxed);
+    rtpStreamManager->isStreamRunning = false;
+    DEBUG_PRINT("RTP stream ended");
+    vTaskDelete(NULL);
+}
+
+esp_err_t RtpStreamManager::startStream(uint32_t address, uint16_t port, uint8_t fecGroupSize) {
+    uint32_t leaseEnd = uint32_t(Hal::Timer::getTimeUs() / 1000) + RTP_LEASE_MS;
+    if (isStreamRunning) {
+        if (address != destinationAddress || port != destinationPort) { return ESP_ERR_INVALID_STATE; }
+        leaseEndMs = leaseEnd;
+        return ESP_OK;
+    }
+    streamSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (streamSocket < 0) {
+        LOG_E(SERVER, "RTP socket failed");
+        return ESP_FAIL;
+    }
+    destinationAddress = address;
+    destinationPort = port;
+    leaseEndMs = leaseEnd;
+    packetizer.reset(esp_random(), fecGroupSize);
+    pacer = RtpPacer(RTP_PACING_RATE_BYTES_PER_S, RTP_PACING_BURST_BYTES);
+
+    streams.fetch_add(1, std::memory_order_relaxed);
+    framesSent.store(0, std::memory_order_relaxed);
+    framesDropped.store(0, std::memory_order_relaxed);
+    packetsSent.store(0, std::memory_order_relaxed);
+    fecPacketsSent.store(0, std::memory_order_relaxed);
+    sendErrors.store(0, std::memory_order_relaxed);
+    averageSendTimeUs.store(0, std::memory_order_relaxed);
+    isActive.store(true, std::memory_order_relaxed);
+    isStreamEnabled = true;
+    isStreamRunning = true;
+
+    if (xTaskCreatePinnedToCore(&taskRtpStream, "RTP_STREAM", RTP_STREAM_STACK_SIZE, this, RTP_STREAM_PRIORITY, nullptr,
+                                RTP_STREAM_CORE) != pdPASS) {
+        close(streamSocket);
+        streamSocket = -1;
+        isActive.store(false, std::memory_order_relaxed);
+        isStreamEnabled = false;
+        isStreamRunning = false;
+        return ESP_FAIL;
+    }
+    DEBUG_PRINT("RTP stream started, FEC group %u", unsigned(packetizer.getFecGroupSize()));
+    return ESP_OK;
+}
+
+esp_err_t RtpStreamManager::stopStream() {
+    if (!isStreamRunning) { return ESP_OK; } // Not running
+    isStreamEnabled = false;
+    for (uint16_t waitedMs = 0; isStreamRunning && waitedMs < RTP_STREAM_STOP_TIMEOUT_MS; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (isStreamRunning) {
+        LOG_E(SERVER, "RTP stream did not stop in time");
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+// Deinit RTP stream manager --------------------------------------------
+RtpStreamManager::~RtpStreamManager() {
+    DEBUG_DEINIT_START("RTP stream manager");
+    stopStream();
+    DEBUG_DEINIT_END("RTP stream manager");
+}
+
+// Singleton ------------------------------------------------------------
+RtpStreamManager* RtpStreamManager::instance = nullptr;
+
+void RtpStreamManager::init() {
+    if (instance == nullptr) {
+        instance = new RtpStreamManager();
+        return;
+    }
+    DEBUG_INIT_NO_NEED("RTP stream manager");
+}
+
+void RtpStreamManager::deinit() {
+    if (instance) {
+        // The stream task still uses the instance (a capture or a send takes longer than the timeout): kept for a retry
+        if (instance->stopStream() != ESP_OK) { return; }
+        delete instance;
+        instance = nullptr;
+        return;
+    }
+    DEBUG_DEINIT_NO_NEED("RTP stream manager");
+}
@@ -12,30 +12,177 @@
  */
 
 #include "ServerManager.h"
+#include "CameraManager.h"
+#include "ClockSync.h"
+#include "ControlJitterBuffer.h"
+#include "DashcamManager.h"
+#include "FlightRecorder.h"
+#include "Hal.h"
 #include "MotorManager.h"
+#include "PhotoManager.h"
 #include "LedManager.h"
-#include <iostream>
+#include "RequestArena.h"
+#include "RtpStreamManager.h"
+#include "LogManager.h"
+#include "ModeManager.h"
+#include "SettingsJson.h"
+#include "SnapshotCache.h"
+#include "StorageManager.h"
+#include "TelemetryManager.h"
+#include "TraceManager.h"
+#include "VisionManager.h"
+#include <atomic>
 
 extern "C" {
-#include "esp_camera.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "esp_err.h"
 #include "esp_http_server.h"
-#include "esp_timer.h"
+#include "lwip/sockets.h"
 }
 
 // Server Manager -------------------------------------------------------------------
+// Request Arenas -----------------------------------------------------------
+// One per server, only used by the server task (the handlers of a server never run in parallel)
+static uint8_t commandArenaBuffer[COMMAND_SERVER_ARENA_SIZE];
+static RequestArena commandArena(commandArenaBuffer, sizeof(commandArenaBuffer));
+static uint8_t videoArenaBuffer[VIDEO_SERVER_ARENA_SIZE];
+static RequestArena videoArena(videoArenaBuffer, sizeof(videoArenaBuffer));
+
+// Allocation Check ---------------------------------------------------------
+#if defined(SERVER_ALLOCATION_CHECK) && defined(CONFIG_HEAP_USE_HOOKS)
+static std::atomic<TaskHandle_t> allocationCheckTask(nullptr);     // The task of the checked handler, nullptr: no check
+static std::atomic<uint32_t> allocationCheckCount(0);
+static ServerAllocationStats allocationStats = {};                  // Only written by the command server task
+
+// Heap hooks of the ESP-IDF, called on every allocation of every task
+extern "C" void esp_heap_trace_alloc_hook(void* pointer, size_t size, uint32_t caps) {
+    if (xTaskGetCurrentTaskHandle() == allocationCheckTask.load(std::memory_order_relaxed)) {
+        allocationCheckCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+extern "C" void esp_heap_trace_free_hook(void* pointer) {}
+
+/*
+    Counts the heap allocations of the calling task while it is in scope.
+*/
+class AllocationCheck {
+public:
+    AllocationCheck() {
+        allocationCheckCount.store(0, std::memory_order_relaxed);
+        allocationCheckTask.store(xTaskGetCurrentTaskHandle(), std::memory_order_relaxed);
+    }
+
+    ~AllocationCheck() {
+        allocationCheckTask.store(nullptr, std::memory_order_relaxed);
+        uint32_t allocations = allocationCheckCount.load(std::memory_order_relaxed);
+        allocationStats.checkedRequests++;
+        if (allocations > 0) {
+            allocationStats.allocatingRequests++;
+            allocationStats.lastAllocations = allocations;
+            LOG_E(SERVER, "Control request allocated %u times", unsigned(allocations));
+        }
+    }
+};
+
+ServerAllocationStats ServerManager::getAllocationStats() { return allocationStats; }
+#else
+class AllocationCheck {
+public:
+    AllocationCheck() {}
+};
+
+ServerAllocationStats ServerManager::getAllocationStats() { return {}; }
+#endif
+
+// Session Stats ------------------------------------------------------------
+static CommandSessionStats sessionStatsPool[COMMAND_SERVER_MAX_OPEN_SOCKETS];
+static uint32_t sessionsOpened = 0;
+static uint32_t sessionsClosed = 0; // Closed by the client, timed out or purged (LRU)
+
+static CommandSessionStats* acquireSessionStats(int socket) {
+    for (uint8_t i = 0; i < COMMAND_SERVER_MAX_OPEN_SOCKETS; i++) {
+        if (!sessionStatsPool[i].isUsed) {
+            sessionStatsPool[i] = {
+                .isUsed = true,
+                .socket = socket,
+                .requests = 0,
+                .openedAtUs = Hal::Timer::getTimeUs(),
+                .lastRequestAtUs = 0,
+                .maxHandlerTimeUs = 0,
+                .totalHandlerTimeUs = 0
+            };
+            return &sessionStatsPool[i];
+        }
+    }
+    return nullptr;
+}
+
+static void releaseSessionStats(void *ctx) { // Called by the server, when the session is closed
+    static_cast<CommandSessionStats*>(ctx)->isUsed = false;
+    sessionsClosed++;
+}
+
+static esp_err_t onCommandSessionOpen(httpd_handle_t handle, int socket) {
+    // The responses are tiny, do not let Nagle's algorithm hold them back (it would add up to 200 ms with delayed ACKs)
+    int noDelay = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    sessionsOpened++;
+    CommandSessionStats* stats = acquireSessionStats(socket);
+    if (stats) { httpd_sess_set_ctx(handle, socket, stats, releaseSessionStats); }
+    return ESP_OK;
+}
+
+/*
+    Measures the handler time of a command request, and adds it to the stats of the session when it goes out of scope.
+*/
+class SessionRequestTimer {
+private:
+    httpd_req_t *req;
+    int64_t startUs;
+
+public:
+    SessionRequestTimer(httpd_req_t *req) : req(req), startUs(Hal::Timer::getTimeUs()) {}
+
+    ~SessionRequestTimer() {
+        CommandSessionStats* stats = static_cast<CommandSessionStats*>(req->sess_ctx);
+        if (!stats) { return; }
+        int64_t nowUs = Hal::Timer::getTimeUs();
+        uint32_t handlerTimeUs = uint32_t(nowUs - startUs);
+        stats->requests++;
+        stats->lastRequestAtUs = nowUs;
+        stats->totalHandlerTimeUs += handlerTimeUs;
+        if (handlerTimeUs > stats->maxHandlerTimeUs) { stats->maxHandlerTimeUs = handlerTimeUs; }
+    }
+};
+
 // Command Server -----------------------------------------------------------
 static esp_err_t connectionHandler(httpd_req_t *req) {
-    LedManager::getInstance()->setAnimation(AnimationType::IDLE);
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    ModeManager* modeManager = ModeManager::getInstance();
+    if (modeManager) { modeManager->wakeUp(); } // A controller connected, leave the room plant mode
+    LedManager* ledManager = LedManager::getInstance();
+    if (ledManager) { ledManager->setAnimation(AnimationType::IDLE); }
     return httpd_resp_send(req, "OK", 2);
 }
 
 static esp_err_t disconnectionHandler(httpd_req_t *req) {
-    LedManager::getInstance()->setAnimation(AnimationType::NONE);
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    LedManager* ledManager = LedManager::getInstance();
+    if (ledManager) { ledManager->setAnimation(AnimationType::NONE); }
     return httpd_resp_send(req, nullptr, 0);
 }
 
 static esp_err_t moveHandler(httpd_req_t *req) {
+    AllocationCheck allocationCheck;
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    TRACE_SPAN("mov");
     char*  buf;
     size_t bufferLength;
     char axisValueInChar[10] = {0,};
@@ -46,148 +193,1220 @@ static esp_err_t moveHandler(httpd_req_t *req) {
 
     bufferLength = httpd_req_get_url_query_len(req) + 1;
     if (bufferLength > 1) {
-        buf = (char*)malloc(bufferLength);
+        TRACE_SPAN("mov_parse");
+        buf = commandArena.allocateString(bufferLength - 1);
         if(!buf){
             httpd_resp_send_500(req);
             return ESP_FAIL;
         }
         // Get the query parameter data
         if (httpd_req_get_url_query_str(req, buf, bufferLength) != ESP_OK) {
-            free(buf);
             httpd_resp_send_404(req);
             return ESP_FAIL;
         }
         // Get the value of the query parameter
         if (httpd_query_key_value(buf, "X", axisValueInChar, sizeof(axisValueInChar)) != ESP_OK) {
-            free(buf);
             httpd_resp_send_404(req);
             return ESP_FAIL;
         }
         XAxisValue = atoi(axisValueInChar);
 
         if (httpd_query_key_value(buf, "Y", axisValueInChar, sizeof(axisValueInChar)) != ESP_OK) {
-            free(buf);
             httpd_resp_send_404(req);
             return ESP_FAIL;
         }
         YAxisValue = atoi(axisValueInChar);
 
         if (httpd_query_key_value(buf, "L", axisValueInChar, sizeof(axisValueInChar)) != ESP_OK) {
-            free(buf);
             httpd_resp_send_404(req);
             return ESP_FAIL;
         }
         LDirectionValue = atoi(axisValueInChar);
 
         if (httpd_query_key_value(buf, "R", axisValueInChar, sizeof(axisValueInChar)) != ESP_OK) {
-            free(buf);
             httpd_resp_send_404(req);
             return ESP_FAIL;
         }
         RDirectionValue = atoi(axisValueInChar);
-
-        free(buf);
     } else {
         httpd_resp_send_404(req);
         return ESP_FAIL;
     }
 
+    ModeManager* modeManager = ModeManager::getInstance();
+    if (modeManager) { modeManager->wakeUp(); } // The motors start with the next mode change, this command is dropped
+    if (VisionManager::isLineFollowing()) {
+        // The controller sends its idle stick too, only a move takes over from the line follow
+        if (XAxisValue == 0 && YAxisValue == 0 && LDirectionValue == 0 && RDirectionValue == 0) {
+            return httpd_resp_send(req, nullptr, 0);
+        }
+        VisionManager::setLineFollow(false);
+        LOG_I(SERVER, "Manual control took over from the line follow");
+    }
     MotorManager* motorManager = MotorManager::getInstance();
-    DEBUG_PRINT("X: %d, Y: %d, L: %d, R: %d", XAxisValue, YAxisValue, LDirectionValue, RDirectionValue);
-    motorManager->setControlData(XAxisValue, YAxisValue, LDirectionValue, RDirectionValue);
+    LOG_D(SERVER, "X: %d, Y: %d, L: %d, R: %d", XAxisValue, YAxisValue, LDirectionValue, RDirectionValue);
+    motorManager->queueControlData(XAxisValue, YAxisValue, LDirectionValue, RDirectionValue);
+    TelemetryManager::recordControlData();
     return httpd_resp_send(req, nullptr, 0);
 }
 
+// Settings ---------------------------------------------
+static esp_err_t sendSettings(httpd_req_t *req) {
+    StorageManager* storageManager = StorageManager::getInstance();
+    char* response = commandArena.allocateString(SETTINGS_JSON_MAX_LENGTH - 1);
+    size_t length = response ? SettingsJson::write(response, SETTINGS_JSON_MAX_LENGTH, storageManager->getWiFiSSID().c_str(),
+                                                   storageManager->getColorNumber()) : 0;
+    if (length == 0) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, response, length);
+}
+
+/**
+ * @brief Receive the whole body, zero terminated.
+ *
+ * @return int The length, -1 if it is too long or the socket failed, HTTPD_SOCK_ERR_TIMEOUT if the client stalled
+ * (then 408 is sent, so a stalled client does not hold the server task).
+ */
+static int receiveBody(httpd_req_t *req, char* buffer, size_t size) {
+    if (req->content_len >= size) { return -1; } // Too long (keep place for the terminating zero)
+    size_t received = 0;
+    uint8_t timeouts = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, buffer + received, req->content_len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            if (++timeouts < COMMAND_SERVER_BODY_TIMEOUTS) { continue; }
+            httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Body timeout");
+            return HTTPD_SOCK_ERR_TIMEOUT;
+        }
+        if (ret <= 0) { return -1; }
+        received += ret;
+    }
+    buffer[received] = '\0';
+    return received;
+}
+
+/**
+ * @brief Parse the JSON body, store the settings and send back the current settings.
+ * Nothing is stored, if any field is invalid.
+ *
+ * @param allowedFields The fields which can be set with this endpoint (SETTINGS_FIELD_*).
+ */
+static esp_err_t updateSettings(httpd_req_t *req, uint8_t allowedFields) {
+    StorageManager* storageManager = StorageManager::getInstance();
+    if (!storageManager) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    char* body = commandArena.allocateString(SETTINGS_JSON_MAX_LENGTH - 1);
+    int length = body ? receiveBody(req, body, SETTINGS_JSON_MAX_LENGTH) : -1;
+    if (length == HTTPD_SOCK_ERR_TIMEOUT) { return ESP_FAIL; } // 408 is sent
+    SettingsUpdate update;
+    if (length < 0 || !SettingsJson::parse(body, length, allowedFields, update)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid settings");
+        return ESP_FAIL;
+    }
+
+    // The Wi-Fi settings are used at the next connection (next Wi-Fi start)
+    if (update.fields & SETTINGS_FIELD_SSID) { storageManager->setWiFiSSID(update.ssid); }
+    if (update.fields & SETTINGS_FIELD_PASSWORD) { storageManager->setWiFiPassword(update.password); }
+    if (update.fields & SETTINGS_FIELD_COLOR) {
+        storageManager->setColorNumber(update.colorNumber);
+        LedManager* ledManager = LedManager::getInstance();
+        if (ledManager) {
+            ledManager->setColor(Colors::getGadgetColor(update.colorNumber));
+            AnimationType animation = ledManager->getCurrentAnimation();
+            ledManager->resetAnimation(); // Restart the animation with the new color
+            ledManager->setAnimation(animation);
+        }
+    }
+    return sendSettings(req);
+}
+
 static esp_err_t getSettingsHandler(httpd_req_t *req) {
-    // JSON format
-    // {
-    //      "ssid": "ssid",
-    //      "password": "password",
-    //      "color": 2
-    // }
-
-    // TODO: Implement the getSettingsHandler (JSON)
-    // httpd_resp_set_type(req, "application/json");
-    // std::string ssidS = WiFiModulManager::getInstance()->getSSID();
-    // std::string passwordS = WiFiModulManager::getInstance()->getPassword();
-    // std::string colorS = LedManager::getInstance()->getLedColor();
-    // std::string settings = "{\"ssid\": \"" + ssidS + "\", \"password\": \"" + passwordS + "\", \"color\": " + colorS + "}";
-    // return httpd_resp_send(req, settings.c_str(), settings.length());
-    return httpd_resp_send(req, nullptr, 0);
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    if (!StorageManager::getInstance()) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    return sendSettings(req);
+}
+
+static esp_err_t setSettingsHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    return updateSettings(req, SETTINGS_FIELD_ALL);
 }
 
 static esp_err_t setWiFiHandler(httpd_req_t *req) {
-    // Something like the moveHandler
-    // TODO: Implement the setWiFiHandler
-    // WiFiModulManager* wifiModulManager = WiFiModulManager::getInstance();
-    // wifiModulManager->setNextSSID("ssid");
-    // wifiModulManager->setNextPassword("password");
-    return httpd_resp_send(req, nullptr, 0);
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    return updateSettings(req, SETTINGS_FIELD_SSID | SETTINGS_FIELD_PASSWORD);
 }
 
 static esp_err_t setLedHandler(httpd_req_t *req) {
-    // Something like the moveHandler
-    // TODO: Implement the setLedHandler
-    // LedManager* ledManager = LedManager::getInstance();
-    // ledManager->setLedColor(2);
-    return httpd_resp_send(req, nullptr, 0);
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    return updateSettings(req, SETTINGS_FIELD_COLOR);
 }
 
 static esp_err_t setRoomPlantHandler(httpd_req_t *req) {
-    // TODO: Implement the setRoomPlantHandler
-    // ModeManager::getInstance()->setMode(ROOM_PLANT);
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    ModeManager* modeManager = ModeManager::getInstance();
+    if (!modeManager) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    modeManager->setMode(DroneMode::ROOM_PLANT);
+    return httpd_resp_send(req, nullptr, 0);
+}
+
+static esp_err_t setModeHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    char query[16] = {0,};
+    char modeValueInChar[4] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "M", modeValueInChar, sizeof(modeValueInChar)) != ESP_OK) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    int mode = atoi(modeValueInChar);
+    ModeManager* modeManager = ModeManager::getInstance();
+    if (!modeManager || mode <= DroneMode::SHUTDOWN || mode > DroneMode::LOW_POWER) { // Shutdown is not allowed remotely
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    modeManager->setMode(static_cast<DroneMode>(mode));
     return httpd_resp_send(req, nullptr, 0);
 }
 
+static esp_err_t sessionStatsHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    // Plain text table, one line per open session, then the request arena, the allocation check, the video streams,
+    // the snapshot cache, the vision stage and the flight recorder
+    FixedString response(commandArena, 740 + COMMAND_SERVER_MAX_OPEN_SOCKETS * 64);
+    int64_t nowUs = Hal::Timer::getTimeUs();
+    response.appendFormat("opened %lu closed %lu\nsocket requests age_ms idle_ms avg_us max_us\n",
+                          (unsigned long)sessionsOpened, (unsigned long)sessionsClosed);
+    for (uint8_t i = 0; i < COMMAND_SERVER_MAX_OPEN_SOCKETS; i++) {
+        const CommandSessionStats& stats = sessionStatsPool[i];
+        if (!stats.isUsed) { continue; }
+        response.appendFormat("%d %lu %lu %lu %lu %lu\n",
+                              stats.socket,
+                              (unsigned long)stats.requests,
+                              (unsigned long)((nowUs - stats.openedAtUs) / 1000),
+                              (unsigned long)(stats.lastRequestAtUs ? (nowUs - stats.lastRequestAtUs) / 1000 : 0),
+                              (unsigned long)(stats.requests ? stats.totalHandlerTimeUs / stats.requests : 0),
+                              (unsigned long)stats.maxHandlerTimeUs);
+    }
+    ServerAllocationStats allocationStats = ServerManager::getAllocationStats();
+    response.appendFormat("arena max_used %u size %u failed %lu\ncontrol_requests checked %lu allocating %lu\n",
+                          unsigned(commandArena.getHighWaterMark()), unsigned(commandArena.getSize()),
+                          (unsigned long)commandArena.getFailedCount(), (unsigned long)allocationStats.checkedRequests,
+                          (unsigned long)allocationStats.allocatingRequests);
+    VideoStreamStats stream = ServerManager::getStreamStats();
+    response.appendFormat("stream streams %lu active %u sent %lu dropped %lu avg_send_us %lu max_send_us %lu avg_age_us %lu\n",
+                          (unsigned long)stream.streams, unsigned(stream.isActive), (unsigned long)stream.framesSent,
+                          (unsigned long)stream.framesDropped, (unsigned long)stream.averageSendTimeUs,
+                          (unsigned long)stream.maxSendTimeUs, (unsigned long)stream.averageAgeUs);
+    RtpStreamStats rtp = RtpStreamManager::getStats();
+    response.appendFormat("rtp streams %lu active %u sent %lu dropped %lu packets %lu fec %lu errors %lu avg_send_us %lu\n",
+                          (unsigned long)rtp.streams, unsigned(rtp.isActive), (unsigned long)rtp.framesSent,
+                          (unsigned long)rtp.framesDropped, (unsigned long)rtp.packetsSent, (unsigned long)rtp.fecPacketsSent,
+                          (unsigned long)rtp.sendErrors, (unsigned long)rtp.averageSendTimeUs);
+    SnapshotCache* snapshotCache = SnapshotCache::getInstance();
+    if (snapshotCache) {
+        SnapshotCacheStats snapshot = snapshotCache->getStats();
+        response.appendFormat("snapshot requests %lu hits %lu captures %lu publishes %lu failures %lu\n",
+                              (unsigned long)snapshot.requests, (unsigned long)snapshot.hits, (unsigned long)snapshot.captures,
+                              (unsigned long)snapshot.publishes, (unsigned long)snapshot.failures);
+    }
+    VisionStats vision = VisionManager::getStats();
+    response.appendFormat("vision enabled %u frames %lu skipped %lu failures %lu avg_us %lu max_us %lu over_budget %lu stop_hints %lu\n",
+                          unsigned(vision.isEnabled), (unsigned long)vision.frames, (unsigned long)vision.skippedFrames,
+                          (unsigned long)vision.failures, (unsigned long)vision.averageFrameUs, (unsigned long)vision.maxFrameUs,
+                          (unsigned long)vision.framesOverBudget, (unsigned long)vision.stopHints);
+    FlightRecorder* flightRecorder = FlightRecorder::getInstance();
+    if (flightRecorder) {
+        FlightRecorderStats flight = flightRecorder->getStats();
+        response.appendFormat("flight records %lu rejected %lu blocks %lu overwritten %lu bytes %lu downloads %lu\n",
+                              (unsigned long)flight.records, (unsigned long)flight.rejectedRecords, (unsigned long)flight.blocks,
+                              (unsigned long)flight.overwrittenBlocks, (unsigned long)flight.bytes, (unsigned long)flight.downloads);
+    }
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_send(req, response.c_str(), response.length());
+}
+
+static esp_err_t telemetryHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    TelemetryManager* telemetryManager = TelemetryManager::getInstance();
+    if (!telemetryManager) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    char query[16] = {0,};
+    char rateValueInChar[4] = {0,};
+    int rate = TELEMETRY_DEFAULT_RATE_HZ;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "F", rateValueInChar, sizeof(rateValueInChar)) == ESP_OK) {
+        rate = atoi(rateValueInChar);
+    }
+    // The telemetry task sends the frames, this session is not served until the stream ends
+    esp_err_t res = telemetryManager->startStream(req, rate);
+    if (res == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "Telemetry stream is already running", HTTPD_RESP_USE_STRLEN);
+    }
+    if (res != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static void sendLogEntry(const LogEntry& entry, const char* line, void* context) {
+    static const char LEVELS[] = "NEWID";
+    char header[32];
+    int length = snprintf(header, sizeof(header), "%c [%lu.%06lu] %s: ", LEVELS[entry.site->level % 5], (unsigned long)(entry.timestampUs / 1000000),
+                          (unsigned long)(entry.timestampUs % 1000000), entry.site->tag);
+    httpd_req_t *req = static_cast<httpd_req_t*>(context);
+    httpd_resp_send_chunk(req, header, length);
+    httpd_resp_send_chunk(req, line, HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, "\n", 1);
+}
+
+static esp_err_t logHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    LogManager* logManager = LogManager::getInstance();
+    if (!logManager) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    // The pending deferred log entries (they are not printed on the UART then), as plain text
+    httpd_resp_set_type(req, "text/plain");
+    logManager->drain(sendLogEntry, req);
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+static void sendTracePiece(const char* data, size_t length, void* context) {
+    httpd_resp_send_chunk(static_cast<httpd_req_t*>(context), data, length);
+}
+
+static esp_err_t traceHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    TraceManager* traceManager = TraceManager::getInstance();
+    if (!traceManager) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    // Chrome trace JSON of the last spans (chrome://tracing, ui.perfetto.dev)
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"trace.json\"");
+    traceManager->exportChromeTrace(sendTracePiece, req);
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+// Camera -----------------------------------------------
+/**
+ * @brief Read an integer query parameter into value (unchanged if the key is missing).
+ *
+ * @return false If the value is not a number or out of the range.
+ */
+static bool readQueryInt(const char* query, const char* key, int32_t min, int32_t max, int32_t* value) {
+    char text[12] = {0,};
+    if (httpd_query_key_value(query, key, text, sizeof(text)) != ESP_OK) { return true; } // Not set (or too long, then not a number)
+    char* end;
+    long number = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || number < min || number > max) { return false; }
+    *value = int32_t(number);
+    return true;
+}
+
+/**
+ * @brief F: frame size (HalFrameSize), Q: JPEG quality, B: frame buffer count, C: XCLK in Hz, L: grab the latest frame (0/1),
+ * G: gain (-1: automatic), E: exposure (-1: automatic), W: window x,y,width,height (0: the full sensor).
+ * The ranges are checked by CameraManager::isValid().
+ */
+static bool parseCameraQuery(const char* query, CameraSettings& settings) {
+    int32_t frameSize = settings.frameSize;
+    int32_t quality = settings.jpegQuality;
+    int32_t frameBufferCount = settings.frameBufferCount;
+    int32_t xclkFrequencyHz = int32_t(settings.xclkFrequencyHz);
+    int32_t isGrabLatest = settings.isGrabLatest;
+    int32_t gain = settings.isAutoGain ? -1 : settings.gain;
+    int32_t exposure = settings.isAutoExposure ? -1 : settings.exposure;
+    if (!readQueryInt(query, "F", 0, HAL_FRAMESIZE_UXGA, &frameSize) ||
+        !readQueryInt(query, "Q", 0, UINT8_MAX, &quality) ||
+        !readQueryInt(query, "B", 0, UINT8_MAX, &frameBufferCount) ||
+        !readQueryInt(query, "C", 0, INT32_MAX, &xclkFrequencyHz) ||
+        !readQueryInt(query, "L", 0, 1, &isGrabLatest) ||
+        !readQueryInt(query, "G", -1, UINT8_MAX, &gain) ||
+        !readQueryInt(query, "E", -1, UINT16_MAX, &exposure)) {
+        return false;
+    }
+    settings.frameSize = static_cast<HalFrameSize>(frameSize);
+    settings.jpegQuality = uint8_t(quality);
+    settings.frameBufferCount = uint8_t(frameBufferCount);
+    settings.xclkFrequencyHz = uint32_t(xclkFrequencyHz);
+    settings.isGrabLatest = isGrabLatest != 0;
+    settings.isAutoGain = gain < 0;
+    if (gain >= 0) { settings.gain = uint8_t(gain); }
+    settings.isAutoExposure = exposure < 0;
+    if (exposure >= 0) { settings.exposure = uint16_t(exposure); }
+
+    char window[24] = {0,};
+    if (httpd_query_key_value(query, "W", window, sizeof(window)) == ESP_OK) {
+        unsigned int x, y, width, height;
+        if (strcmp(window, "0") == 0) {
+            settings.window = {};
+        } else if (sscanf(window, "%u,%u,%u,%u", &x, &y, &width, &height) == 4 &&
+                   x <= UINT16_MAX && y <= UINT16_MAX && width <= UINT16_MAX && height <= UINT16_MAX) {
+            settings.window = { uint16_t(x), uint16_t(y), uint16_t(width), uint16_t(height) };
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static esp_err_t sendCameraSettings(httpd_req_t *req, CameraManager* cameraManager) {
+    static const char* SWITCH_TYPES[] = { "none", "live", "reallocated" };
+    CameraSettings settings = cameraManager->getSettings();
+    CameraSwitch lastSwitch = cameraManager->getLastSwitch();
+    FixedString response(commandArena, 255);
+    response.appendFormat("{\"frameSize\":%u,\"quality\":%u,\"frameBuffers\":%u,\"xclk\":%lu,\"grabLatest\":%s,\"gain\":%d,\"exposure\":%d,"
+                          "\"window\":[%u,%u,%u,%u],\"switch\":\"%s\",\"switchUs\":%lu}",
+                          settings.frameSize, settings.jpegQuality, settings.frameBufferCount, (unsigned long)settings.xclkFrequencyHz,
+                          settings.isGrabLatest ? "true" : "false",
+                          settings.isAutoGain ? -1 : settings.gain, settings.isAutoExposure ? -1 : settings.exposure,
+                          settings.window.offsetX, settings.window.offsetY, settings.window.width, settings.window.height,
+                          SWITCH_TYPES[uint8_t(lastSwitch.type)], (unsigned long)lastSwitch.durationUs);
+    if (response.isOverflow()) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, response.c_str(), response.length());
+}
+
+/**
+ * @brief GET /cam: the sensor settings, with a query they are changed first (only the given keys, see parseCameraQuery()).
+ * Frame size (up to the allocated one), quality, gain, exposure and window are applied live; a new frame buffer count,
+ * grab mode, XCLK or a bigger frame size reinitializes the camera, the stream is stopped for it and restarted.
+ */
+static esp_err_t cameraHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    CameraManager* cameraManager = CameraManager::getInstance();
+    if (!cameraManager) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    size_t queryLength = httpd_req_get_url_query_len(req);
+    if (queryLength > 0) {
+        CameraSettings settings = cameraManager->getSettings();
+        char* query = commandArena.allocateString(queryLength);
+        if (!query || httpd_req_get_url_query_str(req, query, queryLength + 1) != ESP_OK ||
+            !parseCameraQuery(query, settings) || !CameraManager::isValid(settings)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid camera settings");
+            return ESP_FAIL;
+        }
+        // The frame buffers are freed by a reallocation: nobody may hold one
+        ServerManager* serverManager = ServerManager::getInstance();
+        bool isStreamStopped = cameraManager->requiresReallocation(settings) && serverManager->isVideoServerRunning();
+        if (isStreamStopped) { serverManager->stopVideoServer(); }
+        esp_err_t err = cameraManager->applySettings(settings, true);
+        if (isStreamStopped) { serverManager->startVideoServer(); }
+        if (err != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Camera settings failed");
+            return ESP_FAIL;
+        }
+    }
+    return sendCameraSettings(req, cameraManager);
+}
+
+// Vision -----------------------------------------------
+/**
+ * @brief GET /vis: the state of the vision stage (VisionManager), E=0|1 disables or enables it first. The maps have
+ * one bit per cell, row by row from the top left; the odometry is the last optical flow estimate (0 blocks: none).
+ */
+static esp_err_t visionHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    char query[16] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        int32_t isEnabled = VisionManager::isEnabled();
+        if (!readQueryInt(query, "E", 0, 1, &isEnabled)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid vision settings");
+            return ESP_FAIL;
+        }
+        VisionManager::setEnabled(isEnabled != 0);
+    }
+    VisionStats stats = VisionManager::getStats();
+    VisionOdometry odometry = VisionManager::getOdometry();
+    FixedString response(commandArena, 400);
+    response.appendFormat("{\"enabled\":%s,\"running\":%s,\"frames\":%lu,\"skipped\":%lu,\"failures\":%lu,\"avgUs\":%lu,"
+                          "\"maxUs\":%lu,\"overBudget\":%lu,\"motionMap\":%lu,\"obstacleMap\":%lu,\"motionPermille\":%u,"
+                          "\"nearCells\":%u,\"stopHint\":%s,\"stopHints\":%lu,\"forwardHeld\":%lu,"
+                          "\"flowBlocks\":%u,\"forwardMmS\":%d,\"yawDeciDegS\":%d,\"odometryAgeMs\":%lu}",
+                          stats.isEnabled ? "true" : "false", VisionManager::getInstance() ? "true" : "false",
+                          (unsigned long)stats.frames, (unsigned long)stats.skippedFrames, (unsigned long)stats.failures,
+                          (unsigned long)stats.averageFrameUs, (unsigned long)stats.maxFrameUs, (unsigned long)stats.framesOverBudget,
+                          (unsigned long)stats.motionMap, (unsigned long)stats.obstacleMap, unsigned(stats.motionPermille),
+                          unsigned(stats.nearObstacleCells), stats.isStopHint ? "true" : "false",
+                          (unsigned long)stats.stopHints, (unsigned long)MotorManager::getStopHintBlocks(),
+                          unsigned(odometry.flowBlocks), odometry.forwardMmPerS, odometry.yawRateDeciDegPerS,
+                          (unsigned long)odometry.ageMs);
+    if (response.isOverflow()) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, response.c_str(), response.length());
+}
+
+/**
+ * @brief GET /lfw: the state of the line follow (VisionManager), E=0|1 stops or starts it first, S: the speed in percent
+ * (LINE_MIN_SPEED - LINE_MAX_SPEED). It starts only with the vision stage enabled and the motor controls running.
+ */
+static esp_err_t lineFollowHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    char query[24] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        int32_t isEnabled = VisionManager::isLineFollowing();
+        int32_t speed = VisionManager::getLineFollowStats().speed;
+        if (!readQueryInt(query, "E", 0, 1, &isEnabled) || !readQueryInt(query, "S", LINE_MIN_SPEED, LINE_MAX_SPEED, &speed)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid line follow settings");
+            return ESP_FAIL;
+        }
+        if (VisionManager::setLineFollow(isEnabled != 0, uint8_t(speed)) != ESP_OK) {
+            httpd_resp_set_status(req, "409 Conflict");
+            return httpd_resp_send(req, "Vision stage or motor controls are not running", HTTPD_RESP_USE_STRLEN);
+        }
+    }
+    LineFollowStats stats = VisionManager::getLineFollowStats();
+    FixedString response(commandArena, 200);
+    response.appendFormat("{\"enabled\":%s,\"found\":%s,\"speed\":%u,\"offsetMm\":%d,\"angleDeciDeg\":%d,"
+                          "\"forward\":%d,\"steering\":%d,\"frames\":%lu,\"missed\":%lu}",
+                          stats.isEnabled ? "true" : "false", stats.isFound ? "true" : "false", unsigned(stats.speed),
+                          stats.offsetMm, stats.angleDeciDeg, stats.forward, stats.steering,
+                          (unsigned long)stats.frames, (unsigned long)stats.missedFrames);
+    if (response.isOverflow()) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, response.c_str(), response.length());
+}
+
+// Photo ------------------------------------------------
+static esp_err_t sendPhotoStatus(httpd_req_t *req, PhotoManager* photoManager) {
+    uint32_t ids[PHOTO_RING_SIZE];
+    uint8_t count = photoManager->getIds(ids);
+    PhotoStats stats = photoManager->getStats();
+    CameraManager* cameraManager = CameraManager::getInstance();
+    FixedString response(commandArena, 300);
+    response.append("{\"stills\":[");
+    for (uint8_t i = 0; i < count; i++) { response.appendFormat(i ? ",%lu" : "%lu", (unsigned long)ids[i]); }
+    response.appendFormat("],\"reserved\":%s,\"bursts\":%lu,\"failures\":%lu,\"dropped\":%lu,\"switchUs\":%lu,"
+                          "\"gapUs\":%lu,\"maxGapUs\":%lu,\"overBudget\":%lu}",
+                          cameraManager && cameraManager->isFrameSizeAllocated(PHOTO_FRAMESIZE) ? "true" : "false",
+                          (unsigned long)stats.bursts, (unsigned long)stats.failures, (unsigned long)stats.droppedFrames,
+                          (unsigned long)stats.lastSwitchUs, (unsigned long)stats.lastGapUs, (unsigned long)stats.maxGapUs,
+                          (unsigned long)stats.gapsOverBudget);
+    if (response.isOverflow()) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, response.c_str(), response.length());
+}
+
+/**
+ * @brief GET /pic: the stills of the ring (PhotoManager) and the stream gaps, N=<1 - PHOTO_BURST_MAX> captures a
+ * burst first. The frame buffers are reallocated for the photo size on the first capture if they do not fit it (the
+ * stream is restarted once, like /cam), the captures after it switch live. The stills are on the video server (/stl).
+ */
+static esp_err_t photoHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    PhotoManager* photoManager = PhotoManager::getInstance();
+    if (!photoManager) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    char query[16] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        int32_t count = 0;
+        if (!readQueryInt(query, "N", 1, PHOTO_BURST_MAX, &count) || count == 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid photo count");
+            return ESP_FAIL;
+        }
+        CameraManager* cameraManager = CameraManager::getInstance();
+        if (cameraManager && !cameraManager->isCameraPoweredDown() && !cameraManager->isFrameSizeAllocated(PHOTO_FRAMESIZE)) {
+            ServerManager* serverManager = ServerManager::getInstance();
+            bool isStreamStopped = serverManager->isVideoServerRunning();
+            if (isStreamStopped) { serverManager->stopVideoServer(); }
+            esp_err_t err = cameraManager->reserveFrameSize(PHOTO_FRAMESIZE);
+            if (isStreamStopped) { serverManager->startVideoServer(); }
+            if (err != ESP_OK) {
+                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Frame buffers for the photo size failed");
+                return ESP_FAIL;
+            }
+        }
+        uint32_t firstId = 0;
+        esp_err_t err = photoManager->capture(uint8_t(count), &firstId);
+        if (err == ESP_ERR_INVALID_STATE) {
+            httpd_resp_set_status(req, "409 Conflict");
+            return httpd_resp_send(req, "Camera is not running or a photo is being taken", HTTPD_RESP_USE_STRLEN);
+        }
+        if (err != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Photo capture failed");
+            return ESP_FAIL;
+        }
+    }
+    return sendPhotoStatus(req, photoManager);
+}
+
+// Dashcam ----------------------------------------------
+/**
+ * @brief GET /rec: the state of the dashcam (DashcamManager), E=0|1 stops or starts the recording first. The times
+ * are esp_timer milliseconds, like the from and to of /dcm on the video server.
+ */
+static esp_err_t dashcamHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    DashcamManager* dashcamManager = DashcamManager::getInstance();
+    if (!dashcamManager) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    char query[16] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        int32_t isEnabled = DashcamManager::isEnabled();
+        if (!readQueryInt(query, "E", 0, 1, &isEnabled)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid dashcam settings");
+            return ESP_FAIL;
+        }
+        DashcamManager::setEnabled(isEnabled != 0);
+    }
+    DashcamStats stats = dashcamManager->getStats();
+    FixedString response(commandArena, 300);
+    response.appendFormat("{\"enabled\":%s,\"recording\":%s,\"frames\":%lu,\"bytes\":%lu,\"slabs\":%u,\"recorded\":%lu,"
+                          "\"evicted\":%lu,\"dropped\":%lu,\"failures\":%lu,\"downloads\":%lu,\"oldestMs\":%lu,\"newestMs\":%lu}",
+                          stats.isEnabled ? "true" : "false", stats.isRecording ? "true" : "false",
+                          (unsigned long)stats.frames, (unsigned long)stats.bytes, unsigned(stats.slabsUsed),
+                          (unsigned long)stats.recordedFrames, (unsigned long)stats.evictedFrames,
+                          (unsigned long)stats.droppedFrames, (unsigned long)stats.failures, (unsigned long)stats.downloads,
+                          (unsigned long)(stats.oldestTimestampUs / 1000), (unsigned long)(stats.newestTimestampUs / 1000));
+    if (response.isOverflow()) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, response.c_str(), response.length());
+}
+
+// Flight recorder --------------------------------------
+static bool sendFlightBlock(const char* data, size_t length, void* context) {
+    return httpd_resp_send_chunk(static_cast<httpd_req_t*>(context), data, length) == ESP_OK;
+}
+
+/**
+ * @brief GET /flt: the blocks of the flight recorder (FlightRecorder), binary, decoded by tools/flight_decode.py.
+ * S=<sequence> sends the blocks from that one on (the newest block of the previous download, to follow the log).
+ */
+static esp_err_t flightRecorderHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    FlightRecorder* flightRecorder = FlightRecorder::getInstance();
+    if (!flightRecorder) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    int32_t firstSequence = 0;
+    char query[24] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        !readQueryInt(query, "S", 0, INT32_MAX, &firstSequence)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid query");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"flight.bin\"");
+    if (flightRecorder->exportLog(uint32_t(firstSequence), sendFlightBlock, req) != ESP_OK) { return ESP_FAIL; } // The session is closed
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+// Control jitter buffer --------------------------------
+/**
+ * @brief GET /jit: the jitter buffer of the /mov commands (ControlJitterBuffer), JSON. D=<ms> sets its depth
+ * (0 - CONTROL_JITTER_MAX_DEPTH_MS): a deeper buffer rides out longer Wi-Fi gaps, but the drone follows the stick later.
+ */
+static esp_err_t controlJitterHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    MotorManager* motorManager = MotorManager::getInstance();
+    char query[24] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        int32_t depthMs = motorManager->getControlJitterStats().depthMs;
+        if (!readQueryInt(query, "D", 0, CONTROL_JITTER_MAX_DEPTH_MS, &depthMs)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid query");
+            return ESP_FAIL;
+        }
+        motorManager->setControlJitterDepthMs(uint16_t(depthMs));
+    }
+    ControlJitterStats stats = motorManager->getControlJitterStats();
+    FixedString response(commandArena, 300);
+    response.appendFormat("{\"depthMs\":%u,\"intervalUs\":%lu,\"queued\":%u,\"commands\":%lu,\"backdated\":%lu,"
+                          "\"overflows\":%lu,\"skipped\":%lu,\"extrapolations\":%lu,\"failsafes\":%lu,",
+                          unsigned(stats.depthMs), (unsigned long)stats.intervalUs, unsigned(stats.queued),
+                          (unsigned long)stats.commands, (unsigned long)stats.backdated, (unsigned long)stats.overflows,
+                          (unsigned long)stats.skipped, (unsigned long)stats.extrapolations, (unsigned long)stats.failsafes);
+    response.appendFormat("\"averageDelayUs\":%lu,\"maxDelayUs\":%lu}",
+                          (unsigned long)stats.averageDelayUs, (unsigned long)stats.maxDelayUs);
+    if (response.isOverflow()) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, response.c_str(), response.length());
+}
+
+// Clock sync -------------------------------------------
+// Stamped and completed by the /syn handler (the command server task), read by the telemetry task
+static ClockSync clockSync;
+static SemaphoreHandle_t clockSyncMutex = nullptr;     // Created with the server manager
+
+static bool readQueryTimeUs(const char* query, const char* key, int64_t* value) {
+    char text[21] = {0,};
+    if (httpd_query_key_value(query, key, text, sizeof(text)) != ESP_OK) { return true; } // Not set (or too long, then not a number)
+    char* end;
+    long long number = strtoll(text, &end, 10);
+    if (end == text || *end != '\0' || number < 0) { return false; }
+    *value = int64_t(number);
+    return true;
+}
+
+/**
+ * @brief GET /syn: one NTP-style exchange of the clock sync (ClockSync.h), JSON. T=<t1> is the clock of the operator
+ * (us, any epoch), the response has the arrival (t2) and the send time (t3) on the drone clock. P=<t1>&E=<t4> completes
+ * an earlier exchange with the time its response arrived, R=1 drops the samples first (a new operator clock).
+ * The client is tools/clock_sync.py.
+ */
+static esp_err_t clockSyncHandler(httpd_req_t *req) {
+    int64_t receiveUs = Hal::Timer::getTimeUs();
+    RequestArenaScope arenaScope(commandArena);
+    SessionRequestTimer timer(req);
+    int64_t t1 = -1;
+    int64_t previousT1 = -1;
+    int64_t previousT4 = -1;
+    int32_t isReset = 0;
+    char query[96] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        !readQueryTimeUs(query, "T", &t1) || !readQueryTimeUs(query, "P", &previousT1) ||
+        !readQueryTimeUs(query, "E", &previousT4) || !readQueryInt(query, "R", 0, 1, &isReset) ||
+        t1 < 0 || (previousT1 < 0) != (previousT4 < 0)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid query");
+        return ESP_FAIL;
+    }
+    xSemaphoreTake(clockSyncMutex, portMAX_DELAY);
+    if (isReset) { clockSync.clear(); }
+    if (previousT1 >= 0) { clockSync.complete(previousT1, previousT4); }
+    int64_t sendUs = Hal::Timer::getTimeUs();
+    clockSync.stamp(t1, receiveUs, sendUs);
+    ClockSyncStats stats = clockSync.getStats();
+    xSemaphoreGive(clockSyncMutex);
+
+    FixedString response(commandArena, 200);
+    response.appendFormat("{\"t1\":%lld,\"t2\":%lld,\"t3\":%lld,\"offsetUs\":%lld,\"rttUs\":%lu,\"samples\":%u}",
+                          (long long)t1, (long long)receiveUs, (long long)sendUs, (long long)stats.offsetUs,
+                          (unsigned long)stats.rttUs, unsigned(stats.windowCount));
+    if (response.isOverflow()) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, response.c_str(), response.length());
+}
+
+ClockSyncStats ServerManager::getClockSyncStats() {
+    if (!clockSyncMutex) { return {}; }
+    xSemaphoreTake(clockSyncMutex, portMAX_DELAY);
+    ClockSyncStats stats = clockSync.getStats();
+    xSemaphoreGive(clockSyncMutex);
+    return stats;
+}
+
 // Video Server -------------------------------------------------------------
 #define PART_BOUNDARY "123456789000000000000987654321"
 static const char* STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
 static const char* STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
-static const char* STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
+// The capture and the send time (esp_timer, seconds since boot) and the number of the frame in the stream
+static const char* STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %lu.%06lu\r\n"
+                                 "X-Frame-Sequence: %lu\r\nX-Send-Timestamp: %lu.%06lu\r\n\r\n";
+#define STREAM_PART_MAX_LENGTH  192
 
-static esp_err_t streamHandler(httpd_req_t *req) {
-    camera_fb_t * fb = NULL;
+static std::atomic<bool> isStreamEnabled(false); // Cleared before stopping the video server, to end the stream loop
+static std::atomic<bool> isStreamRunning(false); // The stream task runs (one stream at a time)
+static char streamPartBuffer[STREAM_PART_MAX_LENGTH];  // Only used by the stream task
+
+// Stream Stats -------------------------------------------------------------
+// Written by the video server task, read by the command server task: single 32 bit atomics (a reader can see the
+// fields of two adjacent frames, like the counters of TelemetryManager)
+static struct {
+    std::atomic<uint32_t> streams{0};
+    std::atomic<bool> isActive{false};
+    std::atomic<uint32_t> framesSent{0};
+    std::atomic<uint32_t> framesDropped{0};
+    std::atomic<uint32_t> averageSendTimeUs{0};
+    std::atomic<uint32_t> maxSendTimeUs{0};
+    std::atomic<uint32_t> averageAgeUs{0};
+} streamStats;
+
+/*
+    The totals of one stream, kept by its handler and published after every frame.
+*/
+struct StreamCounters {
+    uint32_t framesSent = 0;
+    uint32_t framesDropped = 0;
+    uint64_t totalSendTimeUs = 0;
+    uint32_t maxSendTimeUs = 0;
+    uint64_t totalAgeUs = 0;
+
+    void publish() const {
+        streamStats.framesSent.store(framesSent, std::memory_order_relaxed);
+        streamStats.framesDropped.store(framesDropped, std::memory_order_relaxed);
+        streamStats.averageSendTimeUs.store(framesSent ? uint32_t(totalSendTimeUs / framesSent) : 0, std::memory_order_relaxed);
+        streamStats.maxSendTimeUs.store(maxSendTimeUs, std::memory_order_relaxed);
+        streamStats.averageAgeUs.store(framesSent ? uint32_t(totalAgeUs / framesSent) : 0, std::memory_order_relaxed);
+    }
+};
+
+VideoStreamStats ServerManager::getStreamStats() {
+    return {
+        .streams = streamStats.streams.load(std::memory_order_relaxed),
+        .isActive = streamStats.isActive.load(std::memory_order_relaxed),
+        .framesSent = streamStats.framesSent.load(std::memory_order_relaxed),
+        .framesDropped = streamStats.framesDropped.load(std::memory_order_relaxed),
+        .averageSendTimeUs = streamStats.averageSendTimeUs.load(std::memory_order_relaxed),
+        .maxSendTimeUs = streamStats.maxSendTimeUs.load(std::memory_order_relaxed),
+        .averageAgeUs = streamStats.averageAgeUs.load(std::memory_order_relaxed),
+    };
+}
+
+/**
+ * @brief /str?latency=1: log the capture-to-send delay of every frame (the deferred log, /log).
+ */
+static bool isLatencyModeRequested(httpd_req_t *req) {
+    char query[24] = {0,};
+    char value[4] = {0,};
+    return httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+           httpd_query_key_value(query, "latency", value, sizeof(value)) == ESP_OK && strcmp(value, "1") == 0;
+}
+
+/**
+ * @brief The stream loop, in its own task: the video server task stays free for the snapshots (/jpg).
+ */
+static void taskVideoStream(void *pvParameters) {
+    httpd_req_t *req = static_cast<httpd_req_t*>(pvParameters);
+    HalCameraFrame frame;
     esp_err_t res = ESP_OK;
+    bool isFrameValid = false;
     size_t jpgBufferLength = 0;
     uint8_t * jpgBuffer = nullptr;
-    char * partitionBuffer[64];
-    // static int64_t lastFrame = 0;
+    bool isLatencyMode = isLatencyModeRequested(req);
+    uint32_t sequence = 0;          // Every frame taken from the camera gets one, a dropped frame is a gap at the client
+    StreamCounters counters;
 
-    // if(!lastFrame) { lastFrame = esp_timer_get_time(); }
-    res = httpd_resp_set_type(req, STREAM_CONTENT_TYPE);
-    if (res != ESP_OK) { return res; }
-
-    while (true) {
-        fb = esp_camera_fb_get();
-        if (!fb) {
-            DEBUG_PRINT("Camera capture failed");
+    streamStats.streams.fetch_add(1, std::memory_order_relaxed);
+    counters.publish();
+    streamStats.isActive.store(true, std::memory_order_relaxed);
+    while (isStreamEnabled) {
+        TRACE_SPAN("stream_frame");
+        int64_t getStartUs = Hal::Timer::getTimeUs();
+        {
+            TRACE_SPAN("fb_get");
+            isFrameValid = CameraManager::getStreamFrame(frame);
+        }
+        if (!isFrameValid) {
+            LOG_E(SERVER, "Camera capture failed");
             res = ESP_FAIL;
             break;
         }
-        if (fb->format != PIXFORMAT_JPEG) {
-            if (!frame2jpg(fb, 80, &jpgBuffer, &jpgBufferLength)) {
-                DEBUG_PRINT("JPEG compression failed");
-                esp_camera_fb_return(fb);
-                res = ESP_FAIL;
+        uint32_t frameSequence = sequence++;
+        if (frame.format != HAL_PIXFORMAT_JPEG) {
+            TRACE_SPAN("jpeg_encode");
+            // The JPEG buffer is allocated by the camera driver (frame2jpg), the only allocation of the stream loop
+            if (!Hal::Camera::convertToJpeg(frame, 80, &jpgBuffer, &jpgBufferLength)) {
+                // Out of memory for a frame: the frame is dropped, the stream goes on with the next one
+                LOG_E(SERVER, "JPEG compression failed, frame %u dropped", unsigned(frameSequence));
+                Hal::Camera::returnFrame(frame);
+                counters.framesDropped++;
+                counters.publish();
+                continue;
             }
         } else {
-            jpgBufferLength = fb->len;
-            jpgBuffer = fb->buf;
+            jpgBufferLength = frame.length;
+            jpgBuffer = frame.data;
+        }
+        // The snapshots (/jpg) use a copy of the stream, so they do not take a frame from it
+        SnapshotCache* snapshotCache = SnapshotCache::getInstance();
+        if (snapshotCache && snapshotCache->isPublishDue(frame.timestampUs)) {
+            TRACE_SPAN("snapshot_publish");
+            snapshotCache->publish(jpgBuffer, jpgBufferLength, frame.width, frame.height, frame.timestampUs);
         }
-        if (res == ESP_OK) { res = httpd_resp_send_chunk(req, STREAM_BOUNDARY, strlen(STREAM_BOUNDARY)); }
+        int64_t sendStartUs = Hal::Timer::getTimeUs();
+        {
+            TRACE_SPAN("stream_send");
+            res = httpd_resp_send_chunk(req, STREAM_BOUNDARY, strlen(STREAM_BOUNDARY));
+            if (res == ESP_OK) {
+                size_t hlen = snprintf(streamPartBuffer, STREAM_PART_MAX_LENGTH, STREAM_PART, jpgBufferLength,
+                                       (unsigned long)(frame.timestampUs / 1000000), (unsigned long)(frame.timestampUs % 1000000),
+                                       (unsigned long)frameSequence,
+                                       (unsigned long)(sendStartUs / 1000000), (unsigned long)(sendStartUs % 1000000));
+                res = httpd_resp_send_chunk(req, (const char *)streamPartBuffer, hlen);
+            }
+            if (res == ESP_OK) { res = httpd_resp_send_chunk(req, (const char *)jpgBuffer, jpgBufferLength); }
+        }
+        int64_t sentUs = Hal::Timer::getTimeUs();
         if (res == ESP_OK) {
-            size_t hlen = snprintf((char *)partitionBuffer, 64, STREAM_PART, jpgBufferLength);
-            res = httpd_resp_send_chunk(req, (const char *)partitionBuffer, hlen);
+            TelemetryManager::recordStreamFrame(jpgBufferLength);
+            uint32_t sendTimeUs = uint32_t(sentUs - sendStartUs);
+            counters.framesSent++;
+            counters.totalSendTimeUs += sendTimeUs;
+            if (sendTimeUs > counters.maxSendTimeUs) { counters.maxSendTimeUs = sendTimeUs; }
+            counters.totalAgeUs += uint64_t(sendStartUs - frame.timestampUs);
+        } else {
+            counters.framesDropped++;
         }
-        if (res == ESP_OK) { res = httpd_resp_send_chunk(req, (const char *)jpgBuffer, jpgBufferLength); }
-        if (fb->format != PIXFORMAT_JPEG) { free(jpgBuffer); }
+        counters.publish();
+        if (frame.format != HAL_PIXFORMAT_JPEG) { free(jpgBuffer); }
         
-        esp_camera_fb_return(fb);
-        if (res != ESP_OK) { break; }   
+        Hal::Camera::returnFrame(frame);
+        if (res != ESP_OK) { break; }
+        if (isLatencyMode) {
+            // Capture age when the send started (a stale frame waited in a buffer), and the whole capture-to-sent delay
+            LOG_I(SERVER, "Frame latency: age %u us, capture->sent %u us (fb_get %u us, send %u us)",
+                  unsigned(sendStartUs - frame.timestampUs), unsigned(sentUs - frame.timestampUs),
+                  unsigned(sendStartUs - getStartUs), unsigned(sentUs - sendStartUs));
+        }
+    }
+
+    if (res == ESP_OK) {
+        httpd_resp_send_chunk(req, nullptr, 0); // Stopped: end of the chunked response
+    } else {
+        httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req)); // Like a failed handler: the session is closed
+    }
+    httpd_req_async_handler_complete(req);
+    streamStats.isActive.store(false, std::memory_order_relaxed);
+    isStreamRunning = false;
+    vTaskDelete(NULL);
+}
+
+static esp_err_t streamHandler(httpd_req_t *req) {
+    if (isStreamRunning.exchange(true)) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "Stream is already running", HTTPD_RESP_USE_STRLEN);
+    }
+    RtpStreamManager* rtpStreamManager = RtpStreamManager::getInstance();
+    if (rtpStreamManager && rtpStreamManager->isStreaming()) { // One camera stream at a time
+        isStreamRunning = false;
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "RTP stream is running", HTTPD_RESP_USE_STRLEN);
+    }
+    httpd_req_t* asyncRequest = nullptr;
+    esp_err_t res = httpd_req_async_handler_begin(req, &asyncRequest);
+    if (res == ESP_OK) { res = httpd_resp_set_type(asyncRequest, STREAM_CONTENT_TYPE); }
+    if (res == ESP_OK &&
+        xTaskCreatePinnedToCore(&taskVideoStream, "VIDEO_STREAM", VIDEO_STREAM_STACK_SIZE, asyncRequest,
+                                VIDEO_STREAM_PRIORITY, nullptr, VIDEO_STREAM_CORE) != pdPASS) {
+        res = ESP_ERR_NO_MEM;
+    }
+    if (res != ESP_OK) {
+        if (asyncRequest) { httpd_req_async_handler_complete(asyncRequest); }
+        isStreamRunning = false;
+        return res;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Wait for the stream task to end (isStreamEnabled is cleared), it ends after the frame it is sending.
+ */
+static void waitForStreamEnd() {
+    for (uint16_t waitedMs = 0; isStreamRunning && waitedMs < VIDEO_STREAM_STOP_TIMEOUT_MS; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (isStreamRunning) { DEBUG_PRINT("Video stream did not stop in time"); }
+}
+
+// Snapshot -----------------------------------------------------------------
+/**
+ * @brief GET /jpg: the latest frame as one JPEG, from the snapshot cache. /jpg?maxAge=<ms> is the largest accepted
+ * age of the cached frame (SNAPSHOT_MAX_AGE_MS by default), an older one is captured again. The ETag is the capture
+ * time: If-None-Match with it is answered with 304 Not Modified.
+ */
+static esp_err_t snapshotHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(videoArena);
+    SnapshotCache* snapshotCache = SnapshotCache::getInstance();
+    if (!snapshotCache) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    int32_t maxAgeMs = SNAPSHOT_MAX_AGE_MS;
+    char query[24] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        !readQueryInt(query, "maxAge", 0, SNAPSHOT_MAX_AGE_LIMIT_MS, &maxAgeMs)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid maxAge");
+        return ESP_FAIL;
+    }
+
+    const SnapshotFrame* frame = nullptr;
+    if (snapshotCache->acquire(uint32_t(maxAgeMs), frame) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Camera capture failed");
+        return ESP_FAIL;
+    }
+    uint32_t ageMs = uint32_t((Hal::Timer::getTimeUs() - frame->timestampUs) / 1000);
+    // The header values are sent with the response, they stay in the arena until then
+    FixedString timestamp(videoArena, 20);
+    timestamp.appendFormat("%lu.%06lu", (unsigned long)(frame->timestampUs / 1000000), (unsigned long)(frame->timestampUs % 1000000));
+    FixedString etag(videoArena, 24);
+    etag.appendFormat("\"%s\"", timestamp.c_str());
+    FixedString age(videoArena, 12);
+    age.appendFormat("%lu", (unsigned long)(ageMs / 1000));
+    FixedString frameAge(videoArena, 12);
+    frameAge.appendFormat("%lu", (unsigned long)ageMs);
+    httpd_resp_set_hdr(req, "ETag", etag.c_str());
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Age", age.c_str());
+    httpd_resp_set_hdr(req, "X-Timestamp", timestamp.c_str());
+    httpd_resp_set_hdr(req, "X-Frame-Age-Ms", frameAge.c_str());
+
+    esp_err_t res;
+    char ifNoneMatch[24] = {0,};
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", ifNoneMatch, sizeof(ifNoneMatch)) == ESP_OK &&
+        strcmp(ifNoneMatch, etag.c_str()) == 0) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        res = httpd_resp_send(req, nullptr, 0);
+    } else {
+        TRACE_SPAN("snapshot_send");
+        httpd_resp_set_type(req, "image/jpeg");
+        res = httpd_resp_send(req, (const char *)frame->data, frame->length);
+    }
+    snapshotCache->release(frame);
+    return res;
+}
+
+// Still --------------------------------------------------------------------
+/**
+ * @brief GET /stl?id=<n>: a still of the photo ring as JPEG (/pic takes them), the latest without an id. A still never
+ * changes: it can be cached by the client.
+ */
+static esp_err_t stillHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(videoArena);
+    PhotoManager* photoManager = PhotoManager::getInstance();
+    if (!photoManager) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    int32_t id = 0;
+    char query[24] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK && !readQueryInt(query, "id", 1, INT32_MAX, &id)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid id");
+        return ESP_FAIL;
+    }
+    const PhotoFrame* frame = photoManager->acquire(uint32_t(id));
+    if (!frame) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such still");
+        return ESP_FAIL;
+    }
+    FixedString photoId(videoArena, 12);
+    photoId.appendFormat("%lu", (unsigned long)frame->id);
+    FixedString timestamp(videoArena, 20);
+    timestamp.appendFormat("%lu.%06lu", (unsigned long)(frame->timestampUs / 1000000), (unsigned long)(frame->timestampUs % 1000000));
+    httpd_resp_set_hdr(req, "Cache-Control", "max-age=3600");
+    httpd_resp_set_hdr(req, "X-Photo-Id", photoId.c_str());
+    httpd_resp_set_hdr(req, "X-Timestamp", timestamp.c_str());
+    httpd_resp_set_type(req, "image/jpeg");
+    esp_err_t res;
+    {
+        TRACE_SPAN("still_send");
+        res = httpd_resp_send(req, (const char *)frame->data, frame->length);
     }
+    photoManager->release(frame);
     return res;
 }
 
+// Dashcam download ---------------------------------------------------------
+struct DashcamDownload {
+    httpd_req_t* req;
+    DashcamFormat format;
+    bool isStarted;                 // The headers are set with the first piece, an empty range is a 404
+};
+
+static bool sendDashcamPiece(const char* data, size_t length, void* context) {
+    DashcamDownload* download = static_cast<DashcamDownload*>(context);
+    if (!download->isStarted) {
+        download->isStarted = true;
+        httpd_resp_set_type(download->req, DashcamManager::getContentType(download->format));
+        httpd_resp_set_hdr(download->req, "Cache-Control", "no-store");
+        if (download->format == DashcamFormat::AVI) {
+            httpd_resp_set_hdr(download->req, "Content-Disposition", "attachment; filename=\"dashcam.avi\"");
+        }
+    }
+    return httpd_resp_send_chunk(download->req, data, length) == ESP_OK;
+}
+
+/**
+ * @brief GET /dcm: the dashcam recording (DashcamManager). fmt=avi (default), mjpeg (parts like /str, with X-Control)
+ * or json (the index); from and to are esp_timer milliseconds (/rec), last=<s> is the last seconds before the newest
+ * frame. The server task sends the whole recording (about a second for a full ring), the snapshots wait meanwhile.
+ */
+static esp_err_t dashcamDownloadHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(videoArena);
+    DashcamManager* dashcamManager = DashcamManager::getInstance();
+    if (!dashcamManager) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    DashcamFormat format = DashcamFormat::AVI;
+    int32_t fromMs = 0;
+    int32_t toMs = INT32_MAX;
+    int32_t lastS = 0;
+    char query[64] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char value[8] = {0,};
+        bool isFormatValid = true;
+        if (httpd_query_key_value(query, "fmt", value, sizeof(value)) == ESP_OK) {
+            if (strcmp(value, "mjpeg") == 0) { format = DashcamFormat::MJPEG; }
+            else if (strcmp(value, "json") == 0) { format = DashcamFormat::JSON; }
+            else { isFormatValid = strcmp(value, "avi") == 0; }
+        }
+        if (!isFormatValid || !readQueryInt(query, "from", 0, INT32_MAX, &fromMs) ||
+            !readQueryInt(query, "to", 0, INT32_MAX, &toMs) || !readQueryInt(query, "last", 1, 3600, &lastS)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid query");
+            return ESP_FAIL;
+        }
+    }
+    int64_t fromUs = int64_t(fromMs) * 1000;
+    int64_t toUs = toMs == INT32_MAX ? INT64_MAX : int64_t(toMs) * 1000;
+    if (lastS) {
+        DashcamStats stats = dashcamManager->getStats();
+        fromUs = stats.newestTimestampUs - int64_t(lastS) * 1000000;
+    }
+    DashcamDownload download = { req, format, false };
+    esp_err_t res = dashcamManager->exportRecording(format, fromUs, toUs, sendDashcamPiece, &download);
+    if (res == ESP_ERR_NOT_FOUND) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No recorded frames");
+        return ESP_FAIL;
+    }
+    if (res != ESP_OK) { return ESP_FAIL; } // The session is closed
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+// RTP ----------------------------------------------------------------------
+/**
+ * @brief The IPv4 address of the client, or of this end of the connection (network byte order). The server socket
+ * is IPv6 with IPv4 mapped addresses if the IPv6 of lwIP is enabled.
+ */
+static bool getConnectionAddress(httpd_req_t *req, bool isClient, uint32_t* address) {
+    struct sockaddr_storage storage;
+    socklen_t length = sizeof(storage);
+    int socket = httpd_req_to_sockfd(req);
+    struct sockaddr* socketAddress = reinterpret_cast<struct sockaddr*>(&storage);
+    if ((isClient ? getpeername(socket, socketAddress, &length) : getsockname(socket, socketAddress, &length)) != 0) { return false; }
+    if (storage.ss_family == AF_INET) {
+        *address = reinterpret_cast<struct sockaddr_in*>(&storage)->sin_addr.s_addr;
+        return true;
+    }
+#ifdef CONFIG_LWIP_IPV6
+    if (storage.ss_family == AF_INET6) {
+        static const uint8_t MAPPED_PREFIX[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+        const uint8_t* bytes = reinterpret_cast<struct sockaddr_in6*>(&storage)->sin6_addr.s6_addr;
+        if (memcmp(bytes, MAPPED_PREFIX, sizeof(MAPPED_PREFIX)) != 0) { return false; }
+        memcpy(address, bytes + 12, 4);
+        return true;
+    }
+#endif
+    return false;
+}
+
+/**
+ * @brief GET /rtp?port=<udp port>[&fec=<group size>]: RTP/JPEG to the UDP port of the client (RtpStreamManager), the
+ * response is the SDP of the stream (ffplay, VLC). The client repeats the request within RTP_LEASE_MS to keep the
+ * stream running, /rtp?stop=1 stops it. fec is the number of media packets per parity packet (0: no FEC).
+ */
+static esp_err_t rtpHandler(httpd_req_t *req) {
+    RequestArenaScope arenaScope(videoArena);
+    RtpStreamManager* rtpStreamManager = RtpStreamManager::getInstance();
+    if (!rtpStreamManager) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    int32_t port = 0;
+    int32_t fecGroupSize = RTP_DEFAULT_FEC_GROUP_SIZE;
+    int32_t isStop = 0;
+    char query[40] = {0,};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        (!readQueryInt(query, "port", 1, 65535, &port) || !readQueryInt(query, "fec", 0, RTP_FEC_MAX_GROUP_SIZE, &fecGroupSize) ||
+         !readQueryInt(query, "stop", 0, 1, &isStop))) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid query");
+        return ESP_FAIL;
+    }
+    if (isStop) {
+        if (rtpStreamManager->stopStream() != ESP_OK) {
+            httpd_resp_send_500(req); // It ends later, after its current frame
+            return ESP_FAIL;
+        }
+        return httpd_resp_send(req, "RTP stream stopped", HTTPD_RESP_USE_STRLEN);
+    }
+    if (port == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing port");
+        return ESP_FAIL;
+    }
+    if (isStreamRunning) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "MJPEG stream is running", HTTPD_RESP_USE_STRLEN);
+    }
+    uint32_t clientAddress = 0;
+    uint32_t serverAddress = 0;
+    if (!getConnectionAddress(req, true, &clientAddress) || !getConnectionAddress(req, false, &serverAddress)) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Unknown client address");
+        return ESP_FAIL;
+    }
+    esp_err_t res = rtpStreamManager->startStream(clientAddress, uint16_t(port), uint8_t(fecGroupSize));
+    if (res == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "RTP stream is running for another client", HTTPD_RESP_USE_STRLEN);
+    }
+    if (res != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    const uint8_t* client = reinterpret_cast<const uint8_t*>(&clientAddress);
+    const uint8_t* server = reinterpret_cast<const uint8_t*>(&serverAddress);
+    FixedString sdp(videoArena, 192);
+    sdp.appendFormat("v=0\r\no=- 0 0 IN IP4 %u.%u.%u.%u\r\ns=Drone camera\r\nc=IN IP4 %u.%u.%u.%u\r\nt=0 0\r\n"
+                     "m=video %u RTP/AVP %u\r\na=rtpmap:%u JPEG/%u\r\na=recvonly\r\n",
+                     server[0], server[1], server[2], server[3], client[0], client[1], client[2], client[3],
+                     unsigned(port), unsigned(RTP_JPEG_PAYLOAD_TYPE), unsigned(RTP_JPEG_PAYLOAD_TYPE), unsigned(RTP_CLOCK_RATE_HZ));
+    httpd_resp_set_type(req, "application/sdp");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, sdp.c_str(), sdp.length());
+}
+
 ServerManager::ServerManager() {
     DEBUG_PRINT("--- Init Servers called");
     connectionUri = {
@@ -218,16 +1437,23 @@ ServerManager::ServerManager() {
         .user_ctx = nullptr
     };
 
+    setSettingsUri = {
+        .uri = "/set",
+        .method = HTTP_POST,
+        .handler = setSettingsHandler,
+        .user_ctx = nullptr
+    };
+
     setWiFiUri = {
         .uri = "/wif",
-        .method = HTTP_GET,
+        .method = HTTP_POST,
         .handler = setWiFiHandler,
         .user_ctx = nullptr
     };
 
     setLedUri = {
         .uri = "/led",
-        .method = HTTP_GET,
+        .method = HTTP_POST,
         .handler = setLedHandler,
         .user_ctx = nullptr
     };
@@ -239,6 +1465,97 @@ ServerManager::ServerManager() {
         .user_ctx = nullptr
     };
 
+    setModeUri = {
+        .uri = "/mod",
+        .method = HTTP_GET,
+        .handler = setModeHandler,
+        .user_ctx = nullptr
+    };
+
+    sessionStatsUri = {
+        .uri = "/sst",
+        .method = HTTP_GET,
+        .handler = sessionStatsHandler,
+        .user_ctx = nullptr
+    };
+
+    telemetryUri = {
+        .uri = "/tlm",
+        .method = HTTP_GET,
+        .handler = telemetryHandler,
+        .user_ctx = nullptr
+    };
+
+    logUri = {
+        .uri = "/log",
+        .method = HTTP_GET,
+        .handler = logHandler,
+        .user_ctx = nullptr
+    };
+
+    traceUri = {
+        .uri = "/trc",
+        .method = HTTP_GET,
+        .handler = traceHandler,
+        .user_ctx = nullptr
+    };
+
+    cameraUri = {
+        .uri = "/cam",
+        .method = HTTP_GET,
+        .handler = cameraHandler,
+        .user_ctx = nullptr
+    };
+
+    visionUri = {
+        .uri = "/vis",
+        .method = HTTP_GET,
+        .handler = visionHandler,
+        .user_ctx = nullptr
+    };
+
+    lineFollowUri = {
+        .uri = "/lfw",
+        .method = HTTP_GET,
+        .handler = lineFollowHandler,
+        .user_ctx = nullptr
+    };
+
+    photoUri = {
+        .uri = "/pic",
+        .method = HTTP_GET,
+        .handler = photoHandler,
+        .user_ctx = nullptr
+    };
+
+    dashcamUri = {
+        .uri = "/rec",
+        .method = HTTP_GET,
+        .handler = dashcamHandler,
+        .user_ctx = nullptr
+    };
+
+    flightRecorderUri = {
+        .uri = "/flt",
+        .method = HTTP_GET,
+        .handler = flightRecorderHandler,
+        .user_ctx = nullptr
+    };
+
+    controlJitterUri = {
+        .uri = "/jit",
+        .method = HTTP_GET,
+        .handler = controlJitterHandler,
+        .user_ctx = nullptr
+    };
+
+    clockSyncUri = {
+        .uri = "/syn",
+        .method = HTTP_GET,
+        .handler = clockSyncHandler,
+        .user_ctx = nullptr
+    };
+
     // Video Server -------------------------------------------------------------
     streamUri = {
         .uri = "/str",
@@ -246,6 +1563,36 @@ ServerManager::ServerManager() {
         .handler = streamHandler,
         .user_ctx = nullptr
     };
+
+    snapshotUri = {
+        .uri = "/jpg",
+        .method = HTTP_GET,
+        .handler = snapshotHandler,
+        .user_ctx = nullptr
+    };
+
+    rtpUri = {
+        .uri = "/rtp",
+        .method = HTTP_GET,
+        .handler = rtpHandler,
+        .user_ctx = nullptr
+    };
+
+    stillUri = {
+        .uri = "/stl",
+        .method = HTTP_GET,
+        .handler = stillHandler,
+        .user_ctx = nullptr
+    };
+
+    dashcamDownloadUri = {
+        .uri = "/dcm",
+        .method = HTTP_GET,
+        .handler = dashcamDownloadHandler,
+        .user_ctx = nullptr
+    };
+
+    clockSyncMutex = xSemaphoreCreateMutex();
     DEBUG_PRINT("Servers inited ---");
 }
 
@@ -254,33 +1601,117 @@ static httpd_handle_t commandServer = nullptr;
 static httpd_handle_t videoServer = nullptr;
 
 void ServerManager::startServers() {
-    DEBUG_PRINT("--- Starting servers");
+    startCommandServer();
+    startVideoServer();
+}
+
+void ServerManager::stopServers() {
+    stopVideoServer();
+    stopCommandServer();
+}
+
+void ServerManager::startCommandServer() {
+    if (commandServer) { return; } // Already running
+    DEBUG_PRINT("--- Starting command server");
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.server_port = 80;
+    config.server_port = COMMAND_SERVER_PORT;
+    config.max_uri_handlers = COMMAND_SERVER_MAX_URI_HANDLERS;
+    // Persistent sessions: the controllers keep one connection open and send every request on it
+    config.max_open_sockets = COMMAND_SERVER_MAX_OPEN_SOCKETS;
+    config.lru_purge_enable = true; // A new client is never rejected, the least recently used session is closed instead
+    config.keep_alive_enable = true;
+    config.keep_alive_idle = COMMAND_SERVER_KEEP_ALIVE_IDLE_S;
+    config.keep_alive_interval = COMMAND_SERVER_KEEP_ALIVE_INTERVAL_S;
+    config.keep_alive_count = COMMAND_SERVER_KEEP_ALIVE_COUNT;
+    config.open_fn = onCommandSessionOpen;
     if (httpd_start(&commandServer, &config) == ESP_OK) {
         httpd_register_uri_handler(commandServer, &connectionUri);
         httpd_register_uri_handler(commandServer, &disconnectionUri);
         httpd_register_uri_handler(commandServer, &moveUri);
         httpd_register_uri_handler(commandServer, &getSettingsUri);
+        httpd_register_uri_handler(commandServer, &setSettingsUri);
         httpd_register_uri_handler(commandServer, &setWiFiUri);
         httpd_register_uri_handler(commandServer, &setLedUri);
         httpd_register_uri_handler(commandServer, &setRoomPlantModeUri);
-    } else { DEBUG_PRINT("Failed to start command server"); }
-    config.server_port = 81;
+        httpd_register_uri_handler(commandServer, &setModeUri);
+        httpd_register_uri_handler(commandServer, &sessionStatsUri);
+        httpd_register_uri_handler(commandServer, &telemetryUri);
+        httpd_register_uri_handler(commandServer, &logUri);
+        httpd_register_uri_handler(commandServer, &traceUri);
+        httpd_register_uri_handler(commandServer, &cameraUri);
+        httpd_register_uri_handler(commandServer, &visionUri);
+        httpd_register_uri_handler(commandServer, &lineFollowUri);
+        httpd_register_uri_handler(commandServer, &photoUri);
+        httpd_register_uri_handler(commandServer, &dashcamUri);
+        httpd_register_uri_handler(commandServer, &flightRecorderUri);
+        httpd_register_uri_handler(commandServer, &controlJitterUri);
+        httpd_register_uri_handler(commandServer, &clockSyncUri);
+    } else {
+        commandServer = nullptr;
+        DEBUG_PRINT("Failed to start command server");
+    }
+    DEBUG_PRINT("Command server started ---");
+}
+
+void ServerManager::stopCommandServer() {
+    if (!commandServer) { return; } // Not running
+    TelemetryManager* telemetryManager = TelemetryManager::getInstance();
+    if (telemetryManager) { telemetryManager->stopStream(); } // It sends on a session of the command server
+    httpd_stop(commandServer);
+    commandServer = nullptr;
+    DEBUG_PRINT("Command server stopped");
+}
+
+void ServerManager::startVideoServer() {
+    if (videoServer) { return; } // Already running
+    DEBUG_PRINT("--- Starting video server");
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = VIDEO_SERVER_PORT;
     config.ctrl_port += 1;
+    config.max_open_sockets = VIDEO_SERVER_MAX_OPEN_SOCKETS;
+    isStreamEnabled = true;
     if (httpd_start(&videoServer, &config) == ESP_OK) {
+        SnapshotCache::init();
+        RtpStreamManager::init();
+        VisionManager::resume(); // Reads the snapshot cache
+        DashcamManager::resume();
         esp_err_t vari = httpd_register_uri_handler(videoServer, &streamUri);
+        if (vari == ESP_OK) { vari = httpd_register_uri_handler(videoServer, &snapshotUri); }
+        if (vari == ESP_OK) { vari = httpd_register_uri_handler(videoServer, &rtpUri); }
+        if (vari == ESP_OK) { vari = httpd_register_uri_handler(videoServer, &stillUri); }
+        if (vari == ESP_OK) { vari = httpd_register_uri_handler(videoServer, &dashcamDownloadUri); }
         if (vari != ESP_OK) { DEBUG_PRINT("Failed to register URI handler"); }
-    } else { DEBUG_PRINT("Failed to start video server"); }
-    DEBUG_PRINT("Servers started ---");
+    } else {
+        videoServer = nullptr;
+        DEBUG_PRINT("Failed to start video server");
+    }
+    DEBUG_PRINT("Video server started ---");
+}
+
+void ServerManager::stopVideoServer() {
+    if (!videoServer) { return; } // Not running
+    isStreamEnabled = false; // The stream task ends after the current frame
+    waitForStreamEnd();
+    RtpStreamManager::deinit(); // Stops the RTP stream
+    VisionManager::pause(); // Before the snapshot cache it reads
+    DashcamManager::pause();
+    httpd_stop(videoServer);
+    videoServer = nullptr;
+    SnapshotCache::deinit(); // No request holds a snapshot after httpd_stop
+    DEBUG_PRINT("Video server stopped");
 }
 
+bool ServerManager::isCommandServerRunning() const { return commandServer != nullptr; }
+
+bool ServerManager::isVideoServerRunning() const { return videoServer != nullptr; }
+
 // Deinit server manager ----------------------------------------------------
 ServerManager::~ServerManager() {
     DEBUG_PRINT("--- Deinit Servers called");
-    if (commandServer) { httpd_stop(commandServer); }
-    if (videoServer) { httpd_stop(videoServer); }
-    delete instance;
+    stopServers();
+    clockSync.clear(); // The next operator starts over
+    vSemaphoreDelete(clockSyncMutex);
+    clockSyncMutex = nullptr;
     DEBUG_PRINT("Servers deinited ---");
 }
 
@@ -0,0 +1,60 @@
+/*
+ * File: SettingsJson.cpp
+ * Project: drone_r6_fw
+ * File Created: Wednesday, 5th March 2025 8:05:47 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Wednesday, 5th March 2025 8:05:47 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "SettingsJson.h"
+
+extern "C" {
+#include <string.h>
+}
+
+// Settings JSON ------------------------------------------------------------------------------------------------
+size_t SettingsJson::write(char* buffer, size_t size, const char* ssid, int8_t colorNumber) {
+    JsonWriter writer(buffer, size);
+    writer.beginObject();
+    writer.field("ssid", ssid);
+    writer.field("color", int32_t(colorNumber));
+    writer.endObject();
+    return writer.isOverflow() ? 0 : writer.length();
+}
+
+bool SettingsJson::parse(const char* json, size_t length, uint8_t allowedFields, SettingsUpdate& update) {
+    update.fields = 0;
+    JsonReader reader(json, length);
+    JsonField field;
+    while (reader.nextField(field)) {
+        uint8_t fieldBit;
+        if (strcmp(field.key, "ssid") == 0) { fieldBit = SETTINGS_FIELD_SSID; }
+        else if (strcmp(field.key, "password") == 0) { fieldBit = SETTINGS_FIELD_PASSWORD; }
+        else if (strcmp(field.key, "color") == 0) { fieldBit = SETTINGS_FIELD_COLOR; }
+        else { return false; } // Unknown field
+
+        if (!(allowedFields & fieldBit) || (update.fields & fieldBit)) { return false; } // Not allowed or duplicated
+        update.fields |= fieldBit;
+
+        switch (fieldBit) {
+            case SETTINGS_FIELD_SSID:
+                if (field.type != JSON_STRING || field.string[0] == '\0' || strlen(field.string) > STORAGE_MAX_STRING_LENGTH) { return false; }
+                strcpy(update.ssid, field.string);
+                break;
+            case SETTINGS_FIELD_PASSWORD:
+                if (field.type != JSON_STRING || strlen(field.string) > STORAGE_MAX_STRING_LENGTH) { return false; }
+                strcpy(update.password, field.string);
+                break;
+            case SETTINGS_FIELD_COLOR:
+                if (field.type != JSON_NUMBER || field.number < 0 || field.number > STORAGE_MAX_COLOR_NUMBER) { return false; }
+                update.colorNumber = int8_t(field.number);
+                break;
+        }
+    }
+    return reader.isFinished();
+}
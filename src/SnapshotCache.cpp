@@ -0,0 +1,187 @@
+/*
+ * File: SnapshotCache.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "SnapshotCache.h"
+#include "CameraManager.h"
+#include "Hal.h"
+#include "LogManager.h"
+
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+}
+
+// Init snapshot cache --------------------------------------------------
+SnapshotCache::SnapshotCache() {
+    DEBUG_INIT_START("Snapshot cache");
+    cacheMutex = xSemaphoreCreateMutex();
+    captureMutex = xSemaphoreCreateMutex();
+    current = nullptr;
+    currentTimestampUs = 0;
+    memset(&stats, 0, sizeof(stats));
+    DEBUG_INIT_END("Snapshot cache");
+}
+
+// Frames ---------------------------------------------------------------
+SnapshotFrame* SnapshotCache::createFrame(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height, int64_t timestampUs) {
+    // PSRAM first, like the frame buffers: the internal RAM is kept for the Wi-Fi
+    size_t size = sizeof(SnapshotFrame) + length;
+    void* block = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (!block) { block = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT); }
+    if (!block) { return nullptr; }
+
+    SnapshotFrame* frame = static_cast<SnapshotFrame*>(block);
+    frame->data = reinterpret_cast<uint8_t*>(frame + 1);
+    frame->length = length;
+    frame->width = width;
+    frame->height = height;
+    frame->timestampUs = timestampUs;
+    frame->refCount = 1;
+    memcpy(frame->data, jpeg, length);
+    return frame;
+}
+
+SnapshotFrame* SnapshotCache::acquireCurrentLocked(int64_t maxAgeUs) {
+    if (!current || Hal::Timer::getTimeUs() - current->timestampUs > maxAgeUs) { return nullptr; }
+    current->refCount++;
+    return current;
+}
+
+void SnapshotCache::replaceCurrent(SnapshotFrame* frame) {
+    SnapshotFrame* previous = nullptr;
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    if (current && current->timestampUs >= frame->timestampUs) { // A newer frame came from the other task meanwhile
+        xSemaphoreGive(cacheMutex);
+        return;
+    }
+    frame->refCount++;
+    if (current && --current->refCount == 0) { previous = current; }
+    current = frame;
+    currentTimestampUs.store(frame->timestampUs, std::memory_order_relaxed);
+    xSemaphoreGive(cacheMutex);
+    heap_caps_free(previous); // Outside of the lock, nobody else has it
+}
+
+SnapshotFrame* SnapshotCache::captureFrame() {
+    HalCameraFrame cameraFrame;
+    if (!CameraManager::getStreamFrame(cameraFrame)) {
+        LOG_E(CAMERA, "Camera capture failed");
+        return nullptr;
+    }
+    SnapshotFrame* frame = nullptr;
+    if (cameraFrame.format == HAL_PIXFORMAT_JPEG) {
+        frame = createFrame(cameraFrame.data, cameraFrame.length, cameraFrame.width, cameraFrame.height, cameraFrame.timestampUs);
+    } else {
+        uint8_t* jpeg = nullptr;
+        size_t length = 0;
+        if (Hal::Camera::convertToJpeg(cameraFrame, SNAPSHOT_JPEG_QUALITY, &jpeg, &length)) {
+            frame = createFrame(jpeg, length, cameraFrame.width, cameraFrame.height, cameraFrame.timestampUs);
+            free(jpeg);
+        }
+    }
+    Hal::Camera::returnFrame(cameraFrame); // The frame buffer goes back to the driver right away
+    if (!frame) { LOG_E(CAMERA, "Snapshot copy failed (%u bytes)", unsigned(cameraFrame.length)); }
+    return frame;
+}
+
+esp_err_t SnapshotCache::acquire(uint32_t maxAgeMs, const SnapshotFrame*& frame) {
+    int64_t maxAgeUs = int64_t(maxAgeMs) * 1000;
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    stats.requests++;
+    frame = acquireCurrentLocked(maxAgeUs);
+    if (frame) { stats.hits++; }
+    xSemaphoreGive(cacheMutex);
+    if (frame) { return ESP_OK; }
+
+    // Stale: one request captures, the others wait for the capture mutex and find its frame
+    xSemaphoreTake(captureMutex, portMAX_DELAY);
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    frame = acquireCurrentLocked(maxAgeUs);
+    if (frame) { stats.hits++; }
+    xSemaphoreGive(cacheMutex);
+    if (frame) {
+        xSemaphoreGive(captureMutex);
+        return ESP_OK;
+    }
+
+    SnapshotFrame* captured = captureFrame();
+    if (captured) { replaceCurrent(captured); } // The request keeps the reference of createFrame()
+    xSemaphoreGive(captureMutex);
+
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    if (captured) { stats.captures++; } else { stats.failures++; }
+    xSemaphoreGive(cacheMutex);
+    frame = captured;
+    return captured ? ESP_OK : ESP_FAIL;
+}
+
+void SnapshotCache::release(const SnapshotFrame* frame) {
+    if (!frame) { return; }
+    SnapshotFrame* released = const_cast<SnapshotFrame*>(frame);
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    bool isLast = --released->refCount == 0;
+    xSemaphoreGive(cacheMutex);
+    if (isLast) { heap_caps_free(released); }
+}
+
+bool SnapshotCache::isPublishDue(int64_t timestampUs) const {
+    return timestampUs - currentTimestampUs.load(std::memory_order_relaxed) >= int64_t(SNAPSHOT_PUBLISH_INTERVAL_MS) * 1000;
+}
+
+void SnapshotCache::publish(const uint8_t* jpeg, size_t length, uint16_t width, uint16_t height, int64_t timestampUs) {
+    SnapshotFrame* frame = createFrame(jpeg, length, width, height, timestampUs);
+    if (frame) { replaceCurrent(frame); }
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    if (frame) { stats.publishes++; } else { stats.failures++; }
+    xSemaphoreGive(cacheMutex);
+    release(frame); // The cache keeps its own reference
+}
+
+SnapshotCacheStats SnapshotCache::getStats() {
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    SnapshotCacheStats copy = stats;
+    xSemaphoreGive(cacheMutex);
+    return copy;
+}
+
+// Deinit snapshot cache ------------------------------------------------
+SnapshotCache::~SnapshotCache() {
+    DEBUG_DEINIT_START("Snapshot cache");
+    // The video server is stopped: no request holds a frame
+    if (current && --current->refCount == 0) { heap_caps_free(current); }
+    current = nullptr;
+    vSemaphoreDelete(captureMutex);
+    vSemaphoreDelete(cacheMutex);
+    DEBUG_DEINIT_END("Snapshot cache");
+}
+
+// Singleton ------------------------------------------------------------
+SnapshotCache* SnapshotCache::instance = nullptr;
+
+void SnapshotCache::init() {
+    if (instance == nullptr) {
+        instance = new SnapshotCache();
+        return;
+    }
+    DEBUG_INIT_NO_NEED("Snapshot cache");
+}
+
+void SnapshotCache::deinit() {
+    if (instance) {
+        delete instance;
+        instance = nullptr;
+        return;
+    }
+    DEBUG_DEINIT_NO_NEED("Snapshot cache");
+}
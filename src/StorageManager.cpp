@@ -13,6 +13,10 @@
 
 #include "StorageManager.h"
 
+extern "C" {
+#include <string.h>
+}
+
 // Storage manager ---------------------------------------------------------------------
 // Init storage ---------------------------------------------------------
 StorageManager::StorageManager() {
@@ -20,18 +24,20 @@ StorageManager::StorageManager() {
     // Init datas
     WiFiSSID = "";
     WiFiPassword = "";
+    WiFiSSID.reserve(STORAGE_MAX_STRING_LENGTH); // The setters never allocate afterwards
+    WiFiPassword.reserve(STORAGE_MAX_STRING_LENGTH);
     ColorNumber = 0;
 
     // Init NVS
-    esp_err_t err = nvs_flash_init();
+    esp_err_t err = Hal::Storage::init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        err = nvs_flash_init();
+        ESP_ERROR_CHECK(Hal::Storage::erase());
+        err = Hal::Storage::init();
         ESP_ERROR_CHECK(err);
     }
     
     // Open NVS
-    nvsHandle = nvs::open_nvs_handle("storage_manager", NVS_READWRITE, &err);
+    err = Hal::Storage::open("storage_manager", &storageHandle);
     ESP_ERROR_CHECK(err);
 
     DEBUG_INIT_END("Storage manager");
@@ -40,33 +46,27 @@ StorageManager::StorageManager() {
 // Storage management ---------------------------------------------------
 // Get data from storage ------------------------------------------------
 void StorageManager::getWifiSSIDDataFromStorage() {
-    size_t dataSize;
-    esp_err_t err = nvsHandle->get_item_size(nvs::ItemType::SZ, "WIFI_SSID", dataSize);
-    char *WiFiSSIDData = new char[dataSize];
-    err = nvsHandle->get_string("WIFI_SSID", WiFiSSIDData, dataSize);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
+    char WiFiSSIDData[STORAGE_MAX_STRING_LENGTH + 1]; // The setter never stores longer strings
+    esp_err_t err = Hal::Storage::getString(storageHandle, "WIFI_SSID", WiFiSSIDData, sizeof(WiFiSSIDData));
+    if (err != ESP_OK) {
         WiFiSSID = WIFI_SSID;
         return;
     }
     WiFiSSID = WiFiSSIDData;
-    delete[] WiFiSSIDData;
 }
 
 void StorageManager::getWifiPasswordDataFromStorage() {
-    size_t dataSize;
-    esp_err_t err = nvsHandle->get_item_size(nvs::ItemType::SZ, "WIFI_PASSWORD", dataSize);
-    char *WiFiPasswordData = new char[dataSize];
-    err = nvsHandle->get_string("WIFI_PASSWORD", WiFiPasswordData, dataSize);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
+    char WiFiPasswordData[STORAGE_MAX_STRING_LENGTH + 1]; // The setter never stores longer strings
+    esp_err_t err = Hal::Storage::getString(storageHandle, "WIFI_PASSWORD", WiFiPasswordData, sizeof(WiFiPasswordData));
+    if (err != ESP_OK) {
         WiFiPassword = WIFI_PASSWORD;
         return;
     }
     WiFiPassword = WiFiPasswordData;
-    delete[] WiFiPasswordData;
 }
 
 void StorageManager::getColorDataFromStorage() {
-    esp_err_t err = nvsHandle->get_item("COLOR_NUMBER", ColorNumber);
+    esp_err_t err = Hal::Storage::getI8(storageHandle, "COLOR_NUMBER", &ColorNumber);
     if (err == ESP_ERR_NVS_NOT_FOUND) {
         ColorNumber = 0;
         return;
@@ -75,31 +75,34 @@ void StorageManager::getColorDataFromStorage() {
 
 // Commit data to storage ------------------------------------------------
 void StorageManager::commitWifiSSIDDataToStorage() {
-    esp_err_t err = nvsHandle->set_string("WIFI_SSID", WiFiSSID.c_str());
+    esp_err_t err = Hal::Storage::setString(storageHandle, "WIFI_SSID", WiFiSSID.c_str());
     ESP_ERROR_CHECK(err);
+    ESP_ERROR_CHECK(Hal::Storage::commit(storageHandle));
 }
 
 void StorageManager::commitWifiPasswordDataToStorage() {
-    esp_err_t err = nvsHandle->set_string("WIFI_PASSWORD", WiFiPassword.c_str());
+    esp_err_t err = Hal::Storage::setString(storageHandle, "WIFI_PASSWORD", WiFiPassword.c_str());
     ESP_ERROR_CHECK(err);
+    ESP_ERROR_CHECK(Hal::Storage::commit(storageHandle));
 }
 
 void StorageManager::commitColorDataToStorage() {
-    esp_err_t err = nvsHandle->set_item("COLOR_NUMBER", ColorNumber);
+    esp_err_t err = Hal::Storage::setI8(storageHandle, "COLOR_NUMBER", ColorNumber);
     ESP_ERROR_CHECK(err);
+    ESP_ERROR_CHECK(Hal::Storage::commit(storageHandle));
 }
 
 // Set data ------------------------------------------------------------
-void StorageManager::setWiFiSSID(const std::string ssid) {
-    if (ssid.length() > 30) {
+void StorageManager::setWiFiSSID(const char* ssid) {
+    if (strlen(ssid) > STORAGE_MAX_STRING_LENGTH) {
         return;
     }
     WiFiSSID = ssid;
     commitWifiSSIDDataToStorage();
 }
 
-void StorageManager::setWiFiPassword(const std::string password) {
-    if (password.length() > 30) {
+void StorageManager::setWiFiPassword(const char* password) {
+    if (strlen(password) > STORAGE_MAX_STRING_LENGTH) {
         return;
     }
     WiFiPassword = password;
@@ -136,7 +139,7 @@ void StorageManager::resetMemoryToDefault() {
 // Deinit storage -------------------------------------------------------
 StorageManager::~StorageManager() {
     DEBUG_DEINIT_START("Storage manager");
-    nvsHandle.reset();
+    Hal::Storage::close(storageHandle);
     DEBUG_DEINIT_END("Storage manager");
 }
 
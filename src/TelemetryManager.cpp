@@ -0,0 +1,257 @@
+/*
+ * File: TelemetryManager.cpp
+ * Project: drone_r6_fw
+ * File Created: Thursday, 6th March 2025 7:12:44 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Thursday, 6th March 2025 7:12:44 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "TelemetryManager.h"
+#include "ModeManager.h"
+#include "ResourceManager.h"
+#include "ServerManager.h"
+#include "VisionManager.h"
+
+extern "C" {
+#include <string.h>
+#include "esp_heap_caps.h"
+}
+
+// Init telemetry manager -----------------------------------------------
+TelemetryManager::TelemetryManager() {
+    DEBUG_INIT_START("Telemetry manager");
+    sequence = 0;
+    lastSampleUs = 0;
+    lastStreamFrames = 0;
+    lastStreamBytes = 0;
+    lastTaskCount = 0;
+    lastTotalRunTime = 0;
+    isStreamEnabled = false;
+    isStreamRunning = false;
+    streamWakeSemaphore = xSemaphoreCreateBinary();
+    streamRequest = nullptr;
+    streamRateHz = TELEMETRY_DEFAULT_RATE_HZ;
+    DEBUG_INIT_END("Telemetry manager");
+}
+
+// Counters -------------------------------------------------------------
+uint32_t TelemetryManager::ratePerSecond(uint32_t delta, int64_t elapsedUs, uint32_t scale) {
+    if (elapsedUs <= 0) { return 0; }
+    uint64_t rate = uint64_t(delta) * scale * 1000000ULL / uint64_t(elapsedUs);
+    return rate > UINT32_MAX ? UINT32_MAX : uint32_t(rate);
+}
+
+// Frames ---------------------------------------------------------------
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+static TaskStatus_t taskStatuses[TELEMETRY_MAX_SYSTEM_TASKS]; // Too big for the stream task stack, only the stream task uses it
+#endif
+
+uint8_t TelemetryManager::sampleTasks(TelemetryTaskEntry* entries) {
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+    configRUN_TIME_COUNTER_TYPE totalRunTime = 0;
+    UBaseType_t taskCount = uxTaskGetSystemState(taskStatuses, TELEMETRY_MAX_SYSTEM_TASKS, &totalRunTime);
+    if (taskCount == 0) { return 0; } // More tasks than TELEMETRY_MAX_SYSTEM_TASKS
+
+    // The run time counters wrap around (32 bit microseconds), only the differences are used
+    uint32_t elapsed = uint32_t(totalRunTime) - lastTotalRunTime;
+    bool hasPreviousSample = lastTaskCount > 0 && elapsed > 0;
+    uint8_t entryCount = 0;
+    for (UBaseType_t i = 0; i < taskCount; i++) {
+        uint32_t runTime = uint32_t(taskStatuses[i].ulRunTimeCounter);
+        uint16_t cpuPermille = 0;
+        for (uint8_t j = 0; hasPreviousSample && j < lastTaskCount; j++) {
+            if (lastTaskNumbers[j] == taskStatuses[i].xTaskNumber) {
+                uint64_t permille = uint64_t(runTime - lastTaskRunTimes[j]) * 1000 / elapsed;
+                cpuPermille = permille > 1000 ? 1000 : uint16_t(permille);
+                break;
+            }
+        }
+
+        // Insert by CPU usage, only the busiest TELEMETRY_MAX_TASKS are kept
+        uint8_t position = entryCount;
+        while (position > 0 && entries[position - 1].cpuPermille < cpuPermille) { position--; }
+        if (position >= TELEMETRY_MAX_TASKS) { continue; }
+        if (entryCount < TELEMETRY_MAX_TASKS) { entryCount++; }
+        memmove(&entries[position + 1], &entries[position], (entryCount - 1 - position) * sizeof(TelemetryTaskEntry));
+        size_t nameLength = strnlen(taskStatuses[i].pcTaskName, TELEMETRY_TASK_NAME_LENGTH);
+        memset(entries[position].name, 0, TELEMETRY_TASK_NAME_LENGTH);
+        memcpy(entries[position].name, taskStatuses[i].pcTaskName, nameLength); // Not zero terminated if it is truncated
+        entries[position].cpuPermille = cpuPermille;
+        uint32_t stackHighWaterMark = taskStatuses[i].usStackHighWaterMark;
+        entries[position].stackHighWaterMark = stackHighWaterMark > UINT16_MAX ? UINT16_MAX : uint16_t(stackHighWaterMark);
+    }
+
+    for (UBaseType_t i = 0; i < taskCount; i++) {
+        lastTaskNumbers[i] = taskStatuses[i].xTaskNumber;
+        lastTaskRunTimes[i] = uint32_t(taskStatuses[i].ulRunTimeCounter);
+    }
+    lastTaskCount = uint8_t(taskCount);
+    lastTotalRunTime = uint32_t(totalRunTime);
+    return entryCount;
+#else
+    return 0; // The run time stats are disabled in the sdkconfig
+#endif
+}
+
+size_t TelemetryManager::sampleFrame(TelemetryFrame& frame) {
+    int64_t nowUs = Hal::Timer::getTimeUs();
+    uint32_t nowMs = uint32_t(nowUs / 1000);
+    TelemetryFrameHeader& header = frame.header;
+    header.magic = TELEMETRY_FRAME_MAGIC;
+    header.version = TELEMETRY_FRAME_VERSION;
+    header.sequence = sequence++;
+    header.uptimeMs = nowMs;
+
+    // Motors and control
+    uint32_t duties = motorDuties.load(std::memory_order_relaxed);
+    header.leftMotorDuty = int16_t(uint16_t(duties));
+    header.rightMotorDuty = int16_t(uint16_t(duties >> 16));
+    uint32_t controlDataMs = controlDataAtMs.load(std::memory_order_relaxed);
+    header.controlDataAgeMs = controlDataMs ? nowMs - controlDataMs : TELEMETRY_NO_CONTROL_DATA;
+
+    // Stream (the first frame has no previous sample, its rates are 0)
+    uint32_t frames = streamFrames.load(std::memory_order_relaxed);
+    uint32_t bytes = streamBytes.load(std::memory_order_relaxed);
+    int64_t elapsedUs = lastSampleUs ? nowUs - lastSampleUs : 0;
+    uint32_t fpsX10 = ratePerSecond(frames - lastStreamFrames, elapsedUs, 10);
+    header.cameraFpsX10 = fpsX10 > UINT16_MAX ? UINT16_MAX : uint16_t(fpsX10);
+    header.streamBytesPerSec = ratePerSecond(bytes - lastStreamBytes, elapsedUs);
+    lastSampleUs = nowUs;
+    lastStreamFrames = frames;
+    lastStreamBytes = bytes;
+
+    // System
+    int8_t rssi = 0;
+    header.rssi = Hal::WiFi::getRssi(&rssi) == ESP_OK ? rssi : 0;
+    ModeManager* modeManager = ModeManager::getInstance();
+    header.mode = uint8_t(modeManager ? modeManager->getMode() : DroneMode::SHUTDOWN);
+    header.freeInternalHeap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    header.minFreeInternalHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    header.freePsramHeap = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    header.largestFreeInternalBlock = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+    header.largestFreePsramBlock = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+    header.resourceAlarms = ResourceManager::getActiveAlarms();
+
+    // Odometry
+    VisionOdometry odometry = VisionManager::getOdometry();
+    header.forwardSpeedMmPerS = odometry.forwardMmPerS;
+    header.yawRateDeciDegPerS = odometry.yawRateDeciDegPerS;
+    header.odometryBlocks = odometry.flowBlocks;
+
+    // Clock sync
+    ClockSyncStats clockSync = ServerManager::getClockSyncStats();
+    header.clockOffsetUs = clockSync.offsetUs;
+    header.clockRttUs = clockSync.rttUs;
+    memcpy(header.clockRttHistogram, clockSync.rttHistogram, sizeof(header.clockRttHistogram));
+    memcpy(header.clockOffsetHistogram, clockSync.offsetHistogram, sizeof(header.clockOffsetHistogram));
+
+    header.taskCount = sampleTasks(frame.tasks);
+    header.length = uint16_t(sizeof(TelemetryFrameHeader) + header.taskCount * sizeof(TelemetryTaskEntry));
+    return header.length;
+}
+
+// Stream ---------------------------------------------------------------
+void TelemetryManager::taskTelemetryStream(void *pvParameters) {
+    TelemetryManager* telemetryManager = static_cast<TelemetryManager*>(pvParameters);
+    httpd_req_t* req = telemetryManager->streamRequest;
+    TickType_t period = pdMS_TO_TICKS(1000 / telemetryManager->streamRateHz);
+    if (period == 0) { period = 1; }
+    TelemetryFrame frame;
+    esp_err_t res = ESP_OK;
+
+    TickType_t nextFrameAt = xTaskGetTickCount();
+    while (telemetryManager->isStreamEnabled) {
+        size_t length = telemetryManager->sampleFrame(frame);
+        res = httpd_resp_send_chunk(req, reinterpret_cast<const char*>(&frame), length);
+        if (res != ESP_OK) { break; } // The client is gone
+
+        // Wait for the next frame, stopStream() wakes the task up earlier
+        nextFrameAt += period;
+        TickType_t now = xTaskGetTickCount();
+        if (TickType_t(nextFrameAt - now) > period) { nextFrameAt = now + period; } // Late (slow client), do not send a burst to catch up
+        xSemaphoreTake(telemetryManager->streamWakeSemaphore, nextFrameAt - now);
+    }
+    if (res == ESP_OK) { httpd_resp_send_chunk(req, nullptr, 0); } // End of the chunked response
+    httpd_req_async_handler_complete(req);
+    DEBUG_PRINT("Telemetry stream ended");
+
+    telemetryManager->streamRequest = nullptr;
+    telemetryManager->isStreamRunning = false;
+    vTaskDelete(NULL);
+}
+
+esp_err_t TelemetryManager::startStream(httpd_req_t *req, int rateHz) {
+    if (isStreamRunning) { return ESP_ERR_INVALID_STATE; } // Only one stream at a time
+
+    httpd_req_t* asyncRequest = nullptr;
+    esp_err_t res = httpd_req_async_handler_begin(req, &asyncRequest);
+    if (res != ESP_OK) { return res; }
+    httpd_resp_set_type(asyncRequest, "application/octet-stream");
+    httpd_resp_set_hdr(asyncRequest, "Cache-Control", "no-store");
+
+    if (rateHz < TELEMETRY_MIN_RATE_HZ) { rateHz = TELEMETRY_MIN_RATE_HZ; }
+    if (rateHz > TELEMETRY_MAX_RATE_HZ) { rateHz = TELEMETRY_MAX_RATE_HZ; }
+    streamRateHz = uint8_t(rateHz);
+    streamRequest = asyncRequest;
+    sequence = 0;
+    lastSampleUs = 0;
+    lastTaskCount = 0;
+    xSemaphoreTake(streamWakeSemaphore, 0); // Clear a wake up of the previous stream
+    isStreamEnabled = true;
+    isStreamRunning = true;
+
+    // Core 0 with the Wi-Fi, the motor loop runs on core 1
+    if (xTaskCreatePinnedToCore(&taskTelemetryStream, "TELEMETRY", TELEMETRY_STREAM_STACK_SIZE, this,
+                                TELEMETRY_STREAM_PRIORITY, nullptr, 0) != pdPASS) {
+        isStreamEnabled = false;
+        isStreamRunning = false;
+        streamRequest = nullptr;
+        httpd_req_async_handler_complete(asyncRequest);
+        return ESP_ERR_NO_MEM;
+    }
+    DEBUG_PRINT("Telemetry stream started at %d Hz", rateHz);
+    return ESP_OK;
+}
+
+void TelemetryManager::stopStream() {
+    if (!isStreamRunning) { return; } // Not running
+    isStreamEnabled = false;
+    xSemaphoreGive(streamWakeSemaphore);
+    for (uint16_t waitedMs = 0; isStreamRunning && waitedMs < TELEMETRY_STOP_TIMEOUT_MS; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (isStreamRunning) { DEBUG_PRINT("Telemetry stream did not stop in time"); }
+}
+
+// Deinit telemetry manager ---------------------------------------------
+TelemetryManager::~TelemetryManager() {
+    DEBUG_DEINIT_START("Telemetry manager");
+    stopStream();
+    if (!isStreamRunning) { vSemaphoreDelete(streamWakeSemaphore); } // The task may still use it after a timeout
+    DEBUG_DEINIT_END("Telemetry manager");
+}
+
+// Singleton ------------------------------------------------------------
+TelemetryManager* TelemetryManager::instance = nullptr;
+
+void TelemetryManager::init() {
+    if (instance == nullptr) {
+        instance = new TelemetryManager();
+        return;
+    }
+    DEBUG_INIT_NO_NEED("Telemetry manager");
+}
+
+void TelemetryManager::deinit() {
+    if (instance) {
+        delete instance;
+        instance = nullptr;
+        return;
+    }
+    DEBUG_DEINIT_NO_NEED("Telemetry manager");
+}
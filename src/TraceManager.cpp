@@ -0,0 +1,253 @@
+/*
+ * File: TraceManager.cpp
+ * Project: drone_r6_fw
+ * File Created: Sunday, 9th March 2025 2:14:36 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Sunday, 9th March 2025 2:14:36 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "TraceManager.h"
+
+extern "C" {
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#include "esp_ipc.h"
+#include "esp_rom_sys.h"
+#endif
+}
+
+#define TRACE_CALIBRATION_ROUNDS    8
+
+// Init trace manager ---------------------------------------------------
+TraceManager::TraceManager() {
+    DEBUG_INIT_START("Trace manager");
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+#ifdef ESP_PLATFORM
+        // PSRAM first, the internal RAM is kept for the Wi-Fi and the DMA buffers
+        void* ring = heap_caps_calloc(TRACE_RING_SIZE, sizeof(TraceEvent), MALLOC_CAP_SPIRAM);
+        if (!ring) { ring = heap_caps_calloc(TRACE_RING_SIZE, sizeof(TraceEvent), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT); }
+#else
+        void* ring = calloc(TRACE_RING_SIZE, sizeof(TraceEvent));
+#endif
+        if (!ring) { DEBUG_PRINT("Trace ring allocation failed (core %u)", core); }
+        writePositions[core].store(0, std::memory_order_relaxed);
+        rings[core] = static_cast<TraceEvent*>(ring);
+    }
+    calibrateCoreOffsets();
+    DEBUG_INIT_END("Trace manager");
+}
+
+// Clock ----------------------------------------------------------------
+#if defined(ESP_PLATFORM) && !CONFIG_FREERTOS_UNICORE
+static void readCycleCount(void* arg) { // Runs on the other core (IPC task)
+    *static_cast<uint32_t*>(arg) = esp_cpu_get_cycle_count();
+}
+#endif
+
+void TraceManager::calibrateCoreOffsets() {
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) { coreOffsets[core] = 0; }
+#if defined(ESP_PLATFORM) && !CONFIG_FREERTOS_UNICORE
+    // The other core reads its counter between two reads of this core, the round trip with the shortest time is used
+    uint8_t currentCore = uint8_t(xPortGetCoreID());
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        if (core == currentCore) { continue; }
+        uint32_t bestRoundTrip = UINT32_MAX;
+        for (uint8_t round = 0; round < TRACE_CALIBRATION_ROUNDS; round++) {
+            uint32_t remote = 0;
+            uint32_t before = esp_cpu_get_cycle_count();
+            if (esp_ipc_call_blocking(core, readCycleCount, &remote) != ESP_OK) { break; }
+            uint32_t after = esp_cpu_get_cycle_count();
+            if (after - before < bestRoundTrip) {
+                bestRoundTrip = after - before;
+                coreOffsets[core] = remote - (before + (after - before) / 2);
+            }
+        }
+    }
+    // Core 0 is the reference
+    uint32_t reference = coreOffsets[0];
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) { coreOffsets[core] -= reference; }
+    DEBUG_PRINT("Trace core offsets: %ld cycles", (long)int32_t(coreOffsets[portNUM_PROCESSORS - 1]));
+#endif
+}
+
+uint32_t TraceManager::ticksPerUs() {
+#ifdef ESP_PLATFORM
+    return esp_rom_get_cpu_ticks_per_us();
+#else
+    return TRACE_HOST_TICKS_PER_US;
+#endif
+}
+
+// Ring -----------------------------------------------------------------
+void TraceManager::record(const char* name, uint32_t startTicks, uint32_t endTicks) {
+    uint8_t core = uint8_t(xPortGetCoreID());
+    TraceEvent* ring = rings[core];
+    if (!ring) { return; } // Not initialized
+    uint32_t position = writePositions[core].fetch_add(1, std::memory_order_relaxed);
+    TraceEvent& event = ring[position & (TRACE_RING_SIZE - 1)];
+    event.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name = name;
+    event.task = xTaskGetCurrentTaskHandle();
+    event.startTicks = startTicks;
+    event.durationTicks = endTicks - startTicks;
+    event.sequence.store(position + 1, std::memory_order_release);
+}
+
+bool TraceManager::readSpan(uint8_t core, uint32_t position, TraceSpanRecord& record) {
+    TraceEvent* ring = rings[core];
+    if (!ring) { return false; }
+    TraceEvent& event = ring[position & (TRACE_RING_SIZE - 1)];
+    if (event.sequence.load(std::memory_order_acquire) != position + 1) { return false; } // Overwritten or not finished
+    record.name = event.name;
+    record.task = event.task;
+    record.startTicks = event.startTicks;
+    record.durationTicks = event.durationTicks;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return event.sequence.load(std::memory_order_relaxed) == position + 1;
+}
+
+// Export ---------------------------------------------------------------
+namespace {
+    struct ExportWriter {
+        char buffer[TRACE_EXPORT_BUFFER_SIZE];
+        size_t length;
+        void (*output)(const char* data, size_t length, void* context);
+        void* context;
+
+        void flush() {
+            if (length > 0) { output(buffer, length, context); }
+            length = 0;
+        }
+
+        void print(const char* format, ...) {
+            char line[160];
+            va_list args;
+            va_start(args, format);
+            int written = vsnprintf(line, sizeof(line), format, args);
+            va_end(args);
+            if (written < 0) { return; }
+            size_t lineLength = size_t(written) < sizeof(line) ? size_t(written) : sizeof(line) - 1;
+            if (length + lineLength > sizeof(buffer)) { flush(); }
+            memcpy(buffer + length, line, lineLength);
+            length += lineLength;
+        }
+    };
+
+    void copyName(char* output, size_t size, const char* name) { // Task names in JSON strings (no escaping needed)
+        size_t length = 0;
+        for (; name && *name && length < size - 1; name++) {
+            if (*name >= ' ' && *name != '"' && *name != '\\') { output[length++] = *name; }
+        }
+        output[length] = '\0';
+    }
+}
+
+uint32_t TraceManager::exportChromeTrace(void (*output)(const char* data, size_t length, void* context), void* context) {
+    ExportWriter writer;
+    writer.length = 0;
+    writer.output = output;
+    writer.context = context;
+    uint32_t nowTicks = now();
+    uint32_t tickRate = ticksPerUs();
+
+    // The first pass finds the oldest span, the timestamps start from it
+    uint32_t maxAge = 0;
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t end = getWritePosition(core);
+        uint32_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+        for (uint32_t position = begin; position < end; position++) {
+            TraceSpanRecord record;
+            if (!readSpan(core, position, record)) { continue; }
+            uint32_t age = nowTicks - record.startTicks;
+            if (age < 0x80000000u && age > maxAge) { maxAge = age; }
+        }
+    }
+
+    writer.print("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"ticks_per_us\":%lu},\"traceEvents\":[\n", (unsigned long)tickRate);
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        writer.print("%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"Core %u\"}}\n", core ? "," : "", core, core);
+    }
+#if configUSE_TRACE_FACILITY == 1
+    UBaseType_t taskCount = uxTaskGetSystemState(taskStatuses, TRACE_MAX_TASKS, nullptr);
+    for (UBaseType_t i = 0; i < taskCount; i++) {
+        char name[configMAX_TASK_NAME_LEN + 1];
+        copyName(name, sizeof(name), taskStatuses[i].pcTaskName);
+        for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) { // A task can run on both cores
+            writer.print(",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}\n",
+                         core, (unsigned long)uint32_t(uintptr_t(taskStatuses[i].xHandle)), name);
+        }
+    }
+#endif
+
+    uint32_t spanCount = 0;
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t end = getWritePosition(core);
+        uint32_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+        for (uint32_t position = begin; position < end; position++) {
+            TraceSpanRecord record;
+            if (!readSpan(core, position, record)) { continue; }
+            uint32_t age = nowTicks - record.startTicks;
+            if (age > maxAge) { continue; } // Started after the first pass, or older than half of the counter range
+            uint32_t timestamp = maxAge - age;
+            char name[32];
+            copyName(name, sizeof(name), record.name);
+            writer.print(",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%lu,\"ts\":%lu.%03lu,\"dur\":%lu.%03lu}\n",
+                         name, core, (unsigned long)uint32_t(uintptr_t(record.task)),
+                         (unsigned long)(timestamp / tickRate), (unsigned long)(timestamp % tickRate * 1000 / tickRate),
+                         (unsigned long)(record.durationTicks / tickRate), (unsigned long)(record.durationTicks % tickRate * 1000 / tickRate));
+            spanCount++;
+        }
+    }
+    writer.print("]}\n");
+    writer.flush();
+    return spanCount;
+}
+
+// Deinit trace manager -------------------------------------------------
+TraceManager::~TraceManager() {
+    DEBUG_DEINIT_START("Trace manager");
+    TraceEvent* oldRings[portNUM_PROCESSORS];
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        oldRings[core] = rings[core];
+        rings[core] = nullptr; // record() stops using it
+    }
+    vTaskDelay(pdMS_TO_TICKS(20)); // Let a record() in progress finish
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+#ifdef ESP_PLATFORM
+        heap_caps_free(oldRings[core]);
+#else
+        free(oldRings[core]);
+#endif
+    }
+    DEBUG_DEINIT_END("Trace manager");
+}
+
+// Singleton ------------------------------------------------------------
+TraceManager* TraceManager::instance = nullptr;
+
+void TraceManager::init() {
+    if (instance == nullptr) {
+        instance = new TraceManager();
+        return;
+    }
+    DEBUG_INIT_NO_NEED("Trace manager");
+}
+
+void TraceManager::deinit() {
+    if (instance) {
+        delete instance;
+        instance = nullptr;
+        return;
+    }
+    DEBUG_DEINIT_NO_NEED("Trace manager");
+}
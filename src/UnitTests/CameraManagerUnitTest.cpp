@@ -0,0 +1,168 @@
+/*
+ * File: CameraManagerUnitTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "UnitTests.h"
+
+#ifdef UNIT_TESTS
+
+#define CAMERA_TEST_FRAMES          (CAMERA_FB_COUNT * 4)   // Every frame buffer is used a few times
+#define CAMERA_FRAME_MAX_US         200000                  // VGA JPEG at 20 MHz XCLK: 25 fps, the first frame is slower (not measured)
+#define CAMERA_VGA_WIDTH            640
+#define CAMERA_VGA_HEIGHT           480
+#define CAMERA_QVGA_WIDTH           320
+#define CAMERA_SWITCH_FRAMES        (CAMERA_FB_COUNT_MAX + 1)   // The frames captured before the switch are still in the buffers
+#define CAMERA_LIVE_SWITCH_MAX_US   50000                   // A few SCCB register writes
+
+/**
+ * @brief Take a frame, check the JPEG start marker, the size and the timestamp, and return the frame buffer.
+ *
+ * @param lastTimestampUs The timestamp of the previous frame, updated.
+ */
+static bool checkFrame(int64_t& lastTimestampUs) {
+    HalCameraFrame frame;
+    bool isCaptured = false;
+    UNIT_CHECK_TIME_US(isCaptured = Hal::Camera::getFrame(frame), CAMERA_FRAME_MAX_US);
+    UNIT_CHECK(isCaptured);
+
+    bool isValid = frame.format == HAL_PIXFORMAT_JPEG && frame.length > 2 && frame.data[0] == 0xFF && frame.data[1] == 0xD8
+        && frame.width == CAMERA_VGA_WIDTH && frame.height == CAMERA_VGA_HEIGHT && frame.timestampUs > lastTimestampUs;
+    lastTimestampUs = frame.timestampUs;
+    Hal::Camera::returnFrame(frame);
+    UNIT_CHECK(isValid);
+    return true;
+}
+
+static bool checkFrames() {
+    HalCameraFrame frame;
+    UNIT_CHECK(Hal::Camera::getFrame(frame)); // The first frame waits for the sensor (not measured)
+    int64_t lastTimestampUs = frame.timestampUs;
+    Hal::Camera::returnFrame(frame);
+
+    for (uint8_t i = 0; i < CAMERA_TEST_FRAMES; i++) {
+        if (!checkFrame(lastTimestampUs)) {
+            UNIT_PRINT("Frame %d is not valid...", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief The sensor is put into standby and woken up, the frames come again without a new init.
+ */
+static bool checkPower(CameraManager* cameraManager) {
+    cameraManager->powerDown();
+    UNIT_CHECK(cameraManager->isCameraPoweredDown());
+    cameraManager->powerUp();
+    UNIT_CHECK(!cameraManager->isCameraPoweredDown());
+    return checkFrames();
+}
+
+/**
+ * @brief Wait for a frame of the given width (the frame buffers can still hold frames of the old settings).
+ */
+static bool waitForFrameWidth(uint16_t width) {
+    for (uint8_t i = 0; i < CAMERA_SWITCH_FRAMES; i++) {
+        HalCameraFrame frame;
+        UNIT_CHECK(Hal::Camera::getFrame(frame));
+        bool isMatching = frame.width == width;
+        Hal::Camera::returnFrame(frame);
+        if (isMatching) { return true; }
+    }
+    UNIT_PRINT("No frame with width %u...", width);
+    return false;
+}
+
+/**
+ * @brief A smaller frame size and manual gain live, a new frame buffer count with reallocation, then the defaults again.
+ */
+static bool checkSettings(CameraManager* cameraManager) {
+    const CameraSettings defaults = cameraManager->getSettings();
+    CameraSettings settings = defaults;
+    settings.frameSize = HAL_FRAMESIZE_QVGA;
+    settings.isAutoGain = false;
+    settings.gain = 10;
+    UNIT_CHECK(!cameraManager->requiresReallocation(settings));
+    UNIT_CHECK(cameraManager->applySettings(settings, false) == ESP_OK);
+    CameraSwitch liveSwitch = cameraManager->getLastSwitch();
+    UNIT_CHECK(liveSwitch.type == CameraSwitchType::LIVE);
+    UNIT_CHECK(liveSwitch.durationUs < CAMERA_LIVE_SWITCH_MAX_US);
+    UNIT_CHECK(waitForFrameWidth(CAMERA_QVGA_WIDTH));
+
+    settings.frameBufferCount = CAMERA_FB_COUNT + 1;
+    UNIT_CHECK(cameraManager->applySettings(settings, false) == ESP_ERR_INVALID_STATE); // Nothing is changed without permission
+    UNIT_CHECK(cameraManager->getSettings().frameBufferCount == CAMERA_FB_COUNT);
+    UNIT_CHECK(cameraManager->applySettings(settings, true) == ESP_OK);
+    CameraSwitch reallocation = cameraManager->getLastSwitch();
+    UNIT_CHECK(reallocation.type == CameraSwitchType::REALLOCATED);
+    UNIT_CHECK(!cameraManager->getSettings().isAutoGain); // Applied again after the init
+    UNIT_CHECK(waitForFrameWidth(CAMERA_QVGA_WIDTH));
+    UNIT_PRINT("Switch latency: live %lu us, reallocation %lu us", (unsigned long)liveSwitch.durationUs,
+               (unsigned long)reallocation.durationUs);
+
+    UNIT_CHECK(cameraManager->applySettings(defaults, true) == ESP_OK);
+    return waitForFrameWidth(CAMERA_VGA_WIDTH) && checkFrames();
+}
+
+/**
+ * @brief Unit test for Camera Manager
+ *
+ * @param isLoop
+ *
+ * @note Test cases:
+ * init,
+ * frames (JPEG marker, size, timestamps, capture time, every frame buffer returned),
+ * powerDown, powerUp (frames after the standby),
+ * settings (live frame size and gain, reallocation for a new frame buffer count, switch latency, defaults again),
+ * deinit, init again
+ */
+bool UnitTests::CameraManagerUnitTest(bool isLoop) {
+    TEST_START("Camera Manager");
+    do {
+        UNIT_PRINT("Init Camera manager...");
+        CameraManager::init();
+        CameraManager* cameraManager = CameraManager::getInstance();
+        if (!cameraManager) {
+            UNIT_PRINT("Camera manager instance is nullptr...");
+            TEST_END_FAILED("Camera Manager");
+            return false;
+        }
+        bool passed = true;
+
+        UNIT_PRINT("Frames (%d)...", CAMERA_TEST_FRAMES);
+        passed = checkFrames() && passed;
+
+        UNIT_PRINT("Power down and up...");
+        passed = checkPower(cameraManager) && passed;
+
+        UNIT_PRINT("Settings...");
+        passed = checkSettings(cameraManager) && passed;
+
+        UNIT_PRINT("Deinit and init again...");
+        CameraManager::deinit();
+        CameraManager::init();
+        passed = passed && CameraManager::getInstance() && checkFrames();
+
+        UNIT_PRINT("Deinit Camera manager...");
+        CameraManager::deinit();
+
+        if (!passed) {
+            TEST_END_FAILED("Camera Manager");
+            return false;
+        }
+        TEST_END_PASSED("Camera Manager");
+    } while (isLoop);
+    return true;
+}
+
+#endif
@@ -15,8 +15,59 @@
 
 #ifdef UNIT_TESTS
 
-#define LED_COLOR_TEST
-#define LED_ANIMATION_TEST
+//#define LED_COLOR_TEST        // Visual checks (about 40 s), interactive
+//#define LED_ANIMATION_TEST    // Visual checks (about 40 s), interactive
+
+#define LED_TRANSMIT_MAX_US             2000    // 6 LEDs x 24 bits x 1.25 us on the wire, and the RMT setup
+#define LED_ONE_TIME_ANIMATION_MAX_MS   15000   // WIFI_CONNECTED and WIFI_DISCONNECTED end by themselves
+
+/**
+ * @brief Wait until the LED task ends a one time animation.
+ *
+ * @return true If the animation is changed to the expected one in time.
+ */
+static bool checkOneTimeAnimation(LedManager* ledManager, AnimationType animation, AnimationType expectedNext) {
+    ledManager->setAnimation(animation);
+    int64_t startUs = Hal::Timer::getTimeUs();
+    while (ledManager->getCurrentAnimation() == animation) {
+        UNIT_CHECK(Hal::Timer::getTimeUs() - startUs < int64_t(LED_ONE_TIME_ANIMATION_MAX_MS) * 1000);
+        vTaskDelay(pdMS_TO_TICKS(LED_FRAME_PERIOD_MS));
+    }
+    UNIT_CHECK(ledManager->getCurrentAnimation() == expectedNext);
+    return true;
+}
+
+/**
+ * @brief The automated part: the controls task runs every animation, and the frame period follows the power mode.
+ */
+static bool checkLedControls(LedManager* ledManager) {
+    const Colors::Color colors[] = { Colors::Orange, Colors::Red, Colors::Blue, Colors::White, Colors::Pink, Colors::Wifi, Colors::Error, Colors::Off };
+    for (const Colors::Color& color : colors) {
+        ledManager->setColor(color);
+        ledManager->setAnimation(AnimationType::IDLE);
+        vTaskDelay(pdMS_TO_TICKS(3 * LED_FRAME_PERIOD_MS));
+        UNIT_CHECK(ledManager->getCurrentAnimation() == AnimationType::IDLE);
+        ledManager->resetAnimation();
+    }
+
+    UNIT_PRINT("One time animations...");
+    ledManager->setColor(Colors::Pink);
+    if (!checkOneTimeAnimation(ledManager, AnimationType::WIFI_CONNECTED, AnimationType::IDLE)) { return false; }
+    if (!checkOneTimeAnimation(ledManager, AnimationType::WIFI_DISCONNECTED, AnimationType::NONE)) { return false; }
+
+    UNIT_PRINT("Low power mode...");
+    ledManager->setLowPowerMode(true);
+    UNIT_CHECK(ledManager->isLowPowerMode() && ledManager->getFramePeriodMs() == LED_LOW_POWER_FRAME_PERIOD_MS);
+    vTaskDelay(pdMS_TO_TICKS(2 * LED_LOW_POWER_FRAME_PERIOD_MS));
+    ledManager->setLowPowerMode(false);
+    UNIT_CHECK(!ledManager->isLowPowerMode() && ledManager->getFramePeriodMs() == LED_FRAME_PERIOD_MS);
+
+    UNIT_PRINT("Transmit time...");
+    ledManager->stopLedArrayControls(); // The test transmits the frame
+    ledManager->setAllOff();
+    UNIT_CHECK_TIME_US(ledManager->transmitWaveformToLedArray(), LED_TRANSMIT_MAX_US);
+    return true;
+}
 
 /**
  * @brief Unit test for LED Manager
@@ -26,11 +77,14 @@
  * @note Test cases:
  * init,
  * startLedArrayControls,
- * setColor (with all color),
- * setAnimation (with all animations),
+ * setColor (with all color) and the IDLE animation,
+ * the one time animations end by themselves,
+ * setLowPowerMode (frame period),
+ * transmit time,
+ * the visual checks with LED_COLOR_TEST and LED_ANIMATION_TEST,
  * deinit
  */
-void UnitTests::LedManagerUnitTest(bool isLoop) {
+bool UnitTests::LedManagerUnitTest(bool isLoop) {
     TEST_START("LED Manager");
     do {
         UNIT_PRINT("Init LED manager...");
@@ -41,7 +95,7 @@ void UnitTests::LedManagerUnitTest(bool isLoop) {
         if (!ledManager) {
             UNIT_PRINT("LED manager instance is nullptr...");
             TEST_END_FAILED("LED Manager");
-            return;
+            return false;
         }
 
         UNIT_PRINT("Starting LED array controls...");
@@ -128,11 +182,19 @@ void UnitTests::LedManagerUnitTest(bool isLoop) {
         // After this animation, the animation will be NONE
 #endif
 
+        UNIT_PRINT("Checking the LED array controls...");
+        bool passed = checkLedControls(ledManager);
+
         UNIT_PRINT("Deinit LED manager...");
         LedManager::deinit();
 
+        if (!passed) {
+            TEST_END_FAILED("LED Manager");
+            return false;
+        }
         TEST_END_PASSED("LED Manager");
     } while (isLoop);
+    return true;
 }
 
 #endif
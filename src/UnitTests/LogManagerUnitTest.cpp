@@ -0,0 +1,289 @@
+/*
+ * File: LogManagerUnitTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Saturday, 8th March 2025 7:02:18 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Saturday, 8th March 2025 7:02:18 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "UnitTests.h"
+
+#ifdef UNIT_TESTS
+
+#include <inttypes.h>
+#include <string.h>
+
+#define LOG_LEVEL_UNIT_TEST         LOG_LEVEL_DEBUG
+#define LOG_LEVEL_UNIT_TEST_QUIET   LOG_LEVEL_INFO  // LOG_D calls of this module are removed
+
+#define PRODUCER_COUNT              2
+#define PRODUCER_ENTRIES            500
+#define BENCHMARK_ITERATIONS        200
+#define BENCHMARK_BATCH             32      // Less than LOG_RING_SIZE, the ring is drained between the batches (not measured)
+
+// Helpers --------------------------------------------------------------
+struct CapturedLines {
+    char lines[LOG_RING_SIZE][LOG_MAX_LINE_LENGTH];
+    uint32_t args[LOG_RING_SIZE];
+    uint32_t count;
+};
+
+static void captureLine(const LogEntry& entry, const char* line, void* context) {
+    CapturedLines* captured = static_cast<CapturedLines*>(context);
+    if (captured->count < LOG_RING_SIZE) {
+        strncpy(captured->lines[captured->count], line, LOG_MAX_LINE_LENGTH - 1);
+        captured->lines[captured->count][LOG_MAX_LINE_LENGTH - 1] = '\0';
+        captured->args[captured->count] = entry.argCount ? uint32_t(entry.args[0]) : 0;
+    }
+    captured->count++;
+}
+
+static void discardLine(const LogEntry& entry, const char* line, void* context) {}
+
+static bool expectLine(const LogSite& site, const uintptr_t* args, uint8_t argCount, const char* expected) {
+    LogEntry entry = {};
+    entry.site = &site;
+    entry.argCount = argCount;
+    for (uint8_t i = 0; i < argCount; i++) { entry.args[i] = args[i]; }
+    char line[LOG_MAX_LINE_LENGTH];
+    LogManager::format(entry, line, sizeof(line));
+    if (strcmp(line, expected) != 0) {
+        UNIT_PRINT("Format \"%s\": \"%s\" instead of \"%s\"", site.format, line, expected);
+        return false;
+    }
+    return true;
+}
+
+// Test cases -----------------------------------------------------------
+static bool checkFormat() {
+    bool passed = true;
+    static const LogSite integers = { "UNIT_TEST", "%d %u %x %c", LOG_LEVEL_INFO };
+    const uintptr_t integerArgs[] = { uintptr_t(intptr_t(-42)), 4000000000u, 0xBEEF, 'A' };
+    passed = expectLine(integers, integerArgs, 4, "-42 4000000000 beef A") && passed;
+    static const LogSite widths = { "UNIT_TEST", "%5d|%-4X|%03o", LOG_LEVEL_INFO };
+    const uintptr_t widthArgs[] = { 12, 0xAB, 8 };
+    passed = expectLine(widths, widthArgs, 3, "   12|AB  |010") && passed;
+    static const LogSite longs = { "UNIT_TEST", "%ld %lu %lx %hd", LOG_LEVEL_INFO };
+    const uintptr_t longArgs[] = { uintptr_t(intptr_t(-100000)), 3000000000u, 0x12345678, 5 };
+    passed = expectLine(longs, longArgs, 4, "-100000 3000000000 12345678 5") && passed;
+    static const LogSite strings = { "UNIT_TEST", "[%s] [%5s] [%s] 100%%", LOG_LEVEL_INFO };
+    const uintptr_t stringArgs[] = { reinterpret_cast<uintptr_t>("abc"), reinterpret_cast<uintptr_t>("ab"), 0 };
+    passed = expectLine(strings, stringArgs, 3, "[abc] [   ab] [(null)] 100%") && passed;
+    static const LogSite missing = { "UNIT_TEST", "%d %d", LOG_LEVEL_INFO };
+    const uintptr_t missingArgs[] = { 1 };
+    passed = expectLine(missing, missingArgs, 1, "1 0") && passed;
+    static const LogSite unsupported = { "UNIT_TEST", "%f %d", LOG_LEVEL_INFO };
+    const uintptr_t unsupportedArgs[] = { 0, 3 };
+    passed = expectLine(unsupported, unsupportedArgs, 2, "<%f?> 3") && passed;
+
+    // Truncation, the line is always zero terminated
+    static const LogSite longLine = { "UNIT_TEST", "%s%s", LOG_LEVEL_INFO };
+    static char text[LOG_MAX_LINE_LENGTH];
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    LogEntry entry = {};
+    entry.site = &longLine;
+    entry.argCount = 2;
+    entry.args[0] = reinterpret_cast<uintptr_t>(text);
+    entry.args[1] = reinterpret_cast<uintptr_t>(text);
+    char line[16];
+    size_t length = LogManager::format(entry, line, sizeof(line));
+    if (length != sizeof(line) - 1 || strlen(line) != sizeof(line) - 1) {
+        UNIT_PRINT("Truncation failed: %u", (unsigned)length);
+        passed = false;
+    }
+    return passed;
+}
+
+static bool checkRing(LogManager* logManager) {
+    static CapturedLines captured;
+    bool passed = true;
+    logManager->drain(discardLine, nullptr);
+
+    // Order and formatting through the ring
+    captured.count = 0;
+    LOG_I(UNIT_TEST, "First %d", -1);
+    LOG_D(UNIT_TEST, "Second %s %u", "two", 2u);
+    LOG_E(UNIT_TEST, "Third");
+    if (logManager->drain(captureLine, &captured) != 3 || strcmp(captured.lines[0], "First -1") != 0 ||
+        strcmp(captured.lines[1], "Second two 2") != 0 || strcmp(captured.lines[2], "Third") != 0) {
+        UNIT_PRINT("Unexpected ring content (%lu entries)...", (unsigned long)captured.count);
+        passed = false;
+    }
+
+    // Compile-time level: the call is removed
+    LOG_D(UNIT_TEST_QUIET, "Removed %d", 1);
+    if (logManager->drain(discardLine, nullptr) != 0) {
+        UNIT_PRINT("A debug entry was stored above the level of the module...");
+        passed = false;
+    }
+
+    // Full ring: the producer never blocks, the new entries are dropped and counted, the order of the stored ones is kept
+    // Two rounds, so the positions wrap around the ring
+    for (uint8_t round = 0; round < 2; round++) {
+        uint32_t droppedCount = LogManager::getDroppedCount();
+        captured.count = 0;
+        for (uint32_t i = 0; i < LOG_RING_SIZE + 10; i++) { LOG_I(UNIT_TEST, "Entry %" PRIu32, i); }
+        if (LogManager::getDroppedCount() - droppedCount != 10) {
+            UNIT_PRINT("Dropped: %lu instead of 10", (unsigned long)(LogManager::getDroppedCount() - droppedCount));
+            passed = false;
+        }
+        if (logManager->drain(captureLine, &captured) != LOG_RING_SIZE) {
+            UNIT_PRINT("Drained: %lu instead of %d", (unsigned long)captured.count, LOG_RING_SIZE);
+            passed = false;
+        }
+        for (uint32_t i = 0; i < LOG_RING_SIZE && i < captured.count; i++) {
+            if (captured.args[i] != i) {
+                UNIT_PRINT("Entry %lu out of order: %lu", (unsigned long)i, (unsigned long)captured.args[i]);
+                passed = false;
+                break;
+            }
+        }
+    }
+    return passed;
+}
+
+// Producers write concurrently, the test task drains, every producer's entries have to arrive in order
+struct ProducerCheck {
+    std::atomic<uint8_t> finishedCount;
+    uint32_t nextIndex[PRODUCER_COUNT];
+    uint32_t receivedCount;
+    bool isInOrder;
+};
+
+static ProducerCheck producerCheck;
+
+static void taskProducer(void *pvParameters) {
+    uint32_t producer = uint32_t(uintptr_t(pvParameters));
+    for (uint32_t i = 0; i < PRODUCER_ENTRIES; i++) {
+        LOG_I(UNIT_TEST, "Producer %" PRIu32 " entry %" PRIu32, producer, i);
+        if (i % 16 == 15) { vTaskDelay(1); }
+    }
+    producerCheck.finishedCount++;
+    vTaskDelete(NULL);
+}
+
+static void checkProducerLine(const LogEntry& entry, const char* line, void* context) {
+    uint32_t producer = uint32_t(entry.args[0]);
+    uint32_t index = uint32_t(entry.args[1]);
+    if (producer >= PRODUCER_COUNT || index < producerCheck.nextIndex[producer]) {
+        producerCheck.isInOrder = false;
+        return;
+    }
+    producerCheck.nextIndex[producer] = index + 1; // Dropped entries are skipped
+    producerCheck.receivedCount++;
+}
+
+static bool checkProducers(LogManager* logManager) {
+    producerCheck.finishedCount = 0;
+    memset(producerCheck.nextIndex, 0, sizeof(producerCheck.nextIndex));
+    producerCheck.receivedCount = 0;
+    producerCheck.isInOrder = true;
+    uint32_t droppedCount = LogManager::getDroppedCount();
+
+    for (uint32_t i = 0; i < PRODUCER_COUNT; i++) {
+        xTaskCreate(&taskProducer, "LOG_PRODUCER", 2048, reinterpret_cast<void*>(uintptr_t(i)), 2, nullptr);
+    }
+    while (producerCheck.finishedCount < PRODUCER_COUNT) {
+        logManager->drain(checkProducerLine, nullptr);
+        vTaskDelay(1);
+    }
+    logManager->drain(checkProducerLine, nullptr);
+
+    uint32_t dropped = LogManager::getDroppedCount() - droppedCount;
+    UNIT_PRINT("Received: %lu, dropped: %lu", (unsigned long)producerCheck.receivedCount, (unsigned long)dropped);
+    if (!producerCheck.isInOrder || producerCheck.receivedCount + dropped != PRODUCER_COUNT * PRODUCER_ENTRIES) {
+        UNIT_PRINT("Lost or reordered entries...");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Compare the cost of a log call on the calling task: the formatting macro (DEBUG_PRINT, ESP_LOGI) and the
+ * deferred logger (LOG_I). The draining of the deferred entries is not measured, it runs on the drain task.
+ */
+static bool checkBenchmark(LogManager* logManager) {
+    int16_t x = -512;
+    uint16_t y = 1023;
+    int64_t directUs = 0;
+    int64_t deferredUs = 0;
+
+    for (uint32_t done = 0; done < BENCHMARK_ITERATIONS; done += BENCHMARK_BATCH) {
+        int64_t startUs = Hal::Timer::getTimeUs();
+        for (uint32_t i = 0; i < BENCHMARK_BATCH; i++) {
+            ESP_LOGI("DEBUG", "X: %d, Y: %u, Speed: %d, Hint: %s", x, y, int(i), "AUTO");
+        }
+        directUs += Hal::Timer::getTimeUs() - startUs;
+
+        startUs = Hal::Timer::getTimeUs();
+        for (uint32_t i = 0; i < BENCHMARK_BATCH; i++) {
+            LOG_I(UNIT_TEST, "X: %d, Y: %u, Speed: %d, Hint: %s", x, y, int(i), "AUTO");
+        }
+        deferredUs += Hal::Timer::getTimeUs() - startUs;
+        logManager->drain(discardLine, nullptr);
+    }
+
+    uint32_t iterations = (BENCHMARK_ITERATIONS + BENCHMARK_BATCH - 1) / BENCHMARK_BATCH * BENCHMARK_BATCH;
+    uint32_t directNs = uint32_t(directUs * 1000 / iterations);
+    uint32_t deferredNs = uint32_t(deferredUs * 1000 / iterations);
+    UNIT_PRINT("Per call: DEBUG_PRINT %lu ns, LOG_I %lu ns (%lux)", (unsigned long)directNs, (unsigned long)deferredNs,
+               (unsigned long)(deferredNs ? directNs / deferredNs : 0));
+    return deferredNs < directNs;
+}
+
+/**
+ * @brief Unit test for the log manager
+ *
+ * @param isLoop
+ *
+ * @note Test cases:
+ * formatting (integers, long and short modifiers, strings, missing and unsupported arguments, truncation),
+ * ring (order, compile-time level, full ring with drop counting, wraparound),
+ * concurrent producers (order per producer, no lost entries),
+ * per call cost of DEBUG_PRINT and LOG_I
+ */
+bool UnitTests::LogManagerUnitTest(bool isLoop) {
+    TEST_START("Log manager");
+    do {
+        LogManager::init();
+        LogManager* logManager = LogManager::getInstance();
+        if (!logManager) {
+            UNIT_PRINT("Log manager init failed...");
+            TEST_END_FAILED("Log manager");
+            return false;
+        }
+        logManager->stopDrainTask(); // The test is the consumer
+        bool passed = true;
+
+        UNIT_PRINT("Format...");
+        passed = checkFormat() && passed;
+
+        UNIT_PRINT("Ring...");
+        passed = checkRing(logManager) && passed;
+
+        UNIT_PRINT("Concurrent producers (%d x %d entries)...", PRODUCER_COUNT, PRODUCER_ENTRIES);
+        passed = checkProducers(logManager) && passed;
+
+        UNIT_PRINT("Benchmark (%d calls)...", BENCHMARK_ITERATIONS);
+        if (!checkBenchmark(logManager)) {
+            UNIT_PRINT("The deferred logger is not faster than DEBUG_PRINT...");
+            passed = false;
+        }
+
+        logManager->startDrainTask();
+        if (!passed) {
+            TEST_END_FAILED("Log manager");
+            return false;
+        }
+        TEST_END_PASSED("Log manager");
+    } while (isLoop);
+    return true;
+}
+
+#endif
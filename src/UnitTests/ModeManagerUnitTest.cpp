@@ -0,0 +1,292 @@
+/*
+ * File: ModeManagerUnitTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 3rd March 2025 9:40:12 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 3rd March 2025 9:40:12 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "UnitTests.h"
+
+#ifdef UNIT_TESTS
+
+#include <string.h>
+
+/*
+    The subsystems are replaced with stub managers, so the test only checks the
+    mode transitions (no hardware is touched, it can run without the camera, motors, etc.).
+    Every stub call is logged as: action (start, stop, suspend, resume) << 4 | subsystem.
+*/
+#define STUB_LOG_SIZE 32
+
+static uint8_t stubLog[STUB_LOG_SIZE];
+static uint8_t stubLogLength = 0;
+
+#define STARTED(subsystem)      uint8_t((1 << 4) | (subsystem))
+#define STOPPED(subsystem)      uint8_t((2 << 4) | (subsystem))
+#define SUSPENDED(subsystem)    uint8_t((3 << 4) | (subsystem))
+#define RESUMED(subsystem)      uint8_t((4 << 4) | (subsystem))
+
+static void logStubCall(uint8_t call) { if (stubLogLength < STUB_LOG_SIZE) { stubLog[stubLogLength++] = call; } }
+
+template <Subsystem subsystem>
+static void stubStart() { logStubCall(STARTED(subsystem)); }
+
+template <Subsystem subsystem>
+static void stubStop() { logStubCall(STOPPED(subsystem)); }
+
+template <Subsystem subsystem>
+static void stubSuspend() { logStubCall(SUSPENDED(subsystem)); }
+
+template <Subsystem subsystem>
+static void stubResume() { logStubCall(RESUMED(subsystem)); }
+
+static ModeProfile lastPowerProfile;
+static uint8_t powerProfileCalls = 0;
+
+static void stubPowerProfile(const ModeProfile& profile) {
+    lastPowerProfile = profile;
+    powerProfileCalls++;
+}
+
+static void installStubManagers(ModeManager* modeManager) {
+    modeManager->setSubsystemHooks(SUBSYSTEM_WIFI, { stubStart<SUBSYSTEM_WIFI>, stubStop<SUBSYSTEM_WIFI>, nullptr, nullptr });
+    modeManager->setSubsystemHooks(SUBSYSTEM_LEDS, { stubStart<SUBSYSTEM_LEDS>, stubStop<SUBSYSTEM_LEDS>, nullptr, nullptr });
+    modeManager->setSubsystemHooks(SUBSYSTEM_COMMAND_SERVER, { stubStart<SUBSYSTEM_COMMAND_SERVER>, stubStop<SUBSYSTEM_COMMAND_SERVER>, nullptr, nullptr });
+    modeManager->setSubsystemHooks(SUBSYSTEM_CAMERA, { stubStart<SUBSYSTEM_CAMERA>, stubStop<SUBSYSTEM_CAMERA>, stubSuspend<SUBSYSTEM_CAMERA>, stubResume<SUBSYSTEM_CAMERA> });
+    modeManager->setSubsystemHooks(SUBSYSTEM_VIDEO_SERVER, { stubStart<SUBSYSTEM_VIDEO_SERVER>, stubStop<SUBSYSTEM_VIDEO_SERVER>, nullptr, nullptr });
+    modeManager->setSubsystemHooks(SUBSYSTEM_MOTORS, { stubStart<SUBSYSTEM_MOTORS>, stubStop<SUBSYSTEM_MOTORS>, nullptr, nullptr });
+    modeManager->setPowerProfileHook(stubPowerProfile);
+}
+
+/**
+ * @brief Request a mode, process it, and compare the stub calls with the expected ones.
+ *
+ * @return true If the transition started and stopped exactly the expected subsystems, in the expected order.
+ */
+static bool checkTransition(ModeManager* modeManager, DroneMode mode, const uint8_t* expectedLog, uint8_t expectedLength) {
+    stubLogLength = 0;
+    powerProfileCalls = 0;
+    modeManager->setMode(mode);
+    modeManager->processModeRequest();
+    if (modeManager->getMode() != mode) {
+        UNIT_PRINT("Mode is %d, expected %d", modeManager->getMode(), mode);
+        return false;
+    }
+    if (modeManager->getActiveSubsystems() != ModeManager::getRequiredSubsystems(mode)) {
+        UNIT_PRINT("Active subsystems: 0x%02x, expected: 0x%02x", modeManager->getActiveSubsystems(), ModeManager::getRequiredSubsystems(mode));
+        return false;
+    }
+    if (modeManager->getSuspendedSubsystems() != ModeManager::getModeProfile(mode).suspendedSubsystems) {
+        UNIT_PRINT("Suspended subsystems: 0x%02x, expected: 0x%02x", modeManager->getSuspendedSubsystems(), ModeManager::getModeProfile(mode).suspendedSubsystems);
+        return false;
+    }
+    if (expectedLength > 0 && (powerProfileCalls != 1 || lastPowerProfile.isPowerSaveEnabled != ModeManager::getModeProfile(mode).isPowerSaveEnabled)) {
+        UNIT_PRINT("Power profile applied %d times, expected once", powerProfileCalls);
+        return false;
+    }
+    if (stubLogLength != expectedLength) {
+        UNIT_PRINT("%d stub calls, expected %d", stubLogLength, expectedLength);
+        return false;
+    }
+    for (uint8_t i = 0; i < expectedLength; i++) {
+        if (stubLog[i] != expectedLog[i]) {
+            UNIT_PRINT("Stub call %d is %d, expected %d", i, stubLog[i], expectedLog[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Check the mode profiles against the power and latency budget (no transitions, only the policy).
+ *
+ * @return true If every mode can wake up to DRIVE within its budget, and the room plant mode saves power.
+ */
+static bool checkModePolicy() {
+    bool passed = true;
+    for (uint8_t mode = DroneMode::STREAM_ONLY; mode <= DroneMode::LOW_POWER; mode++) {
+        const ModeProfile& profile = ModeManager::getModeProfile(DroneMode(mode));
+        uint16_t latencyMs = ModeManager::estimateTransitionLatencyMs(DroneMode(mode), DroneMode::DRIVE);
+        UNIT_PRINT("Mode %d -> DRIVE: %d ms (budget: %d ms)", mode, latencyMs, profile.wakeLatencyBudgetMs);
+        if (latencyMs > profile.wakeLatencyBudgetMs) { passed = false; }
+        if (profile.requiredSubsystems & profile.suspendedSubsystems) {
+            UNIT_PRINT("Mode %d has running and suspended subsystems at the same time", mode);
+            passed = false;
+        }
+        if (!(profile.requiredSubsystems & SUBSYSTEM_BIT(SUBSYSTEM_COMMAND_SERVER))) {
+            UNIT_PRINT("Mode %d can not be woken up (no command server)", mode);
+            passed = false;
+        }
+    }
+
+    const ModeProfile& roomPlant = ModeManager::getModeProfile(DroneMode::ROOM_PLANT);
+    if (roomPlant.wakeLatencyBudgetMs > 200 || !roomPlant.isPowerSaveEnabled || !roomPlant.isLedDimmed) {
+        UNIT_PRINT("Room plant mode does not save power, or wakes up too slow...");
+        passed = false;
+    }
+    if (roomPlant.requiredSubsystems & (SUBSYSTEM_BIT(SUBSYSTEM_CAMERA) | SUBSYSTEM_BIT(SUBSYSTEM_VIDEO_SERVER) | SUBSYSTEM_BIT(SUBSYSTEM_MOTORS))) {
+        UNIT_PRINT("Room plant mode runs the camera, video server or motors...");
+        passed = false;
+    }
+    if (!(roomPlant.suspendedSubsystems & SUBSYSTEM_BIT(SUBSYSTEM_CAMERA))) {
+        UNIT_PRINT("Room plant mode does not keep the camera in standby (slow wake up)...");
+        passed = false;
+    }
+    return passed;
+}
+
+/*
+    The wake path ROOM_PLANT -> DRIVE with the real camera, video server and motor managers: the unit test task is the
+    main loop (waitForModeRequest(), processModeRequest()), another task calls wakeUp() like the /con and /mov handlers
+    in the server task. The Wi-Fi, the LEDs and the command server run in both modes, they are not on the path (no
+    hooks). The wait for the DTIM beacon is the radio, it is left out of the limit.
+*/
+static void taskWakeUp(void* parameter) {
+    static_cast<ModeManager*>(parameter)->wakeUp();
+    vTaskDelete(nullptr);
+}
+
+static bool wakeUpFromAnotherTask(ModeManager* modeManager) {
+    if (xTaskCreate(&taskWakeUp, "WAKE_UP", 2048, modeManager, 5, nullptr) != pdPASS) { return false; }
+    modeManager->waitForModeRequest(MODE_PROCESS_PERIOD_MS); // Without the notification it is the period, over the limit
+    modeManager->processModeRequest();
+    return modeManager->getMode() == DroneMode::DRIVE;
+}
+
+static bool checkWakeLatency(ModeManager* modeManager) {
+    modeManager->setMode(DroneMode::ROOM_PLANT);
+    modeManager->processModeRequest();
+    UNIT_CHECK(modeManager->getMode() == DroneMode::ROOM_PLANT);
+    modeManager->waitForModeRequest(0);     // The unit test task is the mode task from now on, no pending notification
+
+    const int64_t wakeLatencyMaxUs = int64_t(ModeManager::getModeProfile(DroneMode::ROOM_PLANT).wakeLatencyBudgetMs
+                                             - WIFI_DTIM_WAKE_LATENCY_MS) * 1000;
+    bool isAwake = false;
+    int64_t startUs = Hal::Timer::getTimeUs();
+    UNIT_CHECK_TIME_US(isAwake = wakeUpFromAnotherTask(modeManager), wakeLatencyMaxUs);
+    UNIT_PRINT("Woken up in %lld us (estimate without the DTIM wait: %d ms)", (long long)(Hal::Timer::getTimeUs() - startUs),
+               ModeManager::estimateTransitionLatencyMs(DroneMode::ROOM_PLANT, DroneMode::DRIVE) - WIFI_DTIM_WAKE_LATENCY_MS);
+    UNIT_CHECK(isAwake);
+    return true;
+}
+
+static bool checkWake() {
+    ModeManager::init();
+    ModeManager* modeManager = ModeManager::getInstance();
+    modeManager->setSubsystemHooks(SUBSYSTEM_WIFI, { nullptr, nullptr, nullptr, nullptr });
+    modeManager->setSubsystemHooks(SUBSYSTEM_LEDS, { nullptr, nullptr, nullptr, nullptr });
+    modeManager->setSubsystemHooks(SUBSYSTEM_COMMAND_SERVER, { nullptr, nullptr, nullptr, nullptr });
+    bool passed = checkWakeLatency(modeManager);
+    ModeManager::deinit(); // Stops the motors, the video server and the camera
+    MotorManager::deinit();
+    ServerManager::deinit();
+    return passed;
+}
+
+/**
+ * @brief Unit test for Mode Manager
+ *
+ * @param isLoop
+ *
+ * @note Test cases:
+ * mode policy (wake latency budget, room plant power save),
+ * init (nothing started),
+ * SHUTDOWN -> DRIVE (everything started in dependency order),
+ * DRIVE -> DRIVE (no change),
+ * DRIVE -> STREAM_ONLY (motors stopped),
+ * STREAM_ONLY -> ROOM_PLANT (video server stopped, camera suspended),
+ * ROOM_PLANT -> DRIVE (camera resumed, video server, motors started),
+ * DRIVE -> LOW_POWER (everything stopped, except the Wi-Fi and command server),
+ * LOW_POWER -> ROOM_PLANT (LEDs started, camera started and suspended),
+ * deinit (camera resumed, everything stopped in reverse order),
+ * ROOM_PLANT -> DRIVE wake latency with the real managers (timed)
+ */
+bool UnitTests::ModeManagerUnitTest(bool isLoop) {
+    TEST_START("Mode Manager");
+    do {
+        UNIT_PRINT("Checking the mode policy...");
+        if (!checkModePolicy()) {
+            TEST_END_FAILED("Mode Manager");
+            return false;
+        }
+
+        UNIT_PRINT("Init Mode manager...");
+        ModeManager::init();
+        ModeManager* modeManager = ModeManager::getInstance();
+        if (!modeManager) {
+            UNIT_PRINT("Mode manager instance is nullptr...");
+            TEST_END_FAILED("Mode Manager");
+            return false;
+        }
+
+        UNIT_PRINT("Installing stub managers...");
+        installStubManagers(modeManager);
+        if (modeManager->getMode() != DroneMode::SHUTDOWN || modeManager->getActiveSubsystems() != 0) {
+            UNIT_PRINT("Mode manager started something on init...");
+            ModeManager::deinit();
+            TEST_END_FAILED("Mode Manager");
+            return false;
+        }
+
+        bool passed = true;
+
+        UNIT_PRINT("SHUTDOWN -> DRIVE...");
+        const uint8_t toDrive[] = { STARTED(SUBSYSTEM_WIFI), STARTED(SUBSYSTEM_LEDS), STARTED(SUBSYSTEM_COMMAND_SERVER), STARTED(SUBSYSTEM_CAMERA), STARTED(SUBSYSTEM_VIDEO_SERVER), STARTED(SUBSYSTEM_MOTORS) };
+        passed = passed && checkTransition(modeManager, DroneMode::DRIVE, toDrive, sizeof(toDrive));
+
+        UNIT_PRINT("DRIVE -> DRIVE (no change expected)...");
+        passed = passed && checkTransition(modeManager, DroneMode::DRIVE, nullptr, 0);
+
+        UNIT_PRINT("DRIVE -> STREAM_ONLY...");
+        const uint8_t toStreamOnly[] = { STOPPED(SUBSYSTEM_MOTORS) };
+        passed = passed && checkTransition(modeManager, DroneMode::STREAM_ONLY, toStreamOnly, sizeof(toStreamOnly));
+
+        UNIT_PRINT("STREAM_ONLY -> ROOM_PLANT...");
+        const uint8_t toRoomPlant[] = { STOPPED(SUBSYSTEM_VIDEO_SERVER), SUSPENDED(SUBSYSTEM_CAMERA) };
+        passed = passed && checkTransition(modeManager, DroneMode::ROOM_PLANT, toRoomPlant, sizeof(toRoomPlant));
+
+        UNIT_PRINT("ROOM_PLANT -> DRIVE...");
+        const uint8_t backToDrive[] = { RESUMED(SUBSYSTEM_CAMERA), STARTED(SUBSYSTEM_VIDEO_SERVER), STARTED(SUBSYSTEM_MOTORS) };
+        passed = passed && checkTransition(modeManager, DroneMode::DRIVE, backToDrive, sizeof(backToDrive));
+
+        UNIT_PRINT("DRIVE -> LOW_POWER...");
+        const uint8_t toLowPower[] = { STOPPED(SUBSYSTEM_MOTORS), STOPPED(SUBSYSTEM_VIDEO_SERVER), STOPPED(SUBSYSTEM_CAMERA), STOPPED(SUBSYSTEM_LEDS) };
+        passed = passed && checkTransition(modeManager, DroneMode::LOW_POWER, toLowPower, sizeof(toLowPower));
+
+        UNIT_PRINT("LOW_POWER -> ROOM_PLANT...");
+        const uint8_t lowPowerToRoomPlant[] = { STARTED(SUBSYSTEM_LEDS), STARTED(SUBSYSTEM_CAMERA), SUSPENDED(SUBSYSTEM_CAMERA) };
+        passed = passed && checkTransition(modeManager, DroneMode::ROOM_PLANT, lowPowerToRoomPlant, sizeof(lowPowerToRoomPlant));
+
+        UNIT_PRINT("Deinit Mode manager (everything should stop)...");
+        stubLogLength = 0;
+        ModeManager::deinit();
+        const uint8_t toShutdown[] = { RESUMED(SUBSYSTEM_CAMERA), STOPPED(SUBSYSTEM_CAMERA), STOPPED(SUBSYSTEM_COMMAND_SERVER), STOPPED(SUBSYSTEM_LEDS), STOPPED(SUBSYSTEM_WIFI) };
+        if (stubLogLength != sizeof(toShutdown) || memcmp(stubLog, toShutdown, sizeof(toShutdown)) != 0) {
+            UNIT_PRINT("Deinit did not stop the subsystems in reverse order...");
+            passed = false;
+        }
+
+        UNIT_PRINT("ROOM_PLANT -> DRIVE wake latency (camera, video server, motors)...");
+        passed = passed && checkWake();
+
+        if (!passed) {
+            TEST_END_FAILED("Mode Manager");
+            return false;
+        }
+        TEST_END_PASSED("Mode Manager");
+    } while (isLoop);
+    return true;
+}
+
+#undef STARTED
+#undef STOPPED
+#undef SUSPENDED
+#undef RESUMED
+
+#endif
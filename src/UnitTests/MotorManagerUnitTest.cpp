@@ -0,0 +1,165 @@
+/*
+ * File: MotorManagerUnitTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "UnitTests.h"
+
+#ifdef UNIT_TESTS
+
+/*
+    The mixer is checked through the applied PWM duties (Hal::Pwm::getDuty), so the motors should be lifted
+    off the ground: the full speed cases spin them for a few milliseconds.
+*/
+#define DIRECTION_CONTROL_MAX_US    200     // One motor loop iteration, far below MOTOR_CONTROL_PERIOD_MS
+#define DIRECTION_CONTROL_LOOPS     3       // Motor loop periods to wait for the control task
+
+/**
+ * @brief The expected signed duty of a speed percentage (the formula of Motor::convertSpeedPercentageToDutyCycle()).
+ */
+static int16_t expectedDuty(int16_t speed) {
+    if (speed > 1) { return int16_t(speed * 1.6 + MOTOR_MIN_SPEED); }
+    if (speed < -1) { return int16_t(speed * 1.6 - MOTOR_MIN_SPEED); }
+    return MOTOR_OFF;
+}
+
+/**
+ * @brief Compare the applied duties of both motors (positive: clockwise channel, negative: counter-clockwise channel).
+ */
+static bool checkDuties(int16_t left, int16_t right) {
+    UNIT_CHECK(Hal::Pwm::getDuty(MOTOR_1_CW) == uint32_t(left > 0 ? left : 0));
+    UNIT_CHECK(Hal::Pwm::getDuty(MOTOR_1_CCW) == uint32_t(left < 0 ? -left : 0));
+    UNIT_CHECK(Hal::Pwm::getDuty(MOTOR_2_CW) == uint32_t(right > 0 ? right : 0));
+    UNIT_CHECK(Hal::Pwm::getDuty(MOTOR_2_CCW) == uint32_t(right < 0 ? -right : 0));
+    return true;
+}
+
+static bool checkControl(MotorManager* motorManager, int16_t X, int16_t Y, int8_t L, int8_t R, int16_t left, int16_t right) {
+    motorManager->setControlData(X, Y, L, R);
+    UNIT_CHECK_TIME_US(motorManager->directionControlManual(), DIRECTION_CONTROL_MAX_US);
+    if (!checkDuties(left, right)) {
+        UNIT_PRINT("Control data: X: %d, Y: %d, L: %d, R: %d", X, Y, L, R);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Every branch of directionControlManual(): Y axis (straight and steering), X axis, Z axis, dead zone, safety stop.
+ */
+static bool checkMixer(MotorManager* motorManager) {
+    UNIT_CHECK(expectedDuty(100) == MOTOR_MAX_SPEED);
+    if (!checkControl(motorManager, 0, 100, 0, 0, MOTOR_MAX_SPEED, MOTOR_MAX_SPEED)) { return false; }
+    if (!checkControl(motorManager, 0, -100, 0, 0, -MOTOR_MAX_SPEED, -MOTOR_MAX_SPEED)) { return false; }
+    if (!checkControl(motorManager, 0, 50, 20, 0, expectedDuty(30), expectedDuty(50))) { return false; }
+    if (!checkControl(motorManager, 0, 50, 0, 20, expectedDuty(50), expectedDuty(30))) { return false; }
+    if (!checkControl(motorManager, 0, -50, 20, 0, expectedDuty(-50), expectedDuty(-30))) { return false; }
+    if (!checkControl(motorManager, 0, -50, 0, 20, expectedDuty(-30), expectedDuty(-50))) { return false; }
+    if (!checkControl(motorManager, 80, 50, 0, 0, expectedDuty(80), expectedDuty(-80))) { return false; }
+    if (!checkControl(motorManager, -80, 50, 0, 0, expectedDuty(-80), expectedDuty(80))) { return false; }
+    if (!checkControl(motorManager, 0, 0, 40, 0, MOTOR_OFF, expectedDuty(40))) { return false; }
+    if (!checkControl(motorManager, 0, 0, 0, 40, expectedDuty(40), MOTOR_OFF)) { return false; }
+    if (!checkControl(motorManager, 0, 1, 0, 0, MOTOR_OFF, MOTOR_OFF)) { return false; }          // Dead zone
+    if (!checkControl(motorManager, 0, 0, 40, 40, MOTOR_OFF, MOTOR_OFF)) { return false; }        // Both steering: stop
+
+    ControlData controlData = motorManager->getControlData();
+    UNIT_CHECK(controlData.L == 0 && controlData.R == 0); // Cleared for safety
+    return true;
+}
+
+/**
+ * @brief A stop hint holds the forward moves, backward moves and turns still work, the hint expires.
+ */
+static bool checkStopHint(MotorManager* motorManager) {
+    MotorManager::setStopHint(50);
+    UNIT_CHECK(MotorManager::isStopHinted());
+    bool isHeld = checkControl(motorManager, 0, 60, 0, 0, MOTOR_OFF, MOTOR_OFF) &&
+                  checkControl(motorManager, 0, -60, 0, 0, expectedDuty(-60), expectedDuty(-60)) &&
+                  checkControl(motorManager, 80, 60, 0, 0, expectedDuty(80), expectedDuty(-80));
+    vTaskDelay(pdMS_TO_TICKS(60));
+    bool isExpired = !MotorManager::isStopHinted() && checkControl(motorManager, 0, 60, 0, 0, expectedDuty(60), expectedDuty(60));
+    MotorManager::setStopHint(1000);
+    MotorManager::clearStopHint();
+    UNIT_CHECK(isHeld && isExpired && !MotorManager::isStopHinted());
+    return true;
+}
+
+/**
+ * @brief The control task applies the control data in a few periods, and stopMotorControls() stops the motors.
+ */
+static bool checkMotorControls(MotorManager* motorManager) {
+    motorManager->startMotorControls();
+    UNIT_CHECK(checkDuties(MOTOR_OFF, MOTOR_OFF)); // An old command is not continued
+
+    motorManager->setControlData(0, 60, 0, 0);
+    vTaskDelay(pdMS_TO_TICKS(DIRECTION_CONTROL_LOOPS * MOTOR_CONTROL_PERIOD_MS));
+    bool isApplied = checkDuties(expectedDuty(60), expectedDuty(60));
+
+    motorManager->stopMotorControls();
+    UNIT_CHECK(!MotorManager::isMotorControlRunning()); // The task ended by itself
+    UNIT_CHECK(isApplied);
+    UNIT_CHECK(checkDuties(MOTOR_OFF, MOTOR_OFF));
+    ControlData controlData = motorManager->getControlData();
+    UNIT_CHECK(controlData.X == 0 && controlData.Y == 0 && controlData.L == 0 && controlData.R == 0);
+    return true;
+}
+
+/**
+ * @brief Unit test for Motor Manager
+ *
+ * @param isLoop
+ *
+ * @note Test cases:
+ * getInstance,
+ * directionControlManual (every branch, duties and time of one iteration),
+ * setStopHint (forward moves held until it expires, backward and turns allowed), clearStopHint,
+ * startMotorControls (the task applies the control data),
+ * stopMotorControls (motors stopped, control data cleared),
+ * deinit
+ */
+bool UnitTests::MotorManagerUnitTest(bool isLoop) {
+    TEST_START("Motor Manager");
+    do {
+        UNIT_PRINT("Getting Motor manager instance...");
+        MotorManager* motorManager = MotorManager::getInstance();
+        if (!motorManager) {
+            UNIT_PRINT("Motor manager instance is nullptr...");
+            TEST_END_FAILED("Motor Manager");
+            return false;
+        }
+        bool passed = true;
+
+        UNIT_PRINT("Mixer...");
+        passed = checkMixer(motorManager) && passed;
+        motorManager->setControlData(0, 0, 0, 0);
+        motorManager->directionControlManual();
+
+        UNIT_PRINT("Stop hint...");
+        passed = checkStopHint(motorManager) && passed;
+        motorManager->setControlData(0, 0, 0, 0);
+        motorManager->directionControlManual();
+
+        UNIT_PRINT("Motor controls task...");
+        passed = checkMotorControls(motorManager) && passed;
+
+        UNIT_PRINT("Deinit Motor manager...");
+        MotorManager::deinit();
+
+        if (!passed) {
+            TEST_END_FAILED("Motor Manager");
+            return false;
+        }
+        TEST_END_PASSED("Motor Manager");
+    } while (isLoop);
+    return true;
+}
+
+#endif
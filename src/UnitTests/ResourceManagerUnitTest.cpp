@@ -0,0 +1,124 @@
+/*
+ * File: ResourceManagerUnitTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "UnitTests.h"
+
+#ifdef UNIT_TESTS
+
+#include <string.h>
+
+#define FIRST_SAMPLE_TIMEOUT_MS     500
+
+// Test cases -----------------------------------------------------------
+static ResourceSample testSample; // Too big for the stack of the test task
+
+static bool checkSample(ResourceManager* resourceManager) {
+    resourceManager->sample(testSample);
+    UNIT_CHECK(testSample.internalHeap.freeBytes > 0);
+    UNIT_CHECK(testSample.internalHeap.minFreeBytes <= testSample.internalHeap.freeBytes);
+    UNIT_CHECK(testSample.internalHeap.largestFreeBlock > 0);
+    UNIT_CHECK(testSample.hasPsram || testSample.psramHeap.freeBytes == 0);
+    UNIT_CHECK(testSample.taskCount > 0);
+    UNIT_CHECK(testSample.lowestStackTask >= 0 && testSample.lowestStackTask < testSample.taskCount);
+
+    bool isMonitorFound = false;
+    for (uint8_t i = 0; i < testSample.taskCount; i++) {
+        const ResourceTaskStats& task = testSample.tasks[i];
+        UNIT_CHECK(task.cpuPermille <= 1000);
+        UNIT_CHECK(task.stackHighWaterMark >= testSample.tasks[testSample.lowestStackTask].stackHighWaterMark);
+        isMonitorFound = isMonitorFound || strcmp(task.name, "RES_MON") == 0;
+    }
+    UNIT_CHECK(isMonitorFound);
+
+    const ResourceTaskStats& lowest = testSample.tasks[testSample.lowestStackTask];
+    UNIT_PRINT("Internal heap: %lu free, %lu min, %lu largest block, PSRAM: %lu free, %lu largest block",
+               (unsigned long)testSample.internalHeap.freeBytes, (unsigned long)testSample.internalHeap.minFreeBytes,
+               (unsigned long)testSample.internalHeap.largestFreeBlock, (unsigned long)testSample.psramHeap.freeBytes,
+               (unsigned long)testSample.psramHeap.largestFreeBlock);
+    UNIT_PRINT("%u tasks, least free stack: %s (%lu bytes)", testSample.taskCount, lowest.name, (unsigned long)lowest.stackHighWaterMark);
+    return true;
+}
+
+/**
+ * @brief The same sample against thresholds below and above its values (the hysteresis is covered by the host test).
+ */
+static bool checkAlarms() {
+    const ResourceThresholds low = { 0, 0, 0, 0 };
+    UNIT_CHECK(ResourceManager::evaluateAlarms(testSample, low, RESOURCE_ALARM_NONE) == RESOURCE_ALARM_NONE);
+
+    const ResourceThresholds high = { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX };
+    uint8_t expected = RESOURCE_ALARM_STACK | RESOURCE_ALARM_INTERNAL_FREE | RESOURCE_ALARM_INTERNAL_BLOCK |
+                       (testSample.hasPsram ? RESOURCE_ALARM_PSRAM_FREE : RESOURCE_ALARM_NONE);
+    UNIT_CHECK(ResourceManager::evaluateAlarms(testSample, high, RESOURCE_ALARM_NONE) == expected);
+    return true;
+}
+
+static bool checkMonitorTask(ResourceManager* resourceManager) {
+    // The monitor task samples as soon as it starts
+    bool hasSample = false;
+    for (uint16_t waitedMs = 0; !hasSample && waitedMs < FIRST_SAMPLE_TIMEOUT_MS; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        hasSample = resourceManager->getLastSample(testSample);
+    }
+    UNIT_CHECK(hasSample);
+    UNIT_CHECK(testSample.taskCount > 0);
+    UNIT_PRINT("Active alarms: 0x%02x", ResourceManager::getActiveAlarms());
+
+    resourceManager->stopMonitorTask();
+    UNIT_CHECK(ResourceManager::getActiveAlarms() == RESOURCE_ALARM_NONE);
+    resourceManager->startMonitorTask();
+    return true;
+}
+
+/**
+ * @brief Unit test for the resource manager
+ *
+ * @param isLoop
+ *
+ * @note Test cases:
+ * sampling (heap stats, task stats, the monitor task is listed, the lowest stack task),
+ * alarms of a real sample (thresholds below and above every value),
+ * monitor task (first sample, stop clears the alarms, restart)
+ */
+bool UnitTests::ResourceManagerUnitTest(bool isLoop) {
+    TEST_START("Resource manager");
+    do {
+        ResourceManager::init();
+        ResourceManager* resourceManager = ResourceManager::getInstance();
+        if (!resourceManager) {
+            UNIT_PRINT("Resource manager init failed...");
+            TEST_END_FAILED("Resource manager");
+            return false;
+        }
+        bool passed = true;
+
+        UNIT_PRINT("Monitor task...");
+        passed = checkMonitorTask(resourceManager) && passed;
+
+        UNIT_PRINT("Sample...");
+        passed = checkSample(resourceManager) && passed;
+
+        UNIT_PRINT("Alarms...");
+        passed = checkAlarms() && passed;
+
+        ResourceManager::deinit();
+        if (!passed) {
+            TEST_END_FAILED("Resource manager");
+            return false;
+        }
+        TEST_END_PASSED("Resource manager");
+    } while (isLoop);
+    return true;
+}
+
+#endif
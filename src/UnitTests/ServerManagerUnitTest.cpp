@@ -0,0 +1,106 @@
+/*
+ * File: ServerManagerUnitTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "UnitTests.h"
+
+#ifdef UNIT_TESTS
+
+/*
+    The servers are started and stopped without a client (the Wi-Fi is not needed). The handlers are checked
+    with injected requests in the host build (host/test/ServerManagerHostTest.cpp).
+*/
+#define SERVER_START_MAX_US         100000  // httpd_start: the server task, the control socket and the listening socket
+#define SERVER_STOP_MAX_US          100000
+#define SERVER_CYCLES               10
+#define SERVER_HEAP_TOLERANCE       1024    // bytes, allocations of the other tasks during the cycles
+
+static bool checkStartStop(ServerManager* serverManager) {
+    UNIT_CHECK_TIME_US(serverManager->startCommandServer(), SERVER_START_MAX_US);
+    UNIT_CHECK(serverManager->isCommandServerRunning());
+    serverManager->startCommandServer(); // Already running, nothing happens
+    UNIT_CHECK(serverManager->isCommandServerRunning());
+
+    UNIT_CHECK_TIME_US(serverManager->startVideoServer(), SERVER_START_MAX_US);
+    UNIT_CHECK(serverManager->isVideoServerRunning());
+
+    UNIT_CHECK_TIME_US(serverManager->stopVideoServer(), SERVER_STOP_MAX_US);
+    UNIT_CHECK(!serverManager->isVideoServerRunning());
+    UNIT_CHECK(serverManager->isCommandServerRunning());
+
+    UNIT_CHECK_TIME_US(serverManager->stopCommandServer(), SERVER_STOP_MAX_US);
+    UNIT_CHECK(!serverManager->isCommandServerRunning());
+    serverManager->stopCommandServer(); // Not running, nothing happens
+    return true;
+}
+
+/**
+ * @brief Start and stop the servers a few times, the free heap has to come back (the first cycle is the baseline,
+ * the lazy allocations of the network stack are done by then).
+ */
+static bool checkHeap(ServerManager* serverManager) {
+    serverManager->startServers();
+    serverManager->stopServers();
+    size_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    for (uint8_t i = 0; i < SERVER_CYCLES; i++) {
+        serverManager->startServers();
+        serverManager->stopServers();
+    }
+    size_t freeAfter = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    UNIT_PRINT("Free heap before: %u, after %d cycles: %u", unsigned(freeBefore), SERVER_CYCLES, unsigned(freeAfter));
+    UNIT_CHECK(freeAfter + SERVER_HEAP_TOLERANCE >= freeBefore);
+    return true;
+}
+
+/**
+ * @brief Unit test for Server Manager
+ *
+ * @param isLoop
+ *
+ * @note Test cases:
+ * getInstance,
+ * startCommandServer, startVideoServer (time, running, started twice),
+ * stopVideoServer, stopCommandServer (time, stopped, stopped twice),
+ * start and stop cycles (no leaked memory),
+ * deinit
+ */
+bool UnitTests::ServerManagerUnitTest(bool isLoop) {
+    TEST_START("Server Manager");
+    do {
+        UNIT_PRINT("Getting Server manager instance...");
+        ServerManager* serverManager = ServerManager::getInstance();
+        if (!serverManager) {
+            UNIT_PRINT("Server manager instance is nullptr...");
+            TEST_END_FAILED("Server Manager");
+            return false;
+        }
+        bool passed = true;
+
+        UNIT_PRINT("Start and stop...");
+        passed = checkStartStop(serverManager) && passed;
+
+        UNIT_PRINT("Start and stop cycles (%d)...", SERVER_CYCLES);
+        passed = checkHeap(serverManager) && passed;
+
+        UNIT_PRINT("Deinit Server manager...");
+        ServerManager::deinit();
+
+        if (!passed) {
+            TEST_END_FAILED("Server Manager");
+            return false;
+        }
+        TEST_END_PASSED("Server Manager");
+    } while (isLoop);
+    return true;
+}
+
+#endif
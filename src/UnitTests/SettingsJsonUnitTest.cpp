@@ -0,0 +1,233 @@
+/*
+ * File: SettingsJsonUnitTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Wednesday, 5th March 2025 9:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Wednesday, 5th March 2025 9:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "UnitTests.h"
+
+#ifdef UNIT_TESTS
+
+#include <string.h>
+
+#define FUZZ_ITERATIONS         5000
+#define BENCHMARK_ITERATIONS    1000
+
+// Fuzzing --------------------------------------------------------------
+static uint32_t fuzzState = 0x2545F491;
+
+static uint32_t fuzzRandom() { // xorshift32, reproducible on every run
+    fuzzState ^= fuzzState << 13;
+    fuzzState ^= fuzzState >> 17;
+    fuzzState ^= fuzzState << 5;
+    return fuzzState;
+}
+
+static const char* VALID_PAYLOADS[] = {
+    "{\"ssid\":\"Home\",\"password\":\"secret\",\"color\":2}",
+    "{ \"color\" : 0 }",
+    "{\"ssid\":\"A \\\"quoted\\\" \\u0041\"}",
+    "{}"
+};
+
+/**
+ * @brief Mutate a valid payload (flip, insert, delete, truncate bytes), and check that the parser
+ * either rejects it, or returns settings which are in range. The input has no terminating zero,
+ * so reading past the length would be caught by the guard bytes.
+ */
+static bool fuzzSettingsParser() {
+    char payload[SETTINGS_JSON_MAX_LENGTH + 8];
+    for (uint32_t i = 0; i < FUZZ_ITERATIONS; i++) {
+        const char* seed = VALID_PAYLOADS[fuzzRandom() % (sizeof(VALID_PAYLOADS) / sizeof(VALID_PAYLOADS[0]))];
+        size_t length = strlen(seed);
+        memcpy(payload, seed, length);
+
+        uint8_t mutations = 1 + fuzzRandom() % 4;
+        for (uint8_t m = 0; m < mutations && length > 0; m++) {
+            size_t at = fuzzRandom() % length;
+            switch (fuzzRandom() % 4) {
+                case 0: payload[at] = char(fuzzRandom()); break;                                    // Flip
+                case 1: if (length < SETTINGS_JSON_MAX_LENGTH) {                                     // Insert
+                            memmove(payload + at + 1, payload + at, length - at);
+                            payload[at] = char(fuzzRandom());
+                            length++;
+                        }
+                        break;
+                case 2: memmove(payload + at, payload + at + 1, length - at - 1); length--; break;   // Delete
+                case 3: length = at; break;                                                          // Truncate
+            }
+        }
+        memset(payload + length, '"', sizeof(payload) - length); // Guard bytes, they would change the result if read
+
+        SettingsUpdate update;
+        if (SettingsJson::parse(payload, length, SETTINGS_FIELD_ALL, update)) {
+            if ((update.fields & SETTINGS_FIELD_SSID) && (update.ssid[0] == '\0' || strlen(update.ssid) > STORAGE_MAX_STRING_LENGTH)) { return false; }
+            if ((update.fields & SETTINGS_FIELD_PASSWORD) && strlen(update.password) > STORAGE_MAX_STRING_LENGTH) { return false; }
+            if ((update.fields & SETTINGS_FIELD_COLOR) && (update.colorNumber < 0 || update.colorNumber > STORAGE_MAX_COLOR_NUMBER)) { return false; }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Write random ASCII strings (with control characters and quotes) with the writer, and read them back.
+ */
+static bool fuzzRoundTrip() {
+    char value[JSON_MAX_STRING_LENGTH + 1];
+    char json[SETTINGS_JSON_MAX_LENGTH];
+    for (uint32_t i = 0; i < FUZZ_ITERATIONS; i++) {
+        size_t length = fuzzRandom() % (JSON_MAX_STRING_LENGTH / 6); // Fits even if every character is escaped (\u00XX)
+        for (size_t c = 0; c < length; c++) { value[c] = char(1 + fuzzRandom() % 0x7E); }
+        value[length] = '\0';
+        int32_t number = int32_t(fuzzRandom());
+
+        JsonWriter writer(json, sizeof(json));
+        writer.beginObject();
+        writer.field("value", value);
+        writer.field("number", number);
+        writer.field("flag", (number & 1) != 0);
+        writer.endObject();
+        if (writer.isOverflow()) { return false; }
+
+        JsonReader reader(writer.c_str(), writer.length());
+        JsonField field;
+        if (!reader.nextField(field) || field.type != JSON_STRING || strcmp(field.key, "value") != 0 || strcmp(field.string, value) != 0) { return false; }
+        if (!reader.nextField(field) || field.type != JSON_NUMBER || field.number != number) { return false; }
+        if (!reader.nextField(field) || field.type != JSON_BOOL || field.boolean != ((number & 1) != 0)) { return false; }
+        if (reader.nextField(field) || !reader.isFinished()) { return false; }
+    }
+    return true;
+}
+
+// Test cases -----------------------------------------------------------
+static bool checkSettingsJson() {
+    bool passed = true;
+    char json[SETTINGS_JSON_MAX_LENGTH];
+
+    size_t length = SettingsJson::write(json, sizeof(json), "My \"net\"", 2);
+    if (length == 0 || strcmp(json, "{\"ssid\":\"My \\\"net\\\"\",\"color\":2}") != 0) {
+        UNIT_PRINT("Unexpected settings JSON: %s", json);
+        passed = false;
+    }
+    if (SettingsJson::write(json, 8, "ssid", 1) != 0) {
+        UNIT_PRINT("Truncated settings JSON is not reported...");
+        passed = false;
+    }
+
+    SettingsUpdate update;
+    const char* batch = "{\"ssid\":\"Home\",\"password\":\"secret\",\"color\":3}";
+    if (!SettingsJson::parse(batch, strlen(batch), SETTINGS_FIELD_ALL, update) || update.fields != SETTINGS_FIELD_ALL ||
+        strcmp(update.ssid, "Home") != 0 || strcmp(update.password, "secret") != 0 || update.colorNumber != 3) {
+        UNIT_PRINT("Batch settings are not parsed...");
+        passed = false;
+    }
+
+    const char* invalid[] = {
+        "{\"color\":4}",                                        // Out of range
+        "{\"color\":\"2\"}",                                    // Wrong type
+        "{\"ssid\":\"\"}",                                      // Empty SSID
+        "{\"ssid\":\"0123456789012345678901234567890\"}",       // Too long SSID
+        "{\"color\":1,\"color\":2}",                            // Duplicated
+        "{\"name\":\"drone\"}",                                 // Unknown
+        "{\"color\":1}x",                                       // Trailing data
+        "{\"color\":1,}",                                       // Trailing comma
+        "{\"color\":{}}",                                       // Nested
+        "{\"color\":1.5}",                                      // Fraction
+        "{\"color\":1"                                          // Not terminated
+    };
+    for (uint8_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        if (SettingsJson::parse(invalid[i], strlen(invalid[i]), SETTINGS_FIELD_ALL, update)) {
+            UNIT_PRINT("Invalid settings accepted: %s", invalid[i]);
+            passed = false;
+        }
+    }
+
+    const char* notAllowed = "{\"password\":\"secret\"}";
+    if (SettingsJson::parse(notAllowed, strlen(notAllowed), SETTINGS_FIELD_COLOR, update)) {
+        UNIT_PRINT("Not allowed field accepted...");
+        passed = false;
+    }
+    return passed;
+}
+
+/**
+ * @brief Serialize and parse the settings (the work of one /gst and one /set request) many times,
+ * and print the time and the heap usage per request.
+ */
+static bool benchmarkSettingsJson() {
+    char json[SETTINGS_JSON_MAX_LENGTH];
+    const char* batch = "{\"ssid\":\"Home network\",\"password\":\"a long secret pass\",\"color\":1}";
+    SettingsUpdate update;
+
+    size_t freeHeapBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t minimumFreeHeapBefore = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    int64_t startUs = Hal::Timer::getTimeUs();
+    for (uint32_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        if (SettingsJson::write(json, sizeof(json), "Home network", 1) == 0) { return false; }
+        if (!SettingsJson::parse(batch, strlen(batch), SETTINGS_FIELD_ALL, update)) { return false; }
+    }
+    int64_t elapsedUs = Hal::Timer::getTimeUs() - startUs;
+    size_t freeHeapAfter = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t minimumFreeHeapAfter = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+
+    UNIT_PRINT("Settings JSON: %lu ns per request (write + parse)", (unsigned long)(elapsedUs * 1000 / BENCHMARK_ITERATIONS));
+    UNIT_PRINT("Heap used per request: %ld bytes, heap low-water mark change: %ld bytes",
+               (long)(freeHeapBefore - freeHeapAfter) / BENCHMARK_ITERATIONS, (long)(minimumFreeHeapBefore - minimumFreeHeapAfter));
+    return freeHeapBefore == freeHeapAfter && minimumFreeHeapBefore == minimumFreeHeapAfter;
+}
+
+/**
+ * @brief Unit test for the settings JSON API (JsonWriter, JsonReader, SettingsJson)
+ *
+ * @param isLoop
+ *
+ * @note Test cases:
+ * settings JSON write (escaping, truncation),
+ * settings JSON parse (batch, invalid and not allowed fields),
+ * fuzzed payloads (mutated valid payloads, no over-read, results in range),
+ * writer -> reader round trip (random strings, numbers, booleans),
+ * benchmark (time and heap per request, no heap should be used)
+ */
+bool UnitTests::SettingsJsonUnitTest(bool isLoop) {
+    TEST_START("Settings JSON");
+    do {
+        bool passed = true;
+
+        UNIT_PRINT("Settings JSON write and parse...");
+        passed = checkSettingsJson() && passed;
+
+        UNIT_PRINT("Fuzzing the settings parser (%d payloads)...", FUZZ_ITERATIONS);
+        if (!fuzzSettingsParser()) {
+            UNIT_PRINT("The parser accepted out of range settings...");
+            passed = false;
+        }
+
+        UNIT_PRINT("Fuzzing the writer -> reader round trip (%d objects)...", FUZZ_ITERATIONS);
+        if (!fuzzRoundTrip()) {
+            UNIT_PRINT("Round trip failed...");
+            passed = false;
+        }
+
+        UNIT_PRINT("Benchmark (%d requests)...", BENCHMARK_ITERATIONS);
+        if (!benchmarkSettingsJson()) {
+            UNIT_PRINT("The settings JSON used the heap...");
+            passed = false;
+        }
+
+        if (!passed) {
+            TEST_END_FAILED("Settings JSON");
+            return false;
+        }
+        TEST_END_PASSED("Settings JSON");
+    } while (isLoop);
+    return true;
+}
+
+#endif
@@ -15,7 +15,81 @@
 
 #ifdef UNIT_TESTS
 
-void UnitTests::StorageManagerUnitTest(bool isLoop) {
+//#define STORAGE_RESTART_TEST  // The data survives an esp_restart(), interactive (run the test twice)
+
+#define STORAGE_TEST_SSID       "Test ssid 01"
+#define STORAGE_TEST_PASSWORD   "Test password 01"
+#define STORAGE_TEST_COLOR      5
+
+#ifdef STORAGE_RESTART_TEST
+static void checkRestart(StorageManager* storageManager) {
+    if (storageManager->getColorNumber() != STORAGE_TEST_COLOR) {
+        UNIT_PRINT("Getting all data from storage (Nothing should be stored yet)...");
+    
+        UNIT_PRINT("WiFi SSID: %s", storageManager->getWiFiSSID().c_str());
+        UNIT_PRINT("WiFi Password: %s", storageManager->getWiFiPassword().c_str());
+        UNIT_PRINT("Color Number: %d", storageManager->getColorNumber());
+
+        UNIT_PRINT("Setting WiFi SSID to '%s'...", STORAGE_TEST_SSID);
+        storageManager->setWiFiSSID(STORAGE_TEST_SSID);
+
+        UNIT_PRINT("Setting WiFi Password to '%s'...", STORAGE_TEST_PASSWORD);
+        storageManager->setWiFiPassword(STORAGE_TEST_PASSWORD);
+
+        UNIT_PRINT("Setting Color Number to %d...", STORAGE_TEST_COLOR);
+        storageManager->setColorNumber(STORAGE_TEST_COLOR);
+
+        UNIT_PRINT("Restarting ESP32 in 5 seconds...");
+        vTaskDelay(5000 / portTICK_PERIOD_MS);
+        TEST_END_PASSED("If the ESP32 restarts and the data is stored, this text will not be printed again.");
+
+        UNIT_PRINT("Deinit Storage manager...");
+        StorageManager::deinit();
+
+        UNIT_PRINT("Restarting ESP32...");
+        esp_restart();
+    } else {
+        UNIT_PRINT("Getting all data from storage (After restart)...");
+
+        UNIT_PRINT("WiFi SSID: %s", storageManager->getWiFiSSID().c_str());
+        UNIT_PRINT("WiFi Password: %s", storageManager->getWiFiPassword().c_str());
+        UNIT_PRINT("Color Number: %d", storageManager->getColorNumber());
+    }
+}
+#endif
+
+/**
+ * @brief Write the test values, reinit the manager (the values are read back from the NVS) and compare.
+ */
+static bool checkPersistence(StorageManager* storageManager) {
+    storageManager->setWiFiSSID(STORAGE_TEST_SSID);
+    storageManager->setWiFiPassword(STORAGE_TEST_PASSWORD);
+    storageManager->setColorNumber(STORAGE_TEST_COLOR);
+
+    StorageManager::deinit();
+    StorageManager::init();
+    storageManager = StorageManager::getInstance();
+    UNIT_CHECK(storageManager != nullptr);
+    storageManager->getAllDataFromStorage();
+
+    UNIT_CHECK(storageManager->getWiFiSSID() == STORAGE_TEST_SSID);
+    UNIT_CHECK(storageManager->getWiFiPassword() == STORAGE_TEST_PASSWORD);
+    UNIT_CHECK(storageManager->getColorNumber() == STORAGE_TEST_COLOR);
+    return true;
+}
+
+/**
+ * @brief Unit test for Storage Manager
+ *
+ * @param isLoop
+ *
+ * @note Test cases:
+ * init,
+ * set and read back the Wi-Fi credentials and the color after a reinit (the stored values are restored after),
+ * the data survives a restart (STORAGE_RESTART_TEST),
+ * deinit
+ */
+bool UnitTests::StorageManagerUnitTest(bool isLoop) {
     TEST_START("Storage Manager");
     do {
         UNIT_PRINT("Init Storage manager...");
@@ -26,46 +100,39 @@ void UnitTests::StorageManagerUnitTest(bool isLoop) {
         if (!storageManager) {
             UNIT_PRINT("Storage manager instance is nullptr...");
             TEST_END_FAILED("Storage Manager");
-            return;
+            return false;
         }
         storageManager->getAllDataFromStorage();
-        if (storageManager->getColorNumber() != 5) {
-            UNIT_PRINT("Getting all data from storage (Nothing should be stored yet)...");
-        
-            UNIT_PRINT("WiFi SSID: %s", storageManager->getWiFiSSID().c_str());
-            UNIT_PRINT("WiFi Password: %s", storageManager->getWiFiPassword().c_str());
-            UNIT_PRINT("Color Number: %d", storageManager->getColorNumber());
-
-            UNIT_PRINT("Setting WiFi SSID to 'Test ssid 01'...");
-            storageManager->setWiFiSSID("Test ssid 01");
 
-            UNIT_PRINT("Setting WiFi Password to 'Test password 01'...");
-            storageManager->setWiFiPassword("Test password 01");
+#ifdef STORAGE_RESTART_TEST
+        checkRestart(storageManager);
+#else
+        UNIT_PRINT("Saving the stored data...");
+        std::string ssid = storageManager->getWiFiSSID();
+        std::string password = storageManager->getWiFiPassword();
+        int8_t colorNumber = storageManager->getColorNumber();
 
-            UNIT_PRINT("Setting Color Number to 5...");
-            storageManager->setColorNumber(5);
+        UNIT_PRINT("Write, reinit and read back...");
+        bool passed = checkPersistence(storageManager);
 
-            UNIT_PRINT("Restarting ESP32 in 5 seconds...");
-            vTaskDelay(5000 / portTICK_PERIOD_MS);
-            TEST_END_PASSED("If the ESP32 restarts and the data is stored, this text will not be printed again.");
-
-            UNIT_PRINT("Deinit Storage manager...");
-            StorageManager::deinit();
-
-            UNIT_PRINT("Restarting ESP32...");
-            esp_restart();
-        } else {
-            UNIT_PRINT("Getting all data from storage (After restart)...");
-
-            UNIT_PRINT("WiFi SSID: %s", storageManager->getWiFiSSID().c_str());
-            UNIT_PRINT("WiFi Password: %s", storageManager->getWiFiPassword().c_str());
-            UNIT_PRINT("Color Number: %d", storageManager->getColorNumber());
+        UNIT_PRINT("Restoring the stored data...");
+        storageManager = StorageManager::getInstance();
+        storageManager->setWiFiSSID(ssid.c_str());
+        storageManager->setWiFiPassword(password.c_str());
+        storageManager->setColorNumber(colorNumber);
+#endif
 
-            UNIT_PRINT("Deinit Storage manager...");
-            StorageManager::deinit();
-            TEST_END_PASSED("Storage Manager");
+        UNIT_PRINT("Deinit Storage manager...");
+        StorageManager::deinit();
+#ifndef STORAGE_RESTART_TEST
+        if (!passed) {
+            TEST_END_FAILED("Storage Manager");
+            return false;
         }
+#endif
+        TEST_END_PASSED("Storage Manager");
     } while (isLoop);
+    return true;
 }
 
 #endif
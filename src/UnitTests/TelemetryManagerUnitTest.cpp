@@ -0,0 +1,161 @@
+/*
+ * File: TelemetryManagerUnitTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Thursday, 6th March 2025 9:05:37 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Thursday, 6th March 2025 9:05:37 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "UnitTests.h"
+
+#ifdef UNIT_TESTS
+
+#define OVERHEAD_ITERATIONS         100000
+#define OVERHEAD_MAX_PERMILLE       1       // Max overhead of the counters in one motor loop period (0.1%)
+#define RATE_TOLERANCE_PERCENT      20
+
+// Test cases -----------------------------------------------------------
+static bool checkRates() {
+    bool passed = true;
+    if (TelemetryManager::ratePerSecond(25, 1000000, 10) != 250) { passed = false; }    // 25 fps, one decimal
+    if (TelemetryManager::ratePerSecond(5000, 100000) != 50000) { passed = false; }     // 5000 bytes in 100 ms
+    if (TelemetryManager::ratePerSecond(100, 0) != 0) { passed = false; }               // No time elapsed
+    if (TelemetryManager::ratePerSecond(UINT32_MAX, 1, 10) != UINT32_MAX) { passed = false; } // Saturated
+    if (!passed) { UNIT_PRINT("Unexpected rate..."); }
+    return passed;
+}
+
+static bool checkFrame(TelemetryManager* telemetryManager) {
+    bool passed = true;
+    TelemetryFrame frame;
+
+    TelemetryManager::recordMotorDuties(-150, 97);
+    TelemetryManager::recordControlData();
+    size_t length = telemetryManager->sampleFrame(frame);
+    const TelemetryFrameHeader& header = frame.header;
+    if (header.magic != TELEMETRY_FRAME_MAGIC || header.version != TELEMETRY_FRAME_VERSION) {
+        UNIT_PRINT("Invalid frame header...");
+        passed = false;
+    }
+    if (length != header.length || length != sizeof(TelemetryFrameHeader) + header.taskCount * sizeof(TelemetryTaskEntry)) {
+        UNIT_PRINT("Invalid frame length: %u (%u tasks)", (unsigned)length, header.taskCount);
+        passed = false;
+    }
+    if (header.leftMotorDuty != -150 || header.rightMotorDuty != 97) {
+        UNIT_PRINT("Invalid motor duties: %d, %d", header.leftMotorDuty, header.rightMotorDuty);
+        passed = false;
+    }
+    if (header.largestFreeInternalBlock == 0) {
+        UNIT_PRINT("Invalid largest internal block: %lu", (unsigned long)header.largestFreeInternalBlock);
+        passed = false;
+    }
+    if (header.controlDataAgeMs > 100) {
+        UNIT_PRINT("Invalid control data age: %lu ms", (unsigned long)header.controlDataAgeMs);
+        passed = false;
+    }
+
+    // 10 frames of 1000 bytes in 100 ms: 100 fps, 100000 bytes/sec
+    uint32_t sequence = header.sequence;
+    for (uint8_t i = 0; i < 10; i++) { TelemetryManager::recordStreamFrame(1000); }
+    vTaskDelay(pdMS_TO_TICKS(100));
+    telemetryManager->sampleFrame(frame);
+    if (frame.header.sequence != sequence + 1) {
+        UNIT_PRINT("The sequence is not continuous...");
+        passed = false;
+    }
+    if (frame.header.cameraFpsX10 < 1000 * (100 - RATE_TOLERANCE_PERCENT) / 100 || frame.header.cameraFpsX10 > 1000 * (100 + RATE_TOLERANCE_PERCENT) / 100 ||
+        frame.header.streamBytesPerSec < 100000 * (100 - RATE_TOLERANCE_PERCENT) / 100 || frame.header.streamBytesPerSec > 100000 * (100 + RATE_TOLERANCE_PERCENT) / 100) {
+        UNIT_PRINT("Invalid stream rates: %u.%u fps, %lu bytes/sec", frame.header.cameraFpsX10 / 10, frame.header.cameraFpsX10 % 10,
+                   (unsigned long)frame.header.streamBytesPerSec);
+        passed = false;
+    }
+
+    // The busiest tasks first, a task can not use more than one core
+    for (uint8_t i = 0; i < frame.header.taskCount; i++) {
+        if (frame.tasks[i].cpuPermille > 1000 || (i > 0 && frame.tasks[i].cpuPermille > frame.tasks[i - 1].cpuPermille) ||
+            frame.tasks[i].stackHighWaterMark == 0) {
+            UNIT_PRINT("Invalid task entry: %.8s %u", frame.tasks[i].name, frame.tasks[i].cpuPermille);
+            passed = false;
+        }
+    }
+    UNIT_PRINT("Frame: %u bytes, %u tasks, RSSI %d dBm, free heap %lu (internal) %lu (PSRAM)", frame.header.length, frame.header.taskCount,
+               frame.header.rssi, (unsigned long)frame.header.freeInternalHeap, (unsigned long)frame.header.freePsramHeap);
+    return passed;
+}
+
+/**
+ * @brief Measure the cost of the counters in the motor loop (one duty record per iteration, plus one control data record
+ * per /mov command), and compare it to the motor loop period.
+ */
+static bool checkMotorLoopOverhead() {
+    volatile int16_t sink = 0;
+
+    // Baseline: the same loop with plain stores
+    int64_t startUs = Hal::Timer::getTimeUs();
+    for (uint32_t i = 0; i < OVERHEAD_ITERATIONS; i++) { sink = int16_t(i); }
+    int64_t baselineUs = Hal::Timer::getTimeUs() - startUs;
+
+    startUs = Hal::Timer::getTimeUs();
+    for (uint32_t i = 0; i < OVERHEAD_ITERATIONS; i++) {
+        TelemetryManager::recordMotorDuties(int16_t(i), -int16_t(i));
+        TelemetryManager::recordControlData();
+    }
+    int64_t countersUs = Hal::Timer::getTimeUs() - startUs;
+    (void)sink;
+
+    int64_t overheadNs = (countersUs - baselineUs) * 1000 / OVERHEAD_ITERATIONS;
+    if (overheadNs < 0) { overheadNs = 0; }
+    UNIT_PRINT("Counter overhead: %ld ns per motor loop iteration (period: %d ms)", (long)overheadNs, MOTOR_CONTROL_PERIOD_MS);
+    return overheadNs * 1000 <= int64_t(MOTOR_CONTROL_PERIOD_MS) * 1000000 * OVERHEAD_MAX_PERMILLE;
+}
+
+/**
+ * @brief Unit test for the telemetry manager
+ *
+ * @param isLoop
+ *
+ * @note Test cases:
+ * rate calculation (scale, no elapsed time, saturation),
+ * frame sampling (header, length, motor duties, largest block, control data age, sequence, stream rates, task order and stacks),
+ * counter overhead in the motor loop (less than 0.1% of the period)
+ */
+bool UnitTests::TelemetryManagerUnitTest(bool isLoop) {
+    TEST_START("Telemetry manager");
+    do {
+        TelemetryManager::init();
+        TelemetryManager* telemetryManager = TelemetryManager::getInstance();
+        if (!telemetryManager) {
+            UNIT_PRINT("Telemetry manager init failed...");
+            TEST_END_FAILED("Telemetry manager");
+            return false;
+        }
+        bool passed = true;
+
+        UNIT_PRINT("Rates...");
+        passed = checkRates() && passed;
+
+        UNIT_PRINT("Frames...");
+        passed = checkFrame(telemetryManager) && passed;
+
+        UNIT_PRINT("Motor loop overhead (%d iterations)...", OVERHEAD_ITERATIONS);
+        if (!checkMotorLoopOverhead()) {
+            UNIT_PRINT("The counters slow down the motor loop...");
+            passed = false;
+        }
+
+        TelemetryManager::deinit();
+        if (!passed) {
+            TEST_END_FAILED("Telemetry manager");
+            return false;
+        }
+        TEST_END_PASSED("Telemetry manager");
+    } while (isLoop);
+    return true;
+}
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ * File: TraceManagerUnitTest.cpp
+ * Project: drone_r6_fw
+ * File Created: Sunday, 9th March 2025 5:48:10 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Sunday, 9th March 2025 5:48:10 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "UnitTests.h"
+
+#ifdef UNIT_TESTS
+
+#include <stdio.h>
+#include <string.h>
+
+#define WRAPAROUND_EXTRA_SPANS      37
+#define EXPORT_BUFFER_SIZE          (16 * 1024)
+#define OUTER_SPAN_US               300
+#define INNER_SPAN_US               100
+#define OVERHEAD_ITERATIONS         10000
+#define OVERHEAD_MAX_NS             2000    // Max cost of one span (two clock reads and one ring write)
+
+// Helpers --------------------------------------------------------------
+static void busyWait(int64_t us) {
+    int64_t endUs = Hal::Timer::getTimeUs() + us + 1; // The timer has 1 us resolution, at least us elapses
+    while (Hal::Timer::getTimeUs() < endUs) {}
+}
+
+struct ExportCapture {
+    char data[EXPORT_BUFFER_SIZE];
+    size_t length;
+    bool isOverflowed;
+};
+
+static void captureExport(const char* data, size_t length, void* context) {
+    ExportCapture* capture = static_cast<ExportCapture*>(context);
+    if (capture->length + length >= sizeof(capture->data)) {
+        capture->isOverflowed = true;
+        return;
+    }
+    memcpy(capture->data + capture->length, data, length);
+    capture->length += length;
+    capture->data[capture->length] = '\0';
+}
+
+/*
+    Minimal JSON syntax check (objects, arrays, strings, numbers, literals), enough to catch a broken export.
+*/
+static bool skipJsonValue(const char*& json, uint8_t depth);
+
+static void skipJsonWhitespace(const char*& json) {
+    while (*json == ' ' || *json == '\n' || *json == '\r' || *json == '\t') { json++; }
+}
+
+static bool skipJsonString(const char*& json) {
+    if (*json != '"') { return false; }
+    for (json++; *json && *json != '"'; json++) {
+        if ((unsigned char)*json < ' ') { return false; }
+        if (*json == '\\' && !*++json) { return false; }
+    }
+    if (*json != '"') { return false; }
+    json++;
+    return true;
+}
+
+static bool skipJsonValue(const char*& json, uint8_t depth) {
+    if (depth > 8) { return false; }
+    skipJsonWhitespace(json);
+    if (*json == '{' || *json == '[') {
+        char close = *json == '{' ? '}' : ']';
+        bool isObject = *json == '{';
+        json++;
+        skipJsonWhitespace(json);
+        if (*json == close) { json++; return true; }
+        while (true) {
+            skipJsonWhitespace(json);
+            if (isObject) {
+                if (!skipJsonString(json)) { return false; }
+                skipJsonWhitespace(json);
+                if (*json++ != ':') { return false; }
+            }
+            if (!skipJsonValue(json, depth + 1)) { return false; }
+            skipJsonWhitespace(json);
+            if (*json == ',') { json++; continue; }
+            if (*json == close) { json++; return true; }
+            return false;
+        }
+    }
+    if (*json == '"') { return skipJsonString(json); }
+    if (strncmp(json, "true", 4) == 0 || strncmp(json, "null", 4) == 0) { json += 4; return true; }
+    if (strncmp(json, "false", 5) == 0) { json += 5; return true; }
+    const char* start = json;
+    if (*json == '-') { json++; }
+    while ((*json >= '0' && *json <= '9') || *json == '.') { json++; }
+    return json > start && json[-1] != '-';
+}
+
+static bool findSpan(const char* json, const char* name, double& ts, double& dur) {
+    char key[48];
+    snprintf(key, sizeof(key), "{\"name\":\"%s\",\"ph\":\"X\"", name);
+    const char* span = strstr(json, key);
+    if (!span) { return false; }
+    const char* tsField = strstr(span, "\"ts\":");
+    const char* durField = strstr(span, "\"dur\":");
+    return tsField && durField && sscanf(tsField, "\"ts\":%lf", &ts) == 1 && sscanf(durField, "\"dur\":%lf", &dur) == 1;
+}
+
+// Test cases -----------------------------------------------------------
+static bool checkWraparound() {
+    static const char* SPAN_NAME = "unit_wrap";
+    uint8_t core = uint8_t(xPortGetCoreID());
+    uint32_t begin = TraceManager::getWritePosition(core);
+    uint32_t spanCount = TRACE_RING_SIZE + WRAPAROUND_EXTRA_SPANS;
+    for (uint32_t i = 0; i < spanCount; i++) { TraceManager::record(SPAN_NAME, i * 10, i * 10 + i); }
+
+    uint32_t end = TraceManager::getWritePosition(core);
+    if (end - begin != spanCount) {
+        UNIT_PRINT("Write position: %lu instead of %lu", (unsigned long)(end - begin), (unsigned long)spanCount);
+        return false;
+    }
+    // The oldest spans are overwritten, the last TRACE_RING_SIZE are kept in order
+    TraceSpanRecord record;
+    if (TraceManager::readSpan(core, end - TRACE_RING_SIZE - 1, record)) {
+        UNIT_PRINT("An overwritten span is still readable...");
+        return false;
+    }
+    for (uint32_t position = end - TRACE_RING_SIZE; position < end; position++) {
+        uint32_t i = position - begin;
+        if (!TraceManager::readSpan(core, position, record) || record.name != SPAN_NAME ||
+            record.startTicks != i * 10 || record.durationTicks != i) {
+            UNIT_PRINT("Invalid span at position %lu", (unsigned long)position);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool checkExport() {
+    static ExportCapture capture;
+    TraceManager::deinit(); // Empty rings
+    TraceManager::init();
+    TraceManager* traceManager = TraceManager::getInstance();
+    if (!traceManager) { return false; }
+
+    {
+        TraceSpan outer("unit_outer");
+        busyWait(OUTER_SPAN_US - INNER_SPAN_US);
+        {
+            TraceSpan inner("unit_inner");
+            busyWait(INNER_SPAN_US);
+        }
+    }
+
+    capture.length = 0;
+    capture.isOverflowed = false;
+    capture.data[0] = '\0';
+    uint32_t spanCount = traceManager->exportChromeTrace(captureExport, &capture);
+    if (capture.isOverflowed || spanCount != 2) {
+        UNIT_PRINT("Export: %lu spans, %u bytes%s", (unsigned long)spanCount, (unsigned)capture.length, capture.isOverflowed ? " (overflow)" : "");
+        return false;
+    }
+
+    const char* json = capture.data;
+    if (!skipJsonValue(json, 0)) {
+        UNIT_PRINT("Invalid JSON at byte %u", (unsigned)(json - capture.data));
+        return false;
+    }
+    skipJsonWhitespace(json);
+    if (*json || !strstr(capture.data, "\"traceEvents\":[")) {
+        UNIT_PRINT("Not a Chrome trace...");
+        return false;
+    }
+
+    // The inner span is inside the outer one (0.001 us rounding), the durations are measured
+    double outerTs, outerDur, innerTs, innerDur;
+    if (!findSpan(capture.data, "unit_outer", outerTs, outerDur) || !findSpan(capture.data, "unit_inner", innerTs, innerDur)) {
+        UNIT_PRINT("Missing span...");
+        return false;
+    }
+    UNIT_PRINT("Outer: %.3f us + %.3f us, inner: %.3f us + %.3f us", outerTs, outerDur, innerTs, innerDur);
+    if (outerTs != 0.0 || innerTs < outerTs || innerTs + innerDur > outerTs + outerDur + 0.002 ||
+        outerDur < OUTER_SPAN_US || innerDur < INNER_SPAN_US) {
+        UNIT_PRINT("Invalid span times...");
+        return false;
+    }
+    return true;
+}
+
+static bool checkOverhead() {
+    int64_t startUs = Hal::Timer::getTimeUs();
+    for (uint32_t i = 0; i < OVERHEAD_ITERATIONS; i++) {
+        TraceSpan span("unit_overhead");
+    }
+    int64_t overheadNs = (Hal::Timer::getTimeUs() - startUs) * 1000 / OVERHEAD_ITERATIONS;
+    UNIT_PRINT("Span cost: %ld ns", (long)overheadNs);
+    return overheadNs <= OVERHEAD_MAX_NS;
+}
+
+/**
+ * @brief Unit test for the trace manager
+ *
+ * @param isLoop
+ *
+ * @note Test cases:
+ * ring wraparound (the last TRACE_RING_SIZE spans are kept in order, the overwritten ones are not readable),
+ * Chrome trace export (valid JSON, span count, nested span times),
+ * cost of one span
+ */
+bool UnitTests::TraceManagerUnitTest(bool isLoop) {
+    TEST_START("Trace manager");
+    do {
+        TraceManager::init();
+        if (!TraceManager::getInstance()) {
+            UNIT_PRINT("Trace manager init failed...");
+            TEST_END_FAILED("Trace manager");
+            return false;
+        }
+        bool passed = true;
+
+        UNIT_PRINT("Ring wraparound...");
+        passed = checkWraparound() && passed;
+
+        UNIT_PRINT("Chrome trace export...");
+        passed = checkExport() && passed;
+
+        UNIT_PRINT("Span cost (%d spans)...", OVERHEAD_ITERATIONS);
+        if (!checkOverhead()) {
+            UNIT_PRINT("The spans slow down the hot paths...");
+            passed = false;
+        }
+
+        TraceManager::deinit();
+        if (!passed) {
+            TEST_END_FAILED("Trace manager");
+            return false;
+        }
+        TEST_END_PASSED("Trace manager");
+    } while (isLoop);
+    return true;
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * File: UnitTestRunner.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "UnitTests.h"
+
+#ifdef UNIT_TESTS
+
+// Suites -------------------------------------------------------------------------------------------------------
+const UnitTestSuite UnitTests::SUITES[] = {
+    { "Camera",         CameraManagerUnitTest,      UNIT_SUITE_AUTOMATED },
+    { "Led",            LedManagerUnitTest,         UNIT_SUITE_AUTOMATED },
+    { "Log",            LogManagerUnitTest,         UNIT_SUITE_AUTOMATED },
+    { "Mode",           ModeManagerUnitTest,        UNIT_SUITE_AUTOMATED },
+    { "Motor",          MotorManagerUnitTest,       UNIT_SUITE_AUTOMATED },
+    { "Resource",       ResourceManagerUnitTest,    UNIT_SUITE_AUTOMATED },
+    { "Server",         ServerManagerUnitTest,      UNIT_SUITE_AUTOMATED },
+    { "SettingsJson",   SettingsJsonUnitTest,       UNIT_SUITE_AUTOMATED },
+    { "Storage",        StorageManagerUnitTest,     UNIT_SUITE_AUTOMATED },
+    { "Telemetry",      TelemetryManagerUnitTest,   UNIT_SUITE_AUTOMATED },
+    { "Trace",          TraceManagerUnitTest,       UNIT_SUITE_AUTOMATED },
+    { "WiFiModul",      WiFiModulManagerUnitTest,   UNIT_SUITE_INTERACTIVE },    // Needs the access point of AuthAndPasswords.h
+};
+
+const uint8_t UnitTests::SUITE_COUNT = sizeof(UnitTests::SUITES) / sizeof(UnitTests::SUITES[0]);
+
+// Runner -------------------------------------------------------------------------------------------------------
+uint8_t UnitTests::runAll(uint8_t skippedFlags) {
+    uint8_t failedCount = 0;
+    uint8_t skippedCount = 0;
+    bool results[sizeof(SUITES) / sizeof(SUITES[0])];
+    int64_t startUs = Hal::Timer::getTimeUs();
+
+    for (uint8_t i = 0; i < SUITE_COUNT; i++) {
+        if (SUITES[i].flags & skippedFlags) {
+            skippedCount++;
+            continue;
+        }
+        results[i] = SUITES[i].run(false);
+        if (!results[i]) { failedCount++; }
+    }
+
+    UNIT_PRINT("\n--- Summary (%lld ms) ---", (long long)((Hal::Timer::getTimeUs() - startUs) / 1000));
+    for (uint8_t i = 0; i < SUITE_COUNT; i++) {
+        const char* result = (SUITES[i].flags & skippedFlags) ? "SKIPPED" : (results[i] ? "PASSED" : "FAILED");
+        UNIT_PRINT("%-14s %s", SUITES[i].name, result);
+    }
+    UNIT_PRINT("%d passed, %d failed, %d skipped\n", SUITE_COUNT - failedCount - skippedCount, failedCount, skippedCount);
+    return failedCount;
+}
+
+#endif
@@ -40,10 +40,11 @@
  * disconnectFromWiFi,
  * deinit
  */
-void UnitTests::WiFiModulManagerUnitTest(bool isLoop) {
+bool UnitTests::WiFiModulManagerUnitTest(bool isLoop) {
     TEST_START("WiFi Modul Manager");
     do {
         UNIT_PRINT("Init Led manager...");
+        LedManager::init();
         LedManager* ledManager = LedManager::getInstance();
         
         UNIT_PRINT("Starting LED array controls...");
@@ -91,7 +92,9 @@ void UnitTests::WiFiModulManagerUnitTest(bool isLoop) {
 
 
             TEST_END_FAILED("WiFi Modul Manager");
+            return false;
         }
     } while (isLoop);
+    return true;
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,315 @@
+/*
+ * File: VisionManager.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "VisionManager.h"
+#include "Hal.h"
+#include "LogManager.h"
+#include "MotorManager.h"
+#include "SnapshotCache.h"
+#include "TelemetryManager.h"
+#include "TraceManager.h"
+
+#define ODOMETRY_TIME_MASK      0x0FFFFFFFu     // The time of the odometry info, in ms (wraps after 74 hours)
+
+// Init vision manager --------------------------------------------------
+VisionManager::VisionManager() {
+    DEBUG_INIT_START("Vision manager");
+    lastTimestampUs = 0;
+    totalFrameUs = 0;
+    taskHandle = nullptr;
+    frames.store(0, std::memory_order_relaxed);
+    skippedFrames.store(0, std::memory_order_relaxed);
+    failures.store(0, std::memory_order_relaxed);
+    averageFrameUs.store(0, std::memory_order_relaxed);
+    maxFrameUs.store(0, std::memory_order_relaxed);
+    framesOverBudget.store(0, std::memory_order_relaxed);
+    stopHints.store(0, std::memory_order_relaxed);
+    motionMap.store(0, std::memory_order_relaxed);
+    obstacleMap.store(0, std::memory_order_relaxed);
+    lastFrameInfo.store(0, std::memory_order_relaxed);
+    odometry.store(0, std::memory_order_relaxed);
+    odometryInfo.store(0, std::memory_order_relaxed);
+    lineFrames.store(0, std::memory_order_relaxed);
+    lineMissedFrames.store(0, std::memory_order_relaxed);
+    lineInfo.store(0, std::memory_order_relaxed);
+    lineCommand.store(0, std::memory_order_relaxed);
+    isLineFound.store(false, std::memory_order_relaxed);
+    isTaskEnabled = pipeline.isAllocated();
+    isTaskRunning = isTaskEnabled.load();
+    if (!isTaskEnabled) {
+        LOG_E(CAMERA, "Vision buffers could not be allocated");
+    } else if (xTaskCreatePinnedToCore(&taskVision, "VISION", VISION_STACK_SIZE, this, VISION_PRIORITY, &taskHandle,
+                                       VISION_CORE) != pdPASS) {
+        LOG_E(CAMERA, "Vision task could not be created");
+        isTaskEnabled = false;
+        isTaskRunning = false;
+    }
+    DEBUG_INIT_END("Vision manager");
+}
+
+// Stats ----------------------------------------------------------------
+VisionStats VisionManager::getStats() {
+    uint32_t frameInfo = lastFrameInfo.load(std::memory_order_relaxed);
+    return {
+        .isEnabled = isVisionEnabled.load(std::memory_order_relaxed),
+        .frames = frames.load(std::memory_order_relaxed),
+        .skippedFrames = skippedFrames.load(std::memory_order_relaxed),
+        .failures = failures.load(std::memory_order_relaxed),
+        .averageFrameUs = averageFrameUs.load(std::memory_order_relaxed),
+        .maxFrameUs = maxFrameUs.load(std::memory_order_relaxed),
+        .framesOverBudget = framesOverBudget.load(std::memory_order_relaxed),
+        .stopHints = stopHints.load(std::memory_order_relaxed),
+        .motionMap = motionMap.load(std::memory_order_relaxed),
+        .obstacleMap = obstacleMap.load(std::memory_order_relaxed),
+        .motionPermille = uint16_t(frameInfo & 0xFFFF),
+        .nearObstacleCells = uint8_t((frameInfo >> 16) & 0xFF),
+        .isStopHint = ((frameInfo >> 24) & 1) != 0,
+        .flowBlocks = uint8_t((frameInfo >> 25) & 0x0F),
+    };
+}
+
+VisionOdometry VisionManager::getOdometry() {
+    uint32_t info = odometryInfo.load(std::memory_order_relaxed);
+    uint32_t speeds = odometry.load(std::memory_order_relaxed);
+    uint32_t ageMs = (uint32_t(Hal::Timer::getTimeUs() / 1000) - info) & ODOMETRY_TIME_MASK;
+    if (info == 0 || ageMs > VISION_ODOMETRY_MAX_AGE_MS) { return { 0, 0, 0, ageMs }; }
+    return {
+        .forwardMmPerS = int16_t(uint16_t(speeds)),
+        .yawRateDeciDegPerS = int16_t(uint16_t(speeds >> 16)),
+        .flowBlocks = uint8_t(info >> 28),
+        .ageMs = ageMs,
+    };
+}
+
+LineFollowStats VisionManager::getLineFollowStats() {
+    uint32_t info = lineInfo.load(std::memory_order_relaxed);
+    uint32_t command = lineCommand.load(std::memory_order_relaxed);
+    return {
+        .isEnabled = isLineFollowEnabled.load(std::memory_order_relaxed),
+        .isFound = isLineFound.load(std::memory_order_relaxed),
+        .speed = lineFollowSpeed.load(std::memory_order_relaxed),
+        .offsetMm = int16_t(uint16_t(info)),
+        .angleDeciDeg = int16_t(uint16_t(info >> 16)),
+        .forward = int16_t(uint16_t(command)),
+        .steering = int16_t(uint16_t(command >> 16)),
+        .frames = lineFrames.load(std::memory_order_relaxed),
+        .missedFrames = lineMissedFrames.load(std::memory_order_relaxed),
+    };
+}
+
+// Vision task ----------------------------------------------------------
+void VisionManager::processFrame() {
+    SnapshotCache* snapshotCache = SnapshotCache::getInstance();
+    if (!snapshotCache) {
+        followLine(nullptr);
+        return;
+    }
+    TRACE_SPAN("vision_frame");
+    const bool isFollowing = isLineFollowEnabled.load();
+    const SnapshotFrame* frame = nullptr;
+    if (snapshotCache->acquire(isFollowing ? VISION_LINE_FRAME_MAX_AGE_MS : VISION_FRAME_MAX_AGE_MS, frame) != ESP_OK) {
+        failures.fetch_add(1, std::memory_order_relaxed);
+        followLine(nullptr);
+        return;
+    }
+    const uint16_t width = frame->width >> VISION_SCALE_SHIFT;
+    const uint16_t height = frame->height >> VISION_SCALE_SHIFT;
+    if (frame->timestampUs == lastTimestampUs || !VisionPipeline::isSupported(width, height)) {
+        snapshotCache->release(frame);
+        skippedFrames.fetch_add(1, std::memory_order_relaxed);
+        if (frame->timestampUs != lastTimestampUs) { followLine(nullptr); } // The same frame: the last command holds
+        return;
+    }
+    // The flow is measured over the capture interval (0: no previous frame)
+    int64_t intervalUs = lastTimestampUs ? frame->timestampUs - lastTimestampUs : 0;
+    lastTimestampUs = frame->timestampUs;
+
+    // The budget is the work of this stage, the capture is shared with the streams and the snapshots
+    int64_t startUs = Hal::Timer::getTimeUs();
+    bool isDecoded;
+    {
+        TRACE_SPAN("vision_decode");
+        isDecoded = Hal::Camera::decodeJpegGray8(frame->data, frame->length, frame->width, frame->height,
+                                                 pipeline.getInputBuffer());
+    }
+    snapshotCache->release(frame);
+    if (!isDecoded) {
+        failures.fetch_add(1, std::memory_order_relaxed);
+        followLine(nullptr);
+        return;
+    }
+    // Before the pipeline, it takes the input buffer as the previous frame
+    LineObservation observation = {};
+    if (isFollowing) {
+        TRACE_SPAN("vision_line");
+        LineFollower::detect(pipeline.getInputBuffer(), width, height, observation);
+        followLine(&observation);
+    }
+    pipeline.setIgnoredCells(observation.cells);
+    VisionResult result;
+    {
+        TRACE_SPAN("vision_kernels");
+        pipeline.process(width, height, intervalUs > 0 && intervalUs <= UINT32_MAX ? uint32_t(intervalUs) : 0, result);
+    }
+    uint32_t frameUs = uint32_t(Hal::Timer::getTimeUs() - startUs);
+
+    uint32_t processed = frames.load(std::memory_order_relaxed) + 1;
+    totalFrameUs += frameUs;
+    frames.store(processed, std::memory_order_relaxed);
+    averageFrameUs.store(uint32_t(totalFrameUs / processed), std::memory_order_relaxed);
+    if (frameUs > maxFrameUs.load(std::memory_order_relaxed)) { maxFrameUs.store(frameUs, std::memory_order_relaxed); }
+    if (frameUs > VISION_FRAME_BUDGET_US) { framesOverBudget.fetch_add(1, std::memory_order_relaxed); }
+    motionMap.store(result.motionMap, std::memory_order_relaxed);
+    obstacleMap.store(result.obstacleMap, std::memory_order_relaxed);
+    bool wasStopHint = ((lastFrameInfo.load(std::memory_order_relaxed) >> 24) & 1) != 0;
+    lastFrameInfo.store(uint32_t(result.motionPermille) | (uint32_t(result.nearObstacleCells) << 16) |
+                        (uint32_t(result.isStopHint) << 24) | (uint32_t(result.flowBlocks) << 25), std::memory_order_relaxed);
+    if (result.flowBlocks) {
+        odometry.store(uint32_t(uint16_t(result.forwardMmPerS)) | (uint32_t(uint16_t(result.yawRateDeciDegPerS)) << 16),
+                       std::memory_order_relaxed);
+        uint32_t nowMs = uint32_t(Hal::Timer::getTimeUs() / 1000) & ODOMETRY_TIME_MASK;
+        odometryInfo.store((nowMs ? nowMs : 1) | (uint32_t(result.flowBlocks) << 28), std::memory_order_relaxed);
+    }
+
+    if (result.isStopHint) {
+        MotorManager::setStopHint(VISION_STOP_HOLD_MS);
+        stopHints.fetch_add(1, std::memory_order_relaxed);
+        if (!wasStopHint) { LOG_I(CAMERA, "Obstacle ahead (%u near cells), forward moves stopped", unsigned(result.nearObstacleCells)); }
+    }
+}
+
+void VisionManager::followLine(const LineObservation* observation) {
+    if (!isLineFollowEnabled.load()) { return; } // Checked while processing: setLineFollow() waits for the frame
+    if (isLineFollowRestarted.exchange(false)) { lineFollower.reset(); }
+    const bool wasLost = lineFollower.isLost();
+    const LineObservation missed = {};
+    lineFollower.setSpeed(lineFollowSpeed.load(std::memory_order_relaxed));
+    ControlData command = lineFollower.steer(observation ? *observation : missed);
+    MotorManager::getInstance()->setControlData(command.X, command.Y, command.L, command.R);
+    TelemetryManager::recordControlData();
+
+    lineFrames.fetch_add(1, std::memory_order_relaxed);
+    isLineFound.store(observation && observation->isFound, std::memory_order_relaxed);
+    if (observation && observation->isFound) {
+        lineInfo.store(uint32_t(uint16_t(observation->offsetMm)) | (uint32_t(uint16_t(observation->angleDeciDeg)) << 16),
+                       std::memory_order_relaxed);
+    } else {
+        lineMissedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+    lineCommand.store(uint32_t(uint16_t(command.Y)) | (uint32_t(uint16_t(int16_t(command.R - command.L))) << 16),
+                      std::memory_order_relaxed);
+    if (!wasLost && lineFollower.isLost()) { LOG_W(CAMERA, "Line lost for %u frames, stopped", unsigned(LINE_LOST_FRAMES + 1)); }
+}
+
+void VisionManager::taskVision(void *pvParameters) {
+    VisionManager* visionManager = static_cast<VisionManager*>(pvParameters);
+    bool wasActive = false;
+
+    while (visionManager->isTaskEnabled) {
+        // Notified by the destructor
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(isLineFollowEnabled.load() ? VISION_LINE_PERIOD_MS : VISION_PERIOD_MS));
+        if (!visionManager->isTaskEnabled) { break; }
+        // Nothing to stop while the motors are off: no capture, the streams keep the camera
+        bool isActive = isVisionEnabled.load(std::memory_order_relaxed) && MotorManager::isMotorControlRunning();
+        if (isActive) {
+            isProcessing = true;
+            if (!isPaused) { visionManager->processFrame(); }
+            else { visionManager->followLine(nullptr); } // No frames: stop after LINE_LOST_FRAMES
+            isProcessing = false;
+        } else if (wasActive) {
+            visionManager->pipeline.reset(); // The next frame is not compared to a stale one
+            visionManager->lastTimestampUs = 0;
+            // The motor controls stopped (a mode change): they do not start following again by themselves
+            if (isLineFollowEnabled.exchange(false)) { LOG_I(CAMERA, "Line follow stopped with the motor controls"); }
+        }
+        wasActive = isActive;
+    }
+
+    visionManager->isTaskRunning = false;
+    DEBUG_PRINT("Vision task ended");
+    vTaskDelete(NULL);
+}
+
+void VisionManager::setEnabled(bool isEnabled) {
+    if (!isEnabled) { setLineFollow(false); }
+    isVisionEnabled.store(isEnabled, std::memory_order_relaxed);
+    if (!isEnabled) { MotorManager::clearStopHint(); }
+}
+
+void VisionManager::waitForFrameEnd() {
+    for (uint16_t waitedMs = 0; isProcessing && waitedMs < VISION_STOP_TIMEOUT_MS; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (isProcessing) { DEBUG_PRINT("Vision frame did not end in time"); }
+}
+
+esp_err_t VisionManager::setLineFollow(bool isEnabled, uint8_t speed) {
+    if (isEnabled) {
+        if (speed < LINE_MIN_SPEED || speed > LINE_MAX_SPEED) { return ESP_ERR_INVALID_ARG; }
+        if (!instance || !instance->isTaskRunning || !isVisionEnabled.load() || !MotorManager::isMotorControlRunning()) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        lineFollowSpeed.store(speed, std::memory_order_relaxed);
+        if (!isLineFollowEnabled.exchange(true)) {
+            isLineFollowRestarted = true;
+            LOG_I(CAMERA, "Line follow started at %u%%", unsigned(speed));
+        }
+        return ESP_OK;
+    }
+    if (!isLineFollowEnabled.exchange(false)) { return ESP_OK; }
+    waitForFrameEnd(); // The task checks the flag before it sends, nothing is sent after this
+    if (MotorManager::isMotorControlRunning()) { MotorManager::getInstance()->setControlData(0, 0, 0, 0); }
+    LOG_I(CAMERA, "Line follow stopped");
+    return ESP_OK;
+}
+
+void VisionManager::pause() {
+    isPaused = true;
+    waitForFrameEnd();
+}
+
+void VisionManager::resume() {
+    isPaused = false;
+}
+
+// Deinit vision manager ------------------------------------------------
+VisionManager::~VisionManager() {
+    DEBUG_DEINIT_START("Vision manager");
+    isTaskEnabled = false;
+    if (taskHandle) { xTaskNotifyGive(taskHandle); }
+    for (uint16_t waitedMs = 0; isTaskRunning && waitedMs < VISION_STOP_TIMEOUT_MS; waitedMs += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (isTaskRunning) { DEBUG_PRINT("Vision task did not stop in time"); }
+    DEBUG_DEINIT_END("Vision manager");
+}
+
+// Singleton ------------------------------------------------------------
+VisionManager* VisionManager::instance = nullptr;
+
+void VisionManager::init() {
+    if (instance == nullptr) {
+        instance = new VisionManager();
+        return;
+    }
+    DEBUG_INIT_NO_NEED("Vision manager");
+}
+
+void VisionManager::deinit() {
+    if (instance) {
+        delete instance;
+        instance = nullptr;
+        return;
+    }
+    DEBUG_DEINIT_NO_NEED("Vision manager");
+}
@@ -0,0 +1,271 @@
+/*
+ * File: VisionPipeline.cpp
+ * Project: drone_r6_fw
+ * File Created: Monday, 10th March 2025 7:31:05 pm
+ * Author: MZoltan (zoltan.matus.smm@gmail.com)
+ * 
+ * Last Modified: Monday, 10th March 2025 7:31:05 pm
+ * Version: 0.1.0 (ALPHA)
+ * 
+ * Copyright (c) 2025 MZoltan
+ * License: MIT License
+ */
+
+#include "VisionPipeline.h"
+
+// C++
+#include <utility>
+
+// C
+extern "C" {
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+}
+
+#define LANES_LOW               0x00FF00FFu     // Pixels 0 and 2 of a word (after >> 8: 1 and 3)
+#define LANES_CARRY             0x01000100u     // Bit 8 of both 16 bit halves
+#define LANES_ONE               0x00010001u
+#define LANE_BLOCK_WORDS        128             // 2 x 255 per word and lane: the 16 bit lane sums do not overflow
+
+#define FLOW_SEARCH_COLUMNS     (2 * VISION_FLOW_SEARCH_X + 1)
+#define FLOW_SEARCH_ROWS        (2 * VISION_FLOW_SEARCH_Y + 1)
+#define RADIANS_TO_DECIDEGREES  572.957795f
+
+// Kernels ------------------------------------------------------------------------------------------------------
+static inline uint32_t loadWord(const uint8_t* data) {
+    uint32_t word;
+    memcpy(&word, data, sizeof(word)); // The rows of a cell are not aligned
+    return word;
+}
+
+/**
+ * @brief |a - b| of the two 8 bit lanes (bits 0-7 and 16-23). 256 + a - b is positive in every lane, bit 8 is set
+ * where a >= b.
+ */
+static inline uint32_t absoluteDifferences(uint32_t a, uint32_t b) {
+    uint32_t aMinusB = (a | LANES_CARRY) - b;
+    uint32_t bMinusA = (b | LANES_CARRY) - a;
+    uint32_t isAGreater = ((aMinusB >> 8) & LANES_ONE) * 0xFF;
+    return ((aMinusB & isAGreater) | (bMinusA & ~isAGreater)) & LANES_LOW;
+}
+
+static inline uint32_t sumLanes(uint32_t lanes) { return (lanes & 0xFFFF) + (lanes >> 16); }
+
+uint32_t VisionKernels::sumAbsoluteDifferences(const uint8_t* a, const uint8_t* b, size_t length) {
+    uint32_t sum = 0;
+    size_t i = 0;
+    size_t wordEnd = length & ~size_t(3);
+    while (i < wordEnd) {
+        size_t blockEnd = i + LANE_BLOCK_WORDS * 4 < wordEnd ? i + LANE_BLOCK_WORDS * 4 : wordEnd;
+        uint32_t lanes = 0;
+        for (; i < blockEnd; i += 4) {
+            uint32_t wordA = loadWord(a + i);
+            uint32_t wordB = loadWord(b + i);
+            lanes += absoluteDifferences(wordA & LANES_LOW, wordB & LANES_LOW);
+            lanes += absoluteDifferences((wordA >> 8) & LANES_LOW, (wordB >> 8) & LANES_LOW);
+        }
+        sum += sumLanes(lanes);
+    }
+    for (; i < length; i++) { sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]; }
+    return sum;
+}
+
+uint32_t VisionKernels::countDifferences(const uint8_t* a, const uint8_t* b, size_t length, uint8_t threshold) {
+    // |a - b| + 255 - threshold reaches bit 8 exactly if |a - b| > threshold
+    const uint32_t bias = uint32_t(0xFF - threshold) * LANES_ONE;
+    uint32_t count = 0;
+    size_t i = 0;
+    size_t wordEnd = length & ~size_t(3);
+    while (i < wordEnd) {
+        size_t blockEnd = i + LANE_BLOCK_WORDS * 4 < wordEnd ? i + LANE_BLOCK_WORDS * 4 : wordEnd;
+        uint32_t lanes = 0;
+        for (; i < blockEnd; i += 4) {
+            uint32_t wordA = loadWord(a + i);
+            uint32_t wordB = loadWord(b + i);
+            lanes += ((absoluteDifferences(wordA & LANES_LOW, wordB & LANES_LOW) + bias) >> 8) & LANES_ONE;
+            lanes += ((absoluteDifferences((wordA >> 8) & LANES_LOW, (wordB >> 8) & LANES_LOW) + bias) >> 8) & LANES_ONE;
+        }
+        count += sumLanes(lanes);
+    }
+    for (; i < length; i++) { count += (a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]) > threshold ? 1 : 0; }
+    return count;
+}
+
+
+// Optical Flow -------------------------------------------------------------------------------------------------
+// Crop centers in permille of the width and the height: left and right of the axis, on the floor at two distances
+static const uint16_t FLOW_BLOCK_CENTERS[VISION_FLOW_BLOCKS][2] = { { 250, 700 }, { 750, 700 }, { 250, 830 }, { 750, 830 } };
+
+/**
+ * @brief Minimum of the V through the costs around the best match (equal slopes, the shape of a SAD near the match;
+ * a parabola pulls to the whole pixels), in 1/16 pixels (-8 - 8).
+ */
+static int16_t subpixelOffset16(uint32_t before, uint32_t best, uint32_t after) {
+    int32_t slope = int32_t(before > after ? before : after) - int32_t(best);
+    if (slope <= 0) { return 0; }
+    return int16_t((int32_t(before) - int32_t(after)) * 8 / slope);
+}
+
+static int16_t saturateInt16(float value) {
+    if (value >= INT16_MAX) { return INT16_MAX; }
+    if (value <= INT16_MIN) { return INT16_MIN; }
+    return int16_t(value < 0 ? value - 0.5f : value + 0.5f);
+}
+
+bool VisionPipeline::matchBlock(uint16_t width, uint16_t left, uint16_t top, int16_t& shiftX16, int16_t& shiftY16) const {
+    uint32_t costs[FLOW_SEARCH_ROWS][FLOW_SEARCH_COLUMNS];
+    uint32_t bestCost = UINT32_MAX;
+    uint32_t totalCost = 0;
+    int8_t bestX = 0;
+    int8_t bestY = 0;
+    const uint8_t* block = previous + size_t(top) * width + left;
+    for (int8_t y = -VISION_FLOW_SEARCH_Y; y <= VISION_FLOW_SEARCH_Y; y++) {
+        for (int8_t x = -VISION_FLOW_SEARCH_X; x <= VISION_FLOW_SEARCH_X; x++) {
+            const uint8_t* candidate = current + (size_t(top) + y) * width + left + x;
+            uint32_t cost = 0;
+            for (uint8_t line = 0; line < VISION_FLOW_BLOCK_SIZE; line++) {
+                cost += VisionKernels::sumAbsoluteDifferences(block + line * width, candidate + line * width, VISION_FLOW_BLOCK_SIZE);
+            }
+            costs[y + VISION_FLOW_SEARCH_Y][x + VISION_FLOW_SEARCH_X] = cost;
+            totalCost += cost;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestX = x;
+                bestY = y;
+            }
+        }
+    }
+    const uint32_t pixels = VISION_FLOW_BLOCK_SIZE * VISION_FLOW_BLOCK_SIZE;
+    if (totalCost / (FLOW_SEARCH_ROWS * FLOW_SEARCH_COLUMNS) < bestCost + VISION_FLOW_MIN_CONTRAST * pixels) { return false; }
+    if (bestX == -VISION_FLOW_SEARCH_X || bestX == VISION_FLOW_SEARCH_X ||
+        bestY == -VISION_FLOW_SEARCH_Y || bestY == VISION_FLOW_SEARCH_Y) { return false; } // Maybe further out
+
+    const uint32_t* bestRow = costs[bestY + VISION_FLOW_SEARCH_Y];
+    const uint8_t column = bestX + VISION_FLOW_SEARCH_X;
+    shiftX16 = int16_t(bestX * 16 + subpixelOffset16(bestRow[column - 1], bestCost, bestRow[column + 1]));
+    shiftY16 = int16_t(bestY * 16 + subpixelOffset16(costs[bestY + VISION_FLOW_SEARCH_Y - 1][column], bestCost,
+                                                      costs[bestY + VISION_FLOW_SEARCH_Y + 1][column]));
+    return true;
+}
+
+void VisionPipeline::estimateFlow(uint16_t width, uint16_t height, uint32_t intervalUs, VisionResult& result) const {
+    const float focal = width * VISION_FOCAL_PERMILLE / 1000.0f;
+    const float horizon = height * VISION_HORIZON_PERMILLE / 1000.0f;
+    float forwardSum = 0;
+    float forwardWeights = 0;
+    float yawSum = 0;
+    for (const uint16_t* center : FLOW_BLOCK_CENTERS) {
+        int32_t left = int32_t(width) * center[0] / 1000 - VISION_FLOW_BLOCK_SIZE / 2;
+        int32_t top = int32_t(height) * center[1] / 1000 - VISION_FLOW_BLOCK_SIZE / 2;
+        if (left < VISION_FLOW_SEARCH_X || top < VISION_FLOW_SEARCH_Y ||
+            left + VISION_FLOW_BLOCK_SIZE + VISION_FLOW_SEARCH_X > width ||
+            top + VISION_FLOW_BLOCK_SIZE + VISION_FLOW_SEARCH_Y > height) { continue; } // A small thumbnail
+        const float u = left + VISION_FLOW_BLOCK_SIZE / 2.0f - width / 2.0f;    // From the optical axis
+        const float v = top + VISION_FLOW_BLOCK_SIZE / 2.0f - horizon;          // Below the horizon
+        int16_t shiftX16;
+        int16_t shiftY16;
+        if (v < VISION_FLOW_MIN_HORIZON_ROWS || !matchBlock(width, uint16_t(left), uint16_t(top), shiftX16, shiftY16)) { continue; }
+
+        // First order: a yaw (right) moves the crop by -focal * yaw horizontally and by -v * u / focal * yaw
+        // vertically, the forward move by translationY vertically and by u * translationY / v horizontally
+        const float shiftX = shiftX16 / 16.0f;
+        const float shiftY = shiftY16 / 16.0f;
+        const float yaw = (u * shiftY / v - shiftX) / focal;
+        const float translationY = shiftY + v * u * yaw / focal;
+        if (v + translationY <= 0) { continue; }
+        // The flow grows with the square of v, the match is the mean of the crop rows
+        const float rows = sqrtf(v * v + VISION_FLOW_BLOCK_SIZE * VISION_FLOW_BLOCK_SIZE / 12.0f);
+        const float forwardMm = VISION_CAMERA_HEIGHT_MM * focal * translationY / (rows * (rows + translationY));
+        const float weight = v * v; // The pixels of the forward move grow with the square of the distance from the horizon
+        forwardSum += forwardMm * weight;
+        forwardWeights += weight;
+        yawSum += yaw; // The errors of the left and the right crops cancel
+        result.flowBlocks++;
+    }
+    if (result.flowBlocks < VISION_FLOW_MIN_BLOCKS) {
+        result.flowBlocks = 0;
+        return;
+    }
+    const float perSecond = 1000000.0f / intervalUs;
+    result.forwardMmPerS = saturateInt16(forwardSum / forwardWeights * perSecond);
+    result.yawRateDeciDegPerS = saturateInt16(yawSum / result.flowBlocks * perSecond * RADIANS_TO_DECIDEGREES);
+}
+
+
+// Vision Pipeline ----------------------------------------------------------------------------------------------
+VisionPipeline::VisionPipeline() {
+    // Internal RAM: the kernels read every pixel several times, PSRAM would go through the cache
+    current = static_cast<uint8_t*>(malloc(VISION_MAX_WIDTH * VISION_MAX_HEIGHT));
+    previous = static_cast<uint8_t*>(malloc(VISION_MAX_WIDTH * VISION_MAX_HEIGHT));
+    ignoredCells = 0;
+    reset();
+}
+
+VisionPipeline::~VisionPipeline() {
+    free(current);
+    free(previous);
+}
+
+bool VisionPipeline::isSupported(uint16_t width, uint16_t height) {
+    return width <= VISION_MAX_WIDTH && height <= VISION_MAX_HEIGHT &&
+           width >= VISION_GRID_COLUMNS * VISION_MIN_CELL_SIZE && height >= VISION_GRID_ROWS * VISION_MIN_CELL_SIZE;
+}
+
+void VisionPipeline::reset() {
+    previousWidth = 0;
+    previousHeight = 0;
+    stopFrames = 0;
+}
+
+void VisionPipeline::process(uint16_t width, uint16_t height, uint32_t intervalUs, VisionResult& result) {
+    result = {};
+    if (!isAllocated() || !isSupported(width, height)) { return; }
+    const uint16_t cellWidth = width / VISION_GRID_COLUMNS;
+    const uint16_t cellHeight = height / VISION_GRID_ROWS;
+    const uint32_t cellPixels = uint32_t(cellWidth) * cellHeight;
+    const bool hasPrevious = previousWidth == width && previousHeight == height;
+    uint32_t changedPixels = 0;
+
+    for (uint8_t row = 0; row < VISION_GRID_ROWS; row++) {
+        for (uint8_t column = 0; column < VISION_GRID_COLUMNS; column++) {
+            const uint32_t bit = 1u << (row * VISION_GRID_COLUMNS + column);
+            const size_t cellStart = size_t(row) * cellHeight * width + size_t(column) * cellWidth;
+            uint32_t gradient = 0;
+            uint32_t changed = 0;
+            for (uint16_t y = 0; y < cellHeight; y++) {
+                const uint8_t* line = current + cellStart + size_t(y) * width;
+                gradient += VisionKernels::sumAbsoluteDifferences(line, line + 1, cellWidth - 1);
+                if (row * cellHeight + y + 1 < height) { gradient += VisionKernels::sumAbsoluteDifferences(line, line + width, cellWidth); }
+                if (hasPrevious) {
+                    changed += VisionKernels::countDifferences(previous + cellStart + size_t(y) * width, line, cellWidth, VISION_MOTION_THRESHOLD);
+                }
+            }
+            if (gradient >= uint32_t(VISION_EDGE_THRESHOLD) * cellPixels) { result.obstacleMap |= bit; }
+            if (changed * 1000 >= uint32_t(VISION_MOTION_CELL_PERMILLE) * cellPixels) { result.motionMap |= bit; }
+            changedPixels += changed;
+        }
+    }
+    result.motionPermille = uint16_t(changedPixels * 1000 / (cellPixels * VISION_GRID_COLUMNS * VISION_GRID_ROWS));
+
+    for (uint8_t row = VISION_NEAR_FIRST_ROW; row < VISION_GRID_ROWS; row++) {
+        for (uint8_t column = VISION_NEAR_FIRST_COLUMN; column < VISION_NEAR_FIRST_COLUMN + VISION_NEAR_COLUMNS; column++) {
+            const uint32_t bit = 1u << (row * VISION_GRID_COLUMNS + column);
+            if ((result.obstacleMap & bit) && !(ignoredCells & bit)) { result.nearObstacleCells++; }
+        }
+    }
+    if (result.nearObstacleCells >= VISION_STOP_MIN_CELLS) {
+        if (stopFrames < VISION_STOP_FRAMES) { stopFrames++; }
+    } else {
+        stopFrames = 0;
+    }
+    result.isStopHint = stopFrames >= VISION_STOP_FRAMES;
+
+    if (hasPrevious && intervalUs > 0 && intervalUs <= VISION_FLOW_MAX_INTERVAL_MS * 1000) {
+        estimateFlow(width, height, intervalUs, result);
+    }
+
+    std::swap(current, previous); // The next frame is decoded over the older one
+    previousWidth = width;
+    previousHeight = height;
+}
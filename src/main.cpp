@@ -16,13 +16,21 @@
 
 #ifndef UNIT_TESTS
 #include "CameraManager.h"
+#include "DashcamManager.h"
 #include "DistanceSensorManager.h"
+#include "FlightRecorder.h"
 #include "GyroSensorManager.h"
 #include "LedManager.h"
+#include "LogManager.h"
 #include "ModeManager.h"
 #include "MotorManager.h"
+#include "PhotoManager.h"
+#include "ResourceManager.h"
 #include "ServerManager.h"
 #include "StorageManager.h"
+#include "TelemetryManager.h"
+#include "TraceManager.h"
+#include "VisionManager.h"
 #include "WiFiModulManager.h"
 #endif
 
@@ -35,20 +43,15 @@ void cleanup();
 extern "C" void app_main(void)
 {
 #ifdef UNIT_TESTS
-    //UnitTests::CameraManagerUnitTest(false);
-    //UnitTests::DistanceSensorManagerUnitTest(false);
-    //UnitTests::GyroSensorManagerUnitTest(false);
-    //UnitTests::LedManagerUnitTest(false);
-    //UnitTests::ModeManagerUnitTest(false);
-    //UnitTests::MotorManagerUnitTest(false);
-    //UnitTestst::ServerManagerUnitTest(false);
-    //UnitTests::StorageManagerUnitTest(false);
-    UnitTests::WiFiModulManagerUnitTest(false);
+#ifdef UNIT_TESTS_INTERACTIVE
+    UnitTests::runAll(0);
+#else
+    UnitTests::runAll(UNIT_SUITE_INTERACTIVE);
+#endif
 #else
 #ifdef RESET_MEMORY_TO_DEFAULT
     StorageManager::resetMemoryToDefault();
 #else
-    // TODO: Implement the main function
     initialize();
     process();
     cleanup();
@@ -58,14 +61,54 @@ extern "C" void app_main(void)
 
 #ifndef UNIT_TESTS
 void initialize() {
-    
+    LogManager::init(); // First, the other managers log into it
+#ifdef TRACE_SPANS
+    TraceManager::init();
+#endif
+    // Storage first, the other managers are configured from the stored settings
+    StorageManager::init();
+    StorageManager* storageManager = StorageManager::getInstance();
+    storageManager->getAllDataFromStorage();
+
+    LedManager::init();
+    LedManager::getInstance()->setColor(Colors::getGadgetColor(storageManager->getColorNumber()));
+
+    TelemetryManager::init();
+    FlightRecorder::init(); // Before the Wi-Fi and the motor controls start, it records their events
+    ResourceManager::init();
+    VisionManager::init(); // Idles until the motor controls run
+    PhotoManager::init(); // The stills outlive the restarts of the camera and the video server
+    DashcamManager::init(); // Records while the motor controls run, the recording outlives the link
+
+    // The mode manager starts and stops the rest of the managers
+    ModeManager::init();
+    ModeManager::getInstance()->setMode(DroneMode::DRIVE);
 }
 
 void process() {
-    
+    ModeManager* modeManager = ModeManager::getInstance();
+    while (true) {
+        modeManager->processModeRequest();
+        if (modeManager->getMode() == DroneMode::SHUTDOWN) { break; }
+        modeManager->waitForModeRequest(MODE_PROCESS_PERIOD_MS);
+    }
 }
 
 void cleanup() {
-    
+    ModeManager::deinit(); // Stops every subsystem
+    ServerManager::deinit();
+    DashcamManager::deinit();
+    PhotoManager::deinit();
+    VisionManager::deinit();
+    ResourceManager::deinit();
+    FlightRecorder::deinit();
+    TelemetryManager::deinit();
+    MotorManager::deinit();
+    LedManager::deinit();
+    StorageManager::deinit();
+#ifdef TRACE_SPANS
+    TraceManager::deinit();
+#endif
+    LogManager::deinit();
 }
 #endif
\ No newline at end of file
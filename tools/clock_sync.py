@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+#
+# File: clock_sync.py
+# Project: drone_r6_fw
+# File Created: Tuesday, 11th March 2025 6:02:17 pm
+# Author: MZoltan (zoltan.matus.smm@gmail.com)
+#
+# Last Modified: Tuesday, 11th March 2025 6:02:17 pm
+# Version: 0.1.0 (ALPHA)
+#
+# Copyright (c) 2025 MZoltan
+# License: MIT License
+#
+
+"""
+Clock sync and round trip measurement against the command server (/syn, include/ClockSync.h).
+
+Every ping is an NTP-style exchange: this machine sends its clock (t1), the drone answers with the arrival (t2) and
+the send time (t3) on its own clock (esp_timer, us since boot), the answer arrives at t4. Then
+    offset = ((t2 - t1) + (t3 - t4)) / 2    (drone clock - this clock),    rtt = (t4 - t1) - (t3 - t2).
+The next ping carries t1 and t4 of the previous one (P, E), so the drone keeps the same estimate: the offset of the
+fastest exchange of its window, shown in the telemetry (tools/telemetry_decode.py). The offset is off by half of the
+difference of the two ways, at most rtt / 2 of the exchange it comes from.
+Every exchange is printed (or a CSV row with --csv), then the estimate and a histogram of the round trips.
+A drone time (e.g. X-Timestamp of the stream) on this clock is drone_time - offset; tools/stream_latency.py --sync
+uses it for the absolute network delay of the frames.
+
+Examples:
+    python3 tools/clock_sync.py --host 192.168.1.50
+    python3 tools/clock_sync.py --host 192.168.1.50 --count 60 --interval 1 --reset
+    python3 tools/clock_sync.py --host 192.168.1.50 --count 200 --interval 0.05 --csv > rtt.csv
+"""
+
+import argparse
+import json
+import socket
+import sys
+import time
+
+
+# Exchange ---------------------------------------------------------------------------------------
+# Keep in sync with CLOCK_SYNC_WINDOW and ClockSync::histogramBin() (include/ClockSync.h)
+WINDOW = 32
+HISTOGRAM_EDGES_MS = (1, 2, 5, 10, 20, 50, 100)
+
+
+def local_clock_us():
+    return time.time_ns() // 1000
+
+
+def measure(t1, t2, t3, t4):
+    """The four timestamps of one exchange into (offset_us, rtt_us)."""
+    return ((t2 - t1) + (t3 - t4)) // 2, (t4 - t1) - (t3 - t2)
+
+
+class ClockEstimate:
+    """The offset of the fastest exchange of the last WINDOW samples, like the drone."""
+
+    def __init__(self, window=WINDOW):
+        self.window = window
+        self.samples = []
+
+    def add(self, offset_us, rtt_us):
+        self.samples = (self.samples + [(offset_us, rtt_us)])[-self.window:]
+
+    def best(self):
+        """(offset_us, rtt_us) of the fastest sample (the newest of the equal ones), None before the first one."""
+        best = None
+        for sample in self.samples:
+            if best is None or sample[1] <= best[1]:
+                best = sample
+        return best
+
+
+def histogram_bin(time_us):
+    for index, edge in enumerate(HISTOGRAM_EDGES_MS):
+        if time_us < edge * 1000:
+            return index
+    return len(HISTOGRAM_EDGES_MS)
+
+
+def format_histogram(counts):
+    names = ["<%dms" % edge for edge in HISTOGRAM_EDGES_MS] + [">=%dms" % HISTOGRAM_EDGES_MS[-1]]
+    return "  ".join("%s %d" % (name, count) for name, count in zip(names, counts))
+
+
+# HTTP -------------------------------------------------------------------------------------------
+class SyncSession:
+    """One keep-alive connection to the command server, like the controller app."""
+
+    def __init__(self, host, port, timeout, clock=local_clock_us):
+        self.host = host
+        self.clock = clock
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buffer = b""
+        self.previous = None    # (t1, t4) of the last exchange, sent with the next ping
+
+    def close(self):
+        self.sock.close()
+
+    def read_response(self):
+        while b"\r\n\r\n" not in self.buffer:
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError("connection closed by the server")
+            self.buffer += data
+        header, self.buffer = self.buffer.split(b"\r\n\r\n", 1)
+        lines = header.decode("latin-1").split("\r\n")
+        length = 0
+        for line in lines[1:]:
+            name, _, value = line.partition(":")
+            if name.strip().lower() == "content-length":
+                length = int(value)
+        while len(self.buffer) < length:
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError("connection closed by the server")
+            self.buffer += data
+        body, self.buffer = self.buffer[:length], self.buffer[length:]
+        if " 200 " not in lines[0] + " ":
+            raise ConnectionError("unexpected response: %s" % lines[0])
+        return body
+
+    def ping(self, reset=False):
+        """One exchange. Returns the response of the drone with the local t4 and the measured offset and rtt."""
+        query = ""
+        if self.previous:
+            query += "&P=%d&E=%d" % self.previous
+        if reset:
+            query += "&R=1"
+        t1 = self.clock()
+        self.sock.sendall(("GET /syn?T=%d%s HTTP/1.1\r\nHost: %s\r\n\r\n" % (t1, query, self.host)).encode("ascii"))
+        response = json.loads(self.read_response())
+        t4 = self.clock()
+        if response["t1"] != t1:
+            raise ValueError("the response is of another ping")
+        self.previous = (t1, t4)
+        response["t4"] = t4
+        response["offset_us"], response["rtt_us"] = measure(t1, response["t2"], response["t3"], t4)
+        return response
+
+
+def sync(host, port=80, count=16, interval=0.1, timeout=5.0, clock=local_clock_us, reset=False, on_exchange=None):
+    """Ping count times (and once more to hand over the last t4). Returns the ClockEstimate of the exchanges."""
+    estimate = ClockEstimate()
+    session = SyncSession(host, port, timeout, clock)
+    try:
+        for index in range(count):
+            if index:
+                time.sleep(interval)
+            response = session.ping(reset and index == 0)
+            estimate.add(response["offset_us"], response["rtt_us"])
+            if on_exchange:
+                on_exchange(index, response)
+        session.ping()
+    finally:
+        session.close()
+    return estimate
+
+
+# Output -----------------------------------------------------------------------------------------
+def format_exchange(index, response):
+    drone = "%+.3f ms +-%.3f ms (%d)" % (response["offsetUs"] / 1000.0, response["rttUs"] / 2000.0, response["samples"]) \
+        if response["samples"] else "-"
+    return "#%-4d rtt %8.3f ms  offset %+16.3f ms  drone estimate %s" % (
+        index, response["rtt_us"] / 1000.0, response["offset_us"] / 1000.0, drone)
+
+
+CSV_FIELDS = ("t1", "t2", "t3", "t4", "rtt_us", "offset_us")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Clock sync and round trip measurement against the drone.")
+    parser.add_argument("--host", required=True, help="IP address of the drone")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--count", type=int, default=16, help="Exchanges")
+    parser.add_argument("--interval", type=float, default=0.5, help="Seconds between the exchanges")
+    parser.add_argument("--timeout", type=float, default=5.0, help="Socket timeout in seconds")
+    parser.add_argument("--reset", action="store_true", help="Drop the samples of the drone first (another clock synced it)")
+    parser.add_argument("--csv", action="store_true", help="CSV output per exchange (with a header row), the summary on stderr")
+    args = parser.parse_args()
+
+    output = sys.stderr if args.csv else sys.stdout
+    rtts = []
+
+    def on_exchange(index, response):
+        rtts.append(response["rtt_us"])
+        if args.csv:
+            print(",".join(str(response[field]) for field in CSV_FIELDS), flush=True)
+        else:
+            print(format_exchange(index, response), flush=True)
+
+    if args.csv:
+        print(",".join(CSV_FIELDS))
+    try:
+        estimate = sync(args.host, args.port, args.count, args.interval, args.timeout, reset=args.reset, on_exchange=on_exchange)
+    except KeyboardInterrupt:
+        return 0
+    except (OSError, ConnectionError, ValueError) as error:
+        print("sync error: %s" % error, file=sys.stderr)
+        return 1
+    best = estimate.best()
+    if best is None:
+        print("no exchange", file=output)
+        return 1
+    counts = [0] * (len(HISTOGRAM_EDGES_MS) + 1)
+    for rtt in rtts:
+        counts[histogram_bin(rtt)] += 1
+    ordered = sorted(rtts)
+    print("offset %+.3f ms +-%.3f ms (drone clock - this clock, drone boot at %s)" % (
+        best[0] / 1000.0, best[1] / 2000.0, time.strftime("%Y-%m-%d %H:%M:%S", time.localtime(-best[0] / 1e6))), file=output)
+    print("rtt min %.3f  p50 %.3f  max %.3f ms" % (ordered[0] / 1000.0, ordered[len(ordered) // 2] / 1000.0, ordered[-1] / 1000.0),
+          file=output)
+    print("rtt histogram: %s" % format_histogram(counts), file=output)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
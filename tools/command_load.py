@@ -0,0 +1,221 @@
+#!/usr/bin/env python3
+#
+# File: command_load.py
+# Project: drone_r6_fw
+# File Created: Tuesday, 4th March 2025 8:15:31 pm
+# Author: MZoltan (zoltan.matus.smm@gmail.com)
+#
+# Last Modified: Tuesday, 4th March 2025 8:15:31 pm
+# Version: 0.1.0 (ALPHA)
+#
+# Copyright (c) 2025 MZoltan
+# License: MIT License
+#
+
+"""
+Load generator for the command server (port 80).
+
+Every connection is a persistent (keep-alive) HTTP/1.1 session, which sends /mov requests
+at a fixed rate (like a controller app, 50 Hz by default) or as fast as possible (--rate 0).
+With --pipeline N, N requests are sent before the first response is read (a stress test of the board only: the
+server is not tested with pipelined requests).
+With --new-connection, every request opens a new TCP connection (the old controller behavior), for comparison.
+
+Reports requests/sec and the latency percentiles (from sending a request to receiving its full response).
+The host build runs the same keep-alive load over the fake server, without sockets and one request at a time per
+session (ServerManagerHostTest.MoveLoadFromKeepAliveSessions in host/test/ServerManagerHostTest.cpp).
+
+Examples:
+    python3 tools/command_load.py --host 192.168.1.50
+    python3 tools/command_load.py --host 192.168.1.50 --connections 2 --rate 0 --pipeline 4 --duration 20
+    python3 tools/command_load.py --host 192.168.1.50 --new-connection
+    python3 tools/command_load.py --host 192.168.1.50 --max-p99-ms 20 --min-rps 45   # Fails (exit code 1) if the limits are not met
+"""
+
+import argparse
+import collections
+import socket
+import sys
+import threading
+import time
+
+
+# HTTP -------------------------------------------------------------------------------------------
+def build_request(host, path):
+    return ("GET %s HTTP/1.1\r\nHost: %s\r\n\r\n" % (path, host)).encode("ascii")
+
+
+class ResponseReader:
+    """Reads HTTP/1.1 responses from a persistent connection (Content-Length bodies only, like the command server)."""
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.buffer = b""
+
+    def _fill(self):
+        data = self.sock.recv(4096)
+        if not data:
+            raise ConnectionError("connection closed by the server")
+        self.buffer += data
+
+    def read_response(self):
+        while b"\r\n\r\n" not in self.buffer:
+            self._fill()
+        header, self.buffer = self.buffer.split(b"\r\n\r\n", 1)
+        lines = header.decode("latin-1").split("\r\n")
+        status = int(lines[0].split(" ")[1])
+        content_length = 0
+        for line in lines[1:]:
+            name, _, value = line.partition(":")
+            if name.strip().lower() == "content-length":
+                content_length = int(value.strip())
+        while len(self.buffer) < content_length:
+            self._fill()
+        body, self.buffer = self.buffer[:content_length], self.buffer[content_length:]
+        return status, body
+
+
+def http_get(host, port, path, timeout):
+    with socket.create_connection((host, port), timeout=timeout) as sock:
+        sock.sendall(build_request(host, path))
+        return ResponseReader(sock).read_response()
+
+
+# Load -------------------------------------------------------------------------------------------
+class ConnectionStats:
+    def __init__(self):
+        self.latencies_ms = []
+        self.errors = 0
+        self.reconnects = 0
+
+
+def move_path(sequence):
+    # A slow sweep on the Y axis, so the requests are not identical (and the motors do something visible)
+    y = (sequence % 41) - 20
+    return "/mov?X=0&Y=%d&L=0&R=0" % y
+
+
+def run_persistent(args, stats, stop_at):
+    period = 1.0 / args.rate if args.rate > 0 else 0.0
+    sequence = 0
+    next_send = time.perf_counter()
+    while time.perf_counter() < stop_at:
+        try:
+            with socket.create_connection((args.host, args.port), timeout=args.timeout) as sock:
+                sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                reader = ResponseReader(sock)
+                in_flight = collections.deque()
+                while time.perf_counter() < stop_at:
+                    # Keep the pipeline full
+                    while len(in_flight) < args.pipeline:
+                        if period:
+                            delay = next_send - time.perf_counter()
+                            if delay > 0 and in_flight:
+                                break # Read the responses while waiting for the next tick
+                            if delay > 0:
+                                time.sleep(delay)
+                            next_send += period
+                        sock.sendall(build_request(args.host, move_path(sequence)))
+                        in_flight.append(time.perf_counter())
+                        sequence += 1
+                    status, _ = reader.read_response()
+                    sent_at = in_flight.popleft()
+                    if status == 200:
+                        stats.latencies_ms.append((time.perf_counter() - sent_at) * 1000.0)
+                    else:
+                        stats.errors += 1
+        except (OSError, ConnectionError, ValueError, IndexError):
+            stats.errors += 1
+            stats.reconnects += 1
+            time.sleep(0.1)
+
+
+def run_new_connection(args, stats, stop_at):
+    period = 1.0 / args.rate if args.rate > 0 else 0.0
+    sequence = 0
+    next_send = time.perf_counter()
+    while time.perf_counter() < stop_at:
+        if period:
+            delay = next_send - time.perf_counter()
+            if delay > 0:
+                time.sleep(delay)
+            next_send += period
+        sent_at = time.perf_counter()
+        try:
+            status, _ = http_get(args.host, args.port, move_path(sequence), args.timeout)
+            if status == 200:
+                stats.latencies_ms.append((time.perf_counter() - sent_at) * 1000.0)
+            else:
+                stats.errors += 1
+        except (OSError, ConnectionError, ValueError, IndexError):
+            stats.errors += 1
+        sequence += 1
+
+
+# Report -----------------------------------------------------------------------------------------
+def percentile(sorted_values, fraction):
+    if not sorted_values:
+        return float("nan")
+    index = min(len(sorted_values) - 1, int(round(fraction * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Load generator for the drone command server.")
+    parser.add_argument("--host", required=True, help="IP address of the drone (or the host build)")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--connections", type=int, default=1, help="Parallel persistent sessions")
+    parser.add_argument("--rate", type=float, default=50.0, help="Requests/sec per connection (0: as fast as possible)")
+    parser.add_argument("--pipeline", type=int, default=1, help="Requests sent before waiting for a response")
+    parser.add_argument("--duration", type=float, default=10.0, help="Test duration in seconds")
+    parser.add_argument("--timeout", type=float, default=2.0, help="Socket timeout in seconds")
+    parser.add_argument("--new-connection", action="store_true", help="Open a new TCP connection for every request")
+    parser.add_argument("--session-stats", action="store_true", help="Print the /sst session stats of the server at the end")
+    parser.add_argument("--max-p99-ms", type=float, default=None, help="Fail if the p99 latency is higher")
+    parser.add_argument("--min-rps", type=float, default=None, help="Fail if the throughput is lower")
+    args = parser.parse_args()
+    args.pipeline = max(1, args.pipeline)
+
+    stop_at = time.perf_counter() + args.duration
+    worker = run_new_connection if args.new_connection else run_persistent
+    all_stats = [ConnectionStats() for _ in range(args.connections)]
+    threads = [threading.Thread(target=worker, args=(args, stats, stop_at), daemon=True) for stats in all_stats]
+    started_at = time.perf_counter()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join(args.duration + args.timeout * 2)
+    elapsed = time.perf_counter() - started_at
+
+    latencies = sorted(latency for stats in all_stats for latency in stats.latencies_ms)
+    errors = sum(stats.errors for stats in all_stats)
+    reconnects = sum(stats.reconnects for stats in all_stats)
+    rps = len(latencies) / elapsed if elapsed > 0 else 0.0
+
+    print("mode:        %s" % ("new connection per request" if args.new_connection else "keep-alive, pipeline %d" % args.pipeline))
+    print("connections: %d, rate: %s" % (args.connections, ("%.1f Hz" % args.rate) if args.rate > 0 else "max"))
+    print("requests:    %d ok, %d errors, %d reconnects in %.1f s" % (len(latencies), errors, reconnects, elapsed))
+    print("throughput:  %.1f requests/sec" % rps)
+    print("latency ms:  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f" % (
+        percentile(latencies, 0.50), percentile(latencies, 0.90), percentile(latencies, 0.99),
+        latencies[-1] if latencies else float("nan")))
+
+    if args.session_stats:
+        try:
+            _, body = http_get(args.host, args.port, "/sst", args.timeout)
+            print("session stats:\n" + body.decode("ascii", "replace"))
+        except (OSError, ConnectionError, ValueError, IndexError) as error:
+            print("session stats: unavailable (%s)" % error)
+
+    failed = not latencies
+    if args.max_p99_ms is not None and percentile(latencies, 0.99) > args.max_p99_ms:
+        print("FAILED: p99 latency is above %.2f ms" % args.max_p99_ms)
+        failed = True
+    if args.min_rps is not None and rps < args.min_rps:
+        print("FAILED: throughput is below %.1f requests/sec" % args.min_rps)
+        failed = True
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+#
+# File: flight_decode.py
+# Project: drone_r6_fw
+# File Created: Monday, 10th March 2025 7:31:05 pm
+# Author: MZoltan (zoltan.matus.smm@gmail.com)
+#
+# Last Modified: Monday, 10th March 2025 7:31:05 pm
+# Version: 0.1.0 (ALPHA)
+#
+# Copyright (c) 2025 MZoltan
+# License: MIT License
+#
+
+"""
+Decoder for the flight recorder of the command server (/flt).
+
+The drone keeps the accepted control data, the duties and the timing of every motor loop, and the Wi-Fi station events
+in delta encoded blocks (FlightLogBlockHeader in include/FlightLog.h). The download is the blocks back to back, every
+record is printed as one line (or one CSV row with --csv), then a summary of the motor loop timing.
+The raw blocks can be saved with --record, and decoded later with --input (a `curl -s http://<drone>/flt > flight.bin`
+download works too). With --follow the new records are fetched every second (/flt?S=<newest block>).
+
+Examples:
+    python3 tools/flight_decode.py --host 192.168.1.50
+    python3 tools/flight_decode.py --host 192.168.1.50 --csv > flight.csv
+    python3 tools/flight_decode.py --host 192.168.1.50 --follow --type MOTOR
+    python3 tools/flight_decode.py --input flight.bin
+"""
+
+import argparse
+import struct
+import sys
+import time
+import urllib.error
+import urllib.request
+
+
+# Block ------------------------------------------------------------------------------------------
+# Keep in sync with FlightLogBlockHeader and FlightLogEncoder (include/FlightLog.h, src/FlightLog.cpp)
+BLOCK_MAGIC = 0x5246
+BLOCK_VERSION = 1
+HEADER = struct.Struct("<HBBHHIq")
+
+# FlightRecordType: name and field names
+RECORD_TYPES = {
+    1: ("CONTROL", ("x", "y", "l", "r")),
+    2: ("MOTOR", ("left_duty", "right_duty", "period_us", "busy_us")),
+    3: ("WIFI", ("event", "reason")),
+}
+
+# HalWiFiEvent (include/Hal.h)
+WIFI_EVENTS = ("STA_CONNECTED", "STA_DISCONNECTED", "STA_GOT_IP")
+
+
+class BlockError(ValueError):
+    pass
+
+
+def read_varint(data, offset, end):
+    value = 0
+    shift = 0
+    while offset < end and shift < 64:
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, offset
+        shift += 7
+    raise BlockError("truncated varint")
+
+
+def to_int32(value):
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def decode_block(data, offset=0):
+    """Decodes the block at offset. Returns the header fields, the records (type, timestamp_us, fields) and the block length."""
+    if len(data) - offset < HEADER.size:
+        raise BlockError("truncated header")
+    magic, version, _, length, record_count, sequence, base_us = HEADER.unpack_from(data, offset)
+    if magic != BLOCK_MAGIC or version != BLOCK_VERSION:
+        raise BlockError("not a block of version %d" % BLOCK_VERSION)
+    if length < HEADER.size or offset + length > len(data):
+        raise BlockError("truncated block")
+    position = offset + HEADER.size
+    end = offset + length
+    timestamp_us = base_us
+    last_fields = {}
+    records = []
+    for _ in range(record_count):
+        if position >= end:
+            raise BlockError("record count over the block length")
+        tag = data[position]
+        position += 1
+        record_type = tag & 0x0F
+        changed = tag >> 4
+        if record_type not in RECORD_TYPES or changed >> len(RECORD_TYPES[record_type][1]):
+            raise BlockError("unknown record type %d" % record_type)
+        delta_us, position = read_varint(data, position, end)
+        timestamp_us += delta_us
+        fields = last_fields.setdefault(record_type, [0] * len(RECORD_TYPES[record_type][1]))
+        for index in range(len(fields)):
+            if changed & (1 << index):
+                value, position = read_varint(data, position, end)
+                fields[index] = to_int32(fields[index] + ((value >> 1) ^ -(value & 1)))  # Zigzag, the deltas wrap around
+        records.append((record_type, timestamp_us, list(fields)))
+    if position != end:
+        raise BlockError("records over the block length")
+    return {"sequence": sequence, "base_us": base_us, "records": records}, length
+
+
+def decode_blocks(data):
+    """Decodes a download. Yields the blocks, stops at the first broken block (a truncated download)."""
+    offset = 0
+    while offset < len(data):
+        block, length = decode_block(data, offset)
+        yield block
+        offset += length
+
+
+# HTTP -------------------------------------------------------------------------------------------
+def download(host, port, first_sequence, timeout):
+    url = "http://%s:%d/flt?S=%d" % (host, port, first_sequence)
+    with urllib.request.urlopen(url, timeout=timeout) as response:
+        return response.read()
+
+
+def read_file(path):
+    with open(path, "rb") as file:
+        return file.read()
+
+
+# Output -----------------------------------------------------------------------------------------
+def format_record(record_type, timestamp_us, fields):
+    name = RECORD_TYPES[record_type][0]
+    time_text = "%11.6fs" % (timestamp_us / 1e6)
+    if name == "CONTROL":
+        return "%s CONTROL X %4d Y %4d L %3d R %3d" % ((time_text,) + tuple(fields))
+    if name == "MOTOR":
+        return "%s MOTOR   duty L %4d R %4d  period %7.2f ms  busy %5d us" % (
+            time_text, fields[0], fields[1], fields[2] / 1000.0, fields[3])
+    event = WIFI_EVENTS[fields[0]] if 0 <= fields[0] < len(WIFI_EVENTS) else str(fields[0])
+    return "%s WIFI    %s%s" % (time_text, event, " reason %d" % fields[1] if fields[1] else "")
+
+
+def format_csv(sequence, record_type, timestamp_us, fields):
+    return "%d,%d,%s,%s" % (sequence, timestamp_us, RECORD_TYPES[record_type][0], ",".join(str(field) for field in fields))
+
+
+class Summary:
+    """Counts the records and the lost blocks, and the timing of the motor loops."""
+
+    def __init__(self):
+        self.blocks = 0
+        self.lost_blocks = 0
+        self.records = {name: 0 for name, _ in RECORD_TYPES.values()}
+        self.periods_us = []
+        self.max_busy_us = 0
+        self.last_sequence = None
+
+    def add_block(self, block):
+        if self.last_sequence is not None and block["sequence"] > self.last_sequence + 1:
+            self.lost_blocks += block["sequence"] - self.last_sequence - 1
+        self.last_sequence = block["sequence"]
+        self.blocks += 1
+
+    def add_record(self, record_type, fields):
+        name = RECORD_TYPES[record_type][0]
+        self.records[name] += 1
+        if name == "MOTOR":
+            if fields[2]:
+                self.periods_us.append(fields[2])
+            self.max_busy_us = max(self.max_busy_us, fields[3])
+
+    def print(self, file):
+        print("blocks: %d, lost: %d, records: %s" % (self.blocks, self.lost_blocks,
+              ", ".join("%s %d" % item for item in self.records.items())), file=file)
+        if self.periods_us:
+            periods = sorted(self.periods_us)
+            print("motor loop period: min %.2f ms, avg %.2f ms, p99 %.2f ms, max %.2f ms; busy max %d us" % (
+                periods[0] / 1000.0, sum(periods) / len(periods) / 1000.0, periods[int(len(periods) * 0.99)] / 1000.0,
+                periods[-1] / 1000.0, self.max_busy_us), file=file)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decoder for the drone flight recorder.")
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--host", help="IP address of the drone")
+    source.add_argument("--input", help="Decode a file of raw blocks instead of a download")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--timeout", type=float, default=10.0, help="HTTP timeout in seconds")
+    parser.add_argument("--record", help="Save the raw blocks into this file")
+    parser.add_argument("--csv", action="store_true", help="CSV output (with a header row)")
+    parser.add_argument("--type", choices=[name for name, _ in RECORD_TYPES.values()], action="append",
+                        help="Print only these record types (repeatable)")
+    parser.add_argument("--follow", action="store_true", help="Fetch the new records every second (with --host)")
+    args = parser.parse_args()
+    if args.follow and (args.input or args.record):
+        parser.error("--follow needs --host, and it cannot be recorded (the newest block is downloaded again)")
+
+    summary = Summary()
+    record_file = open(args.record, "wb") if args.record else None
+    if args.csv:
+        print("sequence,timestamp_us,type,field0,field1,field2,field3")
+    printed = {}  # Records printed per block sequence (the newest block is downloaded again with --follow)
+    next_sequence = 0
+    try:
+        while True:
+            data = read_file(args.input) if args.input else download(args.host, args.port, next_sequence, args.timeout)
+            try:
+                for block in decode_blocks(data):
+                    skip = printed.get(block["sequence"], 0)
+                    if not skip:
+                        summary.add_block(block)
+                    for record_type, timestamp_us, fields in block["records"][skip:]:
+                        summary.add_record(record_type, fields)
+                        if args.type and RECORD_TYPES[record_type][0] not in args.type:
+                            continue
+                        if args.csv:
+                            print(format_csv(block["sequence"], record_type, timestamp_us, fields), flush=True)
+                        else:
+                            print(format_record(record_type, timestamp_us, fields), flush=True)
+                    printed[block["sequence"]] = len(block["records"])
+                    next_sequence = block["sequence"]
+            except BlockError as error:
+                print("broken block: %s" % error, file=sys.stderr)
+            if record_file:
+                record_file.write(data)
+            if not args.follow:
+                return 0
+            time.sleep(1.0)
+    except KeyboardInterrupt:
+        pass
+    except (OSError, urllib.error.URLError) as error:
+        print("download error: %s" % error, file=sys.stderr)
+        return 1
+    finally:
+        if record_file:
+            record_file.close()
+        summary.print(sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
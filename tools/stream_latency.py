@@ -0,0 +1,278 @@
+#!/usr/bin/env python3
+#
+# File: stream_latency.py
+# Project: drone_r6_fw
+# File Created: Monday, 10th March 2025 7:31:05 pm
+# Author: MZoltan (zoltan.matus.smm@gmail.com)
+#
+# Last Modified: Monday, 10th March 2025 7:31:05 pm
+# Version: 0.1.0 (ALPHA)
+#
+# Copyright (c) 2025 MZoltan
+# License: MIT License
+#
+
+"""
+Latency report of the MJPEG stream of the video server (/str on port 81).
+
+Every part of the stream carries the capture time (X-Timestamp), the send time (X-Send-Timestamp), both in esp_timer
+seconds since boot, and the number of the frame in the stream (X-Frame-Sequence). The report shows per frame:
+    - on-device delay: send - capture (the frame waited in a buffer, or the JPEG conversion),
+    - capture interval: the time between the captures of two received frames,
+    - network delay: receive - send, relative to the fastest frame of the run (the clocks of the drone and of this
+      machine are not synchronized, only the variation is measured), or absolute with --sync (the clocks are synced
+      with /syn of the command server first, tools/clock_sync.py, within +- half of its fastest round trip),
+    - dropped frames: gaps in the sequence (the drone took the frame from the camera and did not send it).
+A capture interval much longer than the usual one means the camera driver skipped frames (grab latest mode).
+A `curl -s http://<drone>:81/str > dump.mjpeg` capture can be decoded with --input (without the network delay).
+
+Examples:
+    python3 tools/stream_latency.py --host 192.168.1.50 --count 300
+    python3 tools/stream_latency.py --host 192.168.1.50 --count 300 --csv > latency.csv
+    python3 tools/stream_latency.py --host 192.168.1.50 --count 300 --sync
+    python3 tools/stream_latency.py --input dump.mjpeg
+"""
+
+import argparse
+import socket
+import sys
+import time
+
+import clock_sync
+
+
+# Multipart --------------------------------------------------------------------------------------
+# Keep in sync with STREAM_BOUNDARY and STREAM_PART (src/ServerManager.cpp)
+PART_BOUNDARY = b"123456789000000000000987654321"
+
+
+class PartParser:
+    """Splits the multipart/x-mixed-replace body into parts. Bytes before a boundary are skipped (resync)."""
+
+    def __init__(self, boundary=PART_BOUNDARY):
+        self.delimiter = b"--" + boundary + b"\r\n"
+        self.buffer = b""
+        self.skipped_bytes = 0
+
+    def feed(self, data):
+        self.buffer += data
+        parts = []
+        while True:
+            start = self.buffer.find(self.delimiter)
+            if start < 0:
+                keep = len(self.delimiter) + 1     # A delimiter cut in two, with the CRLF before it
+                self.skipped_bytes += max(0, len(self.buffer) - keep)
+                self.buffer = self.buffer[-keep:]
+                return parts
+            headers_end = self.buffer.find(b"\r\n\r\n", start)
+            if headers_end < 0:
+                return parts
+            headers = {}
+            for line in self.buffer[start + len(self.delimiter):headers_end].split(b"\r\n"):
+                name, _, value = line.decode("latin-1").partition(": ")
+                headers[name] = value
+            length = int(headers.get("Content-Length", "0"))
+            body_start = headers_end + 4
+            if len(self.buffer) < body_start + length:
+                return parts
+            self.skipped_bytes += start - (2 if start >= 2 and self.buffer[start - 2:start] == b"\r\n" else 0)
+            parts.append(parse_part(headers, self.buffer[body_start:body_start + length]))
+            self.buffer = self.buffer[body_start + length:]
+
+
+def parse_timestamp(value):
+    """'<seconds>.<microseconds>' to seconds, None if the header is missing."""
+    return float(value) if value else None
+
+
+def parse_part(headers, jpeg):
+    sequence = headers.get("X-Frame-Sequence")
+    return {
+        "sequence": int(sequence) if sequence is not None else None,
+        "capture": parse_timestamp(headers.get("X-Timestamp")),
+        "send": parse_timestamp(headers.get("X-Send-Timestamp")),
+        "length": len(jpeg),
+        "is_jpeg": jpeg[:2] == b"\xff\xd8",
+    }
+
+
+# HTTP -------------------------------------------------------------------------------------------
+def read_stream(host, port, timeout):
+    """Yields the body of the chunked /str response as it arrives."""
+    sock = socket.create_connection((host, port), timeout=timeout)
+    sock.sendall(("GET /str HTTP/1.1\r\nHost: %s\r\n\r\n" % host).encode("ascii"))
+    buffer = b""
+
+    def fill():
+        data = sock.recv(16384)
+        if not data:
+            raise ConnectionError("connection closed by the server")
+        return data
+
+    with sock:
+        while b"\r\n\r\n" not in buffer:
+            buffer += fill()
+        header, buffer = buffer.split(b"\r\n\r\n", 1)
+        status_line = header.split(b"\r\n", 1)[0].decode("latin-1")
+        if " 200 " not in status_line + " ":
+            raise ConnectionError("unexpected response: %s" % status_line)
+        while True:
+            while b"\r\n" not in buffer:
+                buffer += fill()
+            size_line, buffer = buffer.split(b"\r\n", 1)
+            size = int(size_line.split(b";", 1)[0], 16)
+            if size == 0:
+                return
+            while len(buffer) < size + 2:
+                buffer += fill()
+            yield buffer[:size]
+            buffer = buffer[size + 2:]
+
+
+def read_file(path):
+    with open(path, "rb") as file:
+        while True:
+            data = file.read(16384)
+            if not data:
+                return
+            yield data
+
+
+# Report -----------------------------------------------------------------------------------------
+def percentile(values, fraction):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def summarize(name, values_ms):
+    if not values_ms:
+        return "%-18s -" % name
+    return "%-18s avg %7.1f  p50 %7.1f  p95 %7.1f  max %7.1f ms" % (
+        name, sum(values_ms) / len(values_ms), percentile(values_ms, 0.5), percentile(values_ms, 0.95), max(values_ms))
+
+
+class LatencyReport:
+    def __init__(self, offset=None):
+        self.frames = []
+        self.dropped = 0
+        self.invalid = 0
+        self.min_transit = None
+        self.offset = offset    # Drone clock - the receive clock in seconds (--sync), None: relative network delays
+
+    def add(self, part, received):
+        previous = self.frames[-1] if self.frames else None
+        if previous and part["sequence"] is not None and previous["sequence"] is not None:
+            if part["sequence"] > previous["sequence"] + 1:
+                self.dropped += part["sequence"] - previous["sequence"] - 1
+        if not part["is_jpeg"]:
+            self.invalid += 1
+        part["received"] = received
+        part["device_ms"] = (part["send"] - part["capture"]) * 1000 if part["send"] is not None and part["capture"] is not None else None
+        part["interval_ms"] = (part["capture"] - previous["capture"]) * 1000 \
+            if previous and previous["capture"] is not None and part["capture"] is not None else None
+        part["transit"] = received - part["send"] if received is not None and part["send"] is not None else None
+        if part["transit"] is not None and (self.min_transit is None or part["transit"] < self.min_transit):
+            self.min_transit = part["transit"]
+        self.frames.append(part)
+        return part
+
+    def network_ms(self, part):
+        if part["transit"] is None:
+            return None
+        return (part["transit"] + self.offset) * 1000 if self.offset is not None else (part["transit"] - self.min_transit) * 1000
+
+    def print_summary(self, output):
+        frames = self.frames
+        if not frames:
+            print("no frames", file=output)
+            return
+        intervals = [frame["interval_ms"] for frame in frames if frame["interval_ms"] is not None]
+        median_interval = percentile(intervals, 0.5)
+        # Missing capture periods, without the frames the drone dropped itself (those are sequence gaps)
+        missing = sum(max(0, round(interval / median_interval) - 1) for interval in intervals) if median_interval else 0
+        skipped = max(0, missing - self.dropped)
+        duration = frames[-1]["capture"] - frames[0]["capture"] if len(frames) > 1 and frames[0]["capture"] is not None else 0
+        print("frames %d  dropped %d  skipped by the camera ~%d  invalid %d  %.1f fps  %.1f kB/frame" % (
+            len(frames), self.dropped, skipped, self.invalid, (len(frames) - 1) / duration if duration > 0 else 0,
+            sum(frame["length"] for frame in frames) / len(frames) / 1000), file=output)
+        print(summarize("on-device delay", [frame["device_ms"] for frame in frames if frame["device_ms"] is not None]), file=output)
+        print(summarize("capture interval", intervals), file=output)
+        network = [self.network_ms(frame) for frame in frames if frame["transit"] is not None]
+        print(summarize("network (synced)" if self.offset is not None else "network (relative)", network), file=output)
+
+
+def format_value(value, template):
+    return template % value if value is not None else "-"
+
+
+def format_frame(report, part):
+    return "#%-6s capture %12s  device %7s ms  interval %7s ms  network %7s ms  %7d B" % (
+        format_value(part["sequence"], "%d"), format_value(part["capture"], "%.6f"),
+        format_value(part["device_ms"], "%.1f"), format_value(part["interval_ms"], "%.1f"),
+        format_value(report.network_ms(part), "%.1f"), part["length"])
+
+
+CSV_FIELDS = ("sequence", "capture", "send", "received", "device_ms", "interval_ms", "length")
+
+
+def format_csv(part):
+    return ",".join("" if part[field] is None else ("%.6f" % part[field] if isinstance(part[field], float) else str(part[field]))
+                    for field in CSV_FIELDS)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Latency report of the drone MJPEG stream.")
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--host", help="IP address of the drone")
+    source.add_argument("--input", help="Decode a recorded stream body (curl output) instead of the live stream")
+    parser.add_argument("--port", type=int, default=81)
+    parser.add_argument("--count", type=int, default=0, help="Stop after this many frames (0: until interrupted)")
+    parser.add_argument("--timeout", type=float, default=5.0, help="Socket timeout in seconds")
+    parser.add_argument("--csv", action="store_true", help="CSV output per frame (with a header row), the summary on stderr")
+    parser.add_argument("--quiet", action="store_true", help="Only the summary")
+    parser.add_argument("--sync", action="store_true", help="Sync the clocks first (/syn), the network delays are absolute")
+    parser.add_argument("--command-port", type=int, default=80, help="Port of the command server (--sync)")
+    args = parser.parse_args()
+
+    offset = None
+    if args.sync and args.host:
+        try:
+            best = clock_sync.sync(args.host, args.command_port, timeout=args.timeout,
+                                   clock=lambda: time.monotonic_ns() // 1000).best()
+        except (OSError, ConnectionError, ValueError) as error:
+            print("sync error: %s" % error, file=sys.stderr)
+            return 1
+        offset = best[0] / 1e6
+        print("clock offset %+.3f ms +-%.3f ms" % (best[0] / 1000.0, best[1] / 2000.0), file=sys.stderr)
+    chunks = read_file(args.input) if args.input else read_stream(args.host, args.port, args.timeout)
+    part_parser = PartParser()
+    report = LatencyReport(offset)
+    if args.csv:
+        print(",".join(CSV_FIELDS))
+    try:
+        for chunk in chunks:
+            received = None if args.input else time.monotonic()
+            for part in part_parser.feed(chunk):
+                part = report.add(part, received)
+                if args.csv:
+                    print(format_csv(part), flush=True)
+                elif not args.quiet:
+                    print(format_frame(report, part), flush=True)
+                if args.count and len(report.frames) >= args.count:
+                    return 0
+    except KeyboardInterrupt:
+        pass
+    except (OSError, ConnectionError, ValueError) as error:
+        print("stream error: %s" % error, file=sys.stderr)
+        return 1
+    finally:
+        report.print_summary(sys.stderr if args.csv else sys.stdout)
+        if part_parser.skipped_bytes:
+            print("skipped bytes: %d" % part_parser.skipped_bytes, file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+#
+# File: telemetry_decode.py
+# Project: drone_r6_fw
+# File Created: Thursday, 6th March 2025 10:21:09 pm
+# Author: MZoltan (zoltan.matus.smm@gmail.com)
+#
+# Last Modified: Thursday, 6th March 2025 10:21:09 pm
+# Version: 0.1.0 (ALPHA)
+#
+# Copyright (c) 2025 MZoltan
+# License: MIT License
+#
+
+"""
+Decoder for the telemetry stream of the command server (/tlm).
+
+The drone sends binary frames (TelemetryFrame in include/TelemetryManager.h) back to back in a chunked HTTP response,
+at the rate given with /tlm?F=<Hz>. Every frame is printed as one line (or one CSV row with --csv).
+The raw frames can be saved with --record, and decoded later with --input (a `curl -s http://<drone>/tlm > dump.bin`
+capture works too).
+
+Examples:
+    python3 tools/telemetry_decode.py --host 192.168.1.50
+    python3 tools/telemetry_decode.py --host 192.168.1.50 --rate 50 --tasks
+    python3 tools/telemetry_decode.py --host 192.168.1.50 --csv --count 600 > drive.csv
+    python3 tools/telemetry_decode.py --input dump.bin
+"""
+
+import argparse
+import socket
+import struct
+import sys
+
+
+# Frame ------------------------------------------------------------------------------------------
+# Keep in sync with TelemetryFrameHeader and TelemetryTaskEntry (include/TelemetryManager.h)
+FRAME_MAGIC = 0x4D54
+FRAME_VERSION = 4
+HEADER = struct.Struct("<HBBHIIhhIHbBIIIIIIBhhBqI8s8s")
+TASK = struct.Struct("<8sHH")
+NO_CONTROL_DATA = 0xFFFFFFFF
+
+HEADER_FIELDS = (
+    "magic", "version", "task_count", "length", "sequence", "uptime_ms",
+    "left_motor_duty", "right_motor_duty", "control_data_age_ms", "camera_fps_x10", "rssi", "mode",
+    "stream_bytes_per_sec", "free_internal_heap", "min_free_internal_heap", "free_psram_heap",
+    "largest_internal_block", "largest_psram_block", "resource_alarms",
+    "forward_speed_mm_s", "yaw_rate_decideg_s", "odometry_blocks",
+    "clock_offset_us", "clock_rtt_us", "clock_rtt_histogram", "clock_offset_histogram",
+)
+HISTOGRAM_FIELDS = ("clock_rtt_histogram", "clock_offset_histogram")
+
+# RESOURCE_ALARM_* (include/ResourceManager.h)
+RESOURCE_ALARMS = ("STACK", "INTERNAL_FREE", "INTERNAL_BLOCK", "PSRAM_FREE")
+
+MODES = ("SHUTDOWN", "DRIVE", "STREAM_ONLY", "ROOM_PLANT", "LOW_POWER")
+
+
+class FrameDecoder:
+    """Splits a byte stream into frames. Bytes before a valid header are skipped (resync after a broken frame)."""
+
+    def __init__(self):
+        self.buffer = b""
+        self.skipped_bytes = 0
+
+    def feed(self, data):
+        self.buffer += data
+        frames = []
+        while len(self.buffer) >= HEADER.size:
+            header = dict(zip(HEADER_FIELDS, HEADER.unpack_from(self.buffer)))
+            expected_length = HEADER.size + header["task_count"] * TASK.size
+            if header["magic"] != FRAME_MAGIC or header["version"] != FRAME_VERSION or header["length"] != expected_length:
+                self.buffer = self.buffer[1:]
+                self.skipped_bytes += 1
+                continue
+            if len(self.buffer) < expected_length:
+                break
+            for field in HISTOGRAM_FIELDS:
+                header[field] = list(header[field])
+            tasks = []
+            for index in range(header["task_count"]):
+                name, cpu_permille, stack_free = TASK.unpack_from(self.buffer, HEADER.size + index * TASK.size)
+                tasks.append((name.split(b"\0", 1)[0].decode("ascii", "replace"), cpu_permille, stack_free))
+            header["tasks"] = tasks
+            frames.append(header)
+            self.buffer = self.buffer[expected_length:]
+        return frames
+
+
+# HTTP -------------------------------------------------------------------------------------------
+def read_stream(host, port, rate, timeout):
+    """Yields the body of the chunked /tlm response as it arrives."""
+    sock = socket.create_connection((host, port), timeout=timeout)
+    sock.sendall(("GET /tlm?F=%d HTTP/1.1\r\nHost: %s\r\n\r\n" % (rate, host)).encode("ascii"))
+    buffer = b""
+
+    def fill():
+        data = sock.recv(4096)
+        if not data:
+            raise ConnectionError("connection closed by the server")
+        return data
+
+    with sock:
+        while b"\r\n\r\n" not in buffer:
+            buffer += fill()
+        header, buffer = buffer.split(b"\r\n\r\n", 1)
+        status_line = header.split(b"\r\n", 1)[0].decode("latin-1")
+        if " 200 " not in status_line + " ":
+            raise ConnectionError("unexpected response: %s" % status_line)
+        while True:
+            while b"\r\n" not in buffer:
+                buffer += fill()
+            size_line, buffer = buffer.split(b"\r\n", 1)
+            size = int(size_line.split(b";", 1)[0], 16)
+            if size == 0:
+                return
+            while len(buffer) < size + 2:
+                buffer += fill()
+            yield buffer[:size]
+            buffer = buffer[size + 2:]
+
+
+def read_file(path):
+    with open(path, "rb") as file:
+        while True:
+            data = file.read(4096)
+            if not data:
+                return
+            yield data
+
+
+# Output -----------------------------------------------------------------------------------------
+def format_alarms(alarms):
+    return "|".join(name for bit, name in enumerate(RESOURCE_ALARMS) if alarms & (1 << bit)) or "-"
+
+
+def format_odometry(frame):
+    if not frame["odometry_blocks"]:
+        return "-"
+    return "%d mm/s %.1f deg/s (%d)" % (frame["forward_speed_mm_s"], frame["yaw_rate_decideg_s"] / 10.0, frame["odometry_blocks"])
+
+
+def format_clock_sync(frame):
+    if not sum(frame["clock_rtt_histogram"]):
+        return "-"
+    return "%+.3f ms +-%.3f ms (rtt %s)" % (frame["clock_offset_us"] / 1000.0, frame["clock_rtt_us"] / 2000.0,
+                                          "/".join(str(count) for count in frame["clock_rtt_histogram"]))
+
+
+def format_frame(frame, show_tasks):
+    age = frame["control_data_age_ms"]
+    mode = frame["mode"]
+    line = "#%-6d %9.3fs %-11s duty L %4d R %4d  ctrl age %7s  cam %5.1f fps %7.1f kB/s  rssi %4d  heap %6d (min %6d, block %6d) psram %7d (block %7d)  alarms %s  odo %s  sync %s" % (
+        frame["sequence"], frame["uptime_ms"] / 1000.0, MODES[mode] if mode < len(MODES) else str(mode),
+        frame["left_motor_duty"], frame["right_motor_duty"],
+        "-" if age == NO_CONTROL_DATA else "%dms" % age,
+        frame["camera_fps_x10"] / 10.0, frame["stream_bytes_per_sec"] / 1000.0, frame["rssi"],
+        frame["free_internal_heap"], frame["min_free_internal_heap"], frame["largest_internal_block"],
+        frame["free_psram_heap"], frame["largest_psram_block"], format_alarms(frame["resource_alarms"]),
+        format_odometry(frame), format_clock_sync(frame))
+    if show_tasks and frame["tasks"]:
+        line += "\n        " + "  ".join("%s %.1f%% (stack %d)" % (name, cpu / 10.0, stack) for name, cpu, stack in frame["tasks"])
+    return line
+
+
+CSV_FIELDS = [field for field in HEADER_FIELDS if field not in ("magic", "version", "length")]
+
+
+def format_csv(frame):
+    return ",".join("/".join(map(str, frame[field])) if field in HISTOGRAM_FIELDS else str(frame[field]) for field in CSV_FIELDS) + "," + \
+        ";".join("%s:%d:%d" % task for task in frame["tasks"])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decoder for the drone telemetry stream.")
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--host", help="IP address of the drone")
+    source.add_argument("--input", help="Decode a file of raw frames instead of the live stream")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--rate", type=int, default=10, help="Frames per second (1-50)")
+    parser.add_argument("--count", type=int, default=0, help="Stop after this many frames (0: until interrupted)")
+    parser.add_argument("--timeout", type=float, default=5.0, help="Socket timeout in seconds")
+    parser.add_argument("--record", help="Save the raw frames into this file")
+    parser.add_argument("--csv", action="store_true", help="CSV output (with a header row)")
+    parser.add_argument("--tasks", action="store_true", help="Print the CPU usage and the free stack of the tasks too")
+    args = parser.parse_args()
+
+    chunks = read_file(args.input) if args.input else read_stream(args.host, args.port, args.rate, args.timeout)
+    record = open(args.record, "wb") if args.record else None
+    decoder = FrameDecoder()
+    frames = 0
+    lost = 0
+    last_sequence = None
+    if args.csv:
+        print(",".join(CSV_FIELDS) + ",tasks")
+    try:
+        for chunk in chunks:
+            if record:
+                record.write(chunk)
+            for frame in decoder.feed(chunk):
+                if last_sequence is not None and frame["sequence"] > last_sequence + 1:
+                    lost += frame["sequence"] - last_sequence - 1
+                last_sequence = frame["sequence"]
+                print(format_csv(frame) if args.csv else format_frame(frame, args.tasks), flush=True)
+                frames += 1
+                if args.count and frames >= args.count:
+                    return 0
+    except KeyboardInterrupt:
+        pass
+    except (OSError, ConnectionError, ValueError) as error:
+        print("stream error: %s" % error, file=sys.stderr)
+        return 1
+    finally:
+        if record:
+            record.close()
+        print("frames: %d, lost: %d, skipped bytes: %d" % (frames, lost, decoder.skipped_bytes), file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())